@@ -7,6 +7,7 @@ import (
 
 	"github.com/criblio/scope/bpf"
 	"github.com/criblio/scope/daemon"
+	"github.com/criblio/scope/metrics"
 	"github.com/criblio/scope/snapshot"
 	"github.com/criblio/scope/util"
 	"github.com/rs/zerolog/log"
@@ -14,9 +15,11 @@ import (
 )
 
 /* Args Matrix (X disallows)
- *                 filedest 	sendcore
+ *                 filedest 	sendcore	shm	aggregate
  * filedest        -
  * sendcore                     -
+ * shm                                      -
+ * aggregate                                	-
  */
 
 // daemonCmd represents the daemon command
@@ -25,11 +28,24 @@ var daemonCmd = &cobra.Command{
 	Short: "Run the scope daemon",
 	Long:  `Listen and respond to system events.`,
 	Example: `scope daemon
-	scope daemon --filedest localhost:10089`,
+	scope daemon --filedest localhost:10089
+	scope daemon --filedest localhost:10089 --shm 10s
+	scope daemon --filedest localhost:10089 --aggregate /var/run/appscope/appscope.sock`,
 	Args: cobra.NoArgs,
 	Run: func(cmd *cobra.Command, args []string) {
 		filedest, _ := cmd.Flags().GetString("filedest")
 		sendcore, _ := cmd.Flags().GetBool("sendcore")
+		shm, _ := cmd.Flags().GetDuration("shm")
+		aggregate, _ := cmd.Flags().GetString("aggregate")
+		period, _ := cmd.Flags().GetDuration("period")
+
+		if shm > 0 && filedest == "" {
+			helpErrAndExit(cmd, "Must specify --filedest with --shm")
+		} else if aggregate != "" && filedest == "" {
+			helpErrAndExit(cmd, "Must specify --filedest with --aggregate")
+		} else if period <= 0 {
+			helpErrAndExit(cmd, "--period must be greater than 0")
+		}
 
 		// Create a history directory for logs
 		snapshot.CreateWorkDir("daemon")
@@ -62,9 +78,33 @@ var daemonCmd = &cobra.Command{
 			log.Error().Err(err)
 			util.ErrAndExit("scope daemon was not able to terminate ebpf loader")
 		}
+		// Metrics published to shared memory are sent on every tick
+		var shmTick <-chan time.Time
+		if shm > 0 {
+			shmTick = time.NewTicker(shm).C
+		}
+
+		// Events and metrics from scoped processes are rolled up and sent every period
+		if aggregate != "" {
+			agg := daemon.NewAggregator(aggregate, filedest, period)
+			go func() {
+				if err := agg.Run(); err != nil {
+					util.ErrAndExit("scope daemon was not able to listen on %s", aggregate)
+				}
+			}()
+		}
+
 		d := daemon.New(filedest)
 		for {
 			select {
+			case <-shmTick:
+				if err := d.Connect(); err != nil {
+					log.Error().Err(err).Msgf("error connecting to %s", filedest)
+					continue
+				}
+				d.SendShmMetrics(metrics.ShmDir)
+				d.Disconnect()
+
 			case sigEvent := <-sigDataChan:
 				// Signal received
 				log.Info().Msgf("Signal signal: %d errno: %d handler: 0x%x pid: %d nspid: %d uid: %d gid: %d app %s\n",
@@ -110,5 +150,8 @@ var daemonCmd = &cobra.Command{
 func init() {
 	daemonCmd.Flags().StringP("filedest", "f", "", "Set destination for files (host:port defaults to tcp://)")
 	daemonCmd.Flags().BoolP("sendcore", "s", false, "Include core file when sending files to network destination")
+	daemonCmd.Flags().Duration("shm", 0, "Send metrics that processes publish to shared memory at this interval, e.g. 10s (only the daemon user's, unless run as root)")
+	daemonCmd.Flags().StringP("aggregate", "a", "", "Listen on this unix socket for events and metrics from scoped processes, and send them rolled up to --filedest")
+	daemonCmd.Flags().Duration("period", 10*time.Second, "How often what --aggregate receives is sent")
 	RootCmd.AddCommand(daemonCmd)
 }
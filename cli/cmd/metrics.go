@@ -20,12 +20,13 @@ import (
 )
 
 /* Args Matrix (X disallows)
- *          id metric graph cols uniq
- * id       -
+ *          id metric graph cols uniq shm
+ * id       -                        X
  * metric      -
  * graph              -     X    X
  * cols               X     -
  * uniq               X          -
+ * shm      X                        -
  */
 
 // metricsCmd represents the metrics command
@@ -36,6 +37,7 @@ var metricsCmd = &cobra.Command{
 	Example: `  scope metrics
   scope metrics -m net.error,fs.error
   scope metrics -m net.tx -g
+  scope metrics --shm
 	`,
 	Args: cobra.NoArgs,
 	Run: func(cmd *cobra.Command, args []string) {
@@ -44,6 +46,7 @@ var metricsCmd = &cobra.Command{
 		graph, _ := cmd.Flags().GetBool("graph")
 		cols, _ := cmd.Flags().GetBool("cols")
 		uniq, _ := cmd.Flags().GetBool("uniq")
+		shm, _ := cmd.Flags().GetBool("shm")
 
 		// Disallow bad argument combinations (see Arg Matrix at top of file)
 		if graph && cols {
@@ -54,6 +57,27 @@ var metricsCmd = &cobra.Command{
 			helpErrAndExit(cmd, "Must specify metric names with --graph")
 		} else if cols && len(names) == 0 {
 			helpErrAndExit(cmd, "Must specify metric names with --cols")
+		} else if shm && id != -1 {
+			helpErrAndExit(cmd, "Cannot specify --shm and --id")
+		}
+
+		in := make(chan metrics.Metric)
+		if shm {
+			procs, err := metrics.ScrapeShm(metrics.ShmDir)
+			util.CheckErrSprintf(err, "error reading metrics from %s: %v", metrics.ShmDir, err)
+			go func() {
+				for _, p := range procs {
+					if !p.Alive {
+						continue
+					}
+					for _, m := range p.Metrics {
+						in <- m
+					}
+				}
+				close(in)
+			}()
+			displayMetrics(in, names, graph, cols, uniq)
+			return
 		}
 
 		sessions := sessionByID(id)
@@ -79,7 +103,6 @@ var metricsCmd = &cobra.Command{
 			os.Exit(0)
 		}
 
-		in := make(chan metrics.Metric)
 		// offsetChan := make(chan int)
 		filters := []util.MatchFunc{}
 		if len(names) > 0 {
@@ -97,93 +120,50 @@ var metricsCmd = &cobra.Command{
 		}()
 		util.CheckErrSprintf(err, "error reading metrics from file: %v", err)
 
-		// Filter metrics to match metrics
-		values := []float64{}
-		metricCols := []map[string]interface{}{}
-		mm := []metrics.Metric{}
-
-		for m := range in { // all metrics
-			if len(names) > 0 { // if -m is used
-				for _, name := range names {
-					if m.Name == name { // filter out metrics we arent concerned with
-						if graph {
-							values = append(values, m.Value)
-						} else if cols { // if -c is used
-							inserted := false
-							for i, column := range metricCols { // place metric value in correct place
-								if _, exists := column[m.Name]; !exists {
-									metricCols[i][m.Name] = m.Value
-									inserted = true
-									break
-								}
-							}
-							if !inserted {
-								metricCols = append(metricCols, map[string]interface{}{m.Name: m.Value})
+		displayMetrics(in, names, graph, cols, uniq)
+	},
+}
+
+// displayMetrics prints the metrics received on in
+func displayMetrics(in chan metrics.Metric, names []string, graph, cols, uniq bool) {
+	// Filter metrics to match metrics
+	values := []float64{}
+	metricCols := []map[string]interface{}{}
+	mm := []metrics.Metric{}
+
+	for m := range in { // all metrics
+		if len(names) > 0 { // if -m is used
+			for _, name := range names {
+				if m.Name == name { // filter out metrics we arent concerned with
+					if graph {
+						values = append(values, m.Value)
+					} else if cols { // if -c is used
+						inserted := false
+						for i, column := range metricCols { // place metric value in correct place
+							if _, exists := column[m.Name]; !exists {
+								metricCols[i][m.Name] = m.Value
+								inserted = true
+								break
 							}
-						} else {
-							mm = append(mm, m)
 						}
+						if !inserted {
+							metricCols = append(metricCols, map[string]interface{}{m.Name: m.Value})
+						}
+					} else {
+						mm = append(mm, m)
 					}
 				}
-			} else {
-				mm = append(mm, m)
-			}
-		}
-
-		if graph {
-			if len(values) == 0 {
-				util.ErrAndExit("Valid metric names required with --graph")
-			}
-
-			termWidth, _, err := terminal.GetSize(0)
-			if err != nil {
-				// If we cannot get the terminal size, we are dealing with redirected stdin
-				// as opposed to an actual terminal, so we will assume terminal width is
-				// 160, to show all columns.
-				termWidth = 160
-			}
-
-			q := linq.From(values)
-			max := q.Max().(float64)
-			legendSize := len(fmt.Sprintf("%.0f", max)) + 4
-			maxValues := termWidth - legendSize
-			sampleRate := int(math.Round(float64(len(values)) / float64(maxValues)))
-			if sampleRate == 0 {
-				sampleRate = 1
-			}
-
-			var newValues []float64
-			q.WhereIndexed(
-				func(idx int, _ interface{}) bool {
-					return idx%sampleRate == 0
-				},
-			).ToSlice(&newValues)
-			if maxValues > len(newValues) {
-				maxValues = len(newValues)
-			}
-			fmt.Println(asciigraph.Plot(newValues[:maxValues], asciigraph.Height(20)))
-			os.Exit(0)
-		}
-
-		if cols {
-			ofCols := []util.ObjField{}
-			for _, col := range names {
-				ofCols = append(ofCols, util.ObjField{Name: col, Field: col})
 			}
-			util.PrintObj(ofCols, metricCols)
-			os.Exit(0)
+		} else {
+			mm = append(mm, m)
 		}
+	}
 
-		if uniq {
-			linq.From(mm).DistinctBy(func(item interface{}) interface{} {
-				return item.(metrics.Metric).Name
-			}).ToSlice(&mm)
+	if graph {
+		if len(values) == 0 {
+			util.ErrAndExit("Valid metric names required with --graph")
 		}
 
-		// Goroutine to intercept stdout to perform truncation and tab replacement
-		r, w := io.Pipe()
-		util.SetOut(w)
-		scanner := bufio.NewScanner(r)
 		termWidth, _, err := terminal.GetSize(0)
 		if err != nil {
 			// If we cannot get the terminal size, we are dealing with redirected stdin
@@ -192,48 +172,96 @@ var metricsCmd = &cobra.Command{
 			termWidth = 160
 		}
 
-		var wg sync.WaitGroup
-		wg.Add(1)
-		go func() {
-			defer wg.Done()
-			first := true
-			for scanner.Scan() {
-				line := strings.ReplaceAll(scanner.Text(), "\t", "    ")
-				if first {
-					line = util.Trunc(line, termWidth)
-				} else {
-					line = util.TruncWithEllipsis(line, termWidth)
-				}
-				fmt.Printf("%s\n", line)
-				first = false
+		q := linq.From(values)
+		max := q.Max().(float64)
+		legendSize := len(fmt.Sprintf("%.0f", max)) + 4
+		maxValues := termWidth - legendSize
+		sampleRate := int(math.Round(float64(len(values)) / float64(maxValues)))
+		if sampleRate == 0 {
+			sampleRate = 1
+		}
+
+		var newValues []float64
+		q.WhereIndexed(
+			func(idx int, _ interface{}) bool {
+				return idx%sampleRate == 0
+			},
+		).ToSlice(&newValues)
+		if maxValues > len(newValues) {
+			maxValues = len(newValues)
+		}
+		fmt.Println(asciigraph.Plot(newValues[:maxValues], asciigraph.Height(20)))
+		os.Exit(0)
+	}
+
+	if cols {
+		ofCols := []util.ObjField{}
+		for _, col := range names {
+			ofCols = append(ofCols, util.ObjField{Name: col, Field: col})
+		}
+		util.PrintObj(ofCols, metricCols)
+		os.Exit(0)
+	}
+
+	if uniq {
+		linq.From(mm).DistinctBy(func(item interface{}) interface{} {
+			return item.(metrics.Metric).Name
+		}).ToSlice(&mm)
+	}
+
+	// Goroutine to intercept stdout to perform truncation and tab replacement
+	r, w := io.Pipe()
+	util.SetOut(w)
+	scanner := bufio.NewScanner(r)
+	termWidth, _, err := terminal.GetSize(0)
+	if err != nil {
+		// If we cannot get the terminal size, we are dealing with redirected stdin
+		// as opposed to an actual terminal, so we will assume terminal width is
+		// 160, to show all columns.
+		termWidth = 160
+	}
+
+	var wg sync.WaitGroup
+	wg.Add(1)
+	go func() {
+		defer wg.Done()
+		first := true
+		for scanner.Scan() {
+			line := strings.ReplaceAll(scanner.Text(), "\t", "    ")
+			if first {
+				line = util.Trunc(line, termWidth)
+			} else {
+				line = util.TruncWithEllipsis(line, termWidth)
 			}
-		}()
+			fmt.Printf("%s\n", line)
+			first = false
+		}
+	}()
 
-		util.PrintObj([]util.ObjField{
-			{Name: "Name", Field: "name"},
-			{Name: "Value", Field: "value"},
-			{Name: "Type", Field: "type"},
-			{Name: "Unit", Field: "unit"},
-			{Name: "PID", Field: "pid"},
-			{Name: "Tags", Field: "tags", Transform: func(obj interface{}) string {
-				ret := ""
-				tags := obj.([]metrics.MetricTag)
-				sort.Slice(tags, func(i, j int) bool { return tags[i].Name < tags[j].Name })
-				for _, t := range tags {
-					ret += fmt.Sprintf("%s: %s,", t.Name, t.Value)
-				}
-				if len(ret) > 0 {
-					ret = ret[:len(ret)-1]
-				}
-				return ret
-			}},
-		}, mm)
-
-		// Tell goroutine we're done then wait for it
-		// otherwise you might exit before some output is printed
-		w.Close() // Send EOF to scanner, so it ends for loop
-		wg.Wait() // Wait for wg done
-	},
+	util.PrintObj([]util.ObjField{
+		{Name: "Name", Field: "name"},
+		{Name: "Value", Field: "value"},
+		{Name: "Type", Field: "type"},
+		{Name: "Unit", Field: "unit"},
+		{Name: "PID", Field: "pid"},
+		{Name: "Tags", Field: "tags", Transform: func(obj interface{}) string {
+			ret := ""
+			tags := obj.([]metrics.MetricTag)
+			sort.Slice(tags, func(i, j int) bool { return tags[i].Name < tags[j].Name })
+			for _, t := range tags {
+				ret += fmt.Sprintf("%s: %s,", t.Name, t.Value)
+			}
+			if len(ret) > 0 {
+				ret = ret[:len(ret)-1]
+			}
+			return ret
+		}},
+	}, mm)
+
+	// Tell goroutine we're done then wait for it
+	// otherwise you might exit before some output is printed
+	w.Close() // Send EOF to scanner, so it ends for loop
+	wg.Wait() // Wait for wg done
 }
 
 func init() {
@@ -242,5 +270,6 @@ func init() {
 	metricsCmd.Flags().BoolP("graph", "g", false, "Graph this metric. Must be combined with -m")
 	metricsCmd.Flags().BoolP("cols", "c", false, "Display metrics as columns. Must be combined with -m")
 	metricsCmd.Flags().BoolP("uniq", "u", false, "Display first instance of each unique metric")
+	metricsCmd.Flags().Bool("shm", false, "Display metrics that running processes publish to shared memory (only your own, unless run as root)")
 	RootCmd.AddCommand(metricsCmd)
 }
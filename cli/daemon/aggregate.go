@@ -0,0 +1,337 @@
+package daemon
+
+import (
+	"bufio"
+	"bytes"
+	"compress/gzip"
+	"encoding/json"
+	"fmt"
+	"io"
+	"net"
+	"os"
+	"sort"
+	"strings"
+	"sync"
+	"time"
+
+	"github.com/rs/zerolog/log"
+)
+
+// Aggregator accepts the events and metrics that scoped processes on the node send to a
+// local unix socket (a libscope transport of type unix or edge, in ndjson format), and
+// forwards them upstream in gzip compressed batches, once per period.
+//
+// Metrics are rolled up by name and tags across processes: counters are summed, gauges are
+// the sum of each process's last value, and timers and histograms are averaged. http events
+// are rolled up by target into http.req and http.duration metrics. Everything else is
+// batched as it was received.
+type Aggregator struct {
+	listenPath string
+	upstream   string
+	period     time.Duration
+
+	mu      sync.Mutex
+	metrics map[string]*metricRollup
+	http    map[string]*httpRollup
+	logs    bytes.Buffer
+	dropped uint64 // lines left out of a full batch
+
+	sendMu sync.Mutex // for the connection upstream
+	conn   net.Conn
+	zw     *gzip.Writer
+}
+
+// What a batch holds before it's sent early, and before lines are dropped
+const (
+	aggBatchFlushSize = 1024 * 1024
+	aggBatchMaxSize   = 16 * 1024 * 1024
+	aggMaxLineSize    = 1024 * 1024
+)
+
+type metricRollup struct {
+	name  string
+	typ   string
+	tags  map[string]interface{}
+	sum   float64
+	count uint64
+	last  map[float64]float64 // gauges, by pid
+}
+
+type httpRollup struct {
+	tags     map[string]interface{}
+	count    uint64
+	duration float64
+	side     string // server or client
+}
+
+// NewAggregator creates an aggregator that listens on listenPath and sends to upstream (host:port)
+func NewAggregator(listenPath, upstream string, period time.Duration) *Aggregator {
+	return &Aggregator{
+		listenPath: listenPath,
+		upstream:   upstream,
+		period:     period,
+		metrics:    make(map[string]*metricRollup),
+		http:       make(map[string]*httpRollup),
+	}
+}
+
+// Run listens for scoped processes and sends what they send every period. It returns if
+// the socket can't be created.
+func (a *Aggregator) Run() error {
+	// A socket left by a daemon before us
+	os.Remove(a.listenPath)
+	l, err := net.Listen("unix", a.listenPath)
+	if err != nil {
+		log.Error().Err(err).Msgf("error listening on %s", a.listenPath)
+		return err
+	}
+	defer l.Close()
+
+	// Any scoped process may connect, whoever it runs as
+	if err := os.Chmod(a.listenPath, 0777); err != nil {
+		log.Error().Err(err).Msgf("error setting permissions of %s", a.listenPath)
+	}
+
+	go func() {
+		for {
+			c, err := l.Accept()
+			if err != nil {
+				log.Error().Err(err).Msgf("error accepting on %s", a.listenPath)
+				return
+			}
+			go a.Receive(c)
+		}
+	}()
+
+	ticker := time.NewTicker(a.period)
+	defer ticker.Stop()
+	for range ticker.C {
+		a.Flush()
+	}
+	return nil
+}
+
+// Receive reads ndjson from one process until it disconnects
+func (a *Aggregator) Receive(r io.ReadCloser) {
+	defer r.Close()
+	scanner := bufio.NewScanner(r)
+	scanner.Buffer(make([]byte, 64*1024), aggMaxLineSize)
+	for scanner.Scan() {
+		if a.Ingest(scanner.Bytes()) {
+			a.Flush()
+		}
+	}
+}
+
+// Ingest adds one line to the current batch. It returns true when the batch is big enough
+// to send without waiting for the end of the period.
+func (a *Aggregator) Ingest(line []byte) bool {
+	line = bytes.TrimSpace(line)
+	if len(line) == 0 {
+		return false
+	}
+
+	var msg map[string]interface{}
+	if json.Unmarshal(line, &msg) == nil {
+		body, _ := msg["body"].(map[string]interface{})
+		if msg["type"] == "metric" && body != nil {
+			a.addMetric(body)
+			return false
+		}
+		if _, ok := msg["_metric"]; ok {
+			a.addMetric(msg)
+			return false
+		}
+		if msg["type"] == "evt" && body != nil && body["sourcetype"] == "http" {
+			a.addHttp(body)
+		}
+	}
+
+	a.mu.Lock()
+	defer a.mu.Unlock()
+	if a.logs.Len()+len(line) >= aggBatchMaxSize {
+		a.dropped++
+		return true
+	}
+	a.logs.Write(line)
+	a.logs.WriteByte('\n')
+	return a.logs.Len() >= aggBatchFlushSize
+}
+
+// rollupKey identifies a rollup by name and the tags given, in a stable order
+func rollupKey(name string, tags map[string]interface{}) string {
+	names := make([]string, 0, len(tags))
+	for k := range tags {
+		names = append(names, k)
+	}
+	sort.Strings(names)
+
+	var b strings.Builder
+	b.WriteString(name)
+	for _, k := range names {
+		fmt.Fprintf(&b, "|%s:%v", k, tags[k])
+	}
+	return b.String()
+}
+
+func (a *Aggregator) addMetric(body map[string]interface{}) {
+	name, _ := body["_metric"].(string)
+	typ, _ := body["_metric_type"].(string)
+	value, ok := body["_value"].(float64)
+	if name == "" || !ok {
+		return
+	}
+	pid, _ := body["pid"].(float64)
+
+	// The pid and time are what a rollup spans
+	tags := make(map[string]interface{}, len(body))
+	for k, v := range body {
+		switch k {
+		case "_metric", "_metric_type", "_value", "_time", "pid":
+		default:
+			tags[k] = v
+		}
+	}
+	key := rollupKey(typ+"|"+name, tags)
+
+	a.mu.Lock()
+	defer a.mu.Unlock()
+	r, ok := a.metrics[key]
+	if !ok {
+		r = &metricRollup{name: name, typ: typ, tags: tags, last: make(map[float64]float64)}
+		a.metrics[key] = r
+	}
+	r.sum += value
+	r.count++
+	if typ == "gauge" {
+		r.last[pid] = value
+	}
+}
+
+func (a *Aggregator) addHttp(body map[string]interface{}) {
+	data, _ := body["data"].(map[string]interface{})
+	if data == nil {
+		return
+	}
+
+	tags := map[string]interface{}{
+		"proc": body["proc"],
+		"host": body["host"],
+	}
+	for _, k := range []string{"http_method", "http_target", "http_status_code"} {
+		if v, ok := data[k]; ok {
+			tags[k] = v
+		}
+	}
+	side := "server"
+	duration, ok := data["http_server_duration"].(float64)
+	if !ok {
+		duration, ok = data["http_client_duration"].(float64)
+		side = "client"
+	}
+	if !ok {
+		// A request; its response has the status and duration
+		return
+	}
+	key := rollupKey(side, tags)
+
+	a.mu.Lock()
+	defer a.mu.Unlock()
+	r, ok := a.http[key]
+	if !ok {
+		r = &httpRollup{tags: tags, side: side}
+		a.http[key] = r
+	}
+	r.count++
+	r.duration += duration
+}
+
+// writeMetric writes a metric the way libscope does in ndjson
+func writeMetric(w *bytes.Buffer, name, typ string, value float64, unit string, tags map[string]interface{}, now float64) {
+	body := make(map[string]interface{}, len(tags)+5)
+	for k, v := range tags {
+		body[k] = v
+	}
+	body["_metric"] = name
+	body["_metric_type"] = typ
+	body["_value"] = value
+	body["_time"] = now
+	if unit != "" {
+		body["unit"] = unit
+	}
+	line, err := json.Marshal(map[string]interface{}{"type": "metric", "body": body})
+	if err != nil {
+		log.Error().Err(err).Msgf("error converting %s to JSON", name)
+		return
+	}
+	w.Write(line)
+	w.WriteByte('\n')
+}
+
+// batch takes what's been received since the last one, with the rollups as metrics
+func (a *Aggregator) batch() []byte {
+	a.mu.Lock()
+	rollups, http, logs, dropped := a.metrics, a.http, a.logs, a.dropped
+	a.metrics = make(map[string]*metricRollup)
+	a.http = make(map[string]*httpRollup)
+	a.logs = bytes.Buffer{}
+	a.dropped = 0
+	a.mu.Unlock()
+
+	now := float64(time.Now().UnixNano()) / float64(time.Second)
+	for _, r := range rollups {
+		value := r.sum
+		switch r.typ {
+		case "gauge":
+			value = 0
+			for _, v := range r.last {
+				value += v
+			}
+		case "timer", "histogram":
+			value = r.sum / float64(r.count)
+		}
+		writeMetric(&logs, r.name, r.typ, value, "", r.tags, now)
+	}
+	for _, r := range http {
+		writeMetric(&logs, "http.req", "counter", float64(r.count), "request", r.tags, now)
+		writeMetric(&logs, "http.duration."+r.side, "timer", r.duration/float64(r.count), "millisecond", r.tags, now)
+	}
+	if dropped > 0 {
+		log.Warn().Msgf("%d lines dropped from a full batch", dropped)
+	}
+	return logs.Bytes()
+}
+
+// Flush sends what's been received since the last flush upstream. What can't be sent is lost.
+func (a *Aggregator) Flush() {
+	a.sendMu.Lock()
+	defer a.sendMu.Unlock()
+
+	b := a.batch()
+	if len(b) == 0 {
+		return
+	}
+
+	if a.conn == nil {
+		conn, err := net.Dial("tcp", a.upstream)
+		if err != nil {
+			log.Error().Err(err).Msgf("error connecting to %s", a.upstream)
+			return
+		}
+		a.conn = conn
+		a.zw = gzip.NewWriter(conn)
+	}
+
+	// One gzip stream per connection, flushed at the end of each batch
+	a.conn.SetWriteDeadline(time.Now().Add(5 * time.Second))
+	_, err := a.zw.Write(b)
+	if err == nil {
+		err = a.zw.Flush()
+	}
+	if err != nil {
+		log.Error().Err(err).Msgf("error writing to %s", a.upstream)
+		a.conn.Close()
+		a.conn = nil
+		a.zw = nil
+	}
+}
@@ -0,0 +1,173 @@
+package daemon
+
+import (
+	"bufio"
+	"bytes"
+	"compress/gzip"
+	"encoding/json"
+	"net"
+	"path/filepath"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+)
+
+// batchByName parses a batch into its metrics, by name, and everything else
+func batchByName(t *testing.T, b []byte) (map[string][]map[string]interface{}, []string) {
+	metrics := map[string][]map[string]interface{}{}
+	others := []string{}
+	scanner := bufio.NewScanner(bytes.NewReader(b))
+	for scanner.Scan() {
+		var msg map[string]interface{}
+		assert.NoError(t, json.Unmarshal(scanner.Bytes(), &msg))
+		if msg["type"] == "metric" {
+			body := msg["body"].(map[string]interface{})
+			name := body["_metric"].(string)
+			metrics[name] = append(metrics[name], body)
+		} else {
+			others = append(others, scanner.Text())
+		}
+	}
+	return metrics, others
+}
+
+func TestAggregatorMetricRollups(t *testing.T) {
+	a := NewAggregator("", "", time.Second)
+
+	// The same metrics from two processes
+	for _, pid := range []string{"100", "200"} {
+		a.Ingest([]byte(`{"type":"metric","body":{"_metric":"fs.read","_metric_type":"counter","_value":10,"proc":"nginx","pid":` + pid + `,"host":"h","unit":"byte","_time":1.5}}`))
+		a.Ingest([]byte(`{"type":"metric","body":{"_metric":"fs.read","_metric_type":"counter","_value":5,"proc":"nginx","pid":` + pid + `,"host":"h","unit":"byte","_time":2.5}}`))
+		a.Ingest([]byte(`{"type":"metric","body":{"_metric":"proc.fd","_metric_type":"gauge","_value":3,"proc":"nginx","pid":` + pid + `,"host":"h","_time":1.5}}`))
+		a.Ingest([]byte(`{"type":"metric","body":{"_metric":"proc.fd","_metric_type":"gauge","_value":4,"proc":"nginx","pid":` + pid + `,"host":"h","_time":2.5}}`))
+	}
+	a.Ingest([]byte(`{"_metric":"fs.duration","_metric_type":"timer","_value":10,"proc":"nginx","pid":100,"host":"h","_time":1.5}`))
+	a.Ingest([]byte(`{"_metric":"fs.duration","_metric_type":"timer","_value":20,"proc":"nginx","pid":200,"host":"h","_time":1.5}`))
+	// Different tags are a different rollup
+	a.Ingest([]byte(`{"type":"metric","body":{"_metric":"fs.read","_metric_type":"counter","_value":1,"proc":"redis","pid":300,"host":"h","unit":"byte","_time":1.5}}`))
+
+	metrics, others := batchByName(t, a.batch())
+	assert.Equal(t, 0, len(others))
+
+	assert.Equal(t, 2, len(metrics["fs.read"]))
+	for _, m := range metrics["fs.read"] {
+		assert.Equal(t, "counter", m["_metric_type"])
+		assert.Equal(t, "byte", m["unit"])
+		assert.NotContains(t, m, "pid")
+		if m["proc"] == "nginx" {
+			assert.Equal(t, float64(30), m["_value"])
+		} else {
+			assert.Equal(t, float64(1), m["_value"])
+		}
+	}
+
+	assert.Equal(t, 1, len(metrics["proc.fd"]))
+	assert.Equal(t, float64(8), metrics["proc.fd"][0]["_value"])
+
+	assert.Equal(t, 1, len(metrics["fs.duration"]))
+	assert.Equal(t, float64(15), metrics["fs.duration"][0]["_value"])
+
+	// And the next batch starts from nothing
+	assert.Equal(t, 0, len(a.batch()))
+}
+
+func TestAggregatorHttpRollups(t *testing.T) {
+	a := NewAggregator("", "", time.Second)
+
+	req := `{"type":"evt","body":{"sourcetype":"http","proc":"nginx","host":"h","data":{"http_method":"GET","http_target":"/a"}}}`
+	resp := func(target string, duration string) []byte {
+		return []byte(`{"type":"evt","body":{"sourcetype":"http","proc":"nginx","host":"h","data":{"http_method":"GET","http_target":"` + target + `","http_status_code":200,"http_server_duration":` + duration + `}}}`)
+	}
+	a.Ingest([]byte(req))
+	a.Ingest(resp("/a", "10"))
+	a.Ingest(resp("/a", "30"))
+	a.Ingest(resp("/b", "5"))
+
+	metrics, others := batchByName(t, a.batch())
+
+	// The events themselves are still sent
+	assert.Equal(t, 4, len(others))
+
+	assert.Equal(t, 2, len(metrics["http.req"]))
+	assert.Equal(t, 2, len(metrics["http.duration.server"]))
+	for _, m := range metrics["http.duration.server"] {
+		assert.Equal(t, "GET", m["http_method"])
+		assert.Equal(t, float64(200), m["http_status_code"])
+		if m["http_target"] == "/a" {
+			assert.Equal(t, float64(20), m["_value"])
+		} else {
+			assert.Equal(t, float64(5), m["_value"])
+		}
+	}
+	for _, m := range metrics["http.req"] {
+		if m["http_target"] == "/a" {
+			assert.Equal(t, float64(2), m["_value"])
+		} else {
+			assert.Equal(t, float64(1), m["_value"])
+		}
+	}
+}
+
+func TestAggregatorLogBatching(t *testing.T) {
+	a := NewAggregator("", "", time.Second)
+
+	assert.False(t, a.Ingest([]byte(`{"format":"ndjson","info":{"process":{"pid":100}}}`)))
+	assert.False(t, a.Ingest([]byte(`{"type":"evt","body":{"sourcetype":"console","data":"hello"}}`)))
+	assert.False(t, a.Ingest([]byte("not json")))
+	assert.False(t, a.Ingest([]byte("  ")))
+
+	// As they were received, blank lines aside
+	assert.Equal(t, `{"format":"ndjson","info":{"process":{"pid":100}}}`+"\n"+
+		`{"type":"evt","body":{"sourcetype":"console","data":"hello"}}`+"\n"+
+		"not json\n", string(a.batch()))
+
+	// A batch that's big enough is sent early
+	line := make([]byte, 1024)
+	for i := range line {
+		line[i] = 'x'
+	}
+	full := false
+	for i := 0; i < aggBatchFlushSize/len(line)+1 && !full; i++ {
+		full = a.Ingest(line)
+	}
+	assert.True(t, full)
+}
+
+func TestAggregatorForwardsCompressedBatches(t *testing.T) {
+	upstream, err := net.Listen("tcp", "127.0.0.1:0")
+	assert.NoError(t, err)
+	defer upstream.Close()
+
+	sock := filepath.Join(t.TempDir(), "appscope.sock")
+	a := NewAggregator(sock, upstream.Addr().String(), 50*time.Millisecond)
+	go a.Run()
+
+	// A scoped process
+	var c net.Conn
+	for i := 0; i < 100; i++ {
+		if c, err = net.Dial("unix", sock); err == nil {
+			break
+		}
+		time.Sleep(10 * time.Millisecond)
+	}
+	assert.NoError(t, err)
+	c.Write([]byte(`{"type":"metric","body":{"_metric":"fs.read","_metric_type":"counter","_value":10,"proc":"nginx","pid":1,"host":"h","_time":1.5}}` + "\n"))
+	c.Write([]byte(`{"type":"evt","body":{"sourcetype":"console","data":"hello"}}` + "\n"))
+	c.Close()
+
+	conn, err := upstream.Accept()
+	assert.NoError(t, err)
+	defer conn.Close()
+	zr, err := gzip.NewReader(conn)
+	assert.NoError(t, err)
+
+	lines := []string{}
+	scanner := bufio.NewScanner(zr)
+	for len(lines) < 2 && scanner.Scan() {
+		lines = append(lines, scanner.Text())
+	}
+	assert.Equal(t, 2, len(lines))
+	assert.Equal(t, `{"type":"evt","body":{"sourcetype":"console","data":"hello"}}`, lines[0])
+	assert.Contains(t, lines[1], `"_metric":"fs.read"`)
+}
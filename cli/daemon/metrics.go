@@ -0,0 +1,71 @@
+package daemon
+
+import (
+	"encoding/json"
+	"os"
+	"time"
+
+	"github.com/criblio/scope/metrics"
+	"github.com/rs/zerolog/log"
+)
+
+var metricTypeNames = map[metrics.MetricType]string{
+	metrics.Count:     "counter",
+	metrics.Gauge:     "gauge",
+	metrics.Timer:     "timer",
+	metrics.Histogram: "histogram",
+	metrics.Set:       "set",
+}
+
+// SendShmMetrics attempts to send the metrics every process has published in shared memory
+// to the daemon network destination, in the form libscope sends them in as ndjson.
+// The regions of processes that are gone are removed.
+func (d *Daemon) SendShmMetrics(dirPath string) error {
+	procs, err := metrics.ScrapeShm(dirPath)
+	if err != nil {
+		log.Error().Err(err).Msgf("error unable to read directory %s", dirPath)
+		return err
+	}
+
+	var msg []byte
+	for _, p := range procs {
+		if !p.Alive {
+			if err := os.Remove(p.Path); err != nil {
+				log.Error().Err(err).Msgf("error removing %s", p.Path)
+			}
+			continue
+		}
+
+		for _, m := range p.Metrics {
+			body := map[string]interface{}{
+				"_metric":      m.Name,
+				"_metric_type": metricTypeNames[m.Type],
+				"_value":       m.Value,
+				"pid":          m.Pid,
+				"unit":         m.Unit,
+				"_time":        float64(m.Time.UnixNano()) / float64(time.Second),
+			}
+			for _, t := range m.Tags {
+				body[t.Name] = t.Value
+			}
+			line, err := json.Marshal(map[string]interface{}{"type": "metric", "body": body})
+			if err != nil {
+				log.Error().Err(err).Msgf("error converting %s to JSON", m.Name)
+				continue
+			}
+			msg = append(append(msg, line...), '\n')
+		}
+	}
+	if len(msg) == 0 {
+		return nil
+	}
+
+	// Write data to daemon tcp connection
+	d.connection.SetWriteDeadline(time.Now().Add(1 * time.Second))
+	if _, err = d.connection.Write(msg); err != nil {
+		log.Error().Err(err).Msgf("error writing to %s", d.filedest)
+		return err
+	}
+
+	return nil
+}
@@ -0,0 +1,309 @@
+package events
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/binary"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"io"
+	"math"
+	"strconv"
+	"unicode/utf8"
+)
+
+// BinaryMarker is the first byte of every record in the binary event
+// format (event > format: binary). The format is described in src/evtbin.h.
+const BinaryMarker = 0xB5
+
+const binaryVersion = 1
+
+// maxRecord is far more than any event takes; a length beyond it is garbage
+const maxRecord = 64 * 1024 * 1024
+
+const (
+	tagNull   = 0x00
+	tagFalse  = 0x01
+	tagTrue   = 0x02
+	tagInt    = 0x03
+	tagDouble = 0x04
+	tagStr    = 0x05
+	tagDef    = 0x06
+	tagRef    = 0x07
+	tagObject = 0x08
+	tagArray  = 0x09
+	tagRaw    = 0x0a
+)
+
+// ErrBadRecord is returned for a record that can't be decoded. The records
+// after it can still be read.
+var ErrBadRecord = errors.New("bad binary event record")
+
+// BinaryDecoder reads the records of the binary event format and turns
+// the messages in them back into JSON text
+type BinaryDecoder struct {
+	r      *bufio.Reader
+	offset int64
+	dicts  map[uint64][]string // the string dictionary of each stream
+	rec    []byte
+	out    bytes.Buffer
+}
+
+// NewBinaryDecoder returns a decoder for the records read from r
+func NewBinaryDecoder(r io.Reader) *BinaryDecoder {
+	br, ok := r.(*bufio.Reader)
+	if !ok {
+		br = bufio.NewReader(r)
+	}
+	return &BinaryDecoder{r: br, dicts: map[uint64][]string{}}
+}
+
+// Offset returns how far into the input the decoder has read
+func (d *BinaryDecoder) Offset() int64 {
+	return d.offset
+}
+
+// Next returns the next message as JSON text, good until the next call,
+// and the offset of the record it came from. It returns io.EOF at the end
+// of the input, and ErrBadRecord for a record it can't decode.
+func (d *BinaryDecoder) Next() (int64, []byte, error) {
+	for {
+		offset := d.offset
+		rec, err := d.readRecord()
+		if err != nil {
+			return offset, nil, err
+		}
+
+		typ, stream, payload, err := recordHeader(rec)
+		if err != nil {
+			return offset, nil, err
+		}
+		switch typ {
+		case 'S':
+			if v, n := binary.Uvarint(payload); n <= 0 || v != binaryVersion {
+				return offset, nil, fmt.Errorf("%w: version %d", ErrBadRecord, v)
+			}
+			d.dicts[stream] = d.dicts[stream][:0]
+			continue
+		case 'E':
+			d.out.Reset()
+			rest, err := d.value(stream, payload)
+			if err == nil && len(rest) != 0 {
+				err = fmt.Errorf("%w: %d bytes left over", ErrBadRecord, len(rest))
+			}
+			return offset, d.out.Bytes(), err
+		case 'J':
+			return offset, payload, nil
+		default:
+			return offset, nil, fmt.Errorf("%w: type %q", ErrBadRecord, typ)
+		}
+	}
+}
+
+func (d *BinaryDecoder) readRecord() ([]byte, error) {
+	marker, err := d.r.ReadByte()
+	if err != nil {
+		return nil, err
+	}
+	if marker != BinaryMarker {
+		return nil, fmt.Errorf("not a binary event record at offset %d", d.offset)
+	}
+	length, err := binary.ReadUvarint(d.r)
+	if err != nil {
+		return nil, unexpectedEOF(err)
+	}
+	if length > maxRecord {
+		return nil, fmt.Errorf("binary event record of %d bytes at offset %d", length, d.offset)
+	}
+	if cap(d.rec) < int(length) {
+		d.rec = make([]byte, length)
+	}
+	d.rec = d.rec[:length]
+	if _, err := io.ReadFull(d.r, d.rec); err != nil {
+		return nil, unexpectedEOF(err)
+	}
+	d.offset += int64(1 + uvarintLen(length) + int(length))
+	return d.rec, nil
+}
+
+func recordHeader(rec []byte) (byte, uint64, []byte, error) {
+	if len(rec) < 2 {
+		return 0, 0, nil, fmt.Errorf("%w: too short", ErrBadRecord)
+	}
+	stream, n := binary.Uvarint(rec[1:])
+	if n <= 0 {
+		return 0, 0, nil, fmt.Errorf("%w: stream", ErrBadRecord)
+	}
+	return rec[0], stream, rec[1+n:], nil
+}
+
+// value decodes one value from b onto d.out, and returns what's after it
+func (d *BinaryDecoder) value(stream uint64, b []byte) ([]byte, error) {
+	if len(b) == 0 {
+		return nil, fmt.Errorf("%w: missing value", ErrBadRecord)
+	}
+	tag := b[0]
+	switch tag {
+	case tagNull:
+		d.out.WriteString("null")
+		return b[1:], nil
+	case tagFalse:
+		d.out.WriteString("false")
+		return b[1:], nil
+	case tagTrue:
+		d.out.WriteString("true")
+		return b[1:], nil
+	case tagInt:
+		v, n := binary.Varint(b[1:])
+		if n <= 0 {
+			return nil, fmt.Errorf("%w: int", ErrBadRecord)
+		}
+		d.out.WriteString(strconv.FormatInt(v, 10))
+		return b[1+n:], nil
+	case tagDouble:
+		if len(b) < 9 {
+			return nil, fmt.Errorf("%w: double", ErrBadRecord)
+		}
+		f := math.Float64frombits(binary.LittleEndian.Uint64(b[1:9]))
+		num, err := json.Marshal(f)
+		if err != nil {
+			return nil, fmt.Errorf("%w: %v", ErrBadRecord, err)
+		}
+		d.out.Write(num)
+		return b[9:], nil
+	case tagStr, tagDef, tagRef:
+		s, rest, err := d.str(stream, b)
+		if err != nil {
+			return nil, err
+		}
+		writeJSONString(&d.out, s)
+		return rest, nil
+	case tagRaw:
+		s, rest, err := d.str(stream, b)
+		if err != nil {
+			return nil, err
+		}
+		d.out.WriteString(s)
+		return rest, nil
+	case tagObject, tagArray:
+		count, n := binary.Uvarint(b[1:])
+		if n <= 0 || count > uint64(len(b)) {
+			return nil, fmt.Errorf("%w: count", ErrBadRecord)
+		}
+		b = b[1+n:]
+		start, end := byte('{'), byte('}')
+		if tag == tagArray {
+			start, end = '[', ']'
+		}
+		d.out.WriteByte(start)
+		for i := uint64(0); i < count; i++ {
+			if i > 0 {
+				d.out.WriteByte(',')
+			}
+			var err error
+			if tag == tagObject {
+				var key string
+				if key, b, err = d.str(stream, b); err != nil {
+					return nil, err
+				}
+				writeJSONString(&d.out, key)
+				d.out.WriteByte(':')
+			}
+			if b, err = d.value(stream, b); err != nil {
+				return nil, err
+			}
+		}
+		d.out.WriteByte(end)
+		return b, nil
+	default:
+		return nil, fmt.Errorf("%w: tag 0x%02x", ErrBadRecord, tag)
+	}
+}
+
+// str decodes a string, a definition or a reference
+func (d *BinaryDecoder) str(stream uint64, b []byte) (string, []byte, error) {
+	if len(b) == 0 {
+		return "", nil, fmt.Errorf("%w: missing string", ErrBadRecord)
+	}
+	tag := b[0]
+	v, n := binary.Uvarint(b[1:])
+	if n <= 0 {
+		return "", nil, fmt.Errorf("%w: string", ErrBadRecord)
+	}
+	b = b[1+n:]
+
+	switch tag {
+	case tagRef:
+		dict := d.dicts[stream]
+		if v >= uint64(len(dict)) {
+			return "", nil, fmt.Errorf("%w: no string %d in stream %d", ErrBadRecord, v, stream)
+		}
+		return dict[v], b, nil
+	case tagStr, tagDef, tagRaw:
+		if v > uint64(len(b)) {
+			return "", nil, fmt.Errorf("%w: string length", ErrBadRecord)
+		}
+		s := string(b[:v])
+		if tag == tagDef {
+			d.dicts[stream] = append(d.dicts[stream], s)
+		}
+		return s, b[v:], nil
+	default:
+		return "", nil, fmt.Errorf("%w: tag 0x%02x for a string", ErrBadRecord, tag)
+	}
+}
+
+// writeJSONString writes s quoted and escaped as cJSON would
+func writeJSONString(buf *bytes.Buffer, s string) {
+	const hex = "0123456789abcdef"
+	buf.WriteByte('"')
+	for i := 0; i < len(s); {
+		c := s[i]
+		switch {
+		case c == '"' || c == '\\':
+			buf.WriteByte('\\')
+			buf.WriteByte(c)
+		case c == '\n':
+			buf.WriteString(`\n`)
+		case c == '\r':
+			buf.WriteString(`\r`)
+		case c == '\t':
+			buf.WriteString(`\t`)
+		case c < 0x20:
+			buf.WriteString(`\u00`)
+			buf.WriteByte(hex[c>>4])
+			buf.WriteByte(hex[c&0xf])
+		case c < utf8.RuneSelf:
+			buf.WriteByte(c)
+		default:
+			// What isn't UTF-8 becomes U+FFFD, as encoding/json would have it
+			r, size := utf8.DecodeRuneInString(s[i:])
+			if r == utf8.RuneError && size == 1 {
+				buf.WriteString(`�`)
+			} else {
+				buf.WriteString(s[i : i+size])
+			}
+			i += size
+			continue
+		}
+		i++
+	}
+	buf.WriteByte('"')
+}
+
+func uvarintLen(v uint64) int {
+	n := 1
+	for v >= 0x80 {
+		v >>= 7
+		n++
+	}
+	return n
+}
+
+func unexpectedEOF(err error) error {
+	if err == io.EOF {
+		return io.ErrUnexpectedEOF
+	}
+	return err
+}
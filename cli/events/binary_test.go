@@ -0,0 +1,182 @@
+package events
+
+import (
+	"bytes"
+	"encoding/binary"
+	"io"
+	"math"
+	"os"
+	"testing"
+
+	"github.com/criblio/scope/libscope"
+	"github.com/criblio/scope/util"
+	"github.com/stretchr/testify/assert"
+)
+
+// record builds a binary event record the way src/evtbin.c does
+func record(typ byte, stream uint64, payload ...[]byte) []byte {
+	body := []byte{typ}
+	body = binary.AppendUvarint(body, stream)
+	for _, p := range payload {
+		body = append(body, p...)
+	}
+	rec := []byte{BinaryMarker}
+	rec = binary.AppendUvarint(rec, uint64(len(body)))
+	return append(rec, body...)
+}
+
+func start(stream uint64) []byte {
+	return record('S', stream, []byte{binaryVersion})
+}
+
+func str(tag byte, s string) []byte {
+	b := binary.AppendUvarint([]byte{tag}, uint64(len(s)))
+	return append(b, s...)
+}
+
+func ref(i uint64) []byte {
+	return binary.AppendUvarint([]byte{tagRef}, i)
+}
+
+func num(i int64) []byte {
+	return binary.AppendVarint([]byte{tagInt}, i)
+}
+
+func double(f float64) []byte {
+	return binary.LittleEndian.AppendUint64([]byte{tagDouble}, math.Float64bits(f))
+}
+
+func object(n uint64) []byte {
+	return binary.AppendUvarint([]byte{tagObject}, n)
+}
+
+func array(n uint64) []byte {
+	return binary.AppendUvarint([]byte{tagArray}, n)
+}
+
+// event is {"type":"evt","body":{"source":source,"pid":pid,"_time":t,"data":...}},
+// its keys and "evt" defined on first use in a stream and referred to after
+func event(stream uint64, first bool, source string, pid int64, t float64) []byte {
+	key := func(i uint64, s string) []byte {
+		if first {
+			return str(tagDef, s)
+		}
+		return ref(i)
+	}
+	return record('E', stream,
+		object(2),
+		key(0, "type"), key(1, "evt"),
+		key(2, "body"), object(4),
+		key(3, "source"), str(tagStr, source),
+		key(4, "pid"), num(pid),
+		key(5, "_time"), double(t),
+		key(6, "data"), object(3),
+		str(tagStr, "args"), array(3), str(tagStr, "a \"quoted\"\n"), []byte{tagTrue}, []byte{tagNull},
+		str(tagStr, "raw"), str(tagRaw, `{"x":[1,2]}`),
+		str(tagStr, "neg"), num(-42),
+	)
+}
+
+const eventJSON = `{"type":"evt","body":{"source":"stdout","pid":10117,"_time":1609191683.985,"data":{"args":["a \"quoted\"\n",true,null],"raw":{"x":[1,2]},"neg":-42}}}`
+
+func TestBinaryDecoder(t *testing.T) {
+	var in bytes.Buffer
+	in.Write(start(7))
+	in.Write(event(7, true, "stdout", 10117, 1609191683.985))
+	in.Write(record('J', 7, []byte(`{"type":"resp","status":200}`)))
+	in.Write(event(7, false, "stdout", 10117, 1609191683.985))
+
+	d := NewBinaryDecoder(&in)
+	offset, msg, err := d.Next()
+	assert.NoError(t, err)
+	assert.Equal(t, int64(len(start(7))), offset)
+	assert.Equal(t, eventJSON, string(msg))
+
+	_, msg, err = d.Next()
+	assert.NoError(t, err)
+	assert.Equal(t, `{"type":"resp","status":200}`, string(msg))
+
+	// The same event again, its keys from the dictionary
+	_, msg, err = d.Next()
+	assert.NoError(t, err)
+	assert.Equal(t, eventJSON, string(msg))
+
+	_, _, err = d.Next()
+	assert.Equal(t, io.EOF, err)
+}
+
+func TestBinaryDecoderStreams(t *testing.T) {
+	var in bytes.Buffer
+
+	// Two processes writing to the same file, then the first starting over
+	in.Write(start(1))
+	in.Write(start(2))
+	in.Write(record('E', 1, str(tagDef, "one")))
+	in.Write(record('E', 2, str(tagDef, "two")))
+	in.Write(record('E', 2, ref(0)))
+	in.Write(record('E', 1, ref(0)))
+	in.Write(start(1))
+	in.Write(record('E', 1, ref(0)))
+	in.Write(record('E', 1, []byte{tagFalse}))
+
+	d := NewBinaryDecoder(&in)
+	for _, expected := range []string{`"one"`, `"two"`, `"two"`, `"one"`} {
+		_, msg, err := d.Next()
+		assert.NoError(t, err)
+		assert.Equal(t, expected, string(msg))
+	}
+
+	// That string went with the old dictionary, but what follows is fine
+	_, _, err := d.Next()
+	assert.ErrorIs(t, err, ErrBadRecord)
+	_, msg, err := d.Next()
+	assert.NoError(t, err)
+	assert.Equal(t, "false", string(msg))
+
+	// A record cut short
+	d = NewBinaryDecoder(bytes.NewReader(event(1, true, "x", 1, 1)[:10]))
+	_, _, err = d.Next()
+	assert.Equal(t, io.ErrUnexpectedEOF, err)
+}
+
+func TestEventReaderBinary(t *testing.T) {
+	var in bytes.Buffer
+	in.Write(start(3))
+	in.Write(event(3, true, "stdout", 10117, 1609191683.985))
+	second := int64(in.Len())
+	in.Write(event(3, false, "stderr", 10118, 1609191683.986))
+
+	out := make(chan libscope.EventBody)
+	go EventReader(&in, 0, util.MatchField("pid", 10118), out)
+	events := []libscope.EventBody{}
+	for e := range out {
+		events = append(events, e)
+	}
+
+	assert.Len(t, events, 1)
+	assert.Equal(t, "stderr", events[0].Source)
+	assert.Equal(t, int64(10118), events[0].Pid)
+	assert.Equal(t, 1609191683.986, events[0].Time)
+	assert.Equal(t, util.EncodeOffset(second), events[0].Id)
+}
+
+func TestEventsBinaryLastN(t *testing.T) {
+	f, err := os.CreateTemp("", "events.bin")
+	assert.NoError(t, err)
+	defer os.Remove(f.Name())
+
+	f.Write(start(5))
+	f.Write(event(5, true, "stdout", 1, 1))
+	f.Write(event(5, false, "stdout", 2, 2))
+	f.Write(event(5, false, "stdout", 3, 3))
+
+	in := make(chan libscope.EventBody)
+	em := EventMatch{LastN: 2}
+	go em.Events(f, in)
+	pids := []int64{}
+	for e := range in {
+		pids = append(pids, e.Pid)
+	}
+	assert.Equal(t, []int64{2, 3}, pids)
+	f.Close()
+}
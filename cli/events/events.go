@@ -1,7 +1,9 @@
 package events
 
 import (
+	"bufio"
 	"encoding/json"
+	"errors"
 	"fmt"
 	"io"
 	"os"
@@ -100,8 +102,18 @@ func AnsiStrip(str string) string {
 
 // EventReader reads a newline delimited JSON documents and sends parsed documents
 // to the passed out channel. It exits the process on error.
+// Events in the binary format are read the same way.
 func EventReader(r io.Reader, initOffset int64, match func(string) bool, out chan libscope.EventBody) (int, error) {
-	br, err := util.NewlineReader(r, match, func(idx int, Offset int64, b []byte) error {
+	rd := bufio.NewReader(r)
+	if first, err := rd.Peek(1); err == nil && first[0] == BinaryMarker {
+		n, err := binaryEventReader(rd, initOffset, match, func(event libscope.EventBody) {
+			out <- event
+		})
+		close(out)
+		return n, err
+	}
+
+	br, err := util.NewlineReader(rd, match, func(idx int, Offset int64, b []byte) error {
 		event, err := ParseEvent(b)
 		if err != nil {
 			if err.Error() == "config event" {
@@ -120,6 +132,48 @@ func EventReader(r io.Reader, initOffset int64, match func(string) bool, out cha
 	return br, err
 }
 
+// binaryEventReader decodes the binary format, and passes each event that
+// matches to the callback
+func binaryEventReader(r io.Reader, initOffset int64, match func(string) bool, each func(libscope.EventBody)) (int, error) {
+	d := NewBinaryDecoder(r)
+	for {
+		offset, msg, err := d.Next()
+		if err == io.EOF {
+			return int(d.Offset()), nil
+		}
+		if errors.Is(err, ErrBadRecord) {
+			log.Error().Err(err).Msg("error decoding event")
+			continue
+		}
+		if err != nil {
+			return int(d.Offset()), err
+		}
+		if !match(string(msg)) {
+			continue
+		}
+		event, err := ParseEvent(msg)
+		if err != nil {
+			if err.Error() != "config event" {
+				log.Error().Err(err).Msg("error parsing event")
+			}
+			continue
+		}
+		event.Id = util.EncodeOffset(initOffset + offset)
+		each(event)
+	}
+}
+
+// isBinary tells if the file holds events in the binary format
+func isBinary(file io.ReadSeeker) bool {
+	first := make([]byte, 1)
+	_, err := file.Seek(0, io.SeekStart)
+	if err == nil {
+		_, err = io.ReadFull(file, first)
+	}
+	file.Seek(0, io.SeekStart)
+	return err == nil && first[0] == BinaryMarker
+}
+
 // ParseEvent unmarshals event text into an Event, returning only the Event.Body
 func ParseEvent(b []byte) (libscope.EventBody, error) {
 	var event libscope.Event
@@ -147,6 +201,10 @@ type EventMatch struct {
 
 // Events matches events based on EventMatch config
 func (em EventMatch) Events(file io.ReadSeeker, in chan libscope.EventBody) error {
+	if isBinary(file) {
+		return em.binaryEvents(file, in)
+	}
+
 	var err error
 	if !em.AllEvents && em.Offset == 0 {
 		var err error
@@ -171,6 +229,30 @@ func (em EventMatch) Events(file io.ReadSeeker, in chan libscope.EventBody) erro
 	return nil
 }
 
+// binaryEvents does what Events does for a file in the binary format.
+// A record can refer to strings defined in any record before it, so the
+// file is read from the start rather than searched from the end.
+func (em EventMatch) binaryEvents(file io.Reader, in chan libscope.EventBody) error {
+	events := []libscope.EventBody{}
+	_, err := binaryEventReader(file, 0, em.filter(), func(event libscope.EventBody) {
+		if offset, _ := util.DecodeOffset(event.Id); offset < em.Offset {
+			return
+		}
+		events = append(events, event)
+		if !em.AllEvents && em.Offset == 0 && em.LastN > 0 && len(events) > em.LastN {
+			events = events[1:]
+		}
+	})
+	for _, event := range events {
+		in <- event
+	}
+	close(in)
+	if err != nil {
+		return fmt.Errorf("error reading events: %v", err)
+	}
+	return nil
+}
+
 // filter filters events based on EventMatch config
 func (em EventMatch) filter() func(string) bool {
 	all := []util.MatchFunc{}
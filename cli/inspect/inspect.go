@@ -33,50 +33,25 @@ type InspectOutput struct {
 func InspectProcess(pidCtx ipc.IpcPidCtx) (InspectOutput, string, error) {
 	var iout InspectOutput
 
-	// Get configuration
+	// Get configuration, transport status and process details in a single request
 	cmdGetCfg := ipc.CmdGetScopeCfg{}
-	resp, err := cmdGetCfg.Request(pidCtx)
-	if err != nil {
-		return iout, "", err
-	}
-
-	err = cmdGetCfg.UnmarshalResp(resp.ResponseScopeMsgData)
-	if err != nil {
-		return iout, "", err
-	}
-	if resp.MetaMsgStatus != ipc.ResponseOK || *cmdGetCfg.Response.Status != ipc.ResponseOK {
-		return iout, "", errInspectCfg
-	}
-
-	// Get transport status
 	cmdGetTransportStatus := ipc.CmdGetTransportStatus{}
-	respTr, err := cmdGetTransportStatus.Request(pidCtx)
-	if err != nil {
-		return iout, "", err
-	}
-
-	err = cmdGetTransportStatus.UnmarshalResp(respTr.ResponseScopeMsgData)
-	if err != nil {
-		return iout, "", err
-	}
-
-	if respTr.MetaMsgStatus != ipc.ResponseOK || *cmdGetTransportStatus.Response.Status != ipc.ResponseOK {
-		return iout, "", errInspectCfg
-	}
-
-	// Get process details
 	cmdGetProcDetails := ipc.CmdGetProcessDetails{}
-	respPd, err := cmdGetProcDetails.Request(pidCtx)
+	cmdBatch := ipc.CmdBatch{Cmds: []ipc.BatchCmd{&cmdGetCfg, &cmdGetTransportStatus, &cmdGetProcDetails}}
+	resp, err := cmdBatch.Request(pidCtx)
 	if err != nil {
 		return iout, "", err
 	}
 
-	err = cmdGetProcDetails.UnmarshalResp(respPd.ResponseScopeMsgData)
+	err = cmdBatch.UnmarshalResp(resp.ResponseScopeMsgData)
 	if err != nil {
 		return iout, "", err
 	}
 
-	if respPd.MetaMsgStatus != ipc.ResponseOK || *cmdGetProcDetails.Response.Status != ipc.ResponseOK {
+	if resp.MetaMsgStatus != ipc.ResponseOK ||
+		*cmdGetCfg.Response.Status != ipc.ResponseOK ||
+		*cmdGetTransportStatus.Response.Status != ipc.ResponseOK ||
+		*cmdGetProcDetails.Response.Status != ipc.ResponseOK {
 		return iout, "", errInspectCfg
 	}
 
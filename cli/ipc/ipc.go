@@ -30,6 +30,7 @@ var (
 	errReceiveTimeout            = errors.New("timeout with receive the message")
 	errSendTimeout               = errors.New("timeout with sending the message")
 	errMissingMandatoryField     = errors.New("missing mandatory field in response")
+	errBatchInconsistentSize     = errors.New("batch error number of responses does not match the requests")
 )
 
 const ipcComTimeout time.Duration = 50 * time.Microsecond
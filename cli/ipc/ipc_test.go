@@ -67,3 +67,37 @@ func TestParsingIpcFrameScopeMsgMissingStatus(t *testing.T) {
 	err = cmd.UnmarshalResp(scopeMsg)
 	assert.ErrorIs(t, err, errMissingMandatoryField)
 }
+
+func TestBatchRequest(t *testing.T) {
+	cmdStatus := CmdGetScopeStatus{}
+	cmdTransport := CmdGetTransportStatus{}
+	batch := CmdBatch{Cmds: []BatchCmd{&cmdStatus, &cmdTransport}}
+	for i, expected := range []string{"{\"req\":1}", "{\"req\":4}"} {
+		req, err := batch.Cmds[i].request()
+		assert.NoError(t, err)
+		assert.Equal(t, expected, string(req))
+	}
+}
+
+func TestBatchUnmarshalResp(t *testing.T) {
+	testMsg := "{\"status\":200,\"uniq\":1645,\"remain\":94}\x00" +
+		"[{\"status\":200,\"scoped\":true},{\"status\":200,\"interfaces\":[{\"name\":\"log\",\"connected\":true}]}]"
+	_, scopeMsg, err := parseIpcFrame([]byte(testMsg))
+	assert.NoError(t, err)
+
+	cmdStatus := CmdGetScopeStatus{}
+	cmdTransport := CmdGetTransportStatus{}
+	batch := CmdBatch{Cmds: []BatchCmd{&cmdStatus, &cmdTransport}}
+	err = batch.UnmarshalResp(scopeMsg)
+	assert.NoError(t, err)
+	assert.EqualValues(t, *cmdStatus.Response.Status, 200)
+	assert.EqualValues(t, cmdStatus.Response.Scoped, true)
+	assert.EqualValues(t, *cmdTransport.Response.Status, 200)
+	assert.Equal(t, len(cmdTransport.Response.Interfaces), 1)
+	assert.Equal(t, cmdTransport.Response.Interfaces[0].Name, "log")
+
+	// One response missing
+	batch = CmdBatch{Cmds: []BatchCmd{&cmdStatus, &cmdTransport, &CmdGetProcessDetails{}}}
+	err = batch.UnmarshalResp(scopeMsg)
+	assert.ErrorIs(t, err, errBatchInconsistentSize)
+}
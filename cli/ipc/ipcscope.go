@@ -1,6 +1,7 @@
 package ipc
 
 import (
+	"bytes"
 	"encoding/json"
 	"fmt"
 
@@ -26,6 +27,7 @@ const (
 	reqCmdSetScopeCfg
 	reqCmdGetTransportStatus
 	reqCmdGetProcessDetails
+	reqCmdGetHttp2Memory
 )
 
 // Request which contains only cmd without data
@@ -86,13 +88,23 @@ type scopeGetCfgResponse struct {
 	Cfg    ScopeGetCfgResponseCfg `mapstructure:"cfg" json:"cfg" yaml:"cfg"`
 }
 
+// BatchCmd is a command which can be sent as a part of CmdBatch
+type BatchCmd interface {
+	request() ([]byte, error)
+	UnmarshalResp([]byte) error
+}
+
 // CmdGetSupportedCmds describes Get Supported Commands command request and response
 type CmdGetSupportedCmds struct {
 	Response scopeGetSupportedCmdsResponse
 }
 
+func (cmd *CmdGetSupportedCmds) request() ([]byte, error) {
+	return json.Marshal(scopeRequestOnly{Req: reqCmdGetSupportedCmds})
+}
+
 func (cmd *CmdGetSupportedCmds) Request(pidCtx IpcPidCtx) (*IpcResponseCtx, error) {
-	req, _ := json.Marshal(scopeRequestOnly{Req: reqCmdGetSupportedCmds})
+	req, _ := cmd.request()
 
 	return ipcDispatcher(req, pidCtx)
 }
@@ -127,6 +139,18 @@ type ScopeInterfaceDesc []struct {
 	Attempts int `mapstructure:"attempts,omitempty" json:"attempts,omitempty" yaml:"attempts,omitempty"`
 	// Failure details
 	FailureDetails string `mapstructure:"failure_details,omitempty" json:"failure_details,omitempty" yaml:"failure_details,omitempty"`
+	// Wait after the last failed attempt, in ms
+	BackoffDelayMs uint64 `mapstructure:"backoff_delay_ms,omitempty" json:"backoff_delay_ms,omitempty" yaml:"backoff_delay_ms,omitempty"`
+	// Time until the next attempt, in ms
+	NextConnectMs uint64 `mapstructure:"next_connect_ms,omitempty" json:"next_connect_ms,omitempty" yaml:"next_connect_ms,omitempty"`
+	// Bytes sent before compression, if the connection is compressed
+	UncompressedBytes uint64 `mapstructure:"uncompressed_bytes,omitempty" json:"uncompressed_bytes,omitempty" yaml:"uncompressed_bytes,omitempty"`
+	// Bytes sent after compression, if the connection is compressed
+	CompressedBytes uint64 `mapstructure:"compressed_bytes,omitempty" json:"compressed_bytes,omitempty" yaml:"compressed_bytes,omitempty"`
+	// Bytes spilled to disk while disconnected, not yet sent
+	SpillPendingBytes uint64 `mapstructure:"spill_pending_bytes,omitempty" json:"spill_pending_bytes,omitempty" yaml:"spill_pending_bytes,omitempty"`
+	// Bytes spilled to disk, then dropped to make room
+	SpillDroppedBytes uint64 `mapstructure:"spill_dropped_bytes,omitempty" json:"spill_dropped_bytes,omitempty" yaml:"spill_dropped_bytes,omitempty"`
 }
 
 // Must be inline with server, see: ipcRespGetTransportStatus
@@ -151,8 +175,40 @@ type scopeGetProcessDetailsResponse struct {
 	MachineId string `mapstructure:"machine_id" json:"machine_id" yaml:"machine_id"`
 }
 
+// Http2ChannelMemoryDesc describes the memory held for each HTTP/2 channel
+type Http2ChannelMemoryDesc []struct {
+	// Unique id of the socket
+	Uid uint64 `mapstructure:"uid" json:"uid" yaml:"uid"`
+	// Socket descriptor
+	Fd int `mapstructure:"fd" json:"fd" yaml:"fd"`
+	// Number of open streams
+	Streams int `mapstructure:"streams" json:"streams" yaml:"streams"`
+	// Bytes held for stream records
+	StreamBytes int `mapstructure:"stream_bytes" json:"stream_bytes" yaml:"stream_bytes"`
+	// Bytes held for stream strings
+	StringBytes int `mapstructure:"string_bytes" json:"string_bytes" yaml:"string_bytes"`
+	// Bytes of the stream strings in use
+	StringBytesUsed int `mapstructure:"string_bytes_used" json:"string_bytes_used" yaml:"string_bytes_used"`
+	// Bytes held by the HPACK decoder
+	HpackBytes int `mapstructure:"hpack_bytes" json:"hpack_bytes" yaml:"hpack_bytes"`
+	// Total bytes held for the channel
+	TotalBytes int `mapstructure:"total_bytes" json:"total_bytes" yaml:"total_bytes"`
+}
+
+// Must be inline with server, see: ipcRespGetHttp2Memory
+type scopeGetHttp2MemoryResponse struct {
+	// Response status
+	Status *respStatus `mapstructure:"status" json:"status" yaml:"status"`
+	// Channel description
+	Channels Http2ChannelMemoryDesc `mapstructure:"channels" json:"channels" yaml:"channels"`
+}
+
+func (cmd *CmdGetScopeStatus) request() ([]byte, error) {
+	return json.Marshal(scopeRequestOnly{Req: reqCmdGetScopeStatus})
+}
+
 func (cmd *CmdGetScopeStatus) Request(pidCtx IpcPidCtx) (*IpcResponseCtx, error) {
-	req, _ := json.Marshal(scopeRequestOnly{Req: reqCmdGetScopeStatus})
+	req, _ := cmd.request()
 
 	return ipcDispatcher(req, pidCtx)
 }
@@ -175,8 +231,12 @@ type CmdGetScopeCfg struct {
 	Response scopeGetCfgResponse
 }
 
+func (cmd *CmdGetScopeCfg) request() ([]byte, error) {
+	return json.Marshal(scopeRequestOnly{Req: reqCmdGetScopeCfg})
+}
+
 func (cmd *CmdGetScopeCfg) Request(pidCtx IpcPidCtx) (*IpcResponseCtx, error) {
-	req, _ := json.Marshal(scopeRequestOnly{Req: reqCmdGetScopeCfg})
+	req, _ := cmd.request()
 
 	return ipcDispatcher(req, pidCtx)
 }
@@ -200,14 +260,21 @@ type CmdSetScopeCfg struct {
 	CfgData  []byte
 }
 
-func (cmd *CmdSetScopeCfg) Request(pidCtx IpcPidCtx) (*IpcResponseCtx, error) {
+func (cmd *CmdSetScopeCfg) request() ([]byte, error) {
 	scopeReq := scopeRequestSetCfg{Req: reqCmdSetScopeCfg}
 
 	err := yaml.Unmarshal(cmd.CfgData, &scopeReq.Cfg)
 	if err != nil {
 		return nil, err
 	}
-	req, _ := json.Marshal(scopeReq)
+	return json.Marshal(scopeReq)
+}
+
+func (cmd *CmdSetScopeCfg) Request(pidCtx IpcPidCtx) (*IpcResponseCtx, error) {
+	req, err := cmd.request()
+	if err != nil {
+		return nil, err
+	}
 
 	return ipcDispatcher(req, pidCtx)
 }
@@ -230,8 +297,12 @@ type CmdGetTransportStatus struct {
 	Response scopeGetTransportStatusResponse
 }
 
+func (cmd *CmdGetTransportStatus) request() ([]byte, error) {
+	return json.Marshal(scopeRequestOnly{Req: reqCmdGetTransportStatus})
+}
+
 func (cmd *CmdGetTransportStatus) Request(pidCtx IpcPidCtx) (*IpcResponseCtx, error) {
-	req, _ := json.Marshal(scopeRequestOnly{Req: reqCmdGetTransportStatus})
+	req, _ := cmd.request()
 
 	return ipcDispatcher(req, pidCtx)
 }
@@ -254,8 +325,12 @@ type CmdGetProcessDetails struct {
 	Response scopeGetProcessDetailsResponse
 }
 
+func (cmd *CmdGetProcessDetails) request() ([]byte, error) {
+	return json.Marshal(scopeRequestOnly{Req: reqCmdGetProcessDetails})
+}
+
 func (cmd *CmdGetProcessDetails) Request(pidCtx IpcPidCtx) (*IpcResponseCtx, error) {
-	req, _ := json.Marshal(scopeRequestOnly{Req: reqCmdGetProcessDetails})
+	req, _ := cmd.request()
 
 	return ipcDispatcher(req, pidCtx)
 }
@@ -272,3 +347,94 @@ func (cmd *CmdGetProcessDetails) UnmarshalResp(respData []byte) error {
 
 	return nil
 }
+
+// CmdGetHttp2Memory describes Get HTTP/2 Memory command request and response
+type CmdGetHttp2Memory struct {
+	Response scopeGetHttp2MemoryResponse
+}
+
+func (cmd *CmdGetHttp2Memory) request() ([]byte, error) {
+	return json.Marshal(scopeRequestOnly{Req: reqCmdGetHttp2Memory})
+}
+
+func (cmd *CmdGetHttp2Memory) Request(pidCtx IpcPidCtx) (*IpcResponseCtx, error) {
+	req, _ := cmd.request()
+
+	return ipcDispatcher(req, pidCtx)
+}
+
+func (cmd *CmdGetHttp2Memory) UnmarshalResp(respData []byte) error {
+	err := yaml.Unmarshal(respData, &cmd.Response)
+	if err != nil {
+		return err
+	}
+
+	if cmd.Response.Status == nil {
+		return fmt.Errorf("%w %v", errMissingMandatoryField, "status")
+	}
+
+	return nil
+}
+
+// CmdBatch describes several commands sent in a single request, and answered in a single response
+// Must be inline with server, see: ipcProcessRequestAndPrepareResponse
+type CmdBatch struct {
+	Cmds []BatchCmd
+}
+
+func (cmd *CmdBatch) Request(pidCtx IpcPidCtx) (*IpcResponseCtx, error) {
+	reqs := make([]json.RawMessage, len(cmd.Cmds))
+	for i, c := range cmd.Cmds {
+		req, err := c.request()
+		if err != nil {
+			return nil, err
+		}
+		reqs[i] = req
+	}
+	req, _ := json.Marshal(reqs)
+
+	resp, err := ipcDispatcher(req, pidCtx)
+	if err != nil || resp.MetaMsgStatus != ResponseOK || bytes.HasPrefix(resp.ResponseScopeMsgData, []byte("[")) {
+		return resp, err
+	}
+
+	// The library doesn't support batches (it answers with a single bad request status),
+	// send the commands one by one
+	resp = &IpcResponseCtx{ResponseScopeMsgData: []byte("["), MetaMsgStatus: ResponseOK}
+	for i, req := range reqs {
+		single, err := ipcDispatcher(req, pidCtx)
+		if err != nil {
+			return nil, err
+		}
+		if i > 0 {
+			resp.ResponseScopeMsgData = append(resp.ResponseScopeMsgData, ',')
+		}
+		resp.ResponseScopeMsgData = append(resp.ResponseScopeMsgData, single.ResponseScopeMsgData...)
+		if resp.MetaMsgStatus == ResponseOK {
+			resp.MetaMsgStatus = single.MetaMsgStatus
+		}
+	}
+	resp.ResponseScopeMsgData = append(resp.ResponseScopeMsgData, ']')
+
+	return resp, nil
+}
+
+func (cmd *CmdBatch) UnmarshalResp(respData []byte) error {
+	var resps []json.RawMessage
+	err := json.Unmarshal(respData, &resps)
+	if err != nil {
+		return err
+	}
+
+	if len(resps) != len(cmd.Cmds) {
+		return fmt.Errorf("%w %v/%v", errBatchInconsistentSize, len(resps), len(cmd.Cmds))
+	}
+
+	for i, c := range cmd.Cmds {
+		if err := c.UnmarshalResp(resps[i]); err != nil {
+			return err
+		}
+	}
+
+	return nil
+}
@@ -3,7 +3,7 @@ package libscope
 // Header represents the JSON object a client sends to
 // LogStream when it connects.
 type Header struct {
-	Format    string     `json:"format,omitempty"`    // `ndjson` for event/metric connections or `scope` for payloads
+	Format    string     `json:"format,omitempty"`    // `ndjson` or `binary` for event/metric connections or `scope` for payloads
 	AuthToken string     `json:"authToken,omitempty"` // optional authentication token
 	Info      HeaderInfo `json:"info,omitempty"`      // the rest of the header information
 }
@@ -0,0 +1,207 @@
+package metrics
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"math"
+	"os"
+	"path/filepath"
+	"runtime"
+	"strings"
+	"sync/atomic"
+	"syscall"
+	"time"
+	"unsafe"
+)
+
+// Metrics published to shared memory by libscope (metric transport type shm).
+// The layout of a region is described in src/mtcshm.h
+
+// ShmDir is where libscope creates the regions
+const ShmDir = "/dev/shm"
+
+const (
+	shmPrefix    = "scope_mtc."
+	shmMagic     = uint64(0x43544d45504f4353) // "SCOPEMTC"
+	shmVersion   = 1
+	shmHdrSize   = 192
+	shmEntrySize = 288
+	shmRetries   = 1000
+)
+
+// Offsets in the header
+const (
+	hdrMagic     = 0
+	hdrVersion   = 8
+	hdrSize      = 12
+	hdrEntrySize = 16
+	hdrCapacity  = 20
+	hdrSeq       = 24
+	hdrCount     = 32
+	hdrPid       = 40
+	hdrUpdated   = 48
+	hdrDropped   = 56
+	hdrProcname  = 64
+	hdrHostname  = 128
+)
+
+// Offsets in an entry
+const (
+	entName    = 0
+	entTags    = 64
+	entUnit    = 224
+	entType    = 248
+	entLast    = 256
+	entTotal   = 264
+	entCount   = 272
+	entUpdated = 280
+)
+
+// data_type_t in src/mtcformat.h
+var shmTypes = [...]MetricType{Count, Gauge, Timer, Histogram, Set}
+
+// ShmProcess is the metrics one process has published
+type ShmProcess struct {
+	Pid     int
+	Proc    string
+	Host    string
+	Path    string
+	Updated time.Time
+	Dropped uint64
+	Alive   bool
+	Metrics []Metric
+}
+
+// ScrapeShm reads the metrics of every process that publishes them in dir.
+// Regions that can't be read, e.g. one that's being created, are skipped.
+func ScrapeShm(dir string) ([]ShmProcess, error) {
+	paths, err := filepath.Glob(filepath.Join(dir, shmPrefix+"*"))
+	if err != nil {
+		return nil, err
+	}
+
+	procs := []ShmProcess{}
+	for _, path := range paths {
+		p, err := ReadShm(path)
+		if err != nil {
+			continue
+		}
+		procs = append(procs, p)
+	}
+	return procs, nil
+}
+
+// ReadShm reads the metrics published in one region
+func ReadShm(path string) (ShmProcess, error) {
+	p := ShmProcess{Path: path}
+
+	f, err := os.Open(path)
+	if err != nil {
+		return p, err
+	}
+	defer f.Close()
+
+	fi, err := f.Stat()
+	if err != nil {
+		return p, err
+	}
+	if fi.Size() < shmHdrSize {
+		return p, fmt.Errorf("%s is too small", path)
+	}
+
+	data, err := syscall.Mmap(int(f.Fd()), 0, int(fi.Size()), syscall.PROT_READ, syscall.MAP_SHARED)
+	if err != nil {
+		return p, err
+	}
+	defer syscall.Munmap(data)
+
+	// The magic is written last; until then the header isn't complete
+	if atomic.LoadUint64((*uint64)(unsafe.Pointer(&data[hdrMagic]))) != shmMagic {
+		return p, fmt.Errorf("%s is not a metrics region", path)
+	}
+	le := binary.LittleEndian
+	if le.Uint32(data[hdrVersion:]) != shmVersion {
+		return p, fmt.Errorf("%s has version %d", path, le.Uint32(data[hdrVersion:]))
+	}
+	start := int(le.Uint32(data[hdrSize:]))
+	entrySize := int(le.Uint32(data[hdrEntrySize:]))
+	capacity := int(le.Uint32(data[hdrCapacity:]))
+	if start < shmHdrSize || entrySize < shmEntrySize || start+capacity*entrySize > len(data) {
+		return p, fmt.Errorf("%s has an unexpected layout", path)
+	}
+
+	// Copy what's in use between two loads of seq, until they agree
+	seq := (*uint64)(unsafe.Pointer(&data[hdrSeq]))
+	buf := make([]byte, len(data))
+	for i := 0; i < shmRetries; i++ {
+		s1 := atomic.LoadUint64(seq)
+		if s1&1 == 0 {
+			count := int(le.Uint32(data[hdrCount:]))
+			if count > capacity {
+				count = capacity
+			}
+			end := start + count*entrySize
+			copy(buf[:end], data[:end])
+			if atomic.LoadUint64(seq) == s1 {
+				parseShm(&p, buf[:end], start, entrySize, count)
+				return p, nil
+			}
+		}
+		runtime.Gosched()
+	}
+	return p, fmt.Errorf("%s is too busy to read", path)
+}
+
+func parseShm(p *ShmProcess, b []byte, start, entrySize, count int) {
+	le := binary.LittleEndian
+	p.Pid = int(int64(le.Uint64(b[hdrPid:])))
+	p.Proc = cString(b[hdrProcname:hdrHostname])
+	p.Host = cString(b[hdrHostname:shmHdrSize])
+	p.Updated = time.Unix(0, int64(le.Uint64(b[hdrUpdated:])))
+	p.Dropped = le.Uint64(b[hdrDropped:])
+	p.Alive = pidAlive(p.Pid)
+
+	for i := 0; i < count; i++ {
+		e := b[start+i*entrySize : start+(i+1)*entrySize]
+		m := Metric{
+			Name: cString(e[entName:entTags]),
+			Unit: cString(e[entUnit:entType]),
+			Pid:  p.Pid,
+			Time: time.Unix(0, int64(le.Uint64(e[entUpdated:]))),
+			Tags: []MetricTag{{"proc", p.Proc}, {"host", p.Host}},
+		}
+		if t := le.Uint32(e[entType:]); int(t) < len(shmTypes) {
+			m.Type = shmTypes[t]
+		}
+		// Counters are the sum of every value; the rest are the last one
+		if m.Type == Count {
+			m.Value = math.Float64frombits(le.Uint64(e[entTotal:]))
+		} else {
+			m.Value = math.Float64frombits(le.Uint64(e[entLast:]))
+		}
+		if tags := cString(e[entTags:entUnit]); tags != "" {
+			for _, tag := range strings.Split(tags, ",") {
+				if k, v, ok := strings.Cut(tag, ":"); ok {
+					m.Tags = append(m.Tags, MetricTag{k, v})
+				}
+			}
+		}
+		p.Metrics = append(p.Metrics, m)
+	}
+}
+
+func cString(b []byte) string {
+	if i := strings.IndexByte(string(b), 0); i >= 0 {
+		return string(b[:i])
+	}
+	return string(b)
+}
+
+func pidAlive(pid int) bool {
+	if pid <= 0 {
+		return false
+	}
+	err := syscall.Kill(pid, 0)
+	return err == nil || errors.Is(err, syscall.EPERM)
+}
@@ -0,0 +1,114 @@
+package metrics
+
+import (
+	"encoding/binary"
+	"math"
+	"os"
+	"path/filepath"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+)
+
+type shmTestEntry struct {
+	name, tags, unit string
+	typ              uint32
+	last, total      float64
+}
+
+// writeShm lays out a region the way src/mtcshm.c does
+func writeShm(t *testing.T, dir string, pid int, seq uint64, entries []shmTestEntry) string {
+	const capacity = 4
+	b := make([]byte, shmHdrSize+capacity*shmEntrySize)
+	le := binary.LittleEndian
+	le.PutUint64(b[hdrMagic:], shmMagic)
+	le.PutUint32(b[hdrVersion:], shmVersion)
+	le.PutUint32(b[hdrSize:], shmHdrSize)
+	le.PutUint32(b[hdrEntrySize:], shmEntrySize)
+	le.PutUint32(b[hdrCapacity:], capacity)
+	le.PutUint64(b[hdrSeq:], seq)
+	le.PutUint32(b[hdrCount:], uint32(len(entries)))
+	le.PutUint64(b[hdrPid:], uint64(pid))
+	le.PutUint64(b[hdrUpdated:], uint64(1610682430520000000))
+	le.PutUint64(b[hdrDropped:], 3)
+	copy(b[hdrProcname:], "redis")
+	copy(b[hdrHostname:], "myhost")
+	for i, e := range entries {
+		o := shmHdrSize + i*shmEntrySize
+		copy(b[o+entName:], e.name)
+		copy(b[o+entTags:], e.tags)
+		copy(b[o+entUnit:], e.unit)
+		le.PutUint32(b[o+entType:], e.typ)
+		le.PutUint64(b[o+entLast:], math.Float64bits(e.last))
+		le.PutUint64(b[o+entTotal:], math.Float64bits(e.total))
+		le.PutUint64(b[o+entCount:], 1)
+		le.PutUint64(b[o+entUpdated:], uint64(1610682430520000000))
+	}
+
+	path := filepath.Join(dir, shmPrefix+"1")
+	assert.NoError(t, os.WriteFile(path, b, 0644))
+	return path
+}
+
+func TestScrapeShm(t *testing.T) {
+	dir := t.TempDir()
+	path := writeShm(t, dir, os.Getpid(), 10, []shmTestEntry{
+		{"fs.read", "op:read,file:/tmp/x", "byte", 0, 5, 15},
+		{"proc.fd", "", "file", 1, 7, 21},
+		{"http.duration.server", "", "millisecond", 2, 12, 30},
+	})
+	// Not a region at all
+	assert.NoError(t, os.WriteFile(filepath.Join(dir, shmPrefix+"2"), []byte("hello"), 0644))
+
+	procs, err := ScrapeShm(dir)
+	assert.NoError(t, err)
+	assert.Equal(t, 1, len(procs))
+
+	p := procs[0]
+	assert.Equal(t, os.Getpid(), p.Pid)
+	assert.Equal(t, "redis", p.Proc)
+	assert.Equal(t, "myhost", p.Host)
+	assert.Equal(t, path, p.Path)
+	assert.Equal(t, uint64(3), p.Dropped)
+	assert.Equal(t, time.Unix(0, 1610682430520000000), p.Updated)
+	assert.True(t, p.Alive)
+	assert.Equal(t, 3, len(p.Metrics))
+
+	m := p.Metrics[0]
+	assert.Equal(t, "fs.read", m.Name)
+	assert.Equal(t, MetricType(Count), m.Type)
+	assert.Equal(t, float64(15), m.Value)
+	assert.Equal(t, "byte", m.Unit)
+	assert.Equal(t, os.Getpid(), m.Pid)
+	assert.Equal(t, []MetricTag{
+		{"proc", "redis"}, {"host", "myhost"}, {"op", "read"}, {"file", "/tmp/x"},
+	}, m.Tags)
+
+	m = p.Metrics[1]
+	assert.Equal(t, MetricType(Gauge), m.Type)
+	assert.Equal(t, float64(7), m.Value)
+	assert.Equal(t, 2, len(m.Tags))
+
+	m = p.Metrics[2]
+	assert.Equal(t, MetricType(Timer), m.Type)
+	assert.Equal(t, float64(12), m.Value)
+}
+
+func TestReadShmDuringUpdate(t *testing.T) {
+	dir := t.TempDir()
+
+	// seq stays odd; the writer never finishes
+	path := writeShm(t, dir, os.Getpid(), 11, []shmTestEntry{{"fs.read", "", "byte", 0, 5, 15}})
+	_, err := ReadShm(path)
+	assert.Error(t, err)
+}
+
+func TestReadShmDeadProcess(t *testing.T) {
+	dir := t.TempDir()
+	path := writeShm(t, dir, math.MaxInt32, 2, nil)
+	p, err := ReadShm(path)
+	assert.NoError(t, err)
+	assert.False(t, p.Alive)
+	assert.Equal(t, 0, len(p.Metrics))
+}
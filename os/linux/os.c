@@ -816,6 +816,107 @@ osGetPageProt(uint64_t addr)
     return prot;
 }
 
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    int prot;
+} os_map_t;
+
+struct _os_maps_t {
+    os_map_t *map;          // sorted by address, as the kernel lists them
+    size_t num;
+    size_t alloc;
+};
+
+/*
+ * Read /proc/self/maps once so that osMapsPageProt() can answer from
+ * memory.  The snapshot is only valid as long as nothing is mapped,
+ * unmapped, or protected differently; use it for a single pass and
+ * destroy it.
+ */
+os_maps_t *
+osMapsCreate(void)
+{
+    os_maps_t *maps = scope_calloc(1, sizeof(os_maps_t));
+    if (!maps) return NULL;
+
+    FILE *fstream = scope_fopen("/proc/self/maps", "r");
+    if (fstream == NULL) {
+        scope_free(maps);
+        return NULL;
+    }
+
+    char *buf = NULL;
+    size_t len = 0;
+    while (scope_getline(&buf, &len, fstream) != -1) {
+        char *end = NULL;
+        uint64_t addr1 = scope_strtoull(buf, &end, 0x10);
+        if ((addr1 == ULLONG_MAX) || (*end != '-')) continue;
+        uint64_t addr2 = scope_strtoull(end + 1, &end, 0x10);
+        if ((addr2 == 0) || (addr2 == ULLONG_MAX)) continue;
+
+        if (maps->num >= maps->alloc) {
+            size_t alloc = (maps->alloc) ? maps->alloc * 2 : 256;
+            os_map_t *map = scope_realloc(maps->map, alloc * sizeof(os_map_t));
+            if (!map) {
+                osMapsDestroy(&maps);
+                break;
+            }
+            maps->map = map;
+            maps->alloc = alloc;
+        }
+
+        char *perms = end + 1;
+        os_map_t *entry = &maps->map[maps->num++];
+        entry->start = addr1;
+        entry->end = addr2;
+        entry->prot = 0;
+        entry->prot |= perms[0] == 'r' ? PROT_READ : 0;
+        entry->prot |= perms[1] == 'w' ? PROT_WRITE : 0;
+        entry->prot |= perms[2] == 'x' ? PROT_EXEC : 0;
+    }
+
+    if (buf) scope_free(buf);
+    scope_fclose(fstream);
+    return maps;
+}
+
+void
+osMapsDestroy(os_maps_t **mapsptr)
+{
+    if (!mapsptr || !*mapsptr) return;
+    os_maps_t *maps = *mapsptr;
+
+    if (maps->map) scope_free(maps->map);
+    scope_free(maps);
+    *mapsptr = NULL;
+}
+
+/*
+ * Same as osGetPageProt() but from the snapshot.  With no snapshot,
+ * falls back to osGetPageProt().
+ */
+int
+osMapsPageProt(os_maps_t *maps, uint64_t addr)
+{
+    if (!maps) return osGetPageProt(addr);
+    if (addr == 0) return -1;
+
+    size_t lo = 0;
+    size_t hi = maps->num;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (addr < maps->map[mid].start) {
+            hi = mid;
+        } else if (addr >= maps->map[mid].end) {
+            lo = mid + 1;
+        } else {
+            return maps->map[mid].prot;
+        }
+    }
+    return -1;
+}
+
 int
 osNeedsConnect(int fd)
 {
@@ -45,6 +45,9 @@
 
 extern char *program_invocation_short_name;
 
+// A snapshot of /proc/self/maps for looking up many addresses at once
+typedef struct _os_maps_t os_maps_t;
+
 extern int osGetProcname(char *, int);
 extern int osGetProcUidGid(pid_t, uid_t *, gid_t *);
 extern int osGetNumThreads(pid_t);
@@ -58,6 +61,9 @@ extern bool osThreadInit(void(*handler)(int, siginfo_t *, void *), unsigned);
 extern int osUnixSockPeer(ino_t);
 extern void osInitJavaAgent(void);
 extern int osGetPageProt(unsigned long);
+extern os_maps_t *osMapsCreate(void);
+extern void osMapsDestroy(os_maps_t **);
+extern int osMapsPageProt(os_maps_t *, uint64_t);
 extern int osGetExePath(pid_t, char **);
 extern bool osTimerStop(void);
 extern bool osIsScopeHandlerActive(void);
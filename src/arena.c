@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+#include "arena.h"
+#include "dbg.h"
+#include "scopestdlib.h"
+
+#define ARENA_ALIGN (sizeof(void *) * 2)
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+typedef struct _chunk_t {
+    struct _chunk_t *next;
+    size_t size;                  // bytes available in data
+    size_t used;                  // bytes of data handed out
+    char data[] __attribute__((aligned(sizeof(void *) * 2)));
+} chunk_t;
+
+struct _arena_t {
+    chunk_t *head;                // chunk being allocated from
+    size_t chunkSize;
+    size_t used;
+    size_t size;
+};
+
+static chunk_t *
+chunkCreate(size_t size)
+{
+    chunk_t *chunk = scope_malloc(sizeof(chunk_t) + size);
+    if (!chunk) return NULL;
+
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+arena_t *
+arenaCreate(size_t chunkSize)
+{
+    arena_t *arena = scope_calloc(1, sizeof(arena_t));
+    if (!arena) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    arena->chunkSize = (chunkSize) ? ARENA_ROUND(chunkSize) : DEFAULT_ARENA_CHUNK;
+
+    // The first chunk is created on first use
+    return arena;
+}
+
+static void
+freeChunks(chunk_t *chunk)
+{
+    while (chunk) {
+        chunk_t *next = chunk->next;
+        scope_free(chunk);
+        chunk = next;
+    }
+}
+
+void
+arenaDestroy(arena_t **arenaptr)
+{
+    if (!arenaptr || !*arenaptr) return;
+    arena_t *arena = *arenaptr;
+
+    freeChunks(arena->head);
+    scope_free(arena);
+    *arenaptr = NULL;
+}
+
+void *
+arenaAlloc(arena_t *arena, size_t len)
+{
+    if (!arena) return NULL;
+
+    size_t need = ARENA_ROUND((len) ? len : 1);
+    chunk_t *chunk = arena->head;
+
+    if (!chunk || ((chunk->size - chunk->used) < need)) {
+        size_t size = (need > arena->chunkSize) ? need : arena->chunkSize;
+        chunk_t *newchunk = chunkCreate(size);
+        if (!newchunk) return NULL;
+
+        if (chunk && (need > arena->chunkSize)) {
+            // An oversized request; tuck it in behind the current chunk
+            // so the space left in the current chunk isn't wasted.
+            newchunk->next = chunk->next;
+            chunk->next = newchunk;
+        } else {
+            newchunk->next = chunk;
+            arena->head = newchunk;
+        }
+        arena->size += sizeof(chunk_t) + size;
+        chunk = newchunk;
+    }
+
+    void *mem = &chunk->data[chunk->used];
+    chunk->used += need;
+    arena->used += need;
+    return mem;
+}
+
+char *
+arenaStrndup(arena_t *arena, const char *str, size_t len)
+{
+    if (!arena || !str) return NULL;
+
+    char *copy = arenaAlloc(arena, len + 1);
+    if (!copy) return NULL;
+
+    scope_memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void
+arenaReset(arena_t *arena)
+{
+    if (!arena || !arena->head) return;
+
+    // Keep the last chunk in the list; it's the oldest, so it's
+    // never an oversized one unless that's all there's been.
+    chunk_t *keep = arena->head;
+    chunk_t *prev = NULL;
+    while (keep->next) {
+        prev = keep;
+        keep = keep->next;
+    }
+    if (prev) {
+        prev->next = NULL;
+        freeChunks(arena->head);
+    }
+
+    keep->used = 0;
+    arena->head = keep;
+    arena->used = 0;
+    arena->size = sizeof(chunk_t) + keep->size;
+}
+
+size_t
+arenaUsed(arena_t *arena)
+{
+    return (arena) ? arena->used : 0;
+}
+
+size_t
+arenaSize(arena_t *arena)
+{
+    return (arena) ? arena->size : 0;
+}
@@ -0,0 +1,36 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+#include "scopetypes.h"
+
+// An arena hands out memory from a few large chunks so that many small,
+// variable-length objects with a common lifetime don't each cost a heap
+// allocation (and its overhead).  Nothing allocated from an arena is freed
+// individually; everything goes at once with arenaReset() or
+// arenaDestroy().
+//
+
+typedef struct _arena_t arena_t;
+
+#define DEFAULT_ARENA_CHUNK ( 4096 )
+
+arena_t *arenaCreate(size_t chunkSize);
+void     arenaDestroy(arena_t **);
+
+// Returns NULL if the memory can't be allocated.  Allocations are
+// aligned for any type.  Requests bigger than the chunk size get a
+// chunk of their own.
+void *   arenaAlloc(arena_t *, size_t);
+
+// Copies len bytes of str and adds a null terminator
+char *   arenaStrndup(arena_t *, const char *, size_t);
+
+// Releases everything allocated from the arena but keeps its first chunk
+// around for reuse.
+void     arenaReset(arena_t *);
+
+size_t   arenaUsed(arena_t *);   // bytes handed out since the last reset
+size_t   arenaSize(arena_t *);   // bytes held from the heap
+
+#endif // __ARENA_H__
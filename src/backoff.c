@@ -1,22 +1,59 @@
 #define _GNU_SOURCE
+#include <time.h>
+
 #include "backoff.h"
 #include "dbg.h"
 #include "scopestdlib.h"
 
 
-// Implementation based on this recommendation:
-// https://cloud.google.com/iot/docs/how-tos/exponential-backoff
+// Implementation based on the "decorrelated jitter" recommendation:
+// https://aws.amazon.com/blogs/architecture/exponential-backoff-and-jitter/
 
 
 struct _backoff_t {
-    unsigned int backoff_base;     // 1000ms, 2000ms, 4000ms ...
-    unsigned int backoff_limit;    // current backoff in ms (includes jitter)
-    unsigned int ms_count;         // number of ms we've waited so far
+    uint64_t delay_ms;             // current backoff in ms, 0 before any attempt
+    uint64_t next_ms;              // monotonic time the next attempt is allowed
+    uint64_t seed;                 // our own, as rand() is the same in every process
+    pid_t pid;                     // the process that seed was chosen in
 };
 
-// 4min 16s
-#define BACKOFF_BASE_MAX ( 64 * 4 * 1000)
 
+static bool
+monotonicMs(uint64_t *ms)
+{
+    struct timespec ts;
+    if (scope_clock_gettime(CLOCK_MONOTONIC, &ts)) {
+        DBG(NULL);
+        return FALSE;
+    }
+    *ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    return TRUE;
+}
+
+// xorshift64*
+static uint64_t
+nextRandom(backoff_t *backoff)
+{
+    uint64_t x = backoff->seed;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    backoff->seed = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Different for each process, and each transport in it.  A child that
+// was forked has its parent's seed, so it's chosen again in the child.
+static void
+seedRandom(backoff_t *backoff, pid_t pid)
+{
+    struct timespec ts = {0};
+    scope_clock_gettime(CLOCK_MONOTONIC, &ts);
+    backoff->seed = ((uint64_t)pid << 32) ^ (uint64_t)ts.tv_nsec ^
+                    ((uint64_t)ts.tv_sec << 20) ^ (uint64_t)(uintptr_t)backoff;
+    if (!backoff->seed) backoff->seed = 1;
+    backoff->pid = pid;
+}
 
 backoff_t *
 backoffCreate(void)
@@ -27,6 +64,7 @@ backoffCreate(void)
         return NULL;
     }
 
+    seedRandom(backoff, scope_getpid());
     backoffReset(backoff);
 
     return backoff;
@@ -37,9 +75,8 @@ backoffReset(backoff_t *backoff)
 {
     if (!backoff) return;
 
-    backoff->backoff_base = 1000;
-    backoff->backoff_limit = 1;
-    backoff->ms_count = 0;
+    backoff->delay_ms = 0;
+    backoff->next_ms = 0;
 }
 
 void
@@ -59,20 +96,38 @@ backoffAlgoAllowsConnect(backoff_t *backoff)
     // If there isn't a backoff algo, always allow the connection.
     if (!backoff) return TRUE;
 
-    if (++backoff->ms_count >= backoff->backoff_limit) {
+    uint64_t now;
+    if (!monotonicMs(&now)) return TRUE;
 
-        // A connetion attempt is allowed.  Init for the next retry period.
-        int jitter_ms = scope_rand() % 1000;
-        backoff->backoff_limit = (backoff->backoff_base) + jitter_ms;
+    // It's not time to allow a connection attempt
+    if (now < backoff->next_ms) return FALSE;
 
-        if (backoff->backoff_base < BACKOFF_BASE_MAX) {
-            backoff->backoff_base = backoff->backoff_base * 2;
-        }
-        backoff->ms_count = 0;
-        return TRUE;
-    }
+    // A connection attempt is allowed.  Pick the wait before the next one.
+    pid_t pid = scope_getpid();
+    if (pid != backoff->pid) seedRandom(backoff, pid);
 
-    // It's not time to allow a connection attempt
-    return FALSE;
+    uint64_t prev = (backoff->delay_ms) ? backoff->delay_ms : BACKOFF_BASE_MS;
+    uint64_t range = prev * 3 - BACKOFF_BASE_MS + 1;
+    uint64_t delay = BACKOFF_BASE_MS + nextRandom(backoff) % range;
+    if (delay > BACKOFF_MAX_MS) delay = BACKOFF_MAX_MS;
+
+    backoff->delay_ms = delay;
+    backoff->next_ms = now + delay;
+    return TRUE;
+}
+
+uint64_t
+backoffDelayMs(backoff_t *backoff)
+{
+    return (backoff) ? backoff->delay_ms : 0;
 }
 
+uint64_t
+backoffRemainingMs(backoff_t *backoff)
+{
+    if (!backoff) return 0;
+
+    uint64_t now;
+    if (!monotonicMs(&now) || (now >= backoff->next_ms)) return 0;
+    return backoff->next_ms - now;
+}
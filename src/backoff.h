@@ -1,15 +1,22 @@
 #ifndef __BACKOFF_H__
 #define __BACKOFF_H__
 
+#include <stdint.h>
 #include "scopetypes.h"
 
 // This was written to keep state of connections so we can wait
 // and appropriate amount of time between attempting connections
 // and retrying them later.
 
-// Everything here expects that backoffAlgoAllowsConnect()
-// is called at a 1ms frequency.
+// The wait between attempts is measured on the monotonic clock, so it
+// doesn't matter how often backoffAlgoAllowsConnect() is called.  Each
+// wait is chosen at random from between BACKOFF_BASE_MS and three times
+// the last one, up to BACKOFF_MAX_MS ("decorrelated jitter"), so that
+// processes which lost a connection together don't all retry together.
+// That includes processes forked from one that had already started.
 
+#define BACKOFF_BASE_MS (1000)
+#define BACKOFF_MAX_MS  (64 * 4 * 1000)     // 4min 16s
 
 typedef struct _backoff_t backoff_t;
 
@@ -20,5 +27,7 @@ void          backoffDestroy(backoff_t **);
 // Accessor
 void          backoffReset(backoff_t *);
 bool          backoffAlgoAllowsConnect(backoff_t *);
+uint64_t      backoffDelayMs(backoff_t *);     // the wait after the last attempt
+uint64_t      backoffRemainingMs(backoff_t *); // until the next attempt is allowed
 
 #endif // __BACKOFF_H__
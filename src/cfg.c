@@ -6,6 +6,7 @@
 
 #include "cfg.h"
 #include "dbg.h"
+#include "pcrectx.h"
 #include "scopestdlib.h"
 
 typedef struct {
@@ -23,12 +24,15 @@ typedef struct {
         char* path;                      // For type CFG_FILE
         cfg_buffer_t buf_policy;
     } file;
+    cfg_compress_t compress;             // For CFG_TCP, CFG_UNIX, CFG_EDGE
 } transport_struct_t;
 
 typedef struct {
     bool valid;
     regex_t re;
     char *filter;
+    char *literal;      // filter w/o regex syntax, so it can skip regexec
+    bool nocase;        // literal is matched case-insensitively
 } header_extract_t;
 
 struct _config_t
@@ -57,6 +61,11 @@ struct _config_t
         size_t numHeaders;
         header_extract_t **hextract;
         unsigned allowbinaryconsole;
+        struct {
+            char *dir;
+            size_t maxsize;
+            size_t drainrate;
+        } spill;
     } evt;
 
     struct {
@@ -211,6 +220,9 @@ cfgCreateDefault(void)
     c->evt.hextract = DEFAULT_SRC_HTTP_HEADER;
     c->evt.numHeaders = 0;
     c->evt.allowbinaryconsole = DEFAULT_ALLOW_BINARY_CONSOLE;
+    c->evt.spill.dir = (DEFAULT_SPILL_DIR) ? scope_strdup(DEFAULT_SPILL_DIR) : NULL;
+    c->evt.spill.maxsize = DEFAULT_SPILL_MAXSIZE;
+    c->evt.spill.drainrate = DEFAULT_SPILL_DRAINRATE;
 
     which_transport_t tp;
     for (tp=CFG_MTC; tp<CFG_WHICH_MAX; tp++) {
@@ -225,6 +237,7 @@ cfgCreateDefault(void)
         c->transport[tp].net.tls.enable = DEFAULT_TLS_ENABLE;
         c->transport[tp].net.tls.validateserver = DEFAULT_TLS_VALIDATE_SERVER;
         c->transport[tp].net.tls.cacertpath = (DEFAULT_TLS_CA_CERT) ? scope_strdup(DEFAULT_TLS_CA_CERT) : NULL;
+        c->transport[tp].compress = DEFAULT_COMPRESS;
     }
 
     c->log.level = DEFAULT_LOG_LEVEL;
@@ -268,6 +281,7 @@ cfgDestroy(config_t **cfg)
         if (c->evt.hextract && c->evt.hextract[i]) {
             c->evt.hextract[i]->valid = FALSE;
             if (c->evt.hextract[i]->filter) scope_free(c->evt.hextract[i]->filter);
+            if (c->evt.hextract[i]->literal) scope_free(c->evt.hextract[i]->literal);
             regfree(&c->evt.hextract[i]->re);
             scope_free(c->evt.hextract[i]);
         }
@@ -283,6 +297,7 @@ cfgDestroy(config_t **cfg)
     }
 
     if (c->pay.dir) scope_free(c->pay.dir);
+    if (c->evt.spill.dir) scope_free(c->evt.spill.dir);
 
     if (c->tags) {
         int i = 0;
@@ -448,6 +463,20 @@ cfgEvtFormatHeader(config_t *cfg, int num)
     return DEFAULT_SRC_HTTP_HEADER;
 }
 
+const char *
+cfgEvtFormatHeaderLiteral(config_t *cfg, int num, bool *nocase)
+{
+    if (cfg && (num < cfg->evt.numHeaders)) {
+        if (cfg->evt.hextract && cfg->evt.hextract[num] &&
+            (cfg->evt.hextract[num]->valid == TRUE)) {
+            if (nocase) *nocase = cfg->evt.hextract[num]->nocase;
+            return cfg->evt.hextract[num]->literal;
+        }
+    }
+
+    return NULL;
+}
+
 regex_t *
 cfgEvtFormatHeaderRe(config_t *cfg, int num)
 {
@@ -479,6 +508,24 @@ cfgEvtAllowBinaryConsole(config_t *cfg)
     return (cfg) ? cfg->evt.allowbinaryconsole : DEFAULT_ALLOW_BINARY_CONSOLE;
 }
 
+const char *
+cfgEvtSpillDir(config_t *cfg)
+{
+    return (cfg) ? cfg->evt.spill.dir : DEFAULT_SPILL_DIR;
+}
+
+size_t
+cfgEvtSpillMaxSize(config_t *cfg)
+{
+    return (cfg) ? cfg->evt.spill.maxsize : DEFAULT_SPILL_MAXSIZE;
+}
+
+size_t
+cfgEvtSpillDrainRate(config_t *cfg)
+{
+    return (cfg) ? cfg->evt.spill.drainrate : DEFAULT_SPILL_DRAINRATE;
+}
+
 unsigned
 cfgMtcVerbosity(config_t* cfg)
 {
@@ -578,6 +625,17 @@ cfgTransportTlsCACertPath(config_t *cfg, which_transport_t t)
     return DEFAULT_TLS_CA_CERT;
 }
 
+cfg_compress_t
+cfgTransportCompress(config_t *cfg, which_transport_t t)
+{
+    if (t >= 0 && t < CFG_WHICH_MAX) {
+        if (cfg) return cfg->transport[t].compress;
+        return DEFAULT_COMPRESS;
+    }
+    DBG("%d", t);
+    return DEFAULT_COMPRESS;
+}
+
 custom_tag_t**
 cfgCustomTags(config_t* cfg)
 {
@@ -659,7 +717,7 @@ cfgMtcEnableSet(config_t* cfg, unsigned val)
 void
 cfgMtcFormatSet(config_t* cfg, cfg_mtc_format_t fmt)
 {
-    if (!cfg || fmt < 0 || fmt >= CFG_FORMAT_MAX) return;
+    if (!cfg || fmt < 0 || fmt >= CFG_FORMAT_MAX || fmt == CFG_FMT_BINARY) return;
     cfg->mtc.format = fmt;
 }
 
@@ -821,6 +879,28 @@ cfgEvtFormatNameFilterSet(config_t* cfg, watch_t src, const char* filter)
     cfg->evt.namefilter[src] = scope_strdup(filter);
 }
 
+// Most header filters are just a header name, optionally prefixed with
+// (?i).  Those only ever match as a substring of the header line, so we
+// keep the plain string to search for instead of running the regex.
+static char *
+headerFilterLiteral(const char *filter, bool *nocase)
+{
+    *nocase = FALSE;
+    if (!scope_strncmp(filter, "(?i)", 4)) {
+        *nocase = TRUE;
+        filter += 4;
+    }
+
+    if (!*filter) return NULL;
+
+    const char *c;
+    for (c = filter; *c; c++) {
+        if (scope_strchr("\\^$.|?*+()[]{}", *c)) return NULL;
+    }
+
+    return scope_strdup(filter);
+}
+
 void
 cfgEvtFormatHeaderSet(config_t *cfg, const char *filter)
 {
@@ -838,8 +918,9 @@ cfgEvtFormatHeaderSet(config_t *cfg, const char *filter)
 
     header_extract_t *hextract = scope_calloc(1, sizeof(header_extract_t));
     if (hextract) {
-        if (!regcomp(&hextract->re, filter, REG_EXTENDED | REG_NOSUB)) {
+        if (!regcomp_wrapper(&hextract->re, filter, REG_EXTENDED | REG_NOSUB)) {
             hextract->filter = scope_strdup(filter);
+            hextract->literal = headerFilterLiteral(filter, &hextract->nocase);
             hextract->valid = TRUE;
         } else {
             hextract->valid = FALSE;
@@ -865,11 +946,40 @@ cfgEvtAllowBinaryConsoleSet(config_t *cfg, unsigned val)
     cfg->evt.allowbinaryconsole = val;
 }
 
+void
+cfgEvtSpillDirSet(config_t *cfg, const char *dir)
+{
+    if (!cfg) return;
+    if (cfg->evt.spill.dir) scope_free(cfg->evt.spill.dir);
+    if (!dir || (dir[0] == '\0')) {
+        cfg->evt.spill.dir = (DEFAULT_SPILL_DIR) ? scope_strdup(DEFAULT_SPILL_DIR) : NULL;
+        return;
+    }
+
+    cfg->evt.spill.dir = scope_strdup(dir);
+}
+
+void
+cfgEvtSpillMaxSizeSet(config_t *cfg, size_t val)
+{
+    if (!cfg || !val) return;
+    cfg->evt.spill.maxsize = val;
+}
+
+void
+cfgEvtSpillDrainRateSet(config_t *cfg, size_t val)
+{
+    if (!cfg) return;
+    cfg->evt.spill.drainrate = val;
+}
+
 void
 cfgTransportTypeSet(config_t* cfg, which_transport_t t, cfg_transport_t type)
 {
     if (!cfg || t < 0 || t >= CFG_WHICH_MAX) return;
-    if (type < 0 || type > CFG_EDGE) return;
+    if (type < 0 || type > CFG_SHM) return;
+    // Only metrics can be published to shared memory
+    if ((type == CFG_SHM) && (t != CFG_MTC)) return;
     cfg->transport[t].type = type;
 }
 
@@ -932,6 +1042,14 @@ cfgTransportTlsCACertPathSet(config_t *cfg, which_transport_t t, const char *pat
     cfg->transport[t].net.tls.cacertpath = scope_strdup(path);
 }
 
+void
+cfgTransportCompressSet(config_t *cfg, which_transport_t t, cfg_compress_t compress)
+{
+    if (!cfg || t < 0 || t >= CFG_WHICH_MAX) return;
+    if (compress < CFG_COMPRESS_NONE || compress > CFG_COMPRESS_ZSTD) return;
+    cfg->transport[t].compress = compress;
+}
+
 void
 cfgCustomTagAdd(config_t* c, const char* name, const char* value)
 {
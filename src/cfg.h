@@ -41,6 +41,7 @@ cfg_buffer_t        cfgTransportBuf(config_t*, which_transport_t);
 unsigned            cfgTransportTlsEnable(config_t *, which_transport_t);
 unsigned            cfgTransportTlsValidateServer(config_t *, which_transport_t);
 const char*         cfgTransportTlsCACertPath(config_t *, which_transport_t);
+cfg_compress_t      cfgTransportCompress(config_t *, which_transport_t);
 custom_tag_t**      cfgCustomTags(config_t*);
 const char*         cfgCustomTagValue(config_t*, const char*);
 cfg_log_level_t     cfgLogLevel(config_t*);
@@ -48,10 +49,14 @@ unsigned int        cfgPayEnable(config_t*);
 const char *        cfgPayDir(config_t*);
 const char *        cfgEvtFormatHeader(config_t *, int);
 unsigned            cfgEvtAllowBinaryConsole(config_t *);
+const char *        cfgEvtSpillDir(config_t *);
+size_t              cfgEvtSpillMaxSize(config_t *);
+size_t              cfgEvtSpillDrainRate(config_t *);
 unsigned            cfgLogStreamEnable(config_t *);
 unsigned            cfgLogStreamCloud(config_t *);
 size_t              cfgEvtFormatNumHeaders(config_t *);
 regex_t *           cfgEvtFormatHeaderRe(config_t *, int);
+const char *        cfgEvtFormatHeaderLiteral(config_t *, int, bool *);
 const char *        cfgAuthToken(config_t *);
 unsigned            cfgSnapshotCoredumpEnable(config_t *);
 unsigned            cfgSnapshotBacktraceEnable(config_t *);
@@ -82,12 +87,16 @@ void                cfgTransportBufSet(config_t*, which_transport_t, cfg_buffer_
 void                cfgTransportTlsEnableSet(config_t *, which_transport_t, unsigned);
 void                cfgTransportTlsValidateServerSet(config_t *, which_transport_t, unsigned);
 void                cfgTransportTlsCACertPathSet(config_t *, which_transport_t, const char *);
+void                cfgTransportCompressSet(config_t *, which_transport_t, cfg_compress_t);
 void                cfgCustomTagAdd(config_t*, const char*, const char*);
 void                cfgLogLevelSet(config_t*, cfg_log_level_t);
 void                cfgPayEnableSet(config_t*, unsigned int);
 void                cfgPayDirSet(config_t*, const char *);
 void                cfgEvtFormatHeaderSet(config_t *, const char *);
 void                cfgEvtAllowBinaryConsoleSet(config_t *, unsigned);
+void                cfgEvtSpillDirSet(config_t *, const char *);
+void                cfgEvtSpillMaxSizeSet(config_t *, size_t);
+void                cfgEvtSpillDrainRateSet(config_t *, size_t);
 void                cfgLogStreamEnableSet(config_t *, unsigned);
 void                cfgLogStreamCloudSet(config_t *, unsigned);
 void                cfgAuthTokenSet(config_t *, const char *);
@@ -41,6 +41,7 @@
 #define PORT_NODE                    "port"
 #define PATH_NODE                    "path"
 #define BUFFERING_NODE               "buffering"
+#define COMPRESSION_NODE             "compression"
 #define TLS_NODE                     "tls"
 #define ENABLE_NODE                      "enable"
 #define VALIDATE_NODE                    "validateserver"
@@ -70,6 +71,10 @@
 #define VALUE_NODE                   "value"
 #define EX_HEADERS                   "headers"
 #define ALLOW_BINARY_NODE            "allowbinary"
+#define SPILL_NODE               "spill"
+#define DIR_NODE                     "dir"
+#define MAXSIZE_NODE                 "maxsize"
+#define DRAINRATE_NODE               "drainrate"
 
 #define PAYLOAD_NODE         "payload"
 #define ENABLE_NODE              "enable"
@@ -114,12 +119,20 @@ enum_map_t formatMap[] = {
     {NULL,                    -1}
 };
 #endif
+
+enum_map_t evtFormatMap[] = {
+    {"ndjson",                CFG_FMT_NDJSON},
+    {"binary",                CFG_FMT_BINARY},
+    {NULL,                    -1}
+};
+
 enum_map_t transportTypeMap[] = {
     {"udp",                   CFG_UDP},
     {"tcp",                   CFG_TCP},
     {"unix",                  CFG_UNIX},
     {"file",                  CFG_FILE},
     {"edge",                  CFG_EDGE},
+    {"shm",                   CFG_SHM},
     {NULL,                   -1}
 };
 
@@ -139,6 +152,12 @@ enum_map_t bufferMap[] = {
     {NULL,                    -1}
 };
 
+enum_map_t compressMap[] = {
+    {"none",                  CFG_COMPRESS_NONE},
+    {"zstd",                  CFG_COMPRESS_ZSTD},
+    {NULL,                    -1}
+};
+
 enum_map_t watchTypeMap[] = {
     {"file",                  CFG_SRC_FILE},
     {"console",               CFG_SRC_CONSOLE},
@@ -181,6 +200,9 @@ void cfgEventFormatSetFromStr(config_t*, const char*);
 void cfgEvtRateLimitSetFromStr(config_t*, const char*);
 void cfgEnhanceFsSetFromStr(config_t*, const char*);
 void cfgAllowBinaryConsoleSetFromStr(config_t *, const char *);
+void cfgEvtSpillDirSetFromStr(config_t *, const char *);
+void cfgEvtSpillMaxSizeSetFromStr(config_t *, const char *);
+void cfgEvtSpillDrainRateSetFromStr(config_t *, const char *);
 void cfgEvtFormatValueFilterSetFromStr(config_t*, watch_t, const char*);
 void cfgEvtFormatFieldFilterSetFromStr(config_t*, watch_t, const char*);
 void cfgEvtFormatNameFilterSetFromStr(config_t*, watch_t, const char*);
@@ -320,7 +342,7 @@ envRegex(void)
         return g_regex;
     }
 
-    if (regcomp(g_regex, "\\$[a-zA-Z0-9_]+", REG_EXTENDED)) {
+    if (regcomp_wrapper(g_regex, "\\$[a-zA-Z0-9_]+", REG_EXTENDED)) {
         // regcomp failed.
         DBG(NULL);
         scope_free(g_regex);
@@ -556,6 +578,12 @@ processEnvStyleInput(config_t *cfg, const char *env_line)
         cfgEnhanceFsSetFromStr(cfg, value);
     } else if (!scope_strcmp(env_name, "SCOPE_ALLOW_BINARY_CONSOLE")) {
         cfgAllowBinaryConsoleSetFromStr(cfg, value);
+    } else if (!scope_strcmp(env_name, "SCOPE_EVENT_SPILL_DIR")) {
+        cfgEvtSpillDirSetFromStr(cfg, value);
+    } else if (!scope_strcmp(env_name, "SCOPE_EVENT_SPILL_MAXSIZE")) {
+        cfgEvtSpillMaxSizeSetFromStr(cfg, value);
+    } else if (!scope_strcmp(env_name, "SCOPE_EVENT_SPILL_DRAINRATE")) {
+        cfgEvtSpillDrainRateSetFromStr(cfg, value);
     } else if (!scope_strcmp(env_name, "SCOPE_EVENT_LOGFILE_NAME")) {
         cfgEvtFormatNameFilterSetFromStr(cfg, CFG_SRC_FILE, value);
     } else if (!scope_strcmp(env_name, "SCOPE_EVENT_CONSOLE_NAME")) {
@@ -771,9 +799,7 @@ void
 cfgEventFormatSetFromStr(config_t* cfg, const char* value)
 {
     if (!cfg || !value) return;
-    // only ndjson is valid
-    cfgEventFormatSet(cfg, CFG_FMT_NDJSON);
-    //cfgEventFormatSet(cfg, strToVal(formatMap, value));
+    cfgEventFormatSet(cfg, strToVal(evtFormatMap, value));
 }
 
 void
@@ -802,6 +828,37 @@ cfgAllowBinaryConsoleSetFromStr(config_t *cfg, const char *value)
     cfgEvtAllowBinaryConsoleSet(cfg, strToVal(boolMap, value));
 }
 
+void
+cfgEvtSpillDirSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+    cfgEvtSpillDirSet(cfg, value);
+}
+
+void
+cfgEvtSpillMaxSizeSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+    scope_errno = 0;
+    char *endptr = NULL;
+    unsigned long long x = scope_strtoull(value, &endptr, 10);
+    if (scope_errno || *endptr) return;
+
+    cfgEvtSpillMaxSizeSet(cfg, x);
+}
+
+void
+cfgEvtSpillDrainRateSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+    scope_errno = 0;
+    char *endptr = NULL;
+    unsigned long long x = scope_strtoull(value, &endptr, 10);
+    if (scope_errno || *endptr) return;
+
+    cfgEvtSpillDrainRateSet(cfg, x);
+}
+
 void
 cfgEvtFormatValueFilterSetFromStr(config_t* cfg, watch_t src, const char* value)
 {
@@ -849,17 +906,40 @@ cfgMtcVerbositySetFromStr(config_t* cfg, const char* value)
     cfgMtcVerbositySet(cfg, x);
 }
 
+// The library log is only flushed at exit, so compressed it would hold
+// everything until then, and drop what doesn't fit
+static void
+setCompression(config_t *cfg, which_transport_t t, cfg_compress_t compress)
+{
+    if ((t == CFG_LOG) && (compress > CFG_COMPRESS_NONE)) {
+        scopeLogInfo("compression is ignored for the library log transport");
+        return;
+    }
+    cfgTransportCompressSet(cfg, t, compress);
+}
+
 void
 cfgTransportSetFromStr(config_t *cfg, which_transport_t t, const char *value)
 {
     if (!cfg || !value) return;
 
-    // see if value starts with udp://, tcp://, file://, unix:// or equals edge
-    if (value == scope_strstr(value, "udp://")) {
+    // copied to avoid directly modifying the process's env variable
+    char value_cpy[1024];
+    scope_strncpy(value_cpy, value, sizeof(value_cpy));
+    value_cpy[sizeof(value_cpy) - 1] = '\0';
 
-        // copied to avoid directly modifying the process's env variable
-        char value_cpy[1024];
-        scope_strncpy(value_cpy, value, sizeof(value_cpy));
+    // tcp://, unix:// and edge may be followed by ?compress=zstd
+    int compress = -1;
+    char *query = scope_strstr(value_cpy, "?compress=");
+    if (query) {
+        *query = '\0';
+        compress = strToVal(compressMap, query + C_STRLEN("?compress="));
+        if (compress == -1) return;
+    }
+
+    // see if value starts with udp://, tcp://, file://, unix:// or equals edge or shm
+    if (value_cpy == scope_strstr(value_cpy, "udp://")) {
+        if (query) return;
 
         char *host = value_cpy + C_STRLEN("udp://");
 
@@ -874,11 +954,7 @@ cfgTransportSetFromStr(config_t *cfg, which_transport_t t, const char *value)
         cfgTransportHostSet(cfg, t, host);
         cfgTransportPortSet(cfg, t, port);
 
-    } else if (value == scope_strstr(value, "tcp://")) {
-
-        // copied to avoid directly modifying the process's env variable
-        char value_cpy[1024];
-        scope_strncpy(value_cpy, value, sizeof(value_cpy));
+    } else if (value_cpy == scope_strstr(value_cpy, "tcp://")) {
 
         char *host = value_cpy + C_STRLEN("tcp://");
 
@@ -893,17 +969,25 @@ cfgTransportSetFromStr(config_t *cfg, which_transport_t t, const char *value)
         cfgTransportHostSet(cfg, t, host);
         cfgTransportPortSet(cfg, t, port);
 
-    } else if (value == scope_strstr(value, "file://")) {
-        const char *path = value + C_STRLEN("file://");
+    } else if (value_cpy == scope_strstr(value_cpy, "file://")) {
+        if (query) return;
+        const char *path = value_cpy + C_STRLEN("file://");
         cfgTransportTypeSet(cfg, t, CFG_FILE);
         cfgTransportPathSet(cfg, t, path);
-    } else if (value == scope_strstr(value, "unix://")) {
-        const char *path = value + C_STRLEN("unix://");
+    } else if (value_cpy == scope_strstr(value_cpy, "unix://")) {
+        const char *path = value_cpy + C_STRLEN("unix://");
         cfgTransportTypeSet(cfg, t, CFG_UNIX);
         cfgTransportPathSet(cfg, t, path);
-    } else if (scope_strncmp(value, "edge", C_STRLEN("edge")) == 0) {
+    } else if (scope_strncmp(value_cpy, "edge", C_STRLEN("edge")) == 0) {
         cfgTransportTypeSet(cfg, t, CFG_EDGE);
+    } else if (scope_strncmp(value_cpy, "shm", C_STRLEN("shm")) == 0) {
+        if (query) return;
+        cfgTransportTypeSet(cfg, t, CFG_SHM);
+    } else {
+        return;
     }
+
+    if (query) setCompression(cfg, t, compress);
 }
 
 void
@@ -1081,6 +1165,15 @@ processBuf(config_t* config, yaml_document_t* doc, yaml_node_t* node)
     if (value) scope_free(value);
 }
 
+static void
+processCompression(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    which_transport_t c = transport_context;
+    setCompression(config, c, strToVal(compressMap, value));
+    if (value) scope_free(value);
+}
+
 static void
 processTlsEnable(config_t *config, yaml_document_t *doc, yaml_node_t *node)
 {
@@ -1137,6 +1230,7 @@ processTransport(config_t* config, yaml_document_t* doc, yaml_node_t* node)
         {YAML_SCALAR_NODE,    PORT_NODE,            processPort},
         {YAML_SCALAR_NODE,    PATH_NODE,            processPath},
         {YAML_SCALAR_NODE,    BUFFERING_NODE,       processBuf},
+        {YAML_SCALAR_NODE,    COMPRESSION_NODE,     processCompression},
         {YAML_MAPPING_NODE,   TLS_NODE,             processTls},
         {YAML_NO_NODE,        NULL,                 NULL}
     };
@@ -1581,6 +1675,48 @@ processEvtWatch(config_t* config, yaml_document_t* doc, yaml_node_t* node)
     }
 }
 
+static void
+processEvtSpillDir(config_t *config, yaml_document_t *doc, yaml_node_t *node)
+{
+    char *value = stringVal(node);
+    cfgEvtSpillDirSetFromStr(config, value);
+    if (value) scope_free(value);
+}
+
+static void
+processEvtSpillMaxSize(config_t *config, yaml_document_t *doc, yaml_node_t *node)
+{
+    char *value = stringVal(node);
+    cfgEvtSpillMaxSizeSetFromStr(config, value);
+    if (value) scope_free(value);
+}
+
+static void
+processEvtSpillDrainRate(config_t *config, yaml_document_t *doc, yaml_node_t *node)
+{
+    char *value = stringVal(node);
+    cfgEvtSpillDrainRateSetFromStr(config, value);
+    if (value) scope_free(value);
+}
+
+static void
+processEvtSpill(config_t *config, yaml_document_t *doc, yaml_node_t *node)
+{
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    parse_table_t t[] = {
+        {YAML_SCALAR_NODE,    DIR_NODE,             processEvtSpillDir},
+        {YAML_SCALAR_NODE,    MAXSIZE_NODE,         processEvtSpillMaxSize},
+        {YAML_SCALAR_NODE,    DRAINRATE_NODE,       processEvtSpillDrainRate},
+        {YAML_NO_NODE,        NULL,                 NULL}
+    };
+
+    yaml_node_pair_t* pair;
+    foreach(pair, node->data.mapping.pairs) {
+        processKeyValuePair(t, pair, config, doc);
+    }
+}
+
 static void
 processEvent(config_t* config, yaml_document_t* doc, yaml_node_t* node)
 {
@@ -1592,6 +1728,7 @@ processEvent(config_t* config, yaml_document_t* doc, yaml_node_t* node)
         {YAML_MAPPING_NODE,   FORMAT_NODE,          processEvtFormat},
         {YAML_SEQUENCE_NODE,  WATCH_NODE,           processEvtWatch},
         {YAML_SCALAR_NODE,    WATCH_NODE,           processEvtWatch},
+        {YAML_MAPPING_NODE,   SPILL_NODE,           processEvtSpill},
         {YAML_NO_NODE,        NULL,                 NULL}
     };
 
@@ -1802,7 +1939,7 @@ processProtocolEntry(config_t* config, yaml_document_t* doc, yaml_node_t* node)
     // init the regex
     int errornumber;
     PCRE2_SIZE erroroffset;
-    protocol_context->re = pcre2_compile(
+    protocol_context->re = pcre2_compile_wrapper(
             (PCRE2_SPTR)protocol_context->regex,
             PCRE2_ZERO_TERMINATED, 0,
             &errornumber, &erroroffset, NULL);
@@ -2286,10 +2423,23 @@ createTransportJson(config_t* cfg, which_transport_t trans)
                  valToStr(bufferMap, cfgTransportBuf(cfg, trans)))) goto err;
             break;
         case CFG_EDGE:
+        case CFG_SHM:
             break;
         default:
             DBG(NULL);
     }
+
+    switch (cfgTransportType(cfg, trans)) {
+        case CFG_TCP:
+        case CFG_UNIX:
+        case CFG_EDGE:
+            if (cfgTransportCompress(cfg, trans) == CFG_COMPRESS_NONE) break;
+            if (!cJSON_AddStringToObjLN(root, COMPRESSION_NODE,
+                 valToStr(compressMap, cfgTransportCompress(cfg, trans)))) goto err;
+            break;
+        default:
+            break;
+    }
     return root;
 err:
     if (root) cJSON_Delete(root);
@@ -2513,7 +2663,7 @@ createEventFormatJson(config_t* cfg)
 
     if (!(root = cJSON_CreateObject())) goto err;
     if (!cJSON_AddStringToObjLN(root, TYPE_NODE,
-                      valToStr(formatMap, cfgEventFormat(cfg)))) goto err;
+                      valToStr(evtFormatMap, cfgEventFormat(cfg)))) goto err;
     if (!cJSON_AddNumberToObjLN(root, MAXEPS_NODE,
                       cfgEvtRateLimit(cfg))) goto err;
     if (!cJSON_AddStringToObjLN(root, ENHANCEFS_NODE,
@@ -2525,11 +2675,30 @@ err:
     return NULL;
 }
 
+static cJSON*
+createEventSpillJson(config_t* cfg)
+{
+    cJSON* root = NULL;
+
+    if (!(root = cJSON_CreateObject())) goto err;
+    if (!cJSON_AddStringToObjLN(root, DIR_NODE,
+                      cfgEvtSpillDir(cfg))) goto err;
+    if (!cJSON_AddNumberToObjLN(root, MAXSIZE_NODE,
+                      cfgEvtSpillMaxSize(cfg))) goto err;
+    if (!cJSON_AddNumberToObjLN(root, DRAINRATE_NODE,
+                      cfgEvtSpillDrainRate(cfg))) goto err;
+
+    return root;
+err:
+    if (root) cJSON_Delete(root);
+    return NULL;
+}
+
 static cJSON*
 createEventJson(config_t* cfg)
 {
     cJSON* root = NULL;
-    cJSON* format, *watch, *transport;
+    cJSON* format, *watch, *transport, *spill;
 
     if (!(root = cJSON_CreateObject())) goto err;
 
@@ -2545,6 +2714,12 @@ createEventJson(config_t* cfg)
     if (!(watch = createWatchArrayJson(cfg))) goto err;
     cJSON_AddItemToObjectCS(root, WATCH_NODE, watch);
 
+    // Only when it's been configured
+    if (cfgEvtSpillDir(cfg)) {
+        if (!(spill = createEventSpillJson(cfg))) goto err;
+        cJSON_AddItemToObjectCS(root, SPILL_NODE, spill);
+    }
+
     return root;
 err:
     if (root) cJSON_Delete(root);
@@ -2743,6 +2918,10 @@ initTransport(config_t* cfg, which_transport_t t)
         default:
             DBG("%d", cfgTransportType(cfg, t));
     }
+
+    if (transport && (cfgTransportCompress(cfg, t) != CFG_COMPRESS_NONE)) {
+        transportCompressSet(transport, cfgTransportCompress(cfg, t));
+    }
     return transport;
 }
 
@@ -2783,12 +2962,16 @@ initMtc(config_t* cfg)
 
     mtcEnabledSet(mtc, cfgMtcEnable(cfg));
 
-    transport_t* t = initTransport(cfg, CFG_MTC);
-    if (!t) {
-        mtcDestroy(&mtc);
-        return mtc;
+    if (cfgTransportType(cfg, CFG_MTC) == CFG_SHM) {
+        mtcShmSet(mtc, TRUE);
+    } else {
+        transport_t* t = initTransport(cfg, CFG_MTC);
+        if (!t) {
+            mtcDestroy(&mtc);
+            return mtc;
+        }
+        mtcTransportSet(mtc, t);
     }
-    mtcTransportSet(mtc, t);
 
     mtc_fmt_t* f = initMtcFormat(cfg);
     if (!f) {
@@ -2892,6 +3075,8 @@ initCtl(config_t *cfg)
     ctlPayStatusSet(ctl, payloadStatus);
     ctlPayDirSet(ctl,    cfgPayDir(cfg));
     ctlAllowBinaryConsoleSet(ctl, cfgEvtAllowBinaryConsole(cfg));
+    ctlFormatSet(ctl, cfgEventFormat(cfg));
+    ctlSpillSet(ctl, cfgEvtSpillDir(cfg), cfgEvtSpillMaxSize(cfg), cfgEvtSpillDrainRate(cfg));
 
     return ctl;
 }
@@ -2955,6 +3140,11 @@ cfgLogStreamDefault(config_t *cfg)
     }
     cfgMtcFormatSet(cfg, CFG_FMT_NDJSON);
 
+    if (cfgEventFormat(cfg) != CFG_FMT_NDJSON) {
+        scope_strncat(g_logmsg, "Event format, ", 20);
+    }
+    cfgEventFormatSet(cfg, CFG_FMT_NDJSON);
+
     if (cfgLogLevel(cfg) > CFG_LOG_WARN ) {
         scope_strncat(g_logmsg, "Log level, ", 20);
         cfgLogLevelSet(cfg, CFG_LOG_WARN);
@@ -0,0 +1,339 @@
+#define _GNU_SOURCE
+#include "atomic.h"
+#include "chantab.h"
+#include "dbg.h"
+#include "plattime.h"
+#include "scopestdlib.h"
+
+// Refreshing lastUsed on every lookup would have every thread writing
+// the same cache lines; the idle check doesn't need it more often than this.
+#define CHANNEL_TOUCH_NS ( 1000000ULL )
+
+// refs of a slot whose net_info is set up; the rest of refs counts pins
+#define CHANNEL_LIVE     ( 1ULL << 63 )
+
+typedef struct {
+    uint64_t key;        // channel ID; zero for an unused slot
+    uint64_t refs;       // CHANNEL_LIVE once set up, plus the pins
+    uint64_t lastUsed;   // getTime() of a recent chanTabGet()
+    net_info net;
+} chan_slot_t;
+
+// The net_info of an evicted channel, until chanTabReclaim() resets it
+typedef struct chan_retired {
+    struct chan_retired *next;
+    net_info net;
+} chan_retired_t;
+
+struct _chantab_t {
+    chan_slot_t *slots;  // buckets of CHANNEL_WAYS slots
+    chan_retired_t *retired;
+    uint64_t bucketMask;
+    unsigned int entries;
+    uint64_t maxIdle;
+    chan_reset_fn reset;
+    uint64_t gen;        // tells this table from one created before at the same address
+    chantab_stats_t stats;
+};
+
+static uint64_t g_chanTabGen = 0;
+
+// The last channel this thread looked up.  Go runs our code on threads
+// it created itself, where we don't rely on thread local storage.
+static __thread struct {
+    uint64_t gen;
+    uint64_t id;
+    chan_slot_t *slot;
+} g_lastChannel;
+
+chantab_t *
+chanTabCreate(unsigned int entries, uint64_t maxIdle, chan_reset_fn reset)
+{
+    chantab_t *tab = scope_calloc(1, sizeof(chantab_t));
+    if (!tab) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    unsigned int size = CHANNEL_WAYS;
+    while (size < entries) size <<= 1;
+    tab->entries = size;
+    tab->bucketMask = (size / CHANNEL_WAYS) - 1;
+    tab->maxIdle = maxIdle;
+    tab->reset = reset;
+    tab->gen = __sync_add_and_fetch(&g_chanTabGen, 1);
+    return tab;
+}
+
+// Resets the net_info of the channels that were evicted
+static void
+resetRetired(chantab_t *tab)
+{
+    chan_retired_t *retired = (chan_retired_t *)atomicSwapU64((uint64_t *)&tab->retired, 0ULL);
+    while (retired) {
+        chan_retired_t *next = retired->next;
+        if (tab->reset) tab->reset(&retired->net);
+        scope_free(retired);
+        retired = next;
+    }
+}
+
+void
+chanTabDestroy(chantab_t **tabptr)
+{
+    if (!tabptr || !*tabptr) return;
+    chantab_t *tab = *tabptr;
+
+    if (tab->slots) {
+        unsigned int i;
+        for (i = 0; i < tab->entries; i++) {
+            if (tab->slots[i].key && tab->reset) tab->reset(&tab->slots[i].net);
+        }
+        scope_free(tab->slots);
+    }
+    resetRetired(tab);
+    scope_free(tab);
+    *tabptr = NULL;
+}
+
+static chan_slot_t *
+bucketOf(chantab_t const *tab, uint64_t id)
+{
+    // Fibonacci hashing; IDs are often pointers, with the low bits clear
+    uint64_t bucket = ((id * 0x9e3779b97f4a7c15ULL) >> 32) & tab->bucketMask;
+    return &tab->slots[bucket * CHANNEL_WAYS];
+}
+
+static void
+touch(chan_slot_t *slot, uint64_t now)
+{
+    if (getDurationNow(now, slot->lastUsed) > CHANNEL_TOUCH_NS) {
+        slot->lastUsed = now;
+    }
+}
+
+static bool
+allocSlots(chantab_t *tab)
+{
+    chan_slot_t *slots = scope_calloc(tab->entries, sizeof(chan_slot_t));
+    if (!slots) {
+        DBG(NULL);
+        return FALSE;
+    }
+    if (!atomicCasU64((uint64_t *)&tab->slots, 0ULL, (uint64_t)slots)) {
+        // another thread got there first
+        scope_free(slots);
+    }
+    return TRUE;
+}
+
+/*
+ * Pins the slot if it's live and holds id.  A slot can't be reclaimed
+ * while it's pinned; one that was reclaimed and set up for another
+ * channel before we pinned it is let go again.
+ */
+static bool
+pinSlot(chan_slot_t *slot, uint64_t id)
+{
+    uint64_t refs;
+    do {
+        refs = slot->refs;
+        if (!(refs & CHANNEL_LIVE)) return FALSE;
+    } while (!atomicCasU64(&slot->refs, refs, refs + 1));
+
+    if (slot->key == id) return TRUE;
+    atomicSubU64(&slot->refs, 1);
+    return FALSE;
+}
+
+static chan_slot_t *
+findSlot(chantab_t *tab, chan_slot_t *bucket, uint64_t id)
+{
+    int i;
+    for (i = 0; i < CHANNEL_WAYS; i++) {
+        if ((bucket[i].key == id) && pinSlot(&bucket[i], id)) return &bucket[i];
+    }
+    return NULL;
+}
+
+static void
+setUpSlot(chantab_t *tab, chan_slot_t *slot, uint64_t id, uint64_t now)
+{
+    net_info *net = &slot->net;
+    scope_memset(net, 0, sizeof(*net));
+    net->active = TRUE;
+    net->type = SOCK_STREAM; // assumption needed for doHttp()
+    net->uid = id;
+    slot->lastUsed = now;
+    atomicStoreU64(&slot->refs, CHANNEL_LIVE | 1);
+    atomicAddU64(&tab->stats.inserts, 1);
+}
+
+/*
+ * Takes over the least recently used slot in the bucket that nobody has
+ * pinned.  Once it isn't live nobody can pin it, so its net_info can be
+ * moved out of the way; it's reset later, by chanTabReclaim().
+ */
+static chan_slot_t *
+evictSlot(chantab_t *tab, chan_slot_t *bucket, uint64_t id, uint64_t now)
+{
+    chan_retired_t *retired = scope_malloc(sizeof(*retired));
+    if (!retired) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    int tries;
+    for (tries = 0; tries < CHANNEL_WAYS; tries++) {
+        chan_slot_t *victim = NULL;
+        int i;
+        for (i = 0; i < CHANNEL_WAYS; i++) {
+            if (bucket[i].refs != CHANNEL_LIVE) continue;
+            if (!victim || (bucket[i].lastUsed < victim->lastUsed)) victim = &bucket[i];
+        }
+        if (!victim) break;
+        if (!atomicCasU64(&victim->refs, CHANNEL_LIVE, 0ULL)) continue;
+
+        retired->net = victim->net;
+        do {
+            retired->next = tab->retired;
+        } while (!atomicCasU64((uint64_t *)&tab->retired,
+                               (uint64_t)retired->next, (uint64_t)retired));
+
+        atomicStoreU64(&victim->key, id);
+        setUpSlot(tab, victim, id, now);
+        atomicAddU64(&tab->stats.evictions, 1);
+        return victim;
+    }
+
+    scope_free(retired);
+    return NULL;
+}
+
+/*
+ * Takes an unused slot in the bucket for id, else the one used least
+ * recently that isn't pinned.  Its net_info is set up before it's made
+ * live, pinned for the caller.  Returns NULL if every slot is pinned.
+ */
+static chan_slot_t *
+claimSlot(chantab_t *tab, chan_slot_t *bucket, uint64_t id, uint64_t now)
+{
+    int i;
+    for (i = 0; i < CHANNEL_WAYS; i++) {
+        chan_slot_t *slot = &bucket[i];
+        if (slot->key || !atomicCasU64(&slot->key, 0ULL, id)) continue;
+
+        setUpSlot(tab, slot, id, now);
+        return slot;
+    }
+    return evictSlot(tab, bucket, id, now);
+}
+
+net_info *
+chanTabGet(chantab_t *tab, uint64_t id)
+{
+    if (!tab || !id) return NULL;
+    atomicAddU64(&tab->stats.lookups, 1);
+
+    uint64_t now = getTime();
+    if (!g_isgo && (g_lastChannel.gen == tab->gen) && (g_lastChannel.id == id) &&
+        pinSlot(g_lastChannel.slot, id)) {
+        atomicAddU64(&tab->stats.cacheHits, 1);
+        touch(g_lastChannel.slot, now);
+        return &g_lastChannel.slot->net;
+    }
+
+    if (!tab->slots && !allocSlots(tab)) return NULL;
+
+    // Another thread may be setting up a slot for the same channel; it
+    // isn't found until it's live, so look again a few times.
+    chan_slot_t *bucket = bucketOf(tab, id);
+    chan_slot_t *slot = NULL;
+    int tries;
+    for (tries = 0; !slot && (tries < CHANNEL_WAYS); tries++) {
+        if ((slot = findSlot(tab, bucket, id))) {
+            atomicAddU64(&tab->stats.hits, 1);
+            touch(slot, now);
+        } else {
+            slot = claimSlot(tab, bucket, id, now);
+        }
+    }
+    if (!slot) {
+        atomicAddU64(&tab->stats.full, 1);
+        return NULL;
+    }
+
+    if (!g_isgo) {
+        g_lastChannel.gen = tab->gen;
+        g_lastChannel.id = id;
+        g_lastChannel.slot = slot;
+    }
+    return &slot->net;
+}
+
+void
+chanTabPut(chantab_t *tab, net_info *net)
+{
+    if (!tab || !tab->slots || !net) return;
+
+    chan_slot_t *slot = (chan_slot_t *)((char *)net - offsetof(chan_slot_t, net));
+    if ((slot < tab->slots) || (slot >= tab->slots + tab->entries) ||
+        !(slot->refs & ~CHANNEL_LIVE)) {
+        DBG(NULL);
+        return;
+    }
+    atomicSubU64(&slot->refs, 1);
+}
+
+size_t
+chanTabReclaim(chantab_t *tab)
+{
+    if (!tab || !tab->slots) return 0;
+
+    resetRetired(tab);
+    if (!tab->maxIdle) return 0;
+
+    size_t reclaimed = 0;
+    unsigned int i;
+    for (i = 0; i < tab->entries; i++) {
+        chan_slot_t *slot = &tab->slots[i];
+        if (!slot->key || (getDuration(slot->lastUsed) <= tab->maxIdle)) continue;
+
+        // Only a slot nobody has pinned, and once it isn't live nobody can
+        if (!atomicCasU64(&slot->refs, CHANNEL_LIVE, 0ULL)) continue;
+
+        if (tab->reset) tab->reset(&slot->net);
+        scope_memset(&slot->net, 0, sizeof(slot->net));
+        atomicStoreU64(&slot->key, 0ULL);
+        reclaimed++;
+    }
+
+    if (reclaimed) atomicAddU64(&tab->stats.reclaims, reclaimed);
+    return reclaimed;
+}
+
+net_info *
+chanTabFind(chantab_t const *tab, uint64_t id)
+{
+    if (!tab || !tab->slots || !id) return NULL;
+
+    chan_slot_t *bucket = bucketOf(tab, id);
+    int i;
+    for (i = 0; i < CHANNEL_WAYS; i++) {
+        if ((bucket[i].key != id) || !(bucket[i].refs & CHANNEL_LIVE)) continue;
+        if (tab->maxIdle && (getDuration(bucket[i].lastUsed) > tab->maxIdle)) return NULL;
+        return &bucket[i].net;
+    }
+    return NULL;
+}
+
+void
+chanTabStats(chantab_t const *tab, chantab_stats_t *stats)
+{
+    if (!stats) return;
+    if (!tab) {
+        scope_memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    *stats = tab->stats;
+}
@@ -0,0 +1,72 @@
+#ifndef __CHANTAB_H__
+#define __CHANTAB_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _chantab_t chantab_t;
+
+#include "state.h"
+#include "state_private.h"
+
+// A channel table holds the net_info of TLS/SSL channels that doProtocol()
+// knows by a channel ID rather than by a socket descriptor (Go, Java,
+// gnutls).  It's a fixed number of slots, in buckets of CHANNEL_WAYS; a
+// new channel takes a free slot in its bucket, else the slot of the
+// channel in it used least recently that nothing has pinned.  Each
+// thread remembers the last channel it looked up, which is what
+// consecutive reads and writes on one connection hit.
+//
+// chanTabGet() pins the slot it returns until chanTabPut().  A pinned slot
+// is never taken over, and the net_info of a channel that's evicted is
+// only reset by chanTabReclaim(), from one thread (the periodic thread),
+// which also gives back the slots of channels unused for maxIdle ns.  A
+// slot isn't seen by lookups until its net_info is set up.  A channel ID
+// of zero is never stored.
+//
+
+#define CHANNEL_ENTRIES   ( 512 )
+#define CHANNEL_WAYS      ( 4 )
+#define CHANNEL_MAX_IDLE  ( 300ULL * 1000000000ULL ) // ns
+
+typedef struct {
+    uint64_t lookups;      // chanTabGet() calls
+    uint64_t cacheHits;    // ... found in the thread's last-used channel
+    uint64_t hits;         // ... found in the table
+    uint64_t inserts;      // ... that took a slot for a new channel
+    uint64_t evictions;    // ... that took the slot of another channel
+    uint64_t full;         // ... that found every slot pinned
+    uint64_t reclaims;     // slots given back by chanTabReclaim()
+} chantab_stats_t;
+
+// Called with the net_info of a channel after it's evicted or before its
+// slot is reclaimed, and for each channel when the table is destroyed.
+typedef void (*chan_reset_fn)(net_info *);
+
+// entries is rounded up to a power of two, of at least CHANNEL_WAYS.
+// Slots are allocated on the first chanTabGet().  reset can be NULL.
+// A maxIdle of zero keeps channels until the table is destroyed.
+chantab_t *chanTabCreate(unsigned int entries, uint64_t maxIdle, chan_reset_fn reset);
+void       chanTabDestroy(chantab_t **);
+
+// Returns the net_info of the channel, pinned, taking a slot for it if
+// it's new.  Returns NULL if id is zero, memory can't be had or every
+// slot in the channel's bucket is pinned.  Every net_info returned goes
+// back with chanTabPut().
+net_info  *chanTabGet(chantab_t *, uint64_t id);
+void       chanTabPut(chantab_t *, net_info *);
+
+// Resets the channels evicted since the last call, and gives back the
+// slots of channels unused for more than maxIdle ns.  Returns how many
+// slots it gave back.  Only one thread may call it.
+size_t     chanTabReclaim(chantab_t *);
+
+// Returns the net_info of the channel, or NULL if it isn't in the table or
+// hasn't been looked up with chanTabGet() for more than maxIdle ns.  It
+// isn't pinned; only the thread that calls chanTabReclaim() may use it,
+// and the slot can still be taken over by another channel, so check uid.
+net_info  *chanTabFind(chantab_t const *, uint64_t id);
+
+void       chanTabStats(chantab_t const *, chantab_stats_t *);
+
+#endif // __CHANTAB_H__
@@ -10,30 +10,53 @@
 cbuf_handle_t
 cbufInit(size_t size)
 {
+    if (!size) return NULL;
+
     cbuf_handle_t cbuf = scope_calloc(1, sizeof(struct circbuf_t));
     if (!cbuf) {
         DBG("Circbuf:scope_calloc");
         return NULL;
     }
-    
-    uint64_t *buffer = scope_calloc(size + 1, sizeof(uint64_t));
-    if (!buffer) {
+
+    uint64_t segslots = 1;
+    while ((segslots < size) && (segslots < CBUF_SEG_SLOTS)) segslots <<= 1;
+
+    // One segment more than the entries need.  A put that wraps around to
+    // a segment is then always behind the get that emptied it.
+    uint64_t nsegs = ((size + segslots - 1) / segslots) + 1;
+
+    uint64_t **segs = scope_calloc(nsegs, sizeof(uint64_t *));
+    if (!segs) {
         scope_free(cbuf);
         DBG("Circbuf:scope_calloc");
         return NULL;
     }
 
-    cbufReset(cbuf);
-    cbuf->maxlen = size + 1;
-    cbuf->buffer = buffer;
+    cbuf->segs = segs;
+    cbuf->maxlen = size;
+    cbuf->segslots = segslots;
+    cbuf->nsegs = nsegs;
     return cbuf;
 }
 
+static void
+freeSegments(cbuf_handle_t cbuf)
+{
+    uint64_t i;
+    for (i = 0; i < cbuf->nsegs; i++) {
+        if (cbuf->segs[i]) scope_free(cbuf->segs[i]);
+        cbuf->segs[i] = NULL;
+    }
+    if (cbuf->spare) scope_free(cbuf->spare);
+    cbuf->spare = NULL;
+}
+
 void
 cbufFree(cbuf_handle_t cbuf)
 {
     if (!cbuf) return;
-    if (cbuf->buffer) scope_free(cbuf->buffer);
+    freeSegments(cbuf);
+    scope_free(cbuf->segs);
     scope_free(cbuf);
     return;
 }
@@ -43,87 +66,130 @@ cbufReset(cbuf_handle_t cbuf)
 {
     if (!cbuf) return;
 
+    freeSegments(cbuf);
     cbuf->head = 0;
     cbuf->tail = 0;
+    cbuf->trimmed = 0;
     return;
 }
 
+static uint64_t **
+segmentFor(cbuf_handle_t cbuf, uint64_t pos)
+{
+    return &cbuf->segs[(pos / cbuf->segslots) % cbuf->nsegs];
+}
+
+// Make sure the segment that holds pos is there before it's claimed
+static uint64_t *
+segmentEnsure(cbuf_handle_t cbuf, uint64_t pos)
+{
+    uint64_t **segp = segmentFor(cbuf, pos);
+    uint64_t *seg = (uint64_t *)atomicLoadU64((uint64_t *)segp);
+    if (seg) return seg;
+
+    seg = (uint64_t *)atomicSwapU64((uint64_t *)&cbuf->spare, 0ULL);
+    if (!seg) seg = scope_calloc(cbuf->segslots, sizeof(uint64_t));
+    if (!seg) return NULL;
+
+    if (atomicCasU64((uint64_t *)segp, 0ULL, (uint64_t)seg)) return seg;
+
+    // Another put got there first; keep ours for later
+    if (!atomicCasU64((uint64_t *)&cbuf->spare, 0ULL, (uint64_t)seg)) {
+        scope_free(seg);
+    }
+    return (uint64_t *)atomicLoadU64((uint64_t *)segp);
+}
+
 int
 cbufPut(cbuf_handle_t cbuf, uint64_t data)
 {
-    int head, head_next, attempts, success;
+    uint64_t head, tail;
+    uint64_t *seg;
 
-    if (!cbuf) return -1;
-    attempts = success = 0;
+    if (!cbuf || !data) return -1;
 
     do {
-        head = cbuf->head;
-        head_next = (head + 1) % cbuf->maxlen;
-        if (head_next == cbuf->tail) {
+        head = atomicLoadU64(&cbuf->head);
+        tail = atomicLoadU64(&cbuf->tail);
+        // The tail can pass a head that's gone stale; the cas will fail
+        if ((int64_t)(head - tail) >= (int64_t)cbuf->maxlen) {
             g_cbuf_drop_count++;
             // Note: we commented this out as it caused a
             // double free error when running with 100,000
             // Go routines. We should determine why.
             DBG("maxlen: %"PRIu64, cbuf->maxlen); // Full
-            break;
+            return -1;
         }
-        success = atomicCas32(&cbuf->head, head, head_next);
-    } while (!success && (attempts++ < cbuf->maxlen));
-
-    if (success) {
-        if (cbuf->buffer[head_next] != 0) {
-            // We expect that the entry is not used; has been read
-            DBG(NULL);
+        if (!(seg = segmentEnsure(cbuf, head))) {
+            DBG("Circbuf:scope_calloc");
             return -1;
         }
-        cbuf->buffer[head_next] = data;
-        return 0;
-    }
+    } while (!atomicCasU64(&cbuf->head, head, head + 1));
 
-    return -1;
+    atomicStoreU64(&seg[head & (cbuf->segslots - 1)], data);
+    return 0;
 }
 
 int
 cbufGet(cbuf_handle_t cbuf, uint64_t *data)
 {
-    int tail, tail_next, attempts, success;
+    int rv = -1;
     if (!cbuf || !data) return -1;
 
-    attempts = success = 0;
-
-    do {
-        tail = cbuf->tail;
-        tail_next = (tail + 1) % cbuf->maxlen;
-        if (tail == cbuf->head) break; // Empty
-        success = atomicCas32(&cbuf->tail, tail, tail_next);
-    } while (!success && (attempts++ < cbuf->maxlen));
-
-    if (success) {
-        *data = cbuf->buffer[tail_next];
-        if (*data == 0) {
-            // We expect data before we read
-            // Should we bail out here?
-            DBG(NULL);
+    while (!atomicCasU64(&cbuf->guard, 0ULL, 1ULL));
+
+    uint64_t tail = cbuf->tail;
+    if (tail != atomicLoadU64(&cbuf->head)) {
+        uint64_t **segp = segmentFor(cbuf, tail);
+        uint64_t *seg = (uint64_t *)atomicLoadU64((uint64_t *)segp);
+        uint64_t slot = tail & (cbuf->segslots - 1);
+
+        // Zero is claimed, but not yet written; it's there the next time
+        if (seg && (*data = atomicLoadU64(&seg[slot]))) {
+            // Setting data to 0 to indicate to a put that we're empty
+            seg[slot] = 0ULL;
+
+            // The last of the segment; give it back before the tail
+            // lets a put wrap around to it
+            if (slot == cbuf->segslots - 1) {
+                atomicSwapU64((uint64_t *)segp, 0ULL);
+                if (!atomicCasU64((uint64_t *)&cbuf->spare, 0ULL, (uint64_t)seg)) {
+                    scope_free(seg);
+                }
+            }
+            atomicStoreU64(&cbuf->tail, tail + 1);
+            rv = 0;
         }
-
-        // Setting data to 0 to indicate to a put that we're empty
-        cbuf->buffer[tail_next] = 0ULL;
-        return 0;
     }
 
-    return -1;
+    atomicSwapU64(&cbuf->guard, 0ULL);
+    return rv;
+}
+
+void
+cbufTrim(cbuf_handle_t cbuf)
+{
+    if (!cbuf) return;
+
+    uint64_t head = atomicLoadU64(&cbuf->head);
+    if (head == cbuf->trimmed) {
+        // Idle for a period; what's in use stays, the spare goes
+        uint64_t *seg = (uint64_t *)atomicSwapU64((uint64_t *)&cbuf->spare, 0ULL);
+        if (seg) scope_free(seg);
+    }
+    cbuf->trimmed = head;
 }
 
 size_t
 cbufCapacity(cbuf_handle_t cbuf)
 {
     if (!cbuf) return -1;
-    return cbuf->maxlen - 1;
+    return cbuf->maxlen;
 }
 
 int
 cbufEmpty(cbuf_handle_t cbuf)
 {
-    if (!cbuf || (cbuf->tail == cbuf->head)) return TRUE;
+    if (!cbuf || (atomicLoadU64(&cbuf->tail) == atomicLoadU64(&cbuf->head))) return TRUE;
     return FALSE;
 }
@@ -5,7 +5,7 @@
 
 /*
  * Note:
- * There are 2 things to be aware of with this implementation.
+ * There are 3 things to be aware of with this implementation.
  *
  * 1) There are normally a few utility functions that would be expected
  * with a circular buffer capability. For example, is the buffer empty,
@@ -27,13 +27,32 @@
  * data or should we keep the latest data in a back pressure situation?
  * We have chosen to not support overwrite at this point as it complicates the
  * mult-threaded aspects and we are not sure if it is needed at this point.
+ *
+ * 3) The size given to cbufInit() is a cap, not an allocation.  Entries are
+ * stored in segments of at most CBUF_SEG_SLOTS that are allocated by the
+ * first put to reach them, and given back once a get has emptied them.  One
+ * emptied segment is kept as a spare; cbufTrim() frees it after the buffer
+ * has gone a period without a put.  A buffer that's never used costs only
+ * its handle and its table of segments.
+ *
+ * Any number of threads can put.  Gets are serialized with a guard, so
+ * there can be more than one consumer, but they wait on each other.
+ * Entries must be non-zero; zero marks a slot that is claimed but not yet
+ * written.
  */
 
+#define CBUF_SEG_SLOTS (1024)
+
 typedef struct circbuf_t {
-    uint64_t *buffer;
-    int head;
-    int tail;
-    int maxlen;
+    uint64_t **segs;            // nsegs of them, NULL until a put needs one
+    uint64_t *spare;            // an emptied segment, kept for the next put
+    uint64_t head;              // positions; they only ever increase
+    uint64_t tail;
+    uint64_t maxlen;
+    uint64_t segslots;          // a power of two
+    uint64_t nsegs;
+    uint64_t guard;             // held by a get
+    uint64_t trimmed;           // head as of the last cbufTrim()
 } cbuf_t;
 
 typedef cbuf_t * cbuf_handle_t ;
@@ -44,7 +63,8 @@ cbuf_handle_t cbufInit(size_t size);
 // Free the cbuf itself, not the buffers
 void cbufFree(cbuf_handle_t cbuf);
 
-// Reset to empty, head == tail
+// Reset to empty, head == tail, and give back its segments.
+// Not to be called while others are putting or getting.
 void cbufReset(cbuf_handle_t cbuf);
 
 // Add to the cbuf, if there is room
@@ -55,6 +75,10 @@ int cbufPut(cbuf_handle_t cbuf, uint64_t data);
 // 0 on success, -1 if the buffer is empty
 int cbufGet(cbuf_handle_t cbuf, uint64_t *data);
 
+// Free the spare segment if nothing was put since the last call.
+// Meant to be called by a consumer on a period.
+void cbufTrim(cbuf_handle_t cbuf);
+
 // Returns max capacity of the cbuf
 size_t cbufCapacity(cbuf_handle_t cbuf);
 
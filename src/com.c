@@ -1,7 +1,6 @@
 #define _GNU_SOURCE
 #include <string.h>
 
-#include "atomic.h"
 #include "com.h"
 #include "dbg.h"
 #include "os.h"
@@ -254,7 +253,8 @@ msgStart(proc_id_t *proc, config_t *cfg, which_transport_t who)
     if (who == CFG_LS) {
         if (!cJSON_AddStringToObjLN(json_root, "format", "scope")) goto err;
     } else {
-        if (!cJSON_AddStringToObjLN(json_root, "format", "ndjson")) goto err;
+        const char *format = (cfgEventFormat(cfg) == CFG_FMT_BINARY) ? "binary" : "ndjson";
+        if (!cJSON_AddStringToObjLN(json_root, "format", format)) goto err;
         if (checkEnv("SCOPE_CRIBL_NO_BREAKER", "true")) {
                 if (!cJSON_AddStringToObjLN(json_root, "breaker",
                                     "Cribl - Do Not Break Ruleset")) goto err;
@@ -286,126 +286,47 @@ msgEventGet(ctl_t *ctl)
     return ctlGetEvent(ctl);
 }
 
-// We saw a performance issue with malloc/free of memory
-// used for stacks in pcre2_match_wrapper and regexec_wrapper.
-// Every malloc was an mmap, every free an unmmap (both syscalls).
-//
-// To address this, have a lazily-allocated pool of stacks.
-// Once allocated, never free stacks in this pool, instead just
-// keep track of whether each stack is available for reuse.
-
-// Why 48? Primarily to support 48 concurrent threads,
-// but also to provide some slop. Slop for the unlikely case
-// where a thread is killed asynchronously while the stack
-// is marked as used.  When this happens we'll lose the
-// ability to reuse that stack for the life of this process.
-
-#define POOL_MAX 48
-typedef struct {
-    uint64_t used;
-    char *addr;
-} pool_t;
-
-static pool_t g_stack_pool[POOL_MAX] = {0};
-
-static bool
-grab_unused(pool_t *entry)
-{
-    // Done atomically so two concurrent threads will never try
-    // to use a stack at one time.
-    return atomicCasU64(&entry->used, (uint64_t)FALSE, (uint64_t)TRUE);
-}
-
-static char *
-get_stack(void)
-{
-    int i;
-    for (i=0; i<POOL_MAX; i++) {
-        pool_t *entry = &g_stack_pool[i];
-
-        if (!entry->used && grab_unused(entry)) {
-
-            // Sweet!  Our thread grabbed an allocated spot!
-            if (entry->addr) return entry->addr;
-
-            // We have a spot, but we need to allocate a stack here.
-            entry->addr = scope_malloc(PCRE_STACK_SIZE);
-            if (entry->addr) return entry->addr;
-
-            // We got a spot, but our malloc failed. Put the spot back
-            // into the unused pool. Stop looping if this happens.
-            if (!atomicCasU64(&entry->used, (uint64_t)TRUE, (uint64_t)FALSE)) {
-                 scopeLogError("get_stack failed to set used to FALSE");
-            }
-            break;
-        }
-    }
-
-    // Our attempt to use the pool failed.
-    // All pool entries were probably in use.
-    // As a fall-back, do an allocation that's not from the pool
-    return scope_malloc(PCRE_STACK_SIZE);
-}
-
-static void
-free_stack(char *addr)
-{
-    int i;
-    for (i=0; i<POOL_MAX; i++) {
-        pool_t *entry = &g_stack_pool[i];
-
-        if (entry->addr == addr) {
-
-            // Addr is in the pool. Don't free addr, but set used to false
-            // to allow reuse.
-            if (!atomicCasU64(&entry->used, (uint64_t)TRUE, (uint64_t)FALSE)) {
-                 scopeLogError("free_stack failed to set used to FALSE");
-            }
-            return;
-        }
-    }
-
-    // We didn't find this addr in the pool.
-    // It must not be from the pool.  Free it.
-    scope_free(addr);
-}
-
-
-int
-pcre2_match_wrapper(pcre2_code *re, PCRE2_SPTR data, PCRE2_SIZE size,
-                    PCRE2_SIZE startoffset, uint32_t options,
-                    pcre2_match_data *match_data, pcre2_match_context *mcontext)
+// pcre2 wants more stack than a Go stack has, so matches are run on a
+// stack of our own, which comes with the pcre_ctx_t of the calling thread
+// (see pcrectx.h).  That used to be a stack borrowed from a pool of 48,
+// where threads beyond the 48th paid for a malloc and free (an mmap and
+// munmap) of a stack on every match.
+static __attribute__((noinline)) int
+matchOnStack(pcre_ctx_t *ctx, const pcre2_code *re, PCRE2_SPTR data, PCRE2_SIZE size,
+             PCRE2_SIZE startoffset, uint32_t options,
+             pcre2_match_data *match_data, pcre2_match_context *mcontext)
 {
     int rc;
-    char *pcre_stack = NULL, *tstack = NULL, *gstack = NULL;
-    if ((pcre_stack = get_stack()) == NULL) {
-        scopeLogError("ERROR; pcre2_match_wrapper: get_stack");
-        return -1;
-    }
+    char *tstack = NULL;
 
-    tstack = pcre_stack + PCRE_STACK_SIZE;
+    tstack = pcreCtxStack(ctx);
+    if (!mcontext) mcontext = pcreCtxMatchContext(ctx);
 
     // save the original stack, switch to the tstack
 #if defined (__x86_64__)
-    int arc;
+    // It's all one block so nothing is addressed relative to %rsp while
+    // it points at tstack; that can happen at -O2.  The 7th argument goes
+    // on tstack, which is left 16 byte aligned for the call.
+    register uint64_t arg5 __asm__("r8") = options;
+    register pcre2_match_data *arg6 __asm__("r9") = match_data;
 
     __asm__ volatile (
-        "mov %%rsp, %2 \n"
-        "mov %1, %%rsp \n"
-        : "=r"(arc)                     // output
-        : "m"(tstack), "m"(gstack)      // input
-        :                               // clobbered register
-        );
-
-    rc = pcre2_match(re, data, size, startoffset, options, match_data, mcontext);
-
-    __asm__ volatile (
-        "mov %1, %%rsp \n"
-        : "=r"(arc)                       // output
-        : "r"(gstack)                     // inputs
-        :                                 // clobbered register
+        "mov  %%rsp, %%r12 \n"
+        "mov  %[tstack], %%rsp \n"
+        "sub  $8, %%rsp \n"
+        "push %[mcontext] \n"
+        "call pcre2_match_8@PLT \n"
+        "mov  %%r12, %%rsp \n"
+        : "=a"(rc), "+D"(re), "+S"(data), "+d"(size), "+c"(startoffset),
+          "+r"(arg5), "+r"(arg6)
+        : [tstack] "r"(tstack), [mcontext] "r"(mcontext)
+        : "r10", "r11", "r12", "memory", "cc",
+          "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+          "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"
         );
 #elif defined (__aarch64__)
+    char *gstack = NULL;
+
     __asm__ volatile (
         "ldr  x0, %3 \n"                 // get params from the stack before switching
         "ldr  x1, %4 \n"
@@ -434,71 +355,84 @@ pcre2_match_wrapper(pcre2_code *re, PCRE2_SPTR data, PCRE2_SIZE size,
    #error Bad arch defined
 #endif
 
-    if (pcre_stack) free_stack(pcre_stack);
     return rc;
 }
 
 int
-regexec_wrapper(const regex_t *preg, const char *string, size_t nmatch,
-                regmatch_t *pmatch, int eflags)
+pcre2_match_wrapper(pcre2_code *re, PCRE2_SPTR data, PCRE2_SIZE size,
+                    PCRE2_SIZE startoffset, uint32_t options,
+                    pcre2_match_data *match_data, pcre2_match_context *mcontext)
 {
-    int rc;
-    char *pcre_stack = NULL, *tstack = NULL, *gstack = NULL;
-
-     if ((pcre_stack = get_stack()) == NULL) {
-        scopeLogError("ERROR; regexec_wrapper: get_stack");
+    pcre_ctx_t *ctx;
+    if ((ctx = pcreCtxAcquire()) == NULL) {
+        scopeLogError("ERROR; pcre2_match_wrapper: pcreCtxAcquire");
         return -1;
     }
 
-    tstack = pcre_stack + PCRE_STACK_SIZE;
-
-    // save the original stack, switch to the tstack
-#if defined (__x86_64__)
-    int arc;
+    int rc = matchOnStack(ctx, re, data, size, startoffset, options, match_data, mcontext);
 
-    __asm__ volatile (
-        "mov %%rsp, %2 \n"
-        "mov %1, %%rsp \n"
-        : "=r"(arc)                     // output
-        : "m"(tstack), "m"(gstack)      // input
-        :                               // clobbered register
-        );
+    pcreCtxRelease(ctx);
+    return rc;
+}
 
-    rc = regexec(preg, string, nmatch, pmatch, eflags);
+/*
+ * What pcre2_regexec() does, but with the context's match data rather
+ * than the one made by regcomp(), which all threads would share.
+ */
+int
+regexec_wrapper(const regex_t *preg, const char *string, size_t nmatch,
+                regmatch_t *pmatch, int eflags)
+{
+    if (!preg || !string) return REG_INVARG;
+
+    const pcre2_code *re = preg->re_pcre2_code;
+    uint32_t options = 0;
+    if (eflags & REG_NOTBOL) options |= PCRE2_NOTBOL;
+    if (eflags & REG_NOTEOL) options |= PCRE2_NOTEOL;
+    if (eflags & REG_NOTEMPTY) options |= PCRE2_NOTEMPTY;
+    if ((preg->re_cflags & REG_NOSUB) || !pmatch) nmatch = 0;
+
+    int so = 0, eo;
+    if (eflags & REG_STARTEND) {
+        if (!pmatch) return REG_INVARG;
+        so = pmatch[0].rm_so;
+        eo = pmatch[0].rm_eo;
+    } else {
+        eo = scope_strlen(string);
+    }
 
-    __asm__ volatile (
-        "mov %1, %%rsp \n"
-        : "=r"(arc)                       // output
-        : "r"(gstack)                     // inputs
-        :                                 // clobbered register
-        );
-#elif defined (__aarch64__)
-    __asm__ volatile (
-        "ldr  x0, %3 \n"                 // get params from the stack before switching
-        "ldr  x1, %4 \n"
-        "ldr  x2, %5 \n"
-        "ldr  x3, %6 \n"
-        "ldr  w4, %7 \n"
-        "mov  x14, sp \n"
-        "str  x14, %2 \n"
-        "ldr  x15, %1 \n"
-        "mov  sp, x15 \n"                // increase stack size
+    pcre_ctx_t *ctx;
+    pcre2_match_data *md;
+    if ((ctx = pcreCtxAcquire()) == NULL) {
+        scopeLogError("ERROR; regexec_wrapper: pcreCtxAcquire");
+        return -1;
+    }
+    if ((md = pcreCtxMatchData(ctx, re)) == NULL) {
+        pcreCtxRelease(ctx);
+        return REG_ESPACE;
+    }
 
-        "str  x14, [sp, #-16]! \n"
+    int rc = matchOnStack(ctx, re, (PCRE2_SPTR)string + so, eo - so, 0, options, md, NULL);
 
-        "bl   pcre2_regexec \n"          // call the regexec function
-        "ldr x15, [sp, #0] \n"
-        "mov  sp, x15 \n"
-        "str  w0, %0 \n"                 // save the return value
-        : "=&m"(rc)                      // output
-        : "m"(tstack), "m"(gstack), "m" (preg), "m" (string),"m" (nmatch), "m" (pmatch), "m" (eflags)
-        :                               // clobbered register
-        );
-#else
-   #error Bad arch defined
-#endif
+    if (rc >= 0) {
+        PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(md);
+        size_t i;
+        if ((size_t)rc > nmatch) rc = (int)nmatch;
+        for (i = 0; i < (size_t)rc; i++) {
+            pmatch[i].rm_so = (ovector[i*2] == PCRE2_UNSET) ? -1 : (int)(ovector[i*2] + so);
+            pmatch[i].rm_eo = (ovector[i*2+1] == PCRE2_UNSET) ? -1 : (int)(ovector[i*2+1] + so);
+        }
+        for (; i < nmatch; i++) pmatch[i].rm_so = pmatch[i].rm_eo = -1;
+        rc = 0;
+    } else if (rc == PCRE2_ERROR_NOMATCH) {
+        rc = REG_NOMATCH;
+    } else if ((rc == PCRE2_ERROR_MATCHLIMIT) || (rc == PCRE2_ERROR_NOMEMORY)) {
+        rc = REG_ESPACE;
+    } else {
+        rc = REG_ASSERT;
+    }
 
-    if (pcre_stack) free_stack(pcre_stack);
+    pcreCtxRelease(ctx);
     return rc;
 }
 
@@ -15,8 +15,7 @@
 #include "scopetypes.h"
 #include "runtimecfg.h"
 #include "pcre2.h"
-
-#define PCRE_STACK_SIZE (32 * 1024)
+#include "pcrectx.h"
 
 extern unsigned g_sendprocessstart;
 extern bool g_exitdone;
@@ -0,0 +1,256 @@
+#define _GNU_SOURCE
+#include "atomic.h"
+#include "compress.h"
+#include "dbg.h"
+#include "scopestdlib.h"
+#include "zstd.h"
+
+// Fast, since it's done on the periodic thread, with a window small
+// enough to keep the context around 1MB.
+#define COMPRESS_ZSTD_LEVEL     (1)
+#define COMPRESS_ZSTD_WINDOWLOG (18)
+#define COMPRESS_MIN_PENDING    (64 * 1024)
+
+struct _compress_t
+{
+    cfg_compress_t type;
+    ZSTD_CCtx *cctx;
+
+    // Appended by any thread, under guard
+    uint64_t guard;
+    char *pending;
+    size_t pending_len;
+    size_t pending_size;
+    size_t pending_ahead;   // how much of pending was appended ahead
+    uint64_t reset;         // start a new frame at the next flush
+
+    // Only used by the thread that holds flushing
+    uint64_t flushing;
+    char *work;             // what pending was, swapped at each flush
+    size_t work_size;
+    char *out;
+    size_t out_size;
+
+    compress_stats_t stats;
+};
+
+compress_t *
+compressCreate(cfg_compress_t type)
+{
+    if (type != CFG_COMPRESS_ZSTD) return NULL;
+
+    compress_t *c = scope_calloc(1, sizeof(compress_t));
+    if (!c) {
+        DBG(NULL);
+        return NULL;
+    }
+    c->type = type;
+
+    c->cctx = ZSTD_createCCtx();
+    if (!c->cctx ||
+        ZSTD_isError(ZSTD_CCtx_setParameter(c->cctx, ZSTD_c_compressionLevel, COMPRESS_ZSTD_LEVEL)) ||
+        ZSTD_isError(ZSTD_CCtx_setParameter(c->cctx, ZSTD_c_windowLog, COMPRESS_ZSTD_WINDOWLOG)) ||
+        ZSTD_isError(ZSTD_CCtx_setParameter(c->cctx, ZSTD_c_checksumFlag, 0))) {
+        DBG(NULL);
+        compressDestroy(&c);
+        return NULL;
+    }
+
+    return c;
+}
+
+void
+compressDestroy(compress_t **compress)
+{
+    if (!compress || !*compress) return;
+    compress_t *c = *compress;
+
+    if (c->cctx) ZSTD_freeCCtx(c->cctx);
+    if (c->pending) scope_free(c->pending);
+    if (c->work) scope_free(c->work);
+    if (c->out) scope_free(c->out);
+
+    scope_free(c);
+    *compress = NULL;
+}
+
+// Makes room for needed bytes in pending.  Called under guard.
+static int
+reserve(compress_t *c, size_t needed)
+{
+    if (needed > COMPRESS_MAX_PENDING) return -1;
+    if (needed <= c->pending_size) return 0;
+
+    size_t size = (c->pending_size) ? c->pending_size : COMPRESS_MIN_PENDING;
+    while (size < needed) size *= 2;
+    if (size > COMPRESS_MAX_PENDING) size = COMPRESS_MAX_PENDING;
+
+    char *pending = scope_realloc(c->pending, size);
+    if (!pending) {
+        DBG(NULL);
+        return -1;
+    }
+    c->pending = pending;
+    c->pending_size = size;
+    return 0;
+}
+
+// Puts msg in pending at offset, moving what's there behind it.  Called
+// under guard.
+static int
+insert(compress_t *c, size_t offset, const char *msg, size_t len)
+{
+    if (reserve(c, c->pending_len + len)) {
+        c->stats.dropped += len;
+        return -1;
+    }
+
+    scope_memmove(c->pending + offset + len, c->pending + offset, c->pending_len - offset);
+    scope_memcpy(c->pending + offset, msg, len);
+    c->pending_len += len;
+    return 0;
+}
+
+int
+compressAppend(compress_t *c, const char *msg, size_t len)
+{
+    if (!c || !msg) return -1;
+    if (!len) return 0;
+
+    while (!atomicCasU64(&c->guard, 0ULL, 1ULL));
+    int rc = insert(c, c->pending_len, msg, len);
+    atomicStoreU64(&c->guard, 0ULL);
+    return rc;
+}
+
+int
+compressAppendAhead(compress_t *c, const char *msg, size_t len)
+{
+    if (!c || !msg) return -1;
+    if (!len) return 0;
+
+    while (!atomicCasU64(&c->guard, 0ULL, 1ULL));
+    int rc = insert(c, c->pending_ahead, msg, len);
+    if (!rc) c->pending_ahead += len;
+    atomicStoreU64(&c->guard, 0ULL);
+    return rc;
+}
+
+void
+compressReset(compress_t *c)
+{
+    if (!c) return;
+
+    while (!atomicCasU64(&c->guard, 0ULL, 1ULL));
+    c->reset = TRUE;
+
+    // What was ahead was for the receiver of the last frame
+    scope_memmove(c->pending, c->pending + c->pending_ahead,
+                  c->pending_len - c->pending_ahead);
+    c->pending_len -= c->pending_ahead;
+    c->pending_ahead = 0;
+    atomicStoreU64(&c->guard, 0ULL);
+}
+
+// Puts what couldn't be sent back in pending, behind what's ahead there
+// now and ahead of what was appended since it was taken.
+static void
+requeue(compress_t *c, const char *msg, size_t len)
+{
+    if (!len) return;
+
+    while (!atomicCasU64(&c->guard, 0ULL, 1ULL));
+    insert(c, c->pending_ahead, msg, len);
+    atomicStoreU64(&c->guard, 0ULL);
+}
+
+int
+compressFlush(compress_t *c, compress_send_fn send, void *arg)
+{
+    if (!c || !send) return -1;
+
+    // Someone else is already at it, e.g. the periodic thread at exit
+    if (!atomicCasU64(&c->flushing, 0ULL, 1ULL)) return 0;
+
+    // Take what's pending, leaving the buffer we had last time to fill
+    while (!atomicCasU64(&c->guard, 0ULL, 1ULL));
+    char *work = c->pending;
+    size_t work_size = c->pending_size;
+    size_t len = c->pending_len;
+    size_t ahead = c->pending_ahead;
+    bool reset = c->reset;
+    c->pending = c->work;
+    c->pending_size = c->work_size;
+    c->pending_len = 0;
+    c->pending_ahead = 0;
+    c->reset = FALSE;
+    atomicStoreU64(&c->guard, 0ULL);
+    c->work = work;
+    c->work_size = work_size;
+
+    int rc = 0;
+    if (reset) {
+        ZSTD_CCtx_reset(c->cctx, ZSTD_reset_session_only);
+    }
+    if (!len) goto out;
+
+    // Big enough for all of it, however it compresses
+    size_t bound = ZSTD_compressBound(len) + ZSTD_CStreamOutSize();
+    if (bound > c->out_size) {
+        char *out = scope_realloc(c->out, bound);
+        if (!out) {
+            DBG(NULL);
+            rc = -1;
+            goto fail;
+        }
+        c->out = out;
+        c->out_size = bound;
+    }
+
+    ZSTD_inBuffer in = {c->work, len, 0};
+    ZSTD_outBuffer out = {c->out, c->out_size, 0};
+    size_t remaining;
+    do {
+        remaining = ZSTD_compressStream2(c->cctx, &out, &in, ZSTD_e_flush);
+        if (ZSTD_isError(remaining)) {
+            DBG("%s", ZSTD_getErrorName(remaining));
+            rc = -1;
+            goto fail;
+        }
+    } while (remaining && (out.pos < out.size));
+
+    if (remaining) {
+        DBG("%zu", remaining);
+        rc = -1;
+        goto fail;
+    }
+
+    if (send(arg, c->out, out.pos)) {
+        rc = -1;
+        goto fail;
+    }
+    atomicAddU64(&c->stats.in, len);
+    atomicAddU64(&c->stats.out, out.pos);
+    goto out;
+
+fail:
+    // The receiver may have part of a block; what follows is a new frame.
+    // What was ahead was for this receiver, the rest is sent to the next.
+    ZSTD_CCtx_reset(c->cctx, ZSTD_reset_session_only);
+    requeue(c, c->work + ahead, len - ahead);
+out:
+    atomicStoreU64(&c->flushing, 0ULL);
+    return rc;
+}
+
+compress_stats_t
+compressStats(compress_t *c)
+{
+    compress_stats_t stats = {0};
+    if (!c) return stats;
+
+    stats.in = atomicLoadU64(&c->stats.in);
+    stats.out = atomicLoadU64(&c->stats.out);
+    stats.dropped = atomicLoadU64(&c->stats.dropped);
+    return stats;
+}
@@ -0,0 +1,47 @@
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+#include <stddef.h>
+#include <stdint.h>
+#include "scopetypes.h"
+
+// Streaming compression of what's sent over a transport (transport >
+// compression: zstd).  Any thread may append data; it's copied into a
+// pending buffer and nothing more.  The periodic thread compresses what's
+// pending in compressFlush(), which ends the block so that everything
+// appended so far can be decompressed by the receiver, and hands the
+// output to the given function to send.  If it can't be sent, what was
+// taken from pending is put back, ahead of what was appended since, less
+// what was appended ahead of it.
+//
+// One frame spans a connection.  compressAppendAhead() puts a message
+// ahead of everything else appended for the frame, e.g. what comes first
+// on a connection.  compressReset() starts a new frame at the next flush;
+// it's for when the receiver won't have seen the frame so far, e.g. after
+// a reconnect.  What's pending is kept for the new frame, except what was
+// appended ahead for the last one.
+
+// What's pending beyond this is dropped until the next flush
+#define COMPRESS_MAX_PENDING (4 * 1024 * 1024)
+
+typedef struct _compress_t compress_t;
+
+typedef int (*compress_send_fn)(void *, const char *, size_t);
+
+typedef struct {
+    uint64_t in;        // bytes sent, before they were compressed
+    uint64_t out;       // bytes sent, as they were compressed
+    uint64_t dropped;   // uncompressed bytes, dropped when pending was full
+} compress_stats_t;
+
+// Constructors Destructors
+compress_t *        compressCreate(cfg_compress_t);
+void                compressDestroy(compress_t **);
+
+// Accessors
+int                 compressAppend(compress_t *, const char *, size_t);
+int                 compressAppendAhead(compress_t *, const char *, size_t);
+int                 compressFlush(compress_t *, compress_send_fn, void *);
+void                compressReset(compress_t *);
+compress_stats_t    compressStats(compress_t *);
+
+#endif // __COMPRESS_H__
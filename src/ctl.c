@@ -5,12 +5,14 @@
 #include <string.h>
 #include <sys/time.h>
 
+#include "atomic.h"
 #include "circbuf.h"
 #include "cfgutils.h"
 #include "com.h"
 #include "ctl.h"
 #include "dbg.h"
 #include "com.h"
+#include "evtbin.h"
 #include "evtutils.h"
 #include "fn.h"
 #include "state.h"
@@ -50,6 +52,14 @@ struct _ctl_t
 
     evt_fmt_t *evt;
     cbuf_handle_t events;
+
+    // Only for event > format: binary.  Its dictionary is only good for
+    // as long as the connection it's been sent over.
+    struct {
+        evt_bin_t *enc;
+        uint64_t connections;
+    } bin;
+
     unsigned enhancefs;
     bool allow_binary_console;
     bool stop_aggregating;
@@ -66,6 +76,9 @@ struct _ctl_t
         // and how long to aggregate without reporting
         unsigned long max_agg_bytes;
         unsigned long flush_period_in_ms;
+
+        // how many of streamAgg are open
+        unsigned aggregating;
     } log;
 
     struct {
@@ -77,6 +90,13 @@ struct _ctl_t
 
     // Temporary, I believe...  only used for command/response w/cribl
     cbuf_handle_t msgbuf;
+
+    // The eventfd of the thread that empties the queues above.  Once
+    // armed, the first entry queued writes it, and disarms it.
+    struct {
+        int fd;
+        uint64_t armed;
+    } wake;
 };
 
 typedef struct {
@@ -546,37 +566,98 @@ prepMessage(upload_t *upld)
     return streamMsg;
 }
 
-char *
-ctlCreateTxMsg(upload_t *upld)
+static cJSON *
+createTxJson(upload_t *upld)
 {
-    cJSON *json = NULL;
-    char *msg = NULL;
-
-    if (!upld) goto out;
+    if (!upld) return NULL;
 
     switch (upld->type) {
         case UPLD_INFO:
-            json = create_info_json(upld);
-            break;
+            return create_info_json(upld);
         case UPLD_RESP:
-            json = create_resp_json(upld);
-            break;
+            return create_resp_json(upld);
         case UPLD_EVT:
-            json = create_evt_json(upld);
-            break;
+            return create_evt_json(upld);
         default:
             DBG(NULL);
-            goto out;
     }
-    if (!json) goto out;
+    return NULL;
+}
 
-    msg = cJSON_PrintUnformatted(json);
+char *
+ctlCreateTxMsg(upload_t *upld)
+{
+    char *msg = NULL;
 
-out:
-    if (json) cJSON_Delete(json);
+    cJSON *json = createTxJson(upld);
+    if (!json) return NULL;
+
+    msg = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
     return msg;
 }
 
+static evt_bin_t *
+binEncoder(ctl_t *ctl)
+{
+    // Anything sent before this connection was made went somewhere else,
+    // or nowhere, so the stream (and its dictionary) starts over.
+    uint64_t connections = transportConnections(ctl->transport);
+    if (connections != ctl->bin.connections) {
+        evtBinReset(ctl->bin.enc);
+        ctl->bin.connections = connections;
+    }
+    return ctl->bin.enc;
+}
+
+static int
+binSend(ctl_t *ctl, transport_t *trans, const char *rec, size_t len)
+{
+    if (!rec) return -1;
+
+    int rc = transportSend(trans, rec, len);
+
+    // The record may not have made it, nor a string it defined
+    if (rc) evtBinReset(ctl->bin.enc);
+    return rc;
+}
+
+// send an upload over the event transport, in the configured format
+static int
+sendUpload(ctl_t *ctl, upload_t *upld)
+{
+    int rc = -1;
+
+    if (ctl->bin.enc) {
+        cJSON *json = createTxJson(upld);
+        if (!json) return -1;
+
+        size_t len;
+        const char *rec = evtBinEncode(binEncoder(ctl), json, &len);
+        rc = binSend(ctl, ctl->transport, rec, len);
+        cJSON_Delete(json);
+        return rc;
+    }
+
+    char *msg = prepMessage(upld);
+    if (!msg) return -1;
+
+    rc = transportSend(ctl->transport, msg, scope_strlen(msg));
+    scope_free(msg);
+    return rc;
+}
+
+static void
+wakeup(ctl_t *ctl)
+{
+    // Cheap when disarmed, which is all the while the thread is busy
+    if (!ctl->wake.armed || (ctl->wake.fd == -1)) return;
+    if (!atomicCasU64(&ctl->wake.armed, 1ULL, 0ULL)) return;
+
+    uint64_t one = 1;
+    if (scope_write(ctl->wake.fd, &one, sizeof(one)) == -1) DBG(NULL);
+}
+
 ctl_t *
 ctlCreate(void)
 {
@@ -586,16 +667,8 @@ ctlCreate(void)
         goto err;
     }
 
-    size_t buf_size = DEFAULT_CBUF_SIZE;
-    char *qlen_str;
-    if ((qlen_str = fullGetEnv("SCOPE_QUEUE_LENGTH")) != NULL) {
-        unsigned long qlen;
-        scope_errno = 0;
-        qlen = scope_strtoul(qlen_str, NULL, 10);
-        if (!scope_errno && qlen) {
-            buf_size = qlen;
-        }
-    }
+    // Segments are only allocated as these fill, so the cap costs nothing
+    size_t buf_size = queueLength();
 
     ctl->log.ringbuf = cbufInit(buf_size);
     if (!ctl->log.ringbuf) {
@@ -636,6 +709,8 @@ ctlCreate(void)
         goto err;
     }
 
+    ctl->wake.fd = -1;
+
     return ctl;
 err:
     ctlDestroy(&ctl);
@@ -662,6 +737,7 @@ ctlDestroy(ctl_t **ctl)
 
     cbufFree((*ctl)->payload.ringbuf);
 
+    evtBinDestroy(&(*ctl)->bin.enc);
     transportDestroy(&(*ctl)->transport);
     transportDestroy(&(*ctl)->paytrans);
     evtFormatDestroy(&(*ctl)->evt);
@@ -683,7 +759,9 @@ ctlSendMsg(ctl_t *ctl, char *msg)
         // Full; drop and ignore
         DBG(NULL);
         scope_free(msg);
+        return;
     }
+    wakeup(ctl);
 }
 
 // send raw json (no envelope/messaging protocol), no buffering
@@ -696,15 +774,24 @@ ctlSendJson(ctl_t *ctl, cJSON *json, which_transport_t who)
         return -1;
     }
 
-    char *msg = cJSON_PrintUnformatted(json);
-
     int rc = -1;
 
+    if ((who != CFG_LS) && ctl->bin.enc) {
+        size_t len;
+        const char *rec = evtBinEncode(binEncoder(ctl), json, &len);
+        rc = binSend(ctl, ctl->transport, rec, len);
+        cJSON_Delete(json);
+        return rc;
+    }
+
+    char *msg = cJSON_PrintUnformatted(json);
+
     if (msg && ((msg = msgAddNewLine(msg)) != NULL)) {
         if (who == CFG_LS) {
             rc = transportSend(ctl->paytrans, msg, scope_strlen(msg));
         } else {
-            rc = transportSend(ctl->transport, msg, scope_strlen(msg));
+            // e.g. the process start message, which comes first on a connection
+            rc = transportSendAhead(ctl->transport, msg, scope_strlen(msg));
         }
     }
 
@@ -754,8 +841,6 @@ ctlPostMsg(ctl_t *ctl, cJSON *body, upload_type_t type, request_t *req, bool now
 int
 ctlSendHttp(ctl_t *ctl, event_t *evt, uint64_t uid, proc_id_t *proc)
 {
-    int rc;
-    char *streamMsg;
     cJSON *json;
     upload_t upld;
 
@@ -770,18 +855,12 @@ ctlSendHttp(ctl_t *ctl, event_t *evt, uint64_t uid, proc_id_t *proc)
     upld.req = NULL;
     upld.uid = uid;
     upld.proc = proc;
-    streamMsg = prepMessage(&upld);
-
-    rc = transportSend(ctl->transport, streamMsg, scope_strlen(streamMsg));
-    if (streamMsg) scope_free(streamMsg);
-    return rc;
+    return sendUpload(ctl, &upld);
 }
 
 int
 ctlSendEvent(ctl_t *ctl, event_t *evt, uint64_t uid, proc_id_t *proc)
 {
-    int rc;
-    char *streamMsg;
     cJSON *json;
     upload_t upld;
 
@@ -796,12 +875,7 @@ ctlSendEvent(ctl_t *ctl, event_t *evt, uint64_t uid, proc_id_t *proc)
     upld.req = NULL;
     upld.uid = uid;
     upld.proc = proc;
-    streamMsg = prepMessage(&upld);
-
-    rc = transportSend(ctl->transport, streamMsg, scope_strlen(streamMsg));
-    if (streamMsg) scope_free(streamMsg);
-    return rc;
-
+    return sendUpload(ctl, &upld);
 }
 
 int
@@ -819,11 +893,12 @@ ctlPostEvent(ctl_t *ctl, char *event)
         evtFree((evt_type *)event);
         return -1;
     }
+    wakeup(ctl);
     return 0;
 }
 
 static log_event_t *
-createInternalLogEvent(int fd, const char *path, const void *buf, size_t count, uint64_t uid, proc_id_t *proc, watch_t logType, regex_t *valfilter)
+createInternalLogEvent(int fd, const char *path, const void *buf, size_t count, uint64_t uid, proc_id_t *proc, watch_t logType, evt_filter_t *valfilter)
 {
     log_event_t *event = scope_calloc(1, sizeof(*event));
     char *data = scope_malloc(count);
@@ -885,15 +960,15 @@ ctlSendLog(ctl_t *ctl, int fd, const char *path, const void *buf, size_t count,
 {
     if (!ctl || !path || !buf || !proc) return -1;
 
-    regex_t *filter;
+    evt_filter_t *filter;
     watch_t logType;
     if (evtFormatSourceEnabled(ctl->evt, CFG_SRC_CONSOLE) &&
        (filter = evtFormatNameFilter(ctl->evt, CFG_SRC_CONSOLE)) &&
-       (!regexec_wrapper(filter, path, 0, NULL, 0))) {
+       (evtFilterMatch(filter, path))) {
         logType = CFG_SRC_CONSOLE;
     } else if (evtFormatSourceEnabled(ctl->evt, CFG_SRC_FILE) &&
        (filter = evtFormatNameFilter(ctl->evt, CFG_SRC_FILE)) &&
-       (!regexec_wrapper(filter, path, 0, NULL, 0))) {
+       (evtFilterMatch(filter, path))) {
         logType = CFG_SRC_FILE;
     } else {
         return 0;
@@ -933,6 +1008,7 @@ ctlSendLog(ctl_t *ctl, int fd, const char *path, const void *buf, size_t count,
         destroyInternalLogEvent(&logevent);
         return -1;
     }
+    wakeup(ctl);
     return 0;
 }
 
@@ -952,6 +1028,7 @@ createLogEventJson(ctl_t *ctl, streambuf_t *stmbuf)
 
     scope_fclose(stmbuf->stream);  // updates stmbuf->buf, stmbuf->bufsize
     stmbuf->stream = NULL;
+    ctl->log.aggregating--;
 
     if (!(root = cJSON_CreateObject())) goto out;
     if (!(data = cJSON_CreateStringFromBuffer(stmbuf->buf, stmbuf->bufsize))) goto out;
@@ -959,8 +1036,8 @@ createLogEventJson(ctl_t *ctl, streambuf_t *stmbuf)
     event.data = root;
 
     if (data && data->valuestring) {
-        regex_t *filter = stmbuf->id.valuefilter;
-        if (filter && regexec_wrapper(filter, data->valuestring, 0, NULL, 0)) {
+        evt_filter_t *filter = stmbuf->id.valuefilter;
+        if (filter && !evtFilterMatch(filter, data->valuestring)) {
             // This event doesn't match.  Drop it on the floor.
             goto out;
         }
@@ -988,6 +1065,14 @@ sendBufferedMessages(ctl_t *ctl)
         if (data) {
             char *msg = (char*) data;
 
+            if (ctl->bin.enc) {
+                size_t len;
+                const char *rec = evtBinEncodeText(binEncoder(ctl), msg, &len);
+                binSend(ctl, ctl->transport, rec, len);
+                scope_free(msg);
+                continue;
+            }
+
             // Add the newline delimiter to the msg.
             {
                 int strsize = scope_strlen(msg);
@@ -1022,12 +1107,9 @@ sendAggregatedLogData(ctl_t *ctl, streambuf_t *stmbuf)
     upld.req = NULL;
     upld.proc = stmbuf->id.proc;
     upld.uid = stmbuf->id.uid;
-    char *msg = prepMessage(&upld);
-    if (!msg) return;
 
     // Send it.
-    transportSend(ctl->transport, msg, scope_strlen(msg));
-    scope_free(msg);
+    sendUpload(ctl, &upld);
 }
 
 static void
@@ -1086,6 +1168,7 @@ ctlFlushLog(ctl_t *ctl)
                 if (!stmbuf->stream) {
                     DBG("log buffer create error for fd %d, path %s", event->fd, event->id.path);
                 } else {
+                    ctl->log.aggregating++;
                     stmbuf->id = event->id;
                     event->id.path = NULL; // Tranferring alloc'd path from event to stmbuf.
                 }
@@ -1173,6 +1256,16 @@ ctlConnect(ctl_t *ctl, which_transport_t who)
         transportConnect(ctl->transport);
 }
 
+uint64_t
+ctlConnectWaitMs(ctl_t *ctl, which_transport_t who)
+{
+    if (!ctl) return 0;
+
+    return (who == CFG_LS) ?
+        transportConnectWaitMs(ctl->paytrans) :
+        transportConnectWaitMs(ctl->transport);
+}
+
 int
 ctlDisconnect(ctl_t *ctl, which_transport_t who)
 {
@@ -1188,6 +1281,9 @@ ctlReconnect(ctl_t *ctl, which_transport_t who)
 {
     if (!ctl) return 0;
 
+    // After a fork, the child's records can't be in the parent's stream
+    if (who != CFG_LS) evtBinReset(ctl->bin.enc);
+
     return (who == CFG_LS) ?
         transportReconnect(ctl->paytrans) :
         transportReconnect(ctl->transport);
@@ -1205,6 +1301,12 @@ ctlTransportSet(ctl_t *ctl, transport_t *transport, which_transport_t who)
         // Don't leak if ctlTransportSet is called repeatedly
         transportDestroy(&ctl->transport);
         ctl->transport = transport;
+
+        // Whether it can have a dictionary depends on the transport
+        if (ctl->bin.enc) {
+            evtBinDestroy(&ctl->bin.enc);
+            ctlFormatSet(ctl, CFG_FMT_BINARY);
+        }
     }
 }
 
@@ -1350,6 +1452,52 @@ ctlAllowBinaryConsoleSet(ctl_t *ctl, unsigned val)
     ctl->allow_binary_console = val;
 }
 
+cfg_mtc_format_t
+ctlFormat(ctl_t *ctl)
+{
+    return (ctl && ctl->bin.enc) ? CFG_FMT_BINARY : CFG_FMT_NDJSON;
+}
+
+void
+ctlFormatSet(ctl_t *ctl, cfg_mtc_format_t fmt)
+{
+    if (!ctl) return;
+
+    if (fmt != CFG_FMT_BINARY) {
+        evtBinDestroy(&ctl->bin.enc);
+        return;
+    }
+    if (ctl->bin.enc) return;
+
+    // A datagram can be lost, and with it a string others refer to
+    ctl->bin.enc = evtBinCreate(ctlTransportType(ctl, CFG_CTL) != CFG_UDP);
+    ctl->bin.connections = transportConnections(ctl->transport);
+}
+
+void
+ctlSpillSet(ctl_t *ctl, const char *dir, size_t maxsize, size_t drainrate)
+{
+    if (!ctl || !dir) return;
+
+    // Only a connection can be down for a while
+    cfg_transport_t type = ctlTransportType(ctl, CFG_CTL);
+    if ((type != CFG_TCP) && (type != CFG_UNIX) && (type != CFG_EDGE)) return;
+
+    // A binary record can refer to strings defined on an earlier connection
+    if (ctl->bin.enc) {
+        scopeLogInfo("event spill is ignored when the event format is binary");
+        return;
+    }
+
+    transportSpillSet(ctl->transport, dir, maxsize, drainrate);
+}
+
+bool
+ctlSpills(ctl_t *ctl)
+{
+    return (ctl) ? transportSpills(ctl->transport) : FALSE;
+}
+
 
 uint64_t
 ctlGetEvent(ctl_t *ctl)
@@ -1369,6 +1517,37 @@ ctlCbufEmpty(ctl_t *ctl)
     return cbufEmpty(ctl->log.ringbuf);
 }
 
+void
+ctlTrim(ctl_t *ctl)
+{
+    if (!ctl) return;
+    cbufTrim(ctl->events);
+    cbufTrim(ctl->log.ringbuf);
+    cbufTrim(ctl->payload.ringbuf);
+    cbufTrim(ctl->msgbuf);
+}
+
+void
+ctlWakeupSet(ctl_t *ctl, int fd)
+{
+    if (!ctl) return;
+    ctl->wake.fd = fd;
+    if (fd == -1) ctl->wake.armed = 0ULL;
+}
+
+bool
+ctlWakeupArm(ctl_t *ctl)
+{
+    if (!ctl) return TRUE;
+
+    // Armed first, then checked; anything queued from here on wakes us
+    if (ctl->wake.fd != -1) atomicCasU64(&ctl->wake.armed, 0ULL, 1ULL);
+
+    return cbufEmpty(ctl->events) && cbufEmpty(ctl->log.ringbuf) &&
+           cbufEmpty(ctl->payload.ringbuf) && cbufEmpty(ctl->msgbuf) &&
+           !ctl->log.aggregating && !transportSpilled(ctl->transport);
+}
+
 int
 ctlPostPayload(ctl_t *ctl, char *pay)
 {
@@ -1380,6 +1559,7 @@ ctlPostPayload(ctl_t *ctl, char *pay)
         DBG(NULL);
         return -1;
     }
+    wakeup(ctl);
     return 0;
 }
 
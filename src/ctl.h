@@ -127,6 +127,7 @@ int     ctlPostEvent(ctl_t *, char *);
 int                 ctlNeedsConnection(ctl_t *, which_transport_t);
 int                 ctlConnection(ctl_t *, which_transport_t);
 int                 ctlConnect(ctl_t *, which_transport_t);
+uint64_t            ctlConnectWaitMs(ctl_t *, which_transport_t);
 int                 ctlDisconnect(ctl_t *, which_transport_t);
 int                 ctlReconnect(ctl_t *, which_transport_t);
 void                ctlTransportSet(ctl_t *, transport_t *, which_transport_t);
@@ -146,11 +147,20 @@ void             ctlPayStatusSet(ctl_t *, payload_status_t);
 const char *     ctlPayDir(ctl_t *);
 void             ctlPayDirSet(ctl_t *, const char *);
 void             ctlAllowBinaryConsoleSet(ctl_t *, unsigned);
+cfg_mtc_format_t ctlFormat(ctl_t *);
+void             ctlFormatSet(ctl_t *, cfg_mtc_format_t);
+void             ctlSpillSet(ctl_t *, const char *, size_t, size_t);
+bool             ctlSpills(ctl_t *);
 
 // Retrieve events
 uint64_t   ctlGetEvent(ctl_t *);
 void       ctlFlushLog(ctl_t *);
 bool       ctlCbufEmpty(ctl_t *);
+void       ctlTrim(ctl_t *);            // free what the queues haven't needed
+
+// Waking the thread that retrieves them
+void       ctlWakeupSet(ctl_t *, int);  // an eventfd, or -1 for none
+bool       ctlWakeupArm(ctl_t *);       // TRUE if there's nothing to retrieve
 
 // Payloads
 int        ctlPostPayload(ctl_t *, char *);
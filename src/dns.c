@@ -0,0 +1,136 @@
+#define _GNU_SOURCE
+#include "dns.h"
+#include "scopestdlib.h"
+
+#define DNS_HEADER_LEN   ( 12 )
+#define DNS_MAX_LABEL    ( 63 )
+#define DNS_MAX_POINTERS ( 32 )  // more than this is a loop
+
+static uint16_t
+get16(const unsigned char *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t
+get32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/*
+ * Returns the offset just past the name at off, as it's laid out where it
+ * starts (a pointer ends it), or zero if it runs off the message.
+ */
+static size_t
+skipName(dns_msg_t const *msg, size_t off)
+{
+    while (off < msg->len) {
+        unsigned char len = msg->buf[off];
+        if (len == 0) return off + 1;
+        if ((len & 0xc0) == 0xc0) {
+            return (off + 2 <= msg->len) ? off + 2 : 0;
+        }
+        if (len > DNS_MAX_LABEL) return 0;
+        off += len + 1;
+    }
+    return 0;
+}
+
+bool
+dnsMsgInit(dns_msg_t *msg, const void *buf, size_t len)
+{
+    if (!msg || !buf || (len < DNS_HEADER_LEN)) return FALSE;
+
+    const unsigned char *p = buf;
+    msg->buf = p;
+    msg->len = len;
+    msg->id = get16(&p[0]);
+    msg->flags = get16(&p[2]);
+    msg->qdcount = get16(&p[4]);
+    msg->ancount = get16(&p[6]);
+    msg->qname = DNS_HEADER_LEN;
+
+    msg->next = len;
+    msg->answers = 0;
+
+    // Step over the questions; each is a name, a type and a class.  If
+    // they run off the end, the header and question name can still be
+    // of use, so it's not an error; there are just no answers.
+    size_t off = DNS_HEADER_LEN;
+    int i;
+    for (i = 0; i < msg->qdcount; i++) {
+        if (!(off = skipName(msg, off)) || (off + 4 > len)) return TRUE;
+        off += 4;
+    }
+    msg->next = off;
+    msg->answers = msg->ancount;
+    return TRUE;
+}
+
+int
+dnsMsgName(dns_msg_t const *msg, size_t off, char *name, size_t namelen)
+{
+    if (!msg || !name || !namelen) return -1;
+
+    size_t used = 0;
+    int pointers = 0;
+
+    while (off < msg->len) {
+        unsigned char len = msg->buf[off];
+
+        if (len == 0) {
+            name[used] = '\0';
+            return (int)used;
+        }
+
+        if ((len & 0xc0) == 0xc0) {
+            if ((off + 2 > msg->len) || (++pointers > DNS_MAX_POINTERS)) break;
+            off = get16(&msg->buf[off]) & 0x3fff;
+            continue;
+        }
+        if (len > DNS_MAX_LABEL) break;
+
+        off++;
+        if (off + len > msg->len) break;
+        // Room for the '.' before it, the label and the '\0'.  Names are
+        // only held to what fits, not to the 255 octets of RFC 1035.
+        if (used + (used ? 1 : 0) + len + 1 > namelen) break;
+
+        if (used) name[used++] = '.';
+        scope_memcpy(&name[used], &msg->buf[off], len);
+        used += len;
+        off += len;
+    }
+
+    name[0] = '\0';
+    return -1;
+}
+
+bool
+dnsMsgNextAnswer(dns_msg_t *msg, dns_rr_t *rr)
+{
+    if (!msg || !rr || !msg->answers) return FALSE;
+
+    size_t off = skipName(msg, msg->next);
+    // type, class, ttl and rdlength
+    if (!off || (off + 10 > msg->len)) goto malformed;
+
+    rr->name = msg->next;
+    rr->type = get16(&msg->buf[off]);
+    rr->class = get16(&msg->buf[off + 2]);
+    rr->ttl = get32(&msg->buf[off + 4]);
+    rr->rdlength = get16(&msg->buf[off + 8]);
+    off += 10;
+    if (off + rr->rdlength > msg->len) goto malformed;
+    rr->rdata = &msg->buf[off];
+
+    msg->next = off + rr->rdlength;
+    msg->answers--;
+    return TRUE;
+
+malformed:
+    msg->answers = 0;
+    return FALSE;
+}
@@ -4,6 +4,9 @@
 #include <arpa/nameser.h>
 #include <resolv.h>
 #include <arpa/inet.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "scopetypes.h"
 
 #define DNS_SERVICE 0x7f000035 // 127.0.0.53
 #define DNS_PORT 53
@@ -79,6 +82,55 @@ typedef struct dns_query_t {
     unsigned char name[];
 } dns_query;
 
+/*
+ * A DNS message as it sits in the caller's buffer; nothing is copied out
+ * of it until a name is asked for.  Every offset is checked against the
+ * end of the message, and names may use compression pointers (RFC 1035
+ * 4.1.4).
+ *
+ * Usage:
+ *   dns_msg_t msg;
+ *   dns_rr_t rr;
+ *   if (!dnsMsgInit(&msg, buf, len)) return;
+ *   dnsMsgName(&msg, msg.qname, name, sizeof(name));
+ *   while (dnsMsgNextAnswer(&msg, &rr)) { ... }
+ */
+typedef struct {
+    const unsigned char *buf;
+    size_t len;
+    uint16_t id;
+    uint16_t flags;
+    uint16_t qdcount;
+    uint16_t ancount;
+    size_t qname;                // offset of the first question's name
+    size_t next;                 // offset of the next answer
+    uint16_t answers;            // answers not yet returned
+} dns_msg_t;
+
+typedef struct {
+    size_t name;                 // offset of the owner name
+    uint16_t type;
+    uint16_t class;
+    uint32_t ttl;
+    uint16_t rdlength;
+    const unsigned char *rdata;  // points into the message
+} dns_rr_t;
+
+#define DNS_QR(msg)      (((msg)->flags >> 15) & 0x1)
+#define DNS_OPCODE(msg)  (((msg)->flags >> 11) & 0xf)
+
+// FALSE if buf is too short for a header.  If the questions run past the
+// end of it, there are no answers to be had.
+bool dnsMsgInit(dns_msg_t *, const void *buf, size_t len);
+
+// Writes the dotted name at offset off into name; returns its length, or
+// -1 if it's malformed or doesn't fit in namelen (including the '\0').
+// The root name is "".
+int dnsMsgName(dns_msg_t const *, size_t off, char *name, size_t namelen);
+
+// FALSE when there are no more answers, or the next one is malformed
+bool dnsMsgNextAnswer(dns_msg_t *, dns_rr_t *);
+
 #ifdef __linux__
 struct response {
     HEADER hdr;
@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "dnscache.h"
+#include "plattime.h"
+#include "scopestdlib.h"
+
+typedef struct {
+    uint64_t hash;                  // of answer.name; zero for an unused entry
+    uint64_t expires;               // getTime() at which the TTL runs out
+    uint64_t lastUsed;
+    uint64_t count;                 // repeats since the last drain
+    uint64_t duration;              // ... and their total duration in ns
+    dns_answer_t answer;
+} dns_entry_t;
+
+struct _dns_cache_t {
+    uint64_t guard;
+    unsigned int size;
+    dns_entry_t *entries;           // allocated on first use
+};
+
+static void
+lock(dns_cache_t *cache)
+{
+    while (!atomicCasU64(&cache->guard, 0ULL, 1ULL));
+}
+
+static void
+unlock(dns_cache_t *cache)
+{
+    if (!atomicCasU64(&cache->guard, 1ULL, 0ULL)) DBG(NULL);
+}
+
+static uint64_t
+hashName(const char *name)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 0x100000001b3ULL;
+    }
+    return (hash) ? hash : 1;
+}
+
+static bool
+hasAddr(dns_answer_t const *answer, dns_addr_t const *addr)
+{
+    size_t len = (addr->family == AF_INET) ? 4 : 16;
+    unsigned int i;
+    for (i = 0; i < answer->naddrs; i++) {
+        if ((answer->addrs[i].family == addr->family) &&
+            !scope_memcmp(answer->addrs[i].addr, addr->addr, len)) return TRUE;
+    }
+    return FALSE;
+}
+
+// Resolvers rotate the order of the addresses, so it doesn't count
+static bool
+sameAddrs(dns_answer_t const *a, dns_answer_t const *b)
+{
+    if (a->naddrs != b->naddrs) return FALSE;
+    unsigned int i;
+    for (i = 0; i < a->naddrs; i++) {
+        if (!hasAddr(b, &a->addrs[i])) return FALSE;
+    }
+    return TRUE;
+}
+
+dns_cache_t *
+dnsCacheCreate(unsigned int entries)
+{
+    dns_cache_t *cache = scope_calloc(1, sizeof(dns_cache_t));
+    if (!cache) {
+        DBG(NULL);
+        return NULL;
+    }
+    cache->size = (entries) ? entries : DNS_CACHE_ENTRIES;
+    return cache;
+}
+
+void
+dnsCacheDestroy(dns_cache_t **cacheptr)
+{
+    if (!cacheptr || !*cacheptr) return;
+    dns_cache_t *cache = *cacheptr;
+
+    if (cache->entries) scope_free(cache->entries);
+    scope_free(cache);
+    *cacheptr = NULL;
+}
+
+/*
+ * The entry for a name that isn't cached: an unused one, else the one
+ * used least recently that has nothing waiting to be drained, preferring
+ * one that's expired.  NULL if they all have counts waiting.
+ */
+static dns_entry_t *
+freeEntry(dns_cache_t *cache, uint64_t now)
+{
+    dns_entry_t *victim = NULL;
+    unsigned int i;
+    for (i = 0; i < cache->size; i++) {
+        dns_entry_t *entry = &cache->entries[i];
+        if (!entry->hash) return entry;
+        if (entry->count) continue;
+        if (!victim) {
+            victim = entry;
+            continue;
+        }
+        bool expired = (entry->expires <= now);
+        bool victimExpired = (victim->expires <= now);
+        if ((expired && !victimExpired) ||
+            ((expired == victimExpired) && (entry->lastUsed < victim->lastUsed))) {
+            victim = entry;
+        }
+    }
+    return victim;
+}
+
+bool
+dnsCacheRepeat(dns_cache_t *cache, dns_answer_t const *answer, uint64_t duration)
+{
+    if (!cache || !answer || !answer->name[0] || !answer->naddrs) return FALSE;
+
+    uint64_t hash = hashName(answer->name);
+    uint64_t now = getTime();
+    uint32_t ttl = (answer->ttl < DNS_CACHE_MAX_TTL) ? answer->ttl : DNS_CACHE_MAX_TTL;
+    bool repeat = FALSE;
+
+    lock(cache);
+
+    if (!cache->entries) {
+        cache->entries = scope_calloc(cache->size, sizeof(dns_entry_t));
+        if (!cache->entries) {
+            DBG(NULL);
+            goto out;
+        }
+    }
+
+    dns_entry_t *entry = NULL;
+    unsigned int i;
+    for (i = 0; i < cache->size; i++) {
+        if ((cache->entries[i].hash == hash) &&
+            !scope_strcmp(cache->entries[i].answer.name, answer->name)) {
+            entry = &cache->entries[i];
+            break;
+        }
+    }
+
+    if (entry && (entry->expires > now) && sameAddrs(&entry->answer, answer)) {
+        entry->count++;
+        entry->duration += duration;
+        entry->lastUsed = now;
+        repeat = TRUE;
+        goto out;
+    }
+
+    // What's counted was for the answer that's cached; it's replaced
+    // after it's drained.
+    if (entry && entry->count) goto out;
+    if (!entry && !(entry = freeEntry(cache, now))) goto out;
+
+    entry->hash = hash;
+    entry->expires = now + (ttl * 1000000000ULL);
+    entry->lastUsed = now;
+    entry->count = 0;
+    entry->duration = 0;
+    entry->answer = *answer;
+
+out:
+    unlock(cache);
+    return repeat;
+}
+
+void
+dnsCacheDrain(dns_cache_t *cache, dns_cache_fn fn, void *ctx)
+{
+    if (!cache || !fn) return;
+
+    typedef struct {
+        uint64_t count;
+        uint64_t duration;
+        dns_answer_t answer;
+    } drained_t;
+
+    if (!cache->entries) return;
+    drained_t *drained = scope_malloc(cache->size * sizeof(drained_t));
+    if (!drained) {
+        DBG(NULL);
+        return;
+    }
+    unsigned int num = 0;
+
+    lock(cache);
+    unsigned int i;
+    for (i = 0; i < cache->size; i++) {
+        dns_entry_t *entry = &cache->entries[i];
+        if (!entry->count) continue;
+        drained[num].count = entry->count;
+        drained[num].duration = entry->duration;
+        drained[num].answer = entry->answer;
+        num++;
+        entry->count = 0;
+        entry->duration = 0;
+    }
+    unlock(cache);
+
+    for (i = 0; i < num; i++) {
+        fn(&drained[i].answer, drained[i].count, drained[i].duration, ctx);
+    }
+    scope_free(drained);
+}
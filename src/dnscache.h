@@ -0,0 +1,47 @@
+#ifndef __DNSCACHE_H__
+#define __DNSCACHE_H__
+
+#include <stdint.h>
+#include "scopetypes.h"
+
+// A cache of the answers to DNS lookups, by name, for as long as their
+// TTL.  Programs tend to look up the same few names over and over; a
+// response that repeats an answer still in the cache is counted against
+// it rather than reported on its own, and what's been counted is reported
+// once per period, per name (see dnsCacheDrain).
+//
+// A cache can be used from any thread.
+
+#define DNS_CACHE_ENTRIES ( 64 )
+#define DNS_CACHE_MAX_TTL ( 3600 )  // s; longer TTLs are cut to this
+#define DNS_MAX_ADDRS     ( 8 )     // more than this are not kept
+
+typedef struct {
+    int family;                     // AF_INET or AF_INET6
+    unsigned char addr[16];
+} dns_addr_t;
+
+typedef struct {
+    char name[MAX_HOSTNAME];
+    uint32_t ttl;                   // the least of the answers' TTLs, in s
+    unsigned int naddrs;
+    dns_addr_t addrs[DNS_MAX_ADDRS];
+} dns_answer_t;
+
+typedef struct _dns_cache_t dns_cache_t;
+
+dns_cache_t *dnsCacheCreate(unsigned int entries);
+void         dnsCacheDestroy(dns_cache_t **);
+
+// Returns TRUE if the answer has the same addresses, in any order, as the
+// one cached for its name, and that one hasn't expired; the response and
+// its duration (ns) are then counted against the cached answer.
+// Otherwise the answer is cached, if there's room, and FALSE is returned.
+bool dnsCacheRepeat(dns_cache_t *, dns_answer_t const *, uint64_t duration);
+
+// Calls fn for each name with responses counted since the last drain,
+// and clears the counts.  fn is not called with the cache locked.
+typedef void (*dns_cache_fn)(dns_answer_t const *, uint64_t count, uint64_t duration, void *ctx);
+void         dnsCacheDrain(dns_cache_t *, dns_cache_fn, void *ctx);
+
+#endif // __DNSCACHE_H__
@@ -0,0 +1,167 @@
+#define _GNU_SOURCE
+#include "atomic.h"
+#include "dbg.h"
+#include "epoch.h"
+#include "scopestdlib.h"
+
+#define EPOCH_STRIPES (16)
+#define CACHE_LINE (64)
+
+// Sections are counted by the parity of the epoch they began in.  The
+// counts are spread over stripes so that threads on different cores
+// don't all bounce the same cache line.
+typedef struct {
+    uint64_t count[2];
+} __attribute__((aligned(CACHE_LINE))) stripe_t;
+
+typedef struct _retired_t {
+    struct _retired_t *next;
+    epoch_free_fn fn;
+    void *obj;
+    uint64_t epoch;                 // the one it was retired in
+} retired_t;
+
+static stripe_t g_stripe[EPOCH_STRIPES];
+static uint64_t g_epoch = 0;
+static unsigned g_next_stripe = 0;
+
+// Only touched by the writer; newest first, so in descending epochs
+static retired_t *g_retired = NULL;
+static size_t g_retired_count = 0;
+
+// The nesting depth times two, plus the parity of the outermost section.
+// One word, so that a signal handler with sections of its own never sees
+// it half written.
+static __thread unsigned g_section = 0;
+static __thread unsigned g_stripe_idx = 0;      // plus one; 0 until first use
+
+static stripe_t *
+myStripe(void)
+{
+    if (!g_stripe_idx) {
+        g_stripe_idx = (__sync_fetch_and_add(&g_next_stripe, 1) % EPOCH_STRIPES) + 1;
+    }
+    return &g_stripe[g_stripe_idx - 1];
+}
+
+void
+epochEnter(void)
+{
+    if (g_section) {
+        g_section += 2;
+        return;
+    }
+
+    stripe_t *stripe = myStripe();
+    unsigned parity;
+    while (1) {
+        parity = g_epoch & 1;
+        atomicAddU64(&stripe->count[parity], 1);
+
+        // Counted in before the epoch moved on; the writer will wait for us
+        if ((g_epoch & 1) == parity) break;
+
+        atomicSubU64(&stripe->count[parity], 1);
+    }
+
+    g_section = 2 | parity;
+}
+
+void
+epochLeave(void)
+{
+    unsigned section = g_section;
+    if (section > 3) {
+        g_section = section - 2;
+        return;
+    }
+    if (!section) {
+        DBG(NULL);
+        return;
+    }
+
+    g_section = 0;
+    atomicSubU64(&myStripe()->count[section & 1], 1);
+}
+
+static uint64_t
+readers(unsigned parity)
+{
+    uint64_t total = 0;
+    int i;
+    for (i = 0; i < EPOCH_STRIPES; i++) {
+        total += g_stripe[i].count[parity];
+    }
+    return total;
+}
+
+// Destroy everything retired before the epoch given
+static void
+reclaimBefore(uint64_t epoch)
+{
+    retired_t **prev = &g_retired;
+    while (*prev && ((*prev)->epoch >= epoch)) prev = &(*prev)->next;
+
+    retired_t *item = *prev;
+    *prev = NULL;
+
+    while (item) {
+        retired_t *next = item->next;
+        item->fn(item->obj);
+        scope_free(item);
+        g_retired_count--;
+        item = next;
+    }
+}
+
+void
+epochRetire(epoch_free_fn fn, void *obj)
+{
+    if (!fn || !obj) return;
+
+    retired_t *item = scope_malloc(sizeof(retired_t));
+    if (!item) {
+        // Leaked, but never destroyed while it's in use
+        DBG(NULL);
+        return;
+    }
+
+    item->fn = fn;
+    item->obj = obj;
+    item->epoch = g_epoch;
+    item->next = g_retired;
+    g_retired = item;
+    g_retired_count++;
+}
+
+size_t
+epochReclaim(void)
+{
+    if (!g_retired) return 0;
+
+    uint64_t epoch = g_epoch;
+
+    // Sections that began in the previous epoch may still hold on to
+    // anything retired before it ended
+    if (readers((epoch - 1) & 1)) return g_retired_count;
+    reclaimBefore(epoch);
+
+    // What was retired in this one waits for its sections to end.  The
+    // ones that begin from now on can't reach it.
+    if (g_retired) {
+        atomicAddU64(&g_epoch, 1);
+        if (!readers(epoch & 1)) reclaimBefore(epoch + 1);
+    }
+
+    return g_retired_count;
+}
+
+void
+epochReset(void)
+{
+    int i;
+    for (i = 0; i < EPOCH_STRIPES; i++) {
+        g_stripe[i].count[0] = 0;
+        g_stripe[i].count[1] = 0;
+    }
+}
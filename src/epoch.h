@@ -0,0 +1,40 @@
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+#include <stddef.h>
+#include "scopetypes.h"
+
+// Epoch based reclamation of what a new configuration replaces.
+//
+// The periodic thread swaps g_ctl, g_mtc and g_log for new objects while
+// the datapath threads are using them.  The datapath loads those pointers
+// only inside a read section, and doesn't hold on to what it loaded past
+// the end of the section.  The old objects are retired once nothing new can
+// reach them, and epochReclaim() destroys them after every section that
+// might have seen them has ended.
+//
+// Sections nest, and cost a pair of atomics on an uncontended cache line
+// for the outermost one.  They must not enclose anything that blocks.
+
+// Read side; any thread, signal handlers included
+void   epochEnter(void);
+void   epochLeave(void);
+
+static inline int  epochSection(void) { epochEnter(); return 0; }
+static inline void epochSectionEnd(int *unused) { epochLeave(); }
+
+// A section that ends wherever the enclosing block is left
+#define EPOCH_SECTION() \
+    int epoch_section __attribute__((cleanup(epochSectionEnd), unused)) = epochSection()
+
+// Write side; one thread at a time (the periodic thread, or the
+// constructor before it's started)
+typedef void (*epoch_free_fn)(void *);
+
+void   epochRetire(epoch_free_fn, void *);
+size_t epochReclaim(void);      // returns how many are still retired
+
+// Only the calling thread is left, e.g. in the child after a fork
+void   epochReset(void);
+
+#endif // __EPOCH_H__
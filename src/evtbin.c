@@ -0,0 +1,358 @@
+#define _GNU_SOURCE
+#include "dbg.h"
+#include "evtbin.h"
+#include "scopestdlib.h"
+
+#define EVTBIN_DICT_MAX     (4096)  // strings in a stream's dictionary
+#define EVTBIN_DICT_SLOTS   (8192)  // a power of 2, more than EVTBIN_DICT_MAX
+#define EVTBIN_SEEN_SLOTS   (4096)  // a power of 2
+#define EVTBIN_STR_MAX      (64)    // longer values never go in the dictionary
+#define EVTBIN_HEADROOM     (48)    // room ahead of a payload for the headers
+#define EVTBIN_PID_BITS     (22)    // pid_max can't be more than 2^22
+
+typedef enum {
+    TAG_NULL   = 0x00,
+    TAG_FALSE  = 0x01,
+    TAG_TRUE   = 0x02,
+    TAG_INT    = 0x03,
+    TAG_DOUBLE = 0x04,
+    TAG_STR    = 0x05,
+    TAG_DEF    = 0x06,
+    TAG_REF    = 0x07,
+    TAG_OBJECT = 0x08,
+    TAG_ARRAY  = 0x09,
+    TAG_RAW    = 0x0a,
+} tag_t;
+
+struct _evt_bin_t {
+    bool dictionary;
+    bool started;                   // the stream's 'S' record is out
+    uint64_t stream;
+
+    // The record being encoded; the payload starts at EVTBIN_HEADROOM
+    char *buf;
+    size_t size;
+    size_t len;
+    bool failed;                    // out of memory somewhere along the way
+
+    char *strs[EVTBIN_DICT_MAX];
+    uint32_t nstrs;
+    uint32_t slots[EVTBIN_DICT_SLOTS];      // index into strs + 1, 0 if empty
+    uint32_t seen[EVTBIN_SEEN_SLOTS];       // hashes of strings seen once
+};
+
+static void
+dictClear(evt_bin_t *bin)
+{
+    while (bin->nstrs) scope_free(bin->strs[--bin->nstrs]);
+    scope_memset(bin->slots, 0, sizeof(bin->slots));
+    scope_memset(bin->seen, 0, sizeof(bin->seen));
+    bin->started = FALSE;
+}
+
+void
+evtBinReset(evt_bin_t *bin)
+{
+    // Small enough to cost little in every record, and different from
+    // the id of any other stream being written at the same time: the
+    // pid keeps processes apart, the count the encoders of one process.
+    static uint64_t count = 0;
+
+    if (!bin) return;
+    dictClear(bin);
+    bin->stream = (++count << EVTBIN_PID_BITS) | (uint64_t)scope_getpid();
+}
+
+evt_bin_t *
+evtBinCreate(bool dictionary)
+{
+    evt_bin_t *bin = scope_calloc(1, sizeof(evt_bin_t));
+    if (!bin) {
+        DBG(NULL);
+        return NULL;
+    }
+    bin->dictionary = dictionary;
+    evtBinReset(bin);
+    return bin;
+}
+
+void
+evtBinDestroy(evt_bin_t **bin)
+{
+    if (!bin || !*bin) return;
+
+    dictClear(*bin);
+    if ((*bin)->buf) scope_free((*bin)->buf);
+    scope_free(*bin);
+    *bin = NULL;
+}
+
+static bool
+ensure(evt_bin_t *bin, size_t more)
+{
+    if (bin->failed) return FALSE;
+    if (bin->len + more <= bin->size) return TRUE;
+
+    size_t size = (bin->size) ? bin->size : 4096;
+    while (size < bin->len + more) size *= 2;
+
+    char *buf = scope_realloc(bin->buf, size);
+    if (!buf) {
+        DBG("%zu", size);
+        bin->failed = TRUE;
+        return FALSE;
+    }
+    bin->buf = buf;
+    bin->size = size;
+    return TRUE;
+}
+
+static size_t
+encUvarint(uint8_t *out, uint64_t val)
+{
+    size_t n = 0;
+    while (val >= 0x80) {
+        out[n++] = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+    out[n++] = (uint8_t)val;
+    return n;
+}
+
+static void
+putByte(evt_bin_t *bin, uint8_t byte)
+{
+    if (!ensure(bin, 1)) return;
+    bin->buf[bin->len++] = byte;
+}
+
+static void
+putUvarint(evt_bin_t *bin, uint64_t val)
+{
+    if (!ensure(bin, 10)) return;
+    bin->len += encUvarint((uint8_t *)bin->buf + bin->len, val);
+}
+
+static void
+putBytes(evt_bin_t *bin, uint8_t tag, const char *str, size_t len)
+{
+    putByte(bin, tag);
+    putUvarint(bin, len);
+    if (!ensure(bin, len)) return;
+    scope_memcpy(bin->buf + bin->len, str, len);
+    bin->len += len;
+}
+
+static uint32_t
+hashStr(const char *str, size_t len)
+{
+    // FNV-1a; never 0, that's an empty slot
+    uint32_t hash = 2166136261u;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)str[i]) * 16777619u;
+    }
+    return hash | 1;
+}
+
+static uint32_t *
+dictSlot(evt_bin_t *bin, const char *str, uint32_t hash)
+{
+    uint32_t i = hash & (EVTBIN_DICT_SLOTS - 1);
+    while (bin->slots[i] && scope_strcmp(bin->strs[bin->slots[i] - 1], str)) {
+        i = (i + 1) & (EVTBIN_DICT_SLOTS - 1);
+    }
+    return &bin->slots[i];
+}
+
+static bool
+seenBefore(evt_bin_t *bin, uint32_t hash)
+{
+    uint32_t *seen = &bin->seen[hash & (EVTBIN_SEEN_SLOTS - 1)];
+    if (*seen == hash) return TRUE;
+    *seen = hash;
+    return FALSE;
+}
+
+/*
+ * Keys go in the dictionary the first time; there are few of them and
+ * they repeat in every event.  Values have to be seen twice first, or
+ * every file name and port number would take a place.
+ */
+static void
+putString(evt_bin_t *bin, const char *str, bool key)
+{
+    size_t len = scope_strlen(str);
+
+    if (bin->dictionary && (len <= EVTBIN_STR_MAX)) {
+        uint32_t hash = hashStr(str, len);
+        uint32_t *slot = dictSlot(bin, str, hash);
+        if (*slot) {
+            putByte(bin, TAG_REF);
+            putUvarint(bin, *slot - 1);
+            return;
+        }
+        if ((bin->nstrs < EVTBIN_DICT_MAX) && (key || seenBefore(bin, hash))) {
+            char *copy = scope_strdup(str);
+            if (copy) {
+                bin->strs[bin->nstrs++] = copy;
+                *slot = bin->nstrs;
+                putBytes(bin, TAG_DEF, str, len);
+                return;
+            }
+            DBG(NULL);
+        }
+    }
+    putBytes(bin, TAG_STR, str, len);
+}
+
+static void
+putNumber(evt_bin_t *bin, double d)
+{
+    // As cJSON prints them: NaN and infinity are null, and whole numbers
+    // have no decimal point.  Within 2^53 a double is exactly an integer.
+    if ((d * 0) != 0) {
+        putByte(bin, TAG_NULL);
+    } else if ((d >= -9007199254740992.0) && (d <= 9007199254740992.0) &&
+               (d == (double)(int64_t)d)) {
+        int64_t i = (int64_t)d;
+        putByte(bin, TAG_INT);
+        putUvarint(bin, ((uint64_t)i << 1) ^ (uint64_t)(i >> 63));
+    } else {
+        uint64_t bits;
+        scope_memcpy(&bits, &d, sizeof(bits));
+        putByte(bin, TAG_DOUBLE);
+        if (!ensure(bin, 8)) return;
+        int i;
+        for (i = 0; i < 8; i++) {
+            bin->buf[bin->len++] = (char)(bits >> (i * 8));
+        }
+    }
+}
+
+static void
+putValue(evt_bin_t *bin, cJSON *item)
+{
+    cJSON *child;
+    uint64_t count;
+
+    switch (item->type & 0xFF) {
+        case cJSON_False:
+            putByte(bin, TAG_FALSE);
+            break;
+        case cJSON_True:
+            putByte(bin, TAG_TRUE);
+            break;
+        case cJSON_Number:
+            putNumber(bin, item->valuedouble);
+            break;
+        case cJSON_String:
+            if (item->valuestring) {
+                putString(bin, item->valuestring, FALSE);
+            } else {
+                putByte(bin, TAG_NULL);
+            }
+            break;
+        case cJSON_Raw:
+            if (item->valuestring) {
+                putBytes(bin, TAG_RAW, item->valuestring, scope_strlen(item->valuestring));
+            } else {
+                putByte(bin, TAG_NULL);
+            }
+            break;
+        case cJSON_Array:
+        case cJSON_Object:
+            count = 0;
+            cJSON_ArrayForEach(child, item) count++;
+            putByte(bin, (cJSON_IsArray(item)) ? TAG_ARRAY : TAG_OBJECT);
+            putUvarint(bin, count);
+            cJSON_ArrayForEach(child, item) {
+                if (cJSON_IsObject(item)) {
+                    putString(bin, (child->string) ? child->string : "", TRUE);
+                }
+                putValue(bin, child);
+            }
+            break;
+        case cJSON_NULL:
+        default:
+            putByte(bin, TAG_NULL);
+            break;
+    }
+}
+
+static void
+startRecord(evt_bin_t *bin)
+{
+    // A stream that's filled its dictionary starts over with an empty one
+    if (bin->nstrs >= EVTBIN_DICT_MAX) dictClear(bin);
+
+    bin->failed = FALSE;
+    bin->len = 0;
+    ensure(bin, EVTBIN_HEADROOM);
+    bin->len = EVTBIN_HEADROOM;
+}
+
+/*
+ * The headers go in the headroom, right up against the payload, so the
+ * record (and the 'S' record ahead of it, if the stream is new) can be
+ * handed to the transport as it is.
+ */
+static const char *
+finishRecord(evt_bin_t *bin, char type, size_t *len)
+{
+    if (bin->failed) {
+        // Whatever made it into the dictionary never made it out
+        evtBinReset(bin);
+        return NULL;
+    }
+
+    uint8_t stream[10];
+    size_t nstream = encUvarint(stream, bin->stream);
+    size_t payload = bin->len - EVTBIN_HEADROOM;
+    uint8_t hdr[EVTBIN_HEADROOM];
+    size_t n = 0;
+
+    if (!bin->started) {
+        hdr[n++] = EVTBIN_MARKER;
+        n += encUvarint(hdr + n, 1 + nstream + 1);
+        hdr[n++] = 'S';
+        scope_memcpy(hdr + n, stream, nstream);
+        n += nstream;
+        hdr[n++] = EVTBIN_VERSION;
+        bin->started = TRUE;
+    }
+    hdr[n++] = EVTBIN_MARKER;
+    n += encUvarint(hdr + n, 1 + nstream + payload);
+    hdr[n++] = type;
+    scope_memcpy(hdr + n, stream, nstream);
+    n += nstream;
+
+    char *record = bin->buf + EVTBIN_HEADROOM - n;
+    scope_memcpy(record, hdr, n);
+    *len = n + payload;
+    return record;
+}
+
+const char *
+evtBinEncode(evt_bin_t *bin, cJSON *json, size_t *len)
+{
+    if (!bin || !json || !len) return NULL;
+
+    startRecord(bin);
+    putValue(bin, json);
+    return finishRecord(bin, 'E', len);
+}
+
+const char *
+evtBinEncodeText(evt_bin_t *bin, const char *text, size_t *len)
+{
+    if (!bin || !text || !len) return NULL;
+
+    startRecord(bin);
+    size_t textlen = scope_strlen(text);
+    if (ensure(bin, textlen)) {
+        scope_memcpy(bin->buf + bin->len, text, textlen);
+        bin->len += textlen;
+    }
+    return finishRecord(bin, 'J', len);
+}
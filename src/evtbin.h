@@ -0,0 +1,51 @@
+#ifndef __EVT_BIN_H__
+#define __EVT_BIN_H__
+#include <stdint.h>
+#include "cJSON.h"
+#include "scopetypes.h"
+
+// The binary event format (event > format: binary).  Instead of a line of
+// JSON text, each message is a record:
+//
+//     0xB5                        marker; never the first byte of JSON text
+//     uvarint length              of everything that follows in the record
+//     byte type                   'S' start, 'E' encoded, 'J' JSON text
+//     uvarint stream              which stream it belongs to
+//     payload                     'S': uvarint version
+//                                 'E': the message, one value (below)
+//                                 'J': the message as JSON text
+//
+// A stream is what one encoder writes from its creation or last reset to
+// its next; a file can hold the streams of many processes interleaved.
+// Values are a tag byte and what follows it:
+//
+//     0x00 null   0x01 false   0x02 true
+//     0x03 int    zigzag uvarint; numbers with no fractional part
+//     0x04 double 8 bytes, little endian
+//     0x05 str    uvarint length, bytes
+//     0x06 def    as str, and the string is added to the stream's dictionary
+//     0x07 ref    uvarint index of a string in the stream's dictionary
+//     0x08 object uvarint count, then count key (str/def/ref), value pairs
+//     0x09 array  uvarint count, then count values
+//     0x0a raw    as str; the bytes are JSON text
+//
+// Object keys, and short string values once they've been seen twice, go in
+// the dictionary.  The dictionary is emptied by an 'S' record; the encoder
+// writes one at the start of each stream, ahead of its first record.
+
+#define EVTBIN_MARKER   (0xB5)
+#define EVTBIN_VERSION  (1)
+
+typedef struct _evt_bin_t evt_bin_t;
+
+// Constructors Destructors
+evt_bin_t *         evtBinCreate(bool);     // FALSE: no dictionary (datagrams)
+void                evtBinDestroy(evt_bin_t **);
+
+// Accessors
+// Both return the encoded record(s), good until the next call, or NULL
+const char *        evtBinEncode(evt_bin_t *, cJSON *, size_t *);
+const char *        evtBinEncodeText(evt_bin_t *, const char *, size_t *);
+void                evtBinReset(evt_bin_t *); // what follows is a new stream
+
+#endif // __EVT_BIN_H__
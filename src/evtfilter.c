@@ -0,0 +1,362 @@
+#define _GNU_SOURCE
+#include "atomic.h"
+#include "com.h"
+#include "dbg.h"
+#include "evtfilter.h"
+#include "scopestdlib.h"
+
+#define FILTER_MAX_LITERALS (16)
+#define FILTER_CACHE_SIZE   (64)    // names remembered, a power of 2
+#define FILTER_CACHE_NAME   (32)    // longer names aren't remembered
+
+typedef enum {
+    FILTER_ALL,                     // matches any string at all
+    FILTER_LITERALS,                // matches if any of lit[] does
+    FILTER_REGEX,
+} filter_kind_t;
+
+typedef struct {
+    char *str;
+    size_t len;
+    bool start;                     // has to be at the start (^)
+    bool end;                       // has to be at the end ($)
+} literal_t;
+
+typedef struct {
+    uint64_t seq;                   // odd while it's being written, 0 if unused
+    char name[FILTER_CACHE_NAME];
+    bool match;
+} name_result_t;
+
+struct _evt_filter_t {
+    filter_kind_t kind;
+    literal_t lit[FILTER_MAX_LITERALS];
+    int nlit;
+    regex_t re;                     // compiled for every kind; it's the reference
+    name_result_t names[FILTER_CACHE_SIZE];
+};
+
+typedef enum {
+    TOK_END,
+    TOK_CHAR,
+    TOK_CARET,
+    TOK_DOLLAR,
+    TOK_OPEN,
+    TOK_CLOSE,
+    TOK_BAR,
+    TOK_DOTSTAR,
+} tok_type_t;
+
+typedef struct {
+    tok_type_t type;
+    char c;
+} token_t;
+
+static bool
+isAlnum(unsigned char c)
+{
+    return ((c >= '0') && (c <= '9')) ||
+           ((c >= 'a') && (c <= 'z')) ||
+           ((c >= 'A') && (c <= 'Z'));
+}
+
+/*
+ * Splits the pattern into the few tokens we know how to match without
+ * the regex engine.  Returns FALSE on anything else: classes, quantifiers
+ * other than .*, escapes like \d, non-capturing groups, non-ASCII.
+ * An escaped character that isn't a letter or digit is that character.
+ */
+static bool
+tokenize(const char *pattern, token_t *tok)
+{
+    const unsigned char *p = (const unsigned char *)pattern;
+
+    while (*p) {
+        tok->c = 0;
+        if ((p[0] == '.') && (p[1] == '*')) {
+            tok->type = TOK_DOTSTAR;
+            p += 2;
+        } else if (*p == '\\') {
+            if (!p[1] || isAlnum(p[1]) || (p[1] < 0x20) || (p[1] >= 0x7f)) return FALSE;
+            tok->type = TOK_CHAR;
+            tok->c = p[1];
+            p += 2;
+        } else if (*p == '^') {
+            tok->type = TOK_CARET;
+            p++;
+        } else if (*p == '$') {
+            tok->type = TOK_DOLLAR;
+            p++;
+        } else if (*p == '(') {
+            if (p[1] == '?') return FALSE;
+            tok->type = TOK_OPEN;
+            p++;
+        } else if (*p == ')') {
+            tok->type = TOK_CLOSE;
+            p++;
+        } else if (*p == '|') {
+            tok->type = TOK_BAR;
+            p++;
+        } else if ((*p < 0x20) || (*p >= 0x7f) || scope_strchr(".?*+[]{}", *p)) {
+            return FALSE;
+        } else {
+            tok->type = TOK_CHAR;
+            tok->c = *p;
+            p++;
+        }
+        tok++;
+    }
+    tok->type = TOK_END;
+    return TRUE;
+}
+
+static bool
+addLiteral(evt_filter_t *filter, const token_t *from, const token_t *to, bool start, bool end)
+{
+    if (filter->nlit >= FILTER_MAX_LITERALS) return FALSE;
+
+    literal_t *lit = &filter->lit[filter->nlit];
+    if (!(lit->str = scope_malloc((to - from) + 1))) return FALSE;
+    lit->len = 0;
+    for (; from < to; from++) lit->str[lit->len++] = from->c;
+    lit->str[lit->len] = '\0';
+    lit->start = start;
+    lit->end = end;
+    filter->nlit++;
+    return TRUE;
+}
+
+static const token_t *
+skipChars(const token_t *tok)
+{
+    while (tok->type == TOK_CHAR) tok++;
+    return tok;
+}
+
+/*
+ * The literals a pattern is made of, if it's one of
+ *     ^(lit|lit|...)$              the anchors, either or both, go with each
+ *     alt|alt|...                  where each alt is ^(lit)$ or ^lit$,
+ *                                  with or without either anchor
+ * A .* leading an unanchored alt or trailing one that isn't anchored at
+ * the end can be dropped; it changes nothing about whether it matches.
+ */
+static bool
+parseLiterals(evt_filter_t *filter, const token_t *tok)
+{
+    const token_t *t = tok;
+    const token_t *from, *to;
+    bool start, end;
+
+    // ^(lit|lit|...)$
+    start = (t->type == TOK_CARET);
+    if (start) t++;
+    if (t->type == TOK_OPEN) {
+        const token_t *alt = t + 1;
+        do {
+            to = skipChars(alt);
+            if ((to->type != TOK_BAR) && (to->type != TOK_CLOSE)) break;
+            alt = to + 1;
+        } while (to->type == TOK_BAR);
+
+        end = (alt->type == TOK_DOLLAR);
+        if ((to->type == TOK_CLOSE) && ((end ? alt + 1 : alt)->type == TOK_END)) {
+            for (alt = t + 1; alt <= to; alt = skipChars(alt) + 1) {
+                if (!addLiteral(filter, alt, skipChars(alt), start, end)) return FALSE;
+            }
+            return TRUE;
+        }
+    }
+
+    // alt|alt|...
+    for (t = tok; ; t++) {
+        start = (t->type == TOK_CARET);
+        if (start) t++;
+        if (!start && (t->type == TOK_DOTSTAR)) t++;
+
+        bool group = (t->type == TOK_OPEN);
+        if (group) t++;
+        from = t;
+        to = t = skipChars(t);
+        if (group && ((t++)->type != TOK_CLOSE)) return FALSE;
+
+        if ((t->type == TOK_DOTSTAR) && (t[1].type != TOK_DOLLAR)) t++;
+        end = (t->type == TOK_DOLLAR);
+        if (end) t++;
+
+        if (!addLiteral(filter, from, to, start, end)) return FALSE;
+
+        if (t->type == TOK_END) return TRUE;
+        if (t->type != TOK_BAR) return FALSE;
+    }
+}
+
+static void
+classify(evt_filter_t *filter, const char *pattern)
+{
+    filter->kind = FILTER_REGEX;
+
+    // ".*" can match nothing at the start of any string, as can "".
+    // "^.*$" isn't here: . doesn't match a newline, so it fails "a\nb".
+    if (!scope_strcmp(pattern, "") || !scope_strcmp(pattern, ".*") ||
+        !scope_strcmp(pattern, "^.*") || !scope_strcmp(pattern, ".*$")) {
+        filter->kind = FILTER_ALL;
+        return;
+    }
+
+    token_t *tok = scope_calloc(scope_strlen(pattern) + 1, sizeof(token_t));
+    if (!tok) return;
+
+    if (tokenize(pattern, tok) && parseLiterals(filter, tok)) {
+        filter->kind = FILTER_LITERALS;
+    } else {
+        while (filter->nlit) scope_free(filter->lit[--filter->nlit].str);
+    }
+    scope_free(tok);
+}
+
+evt_filter_t *
+evtFilterCreate(const char *pattern)
+{
+    if (!pattern) return NULL;
+
+    evt_filter_t *filter = scope_calloc(1, sizeof(evt_filter_t));
+    if (!filter) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    if (regcomp_wrapper(&filter->re, pattern, REG_EXTENDED | REG_NOSUB)) {
+        scope_free(filter);
+        return NULL;
+    }
+
+    classify(filter, pattern);
+    return filter;
+}
+
+void
+evtFilterDestroy(evt_filter_t **filter)
+{
+    if (!filter || !*filter) return;
+
+    evt_filter_t *f = *filter;
+    while (f->nlit) scope_free(f->lit[--f->nlit].str);
+    regfree(&f->re);
+    scope_free(f);
+    *filter = NULL;
+}
+
+bool
+evtFilterMatchesAll(evt_filter_t *filter)
+{
+    return (filter) ? (filter->kind == FILTER_ALL) : FALSE;
+}
+
+/*
+ * As the regex would match it.  ^ is only the start of the string; $ is
+ * the end of it, or just before a newline that ends it.
+ */
+static bool
+literalMatch(const literal_t *lit, const char *str, size_t len)
+{
+    // Where $ can match: the end, or before a newline at the end
+    size_t endlen = ((len > 0) && (str[len - 1] == '\n')) ? len - 1 : len;
+
+    if (lit->start && lit->end) {
+        return (((len == lit->len) || (endlen == lit->len)) &&
+                !scope_memcmp(str, lit->str, lit->len));
+    }
+    if (lit->start) {
+        return (len >= lit->len) && !scope_memcmp(str, lit->str, lit->len);
+    }
+    if (lit->end) {
+        return ((len >= lit->len) &&
+                !scope_memcmp(str + len - lit->len, lit->str, lit->len)) ||
+               ((endlen >= lit->len) && (endlen != len) &&
+                !scope_memcmp(str + endlen - lit->len, lit->str, lit->len));
+    }
+    return (scope_strstr(str, lit->str) != NULL);
+}
+
+bool
+evtFilterMatch(evt_filter_t *filter, const char *str)
+{
+    if (!filter || !str) return FALSE;
+
+    switch (filter->kind) {
+        case FILTER_ALL:
+            return TRUE;
+        case FILTER_LITERALS:
+        {
+            size_t len = scope_strlen(str);
+            int i;
+            for (i = 0; i < filter->nlit; i++) {
+                if (literalMatch(&filter->lit[i], str, len)) return TRUE;
+            }
+            return FALSE;
+        }
+        case FILTER_REGEX:
+        default:
+            return !regexec_wrapper(&filter->re, str, 0, NULL, 0);
+    }
+}
+
+static name_result_t *
+nameSlot(evt_filter_t *filter, const char *name)
+{
+    // Names are mostly string constants, so where one is says which it is
+    uint64_t addr = (uint64_t)name;
+    return &filter->names[(addr * 0x9e3779b97f4a7c15ULL) >> 58];
+}
+
+/*
+ * Entries are read and written by any thread without a lock.  A reader
+ * takes the result only if the entry's seq was even and unchanged from
+ * before it compared the name to after it read the result.
+ */
+static bool
+nameLookup(name_result_t *entry, const char *name, bool *match)
+{
+    uint64_t seq = entry->seq;
+    if (!seq || (seq & 1)) return FALSE;
+    __sync_synchronize();
+
+    bool same = !scope_strncmp(entry->name, name, FILTER_CACHE_NAME);
+    bool result = entry->match;
+
+    __sync_synchronize();
+    if (entry->seq != seq || !same) return FALSE;
+    *match = result;
+    return TRUE;
+}
+
+static void
+nameRemember(name_result_t *entry, const char *name, size_t len, bool match)
+{
+    uint64_t seq = entry->seq;
+    if ((seq & 1) || !atomicCasU64(&entry->seq, seq, seq + 1)) return;
+
+    scope_memcpy(entry->name, name, len + 1);
+    entry->match = match;
+
+    if (!atomicCasU64(&entry->seq, seq + 1, seq + 2)) DBG(NULL);
+}
+
+bool
+evtFilterMatchName(evt_filter_t *filter, const char *name)
+{
+    if (!filter || !name) return FALSE;
+
+    // There's nothing to save on the ones that don't take a regex
+    if (filter->kind != FILTER_REGEX) return evtFilterMatch(filter, name);
+
+    name_result_t *entry = nameSlot(filter, name);
+    bool match;
+    if (nameLookup(entry, name, &match)) return match;
+
+    match = evtFilterMatch(filter, name);
+    size_t len = scope_strlen(name);
+    if (len < FILTER_CACHE_NAME) nameRemember(entry, name, len, match);
+    return match;
+}
@@ -0,0 +1,26 @@
+#ifndef __EVT_FILTER_H__
+#define __EVT_FILTER_H__
+
+#include "scopetypes.h"
+
+// An event watch filter (a name, field or value regex from the config),
+// compiled into what it takes to match it.  Most filters in use are ".*",
+// a literal string, a prefix or an alternation of literals; those are
+// matched with string compares, and only the rest go to pcre2.
+//
+// evtFilterMatchName() is for names (event and field names), which are
+// most often the same few strings over and over.  It remembers the
+// results of the names it's seen last.
+
+typedef struct _evt_filter_t evt_filter_t;
+
+// Constructors Destructors
+evt_filter_t *      evtFilterCreate(const char *);  // NULL if it won't compile
+void                evtFilterDestroy(evt_filter_t **);
+
+// Accessors
+bool                evtFilterMatchesAll(evt_filter_t *);
+bool                evtFilterMatch(evt_filter_t *, const char *);
+bool                evtFilterMatchName(evt_filter_t *, const char *);
+
+#endif // __EVT_FILTER_H__
@@ -71,16 +71,11 @@ valToStr(enum_map_t map[], unsigned val)
     return NULL;
 }
 
-typedef struct {
-    int valid;
-    regex_t re;
-} local_re_t;
-
 struct _evt_fmt_t
 {
-    local_re_t value_re[CFG_SRC_MAX];
-    local_re_t field_re[CFG_SRC_MAX];
-    local_re_t name_re[CFG_SRC_MAX];
+    evt_filter_t *value_re[CFG_SRC_MAX];
+    evt_filter_t *field_re[CFG_SRC_MAX];
+    evt_filter_t *name_re[CFG_SRC_MAX];
     unsigned enabled[CFG_SRC_MAX];
 
     struct {
@@ -141,20 +136,19 @@ static unsigned srcEnabledDefault[] = {
 
 
 static void
-filterSet(local_re_t *re, const char *str, const char *default_val)
+filterSet(evt_filter_t **re, const char *str, const char *default_val)
 {
     if (!re) return;
 
-    local_re_t temp;
-    temp.valid = str && !regcomp(&temp.re, str, REG_EXTENDED | REG_NOSUB);
-    if (!temp.valid && default_val) {
-        // regcomp failed on str.  Try the default.
-        temp.valid = !regcomp(&temp.re, default_val, REG_EXTENDED | REG_NOSUB);
+    evt_filter_t *temp = evtFilterCreate(str);
+    if (!temp && default_val) {
+        // str didn't compile.  Try the default.
+        temp = evtFilterCreate(default_val);
     }
 
-    if (temp.valid) {
+    if (temp) {
         // Out with the old
-        if (re->valid) regfree(&re->re);
+        evtFilterDestroy(re);
         // In with the new
         *re = temp;
     } else {
@@ -211,9 +205,9 @@ evtFormatDestroy(evt_fmt_t **evt)
 
     watch_t src;
     for (src=CFG_SRC_FILE; src<CFG_SRC_MAX; src++) {
-        if (edestroy->value_re[src].valid) regfree(&edestroy->value_re[src].re);
-        if (edestroy->field_re[src].valid) regfree(&edestroy->field_re[src].re);
-        if (edestroy->name_re[src].valid) regfree(&edestroy->name_re[src].re);
+        evtFilterDestroy(&edestroy->value_re[src]);
+        evtFilterDestroy(&edestroy->field_re[src]);
+        evtFilterDestroy(&edestroy->name_re[src]);
     }
 
     evtFormatDestroyTags(&edestroy->tags);
@@ -222,46 +216,46 @@ evtFormatDestroy(evt_fmt_t **evt)
     *evt = NULL;
 }
 
-regex_t *
+evt_filter_t *
 evtFormatValueFilter(evt_fmt_t *evt, watch_t src)
 {
     if (src < CFG_SRC_MAX) {
-        if (evt && evt->value_re[src].valid) return &evt->value_re[src].re;
-        static local_re_t default_re[CFG_SRC_MAX];
-        if (!default_re[src].valid) {
+        if (evt && evt->value_re[src]) return evt->value_re[src];
+        static evt_filter_t *default_re[CFG_SRC_MAX];
+        if (!default_re[src]) {
             filterSet(&default_re[src], NULL, valueFilterDefault[src]);
         }
-        if (default_re[src].valid) return &default_re[src].re;
+        if (default_re[src]) return default_re[src];
     }
     DBG("%d", src);
     return NULL;
 }
 
-regex_t *
+evt_filter_t *
 evtFormatFieldFilter(evt_fmt_t *evt, watch_t src)
 {
     if (src < CFG_SRC_MAX) {
-        if (evt && evt->field_re[src].valid) return &evt->field_re[src].re;
-        static local_re_t default_re[CFG_SRC_MAX];
-        if (!default_re[src].valid) {
+        if (evt && evt->field_re[src]) return evt->field_re[src];
+        static evt_filter_t *default_re[CFG_SRC_MAX];
+        if (!default_re[src]) {
             filterSet(&default_re[src], NULL, fieldFilterDefault[src]);
         }
-        if (default_re[src].valid) return &default_re[src].re;
+        if (default_re[src]) return default_re[src];
     }
     DBG("%d", src);
     return NULL;
 }
 
-regex_t *
+evt_filter_t *
 evtFormatNameFilter(evt_fmt_t *evt, watch_t src)
 {
     if (src < CFG_SRC_MAX) {
-        if (evt && evt->name_re[src].valid) return &evt->name_re[src].re;
-        static local_re_t default_re[CFG_SRC_MAX];
-        if (!default_re[src].valid) {
+        if (evt && evt->name_re[src]) return evt->name_re[src];
+        static evt_filter_t *default_re[CFG_SRC_MAX];
+        if (!default_re[src]) {
             filterSet(&default_re[src], NULL, nameFilterDefault[src]);
         }
-        if (default_re[src].valid) return &default_re[src].re;
+        if (default_re[src]) return default_re[src];
     }
     DBG("%d", src);
     return NULL;
@@ -369,25 +363,31 @@ evtFormatCustomTagsSet(evt_fmt_t* fmt, custom_tag_t** tags)
 #define NO_MATCH_FOUND 0
 
 static int
-anyValueFieldMatches(regex_t *filter, event_t *metric)
+anyValueFieldMatches(evt_filter_t *filter, event_t *metric)
 {
     if (!filter || !metric) return MATCH_FOUND;
 
+    // A number is never an empty string, so there's no need to make
+    // one to match it against a filter that matches anything
+    bool all = evtFilterMatchesAll(filter);
+
     // Test the value of metric
     char valbuf[320]; // Seems crazy but -MAX_DBL.00 is 313 chars!
     valbuf[0]='\0';
     switch ( metric->value.type ) {
         case FMT_INT:
+            if (all) return MATCH_FOUND;
             scope_snprintf(valbuf, sizeof(valbuf), "%lld", metric->value.integer);
             break;
         case FMT_FLT:
+            if (all) return MATCH_FOUND;
             scope_snprintf(valbuf, sizeof(valbuf), "%.2f", metric->value.floating);
             break;
         default:
             DBG(NULL);
     }
     if (valbuf[0]) {
-        if (!regexec_wrapper(filter, valbuf, 0, NULL, 0)) return MATCH_FOUND;
+        if (evtFilterMatch(filter, valbuf)) return MATCH_FOUND;
     }
 
     // Handle the case where there are no fields...
@@ -400,12 +400,13 @@ anyValueFieldMatches(regex_t *filter, event_t *metric)
         if (fld->value_type == FMT_STR) {
             str = fld->value.str;
         } else if (fld->value_type == FMT_NUM) {
+            if (all) return MATCH_FOUND;
             if (scope_snprintf(valbuf, sizeof(valbuf), "%lld", fld->value.num) > 0) {
                 str = valbuf;
             }
         }
 
-        if (str && !regexec_wrapper(filter, str, 0, NULL, 0)) return MATCH_FOUND;
+        if (str && evtFilterMatch(filter, str)) return MATCH_FOUND;
     }
 
     return NO_MATCH_FOUND;
@@ -502,7 +503,7 @@ metricTypeStr(data_type_t type)
 }
 
 static int
-addJsonFields(event_field_t *fields, regex_t *fieldFilter, cJSON *json, strset_t *addedFields)
+addJsonFields(event_field_t *fields, evt_filter_t *fieldFilter, cJSON *json, strset_t *addedFields)
 {
     if (!fields) return TRUE;
 
@@ -512,7 +513,7 @@ addJsonFields(event_field_t *fields, regex_t *fieldFilter, cJSON *json, strset_t
     for (fld = fields; fld->value_type != FMT_END; fld++) {
 
         // skip outputting anything that doesn't match fieldFilter
-        if (fieldFilter && regexec_wrapper(fieldFilter, fld->name, 0, NULL, 0)) continue;
+        if (fieldFilter && !evtFilterMatchName(fieldFilter, fld->name)) continue;
 
         // skip if this field is not used in events
         if (fld->event_usage == FALSE) continue;
@@ -533,7 +534,7 @@ addJsonFields(event_field_t *fields, regex_t *fieldFilter, cJSON *json, strset_t
 }
 
 cJSON *
-fmtMetricJson(event_t *metric, regex_t *fieldFilter, watch_t src, custom_tag_t **tags)
+fmtMetricJson(event_t *metric, evt_filter_t *fieldFilter, watch_t src, custom_tag_t **tags)
 {
     const char *metric_type = NULL;
     strset_t *addedFields = NULL;
@@ -591,14 +592,14 @@ evtFormatHelper(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc,
     struct timeval tv;
     scope_gettimeofday(&tv, NULL);
     
-    regex_t *filter;
+    evt_filter_t *filter;
 
     if (!evt || !metric || !proc) return NULL;
 
     // Test for a name field match.  No match, no metric output
     if (!evtFormatSourceEnabled(evt, src) ||
         !(filter = evtFormatNameFilter(evt, src)) ||
-        (regexec_wrapper(filter, metric->name, 0, NULL, 0))) {
+        !evtFilterMatchName(filter, metric->name)) {
         return NULL;
     }
 
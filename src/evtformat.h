@@ -1,8 +1,8 @@
 #ifndef __EVT_FORMAT_H__
 #define __EVT_FORMAT_H__
-#include "pcre2posix.h"
 #include <stdint.h>
 #include "cJSON.h"
+#include "evtfilter.h"
 #include "mtcformat.h"
 
 typedef struct _evt_fmt_t evt_fmt_t;
@@ -12,9 +12,9 @@ evt_fmt_t *         evtFormatCreate(void);
 void                evtFormatDestroy(evt_fmt_t **);
 
 // Accessors
-regex_t *           evtFormatValueFilter(evt_fmt_t *, watch_t);
-regex_t *           evtFormatFieldFilter(evt_fmt_t *, watch_t);
-regex_t *           evtFormatNameFilter(evt_fmt_t *, watch_t);
+evt_filter_t *      evtFormatValueFilter(evt_fmt_t *, watch_t);
+evt_filter_t *      evtFormatFieldFilter(evt_fmt_t *, watch_t);
+evt_filter_t *      evtFormatNameFilter(evt_fmt_t *, watch_t);
 unsigned            evtFormatSourceEnabled(evt_fmt_t *, watch_t);
 unsigned            evtFormatRateLimit(evt_fmt_t *);
 custom_tag_t **     evtFormatCustomTags(evt_fmt_t *);
@@ -24,7 +24,7 @@ cJSON *             evtFormatMetric(evt_fmt_t *, event_t *, uint64_t, proc_id_t
 cJSON *             evtFormatHttp(evt_fmt_t *, event_t *, uint64_t, proc_id_t *);
 
 // Could be static; these are lower level funcs only exposed for testing
-cJSON *             fmtMetricJson(event_t *, regex_t *, watch_t, custom_tag_t **);
+cJSON *             fmtMetricJson(event_t *, evt_filter_t *, watch_t, custom_tag_t **);
 cJSON *             fmtEventJson(evt_fmt_t *, event_format_t *);
 
 // Setters (modifies evt_fmt_t, but does not persist modifications)
@@ -34,6 +34,8 @@ evtProtoAllocHttp1(bool isResponse)
     }
 
     proto->ptype = (isResponse) ? EVT_HRES : EVT_HREQ;
+    http_post *post = (http_post *)proto->data;
+    post->clen = -1;
 
     return proto;
 }
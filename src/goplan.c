@@ -0,0 +1,335 @@
+#define _GNU_SOURCE
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dbg.h"
+#include "goplan.h"
+#include "scopestdlib.h"
+#include "utils.h"
+
+#define GO_PLAN_MAGIC "SCOPEGP1"
+#define MIN_PATCHES 32
+#define MAX_PATCHES 65536
+
+#if defined (__x86_64__)
+   #define GO_PLAN_ARCH "x86_64"
+#elif defined (__aarch64__)
+   #define GO_PLAN_ARCH "aarch64"
+#else
+   #error Bad arch defined
+#endif
+
+// The file is this header, then the key (padded to 8 bytes),
+// then the patches.
+typedef struct {
+    char magic[8];
+    uint32_t keyLen;
+    uint32_t patchNum;
+    uint64_t systemStack;
+    uint64_t checksum;      // of everything after the header
+} go_plan_hdr_t;
+
+struct _go_plan_t {
+    char *key;              // build ID, libscope version, arch, taps
+    size_t keyLen;
+    uint32_t tapNum;
+    uint64_t systemStack;
+    go_patch_t *patch;
+    size_t num;
+    size_t alloc;
+};
+
+static uint64_t
+planHash(uint64_t hash, const void *data, size_t len)
+{
+    // FNV-1a
+    const unsigned char *bytes = data;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+#define PLAN_HASH_INIT 14695981039346656037ULL
+#define KEY_PAD(len) (((len) + 7) & ~7)
+
+/*
+ * Returns the descriptor of the GNU build ID note, or else of the Go
+ * build ID note.  Go only emits a GNU build ID when linking externally.
+ */
+static const char *
+buildId(const char *buf, uint32_t *len)
+{
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *)buf;
+    Elf64_Shdr *sections = (Elf64_Shdr *)(buf + ehdr->e_shoff);
+    const char *section_strtab = buf + sections[ehdr->e_shstrndx].sh_offset;
+    const char *goId = NULL;
+    uint32_t goLen = 0;
+    int i;
+
+    for (i = 0; i < ehdr->e_shnum; i++) {
+        const char *sec_name = section_strtab + sections[i].sh_name;
+        if ((sections[i].sh_type != SHT_NOTE) ||
+            (sections[i].sh_size < sizeof(Elf64_Nhdr))) continue;
+
+        const Elf64_Nhdr *note = (const Elf64_Nhdr *)(buf + sections[i].sh_offset);
+        size_t descOff = sizeof(Elf64_Nhdr) + ROUND_UP(note->n_namesz, 4);
+        if (!note->n_descsz || (descOff + note->n_descsz > sections[i].sh_size)) continue;
+
+        if (!scope_strcmp(sec_name, ".note.gnu.build-id")) {
+            *len = note->n_descsz;
+            return (const char *)note + descOff;
+        } else if (!scope_strcmp(sec_name, ".note.go.buildid")) {
+            goId = (const char *)note + descOff;
+            goLen = note->n_descsz;
+        }
+    }
+
+    *len = goLen;
+    return goId;
+}
+
+go_plan_t *
+goPlanCreate(const char *buf, const char *version, uint32_t tapNum)
+{
+    if (!buf || !version) return NULL;
+
+    uint32_t idLen;
+    const char *id = buildId(buf, &idLen);
+    if (!id) return NULL;
+
+    go_plan_t *plan = scope_calloc(1, sizeof(go_plan_t));
+    if (!plan) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    // The build ID is binary for GNU, so it's hex encoded
+    size_t keyLen = (idLen * 2) + scope_strlen(version) + sizeof(GO_PLAN_ARCH) + 16;
+    if (!(plan->key = scope_malloc(keyLen))) {
+        DBG(NULL);
+        scope_free(plan);
+        return NULL;
+    }
+
+    char *key = plan->key;
+    uint32_t i;
+    for (i = 0; i < idLen; i++) {
+        key += scope_snprintf(key, 3, "%02x", (unsigned char)id[i]);
+    }
+    scope_snprintf(key, keyLen - (key - plan->key), "|%s|%s|%u", version, GO_PLAN_ARCH, tapNum);
+    plan->keyLen = scope_strlen(plan->key);
+    plan->tapNum = tapNum;
+
+    return plan;
+}
+
+void
+goPlanDestroy(go_plan_t **planptr)
+{
+    if (!planptr || !*planptr) return;
+    go_plan_t *plan = *planptr;
+
+    scope_free(plan->key);
+    if (plan->patch) scope_free(plan->patch);
+    scope_free(plan);
+    *planptr = NULL;
+}
+
+/*
+ * Plans are kept in a directory of their own for each euid, which no one
+ * else can write; the directory above it may be shared.  If it isn't ours
+ * alone, no plans are used or saved.
+ */
+static bool
+planDir(const char *dir, bool create, char *path, size_t len)
+{
+    uid_t euid = scope_geteuid();
+    const char *sep = (dir[0] && (dir[scope_strlen(dir) - 1] == '/')) ? "" : "/";
+    int rc = scope_snprintf(path, len, "%s%s%u", dir, sep, euid);
+    if ((rc <= 0) || (rc >= len)) return FALSE;
+
+    if (create) {
+        if (!sigSafeMkdirRecursive(dir)) return FALSE;
+        if (scope_mkdir(path, 0700) && (scope_errno != EEXIST)) return FALSE;
+    }
+
+    struct stat st;
+    if (scope_lstat(path, &st)) return FALSE;
+    if (!S_ISDIR(st.st_mode) || (st.st_uid != euid) ||
+        (st.st_mode & (S_IRWXG | S_IRWXO))) {
+        scopeLogInfo("Not using Go patch plans in %s; it isn't private to this user", path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static bool
+planPath(go_plan_t *plan, const char *dir, bool create, char *path, size_t len)
+{
+    char userDir[PATH_MAX];
+    if (!planDir(dir, create, userDir, sizeof(userDir))) return FALSE;
+
+    uint64_t hash = planHash(PLAN_HASH_INIT, plan->key, plan->keyLen);
+    int rc = scope_snprintf(path, len, "%s/%016lx.plan", userDir, hash);
+    return ((rc > 0) && (rc < len));
+}
+
+bool
+goPlanLoad(go_plan_t *plan, const char *dir)
+{
+    if (!plan || !dir || !dir[0]) return FALSE;
+
+    char path[PATH_MAX];
+    if (!planPath(plan, dir, FALSE, path, sizeof(path))) return FALSE;
+
+    int fd = scope_open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd == -1) return FALSE;
+
+    bool rc = FALSE;
+    struct stat st;
+    char *map = MAP_FAILED;
+    if (scope_fstat(fd, &st)) goto out;
+
+    // Only a plan that no one else could have written is trusted
+    if (!S_ISREG(st.st_mode) || (st.st_uid != scope_geteuid()) ||
+        (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        scopeLogInfo("Ignoring the Go patch plan %s; it isn't private to this user", path);
+        goto out;
+    }
+
+    if ((st.st_size < sizeof(go_plan_hdr_t)) ||
+        ((map = scope_mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)) {
+        goto out;
+    }
+
+    const go_plan_hdr_t *hdr = (const go_plan_hdr_t *)map;
+    size_t patchOff = sizeof(*hdr) + KEY_PAD(plan->keyLen);
+    if (scope_memcmp(hdr->magic, GO_PLAN_MAGIC, sizeof(hdr->magic)) ||
+        (hdr->keyLen != plan->keyLen) ||
+        (hdr->patchNum > MAX_PATCHES) ||
+        (st.st_size != patchOff + (hdr->patchNum * sizeof(go_patch_t))) ||
+        scope_memcmp(map + sizeof(*hdr), plan->key, plan->keyLen) ||
+        (hdr->checksum != planHash(PLAN_HASH_INIT, map + sizeof(*hdr), st.st_size - sizeof(*hdr)))) {
+        scopeLogInfo("Ignoring the Go patch plan %s; it doesn't match this executable", path);
+        goto out;
+    }
+
+    go_patch_t *patch = NULL;
+    if (hdr->patchNum &&
+        !(patch = scope_malloc(hdr->patchNum * sizeof(go_patch_t)))) {
+        DBG(NULL);
+        goto out;
+    }
+    uint32_t i;
+    for (i = 0; i < hdr->patchNum; i++) {
+        scope_memcpy(&patch[i], map + patchOff + (i * sizeof(go_patch_t)), sizeof(go_patch_t));
+        if ((patch[i].tap >= plan->tapNum) || (patch[i].kind > GO_PATCH_RET)) {
+            scope_free(patch);
+            goto out;
+        }
+    }
+
+    if (plan->patch) scope_free(plan->patch);
+    plan->patch = patch;
+    plan->num = plan->alloc = hdr->patchNum;
+    plan->systemStack = hdr->systemStack;
+    rc = TRUE;
+
+out:
+    if (map != MAP_FAILED) scope_munmap(map, st.st_size);
+    scope_close(fd);
+    return rc;
+}
+
+bool
+goPlanSave(go_plan_t *plan, const char *dir)
+{
+    if (!plan || !dir || !dir[0]) return FALSE;
+
+    char path[PATH_MAX];
+    char tmpPath[PATH_MAX];
+    if (!planPath(plan, dir, TRUE, path, sizeof(path))) return FALSE;
+    int len = scope_snprintf(tmpPath, sizeof(tmpPath), "%s.%d", path, scope_getpid());
+    if ((len <= 0) || (len >= sizeof(tmpPath))) return FALSE;
+
+    char pad[8] = {0};
+    size_t padLen = KEY_PAD(plan->keyLen) - plan->keyLen;
+    size_t patchLen = plan->num * sizeof(go_patch_t);
+
+    go_plan_hdr_t hdr = {0};
+    scope_memcpy(hdr.magic, GO_PLAN_MAGIC, sizeof(hdr.magic));
+    hdr.keyLen = plan->keyLen;
+    hdr.patchNum = plan->num;
+    hdr.systemStack = plan->systemStack;
+    hdr.checksum = planHash(PLAN_HASH_INIT, plan->key, plan->keyLen);
+    hdr.checksum = planHash(hdr.checksum, pad, padLen);
+    hdr.checksum = planHash(hdr.checksum, plan->patch, patchLen);
+
+    // Whatever's left of an earlier save is replaced, never written through
+    scope_unlink(tmpPath);
+    int fd = scope_open(tmpPath, O_CREAT | O_EXCL | O_NOFOLLOW | O_WRONLY | O_CLOEXEC, 0600);
+    if (fd == -1) return FALSE;
+
+    bool rc = ((scope_write(fd, &hdr, sizeof(hdr)) == sizeof(hdr)) &&
+               (scope_write(fd, plan->key, plan->keyLen) == plan->keyLen) &&
+               (scope_write(fd, pad, padLen) == padLen) &&
+               (!patchLen || (scope_write(fd, plan->patch, patchLen) == patchLen)));
+    scope_close(fd);
+
+    // Readers only ever see a complete file
+    if (!rc || scope_rename(tmpPath, path)) {
+        scope_unlink(tmpPath);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+bool
+goPlanAdd(go_plan_t *plan, const go_patch_t *patch)
+{
+    if (!plan || !patch || (plan->num >= MAX_PATCHES)) return FALSE;
+
+    if (plan->num == plan->alloc) {
+        size_t alloc = (plan->alloc) ? plan->alloc * 2 : MIN_PATCHES;
+        go_patch_t *grown = scope_realloc(plan->patch, alloc * sizeof(go_patch_t));
+        if (!grown) {
+            DBG(NULL);
+            return FALSE;
+        }
+        plan->patch = grown;
+        plan->alloc = alloc;
+    }
+
+    plan->patch[plan->num++] = *patch;
+    return TRUE;
+}
+
+size_t
+goPlanCount(go_plan_t *plan)
+{
+    return (plan) ? plan->num : 0;
+}
+
+const go_patch_t *
+goPlanPatch(go_plan_t *plan, size_t i)
+{
+    return (plan && (i < plan->num)) ? &plan->patch[i] : NULL;
+}
+
+uint64_t
+goPlanSystemStack(go_plan_t *plan)
+{
+    return (plan) ? plan->systemStack : 0;
+}
+
+void
+goPlanSetSystemStack(go_plan_t *plan, uint64_t addr)
+{
+    if (plan) plan->systemStack = addr;
+}
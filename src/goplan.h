@@ -0,0 +1,55 @@
+#ifndef __GOPLAN_H__
+#define __GOPLAN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "scopetypes.h"
+
+// A Go patch plan records where initGoHook() patched a Go executable,
+// so that later starts of the same executable can skip resolving and
+// disassembling the hooked functions.  Plans are kept in files, one per
+// executable, under GO_PLAN_DIR (or $SCOPE_GO_PLAN_DIR; set it empty to
+// turn plans off), in a subdirectory for each euid that only it can
+// write.  A plan is only used if it was saved for the same build ID and
+// libscope version, its checksum is good, and the file is the euid's and
+// can't be written by anyone else.
+//
+
+#define GO_PLAN_DIR SCOPE_TMP_PATH "goplan/"
+
+typedef enum {
+    GO_PATCH_FIRST,      // the first instruction of the function
+    GO_PATCH_SYSCALL,    // a syscall instruction
+    GO_PATCH_CALL,       // the instruction after a call
+    GO_PATCH_RET,        // the instruction before a ret
+} go_patch_kind_t;
+
+typedef struct {
+    uint64_t addr;       // unrelocated address of the patched instruction
+    uint32_t frameSize;  // Go stack frame size at addr
+    uint16_t tap;        // index into the schema's taps
+    uint8_t  kind;       // a go_patch_kind_t
+    uint8_t  pad;
+} go_patch_t;
+
+typedef struct _go_plan_t go_plan_t;
+
+// buf is the whole ELF file.  Returns NULL if the executable has no
+// build ID; there's nothing to key a plan on.
+go_plan_t *goPlanCreate(const char *buf, const char *version, uint32_t tapNum);
+void       goPlanDestroy(go_plan_t **);
+
+// Returns TRUE if a valid plan was read from dir; its patches replace
+// any in the plan.
+bool       goPlanLoad(go_plan_t *, const char *dir);
+bool       goPlanSave(go_plan_t *, const char *dir);
+
+bool       goPlanAdd(go_plan_t *, const go_patch_t *);
+size_t     goPlanCount(go_plan_t *);
+const go_patch_t *goPlanPatch(go_plan_t *, size_t);
+
+// The (unrelocated) address of the Go system stack switch function
+uint64_t   goPlanSystemStack(go_plan_t *);
+void       goPlanSetSystemStack(go_plan_t *, uint64_t);
+
+#endif // __GOPLAN_H__
@@ -0,0 +1,320 @@
+#define _GNU_SOURCE
+#include <elf.h>
+#include "dbg.h"
+#include "gosymtab.h"
+#include "scopestdlib.h"
+
+#define GOPCLNTAB_MAGIC_112 0xfffffffb
+#define GOPCLNTAB_MAGIC_116 0xfffffffa
+#define GOPCLNTAB_MAGIC_118 0xfffffff0
+#define GOPCLNTAB_MAGIC_120 0xfffffff1
+
+#define MIN_SYM_SLOTS 16
+
+typedef struct {
+    char *name;             // NULL if the slot is empty
+    uint32_t hash;
+    uint64_t symAddr;       // address from the ELF .symtab or 0
+    uint64_t pclnAddr;      // address from the pclntab or 0
+} go_sym_t;
+
+struct _go_symtab_t {
+    const char *buf;
+
+    // ELF .symtab and its strings, if there are any
+    const Elf64_Sym *elfSyms;
+    size_t elfNum;
+    const char *elfStrs;
+
+    // pclntab, if one was found
+    const char *pcln;
+    uint32_t magic;
+    uint64_t funcNum;
+    const char *functab;    // the table of function entries
+    const char *funcnametab;// function name offsets are relative to this
+    uint64_t textStart;     // function entry offsets are relative to this
+
+    // The names asked for, open-addressed and never more than half full
+    go_sym_t *syms;
+    size_t slots;
+};
+
+static uint32_t
+nameHash(const char *name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Returns the slot holding name, or the empty slot where it belongs
+static go_sym_t *
+symSlot(go_symtab_t *symtab, const char *name, uint32_t hash)
+{
+    size_t mask = symtab->slots - 1;
+    size_t ix = hash & mask;
+    go_sym_t *sym;
+
+    while ((sym = &symtab->syms[ix])->name) {
+        if ((sym->hash == hash) && !scope_strcmp(sym->name, name)) break;
+        ix = (ix + 1) & mask;
+    }
+    return sym;
+}
+
+static void
+findElfSymtab(go_symtab_t *symtab)
+{
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *)symtab->buf;
+    Elf64_Shdr *sections = (Elf64_Shdr *)(symtab->buf + ehdr->e_shoff);
+    const char *section_strtab = symtab->buf + sections[ehdr->e_shstrndx].sh_offset;
+    int i;
+
+    for (i = 0; i < ehdr->e_shnum; i++) {
+        const char *sec_name = section_strtab + sections[i].sh_name;
+
+        if ((sections[i].sh_type == SHT_SYMTAB) && sections[i].sh_entsize) {
+            symtab->elfSyms = (const Elf64_Sym *)(symtab->buf + sections[i].sh_offset);
+            symtab->elfNum = sections[i].sh_size / sections[i].sh_entsize;
+        } else if ((sections[i].sh_type == SHT_STRTAB) && !scope_strcmp(sec_name, ".strtab")) {
+            symtab->elfStrs = symtab->buf + sections[i].sh_offset;
+        }
+    }
+
+    if (!symtab->elfStrs) symtab->elfNum = 0;
+}
+
+// Returns a pclntab embedded in .data.rel.ro; used when there's no
+// .gopclntab section
+static const char *
+findEmbeddedPclntab(go_symtab_t *symtab)
+{
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *)symtab->buf;
+    Elf64_Shdr *sections = (Elf64_Shdr *)(symtab->buf + ehdr->e_shoff);
+    const char *section_strtab = symtab->buf + sections[ehdr->e_shstrndx].sh_offset;
+    int i;
+
+    for (i = 0; i < ehdr->e_shnum; i++) {
+        const char *sec_name = section_strtab + sections[i].sh_name;
+        if (!scope_strstr(sec_name, "data.rel.ro")) continue;
+
+        const unsigned char *data = (const unsigned char *)(symtab->buf + sections[i].sh_offset);
+        size_t slen = sections[i].sh_size;
+        size_t j;
+
+        // Find the magic number in the pclntab header
+        for (j = 0; j + 4 <= slen; j += 4) {
+            if (((data[j] == 0xf1) || (data[j] == 0xf0) ||
+                 (data[j] == 0xfa) || (data[j] == 0xfb)) &&
+                data[j+1] == 0xff &&
+                data[j+2] == 0xff &&
+                data[j+3] == 0xff) {
+                return (const char *)&data[j];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void
+findPclntab(go_symtab_t *symtab)
+{
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *)symtab->buf;
+    Elf64_Shdr *sections = (Elf64_Shdr *)(symtab->buf + ehdr->e_shoff);
+    const char *section_strtab = symtab->buf + sections[ehdr->e_shstrndx].sh_offset;
+    const char *pcln = NULL;
+    int i;
+
+    for (i = 0; i < ehdr->e_shnum; i++) {
+        const char *sec_name = section_strtab + sections[i].sh_name;
+        if (scope_strstr(sec_name, ".gopclntab")) {
+            pcln = symtab->buf + sections[i].sh_offset;
+            break;
+        }
+    }
+
+    if (!pcln && !(pcln = findEmbeddedPclntab(symtab))) return;
+
+    /*
+     * The Go symbol table is stored in the .gopclntab section
+     * More info: https://docs.google.com/document/d/1lyPIbmsYbXnpNj57a261hgOYVpNRcgydurVQIyZOz_o/pub
+     */
+    uint32_t magic = *((const uint32_t *)pcln);
+    if (magic == GOPCLNTAB_MAGIC_112) {
+        symtab->functab = pcln + 16;
+        symtab->funcnametab = pcln;
+    } else if (magic == GOPCLNTAB_MAGIC_116) {
+        symtab->funcnametab = pcln + *((const uint64_t *)(pcln + (3 * 8)));
+        symtab->functab = pcln + *((const uint64_t *)(pcln + (7 * 8)));
+    } else if ((magic == GOPCLNTAB_MAGIC_118) || (magic == GOPCLNTAB_MAGIC_120)) {
+        // In go 1.18 the funcname table and the pcln table are stored in the text section
+        symtab->textStart = *((const uint64_t *)(pcln + (3 * 8)));
+        symtab->funcnametab = pcln + *((const uint64_t *)(pcln + (4 * 8)));
+        symtab->functab = pcln + *((const uint64_t *)(pcln + (8 * 8)));
+    } else {
+        scopeLog(CFG_LOG_DEBUG, "Invalid header in .gopclntab");
+        return;
+    }
+
+    symtab->pcln = pcln;
+    symtab->magic = magic;
+    symtab->funcNum = *((const uint64_t *)(pcln + 8));
+}
+
+// Returns the name of the i'th function in the pclntab, and its address
+static const char *
+pclnEntry(go_symtab_t *symtab, uint64_t i, uint64_t *addr)
+{
+    const char *entry;
+    uint32_t name_offset;
+
+    switch (symtab->magic) {
+        case GOPCLNTAB_MAGIC_112:
+            entry = symtab->functab + (i * 16);
+            *addr = *((const uint64_t *)entry);
+            name_offset = *((const uint32_t *)(symtab->pcln + *((const uint64_t *)(entry + 8)) + 8));
+            break;
+        case GOPCLNTAB_MAGIC_116:
+            entry = symtab->functab + (i * 16);
+            *addr = *((const uint64_t *)entry);
+            name_offset = *((const uint32_t *)(symtab->functab + *((const uint64_t *)(entry + 8)) + 8));
+            break;
+        default:
+            // Go 1.18 - 1.20; a "symtab" entry is probably better known as a pcln
+            entry = symtab->functab + (i * 8);
+            *addr = symtab->textStart + *((const uint32_t *)entry);
+            name_offset = *((const uint32_t *)(symtab->functab + *((const uint32_t *)(entry + 4)) + 4));
+            break;
+    }
+
+    return symtab->funcnametab + name_offset;
+}
+
+// One pass over each table finds the address of every name asked for
+static void
+indexSymbols(go_symtab_t *symtab, size_t wanted)
+{
+    size_t found = 0;
+    uint64_t i;
+
+    for (i = 0; (i < symtab->elfNum) && (found < wanted); i++) {
+        const char *name = symtab->elfStrs + symtab->elfSyms[i].st_name;
+        go_sym_t *sym = symSlot(symtab, name, nameHash(name));
+        if (!sym->name || sym->symAddr || !symtab->elfSyms[i].st_value) continue;
+
+        sym->symAddr = symtab->elfSyms[i].st_value;
+        found++;
+    }
+
+    found = 0;
+    for (i = 0; symtab->pcln && (i < symtab->funcNum) && (found < wanted); i++) {
+        uint64_t addr;
+        const char *name = pclnEntry(symtab, i, &addr);
+        go_sym_t *sym = symSlot(symtab, name, nameHash(name));
+        if (!sym->name || sym->pclnAddr || !addr) continue;
+
+        sym->pclnAddr = addr;
+        found++;
+    }
+}
+
+go_symtab_t *
+goSymtabCreate(const char *buf, const char **names, size_t num)
+{
+    if (!buf) return NULL;
+
+    go_symtab_t *symtab = scope_calloc(1, sizeof(go_symtab_t));
+    if (!symtab) {
+        DBG(NULL);
+        return NULL;
+    }
+    symtab->buf = buf;
+
+    symtab->slots = MIN_SYM_SLOTS;
+    while (symtab->slots < (num * 2)) symtab->slots *= 2;
+    if (!(symtab->syms = scope_calloc(symtab->slots, sizeof(go_sym_t)))) {
+        DBG(NULL);
+        scope_free(symtab);
+        return NULL;
+    }
+
+    findElfSymtab(symtab);
+    findPclntab(symtab);
+
+    size_t wanted = 0;
+    size_t i;
+    for (i = 0; names && (i < num); i++) {
+        if (!names[i]) continue;
+
+        uint32_t hash = nameHash(names[i]);
+        go_sym_t *sym = symSlot(symtab, names[i], hash);
+        if (sym->name) continue;  // a duplicate
+
+        if (!(sym->name = scope_strdup(names[i]))) {
+            DBG(NULL);
+            goSymtabDestroy(&symtab);
+            return NULL;
+        }
+        sym->hash = hash;
+        wanted++;
+    }
+
+    if (wanted) indexSymbols(symtab, wanted);
+
+    return symtab;
+}
+
+void
+goSymtabDestroy(go_symtab_t **symtabptr)
+{
+    if (!symtabptr || !*symtabptr) return;
+    go_symtab_t *symtab = *symtabptr;
+
+    size_t i;
+    for (i = 0; i < symtab->slots; i++) {
+        if (symtab->syms[i].name) scope_free(symtab->syms[i].name);
+    }
+    scope_free(symtab->syms);
+    scope_free(symtab);
+    *symtabptr = NULL;
+}
+
+void *
+goSymtabFind(go_symtab_t *symtab, const char *name)
+{
+    if (!symtab || !name) return NULL;
+
+    go_sym_t *sym = symSlot(symtab, name, nameHash(name));
+    if (sym->name) {
+        return (void *)((sym->symAddr) ? sym->symAddr : sym->pclnAddr);
+    }
+
+    // Not one of the names that were indexed; scan for it
+    uint64_t i;
+    for (i = 0; i < symtab->elfNum; i++) {
+        if (symtab->elfSyms[i].st_value &&
+            !scope_strcmp(name, symtab->elfStrs + symtab->elfSyms[i].st_name)) {
+            return (void *)symtab->elfSyms[i].st_value;
+        }
+    }
+
+    for (i = 0; symtab->pcln && (i < symtab->funcNum); i++) {
+        uint64_t addr;
+        if (!scope_strcmp(name, pclnEntry(symtab, i, &addr)) && addr) {
+            return (void *)addr;
+        }
+    }
+
+    return NULL;
+}
+
+uint64_t
+goSymtabFuncCount(go_symtab_t *symtab)
+{
+    return (symtab && symtab->pcln) ? symtab->funcNum : 0;
+}
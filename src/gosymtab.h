@@ -0,0 +1,30 @@
+#ifndef __GOSYMTAB_H__
+#define __GOSYMTAB_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "scopetypes.h"
+
+// A Go symbol table resolves the functions we hook in a Go executable.
+// Names are looked for in the ELF .symtab and then in the Go runtime's
+// function table (the pclntab), which is there even when the executable
+// has been stripped.  The pclntab is located once, and both tables are
+// walked once to find all of the names given to goSymtabCreate(), so
+// looking up many names costs one pass rather than one pass per name.
+//
+
+typedef struct _go_symtab_t go_symtab_t;
+
+// buf is the whole ELF file and must outlive the go_symtab_t.  names
+// are the functions that goSymtabFind() will be asked about; names
+// not in the list can still be found, with a scan.
+go_symtab_t *goSymtabCreate(const char *buf, const char **names, size_t num);
+void         goSymtabDestroy(go_symtab_t **);
+
+// Returns the (unrelocated) address of the function, or NULL
+void *       goSymtabFind(go_symtab_t *, const char *name);
+
+// Returns the number of functions in the pclntab; 0 if there isn't one
+uint64_t     goSymtabFuncCount(go_symtab_t *);
+
+#endif // __GOSYMTAB_H__
@@ -10,7 +10,11 @@
 
 
 #define DEFAULT_TARGET_LEN ( 128 )
+#define DEFAULT_MAX_TARGETS ( 512 )
 #define MAX_CODE_ENTRIES ( 64 )
+#define MIN_CODE_SLOTS ( 8 )
+#define MAX_TARGET_LEN ( 1024 )
+#define OTHER_TARGET "other"
 
 typedef enum {
     SERVER_DURATION,
@@ -46,16 +50,34 @@ typedef struct {
     uint64_t num_entries; // number of entries, to support average calculation
 } agg_counter_t;
 
-typedef struct {
-    char * uri;           // the key that comes from http_target
-    status_code_t status[MAX_CODE_ENTRIES];
+typedef struct target_agg {
+    struct target_agg *next; // next in the hash bucket
+    char * uri;           // the key; http_target with identifiers templated
+    uint64_t hash;        // hash of uri
+    uint64_t count;       // requests counted against this entry; see below
+    uint64_t heap_ix;     // position in http_agg->target
+    status_code_t *status;   // open-addressed by code
+    unsigned status_slots;
+    unsigned num_status;
     agg_counter_t field[FIELD_MAX];
 } target_agg_t;
 
+// Targets are found through a hash table of chained buckets.  They're also
+// kept in the target array as a min-heap ordered by count so once there are
+// max_targets of them, the least-seen one can be evicted to make room for a
+// new one (the "Space-Saving" algorithm).  The new target inherits the count
+// of the one it replaced so a target only stays in the table if it's seen
+// often; the counts are just for ranking, never reported.  What was
+// aggregated for an evicted target is folded into the "other" entry so the
+// reported totals are still correct.
 struct _http_agg_t {
     target_agg_t** target;
     uint64_t count;
     uint64_t alloc;
+    target_agg_t** buckets;
+    uint64_t num_buckets;
+    uint64_t max_targets; // zero means unbounded
+    target_agg_t other;
 };
 
 
@@ -64,16 +86,22 @@ httpAggCreate(void)
 {
     http_agg_t* agg = scope_calloc(1, sizeof(*agg));
     target_agg_t** target_lst = scope_calloc(1, sizeof(*target_lst) * DEFAULT_TARGET_LEN);
-    if (!agg || !target_lst) {
+    target_agg_t** buckets = scope_calloc(1, sizeof(*buckets) * DEFAULT_TARGET_LEN);
+    if (!agg || !target_lst || !buckets) {
         if (agg) scope_free(agg);
         if (target_lst) scope_free(target_lst);
-        DBG("agg = %p, target_lst = %p", agg, target_lst);
+        if (buckets) scope_free(buckets);
+        DBG("agg = %p, target_lst = %p, buckets = %p", agg, target_lst, buckets);
         return NULL;
     }
 
     agg->target = target_lst;
     agg->count = 0;
     agg->alloc = DEFAULT_TARGET_LEN;
+    agg->buckets = buckets;
+    agg->num_buckets = DEFAULT_TARGET_LEN;
+    agg->max_targets = DEFAULT_MAX_TARGETS;
+    agg->other.uri = OTHER_TARGET;
 
     return agg;
 }
@@ -87,12 +115,21 @@ httpAggDestroy(http_agg_t **http_agg_ptr)
     http_agg_t* http_agg = *http_agg_ptr;
     httpAggReset(http_agg);
 
+    if (http_agg->other.status) scope_free(http_agg->other.status);
+    scope_free(http_agg->buckets);
     scope_free(http_agg->target);
     scope_free(http_agg);
 
     *http_agg_ptr = NULL;
 }
 
+void
+httpAggSetMaxTargets(http_agg_t *http_agg, size_t max_targets)
+{
+    if (!http_agg) return;
+    http_agg->max_targets = max_targets;
+}
+
 // accessor for event; return the string value for the name field
 static const char *
 str_value(event_t *evt, const char *name)
@@ -125,32 +162,259 @@ num_value(event_t *evt, const char *name)
     return LLONG_MIN;
 }
 
+static int
+is_hex(const char x)
+{
+    if (x >= '0' && x <= '9') return 1;
+    if (x >= 'A' && x <= 'F') return 1;
+    if (x >= 'a' && x <= 'f') return 1;
+    return 0;
+}
+
+// Is the path segment an identifier that should be templated?  Returns the
+// placeholder for it or NULL.
+static const char *
+segment_template(const char *seg, size_t len)
+{
+    if (!len) return NULL;
+
+    size_t i;
+    for (i = 0; i < len && seg[i] >= '0' && seg[i] <= '9'; i++);
+    if (i == len) return "{id}";
+
+    // 8-4-4-4-12 hex digits
+    if (len != 36) return NULL;
+    for (i = 0; i < len; i++) {
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (seg[i] != '-') return NULL;
+        } else if (!is_hex(seg[i])) {
+            return NULL;
+        }
+    }
+    return "{uuid}";
+}
+
+// Copy the http_target into buf with the query string removed and any path
+// segments that are identifiers replaced with placeholders; "/user/42?x=y"
+// becomes "/user/{id}".  This is done to manage the cardinality.  Returns
+// the length of the result which is truncated to fit if needed.
+static size_t
+template_target(const char *target_val, char *buf, size_t size)
+{
+    size_t len = 0;
+    const char *pos = target_val;
+
+    // per rfc3986: query strings start with a '?'
+    // https://example.com/over/there?name=ferret
+    while (*pos && *pos != '?' && len < size - 1) {
+        size_t seg_len = scope_strcspn(pos, "/?");
+        const char *placeholder = segment_template(pos, seg_len);
+        const char *copy = (placeholder) ? placeholder : pos;
+        size_t copy_len = (placeholder) ? scope_strlen(placeholder) : seg_len;
+
+        if (copy_len > size - 1 - len) copy_len = size - 1 - len;
+        scope_memcpy(&buf[len], copy, copy_len);
+        len += copy_len;
+        pos += seg_len;
+
+        if (*pos == '/' && len < size - 1) {
+            buf[len++] = '/';
+            pos++;
+        }
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static uint64_t
+hash_target(const char *uri, size_t len)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char)uri[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void
+bucket_insert(http_agg_t *http_agg, target_agg_t *entry)
+{
+    target_agg_t **bucket = &http_agg->buckets[entry->hash & (http_agg->num_buckets - 1)];
+    entry->next = *bucket;
+    *bucket = entry;
+}
+
+static void
+bucket_remove(http_agg_t *http_agg, target_agg_t *entry)
+{
+    target_agg_t **link = &http_agg->buckets[entry->hash & (http_agg->num_buckets - 1)];
+    while (*link && *link != entry) link = &(*link)->next;
+    if (*link) *link = entry->next;
+}
+
+// Double the buckets when there's more than one target per bucket.
+// Not being able to grow just makes the chains longer.
+static void
+buckets_grow(http_agg_t *http_agg)
+{
+    uint64_t num_buckets = http_agg->num_buckets * 2;
+    target_agg_t **buckets = scope_calloc(num_buckets, sizeof(*buckets));
+    if (!buckets) return;
+
+    scope_free(http_agg->buckets);
+    http_agg->buckets = buckets;
+    http_agg->num_buckets = num_buckets;
+
+    int i;
+    for (i=0; i<http_agg->count; i++) {
+        bucket_insert(http_agg, http_agg->target[i]);
+    }
+}
+
+static void
+heap_swap(http_agg_t *http_agg, uint64_t a, uint64_t b)
+{
+    target_agg_t *tmp = http_agg->target[a];
+    http_agg->target[a] = http_agg->target[b];
+    http_agg->target[b] = tmp;
+    http_agg->target[a]->heap_ix = a;
+    http_agg->target[b]->heap_ix = b;
+}
+
+static void
+heap_up(http_agg_t *http_agg, uint64_t ix)
+{
+    while (ix) {
+        uint64_t parent = (ix - 1) / 2;
+        if (http_agg->target[parent]->count <= http_agg->target[ix]->count) break;
+        heap_swap(http_agg, parent, ix);
+        ix = parent;
+    }
+}
+
+static void
+heap_down(http_agg_t *http_agg, uint64_t ix)
+{
+    for (;;) {
+        uint64_t least = ix;
+        uint64_t child = 2 * ix + 1;
+        if (child < http_agg->count &&
+            http_agg->target[child]->count < http_agg->target[least]->count) {
+            least = child;
+        }
+        child++;
+        if (child < http_agg->count &&
+            http_agg->target[child]->count < http_agg->target[least]->count) {
+            least = child;
+        }
+        if (least == ix) break;
+        heap_swap(http_agg, least, ix);
+        ix = least;
+    }
+}
+
+// Returns the slot for the status code in the entry, adding it if needed.
+// Returns NULL if the entry already has MAX_CODE_ENTRIES codes.
+static status_code_t *
+status_slot(target_agg_t *entry, int code)
+{
+    if ((entry->num_status + 1) * 2 > entry->status_slots &&
+        entry->num_status < MAX_CODE_ENTRIES) {
+        // keep the table at most half full
+        unsigned slots = (entry->status_slots) ? entry->status_slots * 2 : MIN_CODE_SLOTS;
+        status_code_t *status = scope_calloc(slots, sizeof(*status));
+        if (!status) {
+            DBG(NULL);
+            return NULL;
+        }
+        unsigned i;
+        for (i = 0; i < entry->status_slots; i++) {
+            if (!entry->status[i].code) continue;
+            unsigned j = entry->status[i].code & (slots - 1);
+            while (status[j].code) j = (j + 1) & (slots - 1);
+            status[j] = entry->status[i];
+        }
+        if (entry->status) scope_free(entry->status);
+        entry->status = status;
+        entry->status_slots = slots;
+    }
+    if (!entry->status_slots) return NULL;
+
+    unsigned i = code & (entry->status_slots - 1);
+    while (entry->status[i].code && entry->status[i].code != code) {
+        i = (i + 1) & (entry->status_slots - 1);
+    }
+    if (!entry->status[i].code) {
+        if (entry->num_status >= MAX_CODE_ENTRIES) return NULL;
+        entry->status[i].code = code;
+        entry->num_status++;
+    }
+    return &entry->status[i];
+}
+
+// Fold what's been aggregated for an evicted target into "other"
+static void
+merge_other(http_agg_t *http_agg, target_agg_t *entry)
+{
+    target_agg_t *other = &http_agg->other;
+
+    unsigned i;
+    for (i = 0; i < entry->status_slots; i++) {
+        if (!entry->status[i].code) continue;
+        status_code_t *slot = status_slot(other, entry->status[i].code);
+        if (slot) slot->count += entry->status[i].count;
+    }
+
+    counter_field_enum f;
+    for (f = SERVER_DURATION; f < FIELD_MAX; f++) {
+        other->field[f].total += entry->field[f].total;
+        other->field[f].num_entries += entry->field[f].num_entries;
+    }
+}
+
 static target_agg_t *
 get_target_entry(http_agg_t *http_agg, const char* target_val)
 {
     if (!http_agg || !target_val) return NULL;
 
-    // per rfc3986: query strings start with a '?'
-    // https://example.com/over/there?name=ferret
-    // if a target_val has a query string ignore that part of the uri.
-    // This is done as just one small way to manage the cardiality.
-    char *temp_uri = scope_strdup(target_val);
-    if (!temp_uri) {
+    char uri[MAX_TARGET_LEN];
+    size_t len = template_target(target_val, uri, sizeof(uri));
+    uint64_t hash = hash_target(uri, len);
+
+    // look to see if target already exists
+    // if so, return a pointer to it.
+    target_agg_t *entry = http_agg->buckets[hash & (http_agg->num_buckets - 1)];
+    for (; entry; entry = entry->next) {
+        if (entry->hash == hash && !scope_strcmp(entry->uri, uri)) {
+            return entry;
+        }
+    }
+
+    char *new_uri = scope_strdup(uri);
+    if (!new_uri) {
         DBG(NULL);
         return NULL;
     }
-    char *query_ptr = scope_strchr(temp_uri, '?');
-    if (query_ptr) *query_ptr = '\0';
 
+    // if we're at the limit, replace the least-seen target
+    if (http_agg->max_targets && http_agg->count >= http_agg->max_targets) {
+        entry = http_agg->target[0];
+        merge_other(http_agg, entry);
+        bucket_remove(http_agg, entry);
 
-    // look to see if target already exists in list
-    // if so, return a pointer to it.
-    int i;
-    for (i=0; i<http_agg->count; i++) {
-        if (!scope_strcmp(http_agg->target[i]->uri, temp_uri)) {
-            scope_free(temp_uri);
-            return http_agg->target[i];
+        scope_free(entry->uri);
+        if (entry->status) {
+            scope_memset(entry->status, 0, entry->status_slots * sizeof(*entry->status));
         }
+        entry->num_status = 0;
+        scope_memset(entry->field, 0, sizeof(entry->field));
+        entry->uri = new_uri;
+        entry->hash = hash;
+        bucket_insert(http_agg, entry);
+        return entry;
     }
 
     // if not, and we're out of room, scope_realloc
@@ -158,7 +422,7 @@ get_target_entry(http_agg_t *http_agg, const char* target_val)
         uint64_t new_size = http_agg->alloc << 2; // same as multiplying by 4
         target_agg_t **temp_target = scope_realloc(http_agg->target, sizeof(*temp_target) * new_size);
         if (!temp_target) {
-            scope_free(temp_uri);
+            scope_free(new_uri);
             DBG(NULL);
             return NULL;
         }
@@ -169,18 +433,27 @@ get_target_entry(http_agg_t *http_agg, const char* target_val)
     }
 
     // Now create the new target entry
-    target_agg_t *temp_target = scope_calloc(1, sizeof(*temp_target));
-    if (!temp_target) {
-        scope_free(temp_uri);
+    entry = scope_calloc(1, sizeof(*entry));
+    if (!entry) {
+        scope_free(new_uri);
         DBG(NULL);
         return NULL;
     }
 
     // Add the new target entry
-    temp_target->uri = temp_uri;
-    http_agg->target[http_agg->count++] = temp_target;
+    entry->uri = new_uri;
+    entry->hash = hash;
+    entry->heap_ix = http_agg->count;
+    http_agg->target[http_agg->count++] = entry;
+    heap_up(http_agg, entry->heap_ix);
+
+    if (http_agg->count > http_agg->num_buckets) {
+        buckets_grow(http_agg);
+    } else {
+        bucket_insert(http_agg, entry);
+    }
 
-    return temp_target;
+    return entry;
 }
 
 static void
@@ -200,21 +473,10 @@ add_status(target_agg_t *entry, long long value)
         DBG("%lld", value);
         return;
     }
+    if (value == 0) return;
 
-    int i;
-    for (i=0; i<MAX_CODE_ENTRIES; i++) {
-        if (entry->status[i].code == value) {
-            // the code already exists, increment the count for it
-            entry->status[i].count++;
-            break;
-        }
-        if (entry->status[i].code == 0) {
-            // add code to the end of the list and increment count
-            entry->status[i].code = value;
-            entry->status[i].count++;
-            break;
-        }
-    }
+    status_code_t *slot = status_slot(entry, value);
+    if (slot) slot->count++;
 }
 
 void
@@ -231,6 +493,10 @@ httpAggAddMetric(http_agg_t *http_agg,
     target_agg_t *target_entry = get_target_entry(http_agg, target_val);
     if (!target_entry) return;
 
+    // Rank it for the top-K
+    target_entry->count++;
+    heap_down(http_agg, target_entry->heap_ix);
+
     // Record the status in the target_entry
     long long status_val = num_value(duration, "http_status_code");
     add_status(target_entry, status_val);
@@ -262,8 +528,8 @@ report_target(mtc_t *mtc, target_agg_t *target)
 {
     {
         int i;
-        for (i=0; i<MAX_CODE_ENTRIES; i++) {
-            if (target->status[i].code == 0) break;
+        for (i=0; i<target->status_slots; i++) {
+            if (target->status[i].code == 0) continue;
 
             event_field_t fields[] = {
                 STRFIELD("http_target", target->uri, 4, TRUE),
@@ -323,6 +589,9 @@ httpAggSendReport(http_agg_t *http_agg, mtc_t *mtc)
         target_agg_t *target = http_agg->target[i];
         report_target(mtc, target);
     }
+
+    // targets that were evicted
+    report_target(mtc, &http_agg->other);
 }
 
 void
@@ -335,11 +604,18 @@ httpAggReset(http_agg_t *http_agg)
         target_agg_t *target = http_agg->target[i];
         if (target) {
             if (target->uri) scope_free(target->uri);
+            if (target->status) scope_free(target->status);
             scope_free(target);
         }
         http_agg->target[i] = NULL;
     }
     http_agg->count = 0;
-}
-
+    scope_memset(http_agg->buckets, 0, sizeof(*http_agg->buckets) * http_agg->num_buckets);
 
+    target_agg_t *other = &http_agg->other;
+    if (other->status) {
+        scope_memset(other->status, 0, other->status_slots * sizeof(*other->status));
+    }
+    other->num_status = 0;
+    scope_memset(other->field, 0, sizeof(other->field));
+}
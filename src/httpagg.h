@@ -11,11 +11,17 @@
 //   AddMetric
 //   SendReport (sends a summary of all Metrics received before it)
 //   Reset (returns to a state similar to Create)
+//
+// Targets are aggregated with the query string removed and with numeric and
+// UUID path segments replaced by "{id}" and "{uuid}".  At most 512 targets
+// (see httpAggSetMaxTargets) are tracked between resets; the most frequent
+// ones are kept and the rest are reported with an http_target of "other".
 
 typedef struct _http_agg_t http_agg_t;
 
 http_agg_t *httpAggCreate(void);
 void httpAggDestroy(http_agg_t **);
+void httpAggSetMaxTargets(http_agg_t *, size_t); // zero means no limit
 void httpAggAddMetric(http_agg_t *, event_t *, size_t, size_t);
 void httpAggSendReport(http_agg_t *, mtc_t *);
 void httpAggReset(http_agg_t *);
@@ -22,7 +22,7 @@ typedef void (*freeData_fn)(void *);
 typedef struct _store_t {
     hashTable_t *hashTable[HASH_TABLE_SIZE];
     net_info *netInfo;    // NET_ENTRIES array of pointers to net_info
-    list_t *extraNetInfo; // list of pointers to net_info
+    chantab_t *channelNetInfo; // net_info by channel ID
     freeData_fn freeData;
     size_t cbufSize;
     struct {
@@ -35,10 +35,10 @@ typedef struct _store_t {
 
 static store_t *
 storeCreate(net_info const * const netInfo,
-                list_t const * const extraNetInfo,
+                chantab_t const * const channelNetInfo,
                 freeData_fn freeData)
 {
-    if (!netInfo || !extraNetInfo || !freeData) return NULL;
+    if (!netInfo || !channelNetInfo || !freeData) return NULL;
 
     store_t *match = scope_calloc(1, sizeof(store_t));
     if (!match) {
@@ -47,20 +47,10 @@ storeCreate(net_info const * const netInfo,
     }
 
     match->netInfo = (net_info *) netInfo;
-    match->extraNetInfo = (list_t *)extraNetInfo;
+    match->channelNetInfo = (chantab_t *)channelNetInfo;
     match->freeData = freeData;
 
-    // Not great, but duplicated from ctlCreate()
-    match->cbufSize = DEFAULT_CBUF_SIZE;
-    char *qlen_str;
-    if ((qlen_str = fullGetEnv("SCOPE_QUEUE_LENGTH")) != NULL) {
-        unsigned long qlen;
-        scope_errno = 0;
-        qlen = scope_strtoul(qlen_str, NULL, 10);
-        if (!scope_errno && qlen) {
-            match->cbufSize = qlen;
-        }
-    }
+    match->cbufSize = queueLength();
 
     return match;
 }
@@ -267,15 +257,15 @@ storeExpire(httpmatch_t *match, uint64_t circBufCount, bool circBufWasEmptied)
 
             } else {
 
-                // netinfo and extraNetInfo are references to what sockets
+                // netinfo and channelNetInfo are references to what sockets
                 // are currently active on the datapath side of things.
                 // If the socket descriptor is not in the range of the netInfo
-                // then we'll have to look in extraNetInfo
+                // then we'll have to look in channelNetInfo
                 int sockfd = current->sockfd;
                 uint64_t sockid = current->sockid;
                 net_info *net = NULL;
                 if (sockfd < 0 || sockfd >= NET_ENTRIES) {
-                    net = lstFind(match->extraNetInfo, sockid);
+                    net = chanTabFind(match->channelNetInfo, sockid);
                 } else {
                     net = &match->netInfo[sockfd];
                 }
@@ -304,9 +294,9 @@ storeExpire(httpmatch_t *match, uint64_t circBufCount, bool circBufWasEmptied)
 //////////////////////
 
 httpmatch_t *
-httpMatchCreate(net_info const * const netInfo, list_t const * const extraNetInfo, freeReq_fn freeReq)
+httpMatchCreate(net_info const * const netInfo, chantab_t const * const channelNetInfo, freeReq_fn freeReq)
 {
-    return (httpmatch_t *)storeCreate(netInfo, extraNetInfo, (freeData_fn)freeReq);
+    return (httpmatch_t *)storeCreate(netInfo, channelNetInfo, (freeData_fn)freeReq);
 }
 
 void
@@ -345,9 +335,9 @@ httpReqExpire(httpmatch_t *match, uint64_t circBufCount, bool circBufWasEmptied)
 //////////////////////
 
 channelstore_t *
-channelStoreCreate(net_info const * const netInfo, list_t const * const extraNetInfo, freeChannel_fn freeChannel)
+channelStoreCreate(net_info const * const netInfo, chantab_t const * const channelNetInfo, freeChannel_fn freeChannel)
 {
-    return (channelstore_t *)storeCreate(netInfo, extraNetInfo, (freeData_fn)freeChannel);
+    return (channelstore_t *)storeCreate(netInfo, channelNetInfo, (freeData_fn)freeChannel);
 }
 
 void
@@ -380,4 +370,19 @@ channelExpire(channelstore_t *chanStore, uint64_t circBufCount, bool circBufWasE
     return storeExpire((store_t *)chanStore, circBufCount, circBufWasEmptied);
 }
 
+void
+channelForEach(channelstore_t *chanStore, channelVisit_fn visit, void *ctx)
+{
+    store_t *store = (store_t *)chanStore;
+    if (!store || !visit) return;
+
+    int i;
+    for (i = 0; i < HASH_TABLE_SIZE; i++) {
+        hashTable_t *item;
+        for (item = store->hashTable[i]; item; item = item->next) {
+            visit((http2Channel_t *)item->data, item->sockid, item->sockfd, ctx);
+        }
+    }
+}
+
 
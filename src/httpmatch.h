@@ -33,7 +33,7 @@ typedef struct _store_t httpmatch_t;
 
 typedef void (*freeReq_fn)(http_map *);
 
-httpmatch_t *httpMatchCreate(net_info const * const, list_t const * const, freeReq_fn);
+httpmatch_t *httpMatchCreate(net_info const * const, chantab_t const * const, freeReq_fn);
 void         httpMatchDestroy(httpmatch_t **);
 
 bool         httpReqSave(httpmatch_t *, http_map *);
@@ -57,14 +57,16 @@ typedef struct http2Channel http2Channel_t;
 typedef struct _store_t channelstore_t;
 
 typedef void (*freeChannel_fn)(http2Channel_t *);
+typedef void (*channelVisit_fn)(http2Channel_t *, uint64_t, int, void *);
 
-channelstore_t *channelStoreCreate(net_info const * const, list_t const * const, freeChannel_fn);
+channelstore_t *channelStoreCreate(net_info const * const, chantab_t const * const, freeChannel_fn);
 void            channelStoreDestroy(channelstore_t **);
 
 bool            channelSave(channelstore_t *, http2Channel_t *, uint64_t, int);
 http2Channel_t *channelGet(channelstore_t *, uint64_t);
 bool            channelDelete(channelstore_t *, uint64_t);
 bool            channelExpire(channelstore_t *, uint64_t, bool);
+void            channelForEach(channelstore_t *, channelVisit_fn, void *);
 
 
 
@@ -5,6 +5,7 @@
 
 #include "com.h"
 #include "dbg.h"
+#include "epoch.h"
 #include "evtutils.h"
 #include "httpstate.h"
 #include "plattime.h"
@@ -19,23 +20,38 @@
 #define HTTP2_MAGIC_LEN 24
 
 #define HTTP_START "HTTP/"
-#define HTTP_END "\r\n"
 static search_t* g_http_start = NULL;
-static search_t* g_http_end = NULL;
 
-#define HTTP_CLENGTH "(?i)\\r\\ncontent-length: (\\d+)"
-#define HTTP_UPGRADE "(?i)\\r\\nupgrade: h2"
-#define HTTP_CONNECT "(?i)\\r\\nconnection: upgrade"
-static pcre2_code *g_http_clength = NULL;
-static pcre2_code *g_http_upgrade = NULL;
-static pcre2_code *g_http_connect = NULL;
+// Header fields the HTTP/1.x tokenizer acts on.  Names and tokens are
+// lower case; header bytes are folded to lower case as they're compared.
+enum {
+    HTTP1_FLD_CLENGTH,
+    HTTP1_FLD_TENCODING,
+    HTTP1_FLD_UPGRADE,
+    HTTP1_FLD_CONNECTION,
+    HTTP1_FLD_NUM
+};
+#define HTTP1_FLD_NONE (-1)
+#define HTTP1_FLD_ALL ((1 << HTTP1_FLD_NUM) - 1)
+
+static const struct {
+    const char *name;   // field name
+    unsigned namelen;
+    const char *token;  // value token we're looking for, if any
+    unsigned toklen;
+    bool prefix;        // TRUE if a token only needs to start with `token`
+} g_http1_fields[HTTP1_FLD_NUM] = {
+    [HTTP1_FLD_CLENGTH]    = {"content-length",    14, NULL,      0, FALSE},
+    [HTTP1_FLD_TENCODING]  = {"transfer-encoding", 17, "chunked", 7, FALSE},
+    [HTTP1_FLD_UPGRADE]    = {"upgrade",            7, "h2",      2, TRUE},
+    [HTTP1_FLD_CONNECTION] = {"connection",        10, "upgrade", 7, FALSE},
+};
 
 static void setHttpState(http_state_t *httpstate, http_enum_t toState);
 static void appendHeader(http_state_t *httpstate, char* buf, size_t len);
-static size_t getContentLength(char *header, size_t len);
 static size_t bytesToSkipForContentLength(http_state_t *httpstate, size_t len);
 static bool setHttpId(httpId_t *httpId, net_info *net, int sockfd, metric_t src);
-static int reportHttp1(http_state_t *httpstate);
+static int reportHttp1(http_state_t *httpstate, size_t bodyLen);
 static bool parseHttp1(http_state_t *httpstate, char *buf, size_t len, httpId_t *httpId);
 
 extern int      g_http_guard_enabled;
@@ -63,11 +79,22 @@ setHttpState(http_state_t *httpstate, http_enum_t toState)
             httpstate->hdralloc = 0;
             httpstate->clen = 0;
             scope_memset(&(httpstate->id), 0, sizeof(httpId_t));
+            scope_memset(&(httpstate->tok), 0, sizeof(http1_tok_t));
+            httpstate->chunkState = HTTP_CHUNK_SIZE;
+            httpstate->chunkDigits = 0;
+            httpstate->bodyLen = 0;
+            httpstate->hdrPending = FALSE;
             break;
         case HTTP_HDR:
         case HTTP_HDREND:
         case HTTP_DATA:
             break;
+        case HTTP_CHUNKED:
+            httpstate->chunkState = HTTP_CHUNK_SIZE;
+            httpstate->chunkDigits = 0;
+            httpstate->clen = 0;
+            httpstate->bodyLen = 0;
+            break;
         default:
             DBG(NULL);
             return;
@@ -112,72 +139,233 @@ appendHeader(http_state_t *httpstate, char* buf, size_t len)
     httpstate->hdrlen += len;
 }
 
-// Returns the integer value if header block contains a "content-length" header
-// or -1 if not
-static size_t
-getContentLength(char *header, size_t len)
+static inline char
+http1Lower(char c)
 {
-    if (!g_http_clength) return -1;
+    return ((c >= 'A') && (c <= 'Z')) ? c + ('a' - 'A') : c;
+}
 
-    pcre2_match_data *matches = pcre2_match_data_create_from_pattern(g_http_clength, NULL);
-    if (!matches) return -1;
+// Start a new header; we only copy the full header text when it'll end up
+// in an HTTP event.  Metrics only need the start line and Content-Length.
+static void
+http1TokStart(http1_tok_t *tok)
+{
+    scope_memset(tok, 0, sizeof(*tok));
+    tok->state = HTTP1_START_LINE;
+    tok->field = HTTP1_FLD_NONE;
+    tok->copying = TRUE;
+    tok->copyAll = cfgEvtEnable(g_cfg.staticfg) &&
+                   cfgEvtFormatSourceEnabled(g_cfg.staticfg, CFG_SRC_HTTP);
+}
 
-    int rc = pcre2_match_wrapper(g_http_clength,
-            (PCRE2_SPTR)header, (PCRE2_SIZE)len,
-            0, 0, matches, NULL);
-    if (rc != 2) {
-        pcre2_match_data_free(matches);
-        return -1;
-    }
+static void
+http1TokValueStart(http1_tok_t *tok)
+{
+    tok->tokIx = 0;
+    tok->tokMatch = TRUE;
+    tok->tokTrail = FALSE;
+    tok->valNum = 0;
+    tok->valBad = FALSE;
+}
+
+// Called at the end of each comma-separated token in a value we care about
+static void
+http1TokTokenEnd(http1_tok_t *tok)
+{
+    if (!tok->tokIx) return; // empty list element
 
-    PCRE2_UCHAR *cLen; PCRE2_SIZE cLenLen;
-    pcre2_substring_get_bynumber(matches, 1, &cLen, &cLenLen);
+    unsigned toklen = g_http1_fields[tok->field].toklen;
+    bool match = tok->tokMatch &&
+        (g_http1_fields[tok->field].prefix ? (tok->tokIx >= toklen) : (tok->tokIx == toklen));
 
-    size_t ret = scope_strtoull((const char *)cLen, NULL, 0);
-    if ((ret == 0) || (ret == ULLONG_MAX)) {
-        ret = -1;
+    switch (tok->field) {
+        case HTTP1_FLD_TENCODING:
+            // chunked has to be the final encoding applied
+            tok->isChunked = match;
+            break;
+        case HTTP1_FLD_UPGRADE:
+            tok->hasUpgrade |= match;
+            break;
+        case HTTP1_FLD_CONNECTION:
+            tok->hasConnectionUpgrade |= match;
+            break;
+        default:
+            break;
     }
 
-    pcre2_match_data_free(matches);
-    pcre2_substring_free(cLen);
+    http1TokValueStart(tok);
+}
 
-    return ret;
+static void
+http1TokValueEnd(http1_tok_t *tok)
+{
+    if (tok->field == HTTP1_FLD_CLENGTH) {
+        if (tok->tokIx && !tok->valBad) {
+            tok->clen = tok->valNum;
+            tok->hasClen = TRUE;
+        }
+    } else if (tok->field != HTTP1_FLD_NONE) {
+        http1TokTokenEnd(tok);
+    }
+    tok->field = HTTP1_FLD_NONE;
 }
 
-// Returns TRUE if header block contains an "upgrade: h2" header
-static bool
-hasUpgrade(const char *header, size_t len)
+static void
+http1TokValueChar(http1_tok_t *tok, char c)
 {
-    if (!g_http_upgrade) return FALSE;
+    if (tok->field == HTTP1_FLD_NONE) return;
 
-    pcre2_match_data *matches = pcre2_match_data_create_from_pattern(g_http_upgrade, NULL);
-    if (!matches) return FALSE;
+    if ((c == ' ') || (c == '\t')) {
+        if (tok->tokIx) tok->tokTrail = TRUE;
+        return;
+    }
 
-    int rc = pcre2_match_wrapper(g_http_upgrade,
-            (PCRE2_SPTR)header, (PCRE2_SIZE)len,
-            0, 0, matches, NULL);
+    if (tok->field == HTTP1_FLD_CLENGTH) {
+        if (tok->tokTrail || (c < '0') || (c > '9') ||
+            (tok->valNum > ((SIZE_MAX - 9) / 10))) {
+            tok->valBad = TRUE;
+        } else {
+            tok->valNum = (tok->valNum * 10) + (c - '0');
+        }
+        tok->tokIx++;
+        return;
+    }
 
-    pcre2_match_data_free(matches);
+    if (c == ',') {
+        http1TokTokenEnd(tok);
+        return;
+    }
 
-    return rc == 1;
+    unsigned toklen = g_http1_fields[tok->field].toklen;
+    if (tok->tokTrail) {
+        tok->tokMatch = FALSE;
+    } else if (tok->tokIx < toklen) {
+        tok->tokMatch &= (http1Lower(c) == g_http1_fields[tok->field].token[tok->tokIx]);
+    } else if (!g_http1_fields[tok->field].prefix) {
+        tok->tokMatch = FALSE;
+    }
+    tok->tokIx++;
 }
 
-// Returns TRUE if header block contains an "connection: upgrade" header
-static bool
-hasConnectionUpgrade(const char *header, size_t len)
+static void
+http1TokNameChar(http1_tok_t *tok, char c)
+{
+    char lc = http1Lower(c);
+    int i;
+    for (i = 0; i < HTTP1_FLD_NUM; i++) {
+        if (!(tok->nameMask & (1 << i))) continue;
+        if ((tok->nameIx >= g_http1_fields[i].namelen) ||
+            (lc != g_http1_fields[i].name[tok->nameIx])) {
+            tok->nameMask &= ~(1 << i);
+        }
+    }
+    tok->nameIx++;
+}
+
+static void
+http1TokNameEnd(http1_tok_t *tok)
 {
-    if (!g_http_connect) return FALSE;
+    int i;
+    tok->field = HTTP1_FLD_NONE;
+    for (i = 0; (i < HTTP1_FLD_NUM) && tok->nameMask; i++) {
+        if ((tok->nameMask & (1 << i)) && (tok->nameIx == g_http1_fields[i].namelen)) {
+            tok->field = i;
+            break;
+        }
+    }
+    http1TokValueStart(tok);
+}
+
+// Feeds `len` bytes of `buf` to the tokenizer.  Returns the number of bytes
+// consumed; -1 if the header is too big to be believable.  Sets `*done` if
+// the end of the header was found; bytes after it aren't consumed.  Sets
+// `*copyLen` to the number of leading bytes of `buf` that belong in `hdr`.
+static ssize_t
+http1TokScan(http1_tok_t *tok, const char *buf, size_t len, size_t *copyLen, bool *done)
+{
+    size_t i;
+
+    *done = FALSE;
+    *copyLen = (tok->copying) ? len : 0;
+
+    for (i = 0; i < len; i++) {
+        char c = buf[i];
+
+        if (++tok->len > MAX_HDR_ALLOC) return -1;
+
+        switch (tok->state) {
+            case HTTP1_START_LINE:
+                if (tok->startIx < sizeof(HTTP_START) - 1) {
+                    tok->isResponse = (tok->startIx == 0 || tok->isResponse) &&
+                                      (c == HTTP_START[tok->startIx]);
+                }
+                tok->startIx++;
+                if (c == '\n') {
+                    tok->state = HTTP1_LINE_BEGIN;
+                    if (!tok->copyAll) {
+                        tok->copying = FALSE;
+                        *copyLen = i + 1;
+                    }
+                }
+                break;
 
-    pcre2_match_data *matches = pcre2_match_data_create_from_pattern(g_http_connect, NULL);
-    if (!matches) return FALSE;
+            case HTTP1_LINE_BEGIN:
+                if ((c == '\r') || (c == '\n')) {
+                    // the empty line ending the header isn't copied
+                    if (tok->copying) {
+                        tok->copying = FALSE;
+                        *copyLen = i;
+                    }
+                    if (c == '\n') {
+                        *done = TRUE;
+                        return i + 1;
+                    }
+                    tok->state = HTTP1_END_CR;
+                } else if ((c == ' ') || (c == '\t')) {
+                    // obsolete line folding; the value isn't one we act on
+                    tok->field = HTTP1_FLD_NONE;
+                    tok->state = HTTP1_VALUE;
+                } else {
+                    tok->nameIx = 0;
+                    tok->nameMask = HTTP1_FLD_ALL;
+                    tok->state = HTTP1_NAME;
+                    http1TokNameChar(tok, c);
+                }
+                break;
 
-    int rc = pcre2_match_wrapper(g_http_connect,
-            (PCRE2_SPTR)header, (PCRE2_SIZE)len,
-            0, 0, matches, NULL);
+            case HTTP1_NAME:
+                if (c == ':') {
+                    http1TokNameEnd(tok);
+                    tok->state = HTTP1_VALUE;
+                } else if (c == '\n') {
+                    // malformed line without a colon; ignore it
+                    tok->state = HTTP1_LINE_BEGIN;
+                } else if (c != '\r') {
+                    http1TokNameChar(tok, c);
+                }
+                break;
 
-    pcre2_match_data_free(matches);
+            case HTTP1_VALUE:
+                if (c == '\n') {
+                    http1TokValueEnd(tok);
+                    tok->state = HTTP1_LINE_BEGIN;
+                } else if (c != '\r') {
+                    http1TokValueChar(tok, c);
+                }
+                break;
 
-    return rc == 1;
+            case HTTP1_END_CR:
+                // a bare CR is tolerated as the end of the header too
+                *done = TRUE;
+                return (c == '\n') ? i + 1 : i;
+
+            default:
+                DBG("%d", tok->state);
+                return -1;
+        }
+    }
+
+    return len;
 }
 
 static size_t
@@ -200,6 +388,98 @@ bytesToSkipForContentLength(http_state_t *httpstate, size_t len)
     return len;
 }
 
+static inline int
+hexValue(char c)
+{
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
+
+// Skips a chunked body per RFC 7230 4.1, resuming where the last buffer
+// left off.  Returns the number of bytes consumed or -1 if the body isn't
+// valid chunked encoding.  Sets `*done` once the last chunk and trailer
+// have been seen; bytes after that aren't consumed.
+static ssize_t
+bytesToSkipForChunked(http_state_t *httpstate, const char *buf, size_t len, bool *done)
+{
+    size_t i = 0;
+
+    *done = FALSE;
+
+    while (i < len) {
+        char c = buf[i];
+        int val;
+
+        switch (httpstate->chunkState) {
+            case HTTP_CHUNK_SIZE:
+                if ((val = hexValue(c)) != -1) {
+                    if (httpstate->clen > (SIZE_MAX >> 4)) return -1;
+                    httpstate->clen = (httpstate->clen << 4) | val;
+                    httpstate->chunkDigits++;
+                    i++;
+                    break;
+                }
+                if (!httpstate->chunkDigits) return -1;
+                if ((c == ';') || (c == ' ') || (c == '\t') || (c == '\r')) {
+                    httpstate->chunkState = HTTP_CHUNK_EXT;
+                    i++;
+                    break;
+                }
+                if (c != '\n') return -1;
+                // fall through to handle the end of the chunk-size line
+            case HTTP_CHUNK_EXT:
+                i++;
+                if (c != '\n') break;
+                // a zero chunk-size marks the last chunk
+                httpstate->chunkState =
+                    (httpstate->clen) ? HTTP_CHUNK_DATA : HTTP_CHUNK_TRAILER;
+                httpstate->chunkDigits = 0;
+                break;
+
+            case HTTP_CHUNK_DATA:
+            {
+                size_t skip = len - i;
+                if (skip > httpstate->clen) skip = httpstate->clen;
+                i += skip;
+                httpstate->clen -= skip;
+                httpstate->bodyLen += skip;
+                if (!httpstate->clen) httpstate->chunkState = HTTP_CHUNK_DATA_END;
+                break;
+            }
+
+            case HTTP_CHUNK_DATA_END:
+                i++;
+                if (c == '\r') break;
+                if (c != '\n') return -1;
+                httpstate->chunkState = HTTP_CHUNK_SIZE;
+                break;
+
+            case HTTP_CHUNK_TRAILER:
+                i++;
+                if (c == '\r') break;
+                if (c == '\n') {
+                    *done = TRUE;
+                    return i;
+                }
+                httpstate->chunkState = HTTP_CHUNK_TRAILER_LINE;
+                break;
+
+            case HTTP_CHUNK_TRAILER_LINE:
+                i++;
+                if (c == '\n') httpstate->chunkState = HTTP_CHUNK_TRAILER;
+                break;
+
+            default:
+                DBG("%d", httpstate->chunkState);
+                return -1;
+        }
+    }
+
+    return i;
+}
+
 static bool
 setHttpId(httpId_t *httpId, net_info *net, int sockfd, metric_t src)
 {
@@ -218,8 +498,10 @@ setHttpId(httpId_t *httpId, net_info *net, int sockfd, metric_t src)
 
 // For now, only doing HTTP/1.X headers
 static int
-reportHttp1(http_state_t *httpstate)
+reportHttp1(http_state_t *httpstate, size_t bodyLen)
 {
+    EPOCH_SECTION();
+
     if (!httpstate || !httpstate->hdr || !httpstate->hdrlen) return -1;
 
     protocol_info *proto = evtProtoAllocHttp1(httpstate->isResponse);
@@ -261,8 +543,9 @@ reportHttp1(http_state_t *httpstate)
 
     // Set post info
     post->ssl = httpstate->id.isSsl;
-    post->start_duration = getTime();
+    post->start_duration = httpstate->hdrTime;
     post->id = httpstate->id;
+    post->clen = bodyLen;
 
     // "transfer ownership" of dynamically allocated header from
     // httpstate object to post object
@@ -279,6 +562,8 @@ static bool
 reportHttp2(http_state_t *state, net_info *net, http_buf_t *stash,
         const uint8_t *buf, uint32_t frameLen, httpId_t *httpId)
 {
+    EPOCH_SECTION();
+
     if (!state || !stash || !buf || !frameLen || !httpId) {
         scopeLogError("ERROR: NULL reportHttp2() parameter");
         DBG(NULL);
@@ -293,21 +578,29 @@ reportHttp2(http_state_t *state, net_info *net, http_buf_t *stash,
     }
 
     http_post *post = (http_post *)proto->data;
-    post->ssl            = state->id.isSsl;
+    post->ssl            = httpId->isSsl;
     post->start_duration = getTime();
-    post->id             = state->id;
-    if (stash->len) {
+    post->id             = *httpId;
+    if (stash->len >= frameLen) {
+        scope_memcpy(post->hdr, stash->buf, frameLen);
+    } else if (stash->len) {
         scope_memcpy(post->hdr, stash->buf, stash->len);
         scope_memcpy(post->hdr + stash->len, buf, frameLen - stash->len);
     } else {
         scope_memcpy(post->hdr, buf, frameLen);
     }
 
+    // When only the frame header is reported, its length is cleared so it
+    // describes what was copied.
+    if (frameLen == 9) {
+        post->hdr[0] = post->hdr[1] = post->hdr[2] = 0;
+    }
+
     // Unlike in the HTTP/1 case, we're sending TRUE here if the frame was
     // sent, not if we're the server. We haven't parsed the frame to know if
     // it's a request or response yet so we're sending half of the isServer
     // answer here and will finish the logic on the reporting side.
-    proto->isServer = (state->id.src == NETTX) || (state->id.src == TLSTX);
+    proto->isServer = (httpId->src == NETTX) || (httpId->src == TLSTX);
     proto->len      = frameLen;
     proto->fd       = httpId->sockfd;
     proto->uid      = httpId->uid;
@@ -337,18 +630,35 @@ reportHttp2(http_state_t *state, net_info *net, http_buf_t *stash,
     return ret;
 }
 
+// Reports a response header that was held back until its chunked body
+// was skipped, so the body size can go with it.  The size is only known
+// if the whole body was seen.
+static void
+reportPendingHttp1(http_state_t *httpstate, bool complete)
+{
+    if (!httpstate->hdrPending) return;
+    httpstate->hdrPending = FALSE;
+    reportHttp1(httpstate, (complete) ? httpstate->bodyLen : -1);
+}
+
 /*
  * If we have an fd check for TCP
  * If we don't have a socket it can mean we are
  * called from certain TLS sessions; not an error
  *
- * If we are working down a content length, no
- * need to scan for a header
+ * If we are working down a content length or a
+ * chunked body, no need to scan for a header
  *
  * Note that, at this point, we are not able to
  * use a content length optimization with gnutls
  * because it does not return a file descriptor
  * that is usable
+ *
+ * Header bytes are run through the tokenizer once
+ * as they arrive; they're only copied into `hdr`
+ * for reporting.  Once a message ends, the rest of
+ * the buffer is parsed too since keep-alive clients
+ * can pipeline several messages in one write.
 */
 static bool
 parseHttp1(http_state_t *httpstate, char *buf, size_t len, httpId_t *httpId)
@@ -364,75 +674,115 @@ parseHttp1(http_state_t *httpstate, char *buf, size_t len, httpId_t *httpId)
         if (headerCaptureInProgress && !isSslIsConsistent) return FALSE;
     }
 
-    // Skip data if instructed to do so by previous content length
-    if (httpstate->state == HTTP_DATA) {
-        size_t bts = bytesToSkipForContentLength(httpstate, len);
-        if (bts == len) return FALSE;
-        buf = &buf[bts];
-        len = len - bts;
-        setHttpState(httpstate, HTTP_NONE);
-    }
+    int found_end_of_all_headers = FALSE;
 
-    // Look for start of http header
-    if (httpstate->state == HTTP_NONE) {
+    while (len) {
 
-        if (searchExec(g_http_start, buf, len) == -1) return FALSE;
+        // Skip data if instructed to do so by previous content length
+        if (httpstate->state == HTTP_DATA) {
+            size_t bts = bytesToSkipForContentLength(httpstate, len);
+            buf = &buf[bts];
+            len = len - bts;
+            if (httpstate->clen) break;
+            setHttpState(httpstate, HTTP_NONE);
+            if (!len) break;
+        }
 
-        setHttpState(httpstate, HTTP_HDR);
-        httpstate->id = *httpId;
-    }
+        // Skip data if instructed to do so by a chunked transfer-encoding
+        if (httpstate->state == HTTP_CHUNKED) {
+            bool body_done;
+            ssize_t bts = bytesToSkipForChunked(httpstate, buf, len, &body_done);
+            if (bts == -1) {
+                // Not what we expected; go back to looking for a header
+                scopeLogDebug("DEBUG: fd:%d invalid HTTP chunked body", httpstate->id.sockfd);
+                reportPendingHttp1(httpstate, FALSE);
+                setHttpState(httpstate, HTTP_NONE);
+                break;
+            }
+            if (!body_done) break;
+            buf = &buf[bts];
+            len = len - bts;
+            reportPendingHttp1(httpstate, TRUE);
+            setHttpState(httpstate, HTTP_NONE);
+            if (!len) break;
+        }
 
-    // Look for header data
-    size_t header_start = 0;
-    size_t header_end = -1;
-    int found_end_of_all_headers = FALSE;
-    while ((httpstate->state == HTTP_HDR || httpstate->state == HTTP_HDREND) &&
-           (header_start < len)) {
+        // Look for start of http header
+        if (httpstate->state == HTTP_NONE) {
 
-        header_end =
-            searchExec(g_http_end, &buf[header_start], len-header_start);
+            if (searchExec(g_http_start, buf, len) == -1) break;
 
-        if (header_end == -1) {
-            // We didn't find an end in this buffer, append the rest of the
-            // buffer to what we've found before.
             setHttpState(httpstate, HTTP_HDR);
-            appendHeader(httpstate, &buf[header_start], len-header_start);
-            break;
-        } else {
-            found_end_of_all_headers =
-                ((httpstate->state == HTTP_HDREND) && (header_end == 0));
-            if (found_end_of_all_headers) break;
+            httpstate->id = *httpId;
+            http1TokStart(&httpstate->tok);
+        }
 
-            // We found a complete header!
-            setHttpState(httpstate, HTTP_HDREND);
-            header_end += header_start;  // was measured from header_start
-            header_end += searchLen(g_http_end);
-            appendHeader(httpstate, &buf[header_start], header_end-header_start);
-            header_start = header_end;
+        // Scan for the end of the header
+        http1_tok_t *tok = &httpstate->tok;
+        size_t copyLen;
+        bool header_done;
+        ssize_t used = http1TokScan(tok, buf, len, &copyLen, &header_done);
+        if (used == -1) {
+            DBG(NULL);
+            // More than we're willing to treat as one header.
+            // We might have missed the end of the header???
+            setHttpState(httpstate, HTTP_NONE);
+            break;
         }
-    }
+        if (copyLen) {
+            appendHeader(httpstate, buf, copyLen);
+            if (httpstate->state == HTTP_NONE) break;
+        }
+        if (!header_done) break;
 
-    // Found the end of all headers!  Time to report something!
-    if (found_end_of_all_headers) {
+        buf = &buf[used];
+        len = len - used;
 
-        // append a null terminator to allow us to treat it as a string
-        appendHeader(httpstate, "\0", 1);
+        // Found the end of all headers!  Time to report something!
 
-        // check to see if there is a Content-Length in the header
-        size_t clen = getContentLength(httpstate->hdr, httpstate->hdrlen);
-        size_t content_in_this_buf = len - (header_start + header_end + searchLen(g_http_end));
+        // When only the start line was copied, add back what the
+        // reporting side needs from the rest of the header.
+        if (!tok->copyAll && tok->hasClen && !tok->isChunked) {
+            char clenhdr[64];
+            int clenlen = scope_snprintf(clenhdr, sizeof(clenhdr),
+                                         "Content-Length: %zu\r\n", tok->clen);
+            if ((clenlen > 0) && (clenlen < sizeof(clenhdr))) {
+                appendHeader(httpstate, clenhdr, clenlen);
+            }
+        }
 
-        httpstate->isResponse =
-            (searchExec(g_http_start, httpstate->hdr, searchLen(g_http_start)) != -1);
-        httpstate->hasUpgrade = hasUpgrade(httpstate->hdr, httpstate->hdrlen);
-        httpstate->hasConnectionUpgrade = hasConnectionUpgrade(httpstate->hdr, httpstate->hdrlen);
+        // append a null terminator to allow us to treat it as a string
+        appendHeader(httpstate, "\0", 1);
+        if (httpstate->state == HTTP_NONE) break;
+
+        found_end_of_all_headers = TRUE;
+        httpstate->hdrTime = getTime();
+        httpstate->isResponse = tok->isResponse;
+        httpstate->hasUpgrade = tok->hasUpgrade;
+        httpstate->hasConnectionUpgrade = tok->hasConnectionUpgrade;
+
+        // A chunked transfer-encoding overrides any content length.
+        // Responses wait for the end of the body to report its size.
+        if (tok->isChunked) {
+            httpstate->hdrPending = tok->isResponse;
+            if (!httpstate->hdrPending) reportHttp1(httpstate, -1);
+            setHttpState(httpstate, HTTP_CHUNKED);
+            continue;
+        }
 
         // post and event containing the header we found
-        reportHttp1(httpstate);
+        reportHttp1(httpstate, -1);
+
+        // the rest belongs to another protocol after a successful upgrade
+        if (httpstate->isResponse && httpstate->hasUpgrade &&
+            httpstate->hasConnectionUpgrade) {
+            setHttpState(httpstate, HTTP_NONE);
+            break;
+        }
 
         // change httpstate to HTTP_DATA per Content-Length or HTTP_NONE
-        if ((clen != -1) && (clen >= content_in_this_buf)) {
-            httpstate->clen = clen - content_in_this_buf;
+        if (tok->hasClen && tok->clen) {
+            httpstate->clen = tok->clen;
             setHttpState(httpstate, HTTP_DATA);
         } else {
             setHttpState(httpstate, HTTP_NONE);
@@ -446,34 +796,10 @@ void
 initHttpState(void)
 {
     g_http_start = searchComp(HTTP_START);
-    g_http_end = searchComp(HTTP_END);
-
-    int        errNum;
-    PCRE2_SIZE errPos;
-
-    if (!(g_http_clength = pcre2_compile((PCRE2_SPTR)HTTP_CLENGTH,
-            PCRE2_ZERO_TERMINATED, 0, &errNum, &errPos, NULL))) {
-        scopeLogError("ERROR: HTTP/1 content-length regex failed; err=%d, pos=%ld",
-                errNum, errPos);
-    }
-    if (!(g_http_upgrade = pcre2_compile((PCRE2_SPTR)HTTP_UPGRADE,
-            PCRE2_ZERO_TERMINATED, 0, &errNum, &errPos, NULL))) {
-        scopeLogError("ERROR: HTTP/1 upgrade regex failed; err=%d, pos=%ld",
-                errNum, errPos);
-    }
-    if (!(g_http_connect = pcre2_compile((PCRE2_SPTR)HTTP_CONNECT,
-            PCRE2_ZERO_TERMINATED, 0, &errNum, &errPos, NULL))) {
-        scopeLogError("ERROR: HTTP/1 connection regex failed; err=%d, pos=%ld",
-                errNum, errPos);
-    }
 }
 
 void
 destroyHttpState(void) {
-    pcre2_code_free(g_http_connect);
-    pcre2_code_free(g_http_upgrade);
-    pcre2_code_free(g_http_clength);
-    searchFree(&g_http_end);
     searchFree(&g_http_start);
 }
 
@@ -566,7 +892,6 @@ http2GetFrameType(http_buf_t *stash, const uint8_t *buf, size_t len)
     return ret;
 }
 
-#if 0
 static uint8_t
 http2GetFrameFlags(http_buf_t *stash, const uint8_t *buf, size_t len)
 {
@@ -591,8 +916,7 @@ http2GetFrameFlags(http_buf_t *stash, const uint8_t *buf, size_t len)
     return ret;
 }
 
-
-
+#if 0
 static uint32_t
 http2GetFrameStream(http_buf_t *stash, const uint8_t *buf, size_t len)
 {
@@ -663,19 +987,19 @@ parseHttp2(http_state_t* state, net_info *net, int isTx,
         // stash the buffer if we don't have enough for a frame header
         if (stash->len + bufLen < 9) {
             http2StashFrame(stash, bufPos, bufLen);
-            return FALSE;
+            return ret;
         }
 
         // get the header values
         uint32_t fLen    = http2GetFrameLength(stash, bufPos, bufLen);
         uint8_t  fType   = http2GetFrameType(stash, bufPos, bufLen);
-        //uint8_t  fFlags  = http2GetFrameFlags(stash, bufPos, bufLen);
+        uint8_t  fFlags  = http2GetFrameFlags(stash, bufPos, bufLen);
         //uint32_t fStream = http2GetFrameStream(stash, bufPos, bufLen);
 
         // stash the buffer if we don't have enough for the whole frame
         if (stash->len + bufLen < (9 + fLen)) {
             http2StashFrame(stash, bufPos, bufLen);
-            return FALSE;
+            return ret;
         }
 
         //scopeLogDebug("DEBUG: HTTP/2 %s frame found; type=0x%02x, flags=0x%02x, stream=%d",
@@ -683,6 +1007,17 @@ parseHttp2(http_state_t* state, net_info *net, int isTx,
 
         // process interesting frames
         switch (fType) {
+            case 0x00:
+                // DATA frames only matter when they end the stream; just the
+                // frame header is needed for that
+                if (fFlags & 0x01) {
+                    reportHttp2(state, net, stash, bufPos, 9, httpId);
+                }
+                break;
+            case 0x03:
+                // process RST_STREAM frames so reset streams are released
+                reportHttp2(state, net, stash, bufPos, fLen+9, httpId);
+                break;
             case 0x01:
                 // process HEADERS frames
                 ret |= reportHttp2(state, net, stash, bufPos, fLen+9, httpId);
@@ -880,6 +1215,10 @@ doHttp(int sockfd, net_info *net, char *buf, size_t len, metric_t src, src_data_
 void
 resetHttp(http_state_t httpstate[HTTP_NUM])
 {
+    // don't lose a response because the connection closed mid-body
+    reportPendingHttp1(&httpstate[HTTP_RX], FALSE);
+    reportPendingHttp1(&httpstate[HTTP_TX], FALSE);
+
     setHttpState(&httpstate[HTTP_RX], HTTP_NONE);
     setHttpState(&httpstate[HTTP_TX], HTTP_NONE);
 }
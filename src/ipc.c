@@ -152,249 +152,171 @@ ipcIsActive(mqd_t mqdes, size_t *maxMsgSize, long *msgCount) {
 
 
 /*
- * Verify if the buffer contains NUL termination character
- * Returns status of operation
+ * Parse the metadata of a single frame placed in message queue, where it lies.
+ * Returns the status of parsing the frame, the unique identifer of message request (uniqVal)
+ * and where the scope data starts in the frame (dataOffset)
  */
-static bool
-msgBufIsNULTermPresent(const char* msgBuf, size_t msgLen) {
-    if (msgLen == -1) {
+static req_parse_status_t
+ipcParseSingleFrame(const char *frame, ssize_t frameLen, int *uniqVal, size_t *dataOffset, size_t *remainLen) {
+    req_parse_status_t parseStatus = REQ_PARSE_JSON_ERROR;
+
+    // The metadata is everything up to the first NUL terminator
+    if (frameLen <= 0) {
         DBG(NULL);
-        return FALSE;
+        return REQ_PARSE_JSON_ERROR;
     }
-
-    for(size_t i = 0; i < msgLen; ++i) {
-        if (!msgBuf[i]) {
-            return TRUE;
-        }
-    }
-    return FALSE;
-}
-
-/*
- * Parse single frame placed in message queue.
- * Returns scope data from frame, the status of parsing the frame (parseStatus) and unique identifer of message request (uniqVal)
- */
-static char *
-ipcParseSingleFrame(const char *msgBuf, ssize_t msgLen, req_parse_status_t *parseStatus, int *uniqVal, size_t *scopeFrameLen, size_t *remainLen) {
-    char *scopeMsg = NULL;
-
-    // Check if there is at least one NUL terminator
-    if (msgBufIsNULTermPresent(msgBuf, msgLen) == FALSE) {
-        *parseStatus = REQ_PARSE_JSON_ERROR;
-        goto end;
+    size_t metaDataLen = scope_strnlen(frame, frameLen);
+    if (metaDataLen == frameLen) {
+        return REQ_PARSE_JSON_ERROR;
     }
 
     // Verify if frame is based on JSON-format
-    cJSON *msgJson = cJSON_Parse(msgBuf);
+    cJSON *msgJson = cJSON_Parse(frame);
     if (!msgJson) {
-        *parseStatus = REQ_PARSE_JSON_ERROR;
-        goto end;
+        return REQ_PARSE_JSON_ERROR;
     }
 
     if (!cJSON_IsObject(msgJson)) {
-        *parseStatus = REQ_PARSE_JSON_ERROR;
         goto cleanJson;
     }
 
     // Check the req in message queue frame
     cJSON *reqKey = cJSON_GetObjectItemCaseSensitive(msgJson, "req");
-    if (!reqKey || !cJSON_IsNumber(reqKey)) {
-        *parseStatus = REQ_PARSE_REQ_ERROR;
-        goto cleanJson;
-    }
-
-    if (reqKey->valueint != META_REQ_JSON && reqKey->valueint != META_REQ_JSON_PARTIAL) {
-        *parseStatus = REQ_PARSE_REQ_ERROR;
+    if (!reqKey || !cJSON_IsNumber(reqKey) ||
+        (reqKey->valueint != META_REQ_JSON && reqKey->valueint != META_REQ_JSON_PARTIAL)) {
+        parseStatus = REQ_PARSE_REQ_ERROR;
         goto cleanJson;
     }
 
     // Get the unique request id in message queue frame
     cJSON *uniqKey = cJSON_GetObjectItemCaseSensitive(msgJson, "uniq");
     if (!uniqKey || !cJSON_IsNumber(uniqKey)) {
-        *parseStatus = REQ_PARSE_UNIQ_ERROR;
+        parseStatus = REQ_PARSE_UNIQ_ERROR;
         goto cleanJson;
     }
     *uniqVal = uniqKey->valueint;
 
     // Get the remain data in the message queue frame
     cJSON *remainKey = cJSON_GetObjectItemCaseSensitive(msgJson, "remain");
-    if (!remainKey || !cJSON_IsNumber(remainKey)) {
-        *parseStatus = REQ_PARSE_REMAIN_ERROR;
+    if (!remainKey || !cJSON_IsNumber(remainKey) || remainKey->valueint < 0) {
+        parseStatus = REQ_PARSE_REMAIN_ERROR;
         goto cleanJson;
     }
 
-    // Compare remaining data with previouse frame 
+    // Compare remaining data with previous frame
     if (remainKey->valueint >= *remainLen) {
-        *parseStatus = REQ_PARSE_REMAIN_ERROR;
+        parseStatus = REQ_PARSE_REMAIN_ERROR;
         goto cleanJson;
     }
     *remainLen = remainKey->valueint;
 
-    // Calculate offset of message - skip metadata part
-    char *metaData = cJSON_PrintUnformatted(msgJson);
-    size_t metaDataLen = scope_strlen(metaData);
-    size_t dataOffset = metaDataLen + 1;
-    // There is no scope data
-    if (msgLen <= dataOffset) {
-        *parseStatus = REQ_PARSE_MISSING_SCOPE_DATA_ERROR;
-        goto cleanMetadata;
-    }
-    // Calculate the scope data length
-    size_t dataLen = msgLen - dataOffset;
-    // Allocate place for scope data in the current frame
-    scopeMsg = scope_calloc(1, sizeof(char) * dataLen);
-    if (!scopeMsg) {
-        *parseStatus = REQ_PARSE_ALLOCATION_ERROR;
-        goto cleanMetadata;
+    // Skip the metadata part and the NUL char separator; is there scope data
+    *dataOffset = metaDataLen + 1;
+    if (frameLen <= *dataOffset) {
+        parseStatus = REQ_PARSE_MISSING_SCOPE_DATA_ERROR;
+        goto cleanJson;
     }
-    // Skip NUL char separator
-    scope_memcpy(scopeMsg, msgBuf + dataOffset, dataLen);
-    *parseStatus = REQ_PARSE_OK;
-    *scopeFrameLen = dataLen;
-    if (reqKey->valueint == META_REQ_JSON_PARTIAL ) {
-        *parseStatus = REQ_PARSE_PARTIAL;
-    } 
 
-cleanMetadata:
-    scope_free(metaData);
+    parseStatus = (reqKey->valueint == META_REQ_JSON_PARTIAL) ? REQ_PARSE_PARTIAL : REQ_PARSE_OK;
 
 cleanJson:
     cJSON_Delete(msgJson);
 
-end:
-    return scopeMsg;
+    return parseStatus;
 }
 
-static char *
-scopeMsgCreate(const char *frame, size_t frameLen) {
-    char *msg = scope_calloc(1, frameLen * sizeof(char));
-    if (!msg) {
-        return NULL;
+/*
+ * Makes room in the request buffer for a whole frame past its first used bytes.
+ * The buffer is doubled as it goes.
+ * Returns status of operation
+ */
+static bool
+scopeMsgReserve(char **msg, size_t *msgCap, size_t used, size_t frameLen, req_parse_status_t *parseStatus) {
+    // One more for the NUL terminator
+    size_t needed = used + frameLen + 1;
+    if (needed <= *msgCap) {
+        return TRUE;
     }
-    scope_memcpy(msg, frame, frameLen);
-
-    return msg;
-}
-
-static char *
-scopeMsgAppend(char *msg, size_t msgLen, const char *frame, size_t frameLen, req_parse_status_t *parseStatus) {
-    // When we append we will overwrite the last byte
-    size_t newMsgLen = msgLen - 1 + frameLen;
-    if (newMsgLen > INPUT_MSG_ALLOC_LIMIT) {
-        *parseStatus = REQ_PARSE_SCOPE_SIZE_ERROR;
-        return NULL;
+    size_t newCap = (*msgCap) ? *msgCap : needed;
+    while (newCap < needed) {
+        newCap *= 2;
     }
-    char *temp = scope_realloc(msg, newMsgLen * sizeof(char));
+    char *temp = scope_realloc(*msg, newCap * sizeof(char));
     if (!temp) {
         *parseStatus = REQ_PARSE_ALLOCATION_ERROR;
-        return NULL;
+        return FALSE;
     }
-    // overwrite the NUL byte
-    int lastMsgIndx = msgLen - 1;
-    scope_memcpy(temp + lastMsgIndx, frame, frameLen);
-
-    return temp;
+    *msg = temp;
+    *msgCap = newCap;
+    return TRUE;
 }
 
 /* 
  * ipcRequestHandler performs parsing of incoming frame in message queue
+ *
+ * Each frame is received straight into the tail of one buffer, its metadata
+ * parsed where it lies, and its scope data moved down over the metadata and
+ * the NUL terminator of the data before it.
  * Returns scope msg
  */
 char *
 ipcRequestHandler(mqd_t mqDes, size_t mqMaxMsgSize, req_parse_status_t *parseStatus, int *uniqueReq) {
-    char *frameRes = NULL;
-    char *msgRes = NULL;
-    size_t msgLen = 0;
-
+    char *msg = NULL;
+    size_t msgCap = 0;
+    size_t msgLen = 0;              // scope data so far, without its NUL terminator
+    size_t remainLen = SIZE_MAX;
+
+    do {
+        if (!scopeMsgReserve(&msg, &msgCap, msgLen, mqMaxMsgSize, parseStatus)) {
+            goto err;
+        }
 
-    // Allocate maximum buffer for single meesage in message queue
-    char *mqMsgBuf = scope_malloc(mqMaxMsgSize);
-    if (!mqMsgBuf) {
-        *parseStatus = REQ_PARSE_ALLOCATION_ERROR;
-        return msgRes;
-    }
-    
-    bool listenForResponseTransmission = TRUE;
-    while (listenForResponseTransmission) {
-        size_t frameLen = 0;
-        size_t remainLen = SIZE_MAX;
-        ssize_t mqMsgLen = -1;
-
-        ipc_receive_result recvStatus = ipcReceiveFrameWithRetry(mqDes, mqMsgBuf, mqMaxMsgSize, &mqMsgLen);
+        char *frame = msg + msgLen;
+        ssize_t frameLen = -1;
+        ipc_receive_result recvStatus = ipcReceiveFrameWithRetry(mqDes, frame, mqMaxMsgSize, &frameLen);
         if (recvStatus != MSG_RECV_OK) {
             *parseStatus = (recvStatus == MSG_RECV_RETRY_LIMIT) ? REQ_PARSE_RECEIVE_TIMEOUT_ERROR : REQ_PARSE_RECEIVE_ERROR;
-            scope_free(mqMsgBuf);
-            scope_free(msgRes);
-            return NULL;
-        }
-        // Data from single frame
-        frameRes = ipcParseSingleFrame(mqMsgBuf, mqMsgLen, parseStatus, uniqueReq, &frameLen, &remainLen);
-        if (!frameRes) {
-            scope_free(mqMsgBuf);
-            scope_free(msgRes);
-            return NULL;
+            goto err;
         }
 
-        // First frame 
-        if (!msgRes) {
-            msgRes = scopeMsgCreate(frameRes, frameLen);
-            if (!msgRes) {
-                *parseStatus = REQ_PARSE_ALLOCATION_ERROR;
-                scope_free(frameRes);
-                scope_free(mqMsgBuf);
-                return NULL;
-            }
-            msgLen += frameLen;
-        } else {
-            char *temp = scopeMsgAppend(msgRes, msgLen, frameRes, frameLen, parseStatus);
-            if (!temp) {
-                scope_free(frameRes);
-                scope_free(msgRes);
-                scope_free(mqMsgBuf);
-                return NULL;
-            }
-            msgRes = temp;
-            msgLen = msgLen - 1 + frameLen;
+        size_t dataOffset = 0;
+        *parseStatus = ipcParseSingleFrame(frame, frameLen, uniqueReq, &dataOffset, &remainLen);
+        if (*parseStatus != REQ_PARSE_OK && *parseStatus != REQ_PARSE_PARTIAL) {
+            goto err;
         }
-        scope_free(frameRes);
 
-        if (*parseStatus != REQ_PARSE_PARTIAL) {
-            listenForResponseTransmission = FALSE;
+        // Data from single frame
+        size_t dataLen = frameLen - dataOffset;
+        scope_memmove(frame, frame + dataOffset, dataLen);
+        msgLen += dataLen;
+        if (frame[dataLen - 1] == '\0') {
+            msgLen--;
         }
-    }
-    scope_free(mqMsgBuf);
-
-    return msgRes;
-}
+        if (msgLen > INPUT_MSG_ALLOC_LIMIT) {
+            *parseStatus = REQ_PARSE_SCOPE_SIZE_ERROR;
+            goto err;
+        }
+    } while (*parseStatus == REQ_PARSE_PARTIAL);
 
+    msg[msgLen] = '\0';
+    return msg;
 
+err:
+    scope_free(msg);
+    return NULL;
+}
 
 /*
- * Create metadata in message response
+ * Prints the metadata of message response into buf.
+ * Returns its length, not counting the NUL terminator, or 0 if it doesn't fit
  */
-static cJSON *
-createMetaResp(ipc_resp_status_t status, int uniqReq, int remainLen) {
-    cJSON *meta = cJSON_CreateObject();
-    if (!meta) {
-        return NULL;
-    }
-    if (!cJSON_AddNumberToObjLN(meta, "status", status)) {
-        goto err;
+static size_t
+metaRespPrint(char *buf, size_t bufSize, ipc_resp_status_t status, int uniqReq, size_t remainLen) {
+    int len = scope_snprintf(buf, bufSize, "{\"status\":%d,\"uniq\":%d,\"remain\":%zu}", status, uniqReq, remainLen);
+    if ((len < 0) || (len >= bufSize)) {
+        return 0;
     }
-
-    if (!cJSON_AddNumberToObjLN(meta, "uniq", uniqReq)) {
-        goto err;
-    }
-
-    if (!cJSON_AddNumberToObjLN(meta, "remain", remainLen)) {
-        goto err;
-    }
-
-    return meta;
-
-err:
-    cJSON_Delete(meta);
-    return NULL;
+    return len;
 }
 
 /*
@@ -404,26 +326,14 @@ err:
  */
 ipc_resp_result_t
 ipcSendFailedResponse(mqd_t mqDes, size_t msgBufSize, req_parse_status_t parseStatus, int uniqReq) {    
-    ipc_resp_result_t res = RESP_ALLOCATION_ERROR;
-    cJSON *meta = createMetaResp(translateParseStatusToResp(parseStatus), uniqReq, 0);
-    if (!meta) {
-        return RESP_ALLOCATION_ERROR;
-    }
-
-    char *metadataBytes = cJSON_PrintUnformatted(meta);
-    size_t metadataLen = scope_strlen(metadataBytes);
+    char metadata[128];
+    size_t metadataLen = metaRespPrint(metadata, sizeof(metadata), translateParseStatusToResp(parseStatus), uniqReq, 0);
     // There is not sufficient place to use msg buffer 
-    if (metadataLen >= msgBufSize) {
-        res = RESP_UNSUFFICENT_MSGBUF_ERROR;
-        goto end;
+    if (!metadataLen || metadataLen >= msgBufSize) {
+        return RESP_UNSUFFICENT_MSGBUF_ERROR;
     }
 
-    res = ipcSendFrameWithRetry(mqDes, metadataBytes, metadataLen);
-
-end:
-    scope_free(metadataBytes);
-    cJSON_Delete(meta);
-    return res;
+    return ipcSendFrameWithRetry(mqDes, metadata, metadataLen);
 }
 
 typedef scopeRespWrapper* (*responseProcessor)(const cJSON *);
@@ -435,36 +345,25 @@ static responseProcessor supportedResp[] = {
     [IPC_CMD_SET_SCOPE_CFG]        = ipcRespSetScopeCfg,
     [IPC_CMD_GET_TRANSPORT_STATUS] = ipcRespGetTransportStatus,
     [IPC_CMD_GET_PROC_DETAILS]     = ipcRespGetProcessDetails,
+    [IPC_CMD_GET_HTTP2_MEMORY]     = ipcRespGetHttp2Memory,
     [IPC_CMD_UNKNOWN]              = ipcRespStatusNotImplemented
 };
 
-/* 
- * ipcProcessRequestAndPrepareResponse
- * - parse the scope request
- * - prepare the response
- * It will create response based on:
- * - scopeReq scope request
+/*
+ * Prepares the response to a single scope request
  * Returns scope wrapper which contains the scope message response
  */
 static scopeRespWrapper *
-ipcProcessRequestAndPrepareResponse(const char *scopeReq, ipc_resp_result_t *res) {
-
-    req_parse_status_t status = REQ_PARSE_JSON_ERROR;
-
-    // Verify if scope request is based on JSON-format
-    cJSON *scopeReqJson = cJSON_Parse(scopeReq);
-    if (!scopeReqJson) {
-        goto errJson;
-    }
-
+ipcProcessSingleRequest(const cJSON *scopeReqJson, ipc_resp_result_t *res) {
     if (!cJSON_IsObject(scopeReqJson)) {
-        goto errJson;
+        *res = RESP_REQUEST_ERROR;
+        return ipcRespStatusScopeError(translateParseStatusToResp(REQ_PARSE_JSON_ERROR));
     }
 
     cJSON *cmdReq = cJSON_GetObjectItemCaseSensitive(scopeReqJson, "req");
     if (!cmdReq || !cJSON_IsNumber(cmdReq)) {
-        status = REQ_PARSE_SCOPE_REQ_ERROR;
-        goto errJson;
+        *res = RESP_REQUEST_ERROR;
+        return ipcRespStatusScopeError(translateParseStatusToResp(REQ_PARSE_SCOPE_REQ_ERROR));
     }
 
     ipc_scope_req_t supportedCmd = IPC_CMD_UNKNOWN;
@@ -478,17 +377,56 @@ ipcProcessRequestAndPrepareResponse(const char *scopeReq, ipc_resp_result_t *res
     if (!resp) {
         *res = RESP_PROCESSING_ERROR;
     }
-    cJSON_Delete(scopeReqJson);
-
     return resp;
+}
+
+/* 
+ * ipcProcessRequestAndPrepareResponse
+ * - parse the scope request
+ * - prepare the response
+ * It will create response based on:
+ * - scopeReq scope request, either a single request or an array of them (a batch)
+ * The response to a batch is the array of the responses, in the order of the requests.
+ * Returns scope wrapper which contains the scope message response
+ */
+static scopeRespWrapper *
+ipcProcessRequestAndPrepareResponse(const char *scopeReq, ipc_resp_result_t *res) {
 
-errJson:
-    *res = RESP_REQUEST_ERROR;
+    // Verify if scope request is based on JSON-format
+    cJSON *scopeReqJson = cJSON_Parse(scopeReq);
+    if (!scopeReqJson) {
+        *res = RESP_REQUEST_ERROR;
+        return ipcRespStatusScopeError(translateParseStatusToResp(REQ_PARSE_JSON_ERROR));
+    }
 
-    cJSON_Delete(scopeReqJson);
+    if (!cJSON_IsArray(scopeReqJson)) {
+        scopeRespWrapper *resp = ipcProcessSingleRequest(scopeReqJson, res);
+        cJSON_Delete(scopeReqJson);
+        return resp;
+    }
+
+    scopeRespWrapper *batch = ipcRespBatchCreate();
+    if (!batch) {
+        *res = RESP_ALLOCATION_ERROR;
+        goto end;
+    }
 
-    return ipcRespStatusScopeError(translateParseStatusToResp(status));
+    cJSON *singleReq;
+    cJSON_ArrayForEach(singleReq, scopeReqJson) {
+        ipc_resp_result_t singleRes = RESP_RESULT_OK;
+        scopeRespWrapper *resp = ipcProcessSingleRequest(singleReq, &singleRes);
+        if (!resp || !ipcRespBatchAdd(batch, resp)) {
+            *res = (resp) ? RESP_ALLOCATION_ERROR : singleRes;
+            ipcRespWrapperDestroy(batch);
+            batch = NULL;
+            goto end;
+        }
+    }
+
+end:
+    cJSON_Delete(scopeReqJson);
 
+    return batch;
 }
 
 
@@ -514,26 +452,18 @@ ipcSendSuccessfulResponse(mqd_t mqDes, size_t msgBufSize, const char *scopeDataR
     size_t scopeDataOffset = 0;
 
     // Allocate buffer to send out
-    void *frame = scope_malloc(msgBufSize * sizeof(char));
+    char *frame = scope_malloc(msgBufSize * sizeof(char));
     if (!frame) {
         goto destroyScopeRespStr;
     }
 
     while (scopeDataRemainLen) {
-        // Create basic metadata for response
-        cJSON *metadataJson = createMetaResp(IPC_RESP_OK, uniqReq, scopeDataRemainLen);
-        if (!metadataJson) {
-            goto destroyFrame;
-        }
-
-        char *metadataBytes = cJSON_PrintUnformatted(metadataJson);
-        size_t metadataLen = scope_strlen(metadataBytes) + 1;
+        // Metadata for response including NUL terminator
+        size_t metadataLen = metaRespPrint(frame, msgBufSize, IPC_RESP_OK, uniqReq, scopeDataRemainLen) + 1;
 
         // There is not sufficient place to use msg buffer 
-        if (metadataLen >= msgBufSize) {
+        if (metadataLen == 1 || metadataLen >= msgBufSize) {
             res = RESP_UNSUFFICENT_MSGBUF_ERROR;
-            scope_free(metadataBytes);
-            cJSON_Delete(metadataJson);
             goto destroyFrame;
         }
         // Calculate the scope data offset and length including NUL terminator byte
@@ -542,24 +472,15 @@ ipcSendSuccessfulResponse(mqd_t mqDes, size_t msgBufSize, const char *scopeDataR
         if (scopeDataRemainLen < maxDataLen) {
             dataSendLen = scopeDataRemainLen;
         }
-        scopeDataRemainLen -= dataSendLen;
 
         /*
         * If there is still remaining data we want to change status
-        * from 200 -> 206, but because of how we construct the message
-        * we cannot do this prior
+        * from 200 -> 206, which is printed in the same place
         */
-        if (scopeDataRemainLen != 0) {
-            // Locate the status field
-            char *statusStrs = scope_strstr(metadataBytes, "\"status\":200");
-            // Get the offset for change 200 -> 206 minus 2 escape "\" characters
-            size_t offset = sizeof("\"status\":200") - 2;
-            statusStrs[offset] = '6';
+        if (scopeDataRemainLen != dataSendLen) {
+            metaRespPrint(frame, msgBufSize, IPC_RESP_OK_PARTIAL_DATA, uniqReq, scopeDataRemainLen);
         }
-
-        scope_memcpy(frame, metadataBytes, metadataLen);
-        scope_free(metadataBytes);
-        cJSON_Delete(metadataJson);
+        scopeDataRemainLen -= dataSendLen;
 
         // Copy the scope frame data
         scope_memcpy(frame + metadataLen, scopeRespBytes + scopeDataOffset, dataSendLen);
@@ -585,4 +506,3 @@ destroyWrap:
 
     return res;
 }
-
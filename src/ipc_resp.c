@@ -3,6 +3,7 @@
 #include "com.h"
 #include "dbg.h"
 #include "ipc_resp.h"
+#include "report.h"
 #include "scopestdlib.h"
 #include "runtimecfg.h"
 
@@ -18,6 +19,7 @@ static const char* cmdScopeName[] = {
     [IPC_CMD_SET_SCOPE_CFG]        = "setScopeCfg",
     [IPC_CMD_GET_TRANSPORT_STATUS] = "getTransportStatus",
     [IPC_CMD_GET_PROC_DETAILS]     = "getProcessDetails",
+    [IPC_CMD_GET_HTTP2_MEMORY]     = "getHttp2Memory",
 };
 
 #define CMD_SCOPE_SIZE  (ARRAY_SIZE(cmdScopeName))
@@ -462,6 +464,38 @@ ipcRespGetTransportStatus(const cJSON *unused) {
                     goto interfaceFail;
                 }
             }
+
+            if (!cJSON_AddNumberToObject(singleInterface, "backoff_delay_ms", status.backoffDelayMs)) {
+                cJSON_Delete(singleInterface);
+                goto interfaceFail;
+            }
+
+            if (!cJSON_AddNumberToObject(singleInterface, "next_connect_ms", status.nextConnectMs)) {
+                cJSON_Delete(singleInterface);
+                goto interfaceFail;
+            }
+        }
+
+        if (status.compressed == TRUE) {
+            if (!cJSON_AddNumberToObject(singleInterface, "uncompressed_bytes", status.uncompressedBytes)) {
+                cJSON_Delete(singleInterface);
+                goto interfaceFail;
+            }
+            if (!cJSON_AddNumberToObject(singleInterface, "compressed_bytes", status.compressedBytes)) {
+                cJSON_Delete(singleInterface);
+                goto interfaceFail;
+            }
+        }
+
+        if (status.spilling == TRUE) {
+            if (!cJSON_AddNumberToObject(singleInterface, "spill_pending_bytes", status.spillPendingBytes)) {
+                cJSON_Delete(singleInterface);
+                goto interfaceFail;
+            }
+            if (!cJSON_AddNumberToObject(singleInterface, "spill_dropped_bytes", status.spillDroppedBytes)) {
+                cJSON_Delete(singleInterface);
+                goto interfaceFail;
+            }
         }
         cJSON_AddItemToArray(interfaces, singleInterface);
     }
@@ -517,6 +551,38 @@ allocFail:
     ipcRespWrapperDestroy(wrap);
     return NULL; 
 }
+
+/*
+ * Creates the wrapper for response to IPC_CMD_GET_HTTP2_MEMORY
+ */
+scopeRespWrapper *
+ipcRespGetHttp2Memory(const cJSON *unused) {
+    scopeRespWrapper *wrap = respWrapperCreate();
+    if (!wrap) {
+        return NULL;
+    }
+    cJSON *resp = cJSON_CreateObject();
+    if (!resp) {
+        goto allocFail;
+    }
+    wrap->resp = resp;
+    if (!cJSON_AddNumberToObjLN(resp, "status", IPC_RESP_OK)) {
+        goto allocFail;
+    }
+
+    cJSON *channels = reportHttp2Memory();
+    if (!channels) {
+        goto allocFail;
+    }
+    cJSON_AddItemToObjectCS(resp, "channels", channels);
+
+    return wrap;
+
+allocFail:
+    ipcRespWrapperDestroy(wrap);
+    return NULL;
+}
+
 /*
  * Creates the wrapper for failed case in processing scope msg
  */
@@ -524,3 +590,40 @@ scopeRespWrapper *
 ipcRespStatusScopeError(ipc_resp_status_t status) {
     return ipcRespStatus(status);
 }
+
+/*
+ * Creates the wrapper for the responses to a batch of scope requests
+ */
+scopeRespWrapper *
+ipcRespBatchCreate(void) {
+    scopeRespWrapper *wrap = respWrapperCreate();
+    if (!wrap) {
+        return NULL;
+    }
+    wrap->resp = cJSON_CreateArray();
+    if (!wrap->resp) {
+        ipcRespWrapperDestroy(wrap);
+        return NULL;
+    }
+
+    return wrap;
+}
+
+/*
+ * Adds the response to a single scope request to the batch, after the ones
+ * before it. The response wrapper is destroyed either way.
+ * Returns status of operation
+ */
+bool
+ipcRespBatchAdd(scopeRespWrapper *batch, scopeRespWrapper *wrap) {
+    cJSON *resp = wrap->resp;
+    wrap->resp = NULL;
+    ipcRespWrapperDestroy(wrap);
+
+    if (!resp) {
+        return FALSE;
+    }
+    cJSON_AddItemToArray(batch->resp, resp);
+
+    return TRUE;
+}
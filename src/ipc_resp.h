@@ -2,6 +2,7 @@
 #define __IPC_RESP_H__
 
 #include "cJSON.h"
+#include "scopetypes.h"
 
 /*
  * meta_req_t describes the metadata part of ipc request command retrieves from IPC communication
@@ -28,6 +29,7 @@ typedef enum {
     IPC_CMD_SET_SCOPE_CFG,        // Update the current configuration, introduced in: 1.3.0
     IPC_CMD_GET_TRANSPORT_STATUS, // Retrieves the transport status, introduced in: 1.3.0
     IPC_CMD_GET_PROC_DETAILS,     // Retrieves the process details, introduced in: 1.4.0
+    IPC_CMD_GET_HTTP2_MEMORY,     // Retrieves the memory held for HTTP/2 channels, introduced in: 1.4.0
     // Place to add new message
     IPC_CMD_UNKNOWN,              // MUST BE LAST - points to unsupported message
 } ipc_scope_req_t;
@@ -76,9 +78,14 @@ scopeRespWrapper *ipcRespGetScopeCfg(const cJSON *);
 scopeRespWrapper *ipcRespSetScopeCfg(const cJSON *);
 scopeRespWrapper *ipcRespGetTransportStatus(const cJSON *);
 scopeRespWrapper *ipcRespGetProcessDetails(const cJSON *);
+scopeRespWrapper *ipcRespGetHttp2Memory(const cJSON *);
 scopeRespWrapper *ipcRespStatusNotImplemented(const cJSON *);
 scopeRespWrapper *ipcRespStatusScopeError(ipc_resp_status_t);
 
+// Wrapper for the responses to a batch of scope requests (an array of them)
+scopeRespWrapper *ipcRespBatchCreate(void);
+bool ipcRespBatchAdd(scopeRespWrapper *, scopeRespWrapper *);
+
 // Wrapper destructor
 void ipcRespWrapperDestroy(scopeRespWrapper *);
 
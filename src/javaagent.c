@@ -15,6 +15,8 @@
 typedef struct {
     jmethodID mid_Object_hashCode;
     jmethodID mid_SSLSocketImpl_getSession;
+    jclass    cls_SSLSessionImpl;
+    jfieldID  fid_SSLSessionImpl___scopeId;
     
     jmethodID mid_AppOutputStream___write;
     jmethodID mid_AppInputStream___read;
@@ -96,6 +98,20 @@ initJniGlobals(JNIEnv *jni)
         clearJniException(jni);
     }
     g_java.mid_SSLSocketImpl_getSession = (*jni)->GetMethodID(jni, sslSocketImplClass, "getSession", "()Ljavax/net/ssl/SSLSession;");
+
+    jclass sslSessionImplClass     = (*jni)->FindClass(jni, "sun/security/ssl/SSLSessionImpl");
+    if (sslSessionImplClass == NULL) {
+        // Oracle JDK 6
+        clearJniException(jni);
+        sslSessionImplClass = (*jni)->FindClass(jni, "com/sun/net/ssl/internal/ssl/SSLSessionImpl");
+    }
+    if (sslSessionImplClass != NULL) {
+        g_java.fid_SSLSessionImpl___scopeId = (*jni)->GetFieldID(jni, sslSessionImplClass, "__scopeId", "I");
+        if (g_java.fid_SSLSessionImpl___scopeId != NULL) {
+            g_java.cls_SSLSessionImpl = (*jni)->NewGlobalRef(jni, sslSessionImplClass);
+        }
+    }
+    clearJniException(jni);
 #endif
     jclass socketClass         = (*jni)->FindClass(jni, "java/net/Socket");
     g_java.mid_Socket_getInetAddress = (*jni)->GetMethodID(jni, socketClass, "getInetAddress", "()Ljava/net/InetAddress;");
@@ -248,6 +264,187 @@ initSSLEngineImplGlobals(JNIEnv *jni)
 }
 #endif
 
+typedef enum {
+    HOOK_APP_OUTPUT_STREAM,
+    HOOK_APP_INPUT_STREAM,
+    HOOK_SSL_ENGINE,
+    HOOK_SOCKET_CHANNEL,
+    HOOK_SSL_SESSION,
+    HOOK_DIRECT_BUFFER,
+} java_hook_t;
+
+typedef struct {
+    const char *name;
+    java_hook_t hook;
+} java_class_hook_t;
+
+/*
+ * The classes we instrument.  Netty, OkHttp and gRPC (with the JDK's TLS
+ * provider) all end up in these.  $SCOPE_JAVA_CLASSES, a comma separated
+ * list of names from this table, limits instrumentation to those classes.
+ */
+static const java_class_hook_t g_classHooks[] = {
+    {"sun/security/ssl/AppOutputStream",               HOOK_APP_OUTPUT_STREAM},
+    {"com/sun/net/ssl/internal/ssl/AppOutputStream",   HOOK_APP_OUTPUT_STREAM},
+    {"sun/security/ssl/SSLSocketImpl$AppOutputStream", HOOK_APP_OUTPUT_STREAM},
+    {"sun/security/ssl/AppInputStream",                HOOK_APP_INPUT_STREAM},
+    {"com/sun/net/ssl/internal/ssl/AppInputStream",    HOOK_APP_INPUT_STREAM},
+    {"sun/security/ssl/SSLSocketImpl$AppInputStream",  HOOK_APP_INPUT_STREAM},
+    {"sun/security/ssl/SSLEngineImpl",                 HOOK_SSL_ENGINE},
+    {"com/sun/net/ssl/internal/ssl/SSLEngineImpl",     HOOK_SSL_ENGINE},
+    {"sun/nio/ch/SocketChannelImpl",                   HOOK_SOCKET_CHANNEL},
+    {"sun/security/ssl/SSLSessionImpl",                HOOK_SSL_SESSION},
+    {"com/sun/net/ssl/internal/ssl/SSLSessionImpl",    HOOK_SSL_SESSION},
+    {"java/nio/DirectByteBuffer",                      HOOK_DIRECT_BUFFER},
+    {"java/nio/DirectByteBufferR",                     HOOK_DIRECT_BUFFER},
+};
+
+#define CLASS_HOOK_NUM (sizeof(g_classHooks) / sizeof(g_classHooks[0]))
+#define CLASS_FILTER_SIZE 32   // a power of two, at least twice CLASS_HOOK_NUM
+
+// Every class the JVM loads is looked up here, so it's hashed by name
+// with the length of the names we want as a first cut.
+typedef struct {
+    uint32_t hash[CLASS_FILTER_SIZE];
+    const java_class_hook_t *entry[CLASS_FILTER_SIZE];
+    size_t minLen;
+    size_t maxLen;
+} java_class_filter_t;
+
+static java_class_filter_t g_classFilter = {0};
+
+static uint32_t
+classNameHash(const char *name, size_t *len)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261U;
+    const char *c;
+    for (c = name; *c; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 16777619U;
+    }
+    *len = c - name;
+    return hash;
+}
+
+static void
+classFilterAdd(java_class_filter_t *filter, const java_class_hook_t *entry)
+{
+    size_t len;
+    uint32_t hash = classNameHash(entry->name, &len);
+    uint32_t i = hash & (CLASS_FILTER_SIZE - 1);
+    while (filter->entry[i]) {
+        if (filter->entry[i] == entry) return;
+        i = (i + 1) & (CLASS_FILTER_SIZE - 1);
+    }
+    filter->hash[i] = hash;
+    filter->entry[i] = entry;
+    if (!filter->minLen || (len < filter->minLen)) filter->minLen = len;
+    if (len > filter->maxLen) filter->maxLen = len;
+}
+
+static const java_class_hook_t *
+classFilterFind(java_class_filter_t *filter, const char *name)
+{
+    size_t len;
+    uint32_t hash = classNameHash(name, &len);
+    if ((len < filter->minLen) || (len > filter->maxLen)) return NULL;
+
+    uint32_t i = hash & (CLASS_FILTER_SIZE - 1);
+    while (filter->entry[i]) {
+        if ((filter->hash[i] == hash) && !scope_strcmp(filter->entry[i]->name, name)) {
+            return filter->entry[i];
+        }
+        i = (i + 1) & (CLASS_FILTER_SIZE - 1);
+    }
+    return NULL;
+}
+
+static void
+initClassFilter(java_class_filter_t *filter, const char *classes)
+{
+    int i;
+    if (!classes) {
+        for (i = 0; i < CLASS_HOOK_NUM; i++) {
+            classFilterAdd(filter, &g_classHooks[i]);
+        }
+        return;
+    }
+
+    char *list = scope_strdup(classes);
+    if (!list) {
+        DBG(NULL);
+        return;
+    }
+    char *last;
+    char *name;
+    for (name = scope_strtok_r(list, ", ", &last); name; name = scope_strtok_r(NULL, ", ", &last)) {
+        // accept java.lang.Name as well as java/lang/Name
+        char *c;
+        for (c = name; *c; c++) {
+            if (*c == '.') *c = '/';
+        }
+        for (i = 0; i < CLASS_HOOK_NUM; i++) {
+            if (!scope_strcmp(g_classHooks[i].name, name)) break;
+        }
+        if (i < CLASS_HOOK_NUM) {
+            classFilterAdd(filter, &g_classHooks[i]);
+        } else {
+            scopeLogWarn("%s is not a Java class that can be instrumented; ignoring it", name);
+        }
+    }
+    scope_free(list);
+}
+
+static bool
+hookMethod(java_class_t *classInfo, const char *className, const char *method, const char *signature)
+{
+    int methodIndex = javaFindMethodIndex(classInfo, method, signature);
+    if (methodIndex == -1) {
+        scopeLogError("ERROR: '%s' method not found in %s class\n", method, className);
+        return FALSE;
+    }
+
+    char newName[64];
+    scope_snprintf(newName, sizeof(newName), "__%s", method);
+    javaCopyMethod(classInfo, classInfo->methods[methodIndex], newName);
+    javaConvertMethodToNative(classInfo, methodIndex);
+    return TRUE;
+}
+
+static bool
+instrumentClass(java_class_t *classInfo, java_hook_t hook)
+{
+    switch (hook) {
+        case HOOK_APP_OUTPUT_STREAM:
+            scopeLogInfo("installing Java SSL hooks for AppOutputStream class...");
+            return hookMethod(classInfo, "AppOutputStream", "write", "([BII)V");
+        case HOOK_APP_INPUT_STREAM:
+            scopeLogInfo("installing Java SSL hooks for AppInputStream class...");
+            return hookMethod(classInfo, "AppInputStream", "read", "([BII)I");
+        case HOOK_SSL_ENGINE:
+            scopeLogInfo("installing Java SSL hooks for SSLEngineImpl class...");
+            return hookMethod(classInfo, "SSLEngineImpl", "wrap", "([Ljava/nio/ByteBuffer;IILjava/nio/ByteBuffer;)Ljavax/net/ssl/SSLEngineResult;") &&
+                   hookMethod(classInfo, "SSLEngineImpl", "unwrap", "(Ljava/nio/ByteBuffer;[Ljava/nio/ByteBuffer;II)Ljavax/net/ssl/SSLEngineResult;");
+        case HOOK_SOCKET_CHANNEL:
+            scopeLogInfo("installing Java SSL hooks for SocketChannelImpl class...");
+            return hookMethod(classInfo, "SocketChannelImpl", "read", "(Ljava/nio/ByteBuffer;)I") &&
+                   hookMethod(classInfo, "SocketChannelImpl", "write", "(Ljava/nio/ByteBuffer;)I");
+        case HOOK_SSL_SESSION:
+            scopeLogInfo("installing Java SSL hooks for SSLSessionImpl class...");
+            // add a private field which will cache the id we report for that session
+            javaAddField(classInfo, "__scopeId", "I", ACC_PRIVATE);
+            return TRUE;
+        case HOOK_DIRECT_BUFFER:
+            scopeLogInfo("installing Java SSL hooks for java.nio.DirectByteBuffer class...");
+            // add a private field which will hold the fd used to read/write data for that buffer
+            javaAddField(classInfo, "__fd", "I", ACC_PRIVATE);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
 void JNICALL 
 ClassFileLoadHook(jvmtiEnv *jvmti_env,
     JNIEnv* jni,
@@ -265,141 +462,44 @@ ClassFileLoadHook(jvmtiEnv *jvmti_env,
 #endif
     if (name == NULL) return;
 
-    if (scope_strcmp(name, "sun/security/ssl/AppOutputStream") == 0 || 
-        scope_strcmp(name, "com/sun/net/ssl/internal/ssl/AppOutputStream") == 0 ||
-        scope_strcmp(name, "sun/security/ssl/SSLSocketImpl$AppOutputStream") == 0) {
-
-        scopeLogInfo("installing Java SSL hooks for AppOutputStream class...");
+    // Most classes stop here
+    const java_class_hook_t *entry = classFilterFind(&g_classFilter, name);
+    if (!entry) return;
 
-        java_class_t *classInfo = javaReadClass(class_data);
-
-        int methodIndex = javaFindMethodIndex(classInfo, "write", "([BII)V");
-        if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'write' method not found in AppOutputStream class\n");
-            return;
-        }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__write");
-        javaConvertMethodToNative(classInfo, methodIndex);
+    java_class_t *classInfo = javaReadClass(class_data);
+    if (!classInfo) return;
 
+    if (instrumentClass(classInfo, entry->hook)) {
         unsigned char *dest;
         (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
         javaWriteClass(dest, classInfo);
 
         *new_class_data_len = classInfo->length;
         *new_class_data = dest;
-        javaDestroy(&classInfo);
     }
+    javaDestroy(&classInfo);
+}
 
-    if (scope_strcmp(name, "sun/security/ssl/AppInputStream") == 0 ||
-        scope_strcmp(name, "com/sun/net/ssl/internal/ssl/AppInputStream") == 0 ||
-        scope_strcmp(name, "sun/security/ssl/SSLSocketImpl$AppInputStream") == 0) {
-
-        scopeLogInfo("installing Java SSL hooks for AppInputStream class...");
-
-        java_class_t *classInfo = javaReadClass(class_data);
-
-        int methodIndex = javaFindMethodIndex(classInfo, "read", "([BII)I");
-        if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'read' method not found in AppInputStream class\n");
-            return;
-        }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__read");
-        javaConvertMethodToNative(classInfo, methodIndex);
-
-        unsigned char *dest;
-        (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
-        javaWriteClass(dest, classInfo);
-
-        *new_class_data_len = classInfo->length;
-        *new_class_data = dest;
-        javaDestroy(&classInfo);
-    }
-
-    if (scope_strcmp(name, "sun/security/ssl/SSLEngineImpl") == 0 || 
-        scope_strcmp(name, "com/sun/net/ssl/internal/ssl/SSLEngineImpl") == 0) {
-        
-        scopeLogInfo("installing Java SSL hooks for SSLEngineImpl class...");
-
-        java_class_t *classInfo = javaReadClass(class_data);
-
-        int methodIndex = javaFindMethodIndex(classInfo, "wrap", "([Ljava/nio/ByteBuffer;IILjava/nio/ByteBuffer;)Ljavax/net/ssl/SSLEngineResult;");
-        if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'wrap' method not found in SSLEngineImpl class\n");
-            return;
-        }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__wrap");
-        javaConvertMethodToNative(classInfo, methodIndex);
-
-        methodIndex = javaFindMethodIndex(classInfo, "unwrap", "(Ljava/nio/ByteBuffer;[Ljava/nio/ByteBuffer;II)Ljavax/net/ssl/SSLEngineResult;");
-         if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'unwrap' method not found in SSLEngineImpl class\n");
-            return;
-        }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__unwrap");
-        javaConvertMethodToNative(classInfo, methodIndex);
-        
-        unsigned char *dest;
-        (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
-        javaWriteClass(dest, classInfo);
-
-        *new_class_data_len = classInfo->length;
-        *new_class_data = dest;
-        javaDestroy(&classInfo);
-    }
-
-    if (scope_strcmp(name, "sun/nio/ch/SocketChannelImpl") == 0) {
-
-        scopeLogInfo("installing Java SSL hooks for SocketChannelImpl class...");
-        java_class_t *classInfo = javaReadClass(class_data);
-
-        int methodIndex = javaFindMethodIndex(classInfo, "read", "(Ljava/nio/ByteBuffer;)I");
-        if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'read' method not found in SocketChannelImpl class\n");
-            return;
-        }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__read");
-        javaConvertMethodToNative(classInfo, methodIndex);
-
-        methodIndex = javaFindMethodIndex(classInfo, "write", "(Ljava/nio/ByteBuffer;)I");
-        if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'write' method not found in SocketChannelImpl class\n");
-            return;
-        }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__write");
-        javaConvertMethodToNative(classInfo, methodIndex);
-
-        unsigned char *dest;
-        (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
-        javaWriteClass(dest, classInfo);
-
-        *new_class_data_len = classInfo->length;
-        *new_class_data = dest;
-        javaDestroy(&classInfo);
+/*
+ * The id of a session is its hashCode().  Getting it is an upcall into the
+ * JVM, so for SSLSessionImpl objects it's computed once and kept in the
+ * __scopeId field we add to that class.  Anything else (e.g. the stream
+ * object, when we can't get to the session) is hashed every time.
+ */
+static jint
+getSessionId(JNIEnv *jni, jobject session)
+{
+    if (!g_java.fid_SSLSessionImpl___scopeId ||
+        !(*jni)->IsInstanceOf(jni, session, g_java.cls_SSLSessionImpl)) {
+        return (*jni)->CallIntMethod(jni, session, g_java.mid_Object_hashCode);
     }
 
-    if (scope_strcmp(name, "java/nio/DirectByteBuffer") == 0 ||
-        scope_strcmp(name, "java/nio/DirectByteBufferR") == 0) {
-
-        scopeLogInfo("installing Java SSL hooks for java.nio.DirectByteBuffer class...");
-        java_class_t *classInfo = javaReadClass(class_data);
-
-        // add a private field which will hold the fd used to read/write data for that buffer
-        javaAddField(classInfo, "__fd", "I", ACC_PRIVATE);
-
-        unsigned char *dest;
-        (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
-        javaWriteClass(dest, classInfo);
-
-        *new_class_data_len = classInfo->length;
-        *new_class_data = dest;
-        javaDestroy(&classInfo);
+    jint id = (*jni)->GetIntField(jni, session, g_java.fid_SSLSessionImpl___scopeId);
+    if (!id) {
+        id = (*jni)->CallIntMethod(jni, session, g_java.mid_Object_hashCode);
+        (*jni)->SetIntField(jni, session, g_java.fid_SSLSessionImpl___scopeId, id);
     }
+    return id;
 }
 
 static void
@@ -407,7 +507,7 @@ doJavaProtocolByteArray(JNIEnv *jni, jobject session, jbyteArray buf, jint offse
 {
     if (!jni || !session || !buf) return;
 
-    jint  hash      = (*jni)->CallIntMethod(jni, session, g_java.mid_Object_hashCode);
+    jint  hash      = getSessionId(jni, session);
     jbyte *byteBuf  = (*jni)->GetPrimitiveArrayCritical(jni, buf, 0);
     if (!byteBuf) return;
     doProtocol((uint64_t)hash, fd, &byteBuf[offset], (size_t)(len - offset), src, BUF);
@@ -415,26 +515,27 @@ doJavaProtocolByteArray(JNIEnv *jni, jobject session, jbyteArray buf, jint offse
     (*jni)->ReleasePrimitiveArrayCritical(jni, buf, byteBuf, 0);
 }
 
+/*
+ * buf is the address of a direct buffer.  doProtocol() is done with the
+ * data before it returns, so it gets [offset, len) of the buffer itself;
+ * there's no need to copy it.
+ */
 static void
-doJavaProtocolBufferAddr(JNIEnv *jni, jobject session, void *buf, jint offset, jint len, metric_t src, int fd, jlong bufCap)
+doJavaProtocolBufferAddr(JNIEnv *jni, jobject session, char *buf, jint offset, jint len, metric_t src, int fd, jlong bufCap)
 {
     if (!jni || !session || !buf) return;
+    if ((offset < 0) || (offset >= len) || (len > bufCap)) return;
 
-    jint  hash    = (*jni)->CallIntMethod(jni, session, g_java.mid_Object_hashCode);
-    char *byteBuf = scope_malloc(bufCap);
-    if (!byteBuf) {
-        return;
-    }
-
-    scope_memcpy(byteBuf, buf, bufCap);
-    doProtocol((uint64_t)hash, fd, &byteBuf[offset], (size_t)(len - offset), src, BUF);
-    //scopeLogHexError(&byteBuf[offset], (len - offset), "doJavaProtocolBufferAddr");
-    scope_free(byteBuf);
+    jint  hash    = getSessionId(jni, session);
+    doProtocol((uint64_t)hash, fd, &buf[offset], (size_t)(len - offset), src, BUF);
+    //scopeLogHexError(&buf[offset], (len - offset), "doJavaProtocolBufferAddr");
 }
 
 static void
 saveSocketChannel(JNIEnv *jni, jobject socketChannel, jobject buf)
 {
+    // DirectByteBuffer may have been left out of $SCOPE_JAVA_CLASSES
+    if (!g_java.fid_ByteBuffer___fd) return;
     jint fd = (*jni)->CallIntMethod(jni, socketChannel, g_java.mid_SocketChannelImpl_getFDVal);
     //store the file descriptor in the internal byte buffer's field
     (*jni)->SetIntField(jni, buf, g_java.fid_ByteBuffer___fd, fd);
@@ -491,7 +592,7 @@ Java_sun_security_ssl_SSLEngineImpl_unwrap(JNIEnv *jni, jobject obj, jobject src
         return res;
     }
 
-    jint fdVal = (uint64_t) (*jni)->GetIntField(jni, src, g_java.fid_ByteBuffer___fd);
+    jint fdVal = (g_java.fid_ByteBuffer___fd) ? (*jni)->GetIntField(jni, src, g_java.fid_ByteBuffer___fd) : 0;
     if (fdVal) {
         fd = fdVal;
     }
@@ -577,7 +678,7 @@ Java_sun_security_ssl_SSLEngineImpl_wrap(JNIEnv *jni, jobject obj, jobjectArray
         return res;
     }
 
-    jint fdVal = (uint64_t) (*jni)->GetIntField(jni, dst, g_java.fid_ByteBuffer___fd);
+    jint fdVal = (g_java.fid_ByteBuffer___fd) ? (*jni)->GetIntField(jni, dst, g_java.fid_ByteBuffer___fd) : 0;
     if (fdVal) {
         fd = fdVal;
     }
@@ -770,6 +871,8 @@ Agent_OnLoad(JavaVM *jvm, char *options, void *reserved)
         return JNI_ERR;
     }
    
+    initClassFilter(&g_classFilter, getenv("SCOPE_JAVA_CLASSES"));
+
     jvmtiEventCallbacks callbacks;
     scope_memset(&callbacks, 0, sizeof(callbacks));
     callbacks.ClassFileLoadHook = &ClassFileLoadHook;
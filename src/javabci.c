@@ -51,6 +51,17 @@ javaGetUtf8String(java_class_t *info, int tagIndex)
     return buf;
 }
 
+/*
+Compares a utf8 tag with str without copying the tag
+*/
+static bool
+utf8Equals(java_class_t *info, int tagIndex, const char *str)
+{
+    unsigned char *cp = info->constant_pool[tagIndex - 1];
+    uint16_t len = be16toh(*((uint16_t *)(cp + 1)));
+    return (scope_strlen(str) == len) && !scope_memcmp(cp + 3, str, len);
+}
+
 uint16_t 
 javaGetTagLength(unsigned char *addr) 
 {
@@ -85,7 +96,7 @@ addUtf8Tag(java_class_t *info, const char *str)
 {
     size_t len = scope_strlen(str);
     size_t bufsize = len + 3;
-    unsigned char *utf8Tag = scope_malloc(bufsize);
+    unsigned char *utf8Tag = arenaAlloc(info->arena, bufsize);
     *((uint8_t *)utf8Tag)        = CONSTANT_Utf8;
     *((uint16_t *)(utf8Tag + 1)) = htobe16(len);
     scope_memcpy(utf8Tag + 3, str, len);
@@ -103,7 +114,7 @@ javaAddNameAndTypeTag(java_class_t *info, const char *name, const char *desc)
     uint16_t nameIndex = addUtf8Tag(info, name);
     uint16_t descIndex = addUtf8Tag(info, desc);
     size_t bufsize = 5;
-    unsigned char *tag = scope_malloc(bufsize);
+    unsigned char *tag = arenaAlloc(info->arena, bufsize);
     *((uint8_t *)tag)        = CONSTANT_NameAndType;
     *((uint16_t *)(tag + 1)) = htobe16(nameIndex);
     *((uint16_t *)(tag + 3)) = htobe16(descIndex);
@@ -119,7 +130,7 @@ uint16_t
 javaAddMethodRefTag(java_class_t *info, uint16_t classIndex, uint16_t nameAndTypeIndex) 
 {
     size_t bufsize = 5;
-    unsigned char *tag = scope_malloc(bufsize);
+    unsigned char *tag = arenaAlloc(info->arena, bufsize);
     *((uint8_t *)tag)        = CONSTANT_Methodref;
     *((uint16_t *)(tag + 1)) = htobe16(classIndex);
     *((uint16_t *)(tag + 3)) = htobe16(nameAndTypeIndex);
@@ -135,9 +146,10 @@ uint16_t
 javaAddStringTag(java_class_t *info, const char* str)
 {
     uint16_t idx = addUtf8Tag(info, str);
-    unsigned char *tag = scope_malloc(3);
+    unsigned char *tag = arenaAlloc(info->arena, 3);
     *((uint8_t *)tag)        = CONSTANT_String;
     *((uint16_t *)(tag + 1)) = htobe16(idx);
+    info->length += 3;
     return addTag(info, tag);
 }
 
@@ -171,12 +183,10 @@ getCodeAttributeAddress(java_class_t *info, unsigned char *method)
     for (j=0;j<attributes_count && code == NULL;j++) {
         uint16_t attr_name_index = be16toh(*((uint16_t *)off));
         uint32_t attr_length     = be32toh(*((uint32_t *)(off + 2)));
-        char *attr_name          = javaGetUtf8String(info, attr_name_index);
-        if (scope_strcmp(attr_name, "Code")==0) {
+        if (utf8Equals(info, attr_name_index, "Code")) {
             code = off;
+            break;
         }
-        scope_free(attr_name);
-        if (code != NULL) break;
         off += attr_length + 6;
     }
     return code;
@@ -192,11 +202,9 @@ javaFindClassIndex(java_class_t *info, const char *className)
         uint8_t tag = *((uint8_t *)cp_info);
         if(tag == CONSTANT_Class) {
             uint16_t name_index = be16toh(*((uint16_t *)(cp_info + 1)));
-            char *name = javaGetUtf8String(info, name_index);
-            if (scope_strcmp(name, className) == 0) {
+            if (utf8Equals(info, name_index, className)) {
                 idx = i;
             }
-            scope_free(name);
         }
         if (idx != -1) break;
     }
@@ -212,16 +220,11 @@ javaFindMethodIndex(java_class_t *info, const char *method, const char *signatur
         unsigned char *addr = info->methods[i];
         uint16_t name_index       = be16toh(*((uint16_t *)(addr + 2)));
         uint16_t descriptor_index = be16toh(*((uint16_t *)(addr + 4)));
-        
-        char *method_name = javaGetUtf8String(info, name_index);
-        char *method_desc = javaGetUtf8String(info, descriptor_index);
 
-        if (scope_strcmp(method, method_name) == 0 && scope_strcmp(signature, method_desc) == 0) {
+        if (utf8Equals(info, name_index, method) && utf8Equals(info, descriptor_index, signature)) {
             idx = i;
+            break;
         }
-        scope_free(method_name);
-        scope_free(method_desc);
-        if (idx != -1) break;
     }
     return idx;
 }
@@ -230,7 +233,7 @@ void
 javaCopyMethod(java_class_t *info, unsigned char *method, const char *newName) 
 {
     uint32_t len = javaGetMethodLength(method);
-    unsigned char *dest = scope_malloc(len);
+    unsigned char *dest = arenaAlloc(info->arena, len);
     scope_memcpy(dest, method, len);
     uint16_t nameIndex = addUtf8Tag(info, newName);
     *((uint16_t *)(dest + 2)) = htobe16(nameIndex);
@@ -245,7 +248,7 @@ javaConvertMethodToNative(java_class_t *info, int methodIndex)
     unsigned char *methodAddr = info->methods[methodIndex];
     uint32_t len   = javaGetMethodLength(methodAddr);
     size_t bufsize = 8;
-    unsigned char *addr        = scope_malloc(bufsize);
+    unsigned char *addr        = arenaAlloc(info->arena, bufsize);
     info->methods[methodIndex] = addr;
 
     scope_memcpy(addr, methodAddr, bufsize);
@@ -281,7 +284,7 @@ javaAddMethod(java_class_t *info, const char* name, const char* descriptor,
         bufsize = 8;
     }
 
-    unsigned char *addr = scope_malloc(bufsize);
+    unsigned char *addr = arenaAlloc(info->arena, bufsize);
     info->methods_count++;
     info->methods[info->methods_count - 1] = addr;
 
@@ -326,7 +329,7 @@ javaAddField(java_class_t *info, const char* name, const char* descriptor, uint1
     uint16_t attrCount = 0;
 
     size_t bufsize = 4 * 2;
-    unsigned char *buf = scope_malloc(bufsize);
+    unsigned char *buf = arenaAlloc(info->arena, bufsize);
     info->fields_count++;
     info->fields[info->fields_count - 1] = buf;
     info->length += bufsize;
@@ -401,24 +404,39 @@ javaWriteClass(unsigned char *dest, java_class_t *info)
     }
 }
 
+static void *
+arenaCalloc(arena_t *arena, size_t num, size_t size)
+{
+    void *mem = arenaAlloc(arena, num * size);
+    if (mem) scope_memset(mem, 0, num * size);
+    return mem;
+}
+
 java_class_t* 
 javaReadClass(const unsigned char* classData) 
 {
-    java_class_t *classInfo = scope_malloc(sizeof(java_class_t));
-    if (!classInfo) return NULL;
-
     if (scope_memcmp(classData, magic, sizeof(magic)) != 0) {
-        scope_free(classInfo);
         return NULL;
     }
+
+    // One chunk is normally enough for the constant pool table, the
+    // few tags and methods we add, and the class itself
+    uint16_t cpCount = be16toh(*((uint16_t *)(classData + 8)));
+    arena_t *arena = arenaCreate(sizeof(java_class_t) + (100 + cpCount) * sizeof(unsigned char *) + 4096);
+    java_class_t *classInfo = arenaCalloc(arena, 1, sizeof(java_class_t));
+    if (!classInfo) {
+        arenaDestroy(&arena);
+        return NULL;
+    }
+    classInfo->arena = arena;
+
     unsigned char *addr = (unsigned char *)classData;
     unsigned char *off = addr + sizeof(magic);
     classInfo->minor_version        = be16toh(*((uint16_t *)off)); off += 2;
     classInfo->major_version        = be16toh(*((uint16_t *)off)); off += 2;
     classInfo->constant_pool_count  = be16toh(*((uint16_t *)off)); off += 2;
-    classInfo->_constant_pool_count = classInfo->constant_pool_count;
     //allocate memory for existing constant pool enties and make a room for up to 100 new entries
-    classInfo->constant_pool        = (unsigned char **) scope_calloc(100 + (classInfo->constant_pool_count - 1), sizeof(unsigned char *));
+    classInfo->constant_pool        = (unsigned char **) arenaCalloc(classInfo->arena, 100 + (classInfo->constant_pool_count - 1), sizeof(unsigned char *));
     int i;
     for(i=1;i<classInfo->constant_pool_count;i++) {
         classInfo->constant_pool[i - 1] = (unsigned char *)off;
@@ -443,7 +461,7 @@ javaReadClass(const unsigned char* classData)
     //read fields
     classInfo->fields_count         = be16toh(*((uint16_t *)off)); off += 2;
     //allocate memory for existing fields and make a room for up to 100 new fields
-    classInfo->fields               = (unsigned char **) scope_calloc(100 + classInfo->fields_count, sizeof(unsigned char *));
+    classInfo->fields               = (unsigned char **) arenaCalloc(classInfo->arena, 100 + classInfo->fields_count, sizeof(unsigned char *));
     for (i=0;i<classInfo->fields_count;i++) {
         classInfo->fields[i] = off;
         off += getAttributesLength(off + 6) + 6;
@@ -451,9 +469,8 @@ javaReadClass(const unsigned char* classData)
 
     //read methods
     classInfo->methods_count        = be16toh(*((uint16_t *)off)); off += 2;
-    classInfo->_methods_count       = classInfo->methods_count;
     //allocate memory for existing methods and make a room for up to 100 new methods
-    classInfo->methods              = (unsigned char **) scope_calloc(100 + classInfo->methods_count, sizeof(unsigned char *));
+    classInfo->methods              = (unsigned char **) arenaCalloc(classInfo->arena, 100 + classInfo->methods_count, sizeof(unsigned char *));
     for (i=0;i<classInfo->methods_count;i++) {
         classInfo->methods[i] = off;
         off += javaGetMethodLength(off);
@@ -461,7 +478,7 @@ javaReadClass(const unsigned char* classData)
 
     //read attributes
     classInfo->attributes_count     = be16toh(*((uint16_t *)off)); off += 2;
-    classInfo->attributes           = (unsigned char **) scope_calloc(classInfo->attributes_count, sizeof(unsigned char *));
+    classInfo->attributes           = (unsigned char **) arenaCalloc(classInfo->arena, classInfo->attributes_count, sizeof(unsigned char *));
     for (i=0;i<classInfo->attributes_count;i++) {
         classInfo->attributes[i] = off;
         uint32_t attribute_length = be32toh(*((uint32_t *)(off + 2)));
@@ -472,17 +489,7 @@ javaReadClass(const unsigned char* classData)
 }
 
 void javaDestroy(java_class_t **classInfo) {
-    int i;
-    for(i = (*classInfo)->_constant_pool_count - 1;i<(*classInfo)->constant_pool_count - 1;i++) {
-        scope_free((*classInfo)->constant_pool[i]);
-    }
-    for(i = (*classInfo)->_methods_count;i<(*classInfo)->methods_count;i++) {
-        scope_free((*classInfo)->methods[i]);
-    }
-    scope_free((*classInfo)->constant_pool);
-    scope_free((*classInfo)->fields);
-    scope_free((*classInfo)->methods);
-    scope_free((*classInfo)->attributes);
-    scope_free(*classInfo);
+    arena_t *arena = (*classInfo)->arena;
+    arenaDestroy(&arena);
     *classInfo = NULL;
 }
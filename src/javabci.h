@@ -1,6 +1,7 @@
 #ifndef __JAVABCI_H__
 #define __JAVABCI_H__
 #include <stdint.h>
+#include "arena.h"
 
 // Set of simple utilities for Java byte code instrumentation based on 
 // https://docs.oracle.com/javase/specs/jvms/se14/html/index.html
@@ -62,11 +63,13 @@ typedef struct {
   unsigned char  **attributes;
   uint32_t       length;
 
-  uint16_t       _constant_pool_count;  //original constant pool count
-  uint16_t       _methods_count;        //original method count
+  arena_t        *arena;                //everything added to the class, and the class itself
 } java_class_t;
 
 
+// The class refers to classData rather than copying it, so classData has to
+// outlive it.  Whatever is added to the class comes from its arena and is
+// released by javaDestroy().
 java_class_t*   javaReadClass(const unsigned char* classData);
 void            javaWriteClass(unsigned char *dest, java_class_t *info);
 void            javaDestroy(java_class_t **info);
@@ -27,32 +27,21 @@ initMetricCapture(void)
     PCRE2_SIZE errPos;
 
     if (!g_statsd_regex) {
-        if (!(g_statsd_regex = pcre2_compile((PCRE2_SPTR)STATSD,
+        if (!(g_statsd_regex = pcre2_compile_wrapper((PCRE2_SPTR)STATSD,
                 PCRE2_ZERO_TERMINATED, 0, &errNum, &errPos, NULL))) {
             scopeLogError("ERROR: statsd regex failed; err=%d, pos=%ld",
                     errNum, errPos);
         }
     }
     if (!g_statsd_ext_regex) {
-        if (!(g_statsd_ext_regex = pcre2_compile((PCRE2_SPTR)STATSD_EXT,
+        if (!(g_statsd_ext_regex = pcre2_compile_wrapper((PCRE2_SPTR)STATSD_EXT,
                 PCRE2_ZERO_TERMINATED, 0, &errNum, &errPos, NULL))) {
             scopeLogError("ERROR: statsd extended regex failed; err=%d, pos=%ld",
                     errNum, errPos);
         }
     }
 
-    size_t buf_size = DEFAULT_CBUF_SIZE;
-    char *qlen_str;
-    if ((qlen_str = fullGetEnv("SCOPE_QUEUE_LENGTH")) != NULL) {
-        unsigned long qlen;
-        scope_errno = 0;
-        qlen = scope_strtoul(qlen_str, NULL, 10);
-        if (!scope_errno && qlen) {
-            buf_size = qlen;
-        }
-    }
-
-    if (!(g_metric_buf = cbufInit(buf_size))) {
+    if (!(g_metric_buf = cbufInit(queueLength()))) {
         scopeLogError("ERROR: statsd buffer creation failed");
     }
 }
@@ -128,6 +117,12 @@ reportAllCapturedMetrics(void)
     }
 }
 
+void
+trimCapturedMetrics(void)
+{
+    cbufTrim(g_metric_buf);
+}
+
 static bool
 doMetricBuffer(int sockfd, net_info *net, char *buf, size_t len, metric_t src)
 {
@@ -138,15 +133,15 @@ doMetricBuffer(int sockfd, net_info *net, char *buf, size_t len, metric_t src)
     if (!g_statsd_regex || !g_statsd_ext_regex || !g_metric_buf) goto out;
 
     // Try matching "extended statsd" first
-    matches = pcre2_match_data_create_from_pattern(g_statsd_ext_regex, NULL);
+    matches = pcreMatchDataGet(g_statsd_ext_regex);
     if (!matches) goto out;
 
     int rc = pcre2_match_wrapper(g_statsd_ext_regex,
             (PCRE2_SPTR)buf, (PCRE2_SIZE)len, 0, 0, matches, NULL);
     if (rc != STATSD_EXT_CAPTURE_GROUPS) {
         // Didn't get expected matches.  Try "standard statsd" next.
-        pcre2_match_data_free(matches);
-        matches = pcre2_match_data_create_from_pattern(g_statsd_regex, NULL);
+        pcreMatchDataPut(matches);
+        matches = pcreMatchDataGet(g_statsd_regex);
         if (!matches) goto out;
 
         rc = pcre2_match_wrapper(g_statsd_regex,
@@ -182,7 +177,7 @@ doMetricBuffer(int sockfd, net_info *net, char *buf, size_t len, metric_t src)
 
     is_successful = TRUE;
 out:
-    if (matches) pcre2_match_data_free(matches);
+    if (matches) pcreMatchDataPut(matches);
     return is_successful;
 }
 
@@ -4,6 +4,7 @@
 #include <string.h>
 #include "dbg.h"
 #include "mtc.h"
+#include "mtcshm.h"
 #include "circbuf.h"
 #include "runtimecfg.h"
 #include "scopestdlib.h"
@@ -13,6 +14,7 @@ struct _mtc_t
     unsigned enable;
     transport_t* transport;
     mtc_fmt_t* format;
+    unsigned shm;               // published to shared memory instead
 };
 
 mtc_t *
@@ -35,6 +37,7 @@ mtcDestroy(mtc_t **mtc)
     mtc_t *mtcb = *mtc;
     transportDestroy(&mtcb->transport);
     mtcFormatDestroy(&mtcb->format);
+    if (mtcb->shm) mtcShmDetach();
     scope_free(mtcb);
     *mtc = NULL;
 }
@@ -59,6 +62,8 @@ mtcSendMetric(mtc_t *mtc, event_t *evt)
 {
     if (!mtc || !evt) return -1;
 
+    if (mtc->shm) return mtcShmPublish(evt, mtcFormatVerbosity(mtc->format));
+
     char *msg = mtcFormatEventForOutput(mtc->format, evt, NULL);
     int rv = mtcSend(mtc, msg);
     if (msg) scope_free(msg);
@@ -75,6 +80,11 @@ mtcFlush(mtc_t *mtc)
 
 transport_status_t
 mtcConnectionStatus(mtc_t *mtc) {
+    if (mtc && mtc->shm) {
+        // Nothing to connect to
+        transport_status_t status = {.configString = "shm", .isConnected = TRUE};
+        return status;
+    }
     return transportConnectionStatus(mtc->transport);
 }
 
@@ -129,6 +139,23 @@ mtcTransportSet(mtc_t *mtc, transport_t *transport)
     // Don't leak if mtcTransportSet is called repeatedly
     transportDestroy(&mtc->transport);
     mtc->transport = transport;
+
+    // Where metrics go is one or the other
+    if (transport) mtcShmSet(mtc, FALSE);
+}
+
+void
+mtcShmSet(mtc_t *mtc, unsigned val)
+{
+    if (!mtc || val > 1 || (mtc->shm == val)) return;
+
+    if (val) {
+        transportDestroy(&mtc->transport);
+        mtcShmAttach();
+    } else {
+        mtcShmDetach();
+    }
+    mtc->shm = val;
 }
 
 void
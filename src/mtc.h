@@ -25,6 +25,7 @@ int                 mtcDisconnect(mtc_t *);
 int                 mtcReconnect(mtc_t *);
 void                mtcEnabledSet(mtc_t*, unsigned);
 void                mtcTransportSet(mtc_t*, transport_t*);
+void                mtcShmSet(mtc_t*, unsigned);
 void                mtcFormatSet(mtc_t*, mtc_fmt_t*);
 
 #endif // __MTC_H__
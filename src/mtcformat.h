@@ -5,6 +5,7 @@
 #include "scopetypes.h"
 #include "cfg.h"
 #include "cJSON.h"
+#include "evtfilter.h"
 
 
 // This event structure is meant to meet our needs w.r.t. statsd,
@@ -65,7 +66,7 @@ typedef struct {
     double timestamp;
     char *path;
     watch_t sourcetype;
-    regex_t *valuefilter;
+    evt_filter_t *valuefilter;
     proc_id_t* proc;
 } log_id_t;
 
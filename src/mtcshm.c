@@ -0,0 +1,281 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "mtcshm.h"
+#include "scopestdlib.h"
+
+#define MTCSHM_INDEX (MTCSHM_ENTRIES * 2)
+#define MTCSHM_SIZE (sizeof(mtcshm_hdr_t) + (MTCSHM_ENTRIES * sizeof(mtcshm_entry_t)))
+
+// How long a publish waits on another before it gives up; a signal handler
+// that publishes could otherwise wait on the thread it interrupted
+#define MTCSHM_SPINS (100000)
+
+// The region belongs to the process, not to an mtc.  A config reload
+// replaces the mtc and the counts carry on.
+static struct {
+    uint64_t guard;
+    int refs;
+    pid_t pid;                  // that mapped hdr; a forked child maps its own
+    mtcshm_hdr_t *hdr;
+    mtcshm_entry_t *entry;
+    uint16_t index[MTCSHM_INDEX];   // entry + 1, 0 if unused
+} g_shm;
+
+static void
+shmPath(pid_t pid, char *path, size_t len)
+{
+    scope_snprintf(path, len, "%s%d", MTCSHM_PATH, pid);
+}
+
+static void
+shmUnmap(void)
+{
+    if (g_shm.hdr) scope_munmap(g_shm.hdr, MTCSHM_SIZE);
+    g_shm.hdr = NULL;
+    g_shm.entry = NULL;
+    scope_memset(g_shm.index, 0, sizeof(g_shm.index));
+}
+
+static bool
+shmMap(void)
+{
+    char path[64];
+    pid_t pid = scope_getpid();
+    shmPath(pid, path, sizeof(path));
+
+    // /dev/shm is shared and the name is predictable.  One left by an
+    // earlier process with this pid is removed; one that someone else put
+    // there can't be, and then there's no region.
+    scope_unlink(path);
+    int fd = scope_open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd == -1) {
+        DBG("%s", path);
+        return FALSE;
+    }
+
+    struct stat st;
+    if (scope_fstat(fd, &st) || (st.st_uid != scope_geteuid())) {
+        DBG("%s", path);
+        scope_close(fd);
+        return FALSE;
+    }
+
+    // Pages of the file that no entry reaches are never allocated
+    void *addr = MAP_FAILED;
+    if (scope_ftruncate(fd, MTCSHM_SIZE) == 0) {
+        addr = scope_mmap(NULL, MTCSHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    scope_close(fd);
+    if (addr == MAP_FAILED) {
+        DBG("%s", path);
+        scope_unlink(path);
+        return FALSE;
+    }
+
+    mtcshm_hdr_t *hdr = addr;
+    hdr->seq = 1;
+    hdr->version = MTCSHM_VERSION;
+    hdr->hdr_size = sizeof(mtcshm_hdr_t);
+    hdr->entry_size = sizeof(mtcshm_entry_t);
+    hdr->capacity = MTCSHM_ENTRIES;
+    hdr->pid = pid;
+    scope_strncpy(hdr->procname, g_proc.procname, sizeof(hdr->procname) - 1);
+    scope_strncpy(hdr->hostname, g_proc.hostname, sizeof(hdr->hostname) - 1);
+    atomicStoreU64(&hdr->magic, MTCSHM_MAGIC);
+    atomicStoreU64(&hdr->seq, 2);
+
+    g_shm.hdr = hdr;
+    g_shm.entry = (mtcshm_entry_t *)(hdr + 1);
+    g_shm.pid = pid;
+    scope_memset(g_shm.index, 0, sizeof(g_shm.index));
+    return TRUE;
+}
+
+static void
+shmRemove(void)
+{
+    // Only what this process created; a child's mapping is its parent's
+    if (g_shm.hdr && (g_shm.pid == scope_getpid())) {
+        char path[64];
+        shmPath(g_shm.pid, path, sizeof(path));
+        scope_unlink(path);
+    }
+    shmUnmap();
+}
+
+static bool
+shmLock(void)
+{
+    int spins = 0;
+    while (!atomicCasU64(&g_shm.guard, 0ULL, 1ULL)) {
+        if (++spins > MTCSHM_SPINS) return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+shmUnlock(void)
+{
+    atomicSwapU64(&g_shm.guard, 0ULL);
+}
+
+void
+mtcShmAttach(void)
+{
+    if (!shmLock()) return;
+    g_shm.refs++;
+    shmUnlock();
+}
+
+void
+mtcShmDetach(void)
+{
+    if (!shmLock()) return;
+    if ((g_shm.refs > 0) && (--g_shm.refs == 0)) shmRemove();
+    shmUnlock();
+}
+
+void
+mtcShmRemove(void)
+{
+    if (!shmLock()) return;
+    shmRemove();
+    g_shm.refs = 0;
+    shmUnlock();
+}
+
+// Everything but what the header already says about the process
+static bool
+isTag(event_field_t *field, unsigned verbosity)
+{
+    if (field->cardinality > verbosity) return FALSE;
+    if ((field->value_type == FMT_STR) && !field->value.str) return FALSE;
+
+    static const char *const skip[] = {"proc", "pid", "host", "unit", "summary", NULL};
+    int i;
+    for (i = 0; skip[i]; i++) {
+        if (!scope_strcmp(field->name, skip[i])) return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+shmTags(event_t *evt, unsigned verbosity, char *tags, size_t len, const char **unit)
+{
+    size_t used = 0;
+    tags[0] = '\0';
+    *unit = "";
+
+    event_field_t *field;
+    for (field = evt->fields; field && (field->value_type != FMT_END); field++) {
+        if (!scope_strcmp(field->name, "unit") && (field->value_type == FMT_STR)) {
+            if (field->value.str) *unit = field->value.str;
+            continue;
+        }
+        if (!isTag(field, verbosity)) continue;
+
+        int n;
+        const char *delim = (used) ? "," : "";
+        if (field->value_type == FMT_NUM) {
+            n = scope_snprintf(tags + used, len - used, "%s%s:%lld",
+                               delim, field->name, field->value.num);
+        } else {
+            n = scope_snprintf(tags + used, len - used, "%s%s:%s",
+                               delim, field->name, field->value.str);
+        }
+        // What doesn't fit is left off, a whole tag at a time
+        if ((n < 0) || (n >= len - used)) {
+            tags[used] = '\0';
+            break;
+        }
+        used += n;
+    }
+}
+
+static uint64_t
+shmHash(const char *name, const char *tags)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const char *c;
+    for (c = name; *c; c++) hash = (hash ^ (unsigned char)*c) * 0x100000001b3ULL;
+    hash = (hash ^ 0xff) * 0x100000001b3ULL;
+    for (c = tags; *c; c++) hash = (hash ^ (unsigned char)*c) * 0x100000001b3ULL;
+    return hash;
+}
+
+static mtcshm_entry_t *
+shmEntry(const char *name, const char *tags, const char *unit, data_type_t type)
+{
+    uint64_t i = shmHash(name, tags) % MTCSHM_INDEX;
+    while (g_shm.index[i]) {
+        mtcshm_entry_t *entry = &g_shm.entry[g_shm.index[i] - 1];
+        if (!scope_strncmp(entry->name, name, sizeof(entry->name) - 1) &&
+            !scope_strcmp(entry->tags, tags)) {
+            return entry;
+        }
+        i = (i + 1) % MTCSHM_INDEX;
+    }
+
+    if (g_shm.hdr->count >= MTCSHM_ENTRIES) return NULL;
+
+    mtcshm_entry_t *entry = &g_shm.entry[g_shm.hdr->count];
+    scope_strncpy(entry->name, name, sizeof(entry->name) - 1);
+    scope_strncpy(entry->tags, tags, sizeof(entry->tags) - 1);
+    scope_strncpy(entry->unit, unit, sizeof(entry->unit) - 1);
+    entry->type = type;
+    g_shm.index[i] = ++g_shm.hdr->count;
+    return entry;
+}
+
+int
+mtcShmPublish(event_t *evt, unsigned verbosity)
+{
+    if (!evt || !evt->name) return -1;
+
+    char tags[sizeof(((mtcshm_entry_t *)0)->tags)];
+    const char *unit;
+    shmTags(evt, verbosity, tags, sizeof(tags), &unit);
+
+    struct timespec ts;
+    scope_clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t now = (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+    double value = (evt->value.type == FMT_INT) ?
+        (double)evt->value.integer : evt->value.floating;
+
+    if (!shmLock()) return -1;
+
+    if (g_shm.hdr && (g_shm.pid != scope_getpid())) shmUnmap();
+    if (!g_shm.hdr && !shmMap()) {
+        shmUnlock();
+        return -1;
+    }
+
+    mtcshm_hdr_t *hdr = g_shm.hdr;
+    uint64_t seq = hdr->seq;
+    atomicStoreU64(&hdr->seq, seq + 1);
+    __sync_synchronize();
+
+    int rv = 0;
+    mtcshm_entry_t *entry = shmEntry(evt->name, tags, unit, evt->type);
+    if (entry) {
+        entry->type = evt->type;
+        entry->last = value;
+        entry->total += value;
+        entry->count++;
+        entry->updated = now;
+    } else {
+        hdr->dropped++;
+        rv = -1;
+    }
+    hdr->updated = now;
+
+    atomicStoreU64(&hdr->seq, seq + 2);
+    shmUnlock();
+    return rv;
+}
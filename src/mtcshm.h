@@ -0,0 +1,77 @@
+#ifndef __MTC_SHM_H__
+#define __MTC_SHM_H__
+#include <stdint.h>
+#include "mtcformat.h"
+#include "scopetypes.h"
+
+// Metrics published to shared memory (metric > transport > type: shm).
+// Instead of being formatted and sent, each metric is added in place to an
+// entry of a region mapped from MTCSHM_PATH<pid>, where a collector on the
+// same node can read every process's metrics in one pass.
+//
+// An entry is a metric name and its tags; the fields of the metric other
+// than proc, pid, host, unit and summary that the verbosity allows.  It
+// holds the last value reported, the sum of every value reported and how
+// many there were, so counters keep counting across summary periods and
+// gauges read as their last value.  Entries are never removed; when all
+// MTCSHM_ENTRIES are taken, metrics for new ones are counted as dropped.
+//
+// The region is one header followed by the entries, all little endian as
+// written by the host.  seq is odd while an update is under way.  A reader
+// copies what it needs between two loads of seq, and keeps the copy if
+// they're equal and even:
+//
+//     do {
+//         s1 = load(hdr->seq);
+//         copy
+//         s2 = load(hdr->seq);
+//     } while ((s1 & 1) || (s1 != s2));
+//
+// The file is created 0600, so a collector has to run as the same user as
+// the process, or as root.  It's removed when the process exits, or when no
+// config uses it any more.  One left by a process that was killed has a pid
+// that's gone.
+
+#define MTCSHM_PATH     "/dev/shm/scope_mtc."
+#define MTCSHM_MAGIC    (0x43544d45504f4353ULL)     // "SCOPEMTC"
+#define MTCSHM_VERSION  (1)
+#define MTCSHM_ENTRIES  (1024)
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t hdr_size;          // where the first entry starts
+    uint32_t entry_size;
+    uint32_t capacity;          // entries there's room for
+    uint64_t seq;
+    uint32_t count;             // entries in use
+    uint32_t reserved;
+    int64_t  pid;
+    uint64_t updated;           // ns since the epoch, of the last update
+    uint64_t dropped;           // metrics that found no entry
+    char     procname[64];
+    char     hostname[64];
+} mtcshm_hdr_t;
+
+typedef struct {
+    char     name[64];
+    char     tags[160];         // name:value pairs, comma separated
+    char     unit[24];
+    uint32_t type;              // data_type_t
+    uint32_t reserved;
+    double   last;
+    double   total;
+    uint64_t count;
+    uint64_t updated;
+} mtcshm_entry_t;
+
+// Each mtc with the shm transport holds the region open; it's created on
+// the first publish, by whichever process that turns out to be
+void                mtcShmAttach(void);
+void                mtcShmDetach(void);
+
+// 0 on success, -1 if it wasn't published
+int                 mtcShmPublish(event_t *, unsigned);     // verbosity
+void                mtcShmRemove(void);                     // on exit
+
+#endif // __MTC_SHM_H__
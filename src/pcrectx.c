@@ -0,0 +1,300 @@
+#define _GNU_SOURCE
+#include <sys/syscall.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "pcrectx.h"
+#include "scopestdlib.h"
+
+#define PCRE_CTX_RECLAIM_SCAN (32)  // contexts looked at for one to hand on
+
+typedef struct {
+    const pcre2_code *re;           // the pattern it was made for, maybe freed since
+    pcre2_match_data *md;
+    uint64_t lastUsed;
+    bool out;                       // handed out by pcreMatchDataGet()
+} pcre_data_t;
+
+typedef enum {
+    CTX_THREAD,                     // kept by one thread
+    CTX_POOL,                       // borrowed from g_pcrePool
+    CTX_ONCE,                       // made for one match
+} ctx_kind_t;
+
+struct _pcre_ctx_t {
+    pcre_ctx_t *next;               // all the thread contexts there are
+    uint64_t owner;                 // tid of the thread that keeps it
+    uint64_t used;                  // acquired and not yet released
+    ctx_kind_t kind;
+    char *stack;
+    pcre2_match_context *mcontext;
+    pcre2_jit_stack *jstack;
+    uint64_t clock;                 // for lastUsed
+    pcre_data_t data[PCRE_CTX_PATTERNS];
+};
+
+static pcre_ctx_t *g_pcreCtxs = NULL;       // pushed on, never taken off
+static pcre_ctx_t *g_pcreCtxScan = NULL;    // where the last reclaim scan stopped
+static pcre_ctx_t g_pcrePool[PCRE_CTX_POOL] = {0};
+static __thread pcre_ctx_t *g_pcreCtx = NULL;
+
+static uint64_t
+threadId(void)
+{
+    return (uint64_t)scope_syscall(SYS_gettid);
+}
+
+static bool
+ctxInit(pcre_ctx_t *ctx, ctx_kind_t kind)
+{
+    ctx->kind = kind;
+    if (!ctx->stack && !(ctx->stack = scope_malloc(PCRE_STACK_SIZE))) goto err;
+    if (!ctx->mcontext && !(ctx->mcontext = pcre2_match_context_create(NULL))) goto err;
+
+    // Without a JIT stack, JIT code takes 32K of the stack it runs on,
+    // which is all of ours.  Without JIT support there's no JIT stack.
+    if (!ctx->jstack &&
+        (ctx->jstack = pcre2_jit_stack_create(PCRE_JIT_STACK_START, PCRE_JIT_STACK_MAX, NULL))) {
+        pcre2_jit_stack_assign(ctx->mcontext, NULL, ctx->jstack);
+    }
+    return TRUE;
+
+err:
+    DBG(NULL);
+    return FALSE;
+}
+
+static void
+ctxFree(pcre_ctx_t *ctx)
+{
+    int i;
+    for (i = 0; i < PCRE_CTX_PATTERNS; i++) {
+        if (ctx->data[i].md) pcre2_match_data_free(ctx->data[i].md);
+    }
+    if (ctx->jstack) pcre2_jit_stack_free(ctx->jstack);
+    if (ctx->mcontext) pcre2_match_context_free(ctx->mcontext);
+    if (ctx->stack) scope_free(ctx->stack);
+    scope_free(ctx);
+}
+
+/*
+ * A context kept by a thread that's gone, now kept by tid.  The scan
+ * picks up where the last one stopped, so a thread starting up looks at
+ * no more than PCRE_CTX_RECLAIM_SCAN of them.
+ */
+static pcre_ctx_t *
+reclaimCtx(uint64_t tid)
+{
+    pid_t pid = scope_getpid();
+    pcre_ctx_t *first = NULL;
+    pcre_ctx_t *ctx = g_pcreCtxScan;
+    int i;
+
+    for (i = 0; i < PCRE_CTX_RECLAIM_SCAN; i++) {
+        if (!ctx && !(ctx = g_pcreCtxs)) break;
+        if (ctx == first) break;
+        if (!first) first = ctx;
+
+        // A thread with our tid is gone, else it would be us.  Signal 0
+        // only checks whether there's a thread to send it to.  Should we
+        // be wrong about a thread being gone, the two threads share the
+        // context, which is safe; it's only ever used once acquired.
+        uint64_t owner = ctx->owner;
+        if (!ctx->used &&
+            ((owner == tid) ||
+             (scope_syscall(SYS_tgkill, pid, (pid_t)owner, 0) == -1)) &&
+            atomicCasU64(&ctx->owner, owner, tid)) {
+            g_pcreCtxScan = ctx->next;
+            return ctx;
+        }
+        ctx = ctx->next;
+    }
+
+    g_pcreCtxScan = ctx;
+    return NULL;
+}
+
+static pcre_ctx_t *
+threadCtx(void)
+{
+    if (g_pcreCtx) return g_pcreCtx;
+
+    uint64_t tid = threadId();
+    pcre_ctx_t *ctx = reclaimCtx(tid);
+    if (!ctx) {
+        if (!(ctx = scope_calloc(1, sizeof(pcre_ctx_t)))) {
+            DBG(NULL);
+            return NULL;
+        }
+        if (!ctxInit(ctx, CTX_THREAD)) {
+            ctxFree(ctx);
+            return NULL;
+        }
+        ctx->owner = tid;
+        do {
+            ctx->next = g_pcreCtxs;
+        } while (!atomicCasU64((uint64_t *)&g_pcreCtxs, (uint64_t)ctx->next, (uint64_t)ctx));
+    }
+
+    g_pcreCtx = ctx;
+    return ctx;
+}
+
+pcre_ctx_t *
+pcreCtxAcquire(void)
+{
+    pcre_ctx_t *ctx;
+
+    if (!g_isgo && (ctx = threadCtx()) &&
+        atomicCasU64(&ctx->used, (uint64_t)FALSE, (uint64_t)TRUE)) {
+        return ctx;
+    }
+
+    int i;
+    for (i = 0; i < PCRE_CTX_POOL; i++) {
+        ctx = &g_pcrePool[i];
+        if (ctx->used || !atomicCasU64(&ctx->used, (uint64_t)FALSE, (uint64_t)TRUE)) continue;
+        if (ctxInit(ctx, CTX_POOL)) return ctx;
+        // Put it back, allocated as far as it got, and don't keep trying
+        if (!atomicCasU64(&ctx->used, (uint64_t)TRUE, (uint64_t)FALSE)) DBG(NULL);
+        return NULL;
+    }
+
+    if (!(ctx = scope_calloc(1, sizeof(pcre_ctx_t)))) {
+        DBG(NULL);
+        return NULL;
+    }
+    if (!ctxInit(ctx, CTX_ONCE)) {
+        ctxFree(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void
+pcreCtxRelease(pcre_ctx_t *ctx)
+{
+    if (!ctx) return;
+
+    if (ctx->kind == CTX_ONCE) {
+        ctxFree(ctx);
+        return;
+    }
+    if (!atomicCasU64(&ctx->used, (uint64_t)TRUE, (uint64_t)FALSE)) DBG(NULL);
+}
+
+char *
+pcreCtxStack(pcre_ctx_t *ctx)
+{
+    return (ctx) ? ctx->stack + PCRE_STACK_SIZE : NULL;
+}
+
+pcre2_match_context *
+pcreCtxMatchContext(pcre_ctx_t *ctx)
+{
+    return (ctx) ? ctx->mcontext : NULL;
+}
+
+static bool
+bigEnough(pcre2_match_data *md, const pcre2_code *re)
+{
+    uint32_t captures = 0;
+    pcre2_pattern_info(re, PCRE2_INFO_CAPTURECOUNT, &captures);
+    return pcre2_get_ovector_count(md) > captures;
+}
+
+pcre2_match_data *
+pcreCtxMatchData(pcre_ctx_t *ctx, const pcre2_code *re)
+{
+    if (!ctx || !re) return NULL;
+
+    // The entry for re, else the one used least recently that's not out
+    pcre_data_t *victim = NULL;
+    int i;
+    for (i = 0; i < PCRE_CTX_PATTERNS; i++) {
+        pcre_data_t *data = &ctx->data[i];
+        if (data->out) continue;
+        if ((data->re == re) && data->md) {
+            // A pattern freed and another made at the same address may
+            // have more captures than this holds
+            if (!bigEnough(data->md, re)) {
+                victim = data;
+                break;
+            }
+            data->lastUsed = ++ctx->clock;
+            return data->md;
+        }
+        if (!victim || (data->lastUsed < victim->lastUsed)) victim = data;
+    }
+    if (!victim) return NULL;
+
+    if (victim->md) pcre2_match_data_free(victim->md);
+    victim->re = NULL;
+    if (!(victim->md = pcre2_match_data_create_from_pattern(re, NULL))) {
+        DBG(NULL);
+        return NULL;
+    }
+    victim->re = re;
+    victim->lastUsed = ++ctx->clock;
+    return victim->md;
+}
+
+pcre2_match_data *
+pcreMatchDataGet(const pcre2_code *re)
+{
+    if (!re) return NULL;
+
+    pcre_ctx_t *ctx = NULL;
+    if (!g_isgo && (ctx = threadCtx()) &&
+        atomicCasU64(&ctx->used, (uint64_t)FALSE, (uint64_t)TRUE)) {
+        pcre2_match_data *md = pcreCtxMatchData(ctx, re);
+        int i;
+        for (i = 0; md && (i < PCRE_CTX_PATTERNS); i++) {
+            if (ctx->data[i].md == md) ctx->data[i].out = TRUE;
+        }
+        pcreCtxRelease(ctx);
+        if (md) return md;
+    }
+
+    return pcre2_match_data_create_from_pattern(re, NULL);
+}
+
+void
+pcreMatchDataPut(pcre2_match_data *md)
+{
+    if (!md) return;
+
+    if (!g_isgo && g_pcreCtx) {
+        int i;
+        for (i = 0; i < PCRE_CTX_PATTERNS; i++) {
+            if (g_pcreCtx->data[i].md == md) {
+                g_pcreCtx->data[i].out = FALSE;
+                return;
+            }
+        }
+    }
+
+    pcre2_match_data_free(md);
+}
+
+void
+pcreCtxReset(void)
+{
+    if (!g_isgo && g_pcreCtx) g_pcreCtx->owner = threadId();
+}
+
+int
+regcomp_wrapper(regex_t *preg, const char *pattern, int cflags)
+{
+    int rc = regcomp(preg, pattern, cflags);
+    if (!rc) pcre2_jit_compile(preg->re_pcre2_code, PCRE2_JIT_COMPLETE);
+    return rc;
+}
+
+pcre2_code *
+pcre2_compile_wrapper(PCRE2_SPTR pattern, PCRE2_SIZE len, uint32_t options,
+                      int *errcode, PCRE2_SIZE *erroffset, pcre2_compile_context *ccontext)
+{
+    pcre2_code *re = pcre2_compile(pattern, len, options, errcode, erroffset, ccontext);
+    if (re) pcre2_jit_compile(re, PCRE2_JIT_COMPLETE);
+    return re;
+}
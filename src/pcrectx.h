@@ -0,0 +1,62 @@
+#ifndef __PCRECTX_H__
+#define __PCRECTX_H__
+
+#ifndef PCRE2_CODE_UNIT_WIDTH
+#define PCRE2_CODE_UNIT_WIDTH 8
+#endif
+#include "pcre2.h"
+#include "pcre2posix.h"
+#include "scopetypes.h"
+
+// What it takes to run a regex: the stack pcre2_match_wrapper() and
+// regexec_wrapper() switch to, a match context with a JIT stack of its
+// own, and match data blocks for the patterns matched with it last.
+//
+// Each thread gets a context the first time it matches and keeps it, so
+// what a match costs doesn't depend on how many threads are matching.
+// Once a thread is gone its context is handed on to a new thread; none
+// are freed.  Go runs our code on threads where we don't rely on thread
+// local storage, so Go borrows from a pool of PCRE_CTX_POOL contexts
+// instead, as does a thread that's already using its own (from a signal
+// handler, say).  When those are all in use a context is made for the
+// one match.
+
+#define PCRE_STACK_SIZE      (32 * 1024)
+#define PCRE_JIT_STACK_START (32 * 1024)
+#define PCRE_JIT_STACK_MAX   (256 * 1024)
+#define PCRE_CTX_PATTERNS    (16)   // match data blocks kept per context
+#define PCRE_CTX_POOL        (48)
+
+typedef struct _pcre_ctx_t pcre_ctx_t;
+
+// A context for the calling thread to use until it's released, or NULL
+// if there's no memory for one.
+pcre_ctx_t          *pcreCtxAcquire(void);
+void                 pcreCtxRelease(pcre_ctx_t *);
+
+// The top of the context's stack; stacks grow down
+char                *pcreCtxStack(pcre_ctx_t *);
+pcre2_match_context *pcreCtxMatchContext(pcre_ctx_t *);
+
+// The context's match data block for re, big enough for its captures.
+// It's good until the context is released.
+pcre2_match_data    *pcreCtxMatchData(pcre_ctx_t *, const pcre2_code *re);
+
+// A match data block for re to hold on to past a match, for its
+// captures.  It's the calling thread's own block for re where it can be,
+// else one made for the occasion; either way it goes back with
+// pcreMatchDataPut().
+pcre2_match_data    *pcreMatchDataGet(const pcre2_code *re);
+void                 pcreMatchDataPut(pcre2_match_data *);
+
+// In the child after a fork, the thread takes over the context of the
+// thread that forked.
+void                 pcreCtxReset(void);
+
+// Compile as regcomp() and pcre2_compile() do, then for the JIT where
+// it's available.  Where it isn't, the interpreter runs the pattern.
+int                  regcomp_wrapper(regex_t *, const char *, int);
+pcre2_code          *pcre2_compile_wrapper(PCRE2_SPTR, PCRE2_SIZE, uint32_t,
+                                           int *, PCRE2_SIZE *, pcre2_compile_context *);
+
+#endif // __PCRECTX_H__
@@ -10,6 +10,7 @@
 #include <sys/time.h>
 #include <lshpack.h>
 
+#include "arena.h"
 #include "atomic.h"
 #include "com.h"
 #include "dbg.h"
@@ -103,6 +104,54 @@
 
 #define HTTP_STATUS "HTTP/1."
 
+// Header fields we handle by name, HTTP/1 and HTTP/2 pseudo-headers alike
+typedef enum {
+    HDR_OTHER,
+    HDR_HOST,
+    HDR_USER_AGENT,
+    HDR_X_FORWARDED_FOR,
+    HDR_CONTENT_LENGTH,
+    HDR_X_APPSCOPE,
+    HDR_METHOD,
+    HDR_STATUS,
+    HDR_AUTHORITY,
+    HDR_PATH,
+    HDR_SCHEME,
+    HDR_NUM
+} known_hdr_t;
+
+static const struct {
+    const char *name;   // lowercase
+    size_t len;
+} g_known_hdr[HDR_NUM] = {
+    [HDR_HOST]            = {"host",            4},
+    [HDR_USER_AGENT]      = {"user-agent",      10},
+    [HDR_X_FORWARDED_FOR] = {"x-forwarded-for", 15},
+    [HDR_CONTENT_LENGTH]  = {"content-length",  14},
+    [HDR_X_APPSCOPE]      = {"x-appscope",      10},
+    [HDR_METHOD]          = {":method",         7},
+    [HDR_STATUS]          = {":status",         7},
+    [HDR_AUTHORITY]       = {":authority",      10},
+    [HDR_PATH]            = {":path",           5},
+    [HDR_SCHEME]          = {":scheme",         7},
+};
+
+// Perfect hash of the names above; (length + lowercase last char) & 15
+// lands each of them in its own slot.  Keep this in sync with g_known_hdr.
+#define KNOWN_HDR_HASH(len, last) (((len) + (last)) & 15)
+static const known_hdr_t g_known_hdr_slot[16] = {
+    [1]  = HDR_X_FORWARDED_FOR,
+    [3]  = HDR_AUTHORITY,
+    [6]  = HDR_CONTENT_LENGTH,
+    [8]  = HDR_HOST,
+    [10] = HDR_STATUS,
+    [11] = HDR_METHOD,
+    [12] = HDR_SCHEME,
+    [13] = HDR_PATH,
+    [14] = HDR_USER_AGENT,
+    [15] = HDR_X_APPSCOPE,
+};
+
 typedef struct http_report_t {
     char *hreq;
     char *hres;
@@ -126,36 +175,71 @@ static http_agg_t *g_http_agg = NULL;
 static uint64_t g_cumulativeEventCount = 0;
 static uint64_t g_numCallsToDoEvent = 0;
 
-// saved state for an HTTP/2 channel
-typedef struct http2Channel {
-    // HPAC decoder
-    struct lshpack_dec decoder;
-
-    // list of http2Stream_t indexed by stream
-    list_t *streams;
-} http2Channel_t;
-
 // saved state for an HTTP/2 stream within a channel
 typedef struct http2Stream {
+    struct http2Stream *next;     // next in the hash bucket or free list
+    uint32_t id;                  // stream identifier
+
     // type of the current message being processed
     uint8_t msgType; // 0=unset, 1=request, 2=response
 
+    // END_STREAM was set on the HEADERS frame of the current header block
+    bool endStream;
+
+    // a response was seen and which way it went; its side of the stream
+    // ending (END_STREAM on the response, its DATA, or its trailers) is
+    // what finishes the stream
+    bool responded;
+    bool respSent;
+
     // cJSON node for the content for the event's body.data
     cJSON *jsonData;
 
     // data from the last HTTP/2 request on the stream
     uint64_t lastRequestAt;       // hi-res timer value (nsecs)
     int      lastStatus;          // ":status" integer value; 200, 404
-    char     lastHost[256];       // ":authority" value; server's hostname
-    char     lastMethod[8];       // ":method" value; GET, POST, etc.
-    char     lastTarget[2048];    // ":target" value; the URI
-    char     lastUserAgent[1024]; // "user-agent" value"; mozilla
 
     // req/resp content-length values
     int lastReqLen;
     int lastRespLen;
+
+    // strings from the last request; these live in the channel's arena
+    const char *lastHost;         // ":authority" value; server's hostname
+    const char *lastMethod;       // ":method" value; GET, POST, etc.
+    const char *lastTarget;       // ":target" value; the URI
+    const char *lastUserAgent;    // "user-agent" value"; mozilla
 } http2Stream_t;
 
+// saved state for an HTTP/2 channel
+typedef struct http2Channel {
+    // HPAC decoder
+    struct lshpack_dec decoder;
+
+    // http2Stream_t hashed by stream ID
+    http2Stream_t **buckets;
+    size_t numBuckets;
+    size_t numStreams;
+
+    // released streams kept for reuse
+    http2Stream_t *freeStreams;
+    size_t numFree;
+
+    // Storage for the stream strings.  It's reset when no streams are
+    // open and compacted when it's grown well past what the open streams
+    // are using.  The shared* values are the last string stored for each
+    // field so the repeats that are typical across the streams on a
+    // channel are only stored once.
+    arena_t *strings;
+    size_t compactAt;
+    const char *sharedHost;
+    const char *sharedMethod;
+    const char *sharedUserAgent;
+} http2Channel_t;
+
+#define HTTP2_MIN_BUCKETS   16
+#define HTTP2_MAX_FREE      64
+#define HTTP2_ARENA_COMPACT (64 * 1024)
+
 
 #define DEFAULT_MIN_DURATION_TIME (1)
 
@@ -169,30 +253,254 @@ destroyHttpMap(http_map *map)
 }
 
 
+static void
+destroyHttp2Stream(http2Stream_t *info)
+{
+    if (!info) return;
+
+    if (info->jsonData) {
+        cJSON_Delete(info->jsonData);
+    }
+
+    scope_free(info);
+}
+
 static void
 destroyHttp2Channel(http2Channel_t *info)
 {
     if (!info) return;
 
     lshpack_dec_cleanup(&info->decoder);
-    if (info->streams) {
-        lstDestroy(&info->streams);
+
+    size_t i;
+    for (i = 0; i < info->numBuckets; i++) {
+        http2Stream_t *stream = info->buckets[i];
+        while (stream) {
+            http2Stream_t *next = stream->next;
+            destroyHttp2Stream(stream);
+            stream = next;
+        }
+    }
+    if (info->buckets) scope_free(info->buckets);
+
+    while (info->freeStreams) {
+        http2Stream_t *next = info->freeStreams->next;
+        destroyHttp2Stream(info->freeStreams);
+        info->freeStreams = next;
     }
 
+    arenaDestroy(&info->strings);
     scope_free(info);
 }
 
+static http2Channel_t *
+createHttp2Channel(void)
+{
+    http2Channel_t *channel = scope_calloc(1, sizeof(http2Channel_t));
+    if (!channel) return NULL;
+
+    channel->buckets = scope_calloc(HTTP2_MIN_BUCKETS, sizeof(http2Stream_t *));
+    channel->strings = arenaCreate(DEFAULT_ARENA_CHUNK);
+    if (!channel->buckets || !channel->strings) {
+        if (channel->buckets) scope_free(channel->buckets);
+        arenaDestroy(&channel->strings);
+        scope_free(channel);
+        return NULL;
+    }
+    channel->numBuckets = HTTP2_MIN_BUCKETS;
+    channel->compactAt = HTTP2_ARENA_COMPACT;
+
+    lshpack_dec_init(&channel->decoder);
+    lshpack_dec_set_max_capacity(&channel->decoder, 0x4000);
+
+    return channel;
+}
+
+static http2Stream_t *
+http2StreamFind(http2Channel_t *channel, uint32_t id)
+{
+    http2Stream_t *stream = channel->buckets[id & (channel->numBuckets - 1)];
+    while (stream && (stream->id != id)) {
+        stream = stream->next;
+    }
+    return stream;
+}
+
+// Double the buckets once there's more than one stream per bucket.
+// Not being able to grow just makes the chains longer.
+static void
+http2StreamsGrow(http2Channel_t *channel)
+{
+    size_t numBuckets = channel->numBuckets * 2;
+    http2Stream_t **buckets = scope_calloc(numBuckets, sizeof(http2Stream_t *));
+    if (!buckets) return;
+
+    size_t i;
+    for (i = 0; i < channel->numBuckets; i++) {
+        http2Stream_t *stream = channel->buckets[i];
+        while (stream) {
+            http2Stream_t *next = stream->next;
+            http2Stream_t **bucket = &buckets[stream->id & (numBuckets - 1)];
+            stream->next = *bucket;
+            *bucket = stream;
+            stream = next;
+        }
+    }
+
+    scope_free(channel->buckets);
+    channel->buckets = buckets;
+    channel->numBuckets = numBuckets;
+}
+
+static http2Stream_t *
+http2StreamAdd(http2Channel_t *channel, uint32_t id)
+{
+    http2Stream_t *stream = channel->freeStreams;
+    if (stream) {
+        channel->freeStreams = stream->next;
+        channel->numFree--;
+        scope_memset(stream, 0, sizeof(*stream));
+    } else if (!(stream = scope_calloc(1, sizeof(http2Stream_t)))) {
+        return NULL;
+    }
+
+    if (channel->numStreams >= channel->numBuckets) {
+        http2StreamsGrow(channel);
+    }
+
+    http2Stream_t **bucket = &channel->buckets[id & (channel->numBuckets - 1)];
+    stream->id = id;
+    stream->next = *bucket;
+    *bucket = stream;
+    channel->numStreams++;
+
+    return stream;
+}
+
 static void
-destroyHttp2Stream(void *data)
+http2StreamRelease(http2Channel_t *channel, http2Stream_t *stream)
 {
-    if (!data) return;
-    http2Stream_t *info = (http2Stream_t *)data;
+    http2Stream_t **link = &channel->buckets[stream->id & (channel->numBuckets - 1)];
+    while (*link && (*link != stream)) {
+        link = &(*link)->next;
+    }
+    if (!*link) {
+        DBG("%u", stream->id);
+        return;
+    }
+    *link = stream->next;
+    channel->numStreams--;
 
-    if (info->jsonData) {
-        cJSON_Delete(info->jsonData);
+    if (stream->jsonData) {
+        cJSON_Delete(stream->jsonData);
+        stream->jsonData = NULL;
     }
 
-    scope_free(info);
+    if (channel->numFree < HTTP2_MAX_FREE) {
+        stream->next = channel->freeStreams;
+        channel->freeStreams = stream;
+        channel->numFree++;
+    } else {
+        destroyHttp2Stream(stream);
+    }
+
+    // Nothing references the strings once every stream is closed
+    if (!channel->numStreams) {
+        arenaReset(channel->strings);
+        channel->sharedHost = NULL;
+        channel->sharedMethod = NULL;
+        channel->sharedUserAgent = NULL;
+    }
+}
+
+// Copy a string into the channel's arena.  If shared is given and holds the
+// same string, that copy is used instead.
+static const char *
+http2StringAdd(arena_t *arena, const char **shared, const char *str)
+{
+    if (!str) return NULL;
+    if (shared && *shared && !scope_strcmp(*shared, str)) return *shared;
+
+    const char *copy = arenaStrndup(arena, str, scope_strlen(str));
+    if (copy && shared) *shared = copy;
+    return copy;
+}
+
+// Move the strings of the open streams into a new arena, leaving behind the
+// ones from streams that have been released.
+static void
+http2StringsCompact(http2Channel_t *channel)
+{
+    if (arenaUsed(channel->strings) < channel->compactAt) return;
+
+    arena_t *strings = arenaCreate(DEFAULT_ARENA_CHUNK);
+    if (!strings) return;
+
+    const char *sharedHost = NULL;
+    const char *sharedMethod = NULL;
+    const char *sharedUserAgent = NULL;
+    size_t i;
+    for (i = 0; i < channel->numBuckets; i++) {
+        http2Stream_t *stream;
+        for (stream = channel->buckets[i]; stream; stream = stream->next) {
+            stream->lastHost = http2StringAdd(strings, &sharedHost, stream->lastHost);
+            stream->lastMethod = http2StringAdd(strings, &sharedMethod, stream->lastMethod);
+            stream->lastTarget = http2StringAdd(strings, NULL, stream->lastTarget);
+            stream->lastUserAgent = http2StringAdd(strings, &sharedUserAgent, stream->lastUserAgent);
+        }
+    }
+
+    arenaDestroy(&channel->strings);
+    channel->strings = strings;
+    channel->sharedHost = sharedHost;
+    channel->sharedMethod = sharedMethod;
+    channel->sharedUserAgent = sharedUserAgent;
+
+    channel->compactAt = arenaUsed(strings) * 2;
+    if (channel->compactAt < HTTP2_ARENA_COMPACT) {
+        channel->compactAt = HTTP2_ARENA_COMPACT;
+    }
+}
+
+static void
+http2StringSet(http2Channel_t *channel, const char **field, const char **shared, const char *val)
+{
+    http2StringsCompact(channel);
+    *field = http2StringAdd(channel->strings, shared, val);
+}
+
+static void
+http2ChannelMemory(http2Channel_t *channel, uint64_t uid, int fd, void *ctx)
+{
+    cJSON *channels = (cJSON *)ctx;
+    cJSON *entry;
+    if (!channel || !(entry = cJSON_CreateObject())) return;
+
+    size_t streamBytes = (channel->numStreams + channel->numFree) * sizeof(http2Stream_t) +
+                         channel->numBuckets * sizeof(http2Stream_t *);
+    size_t stringBytes = arenaSize(channel->strings);
+    size_t hpackBytes = channel->decoder.hpd_cur_capacity;
+
+    cJSON_AddNumberToObjLN(entry, "uid", uid);
+    cJSON_AddNumberToObjLN(entry, "fd", fd);
+    cJSON_AddNumberToObjLN(entry, "streams", channel->numStreams);
+    cJSON_AddNumberToObjLN(entry, "stream_bytes", streamBytes);
+    cJSON_AddNumberToObjLN(entry, "string_bytes", stringBytes);
+    cJSON_AddNumberToObjLN(entry, "string_bytes_used", arenaUsed(channel->strings));
+    cJSON_AddNumberToObjLN(entry, "hpack_bytes", hpackBytes);
+    cJSON_AddNumberToObjLN(entry, "total_bytes",
+            sizeof(http2Channel_t) + streamBytes + stringBytes + hpackBytes);
+    cJSON_AddItemToArray(channels, entry);
+}
+
+cJSON *
+reportHttp2Memory(void)
+{
+    cJSON *channels = cJSON_CreateArray();
+    if (!channels) return NULL;
+
+    channelForEach(g_http2_channels, http2ChannelMemory, channels);
+    return channels;
 }
 
 void
@@ -203,8 +511,8 @@ initReporting(void)
     //     thread exits but we've not gotten to it yet. 
     g_http_status = searchComp(HTTP_STATUS);
     g_http_agg = httpAggCreate();
-    g_httpmatch = httpMatchCreate(g_netinfo, g_extra_net_info_list, destroyHttpMap);
-    g_http2_channels = channelStoreCreate(g_netinfo, g_extra_net_info_list, destroyHttp2Channel);
+    g_httpmatch = httpMatchCreate(g_netinfo, g_channel_net_info, destroyHttpMap);
+    g_http2_channels = channelStoreCreate(g_netinfo, g_channel_net_info, destroyHttp2Channel);
 }
 
 void
@@ -415,6 +723,54 @@ headerMatch(regex_t *re, const char *match)
     return FALSE;
 }
 
+static inline char
+hdrLower(char c)
+{
+    return ((c >= 'A') && (c <= 'Z')) ? c + ('a' - 'A') : c;
+}
+
+// Classify a header field name in one pass over it.
+// From RFC 2616 Section 4.2 "Field names are case-insensitive."
+static known_hdr_t
+knownHeader(const char *name, size_t len)
+{
+    if (!name || !len) return HDR_OTHER;
+
+    known_hdr_t hdr = g_known_hdr_slot[KNOWN_HDR_HASH(len, hdrLower(name[len - 1]))];
+    if ((hdr == HDR_OTHER) || (g_known_hdr[hdr].len != len)) return HDR_OTHER;
+
+    size_t i;
+    for (i = 0; i < len; i++) {
+        if (hdrLower(name[i]) != g_known_hdr[hdr].name[i]) return HDR_OTHER;
+    }
+
+    return hdr;
+}
+
+// TRUE if any of the configured header filters match the `name: value`
+// header line.  Filters that are plain strings were pulled out when the
+// config was built so most lines never get to regexec().
+static bool
+headerConfigMatch(config_t *cfg, const char *line)
+{
+    size_t i;
+    size_t numExtracts = cfgEvtFormatNumHeaders(cfg);
+
+    for (i = 0; i < numExtracts; i++) {
+        bool nocase;
+        const char *literal = cfgEvtFormatHeaderLiteral(cfg, i, &nocase);
+        if (literal) {
+            if ((nocase) ? scope_strcasestr(line, literal) : scope_strstr(line, literal)) {
+                return TRUE;
+            }
+        } else if (headerMatch(cfgEvtFormatHeaderRe(cfg, i), line)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
 static bool
 httpFields(event_field_t *fields, http_report *hreport, char *hdr,
            size_t hdr_len, protocol_info *proto, config_t *cfg)
@@ -423,7 +779,6 @@ httpFields(event_field_t *fields, http_report *hreport, char *hdr,
 
     // Start with fields from the header
     char *savea = NULL, *header;
-    size_t numExtracts;
 
     hreport->clen = -1;
 
@@ -445,41 +800,42 @@ httpFields(event_field_t *fields, http_report *hreport, char *hdr,
     }
 
     while ((thishdr = scope_strtok_r(NULL, "\r\n", &savea)) != NULL) {
-        // From RFC 2616 Section 4.2 "Field names are case-insensitive."
-        if (scope_strcasestr(thishdr, "Host:")) {
-            H_ATTRIB(fields[hreport->ix], "http_host", scope_strchr(thishdr, ':') + 2, 1);
-            HTTP_NEXT_FLD(hreport->ix);
-        } else if (scope_strcasestr(thishdr, "User-Agent:")) {
-            H_ATTRIB(fields[hreport->ix], "http_user_agent", scope_strchr(thishdr, ':') + 2, 5);
-            HTTP_NEXT_FLD(hreport->ix);
-        } else if (scope_strcasestr(thishdr, "X-Forwarded-For:")) {
-            H_ATTRIB(fields[hreport->ix], "http_client_ip", scope_strchr(thishdr, ':') + 2, 5);
-            HTTP_NEXT_FLD(hreport->ix);
-        } else if (scope_strcasestr(thishdr, "Content-Length:")) {
-            scope_errno = 0;
-            if (((hreport->clen = scope_strtoull(scope_strchr(thishdr, ':') + 2, NULL, 0)) == 0) || (scope_errno != 0)) {
-                hreport->clen = -1;
-            }
-        } else if (scope_strcasestr(thishdr, "x-appscope:")) {
-                H_ATTRIB(fields[hreport->ix], "x-appscope", scope_strchr(thishdr, ':') + 2, 5);
-                HTTP_NEXT_FLD(hreport->ix);
-        } else if ((numExtracts = cfgEvtFormatNumHeaders(cfg)) > 0) {
-            int i;
+        char *colon = scope_strchr(thishdr, ':');
+        if (!colon) continue;
 
-            for (i = 0; i < numExtracts; i++) {
-                regex_t *re;
+        char *value = colon + 1;
+        while ((*value == ' ') || (*value == '\t')) value++;
 
-                if (((re = cfgEvtFormatHeaderRe(cfg, i)) != NULL) &&
-                    (headerMatch(re, thishdr) == TRUE)) {
-                    char *evsrc = scope_strchr(thishdr, ':');
-
-                    if (evsrc) {
-                        *evsrc = '\0';
-                        H_ATTRIB(fields[hreport->ix], thishdr, evsrc + 2, 5);
-                        HTTP_NEXT_FLD(hreport->ix);
-                    }
+        switch (knownHeader(thishdr, colon - thishdr)) {
+            case HDR_HOST:
+                H_ATTRIB(fields[hreport->ix], "http_host", value, 1);
+                HTTP_NEXT_FLD(hreport->ix);
+                break;
+            case HDR_USER_AGENT:
+                H_ATTRIB(fields[hreport->ix], "http_user_agent", value, 5);
+                HTTP_NEXT_FLD(hreport->ix);
+                break;
+            case HDR_X_FORWARDED_FOR:
+                H_ATTRIB(fields[hreport->ix], "http_client_ip", value, 5);
+                HTTP_NEXT_FLD(hreport->ix);
+                break;
+            case HDR_CONTENT_LENGTH:
+                scope_errno = 0;
+                if (((hreport->clen = scope_strtoull(value, NULL, 10)) == 0) || (scope_errno != 0)) {
+                    hreport->clen = -1;
                 }
-            }
+                break;
+            case HDR_X_APPSCOPE:
+                H_ATTRIB(fields[hreport->ix], "x-appscope", value, 5);
+                HTTP_NEXT_FLD(hreport->ix);
+                break;
+            default:
+                if (headerConfigMatch(cfg, thishdr)) {
+                    *colon = '\0';
+                    H_ATTRIB(fields[hreport->ix], thishdr, value, 5);
+                    HTTP_NEXT_FLD(hreport->ix);
+                }
+                break;
         }
     }
 
@@ -732,6 +1088,13 @@ doHttp1Header(protocol_info *proto)
         httpFields(fields, &hreport, post->hdr, proto->len, proto, g_cfg.staticfg);
         response_clen = hreport.clen;
 
+        // the size of a chunked body isn't in the header
+        if ((response_clen == -1) && (post->clen != -1)) {
+            response_clen = post->clen;
+            H_VALUE(fields[hreport.ix], "http_response_content_length", response_clen, EVENT_ONLY_ATTR);
+            HTTP_NEXT_FLD(hreport.ix);
+        }
+
         httpFieldsInternal(fields, &hreport, proto);
         httpFieldEnd(fields, hreport.ix);
 
@@ -903,31 +1266,31 @@ httpStatusCode2Text(int code)
 static bool
 isHttp2NameEnabled(const char* name)
 {
-    regex_t *nameRe = evtFormatNameFilter(ctlEvtGet(g_ctl), CFG_SRC_HTTP);
+    evt_filter_t *nameRe = evtFormatNameFilter(ctlEvtGet(g_ctl), CFG_SRC_HTTP);
     if (!nameRe) {
         scopeLogError("ERROR: missing name filter for HTTP watch");
         DBG("Missing name filter for HTTP watch");
         return FALSE;
     }
-    return headerMatch(nameRe, name);
+    return evtFilterMatchName(nameRe, name);
 }
 
 static bool
 isHttp2FieldEnabled(const char* field, const char *value)
 {
-    regex_t *fieldRe = evtFormatFieldFilter(ctlEvtGet(g_ctl), CFG_SRC_HTTP);
+    evt_filter_t *fieldRe = evtFormatFieldFilter(ctlEvtGet(g_ctl), CFG_SRC_HTTP);
     if (!fieldRe) {
         scopeLogError("ERROR: missing field filter for HTTP watch");
         DBG("Missing field filter for HTTP watch");
         return FALSE;
     }
-    regex_t *valueRe = evtFormatValueFilter(ctlEvtGet(g_ctl), CFG_SRC_HTTP);
+    evt_filter_t *valueRe = evtFormatValueFilter(ctlEvtGet(g_ctl), CFG_SRC_HTTP);
     if (!valueRe) {
         scopeLogError("ERROR: missing value filter for HTTP watch");
         DBG("Missing value filter for HTTP watch");
         return FALSE;
     }
-    return headerMatch(fieldRe, field) && headerMatch(valueRe, value);
+    return evtFilterMatchName(fieldRe, field) && evtFilterMatch(valueRe, value);
 }
 
 static void
@@ -1022,7 +1385,21 @@ doHttp2Frame(protocol_info *proto)
                 + ( frame[offset+3]            );
     }
 
-    if (fType == 0x01 || fType == 0x05 || fType == 0x09) {
+    if (fType == 0x00 || fType == 0x03) {
+        // DATA(0) frames are only reported when they carry END_STREAM and
+        // RST_STREAM(3) frames always are.  Either can finish a stream we
+        // already know about; neither starts one.
+        http2Channel_t *channel = channelGet(g_http2_channels, proto->uid);
+        if (!channel) return;
+        http2Stream_t *stream = http2StreamFind(channel, fStream);
+        if (!stream) return;
+
+        bool isSend = proto->isServer;
+        if ((fType == 0x03) ||
+            ((fFlags & 0x01) && stream->responded && (stream->respSent == isSend))) {
+            http2StreamRelease(channel, stream);
+        }
+    } else if (fType == 0x01 || fType == 0x05 || fType == 0x09) {
         // Process HEADERS(1), PUSH_PROMISE(5), or CONTINUATION(9) frames. All
         // three contain a header block; an HPACK-encoded lists of key/value
         // headers.
@@ -1045,17 +1422,13 @@ doHttp2Frame(protocol_info *proto)
         // get/create the channel info
         http2Channel_t *channel = channelGet(g_http2_channels, proto->uid);
         if (!channel) {
-            channel = scope_calloc(1, sizeof(http2Channel_t));
+            channel = createHttp2Channel();
             if (!channel) {
                 scopeLogError("ERROR: failed to create channel info");
                 DBG(NULL);
                 return;
             }
 
-            lshpack_dec_init(&channel->decoder);
-            lshpack_dec_set_max_capacity(&channel->decoder, 0x4000);
-            channel->streams = lstCreate(destroyHttp2Stream);
-
             if (channelSave(g_http2_channels, channel, proto->uid, proto->fd) != TRUE) {
                 destroyHttp2Channel(channel);
                 scopeLogError("ERROR: failed to insert channel");
@@ -1065,21 +1438,14 @@ doHttp2Frame(protocol_info *proto)
         }
 
         // get/create the stream info
-        http2Stream_t *stream = lstFind(channel->streams, fStream);
+        http2Stream_t *stream = http2StreamFind(channel, fStream);
         if (!stream) {
-            stream = scope_calloc(1, sizeof(http2Stream_t));
+            stream = http2StreamAdd(channel, fStream);
             if (!stream) {
                 scopeLogError("ERROR: failed to create http2Stream");
                 DBG(NULL);
                 return;
             }
-
-            if (lstInsert(channel->streams, fStream, stream) != TRUE) {
-                destroyHttp2Stream(stream);
-                scopeLogError("ERROR: failed to insert decoder");
-                DBG(NULL);
-                return;
-            }
         }
 
         // Rather than keep an event_field_t array like the HTTP/1 logic does,
@@ -1100,6 +1466,12 @@ doHttp2Frame(protocol_info *proto)
             cJSON_AddStringToObjLN(stream->jsonData, "http_flavor", "2.0");
         }
 
+        // END_STREAM is only carried on the HEADERS frame; the CONTINUATION
+        // frames that may follow are still part of the same header block.
+        if ((fType == 0x01) && (fFlags & 0x01)) {
+            stream->endStream = TRUE;
+        }
+
         // The position in the frame where the header data is depends on the
         // type and flags. Initially, we start just after the frame header and
         // end at the end of the frame then adjust. See below.
@@ -1153,81 +1525,83 @@ doHttp2Frame(protocol_info *proto)
             // of these become entries in the cJSON object that will eventually
             // become the body.data element in the JSON event. Some are stashed
             // into the state object for use later.
-            if (!scope_strcasecmp(":method", name)) {
-                // We use the presence of the :method header to indicate we're
-                // processing a request message.
-                stream->msgType = 1;
-                addHttp2NumField(stream->jsonData, "http_stream", fStream);
-
-                addHttp2StrField(stream->jsonData, "http_method", val);
-                scope_strncpy(stream->lastMethod, val, sizeof(stream->lastMethod));
-
-                // record the start timestamp for duration calculations
-                stream->lastRequestAt = post->start_duration;
-
-                // record the frame type in request events so we can see Server Push
-                if (fType == 0x01) {
-                    addHttp2StrFieldLN(stream->jsonData, "http_frame", "HEADERS");
-                } else if (fType == 0x05) {
-                    addHttp2StrFieldLN(stream->jsonData, "http_frame", "PUSH_PROMISE");
-                }
-            } else if (!scope_strcasecmp(":status", name)) {
-                // We use the presence of the :status header to indicate we're
-                // processing a response message.
-                stream->msgType = 2; // response
-                addHttp2NumField(stream->jsonData, "http_stream", fStream);
-
-                stream->lastStatus = scope_atoi(val);
-                addHttp2NumField(stream->jsonData, "http_status_code", stream->lastStatus);
-                addHttp2StrField(stream->jsonData, "http_status_text", httpStatusCode2Text(stream->lastStatus));
-            } else if (!scope_strcasecmp(":authority", name)) {
-                addHttp2StrField(stream->jsonData, "http_host", val);
-                scope_strncpy(stream->lastHost, val, sizeof(stream->lastHost));
-            } else if (!scope_strcasecmp(":path", name)) {
-                addHttp2StrField(stream->jsonData, "http_target", val);
-                scope_strncpy(stream->lastTarget, val, sizeof(stream->lastTarget));
-            } else if (!scope_strcasecmp(":scheme", name)) {
-                addHttp2StrField(stream->jsonData, "http_scheme", val);
-            } else if (!scope_strcasecmp("user-agent", name)) {
-                addHttp2StrField(stream->jsonData, "http_user_agent", val);
-                scope_strncpy(stream->lastUserAgent, val, sizeof(stream->lastUserAgent));
-            } else if (!scope_strcasecmp("x-appscope", name)) {
-                addHttp2StrField(stream->jsonData, "x-appscope", val);
-            } else if (!scope_strcasecmp("x-forwarded-for", name)) {
-                addHttp2StrField(stream->jsonData, "http_client_ip", val);
-            } else if (!scope_strcasecmp("content-length", name)) {
-                if (stream->msgType == 1) {
-                    stream->lastReqLen = scope_atoi(val);
-                    addHttp2NumField(stream->jsonData, "http_request_content_length", stream->lastReqLen);
-                } else if (stream->msgType == 2) {
-                    stream->lastRespLen = scope_atoi(val);
-                    addHttp2NumField(stream->jsonData, "http_response_content_length", stream->lastRespLen);
-                } else {
-                    scopeLogError("ERROR: invalid msgType; %d", stream->msgType);
-                    DBG(NULL);
-                }
-            } else {
-                // All other header fields need to match a regex in the
-                // event.watch[name=http].headers array in the runtime config.
-                //
-                // Note that the filter is applied to the header's `name:
-                // value` form, not the name and value separately. We're munging the
-                // buffer temporarily here.
-                out[hdr.name_offset + hdr.name_len] = ':';
-                size_t i;
-                size_t numHeaders = cfgEvtFormatNumHeaders(g_cfg.staticfg);
-                for (i = 0; i < numHeaders; ++i) {
-                    regex_t *re = cfgEvtFormatHeaderRe(g_cfg.staticfg, i);
-                    if (re) {
-                        if (!regexec_wrapper(re, out, 0, NULL, 0)) {
-                            // matched, add it and skip the rest of the filters
-                            out[hdr.name_offset + hdr.name_len] = '\0';
-                            cJSON_AddStringToObject(stream->jsonData, name, val);
-                            break;
-                        }
+            switch (knownHeader(name, hdr.name_len)) {
+                case HDR_METHOD:
+                    // We use the presence of the :method header to indicate we're
+                    // processing a request message.
+                    stream->msgType = 1;
+                    addHttp2NumField(stream->jsonData, "http_stream", fStream);
+
+                    addHttp2StrField(stream->jsonData, "http_method", val);
+                    http2StringSet(channel, &stream->lastMethod, &channel->sharedMethod, val);
+
+                    // record the start timestamp for duration calculations
+                    stream->lastRequestAt = post->start_duration;
+
+                    // record the frame type in request events so we can see Server Push
+                    if (fType == 0x01) {
+                        addHttp2StrFieldLN(stream->jsonData, "http_frame", "HEADERS");
+                    } else if (fType == 0x05) {
+                        addHttp2StrFieldLN(stream->jsonData, "http_frame", "PUSH_PROMISE");
                     }
-                }
-                out[hdr.name_offset + hdr.name_len] = '\0';
+                    break;
+                case HDR_STATUS:
+                    // We use the presence of the :status header to indicate we're
+                    // processing a response message.
+                    stream->msgType = 2; // response
+                    addHttp2NumField(stream->jsonData, "http_stream", fStream);
+
+                    stream->lastStatus = scope_atoi(val);
+                    addHttp2NumField(stream->jsonData, "http_status_code", stream->lastStatus);
+                    addHttp2StrField(stream->jsonData, "http_status_text", httpStatusCode2Text(stream->lastStatus));
+                    break;
+                case HDR_AUTHORITY:
+                    addHttp2StrField(stream->jsonData, "http_host", val);
+                    http2StringSet(channel, &stream->lastHost, &channel->sharedHost, val);
+                    break;
+                case HDR_PATH:
+                    addHttp2StrField(stream->jsonData, "http_target", val);
+                    http2StringSet(channel, &stream->lastTarget, NULL, val);
+                    break;
+                case HDR_SCHEME:
+                    addHttp2StrField(stream->jsonData, "http_scheme", val);
+                    break;
+                case HDR_USER_AGENT:
+                    addHttp2StrField(stream->jsonData, "http_user_agent", val);
+                    http2StringSet(channel, &stream->lastUserAgent, &channel->sharedUserAgent, val);
+                    break;
+                case HDR_X_APPSCOPE:
+                    addHttp2StrField(stream->jsonData, "x-appscope", val);
+                    break;
+                case HDR_X_FORWARDED_FOR:
+                    addHttp2StrField(stream->jsonData, "http_client_ip", val);
+                    break;
+                case HDR_CONTENT_LENGTH:
+                    if (stream->msgType == 1) {
+                        stream->lastReqLen = scope_atoi(val);
+                        addHttp2NumField(stream->jsonData, "http_request_content_length", stream->lastReqLen);
+                    } else if (stream->msgType == 2) {
+                        stream->lastRespLen = scope_atoi(val);
+                        addHttp2NumField(stream->jsonData, "http_response_content_length", stream->lastRespLen);
+                    } else {
+                        scopeLogError("ERROR: invalid msgType; %d", stream->msgType);
+                        DBG(NULL);
+                    }
+                    break;
+                default:
+                    // All other header fields need to match a filter in the
+                    // event.watch[name=http].headers array in the runtime config.
+                    //
+                    // Note that the filter is applied to the header's `name:
+                    // value` form, not the name and value separately. We're munging the
+                    // buffer temporarily here.
+                    out[hdr.name_offset + hdr.name_len] = ':';
+                    bool matched = headerConfigMatch(g_cfg.staticfg, name);
+                    out[hdr.name_offset + hdr.name_len] = '\0';
+                    if (matched) {
+                        cJSON_AddStringToObject(stream->jsonData, name, val);
+                    }
+                    break;
             }
         }
 
@@ -1304,33 +1678,36 @@ doHttp2Frame(protocol_info *proto)
                 addHttp2NumField(stream->jsonData, isServer ?  "http_server_duration" : "http_client_duration", duration);
 
                 // add host from request
-                if (stream->lastHost[0]) {
+                if (stream->lastHost) {
                     addHttp2StrField(stream->jsonData, "http_host", stream->lastHost);
                 } else if (map) {
                     // TODO: HTTP/1->2 upgrade, get value from HTTP/1 request
                 }
 
                 // add method from request
-                if (stream->lastMethod[0]) {
+                if (stream->lastMethod) {
                     addHttp2StrField(stream->jsonData, "http_method", stream->lastMethod);
                 } else if (map) {
                     // TODO: HTTP/1->2 upgrade, get value from HTTP/1 request
                 }
 
                 // add target URL from request
-                if (stream->lastTarget[0]) {
+                if (stream->lastTarget) {
                     addHttp2StrField(stream->jsonData, "http_target", stream->lastTarget);
                 } else if (map) {
                     // TODO: HTTP/1->2 upgrade, get value from HTTP/1 request
                 }
 
                 // add user-agent from request
-                if (stream->lastUserAgent[0]) {
+                if (stream->lastUserAgent) {
                     addHttp2StrField(stream->jsonData, "http_user_agent", stream->lastUserAgent);
                 } else if (map) {
                     // TODO: HTTP/1->2 upgrade, get value from HTTP/1 request
                 }
 
+                stream->responded = TRUE;
+                stream->respSent = isSend;
+
                 if (isHttp2NameEnabled("http.resp")) {
                     // send the response event
                     event_t event = INT_EVENT("http.resp", proto->len, SET, NULL);
@@ -1342,7 +1719,7 @@ doHttp2Frame(protocol_info *proto)
                 if (mtcEnabled(g_mtc) && (cfgMtcWatchEnable(g_cfg.staticfg, CFG_MTC_HTTP))) {
                     // update HTTP metrics
                     event_field_t fields[] = {
-                        STRFIELD("http_target", stream->lastTarget, 4, TRUE),
+                        STRFIELD("http_target", (stream->lastTarget) ? stream->lastTarget : "", 4, TRUE),
                         NUMFIELD("http_status_code", stream->lastStatus, 1, TRUE),
                         FIELDEND
                     };
@@ -1355,6 +1732,12 @@ doHttp2Frame(protocol_info *proto)
                 }
             }
 
+            // a header block after the response is its trailers, as gRPC
+            // sends; they don't make an event of their own
+            else if (stream->responded) {
+                cJSON_Delete(stream->jsonData);
+            }
+
             // otherwise, the message type is invalid
             else {
                 scopeLogError("ERROR: HTTP/2 invalid msgType; %d", stream->msgType);
@@ -1362,12 +1745,21 @@ doHttp2Frame(protocol_info *proto)
             }
 
             // reset
+            bool streamDone = stream->endStream && stream->responded &&
+                (stream->respSent == isSend);
             stream->msgType = 0;
+            stream->endStream = FALSE;
             if (stream->jsonData) {
                 // jsonData was deleted for us down in cmdSendHttp()
                 //cJSON_Delete(stream->jsonData);
                 stream->jsonData = NULL;
             }
+
+            // nothing more is needed from the stream once the response
+            // side has ended it
+            if (streamDone) {
+                http2StreamRelease(channel, stream);
+            }
         }
     } else {
         scopeLogError("ERROR: HTTP/2 unexpected frame type; type=0x%02d", fType);
@@ -3407,6 +3799,9 @@ doConnection(void)
         ready = TRUE;
     }
 
+    // What can't be sent now is spilled to disk, to be sent once it can
+    if ((ready == FALSE) && ctlSpills(g_ctl)) ready = TRUE;
+
     if ((cfgLogStreamEnable(g_cfg.staticfg) == FALSE) && (ready == FALSE)) {
         if (mtcNeedsConnection(g_mtc)) {
             if (mtcConnect(g_mtc)) {
@@ -3429,6 +3824,44 @@ doHttpAgg()
     httpAggReset(g_http_agg);
 }
 
+static void
+sendDNSAgg(dns_answer_t const *answer, uint64_t count, uint64_t duration, void *ctx)
+{
+    uint64_t avg = duration / count;
+
+    // This creates a DNS raw event
+    event_field_t resp[] = {
+        PROC_FIELD(g_proc.procname),
+        PID_FIELD(g_proc.pid),
+        HOST_FIELD(g_proc.hostname),
+        DOMAIN_FIELD(answer->name),
+        UNIT_FIELD("response"),
+        FIELDEND
+    };
+    event_t dnsMetric = INT_EVENT("dns.resp", count, DELTA, resp);
+    cmdSendEvent(g_ctl, &dnsMetric, getTime(), &g_proc);
+
+    if (!ctlEvtSourceEnabled(g_ctl, CFG_SRC_DNS)) return;
+
+    // This creates a DNS event
+    event_field_t evfield[] = {
+        DOMAIN_FIELD(answer->name),
+        DURATION_FIELD(avg / 1000000), // convert ns to ms.
+        FIELDEND
+    };
+    event_t dnsEvent = INT_EVENT("dns.resp", count, DELTA, evfield);
+    dnsEvent.src = CFG_SRC_DNS;
+    dnsEvent.data = dnsAnswerJson(answer, avg);
+    cmdSendEvent(g_ctl, &dnsEvent, getTime(), &g_proc);
+}
+
+void
+doDNSAgg()
+{
+    // responses that repeated a cached answer, one event per name
+    dnsCacheDrain(g_dns_cache, sendDNSAgg, NULL);
+}
+
 // Somewhat arbitrary value. Heuristically, on one machine,
 // this seemed adequate for our ipc to remain responsive.
 #define MAX_EVT_COUNT ( DEFAULT_MAXEVENTSPERSEC / 20 )
@@ -3490,6 +3923,8 @@ doEvent()
     }
 
     if ((++g_numCallsToDoEvent % 1000) == 0) {
+        // idle TLS channels first, so their requests are seen to be gone
+        chanTabReclaim(g_channel_net_info);
         httpReqExpire(g_httpmatch, g_cumulativeEventCount, !exitedLoopEarly);
         channelExpire(g_http2_channels, g_cumulativeEventCount, !exitedLoopEarly);
     }
@@ -3670,6 +4105,13 @@ doPayload()
     }
 }
 
+void
+doQueueTrim(void)
+{
+    trimCapturedMetrics();
+    ctlTrim(g_ctl);
+}
+
 void
 doProcStartMetric(void)
 {
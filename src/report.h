@@ -97,9 +97,12 @@ void doStatMetric(const char *, const char *, void *);
 void doTotal(metric_t);
 void doTotalDuration(metric_t);
 void doHttpAgg(void);
+void doDNSAgg(void);
 void doEvent(void);
 void doPayload(void);
+void doQueueTrim(void);
 void doProcStartMetric(void);
 bool doConnection(void);
+cJSON *reportHttp2Memory(void);
 
 #endif // __REPORT_H__
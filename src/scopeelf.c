@@ -159,16 +159,102 @@ out:
     return ebuf;
 }
 
+struct _got_hooks_t {
+    got_list_t **slot;      // open-addressed by the hash of the symbol
+    size_t num_slots;
+};
+
+static uint32_t
+gotHash(const char *symbol)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (; *symbol; symbol++) {
+        hash ^= (unsigned char)*symbol;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Index the hooks in a got_list_t array that ends with a NULL symbol so
+ * that the relocations of an object can be checked against all of them
+ * in a single pass.
+ */
+got_hooks_t *
+gotHooksCreate(got_list_t *list)
+{
+    if (!list) return NULL;
+
+    size_t num = 0;
+    while (list[num].symbol) num++;
+
+    // keep it at most half full
+    size_t num_slots = 16;
+    while (num_slots < num * 2) num_slots *= 2;
+
+    got_hooks_t *hooks = scope_calloc(1, sizeof(got_hooks_t));
+    got_list_t **slot = scope_calloc(num_slots, sizeof(got_list_t *));
+    if (!hooks || !slot) {
+        if (hooks) scope_free(hooks);
+        if (slot) scope_free(slot);
+        DBG(NULL);
+        return NULL;
+    }
+    hooks->slot = slot;
+    hooks->num_slots = num_slots;
+
+    size_t i;
+    for (i = 0; i < num; i++) {
+        size_t j = gotHash(list[i].symbol) & (num_slots - 1);
+        while (slot[j]) j = (j + 1) & (num_slots - 1);
+        slot[j] = &list[i];
+    }
+
+    return hooks;
+}
+
+void
+gotHooksDestroy(got_hooks_t **hooksptr)
+{
+    if (!hooksptr || !*hooksptr) return;
+    got_hooks_t *hooks = *hooksptr;
+
+    scope_free(hooks->slot);
+    scope_free(hooks);
+    *hooksptr = NULL;
+}
+
+got_list_t *
+gotHooksFind(got_hooks_t *hooks, const char *symbol)
+{
+    if (!hooks || !symbol) return NULL;
+
+    size_t j = gotHash(symbol) & (hooks->num_slots - 1);
+    while (hooks->slot[j]) {
+        if (!scope_strcmp(hooks->slot[j]->symbol, symbol)) return hooks->slot[j];
+        j = (j + 1) & (hooks->num_slots - 1);
+    }
+    return NULL;
+}
+
 /*
- * Find the GOT ptr as defined in RELA/DYNSYM (.rela.dyn) for symbol & hook it.
+ * Find the GOT ptrs as defined in RELA/DYNSYM (.rela.dyn) for the hooked
+ * symbols & hook them.
  * .rela.dyn section:
  * The address of relocation entries associated solely with the PLT.
  * The relocation table's entries have a one-to-one correspondence with the PLT.
+ *
+ * Each relocation is looked up in the hooks, so the object is scanned once
+ * no matter how many hooks there are.  If a filter is given, a hook is only
+ * applied when it returns TRUE.  Page protections come from the maps
+ * snapshot when one is given.  Returns the number of GOT entries updated.
  */
 int
-doGotcha(struct link_map *lm, got_list_t *hook, Elf64_Rela *rel, Elf64_Sym *sym, char *str, int rsz, bool attach)
+doGotcha(struct link_map *lm, got_hooks_t *hooks, Elf64_Rela *rel, Elf64_Sym *sym, char *str, int rsz,
+         bool attach, os_maps_t *maps, got_filter_fn filter, void *filter_data)
 {
-    int i, match = -1;
+    int i, patched = 0;
     uint64_t prev;
 
     for (i = 0; i < rsz / sizeof(Elf64_Rela); i++) {
@@ -178,7 +264,7 @@ doGotcha(struct link_map *lm, got_list_t *hook, Elf64_Rela *rel, Elf64_Sym *sym,
          * sym tab offset (st_name). The index is calculated with the
          * ELF64_R_SYM macro, which shifts the elf value >> 32. The dyn sym
          * tab offset is added to the start of the string table (str) to get
-         * the string name. Compare the str entry with a symbol in the list.
+         * the string name. Look the str entry up in the hooks.
          *
          * Note, it would be nice to check the array bounds before indexing the
          * sym[] table. However, DT_SYMENT gives the byte size of a single entry.
@@ -193,89 +279,95 @@ doGotcha(struct link_map *lm, got_list_t *hook, Elf64_Rela *rel, Elf64_Sym *sym,
          * If this is a symbol we want to interpose, then:
          * .rel.plt -> r.offset + load address -> GOT entry for read
          */
-        if (!scope_strcmp(sym[ELF64_R_SYM(rel[i].r_info)].st_name + str, hook->symbol)) {
-            uint64_t *gaddr = (uint64_t *)(rel[i].r_offset + lm->l_addr);
-            int page_size = scope_getpagesize();
-            size_t saddr = ROUND_DOWN((size_t)gaddr, page_size);
-            int prot = osGetPageProt((uint64_t)gaddr);
-
-            if (prot != -1) {
-                if ((prot & PROT_WRITE) == 0) {
-                    // allow for write permission it write permission are not set
-                    if (osMemPermAllow((void *)saddr, 16, prot, PROT_WRITE) == FALSE) {
-                        scopeLog(CFG_LOG_DEBUG, "doGotcha: osMemPermAllow add write protection flag failed");
-                        return -1;
-                    }
+        got_list_t *hook = gotHooksFind(hooks, sym[ELF64_R_SYM(rel[i].r_info)].st_name + str);
+        if (!hook) continue;
+        if (filter && !filter(hook, filter_data)) continue;
+
+        uint64_t *gaddr = (uint64_t *)(rel[i].r_offset + lm->l_addr);
+        int page_size = scope_getpagesize();
+        size_t saddr = ROUND_DOWN((size_t)gaddr, page_size);
+        int prot = osMapsPageProt(maps, (uint64_t)gaddr);
+
+        if (prot != -1) {
+            if ((prot & PROT_WRITE) == 0) {
+                // allow for write permission it write permission are not set
+                if (osMemPermAllow((void *)saddr, 16, prot, PROT_WRITE) == FALSE) {
+                    scopeLog(CFG_LOG_DEBUG, "doGotcha: osMemPermAllow add write protection flag failed");
+                    continue;
                 }
-            } else {
-                /*
-                 * We don't have a valid protection setting for the GOT page.
-                 * It's "almost assuredly" safe to set perms to RD | WR as this is
-                 * a GOT page; we know what settings are expected. However, it
-                 * may be safest to just bail out at this point.
-                 */
-                return -1;
             }
-
+        } else {
             /*
-             * The offset from the matching relocation entry defines the GOT
-             * entry associated with 'symbol'. ELF docs describe that this
-             * is an offset and not a virtual address. Take the load address
-             * of the shared module as defined in the link map's l_addr + offset.
-             * as in: rel[i].r_offset + lm->l_addr
+             * We don't have a valid protection setting for the GOT page.
+             * It's "almost assuredly" safe to set perms to RD | WR as this is
+             * a GOT page; we know what settings are expected. However, it
+             * may be safest to just skip it.
              */
-            prev = *gaddr;
-            if (attach == TRUE) {
-                // been here before, don't update the GOT entry
-                if ((void *)*gaddr == hook->func) return -1;
-                *gaddr = (uint64_t)hook->func;
+            continue;
+        }
+
+        /*
+         * The offset from the matching relocation entry defines the GOT
+         * entry associated with 'symbol'. ELF docs describe that this
+         * is an offset and not a virtual address. Take the load address
+         * of the shared module as defined in the link map's l_addr + offset.
+         * as in: rel[i].r_offset + lm->l_addr
+         */
+        prev = *gaddr;
+        bool updated = TRUE;
+        if (attach == TRUE) {
+            // been here before, don't update the GOT entry
+            if ((void *)*gaddr == hook->func) {
+                updated = FALSE;
             } else {
-                // handle a detach operation
-                *gaddr = *(uint64_t *)hook->gfn;
+                *gaddr = (uint64_t)hook->func;
             }
+        } else {
+            // handle a detach operation
+            *gaddr = *(uint64_t *)hook->gfn;
+        }
 
+        if (updated) {
             scopeLog(CFG_LOG_DEBUG, "%s:%d sym=%s offset 0x%lx GOT entry %p saddr 0x%lx, prev=0x%lx, curr=%p",
                         __FUNCTION__, __LINE__, hook->symbol, rel[i].r_offset, gaddr, saddr, prev, hook->func);
+            patched++;
+        }
 
-            if ((prot & PROT_WRITE) == 0) {
-                // if we didn't mod above leave prot settings as is
-                if (osMemPermRestore((void *)saddr, 16, prot) == FALSE) {
-                    scopeLog(CFG_LOG_DEBUG, "doGotcha: osMemPermRestore remove write memory protection flags failed");
-                    return -1;
-                }
+        if ((prot & PROT_WRITE) == 0) {
+            // if we didn't mod above leave prot settings as is
+            if (osMemPermRestore((void *)saddr, 16, prot) == FALSE) {
+                scopeLog(CFG_LOG_DEBUG, "doGotcha: osMemPermRestore remove write memory protection flags failed");
             }
-            match = 0;
-            break;
         }
     }
 
-    return match;
+    return patched;
 }
 
 // Locate the needed elf entries from a given link map.
 int
-getElfEntries(struct link_map *lm, Elf64_Rela **rel, Elf64_Sym **sym, char **str, int *rsz)
+getElfEntries(struct link_map *lm, Elf64_Rela **rel, Elf64_Sym **sym, char **str, int *rsz, os_maps_t *maps)
 {
     Elf64_Dyn *dyn = NULL;
     char *got = NULL; // TODO; got is not needed, debug, remove
 
     for (dyn = lm->l_ld; dyn->d_tag != DT_NULL; dyn++) {
         if (dyn->d_tag == DT_SYMTAB) {
-            // Note: using osGetPageProt() to determine if the addr is present in the
+            // Note: using osMapsPageProt() to determine if the addr is present in the
             // process address space. We don't need the prot value.
-            if (osGetPageProt((uint64_t)dyn->d_un.d_ptr) != -1) {
+            if (osMapsPageProt(maps, (uint64_t)dyn->d_un.d_ptr) != -1) {
                 *sym = (Elf64_Sym *)((char *)(dyn->d_un.d_ptr));
             } else {
                 *sym = (Elf64_Sym *)((char *)(dyn->d_un.d_ptr + lm->l_addr));
             }
         } else if (dyn->d_tag == DT_STRTAB) {
-            if (osGetPageProt((uint64_t)dyn->d_un.d_ptr) != -1) {
+            if (osMapsPageProt(maps, (uint64_t)dyn->d_un.d_ptr) != -1) {
                 *str = (char *)(dyn->d_un.d_ptr);
             } else {
                 *str = (char *)(dyn->d_un.d_ptr + lm->l_addr);
             }
         } else if (dyn->d_tag == DT_JMPREL) {
-            if (osGetPageProt((uint64_t)dyn->d_un.d_ptr) != -1) {
+            if (osMapsPageProt(maps, (uint64_t)dyn->d_un.d_ptr) != -1) {
                 *rel = (Elf64_Rela *)((char *)(dyn->d_un.d_ptr));
             } else {
                 *rel = (Elf64_Rela *)((char *)(dyn->d_un.d_ptr + lm->l_addr));
@@ -283,7 +375,7 @@ getElfEntries(struct link_map *lm, Elf64_Rela **rel, Elf64_Sym **sym, char **str
         } else if (dyn->d_tag == DT_PLTRELSZ) {
             *rsz = dyn->d_un.d_val;
         } else if (dyn->d_tag == DT_PLTGOT) {
-            if (osGetPageProt((uint64_t)dyn->d_un.d_ptr) != -1) {
+            if (osMapsPageProt(maps, (uint64_t)dyn->d_un.d_ptr) != -1) {
                 got = (char *)(dyn->d_un.d_ptr);
             } else {
                 got = (char *)(dyn->d_un.d_ptr + lm->l_addr);
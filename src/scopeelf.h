@@ -5,6 +5,7 @@
 
 #include <elf.h>
 #include <link.h>
+#include "os.h"
 
 typedef struct {
     const char *symbol;
@@ -12,6 +13,12 @@ typedef struct {
     void *gfn;
 } got_list_t;
 
+// got_list_t entries indexed by symbol
+typedef struct _got_hooks_t got_hooks_t;
+
+// Returns TRUE if the hook should be applied
+typedef bool (*got_filter_fn)(got_list_t *, void *);
+
 typedef struct {
     char *cmd;
     char *buf;
@@ -22,8 +29,12 @@ typedef struct {
 
 void freeElf(char *, size_t);
 elf_buf_t * getElf(char *);
-int doGotcha(struct link_map *, got_list_t *, Elf64_Rela *, Elf64_Sym *, char *, int, bool);
-int getElfEntries(struct link_map *, Elf64_Rela **, Elf64_Sym **, char **, int *rsz);
+got_hooks_t *gotHooksCreate(got_list_t *);
+void gotHooksDestroy(got_hooks_t **);
+got_list_t *gotHooksFind(got_hooks_t *, const char *);
+int doGotcha(struct link_map *, got_hooks_t *, Elf64_Rela *, Elf64_Sym *, char *, int, bool,
+             os_maps_t *, got_filter_fn, void *);
+int getElfEntries(struct link_map *, Elf64_Rela **, Elf64_Sym **, char **, int *rsz, os_maps_t *);
 Elf64_Shdr* getElfSection(char *, const char *);
 void * getSymbol(const char *, char *);
 void * getDynSymbol(const char *, char *);
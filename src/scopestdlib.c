@@ -27,6 +27,7 @@ extern FILE *  scopelibc_open_memstream(char **, size_t *);
 extern void *  scopelibc_memset(void *, int, size_t);
 extern void *  scopelibc_memmove(void *, const void *, size_t);
 extern int     scopelibc_memcmp(const void *, const void *, size_t);
+extern void *  scopelibc_memchr(const void *, int, size_t);
 extern int     scopelibc_mprotect(void *, size_t, int);
 extern void *  scopelibc_memcpy(void *, const void *, size_t);
 extern int     scopelibc_mlock(const void *, size_t);
@@ -222,6 +223,13 @@ extern int             scopelibc_mq_send(mqd_t, const char *, size_t, unsigned i
 extern ssize_t         scopelibc_mq_receive(mqd_t, char *, size_t, unsigned int *);
 extern int             scopelibc_mq_unlink(const char *);
 extern int             scopelibc_mq_getattr(mqd_t, struct mq_attr *);
+extern int             scopelibc_epoll_create1(int);
+extern int             scopelibc_epoll_ctl(int, int, int, struct epoll_event *);
+extern int             scopelibc_epoll_wait(int, struct epoll_event *, int, int);
+extern int             scopelibc_eventfd(unsigned int, int);
+extern int             scopelibc_inotify_init1(int);
+extern int             scopelibc_inotify_add_watch(int, const char *, uint32_t);
+extern int             scopelibc_statfs(const char *, struct statfs *);
 
 static int g_go_static;
 
@@ -324,6 +332,11 @@ scope_memcmp(const void *s1, const void *s2, size_t n) {
     return scopelibc_memcmp(s1, s2, n);
 }
 
+void *
+scope_memchr(const void *s, int c, size_t n) {
+    return scopelibc_memchr(s, c, n);
+}
+
 int
 scope_mprotect(void *addr, size_t len, int prot) {
     return scopelibc_mprotect(addr, len, prot);
@@ -1311,6 +1324,41 @@ scope_mq_getattr(mqd_t mqd, struct mq_attr *attr) {
     return scopelibc_mq_getattr(mqd, attr);
 }
 
+int
+scope_epoll_create1(int flags) {
+    return scopelibc_epoll_create1(flags);
+}
+
+int
+scope_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+    return scopelibc_epoll_ctl(epfd, op, fd, event);
+}
+
+int
+scope_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+    return scopelibc_epoll_wait(epfd, events, maxevents, timeout);
+}
+
+int
+scope_eventfd(unsigned int initval, int flags) {
+    return scopelibc_eventfd(initval, flags);
+}
+
+int
+scope_inotify_init1(int flags) {
+    return scopelibc_inotify_init1(flags);
+}
+
+int
+scope_inotify_add_watch(int fd, const char *pathname, uint32_t mask) {
+    return scopelibc_inotify_add_watch(fd, pathname, mask);
+}
+
+int
+scope_statfs(const char *path, struct statfs *buf) {
+    return scopelibc_statfs(path, buf);
+}
+
 char *
 scope_secure_getenv(const char *name) {
     return getenv(name);
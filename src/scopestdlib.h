@@ -8,6 +8,9 @@
 #include <link.h>
 #include <locale.h>
 #include <sys/auxv.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
@@ -17,6 +20,7 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
+#include <sys/vfs.h>
 #include <mqueue.h>
 #include <netdb.h>
 #include <poll.h>
@@ -121,6 +125,7 @@ FILE* scope_open_memstream(char **, size_t *);
 void* scope_memset(void *, int, size_t);
 void* scope_memmove(void *, const void *, size_t);
 int   scope_memcmp(const void *, const void *, size_t);
+void* scope_memchr(const void *, int, size_t);
 int   scope_mprotect(void *, size_t, int);
 void* scope_memcpy(void *, const void *, size_t);
 int   scope_mlock(const void *, size_t);
@@ -315,6 +320,13 @@ int           scope_mq_send(mqd_t, const char *, size_t, unsigned int);
 ssize_t       scope_mq_receive(mqd_t, char *, size_t, unsigned int *);
 int           scope_mq_unlink(const char *);
 int           scope_mq_getattr(mqd_t, struct mq_attr *);
+int           scope_epoll_create1(int);
+int           scope_epoll_ctl(int, int, int, struct epoll_event *);
+int           scope_epoll_wait(int, struct epoll_event *, int, int);
+int           scope_eventfd(unsigned int, int);
+int           scope_inotify_init1(int);
+int           scope_inotify_add_watch(int, const char *, uint32_t);
+int           scope_statfs(const char *, struct statfs *);
 
 
 #endif // __SCOPE_STDLIB_H__
@@ -14,14 +14,16 @@
 typedef enum {CFG_FMT_STATSD,
               CFG_FMT_NDJSON,
               CFG_FMT_PROMETHEUS,
+              CFG_FMT_BINARY,   // events only
               CFG_FORMAT_MAX} cfg_mtc_format_t;
 #else
 typedef enum {CFG_FMT_STATSD,
               CFG_FMT_NDJSON,
+              CFG_FMT_BINARY,   // events only
               CFG_FORMAT_MAX} cfg_mtc_format_t;
 #endif
 
-typedef enum {CFG_UDP, CFG_UNIX, CFG_FILE, CFG_TCP, CFG_EDGE} cfg_transport_t;
+typedef enum {CFG_UDP, CFG_UNIX, CFG_FILE, CFG_TCP, CFG_EDGE, CFG_SHM} cfg_transport_t;
 typedef enum {CFG_MTC, CFG_CTL, CFG_LOG, CFG_LS, CFG_WHICH_MAX} which_transport_t;
 typedef enum {CFG_LOG_TRACE,
               CFG_LOG_DEBUG,
@@ -30,6 +32,7 @@ typedef enum {CFG_LOG_TRACE,
               CFG_LOG_ERROR,
               CFG_LOG_NONE} cfg_log_level_t;
 typedef enum {CFG_BUFFER_FULLY, CFG_BUFFER_LINE} cfg_buffer_t;
+typedef enum {CFG_COMPRESS_NONE, CFG_COMPRESS_ZSTD} cfg_compress_t;
 typedef enum {CFG_SRC_FILE,
               CFG_SRC_CONSOLE,
               CFG_SRC_SYSLOG,
@@ -160,6 +163,9 @@ typedef struct
 #define DEFAULT_PAYLOAD_ENABLE FALSE
 #define DEFAULT_PAYLOAD_DIR "/tmp"
 #define DEFAULT_PAYLOAD_DIR_REPR "dir:///tmp"
+#define DEFAULT_SPILL_DIR NULL
+#define DEFAULT_SPILL_MAXSIZE (64 * 1024 * 1024)
+#define DEFAULT_SPILL_DRAINRATE (1024 * 1024)
 
 #define DEFAULT_MTC_TYPE CFG_UDP
 #define DEFAULT_MTC_HOST "127.0.0.1"
@@ -184,6 +190,7 @@ typedef struct
 #define DEFAULT_TLS_ENABLE FALSE
 #define DEFAULT_TLS_VALIDATE_SERVER TRUE
 #define DEFAULT_TLS_CA_CERT NULL
+#define DEFAULT_COMPRESS CFG_COMPRESS_NONE
 
 #define DEFAULT_LOGSTREAM_ENABLE TRUE
 #define DEFAULT_LOGSTREAM_CLOUD  FALSE
@@ -226,6 +233,7 @@ typedef struct
 //    SCOPE_QUEUE_LENGTH             override default circular buffer sizes
 //    SCOPE_START_NOPROFILE          cause the start command to ignore updates to /etc/profile.d
 //    SCOPE_START_FORCE_PROFILE      force the start command to update profile.d with a dev version
+//    SCOPE_JAVA_CLASSES             comma separated Java classes to instrument (default is all we know)
 //    CRIBL_EDGE_FS_ROOT             define the location of the host root path inside the Cribl Edge container
 #define SCOPE_PID_ENV "SCOPE_PID"
 #define PRESERVE_PERF_REPORTING "SCOPE_PERF_PRESERVE"
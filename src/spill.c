@@ -0,0 +1,380 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "atomic.h"
+#include "dbg.h"
+#include "scopestdlib.h"
+#include "spill.h"
+#include "transport.h"
+
+// The queue is split into this many segments, so that making room drops
+// no more than this fraction of it at once.
+#define SPILL_SEGMENTS (8)
+#define SPILL_TEMPLATE "scope_spill.XXXXXX"
+
+// Each message is written after its length
+typedef uint32_t record_len_t;
+
+typedef struct _segment_t
+{
+    int fd;                     // until it's sealed
+    char *map;                  // once it's sealed
+    size_t len;                 // bytes written, lengths included
+    size_t off;                 // bytes replayed, lengths included
+    size_t data;                // message bytes not yet replayed
+    struct _segment_t *next;
+} segment_t;
+
+struct _spill_t
+{
+    char *dir;
+    size_t maxsize;
+    size_t segsize;
+    size_t drainrate;           // bytes per second, or 0 for no limit
+
+    // Appended by any thread, under guard
+    uint64_t guard;
+    segment_t *head;            // oldest
+    segment_t *tail;            // appended to, unless it's been sealed
+    segment_t *replaying;       // not to be dropped to make room
+    size_t size;                // bytes in the files not yet replayed
+
+    // Only used by the thread that holds draining
+    uint64_t draining;
+    double budget;              // bytes that can be replayed now
+    struct timespec last;
+
+    spill_stats_t stats;
+};
+
+spill_t *
+spillCreate(const char *dir, size_t maxsize, size_t drainrate)
+{
+    if (!dir || (dir[0] == '\0') || !maxsize) return NULL;
+
+    spill_t *s = scope_calloc(1, sizeof(spill_t));
+    if (!s) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    s->dir = scope_strdup(dir);
+    if (!s->dir) {
+        DBG(NULL);
+        scope_free(s);
+        return NULL;
+    }
+    s->maxsize = maxsize;
+    s->segsize = (maxsize / SPILL_SEGMENTS) ? maxsize / SPILL_SEGMENTS : 1;
+    s->drainrate = drainrate;
+
+    return s;
+}
+
+static segment_t *
+segmentCreate(spill_t *s)
+{
+    char path[PATH_MAX];
+    int len = scope_snprintf(path, sizeof(path), "%s/" SPILL_TEMPLATE, s->dir);
+    if ((len < 0) || (len >= sizeof(path))) {
+        DBG("%s", s->dir);
+        return NULL;
+    }
+
+    int fd = scope_mkstemp(path);
+    if (fd == -1) {
+        DBG("%s", path);
+        return NULL;
+    }
+
+    // Nothing is left behind, however the process ends
+    scope_unlink(path);
+
+    segment_t *seg = scope_calloc(1, sizeof(segment_t));
+    if (!seg) {
+        DBG(NULL);
+        scope_close(fd);
+        return NULL;
+    }
+
+    seg->fd = transportPlaceDescriptor(fd);
+    if (seg->fd == -1) {
+        scope_free(seg);
+        return NULL;
+    }
+    return seg;
+}
+
+static void
+segmentDestroy(segment_t *seg)
+{
+    if (seg->fd != -1) scope_close(seg->fd);
+    if (seg->map) scope_munmap(seg->map, seg->len);
+    scope_free(seg);
+}
+
+// Nothing more is appended to a sealed segment; it's mapped to be replayed.
+// Called under guard.
+static void
+segmentSeal(spill_t *s, segment_t *seg)
+{
+    if (seg->fd == -1) return;
+
+    if (seg->len) {
+        void *map = scope_mmap(NULL, seg->len, PROT_READ, MAP_PRIVATE, seg->fd, 0);
+        if (map == MAP_FAILED) {
+            DBG(NULL);
+            s->stats.dropped += seg->data;
+            s->stats.pending -= seg->data;
+            s->size -= seg->len;
+            seg->len = seg->data = 0;
+        } else {
+            seg->map = map;
+        }
+    }
+
+    scope_close(seg->fd);
+    seg->fd = -1;
+}
+
+// Called under guard
+static void
+segmentRemove(spill_t *s, segment_t *seg)
+{
+    segment_t *prev = NULL;
+    segment_t *cur;
+    for (cur = s->head; cur && (cur != seg); cur = cur->next) {
+        prev = cur;
+    }
+    if (!cur) return;
+
+    if (prev) {
+        prev->next = seg->next;
+    } else {
+        s->head = seg->next;
+    }
+    if (s->tail == seg) s->tail = prev;
+
+    s->stats.pending -= seg->data;
+    s->size -= seg->len - seg->off;
+}
+
+// Drops the oldest segments until what's needed fits, sparing the one
+// that's being replayed.  Called under guard.
+static bool
+makeRoom(spill_t *s, size_t needed)
+{
+    while (s->size + needed > s->maxsize) {
+        segment_t *oldest = s->head;
+        if (oldest && (oldest == s->replaying)) oldest = oldest->next;
+        if (!oldest) return FALSE;
+
+        s->stats.dropped += oldest->data;
+        segmentRemove(s, oldest);
+        segmentDestroy(oldest);
+    }
+    return TRUE;
+}
+
+static int
+writeAll(int fd, const void *buf, size_t len)
+{
+    const char *pos = buf;
+    while (len) {
+        ssize_t rc = scope_write(fd, pos, len);
+        if (rc == -1) {
+            if (scope_errno == EINTR) continue;
+            return -1;
+        }
+        pos += rc;
+        len -= rc;
+    }
+    return 0;
+}
+
+int
+spillAppend(spill_t *s, const char *msg, size_t len)
+{
+    if (!s || !msg) return -1;
+    if (!len) return 0;
+
+    record_len_t rlen = len;
+    size_t needed = sizeof(rlen) + len;
+
+    int rc = -1;
+    while (!atomicCasU64(&s->guard, 0ULL, 1ULL));
+
+    if ((len > UINT32_MAX) || (needed > s->maxsize)) goto drop;
+    if (!makeRoom(s, needed)) goto drop;
+
+    // A new segment when the last was sealed, or this would overfill it
+    segment_t *seg = s->tail;
+    if (!seg || (seg->fd == -1) ||
+        (seg->len && (seg->len + needed > s->segsize))) {
+        if (seg) segmentSeal(s, seg);
+        if (!(seg = segmentCreate(s))) goto drop;
+
+        if (s->tail) {
+            s->tail->next = seg;
+        } else {
+            s->head = seg;
+        }
+        s->tail = seg;
+    }
+
+    if (writeAll(seg->fd, &rlen, sizeof(rlen)) || writeAll(seg->fd, msg, len)) {
+        // Whatever part of it was written is past len, where it won't be read
+        DBG("%d", scope_errno);
+        segmentSeal(s, seg);
+        goto drop;
+    }
+
+    seg->len += needed;
+    seg->data += len;
+    s->size += needed;
+    s->stats.pending += len;
+    s->stats.spilled += len;
+    rc = 0;
+    goto out;
+
+drop:
+    s->stats.dropped += len;
+out:
+    atomicStoreU64(&s->guard, 0ULL);
+    return rc;
+}
+
+// Adds to the budget for the time since the last drain, up to a second's worth
+static void
+refillBudget(spill_t *s)
+{
+    if (!s->drainrate) return;
+
+    struct timespec now;
+    if (scope_clock_gettime(CLOCK_MONOTONIC, &now)) {
+        DBG(NULL);
+        return;
+    }
+
+    if (!s->last.tv_sec && !s->last.tv_nsec) {
+        s->budget = s->drainrate;
+    } else {
+        double elapsed = (double)(now.tv_sec - s->last.tv_sec) +
+                         (double)(now.tv_nsec - s->last.tv_nsec) / 1e9;
+        s->budget += elapsed * s->drainrate;
+        if (s->budget > s->drainrate) s->budget = s->drainrate;
+    }
+    s->last = now;
+}
+
+int
+spillDrain(spill_t *s, spill_send_fn send, void *arg)
+{
+    if (!s || !send) return -1;
+
+    // Someone else is already at it
+    if (!atomicCasU64(&s->draining, 0ULL, 1ULL)) return 0;
+
+    refillBudget(s);
+
+    int rc = 0;
+    while (!s->drainrate || (s->budget > 0)) {
+        while (!atomicCasU64(&s->guard, 0ULL, 1ULL));
+        segment_t *seg = s->head;
+        if (seg && (seg->fd != -1)) {
+            // Appends go to a new segment from here on
+            if (seg->len) {
+                segmentSeal(s, seg);
+            } else {
+                seg = NULL;
+            }
+        }
+        s->replaying = seg;
+        atomicStoreU64(&s->guard, 0ULL);
+        if (!seg) break;
+
+        // A message can take the budget below zero; it's made up next time
+        while ((seg->off < seg->len) && (!s->drainrate || (s->budget > 0))) {
+            record_len_t len;
+            scope_memcpy(&len, seg->map + seg->off, sizeof(len));
+            if (send(arg, seg->map + seg->off + sizeof(len), len)) {
+                rc = -1;
+                break;
+            }
+            s->budget -= len;
+
+            while (!atomicCasU64(&s->guard, 0ULL, 1ULL));
+            seg->off += sizeof(len) + len;
+            seg->data -= len;
+            s->size -= sizeof(len) + len;
+            s->stats.pending -= len;
+            s->stats.replayed += len;
+            atomicStoreU64(&s->guard, 0ULL);
+        }
+
+        while (!atomicCasU64(&s->guard, 0ULL, 1ULL));
+        s->replaying = NULL;
+        bool done = (seg->off == seg->len);
+        if (done) {
+            segmentRemove(s, seg);
+            segmentDestroy(seg);
+        }
+        atomicStoreU64(&s->guard, 0ULL);
+
+        if (rc || !done) break;
+    }
+
+    atomicStoreU64(&s->draining, 0ULL);
+    return rc;
+}
+
+bool
+spillEmpty(spill_t *s)
+{
+    return (s) ? (atomicLoadU64(&s->stats.pending) == 0) : TRUE;
+}
+
+void
+spillReset(spill_t *s)
+{
+    if (!s) return;
+
+    while (!atomicCasU64(&s->guard, 0ULL, 1ULL));
+    while (s->head) {
+        segment_t *seg = s->head;
+        s->head = seg->next;
+        segmentDestroy(seg);
+    }
+    s->tail = s->replaying = NULL;
+    s->size = 0;
+    s->stats.pending = 0;
+    atomicStoreU64(&s->guard, 0ULL);
+}
+
+void
+spillDestroy(spill_t **spill)
+{
+    if (!spill || !*spill) return;
+    spill_t *s = *spill;
+
+    spillReset(s);
+    scope_free(s->dir);
+    scope_free(s);
+    *spill = NULL;
+}
+
+spill_stats_t
+spillStats(spill_t *s)
+{
+    spill_stats_t stats = {0};
+    if (!s) return stats;
+
+    stats.spilled = atomicLoadU64(&s->stats.spilled);
+    stats.replayed = atomicLoadU64(&s->stats.replayed);
+    stats.dropped = atomicLoadU64(&s->stats.dropped);
+    stats.pending = atomicLoadU64(&s->stats.pending);
+    return stats;
+}
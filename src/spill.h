@@ -0,0 +1,40 @@
+#ifndef __SPILL_H__
+#define __SPILL_H__
+#include <stddef.h>
+#include <stdint.h>
+#include "scopetypes.h"
+
+// A bounded, disk-backed queue of messages that couldn't be sent over a
+// transport (event > spill).  Messages are appended, as they'd have been
+// sent, to segment files in the configured directory.  The files are
+// unlinked as soon as they're created, so nothing is left behind when the
+// process goes away.  When the queue would be over its maximum size, the
+// oldest segment is dropped to make room.
+//
+// spillDrain() replays messages, oldest first, from a sealed segment
+// that's been mmapped, at no more than the configured rate.  A message that
+// can't be sent stays where it is for the next drain.
+
+typedef struct _spill_t spill_t;
+
+typedef int (*spill_send_fn)(void *, const char *, size_t);
+
+typedef struct {
+    uint64_t spilled;   // bytes appended
+    uint64_t replayed;  // bytes sent by spillDrain()
+    uint64_t dropped;   // bytes dropped, when full or when a write failed
+    uint64_t pending;   // bytes waiting to be replayed
+} spill_stats_t;
+
+// Constructors Destructors
+spill_t *           spillCreate(const char *, size_t, size_t); // dir, maxsize, drainrate
+void                spillDestroy(spill_t **);
+
+// Accessors
+int                 spillAppend(spill_t *, const char *, size_t);
+int                 spillDrain(spill_t *, spill_send_fn, void *);
+bool                spillEmpty(spill_t *);
+void                spillReset(spill_t *);
+spill_stats_t       spillStats(spill_t *);
+
+#endif // __SPILL_H__
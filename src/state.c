@@ -15,6 +15,7 @@
 #include "com.h"
 #include "dbg.h"
 #include "dns.h"
+#include "epoch.h"
 #include "evtutils.h"
 #include "httpstate.h"
 #include "metriccapture.h"
@@ -52,9 +53,12 @@ static protocol_def_t *g_tls_protocol_def = NULL;
 static protocol_def_t *g_http_protocol_def = NULL;
 static protocol_def_t *g_statsd_protocol_def = NULL;
 
-// Linked list, indexed by channel ID, of net_info pointers used in
-// doProtocol() when it's not provided with a valid file descriptor.
-list_t *g_extra_net_info_list = NULL;
+// Table, indexed by channel ID, of the net_info used in doProtocol()
+// when it's not provided with a valid file descriptor.
+chantab_t *g_channel_net_info = NULL;
+
+// Answers to DNS lookups, so that repeats can be reported per period
+dns_cache_t *g_dns_cache = NULL;
 
 #define DATA_FIELD(val)         STRFIELD("data",           (val),        1)
 #define UNIT_FIELD(val)         STRFIELD("unit",           (val),        1)
@@ -85,16 +89,10 @@ payloadToDiskForced(void)
     return g_force_payloads_to_disk;
 }
 
-
 static void
-destroyNetInfo(void *data)
+resetChannel(net_info *net)
 {
-    if (!data) return;
-    net_info *net = (net_info *)data;
-
     resetHttp(net->http);
-
-    scope_free(net);
 }
 
 int
@@ -182,7 +180,7 @@ addProtocol(request_t *req)
 
     proto = req->protocol;
 
-    proto->re = pcre2_compile((PCRE2_SPTR)proto->regex, PCRE2_ZERO_TERMINATED,
+    proto->re = pcre2_compile_wrapper((PCRE2_SPTR)proto->regex, PCRE2_ZERO_TERMINATED,
                               0, &errornumber, &erroroffset, NULL);
 
     if (proto->re == NULL) {
@@ -215,7 +213,7 @@ initPayloadDetect(void)
     g_tls_protocol_def->binary = TRUE;
     g_tls_protocol_def->len = PAYLOAD_BYTESRC;
     g_tls_protocol_def->regex = PAYLOAD_REGEX;
-    g_tls_protocol_def->re = pcre2_compile((PCRE2_SPTR)g_tls_protocol_def->regex,
+    g_tls_protocol_def->re = pcre2_compile_wrapper((PCRE2_SPTR)g_tls_protocol_def->regex,
                                            PCRE2_ZERO_TERMINATED, 0,
                                            &errornumber, &erroroffset, NULL);
     if (g_tls_protocol_def->re == NULL) {
@@ -233,7 +231,7 @@ initPayloadDetect(void)
     g_http_protocol_def->protname = "HTTP";
     g_http_protocol_def->regex = "(?:HTTP\\/1\\.[0-2]|PRI \\* HTTP\\/2\\.0\r\n\r\nSM\r\n\r\n)";
     g_http_protocol_def->detect = TRUE;
-    g_http_protocol_def->re = pcre2_compile((PCRE2_SPTR)g_http_protocol_def->regex,
+    g_http_protocol_def->re = pcre2_compile_wrapper((PCRE2_SPTR)g_http_protocol_def->regex,
                                             PCRE2_ZERO_TERMINATED, 0,
                                             &errornumber, &erroroffset, NULL);
     if (g_http_protocol_def->re == NULL) {
@@ -251,7 +249,7 @@ initPayloadDetect(void)
     g_statsd_protocol_def->protname = "STATSD";
     g_statsd_protocol_def->regex = "^([^:]+):([\\d.]+)\\|(c|g|ms|s|h)";
     g_statsd_protocol_def->detect = TRUE;
-    g_statsd_protocol_def->re = pcre2_compile((PCRE2_SPTR)g_statsd_protocol_def->regex,
+    g_statsd_protocol_def->re = pcre2_compile_wrapper((PCRE2_SPTR)g_statsd_protocol_def->regex,
                                             PCRE2_ZERO_TERMINATED, 0,
                                             &errornumber, &erroroffset, NULL);
     if (g_statsd_protocol_def->re == NULL) {
@@ -328,7 +326,8 @@ initState(void)
     g_protlist = lstCreate(destroyProtEntry);
     initPayloadDetect();
 
-    g_extra_net_info_list = lstCreate(destroyNetInfo);
+    g_channel_net_info = chanTabCreate(CHANNEL_ENTRIES, CHANNEL_MAX_IDLE, resetChannel);
+    g_dns_cache = dnsCacheCreate(DNS_CACHE_ENTRIES);
 
     initReporting();
 }
@@ -339,10 +338,23 @@ resetState(void)
     scope_memset(&g_ctrs, 0, sizeof(struct metric_counters_t));
 }
 
+static void
+logChannelStats(void)
+{
+    chantab_stats_t stats;
+    chanTabStats(g_channel_net_info, &stats);
+    if (!stats.lookups) return;
+    scopeLogInfo("TLS channels: %lu lookups, %lu thread cache hits, %lu table hits, %lu inserts, %lu evictions, %lu full, %lu reclaims",
+                 stats.lookups, stats.cacheHits, stats.hits, stats.inserts, stats.evictions,
+                 stats.full, stats.reclaims);
+}
+
 void
 destroyState(void) {
     destroyReporting();
-    lstDestroy(&g_extra_net_info_list);
+    logChannelStats();
+    chanTabDestroy(&g_channel_net_info);
+    dnsCacheDestroy(&g_dns_cache);
     destroyPayloadDetect();
     lstDestroy(&g_protlist);
     destroyMetricCapture();
@@ -405,6 +417,8 @@ doUnixEndpoint(int sd, net_info *net)
 static int
 postStatErrState(metric_t stat_err, metric_t type, const char *funcop, const char *pathname)
 {
+    EPOCH_SECTION();
+
     // something passed in a param that is not a viable address; ltp does this
     if ((scopeGetGoAppStateStatic() == FALSE) && (stat_err == EVT_ERR) && (errno == EFAULT)) return FALSE;
 
@@ -462,6 +476,8 @@ postStatErrState(metric_t stat_err, metric_t type, const char *funcop, const cha
 static int
 postFSState(int fd, metric_t type, fs_info *fs, const char *funcop, const char *pathname)
 {
+    EPOCH_SECTION();
+
     int *summarize = NULL;
     switch (type) {
         case FS_READ:
@@ -514,13 +530,22 @@ postFSState(int fd, metric_t type, fs_info *fs, const char *funcop, const char *
 static int
 postDNSState(int fd, metric_t type, net_info *net, uint64_t duration, const char *domain)
 {
+    EPOCH_SECTION();
+
     // Bail if we don't need to post
     int mtc_needs_reporting = !g_summary.net.dns;
     int need_to_post =
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC) ||
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_DNS) ||
         (mtcEnabled(g_mtc) && mtc_needs_reporting);
-    if (!need_to_post) return FALSE;
+    if (!need_to_post) {
+        // nothing will report the answer
+        if (net && net->dnsAnswer) {
+            cJSON_Delete(net->dnsAnswer);
+            net->dnsAnswer = NULL;
+        }
+        return FALSE;
+    }
 
     size_t len = sizeof(struct net_info_t);
     net_info *netp = scope_calloc(1, len);
@@ -549,6 +574,8 @@ postDNSState(int fd, metric_t type, net_info *net, uint64_t duration, const char
 static int
 postNetState(int fd, metric_t type, net_info *net)
 {
+    EPOCH_SECTION();
+
     int *summarize = NULL;
     switch (type) {
         case OPEN_PORTS:
@@ -596,6 +623,8 @@ postNetState(int fd, metric_t type, net_info *net)
 void
 doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const char *pathname)
 {
+    EPOCH_SECTION();
+
     switch (type) {
     case OPEN_PORTS:
     {
@@ -961,6 +990,8 @@ isProtocolSet(int fd)
 static bool
 setProtocol(int sockfd, protocol_def_t *protoDef, net_info *net, char *buf, size_t len)
 {
+    EPOCH_SECTION();
+
     char *data, *cpdata = NULL;
     pcre2_match_data *match_data;
     protocol_info *proto;
@@ -1003,7 +1034,7 @@ setProtocol(int sockfd, protocol_def_t *protoDef, net_info *net, char *buf, size
         cvlen = cvlen * 2;
     }
 
-    match_data = pcre2_match_data_create_from_pattern(protoDef->re, NULL);
+    match_data = pcreMatchDataGet(protoDef->re);
     if (pcre2_match_wrapper(protoDef->re, (PCRE2_SPTR)data, (PCRE2_SIZE)cvlen, 0, 0,
                             match_data, NULL) > 0) {
         scopeLog(CFG_LOG_DEBUG, "fd:%d detected %s", sockfd, protoDef->protname);
@@ -1019,7 +1050,7 @@ setProtocol(int sockfd, protocol_def_t *protoDef, net_info *net, char *buf, size
                 if (cpdata)
                     scope_free(cpdata);
                 if (match_data)
-                    pcre2_match_data_free(match_data);
+                    pcreMatchDataPut(match_data);
                 return FALSE;
             }
             proto->len = sizeof(protocol_def_t);
@@ -1034,7 +1065,7 @@ setProtocol(int sockfd, protocol_def_t *protoDef, net_info *net, char *buf, size
         if (net) net->protoDetect = DETECT_FALSE;
     }
 
-    if (match_data) pcre2_match_data_free(match_data);
+    if (match_data) pcreMatchDataPut(match_data);
     if (cpdata) scope_free(cpdata);
 
     return ret;
@@ -1081,6 +1112,8 @@ setProtocolByType(int sockfd, protocol_def_t *protoDef, net_info *net, char *buf
 static int
 extractPayload(int sockfd, net_info *net, void *buf, size_t len, metric_t src, src_data_t dtype)
 {
+    EPOCH_SECTION();
+
     if (!buf || (len <= 0)) {
         DBG(NULL); // why would we ever get here?
         return -1;
@@ -1208,7 +1241,7 @@ detectTLS(int sockfd, net_info *net, void *buf, size_t len, metric_t src, src_da
     }
 
     // Apply the regex to the hex-string payload
-    pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(tls_proto_def->re, NULL);
+    pcre2_match_data *match_data = pcreMatchDataGet(tls_proto_def->re);
     if ((rc = pcre2_match_wrapper(tls_proto_def->re, (PCRE2_SPTR)cpdata,
                                   (PCRE2_SIZE)alen, 0, 0,
                                   match_data, NULL)) > 0)
@@ -1231,7 +1264,7 @@ detectTLS(int sockfd, net_info *net, void *buf, size_t len, metric_t src, src_da
             scopeLog(CFG_LOG_DEBUG, "%s: fd:%d TLS regex failed", __FUNCTION__, sockfd);
         }
     }
-    pcre2_match_data_free(match_data);
+    pcreMatchDataPut(match_data);
 }
 
 static void
@@ -1272,42 +1305,23 @@ detectProtocol(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
 
 // Alternative to getNetEntry() that returns a net_info for the given channel
 // ID instead of for a socket descriptor. We fallback to using this when we
-// can't get the descriptor in TLS/SSL read/write operations.
+// can't get the descriptor in TLS/SSL read/write operations.  The net_info
+// is pinned until it's given back with putChannelNetEntry().
 static net_info *
 getChannelNetEntry(uint64_t id)
 {
-    net_info *net = lstFind(g_extra_net_info_list, id);
-    if (!net) {
-        net = scope_calloc(1, sizeof(net_info));
-        if (!net) {
-            scopeLogError("ERROR: failed to allocate channel's net_info");
-            DBG(NULL);
-        } else {
-            if (lstInsert(g_extra_net_info_list, id, net) != TRUE) {
-                scope_free(net);
-                net = NULL;
-                scopeLogError("ERROR: failed to save channel's net_info");
-                DBG(NULL);
-            } else {
-                // populate the new net_info
-                net->active = TRUE;
-                net->type = SOCK_STREAM; // assumption needed for doHttp()
-                //net->localConn.ss_family = ???;
-                net->uid = id;
-            }
-        }
-    }
-    return net;
+    return chanTabGet(g_channel_net_info, id);
 }
 
-bool
-doProtocol(uint64_t id, int sockfd, void *buf, size_t len, metric_t src, src_data_t dtype)
+static void
+putChannelNetEntry(net_info *net)
 {
-    // Find the net_info for the channel
-    net_info *net = getNetEntry(sockfd);    // first try by descriptor
-    if (!net) net = getChannelNetEntry(id); // fallback to using channel ID
-    if (!net) return FALSE;
+    chanTabPut(g_channel_net_info, net);
+}
 
+static bool
+doProtocolNet(net_info *net, uint64_t id, int sockfd, void *buf, size_t len, metric_t src, src_data_t dtype)
+{
     scopeLogHexDebug(buf, len > 64 ? 64 : len, // limit hexdump to 64
             "DEBUG: doProtocol(id=%ld, fd=%d, len=%ld, src=%s, dtyp=%s) TLS=%s PROTO=%s",
             id, sockfd, len,
@@ -1373,6 +1387,20 @@ doProtocol(uint64_t id, int sockfd, void *buf, size_t len, metric_t src, src_dat
     return TRUE;
 }
 
+bool
+doProtocol(uint64_t id, int sockfd, void *buf, size_t len, metric_t src, src_data_t dtype)
+{
+    // Find the net_info for the channel
+    net_info *net = getNetEntry(sockfd);    // first try by descriptor
+    if (net) return doProtocolNet(net, id, sockfd, buf, len, src, dtype);
+
+    net = getChannelNetEntry(id);           // fallback to using channel ID
+    if (!net) return FALSE;
+    bool ret = doProtocolNet(net, id, sockfd, buf, len, src, dtype);
+    putChannelNetEntry(net);
+    return ret;
+}
+
 void
 setVerbosity(unsigned verbosity)
 {
@@ -1607,6 +1635,8 @@ doSetConnection(int sd, const struct sockaddr *addr, socklen_t len, control_type
 int
 doSetAddrs(int sockfd)
 {
+    EPOCH_SECTION();
+
     struct sockaddr_storage addr;
     socklen_t addrlen = sizeof(struct sockaddr_storage);
     net_info *net;
@@ -1708,6 +1738,21 @@ isLegalLabelChar(char x)
     return 0;
 }
 
+/*
+ * DNS over TCP puts the length of each message in front of it (RFC 1035
+ * 4.2.2).  Returns where the message starts in buf, and its length in len.
+ */
+static const char *
+dnsMessage(net_info *net, const char *buf, size_t *len)
+{
+    if ((net->type == SOCK_STREAM) && (*len > 2) &&
+        ((((unsigned char)buf[0] << 8) | (unsigned char)buf[1]) == *len - 2)) {
+        *len -= 2;
+        return buf + 2;
+    }
+    return buf;
+}
+
 /*
  * Dereference a DNS packet and
  * extract the domain name.
@@ -1725,11 +1770,8 @@ isLegalLabelChar(char x)
 int
 getDNSName(int sd, void *pkt, int pktlen)
 {
-    dns_query *query;
-    struct dns_header *header;
-    char *dname;
+    dns_msg_t msg;
     char dnsName[MAX_HOSTNAME+1];
-    int dnsNameBytesUsed = 0;
     struct net_info_t *net = getNetEntry(sd);
 
     if (net == NULL) {
@@ -1738,9 +1780,7 @@ getDNSName(int sd, void *pkt, int pktlen)
 
     net->startTime = getTime();
 
-    query = (struct dns_query_t *)pkt;
-    header = &query->qhead;
-    if ((dname = (char *)&query->name) == NULL) {
+    if (!pkt || (pktlen <= 0)) {
         return -1;
     }
 
@@ -1798,150 +1838,148 @@ getDNSName(int sd, void *pkt, int pktlen)
       directly from that function interposition.
     */
 
-    if ((header->opcode != OPCODE_QUERY) && (header->qr != 1)) {
+    size_t len = pktlen;
+    const char *buf = dnsMessage(net, pkt, &len);
+    if (!dnsMsgInit(&msg, buf, len) || !msg.qdcount) {
+        return -1;
+    }
+    if (DNS_QR(&msg) || (DNS_OPCODE(&msg) != OPCODE_QUERY)) {
         return 0;
     }
 
     // We think we have a direct DNS request
-    char *pkt_end = (char *)pkt + pktlen;
-
-    while ((*dname != '\0') && (dname < pkt_end)) {
-        // handle one label
-
-        int label_len = (int)*dname++;
-        if (label_len > 63) return -1; // labels must be 63 chars or less
-        if (&dname[label_len] >= pkt_end) return -1; // honor packet end
-        // Ensure we don't overrun the size of dnsName
-        if ((dnsNameBytesUsed + label_len) >= sizeof(dnsName)) return -1;
-
-        for ( ; (label_len > 0); label_len--) {
-            if (!isLegalLabelChar(*dname)) return -1;
-            dnsName[dnsNameBytesUsed++] = *dname++;
-        }
-        dnsName[dnsNameBytesUsed++] = '.';
+    if (dnsMsgName(&msg, msg.qname, dnsName, sizeof(dnsName)) <= 0) {
+        return -1;
     }
 
-    dnsName[dnsNameBytesUsed-1] = '\0'; // overwrite the last period
+    char *c;
+    for (c = dnsName; *c; c++) {
+        if ((*c != '.') && !isLegalLabelChar(*c)) return -1;
+    }
 
-    if (scope_strncmp(dnsName, g_netinfo[sd].dnsName, dnsNameBytesUsed) == 0) {
+    // A name this long is cut short where it's kept
+    size_t keep = sizeof(g_netinfo[sd].dnsName) - 1;
+    if (scope_strncmp(dnsName, g_netinfo[sd].dnsName, keep) == 0) {
         // Already sent this from an interposed function
         g_netinfo[sd].dnsSend = TRUE;
     } else {
-        scope_strncpy(g_netinfo[sd].dnsName, dnsName, dnsNameBytesUsed);
+        scope_strncpy(g_netinfo[sd].dnsName, dnsName, keep);
+        g_netinfo[sd].dnsName[keep] = '\0';
         g_netinfo[sd].dnsSend = FALSE;
     }
 
     return 0;
 }
 
-#define DNSDONE(var1, var2) {if (var1) cJSON_Delete(var1); if (var2) cJSON_Delete(var2); return FALSE;}
-
+/*
+ * Adds the addresses in one DNS response to answer, and names it after
+ * the first answer (the name that was asked about, ahead of any CNAMEs).
+ * Returns FALSE if it isn't a response with answers.
+ */
 static bool
-parseDNSAnswer(char *buf, size_t len, cJSON *json, cJSON *addrs, int first)
+parseDNSAnswer(net_info *net, const char *buf, size_t len, dns_answer_t *answer)
 {
-    int i, nmsg;
-    ns_rr rr;
-    ns_msg handle;
+    dns_msg_t msg;
+    dns_rr_t rr;
+    bool found = FALSE;
 
-    // init ns lib
-    if (scope_ns_initparse((const unsigned char *)buf, len, &handle) == -1) {
-        scopeLogError("ERROR:init parse");
-        return FALSE;
-    }
+    buf = dnsMessage(net, buf, &len);
+    if (!dnsMsgInit(&msg, buf, len) || !DNS_QR(&msg)) return FALSE;
 
-    nmsg = ns_msg_count(handle, ns_s_an);
+    while (dnsMsgNextAnswer(&msg, &rr)) {
+        if (!answer->name[0] &&
+            (dnsMsgName(&msg, rr.name, answer->name, sizeof(answer->name)) <= 0)) {
+            scopeLogError("ERROR:parse rr");
+            return FALSE;
+        }
+        found = TRUE;
+        if (rr.ttl < answer->ttl) answer->ttl = rr.ttl;
 
-    if (nmsg > 0) {
-        for (i = 0; i < nmsg; i++) {
-            char ipaddr[128];
-            //char dispbuf[4096];
+        // type A is IPv4, AAAA is IPv6
+        int family;
+        if ((rr.type == ns_t_a) && (rr.rdlength == 4)) {
+            family = AF_INET;
+        } else if ((rr.type == ns_t_aaaa) && (rr.rdlength == 16)) {
+            family = AF_INET6;
+        } else {
+            continue;
+        }
 
-            if (scope_ns_parserr(&handle, ns_s_an, i, &rr) == -1) {
-                scopeLogError("ERROR:parse rr");
-                return FALSE;
-            }
+        if (answer->naddrs >= DNS_MAX_ADDRS) continue;
+        dns_addr_t *addr = &answer->addrs[answer->naddrs++];
+        addr->family = family;
+        scope_memcpy(addr->addr, rr.rdata, rr.rdlength);
+    }
 
-            // do this once, after we get the rr
-            if (first == 0) {
-                if (!cJSON_AddStringToObjLN(json, "domain", ns_rr_name(rr))) {
-                    continue;
-                }
-                first = 1;
-            }
+    return found;
+}
 
-            //ns_sprintrr(&handle, &rr, NULL, NULL, dispbuf, sizeof (dispbuf));
-            //scopeLog(CFG_LOG_DEBUG, "%s", dispbuf);
+cJSON *
+dnsAnswerJson(dns_answer_t const *answer, uint64_t duration)
+{
+    cJSON *json = cJSON_CreateObject();
+    if (!json) return NULL;
 
-            // type A is IPv4, AAA is IPv6
-            if (ns_rr_type(rr) == ns_t_a) {
-                if (!scope_inet_ntop(AF_INET, (struct sockaddr_in *)rr.rdata,
-                               ipaddr, sizeof(ipaddr))) {
-                    continue;
-                }
-            } else if (ns_rr_type(rr) == ns_t_aaaa) {
-                if (!scope_inet_ntop(AF_INET6, (struct sockaddr_in6 *)rr.rdata,
-                               ipaddr, sizeof(ipaddr))) {
-                    continue;
-                }
-            } else {
-                DBG("DNS response received without an IP address");
-                continue;
-            }
+    // factor of 1000000 converts ns to ms.
+    if (!cJSON_AddNumberToObjLN(json, "duration", duration / 1000000) ||
+        !cJSON_AddStringToObjLN(json, "domain", answer->name)) {
+        goto err;
+    }
 
-            //scope_snprintf(dispbuf, sizeof(dispbuf), "resolved addr is %s\n", ipaddr);
-            //scopeLog(CFG_LOG_DEBUG, "%s", dispbuf);
+    cJSON *addrs = cJSON_AddArrayToObject(json, "addrs");
+    if (!addrs) goto err;
 
-            if (!cJSON_AddStringToObjLN(addrs, "addr", ipaddr)) {
-                continue;
-            }
+    unsigned int i;
+    for (i = 0; i < answer->naddrs; i++) {
+        char ipaddr[INET6_ADDRSTRLEN];
+        if (!scope_inet_ntop(answer->addrs[i].family, answer->addrs[i].addr,
+                             ipaddr, sizeof(ipaddr))) {
+            continue;
         }
-        return TRUE;
+        cJSON_AddItemToArray(addrs, cJSON_CreateString(ipaddr));
     }
+    return json;
 
-    return FALSE;
+err:
+    cJSON_Delete(json);
+    return NULL;
 }
 
 bool
 getDNSAnswer(int sockfd, char *buf, size_t len, src_data_t dtype)
 {
-    bool result;
+    bool result = FALSE;
     struct net_info_t *net = getNetEntry(sockfd);
 
     if (!buf || !net || (len <= 0)) return FALSE;
 
-    cJSON *json = cJSON_CreateObject();
-    if (!json) return FALSE;
+    // Only the first response on a socket is reported; see doRecv()
+    if (net->dnsRecv) return TRUE;
 
-    cJSON *addrs = cJSON_CreateArray();
-    if (!addrs) DNSDONE(json, addrs);
-
-    if (net->startTime == 0) {
-        if (!cJSON_AddNumberToObjLN(json, "duration", 0)) {
-            DNSDONE(json, addrs);
-        }
-    } else {
-        if (!cJSON_AddNumberToObjLN(json, "duration",
-                                    getDuration(net->startTime) / 1000000)) {
-            DNSDONE(json, addrs);
-        }
-    }
+    dns_answer_t answer;
+    answer.name[0] = '\0';
+    answer.ttl = UINT32_MAX;
+    answer.naddrs = 0;
 
     switch (dtype) {
     case BUF:
-        result = parseDNSAnswer(buf, len, json, addrs, 0);
+        result = parseDNSAnswer(net, buf, len, &answer);
         break;
 
     case MSG:
     {
+        // len is how much was received into the iovs, in order
         int i;
         struct msghdr *msg = (struct msghdr *)buf;
         struct iovec *iov;
 
-        for (i = 0; i < msg->msg_iovlen; i++) {
+        for (i = 0; (i < msg->msg_iovlen) && (len > 0); i++) {
             iov = &msg->msg_iov[i];
             if (iov && iov->iov_base && (iov->iov_len > 0)) {
+                size_t iovlen = (iov->iov_len < len) ? iov->iov_len : len;
+                len -= iovlen;
                 // do we have at least one good pass?
-                if (parseDNSAnswer((char *)iov->iov_base, len, json, addrs, i) == TRUE) {
+                if (parseDNSAnswer(net, (char *)iov->iov_base, iovlen, &answer) == TRUE) {
                     result = TRUE;
                 } else {
                     // should we stop if an iov doesn't parse? probably.
@@ -1954,12 +1992,13 @@ getDNSAnswer(int sockfd, char *buf, size_t len, src_data_t dtype)
 
     case IOV:
     {
+        // len is the number of iovs
         int i;
         struct iovec *iov = (struct iovec *)buf;
 
         for (i = 0; i < len; i++) {
             if (iov[i].iov_base && (iov[i].iov_len > 0)) {
-                if (parseDNSAnswer((char *)iov[i].iov_base, len, json, addrs, i)  == TRUE) {
+                if (parseDNSAnswer(net, (char *)iov[i].iov_base, iov[i].iov_len, &answer) == TRUE) {
                     result = TRUE;
                 } else {
                     break;
@@ -1970,18 +2009,26 @@ getDNSAnswer(int sockfd, char *buf, size_t len, src_data_t dtype)
     }
 
     default:
-        DNSDONE(json, addrs);
+        return FALSE;
     }
 
-    if (result == TRUE) {
-        cJSON_AddItemToObject(json, "addrs", addrs);
-        net->dnsAnswer = json;
-    } else {
+    if (net->dnsAnswer) {
+        cJSON_Delete(net->dnsAnswer);
         net->dnsAnswer = NULL;
-        if (json) cJSON_Delete(json);
-        if (addrs) cJSON_Delete(addrs);
+    }
+    if (result == FALSE) return TRUE;
+
+    uint64_t duration = (net->startTime) ? getDuration(net->startTime) : 0ULL;
+
+    // When DNS is summarized, a response that repeats what's cached for its
+    // name is counted toward the per period dns.resp (doDNSAgg()) instead
+    // of being reported on its own.
+    if (g_summary.net.dns && dnsCacheRepeat(g_dns_cache, &answer, duration)) {
+        net->dnsRecv = TRUE;
+        return TRUE;
     }
 
+    net->dnsAnswer = dnsAnswerJson(&answer, duration);
     return TRUE;
 }
 
@@ -2013,6 +2060,8 @@ doRecv(int sockfd, ssize_t rc, const void *buf, size_t len, src_data_t src)
             (g_netinfo[sockfd].dnsName[0])) {
             g_netinfo[sockfd].dnsRecv = TRUE;
             doUpdateState(DNS, sockfd, (ssize_t)1, NULL, g_netinfo[sockfd].dnsName);
+            // what was posted owns the answer now
+            g_netinfo[sockfd].dnsAnswer = NULL;
         }
 
         if ((sockfd != -1) && buf) {
@@ -2076,6 +2125,8 @@ doAccept(int oldsd, int newsd, struct sockaddr *addr, socklen_t *addrlen, char *
 void
 reportFD(int fd, control_type_t source)
 {
+    EPOCH_SECTION();
+
     if (source == EVENT_BASED) return;
 
     struct net_info_t *ninfo = getNetEntry(fd);
@@ -2154,6 +2205,8 @@ void
 doWrite(int fd, uint64_t initialTime, int success, const void *buf, ssize_t bytes,
         const char *func, src_data_t src, size_t cnt)
 {
+    EPOCH_SECTION();
+
     struct fs_info_t *fs = getFSEntry(fd);
     struct net_info_t *net = getNetEntry(fd);
 
@@ -2273,8 +2326,8 @@ doDupSock(int oldfd, int newfd)
     g_netinfo[newfd].totalDuration = (counters_element_t){.mtc=0, .evt=0};
     g_netinfo[newfd].numDuration = (counters_element_t){.mtc=0, .evt=0};
 
-    // don't dup the HTTP state
-    resetHttp(g_netinfo[newfd].http);
+    // don't dup the HTTP state; the buffers it points to belong to oldfd
+    scope_memset(g_netinfo[newfd].http, 0, sizeof(g_netinfo[newfd].http));
 
     doUpdateState(CONNECTION_OPEN, newfd, 1, "dup", NULL);
     return 0;
@@ -2377,6 +2430,8 @@ doClose(int fd, const char *func)
 void
 doOpen(int fd, const char *path, fs_type_t type, const char *func)
 {
+    EPOCH_SECTION();
+
     if (fd == -1) {
         doUpdateState(FS_ERR_OPEN_CLOSE, -1, 0, func, path);
         return;
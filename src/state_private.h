@@ -3,6 +3,7 @@
 
 #include <limits.h>
 #include <sys/socket.h>
+#include "dnscache.h"
 
 #define NET_ENTRIES 1024
 #define FS_ENTRIES 1024
@@ -103,6 +104,7 @@ typedef struct http_post_t {
     uint64_t start_duration;
     httpId_t id;
     char *hdr;
+    size_t clen;        // body size when it's not in the header, else -1
 } http_post;
 
 typedef struct http_map_t {
@@ -125,9 +127,20 @@ typedef enum {
     HTTP_NONE,
     HTTP_HDR,
     HTTP_HDREND,
-    HTTP_DATA
+    HTTP_DATA,
+    HTTP_CHUNKED
 } http_enum_t;
 
+// position of the chunked transfer-coding parser within a body
+typedef enum {
+    HTTP_CHUNK_SIZE,         // in the hex chunk-size
+    HTTP_CHUNK_EXT,          // in chunk extensions after the chunk-size
+    HTTP_CHUNK_DATA,         // in chunk-data; `clen` bytes remain
+    HTTP_CHUNK_DATA_END,     // expecting the CRLF after chunk-data
+    HTTP_CHUNK_TRAILER,      // at the start of a trailer line
+    HTTP_CHUNK_TRAILER_LINE  // in a trailer line
+} http_chunk_enum_t;
+
 // storage for partial HTTP/2 frames
 typedef struct {
     uint8_t *buf;  // bytes array pointer
@@ -150,13 +163,57 @@ typedef struct protocol_info_t {
 
 typedef enum {HTTP_RX, HTTP_TX, HTTP_NUM} http_direction_t;
 
+// position of the HTTP/1.x header tokenizer within a header
+typedef enum {
+    HTTP1_START_LINE,   // in the request-line or status-line
+    HTTP1_LINE_BEGIN,   // at the first byte of a header line
+    HTTP1_NAME,         // in a header field name
+    HTTP1_VALUE,        // in a header field value
+    HTTP1_END_CR        // saw the CR of the empty line ending the header
+} http1_tok_enum_t;
+
+// Incremental HTTP/1.x header tokenizer.  Bytes are fed to it as they're
+// seen so nothing needs to be buffered to find the end of the header or
+// to extract the few fields we act on.
+typedef struct {
+    http1_tok_enum_t state;
+    size_t len;         // header bytes scanned so far
+    unsigned startIx;   // bytes of the start line scanned so far
+    unsigned nameIx;    // bytes of the current field name scanned so far
+    unsigned nameMask;  // bitmask of known field names still matching
+    int field;          // known field whose value is being scanned or -1
+    unsigned tokIx;     // bytes of the current value token scanned so far
+    bool tokMatch;      // TRUE while the current value token matches
+    bool tokTrail;      // TRUE if whitespace followed the current token
+    size_t valNum;      // numeric value of a Content-Length being scanned
+    bool valBad;        // TRUE if the Content-Length value isn't a number
+    bool copying;       // TRUE while header bytes are copied to `hdr`
+    bool copyAll;       // copy the whole header vs. just the start line
+
+    // results, valid once the end of the header is found
+    size_t clen;        // Content-Length if hasClen
+    bool hasClen;
+    bool isChunked;     // last Transfer-Encoding is `chunked`
+    bool isResponse;    // start line begins with `HTTP/`
+    bool hasUpgrade;
+    bool hasConnectionUpgrade;
+} http1_tok_t;
+
 typedef struct {
     http_enum_t state;
     char *hdr;          // Used if state == HDR
     size_t hdrlen;
     size_t hdralloc;
-    size_t clen;        // Used if state==HTTP_DATA
+    size_t clen;        // Used if state==HTTP_DATA or HTTP_CHUNKED
     httpId_t id;
+    http1_tok_t tok;    // Used if state == HDR or HDREND
+    uint64_t hdrTime;   // when the end of the last header was seen
+
+    // Used if state == HTTP_CHUNKED
+    http_chunk_enum_t chunkState;
+    unsigned chunkDigits;  // hex digits seen in the current chunk-size
+    size_t bodyLen;        // chunk-data bytes seen so far
+    bool hdrPending;       // `hdr` is reported once the body ends
 
     // HTTP version detected (0=unknown, 1=HTTP/1.x, 2=HTTP/2.0)
     int version;
@@ -250,6 +307,7 @@ fs_info *getFSEntry(int);
 bool addrIsNetDomain(struct sockaddr_storage *);
 bool addrIsUnixDomain(struct sockaddr_storage *);
 sock_summary_bucket_t getNetRxTxBucket(net_info *);
+cJSON *dnsAnswerJson(dns_answer_t const *, uint64_t);
 
 // The hiding of objects forces these to be defined here
 void doFSMetric(metric_t, struct fs_info_t *, control_type_t, const char *, ssize_t, const char *);
@@ -259,10 +317,13 @@ void resetInterfaceCounts(counters_element_t *);
 void addToInterfaceCounts(counters_element_t *, uint64_t);
 void subFromInterfaceCounts(counters_element_t *, uint64_t);
 
+#include "chantab.h"
+
 // Data that lives in state.c, but is used in report.c too.
 extern summary_t g_summary;
 extern net_info *g_netinfo;
-extern list_t *g_extra_net_info_list;
+extern chantab_t *g_channel_net_info;
+extern dns_cache_t *g_dns_cache;
 extern fs_info *g_fsinfo;
 extern metric_counters g_ctrs;
 
@@ -15,10 +15,13 @@
 #include <unistd.h>
 #include <sys/un.h>
 
+#include "atomic.h"
 #include "backoff.h"
+#include "compress.h"
 #include "dbg.h"
 #include "os.h"
 #include "scopestdlib.h"
+#include "spill.h"
 #include "fn.h"
 #include "utils.h"
 #include "transport.h"
@@ -67,7 +70,11 @@ struct _transport_t
                            const struct addrinfo *,
                            struct addrinfo **);
     uint64_t connect_attempts;
+    uint64_t connections;           // successful connects, ever
     backoff_t *backoff;
+    compress_t *compress;           // when sends are compressed
+    uint64_t compress_connections;  // the connection compress's frame is for
+    spill_t *spill;                 // for what can't be sent, to be sent later
 
     union {
         struct {
@@ -143,8 +150,8 @@ newTransport(void)
  * range and work our way down until we find one we can get.
  * Then, we force the use of the available fd. 
  */
-static int
-placeDescriptor(int fd, transport_t *t)
+int
+transportPlaceDescriptor(int fd)
 {
     // next_fd_to_try avoids reusing file descriptors.
     // Without this, we've had problems where the buffered stream for
@@ -174,7 +181,7 @@ placeDescriptor(int fd, transport_t *t)
             return dupfd;
         }
     }
-    DBG("%d", t->type);
+    DBG("%d", fd);
     scope_close(fd);
     return -1;
 }
@@ -630,6 +637,9 @@ transportReconnect(transport_t *trans)
 {
     if (!trans) return 0;
 
+    // What the parent couldn't send is for the parent to send
+    spillReset(trans->spill);
+
     switch (trans->type) {
         case CFG_TCP:
             // Since TCP is connection-oriented, we want to disconnect
@@ -659,9 +669,16 @@ transportReconnect(transport_t *trans)
 
             break;
         case CFG_UNIX:
+        case CFG_EDGE:
+            // A compressed stream can't be shared; it'd be interleaved
+            // with the parent's.
+            if (trans->compress) {
+                transportDisconnect(trans);
+                transportConnect(trans);
+            }
+            break;
         case CFG_UDP:
         case CFG_FILE:
-        case CFG_EDGE:
             // Everything else is a no-op.  These can all share
             // the parent's transport.
             break;
@@ -736,12 +753,12 @@ checkPendingSocketStatus(transport_t *trans)
     }
 
     // Move this descriptor up out of the way
-    trans->net.sock = placeDescriptor(trans->net.pending_connect, trans);
+    trans->net.sock = transportPlaceDescriptor(trans->net.pending_connect);
 
     // Remove the pending status from the transport
     trans->net.pending_connect = -1;
 
-    // If the placeDescriptor call failed, we're done
+    // If the transportPlaceDescriptor call failed, we're done
     if (trans->net.sock == -1) return 0;
 
     // Set TCP_QUICKACK
@@ -781,6 +798,7 @@ checkPendingSocketStatus(transport_t *trans)
     // We have a connected socket!  Woot!
     scopeLogInfo("fd:%d connect to %s:%s was successful", trans->net.sock, trans->net.host, trans->net.port);
     trans->connect_attempts = 0;
+    trans->connections++;
     trans->net.failure_reason = NO_FAIL;
     backoffReset(trans->backoff);
 
@@ -932,10 +950,11 @@ socketConnectionStart(transport_t *trans)
 
         if (trans->type == CFG_UDP) {
             // connect on udp sockets normally succeeds immediately.
-            trans->net.sock = placeDescriptor(sock, trans);
+            trans->net.sock = transportPlaceDescriptor(sock);
             if (trans->net.sock != -1) {
                 scopeLogInfo("fd:%d connect to %s:%d was successful", trans->net.sock, addrstr, port);
                 trans->connect_attempts = 0;
+                trans->connections++;
                 trans->net.failure_reason = NO_FAIL;
                 backoffReset(trans->backoff);
                 break;
@@ -971,7 +990,7 @@ transportConnectFile(transport_t *t)
     }
 
     // Move this descriptor up out of the way
-    if ((fd = placeDescriptor(fd, t)) == -1) {
+    if ((fd = transportPlaceDescriptor(fd)) == -1) {
         transportDisconnect(t);
         return 0;
     }
@@ -1015,6 +1034,7 @@ out:
         scopeLogInfo("fd:%d (%s) file connect successful", scope_fileno(t->file.stream), path);
     }
     t->connect_attempts = 0;
+    t->connections++;
     backoffReset(t->backoff);
 
     return 1;
@@ -1097,11 +1117,12 @@ transportConnect(transport_t *trans)
             }
 
             // Move this descriptor up out of the way
-            trans->local.sock = placeDescriptor(trans->local.sock, trans);
+            trans->local.sock = transportPlaceDescriptor(trans->local.sock);
 
             // We have a connection
             scopeLogInfo("fd:%d (%s) connect successful", trans->local.sock, trans->local.path);
             trans->connect_attempts = 0;
+            trans->connections++;
             backoffReset(trans->backoff);
             break;
 
@@ -1112,6 +1133,23 @@ transportConnect(transport_t *trans)
     return 1;
 }
 
+uint64_t
+transportConnectWaitMs(transport_t *trans)
+{
+    if (!trans || !transportNeedsConnection(trans)) return 0;
+
+    // A connection that's underway is checked for on every call
+    switch (trans->type) {
+        case CFG_UDP:
+        case CFG_TCP:
+            if (socketConnectIsPending(trans)) return 0;
+        default:
+            break;
+    }
+
+    return backoffRemainingMs(trans->backoff);
+}
+
 transport_t *
 transportCreateTCP(const char *host, const char *port, unsigned int enable,
                       unsigned int validateserver, const char *cacertpath)
@@ -1279,6 +1317,9 @@ transportDestroy(transport_t **transport)
 
     transport_t *trans = *transport;
 
+    // What's still pending
+    if (trans->compress || trans->spill) transportFlush(trans);
+
     if (trans->configStr) scope_free(trans->configStr);
 
     switch (trans->type) {
@@ -1307,6 +1348,8 @@ transportDestroy(transport_t **transport)
     }
 
     backoffDestroy(&trans->backoff);
+    compressDestroy(&trans->compress);
+    spillDestroy(&trans->spill);
 
     scope_free(trans);
     *transport = NULL;
@@ -1395,11 +1438,9 @@ tcpSendTls(transport_t *trans, const char *msg, size_t len)
     return 0;
 }
 
-int
-transportSend(transport_t *trans, const char *msg, size_t len)
+static int
+sendRaw(transport_t *trans, const char *msg, size_t len)
 {
-    if (!trans || !msg) return -1;
-
     switch (trans->type) {
         case CFG_UDP:
             if (trans->net.sock != -1) {
@@ -1487,11 +1528,151 @@ transportSend(transport_t *trans, const char *msg, size_t len)
     return 0;
 }
 
+int
+transportCompressSet(transport_t *trans, cfg_compress_t type)
+{
+    if (!trans) return -1;
+
+    switch (trans->type) {
+        case CFG_TCP:
+        case CFG_UNIX:
+        case CFG_EDGE:
+            break;
+        default:
+            DBG("%d", trans->type);
+            return -1;
+    }
+
+    compressDestroy(&trans->compress);
+    if (type == CFG_COMPRESS_NONE) return 0;
+
+    trans->compress = compressCreate(type);
+    return (trans->compress) ? 0 : -1;
+}
+
+int
+transportSpillSet(transport_t *trans, const char *dir, size_t maxsize, size_t drainrate)
+{
+    if (!trans) return -1;
+
+    switch (trans->type) {
+        case CFG_TCP:
+        case CFG_UNIX:
+        case CFG_EDGE:
+            break;
+        default:
+            DBG("%d", trans->type);
+            return -1;
+    }
+
+    spillDestroy(&trans->spill);
+    if (!dir) return 0;
+
+    trans->spill = spillCreate(dir, maxsize, drainrate);
+    return (trans->spill) ? 0 : -1;
+}
+
+// Whatever was compressed before this connection was made went to the
+// last one, so the frame starts over.
+static void
+compressConnectionCheck(transport_t *trans)
+{
+    uint64_t connections = trans->connections;
+    if (atomicSwapU64(&trans->compress_connections, connections) != connections) {
+        compressReset(trans->compress);
+    }
+}
+
+// Compressed and sent by transportFlush, on the periodic thread.  What's
+// sent ahead goes first on the connection, and is only for that one.
+static int
+appendCompressed(transport_t *trans, const char *msg, size_t len, bool ahead)
+{
+    if (transportNeedsConnection(trans)) return -1;
+    compressConnectionCheck(trans);
+    if (ahead) return compressAppendAhead(trans->compress, msg, len);
+    return compressAppend(trans->compress, msg, len);
+}
+
+int
+transportSendAhead(transport_t *trans, const char *msg, size_t len)
+{
+    if (!trans || !msg) return -1;
+
+    if (trans->compress) return appendCompressed(trans, msg, len, TRUE);
+    return sendRaw(trans, msg, len);
+}
+
+// Behind what's pending compression, unlike transportSendAhead()
+static int
+sendBehind(transport_t *trans, const char *msg, size_t len)
+{
+    if (trans->compress) return appendCompressed(trans, msg, len, FALSE);
+    return sendRaw(trans, msg, len);
+}
+
+int
+transportSend(transport_t *trans, const char *msg, size_t len)
+{
+    if (!trans || !msg) return -1;
+
+    if (!trans->spill) return sendBehind(trans, msg, len);
+
+    // Behind what's been spilled, until transportFlush has replayed it all
+    if (transportNeedsConnection(trans) || !spillEmpty(trans->spill)) {
+        return spillAppend(trans->spill, msg, len);
+    }
+
+    if (sendBehind(trans, msg, len)) {
+        return spillAppend(trans->spill, msg, len);
+    }
+    return 0;
+}
+
+static int
+sendSpilled(void *arg, const char *msg, size_t len)
+{
+    return sendBehind((transport_t *)arg, msg, len);
+}
+
+static int
+sendCompressed(void *arg, const char *msg, size_t len)
+{
+    return sendRaw((transport_t *)arg, msg, len);
+}
+
+static int
+flushCompressed(transport_t *trans)
+{
+    if (transportNeedsConnection(trans)) return -1;
+    compressConnectionCheck(trans);
+
+    // What can't be sent stays pending, ahead of what's spilled
+    uint64_t connections = trans->connections;
+    if (compressFlush(trans->compress, sendCompressed, trans)) {
+        // The receiver may have part of a frame; start again on a new
+        // connection, unless sending already made one.
+        if (trans->connections == connections) {
+            DBG("%s", trans->configStr);
+            transportDisconnect(trans);
+        }
+        return -1;
+    }
+    return 0;
+}
+
 int
 transportFlush(transport_t* t)
 {
     if (!t) return -1;
 
+    // What was spilled goes first, as fast as its drain rate allows
+    if (t->spill && !spillEmpty(t->spill) && !transportNeedsConnection(t)) {
+        spillDrain(t->spill, sendSpilled, t);
+    }
+
+    if (t->compress) return flushCompressed(t);
+
     switch (t->type) {
         case CFG_UDP:
         case CFG_TCP:
@@ -1511,6 +1692,24 @@ transportFlush(transport_t* t)
     return 0;
 }
 
+uint64_t
+transportConnections(transport_t *trans)
+{
+    return (trans) ? trans->connections : 0;
+}
+
+bool
+transportSpills(transport_t *trans)
+{
+    return (trans && trans->spill);
+}
+
+bool
+transportSpilled(transport_t *trans)
+{
+    return (trans) ? !spillEmpty(trans->spill) : FALSE;
+}
+
 transport_status_t
 transportConnectionStatus(transport_t *trans)
 {
@@ -1518,7 +1717,15 @@ transportConnectionStatus(transport_t *trans)
         .configString = NULL,
         .isConnected = FALSE,
         .connectAttemptCount = 0,
-        .failureString = NULL};
+        .failureString = NULL,
+        .compressed = FALSE,
+        .uncompressedBytes = 0,
+        .compressedBytes = 0,
+        .spilling = FALSE,
+        .spillPendingBytes = 0,
+        .spillDroppedBytes = 0,
+        .backoffDelayMs = 0,
+        .nextConnectMs = 0};
 /*
     configString examples:
         tcp://myhost:myport
@@ -1545,6 +1752,24 @@ transportConnectionStatus(transport_t *trans)
         status.failureString = netFailMap[trans->net.failure_reason];
     }
 
+    if (trans->compress) {
+        compress_stats_t stats = compressStats(trans->compress);
+        status.compressed = TRUE;
+        status.uncompressedBytes = stats.in;
+        status.compressedBytes = stats.out;
+    }
+
+    if (trans->spill) {
+        spill_stats_t stats = spillStats(trans->spill);
+        status.spilling = TRUE;
+        status.spillPendingBytes = stats.pending;
+        status.spillDroppedBytes = stats.dropped;
+    }
+
+    status.backoffDelayMs = backoffDelayMs(trans->backoff);
+    if (!status.isConnected) {
+        status.nextConnectMs = transportConnectWaitMs(trans);
+    }
 
     return status;
 }
@@ -1,5 +1,6 @@
 #ifndef __TRANSPORT_H__
 #define __TRANSPORT_H__
+#include <stddef.h>
 #include <stdint.h>
 #include "scopetypes.h"
 
@@ -8,6 +9,14 @@ typedef struct {
     bool isConnected;               // Indicator about connection status
     uint64_t connectAttemptCount;   // Useful if isConnected is FALSE
     const char *failureString;      // May be provided when isConnected is FALSE
+    bool compressed;                // Indicator that sends are compressed
+    uint64_t uncompressedBytes;     // Useful if compressed is TRUE
+    uint64_t compressedBytes;       // Useful if compressed is TRUE
+    bool spilling;                  // Indicator that sends are spilled to disk
+    uint64_t spillPendingBytes;     // Useful if spilling is TRUE
+    uint64_t spillDroppedBytes;     // Useful if spilling is TRUE
+    uint64_t backoffDelayMs;        // Wait after the last failed attempt
+    uint64_t nextConnectMs;         // Until the next attempt, if isConnected is FALSE
 } transport_status_t;
 
 typedef struct _transport_t transport_t;
@@ -20,21 +29,29 @@ transport_t*        transportCreateFile(const char *, cfg_buffer_t);
 transport_t*        transportCreateUnix(const char *);
 transport_t*        transportCreateEdge(void);
 void                transportDestroy(transport_t **);
+int                 transportCompressSet(transport_t *, cfg_compress_t); // tcp, unix and edge
+int                 transportSpillSet(transport_t *, const char *, size_t, size_t); // tcp, unix and edge
 
 // Accessors
 int                 transportSend(transport_t *, const char *, size_t);
+int                 transportSendAhead(transport_t *, const char *, size_t); // of what's spilled or pending
 int                 transportFlush(transport_t *);
 bool                transportNeedsConnection(transport_t *);
 int                 transportConnect(transport_t *);
+uint64_t            transportConnectWaitMs(transport_t *); // until transportConnect() will try
 int                 transportConnection(transport_t *);
 int                 transportDisconnect(transport_t *);
 int                 transportReconnect(transport_t *);
 cfg_transport_t     transportType(transport_t *);
 bool                transportSupportsCommandControl(transport_t *);
 transport_status_t  transportConnectionStatus(transport_t *);
+uint64_t            transportConnections(transport_t *); // changes on each new connection
+bool                transportSpills(transport_t *);
+bool                transportSpilled(transport_t *); // has some waiting to be replayed
 
 // Misc
 void                transportInit(void);
 void                transportRegisterForExitNotification(void (*fn)(void));
+int                 transportPlaceDescriptor(int); // moves an fd out of the app's way
 
 #endif // __TRANSPORT_H__
@@ -103,6 +103,26 @@ fullGetEnv(char *name) {
     return NULL;
 }
 
+/*
+ * The most entries any of our queues will hold; the default unless
+ * SCOPE_QUEUE_LENGTH overrides it.
+ */
+size_t
+queueLength(void)
+{
+    size_t len = DEFAULT_CBUF_SIZE;
+    char *qlen_str;
+    if ((qlen_str = fullGetEnv("SCOPE_QUEUE_LENGTH")) != NULL) {
+        unsigned long qlen;
+        scope_errno = 0;
+        qlen = scope_strtoul(qlen_str, NULL, 10);
+        if (!scope_errno && qlen) {
+            len = qlen;
+        }
+    }
+    return len;
+}
+
 int
 fullSetenv(const char *key, const char *val, int overwrite)
 {
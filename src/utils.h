@@ -14,6 +14,7 @@ const char* valToStr(enum_map_t[], unsigned int);
 
 int checkEnv(char *, char *);
 char *fullGetEnv(char *);
+size_t queueLength(void);
 int fullSetenv(const char *, const char *, int);
 void setPidEnv(int);
 char *getpath(const char *);
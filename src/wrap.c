@@ -37,9 +37,12 @@
 #include "wrap.h"
 #include "runtimecfg.h"
 #include "javaagent.h"
+#include "epoch.h"
 #include "ipc.h"
+#include "mtcshm.h"
 #include "snapshot.h"
 #include "scopestdlib.h"
+#include "transport.h"
 #include "../contrib/libmusl/musl.h"
 
 #define SSL_FUNC_READ "SSL_read"
@@ -47,9 +50,6 @@
 
 static thread_timing g_thread = {0};
 static config_t *g_staticfg = NULL;
-static log_t *g_prevlog = NULL;
-static mtc_t *g_prevmtc = NULL;
-static ctl_t *g_prevctl = NULL;
 static const char *g_cmddir;
 static list_t *g_nsslist;
 static uint64_t reentrancy_guard = 0ULL;
@@ -248,24 +248,68 @@ freeNssEntry(void *data)
     scope_free(nssentry);
 }
 
-static time_t
-fileModTime(const char *path)
+typedef struct {
+    bool rules;         // when FALSE, only hook execve
+    os_maps_t *maps;    // memory map snapshot for the pass; may be NULL
+} hook_pass_t;
+
+typedef struct {
+    void *handle;       // the object being hooked
+    bool rules;
+} hook_filter_t;
+
+/*
+ * inject_hook_list indexed by symbol so each object's relocations are
+ * scanned once.  It's built the first time it's needed and kept.
+ */
+static got_hooks_t *
+hookTable(void)
 {
-    int fd;
-    struct stat statbuf;
+    static got_hooks_t *hooks = NULL;
 
-    if (!path) return 0;
+    if (!hooks) hooks = gotHooksCreate(inject_hook_list);
+    return hooks;
+}
 
-    if ((fd = scope_open(path, O_RDONLY)) == -1) return 0;
-    
-    if (scope_fstat(fd, &statbuf) < 0) {
-        scope_close(fd);
-        return 0;
+static bool
+hookFilter(got_list_t *hook, void *data)
+{
+    hook_filter_t *filter = (hook_filter_t *)data;
+
+    // if the proc passes the rules then GOT hook all else only hook execve
+    // TODO; all execv?
+    if ((filter->rules == FALSE) && !scope_strstr(hook->symbol, "execve")) return FALSE;
+
+    return dlsym(filter->handle, hook->symbol) != NULL;
+}
+
+/*
+ * GOT hook, or unhook when attach is FALSE, the interposed functions
+ * in the object opened with handle.
+ */
+static int
+hookObject(void *handle, const char *name, bool attach, bool rules, os_maps_t *maps)
+{
+    struct link_map *lm;
+    Elf64_Sym *sym = NULL;
+    Elf64_Rela *rel = NULL;
+    char *str = NULL;
+    int rsz = 0;
+    int patched = 0;
+
+    // Get the link map and ELF sections in advance of something matching
+    if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) &&
+        (getElfEntries(lm, &rel, &sym, &str, &rsz, maps) != -1)) {
+        hook_filter_t filter = {.handle = handle, .rules = rules};
+        patched = doGotcha(lm, hookTable(), rel, sym, str, rsz, attach, maps,
+                           (attach == TRUE) ? hookFilter : NULL, &filter);
+        if (patched) {
+            scopeLog(CFG_LOG_DEBUG, "\tGOT %s %d entries in %s",
+                     (attach == TRUE) ? "patched" : "detached", patched, name);
+        }
     }
 
-    scope_close(fd);
-    // STATMODTIME from os.h as timespec names are different between OSs
-    return STATMODTIME(statbuf);
+    return patched;
 }
 
 /*
@@ -279,12 +323,7 @@ hookAll(struct dl_phdr_info *info, size_t size, void *data)
 {
     if (!info || !info->dlpi_name || !data) return FALSE;
 
-    struct link_map *lm;
-    Elf64_Sym *sym = NULL;
-    Elf64_Rela *rel = NULL;
-    char *str = NULL;
-    int rsz = 0;
-    bool *rules = data;
+    hook_pass_t *pass = data;
 
     scopeLog(CFG_LOG_DEBUG, "%s: shared obj: %s", __FUNCTION__, info->dlpi_name);
 
@@ -307,20 +346,7 @@ hookAll(struct dl_phdr_info *info, size_t size, void *data)
     void *handle = g_fn.dlopen(info->dlpi_name, RTLD_NOW);
     if (handle == NULL) return FALSE;
 
-    // Get the link map and ELF sections in advance of something matching
-    if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) && (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
-        for (int i=0; inject_hook_list[i].symbol; i++) {
-            // if the proc passes the rules then GOT hook all else only hook execve
-            // TODO; all execv?
-            if (((*rules == TRUE) || scope_strstr(inject_hook_list[i].symbol, "execve")) &&
-                dlsym(handle, inject_hook_list[i].symbol)) {
-                if (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, TRUE) != -1) {
-                    scopeLog(CFG_LOG_DEBUG, "\tGOT patched %s from shared obj %s",
-                             inject_hook_list[i].symbol, info->dlpi_name);
-                }
-            }
-        }
-    }
+    hookObject(handle, info->dlpi_name, TRUE, pass->rules, pass->maps);
 
     dlclose(handle);
     return FALSE;
@@ -331,12 +357,7 @@ hookAllAttach(struct dl_phdr_info *info, size_t size, void *data)
 {
     if (!info || !info->dlpi_name || !data) return FALSE;
 
-    struct link_map *lm;
-    Elf64_Sym *sym = NULL;
-    Elf64_Rela *rel = NULL;
-    char *str = NULL;
-    int rsz = 0;
-    bool *rules = data;
+    hook_pass_t *pass = data;
 
     scopeLog(CFG_LOG_DEBUG, "%s: shared obj: %s", __FUNCTION__, info->dlpi_name);
 
@@ -348,50 +369,19 @@ hookAllAttach(struct dl_phdr_info *info, size_t size, void *data)
     void *handle = g_fn.dlopen(info->dlpi_name, RTLD_NOW);
     if (handle == NULL) return FALSE;
 
-    // Get the link map and ELF sections in advance of something matching
-    if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) && (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
-        for (int i=0; inject_hook_list[i].symbol; i++) {
-            // if the proc passes the rules then GOT hook all else only hook execve
-            // TODO; all execv?
-            if (((*rules == TRUE) || scope_strstr(inject_hook_list[i].symbol, "execve")) &&
-                dlsym(handle, inject_hook_list[i].symbol)) {
-                if (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, TRUE) != -1) {
-                    scopeLog(CFG_LOG_DEBUG, "\tGOT patched %s from shared obj %s",
-                             inject_hook_list[i].symbol, info->dlpi_name);
-                }
-            }
-        }
-    }
+    hookObject(handle, info->dlpi_name, TRUE, pass->rules, pass->maps);
 
     dlclose(handle);
     return FALSE;
 }
 
 static int
-hookMain(bool rules)
+hookMain(bool rules, os_maps_t *maps)
 {
-    struct link_map *lm;
-    Elf64_Sym *sym = NULL;
-    Elf64_Rela *rel = NULL;
-    char *str = NULL;
-    int rsz = 0;
-
     void *handle = g_fn.dlopen(NULL, RTLD_NOW);
     if (handle == NULL) return FALSE;
 
-    // Get the link map and ELF sections in advance of something matching
-    if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) && (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
-        for (int i=0; inject_hook_list[i].symbol; i++) {
-            // if the proc passes the rules then GOT hook all else only hook execve
-            // TODO; all execv?
-            if (((rules == TRUE) || scope_strstr(inject_hook_list[i].symbol, "execve")) &&
-                dlsym(handle, inject_hook_list[i].symbol)) {
-                if (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, TRUE) != -1) {
-                    scopeLog(CFG_LOG_DEBUG, "\tGOT patched %s from main", inject_hook_list[i].symbol);
-                }
-            }
-        }
-    }
+    hookObject(handle, "main", TRUE, rules, maps);
 
     dlclose(handle);
     return TRUE;
@@ -405,11 +395,7 @@ unHookAll(struct dl_phdr_info *info, size_t size, void *data)
 {
     if (!info || !info->dlpi_name) return FALSE;
 
-    struct link_map *lm;
-    Elf64_Sym *sym = NULL;
-    Elf64_Rela *rel = NULL;
-    char *str = NULL;
-    int rsz = 0;
+    hook_pass_t *pass = data;
 
     scopeLog(CFG_LOG_DEBUG, "%s: shared obj: %s", __FUNCTION__, info->dlpi_name);
 
@@ -419,15 +405,7 @@ unHookAll(struct dl_phdr_info *info, size_t size, void *data)
     void *handle = g_fn.dlopen(info->dlpi_name, RTLD_NOW);
     if (handle == NULL) return FALSE;
 
-    // Get the link map and ELF sections in advance of something matching
-    if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) && (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
-        for (int i=0; inject_hook_list[i].symbol; i++) {
-            if (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, FALSE) != -1) {
-                scopeLog(CFG_LOG_DEBUG, "\tGOT detached %s from shared obj %s",
-                         inject_hook_list[i].symbol, info->dlpi_name);
-            }
-        }
-    }
+    hookObject(handle, info->dlpi_name, FALSE, TRUE, (pass) ? pass->maps : NULL);
 
     dlclose(handle);
     return FALSE;
@@ -439,7 +417,9 @@ cmdDetach(void)
     if (!g_cfg.funcs_attached) return TRUE;
 
     scopeLog(CFG_LOG_DEBUG, "%s:%d", __FUNCTION__, __LINE__);
-    dl_iterate_phdr(unHookAll, NULL);
+    hook_pass_t pass = {.rules = TRUE, .maps = osMapsCreate()};
+    dl_iterate_phdr(unHookAll, &pass);
+    osMapsDestroy(&pass.maps);
     g_cfg.funcs_attached = FALSE;
     return TRUE;
 }
@@ -449,11 +429,12 @@ cmdAttach(void)
 {
     if (g_cfg.funcs_attached) return TRUE;
 
-    bool rules = TRUE;
     scopeLog(CFG_LOG_DEBUG, "%s:%d", __FUNCTION__, __LINE__);
 
-    dl_iterate_phdr(hookAllAttach, &rules);
-    hookMain(rules);
+    hook_pass_t pass = {.rules = TRUE, .maps = osMapsCreate()};
+    dl_iterate_phdr(hookAllAttach, &pass);
+    hookMain(pass.rules, pass.maps);
+    osMapsDestroy(&pass.maps);
 
     g_cfg.funcs_attached = TRUE;
 
@@ -478,29 +459,47 @@ cmdAttach(void)
     return TRUE;
 }
 
+/*
+ * Returns the descriptor of the output message queue, held from one request
+ * to the next for as long as the queue is there; once it has been removed
+ * the one the cli has made since is opened in its place.
+ */
+static mqd_t
+ipcResponseQueue(mqd_t *mqResponseDesc)
+{
+    struct stat sb;
+    if ((*mqResponseDesc != (mqd_t)-1) &&
+        (scope_fstat(*mqResponseDesc, &sb) == 0) && (sb.st_nlink > 0)) {
+        return *mqResponseDesc;
+    }
+    if (*mqResponseDesc != (mqd_t)-1) ipcCloseConnection(*mqResponseDesc);
+
+    char name[256];
+    scope_snprintf(name, sizeof(name), "/ScopeIPCOut.%d", g_proc.pid);
+    mqd_t mqdes = ipcOpenConnection(name, O_WRONLY | O_NONBLOCK);
+    *mqResponseDesc = (mqdes == (mqd_t)-1) ? (mqd_t)-1 : (mqd_t)transportPlaceDescriptor(mqdes);
+    return *mqResponseDesc;
+}
+
 /*
  * Handle IPC communication
  */
 static void
-ipcCommunication(void) {
+ipcCommunication(mqd_t mqRequestDesc, mqd_t *mqResponseDesc) {
     size_t appMqSize = -1;
     long msgCount = -1;
-    char name[256] = {0};
 
     /*
     * Handle incoming message queue
     * - check if it exists
     * - check if there are message request on it
     */
-    scope_snprintf(name, sizeof(name), "/ScopeIPCIn.%d", g_proc.pid);
-    mqd_t mqRequestDesc  = ipcOpenConnection(name, O_RDONLY | O_NONBLOCK);
-
     if (ipcIsActive(mqRequestDesc, &appMqSize, &msgCount) == FALSE) {
         return;
     }
 
     if (msgCount <= 0) {
-        goto cleanupReqMq;
+        return;
     }
 
     size_t cliMqSize = -1;
@@ -508,13 +507,9 @@ ipcCommunication(void) {
     * Handle output message queue
     * - check if it exists
     */
-    scope_memset(name, 0, sizeof(name));
-    scope_snprintf(name, sizeof(name), "/ScopeIPCOut.%d", g_proc.pid);
-
-    mqd_t mqResponseDesc = ipcOpenConnection(name, O_WRONLY | O_NONBLOCK);
-    if (ipcIsActive(mqResponseDesc, &cliMqSize, &msgCount) == FALSE) {
-        scopeLogError("%s is not active.", name);
-        goto cleanupReqMq;
+    if (ipcIsActive(ipcResponseQueue(mqResponseDesc), &cliMqSize, &msgCount) == FALSE) {
+        scopeLogError("/ScopeIPCOut.%d is not active.", g_proc.pid);
+        return;
     }
 
     /*
@@ -529,37 +524,111 @@ ipcCommunication(void) {
     */
     ipc_resp_result_t res;
     if (parseStatus == REQ_PARSE_OK) {
-        res = ipcSendSuccessfulResponse(mqResponseDesc, cliMqSize, scopeReq, uniqReq);
+        res = ipcSendSuccessfulResponse(*mqResponseDesc, cliMqSize, scopeReq, uniqReq);
     } else {
-        res = ipcSendFailedResponse(mqResponseDesc, cliMqSize, parseStatus, uniqReq);
+        res = ipcSendFailedResponse(*mqResponseDesc, cliMqSize, parseStatus, uniqReq);
     }
 
     if (res != RESP_RESULT_OK) {
-        scopeLogError("ipcCommunication Error sending response to %s failed res %d, parseStatus %d, uniqReq %d", name, res, parseStatus, uniqReq);
+        scopeLogError("ipcCommunication Error sending response to /ScopeIPCOut.%d failed res %d, parseStatus %d, uniqReq %d", g_proc.pid, res, parseStatus, uniqReq);
+        // Don't hold on to a descriptor that's gone bad; open it again next time
+        if (res == RESP_SEND_OTHER) {
+            ipcCloseConnection(*mqResponseDesc);
+            *mqResponseDesc = (mqd_t)-1;
+        }
     }
 
     scope_free(scopeReq);
-    
-    // scopeLogError("OK: Sending answer to %s for cmd %d", name, cmd);
+}
 
-    ipcCloseConnection(mqResponseDesc);
+/*
+ * Carries out a single request received on the ctl connection
+ */
+static void
+remoteRequest(const char *cmd)
+{
+    request_t *req = cmdParse(cmd);
+    if (!req) {
+        cmdSendInfoStr(g_ctl, "Error in receive from stream.  Memory error in scope parsing.");
+        return;
+    }
 
-cleanupReqMq:
-    ipcCloseConnection(mqRequestDesc);
+    cJSON* body = NULL;
+    switch (req->cmd) {
+        case REQ_PARSE_ERR:
+        case REQ_MALFORMED:
+        case REQ_UNKNOWN:
+        case REQ_PARAM_ERR:
+            // Nothing to do here.  Req is not well-formed.
+            break;
+        case REQ_SET_CFG:
+            if (req->cfg) {
+                // Replace the config
+                doAndReplaceConfig(req->cfg);
+            } else {
+                DBG(NULL);
+            }
+            break;
+        case REQ_GET_CFG:
+            // construct a response representing our current config
+            body = jsonConfigurationObject(g_staticfg);
+            break;
+        case REQ_GET_DIAG:
+            // Not implemented yet.
+            break;
+        case REQ_BLOCK_PORT:
+            // Assign new value for port blocking
+            g_cfg.blockconn = req->port;
+            break;
+        case REQ_SWITCH:
+            switch (req->action) {
+                case FUNC_DETACH:
+                    cmdDetach();
+                    break;
+                case FUNC_ATTACH:
+                    cmdAttach();
+                    break;
+                default:
+                    DBG("%d", req->action);
+            }
+            break;
+        case REQ_ADD_PROTOCOL:
+            // define a new protocol
+            addProtocol(req);
+            break;
+        case REQ_DEL_PROTOCOL:
+            // remove a protocol
+            delProtocol(req);
+            break;
+    default:
+            DBG(NULL);
+    }
+
+    cmdSendResponse(g_ctl, req, body);
+    destroyReq(&req);
 }
 
+/*
+ * What has come in on the ctl connection, short of a whole request.
+ * Requests end with a newline (EOM); they're parsed from here, where they
+ * lie, and what's left of a request stays until the rest of it comes in.
+ */
+static struct {
+    char *buf;
+    size_t len;
+    size_t size;
+    int fd;                     // the connection it came in on
+} g_remote = {NULL, 0, 0, -1};
+
 static void
 remoteConfig(void)
 {
     int timeout;
     struct pollfd fds;
-    int rc, success, numtries;
-    FILE *fs;
-    char buf[1024];
-    char path[PATH_MAX];
+    int rc, numtries;
     
-    // to be clear; a 1ms timeout
-    timeout = 1;
+    // to be clear; no waiting, the periodic thread has done that
+    timeout = 0;
     scope_memset(&fds, 0x0, sizeof(fds));
 
     // We want to accept incoming requests on TCP, unix, and edge.
@@ -587,147 +656,475 @@ remoteConfig(void)
     if ((rc == 0) || (fds.revents == 0) || ((fds.revents & POLLIN) == 0) ||
         ((fds.revents & POLLHUP) != 0) || ((fds.revents & POLLNVAL) != 0)) return;
 
-    scope_snprintf(path, sizeof(path), "/tmp/cfg.%d", g_proc.pid);
-    if ((fs = scope_fopen(path, "a+")) == NULL) {
-        DBG(NULL);
-        scopeLogError("ERROR: remoteConfig:fopen");
-        return;
+    // Part of a request from an earlier connection is no use
+    if (fds.fd != g_remote.fd) {
+        g_remote.len = 0;
+        g_remote.fd = fds.fd;
     }
 
-    success = rc = scope_errno = numtries = 0;
+    rc = scope_errno = numtries = 0;
     do {
         numtries++;
-        rc = scope_recv(fds.fd, buf, sizeof(buf), MSG_DONTWAIT);
+
+        // Room to receive into, and for a NUL after it
+        if (g_remote.size - g_remote.len < REMOTE_RECV_SIZE + 1) {
+            size_t size = g_remote.len + REMOTE_RECV_SIZE + 1;
+            char *buf = (size <= REMOTE_REQ_MAX) ? scope_realloc(g_remote.buf, size) : NULL;
+            if (!buf) {
+                g_remote.len = 0;
+                cmdSendInfoStr(g_ctl, "Error in receive from stream.  Memory error in scope receive.");
+                return;
+            }
+            g_remote.buf = buf;
+            g_remote.size = size;
+        }
+
+        rc = scope_recv(fds.fd, g_remote.buf + g_remote.len, REMOTE_RECV_SIZE, MSG_DONTWAIT);
         if (rc <= 0) {
             // Something has happened to this incoming message
             break;
         }
 
-        if (scope_fwrite(buf, rc, (size_t)1, fs) <= 0) {
-            DBG(NULL);
-            break;
-        } else {
-            /*
-             * We are done if we get end of msg (EOM) or if we've read more 
-             * than expected and never saw an EOM.
-             * We are only successful if we've had no errors or disconnects
-             * and we receive a viable EOM.
-             */
-            // EOM
-            if (scope_strchr((const char *)buf, '\n') != NULL) {
-                success = 1;
-                break;
-            } else {
-                // No EOM after more than enough tries, bail out
-                if (numtries > MAXTRIES) {
-                    break;
-                }
+        // Each whole request received
+        char *start = g_remote.buf;
+        char *end = g_remote.buf + g_remote.len + rc;
+        char *eom = scope_memchr(g_remote.buf + g_remote.len, '\n', rc);
+        while (eom) {
+            *eom = '\0';
+            remoteRequest(start);
+
+            // A new config can come with a new connection
+            if (ctlConnection(g_ctl, CFG_CTL) != fds.fd) {
+                g_remote.len = 0;
+                return;
             }
+
+            start = eom + 1;
+            eom = scope_memchr(start, '\n', end - start);
         }
-    } while (1);
+        g_remote.len = end - start;
+        scope_memmove(g_remote.buf, start, g_remote.len);
 
-    if (success == 1) {
-        char *cmd;
-        struct stat sb;
-        request_t *req;
+    // Don't let one connection keep us from everything else
+    } while (numtries <= MAXTRIES);
 
-        if (scope_fflush(fs) != 0) DBG(NULL);
-        scope_rewind(fs);
-        if (scope_lstat(path, &sb) == -1) {
-            sb.st_size = DEFAULT_CONFIG_SIZE;
+    /*
+     * We only wait for the rest of a request while the connection is
+     * still there; otherwise what we have of it is lost.
+     */
+    if ((rc == 0) || ((rc < 0) && (scope_errno != EAGAIN) && (scope_errno != EWOULDBLOCK))) {
+        if (g_remote.len) {
+            g_remote.len = 0;
+            cmdSendInfoStr(g_ctl, "Error in receive from stream.  Scope receive retries exhausted.");
         }
+    }
+}
 
-        cmd = scope_calloc(1, sb.st_size);
-        if (!cmd) {
-            scope_fclose(fs);
-            scope_unlink(path);
-            cmdSendInfoStr(g_ctl, "Error in receive from stream.  Memory error in scope receive.");
-            return;
+/*
+ * What the periodic thread waits on, between the things it does.
+ *
+ * It used to go around every ms, polling the ctl connection and opening
+ * the IPC queue to look for requests, whether there was anything to do
+ * or not.  Now, with nothing queued, it sleeps in epoll_wait until it's
+ * due to summarize, or until one of these has something for it:
+ *   - an eventfd, written by g_ctl when an event, log, or payload is
+ *     queued while it sleeps
+ *   - the ctl connection, when it accepts requests
+ *   - an inotify watch of MQUEUE_DIR, to learn when the cli creates our
+ *     IPC queue, and the queue itself while it exists
+ *   - an inotify watch of the directories the dynamic config files are
+ *     written to, so they're applied as soon as they've been written
+ * All of them are kept out of the app's way, in the range our transports
+ * use.  While a connection is down, it's back when the connection's
+ * backoff allows the next attempt, rather than every ms.  Where the IPC
+ * queue can't be watched for, or epoll can't be had, the thread goes
+ * around every PERIODIC_DRAIN_MS, as it always did.
+ */
+static struct {
+    int epfd;
+    int wakefd;
+    int mqdirfd;                // -1 if the IPC queue has to be polled for
+    mqd_t ipcfd;                // -1 if the IPC queue isn't there
+    mqd_t ipcoutfd;             // the queue we answer on, while it's there
+    int cfgdirfd;               // -1 if the dynamic config has to be polled for
+    char *cfgdir;               // g_cmddir, as last watched
+
+    transport_t *ctltrans;      // the ctl connection, as last watched
+    int ctlfd;
+    uint64_t ctlconns;
+} g_wait = {-1, -1, -1, (mqd_t)-1, (mqd_t)-1, -1, NULL, NULL, -1, 0};
+
+static int dynConfig(void);
+
+static void
+waitCloseFd(int *fd)
+{
+    if (*fd == -1) return;
+    scope_close(*fd);
+    *fd = -1;
+}
+
+static void
+waitClose(void)
+{
+    if (g_wait.ipcfd != (mqd_t)-1) ipcCloseConnection(g_wait.ipcfd);
+    g_wait.ipcfd = (mqd_t)-1;
+    if (g_wait.ipcoutfd != (mqd_t)-1) ipcCloseConnection(g_wait.ipcoutfd);
+    g_wait.ipcoutfd = (mqd_t)-1;
+    waitCloseFd(&g_wait.cfgdirfd);
+    if (g_wait.cfgdir) scope_free(g_wait.cfgdir);
+    g_wait.cfgdir = NULL;
+    waitCloseFd(&g_wait.mqdirfd);
+    waitCloseFd(&g_wait.wakefd);
+    waitCloseFd(&g_wait.epfd);
+    g_wait.ctltrans = NULL;
+    g_wait.ctlfd = -1;
+}
+
+static int
+waitPlace(int fd)
+{
+    return (fd == -1) ? -1 : transportPlaceDescriptor(fd);
+}
+
+static bool
+waitWatch(int fd, uint32_t events)
+{
+    if (g_wait.epfd == -1) return FALSE;
+
+    struct epoll_event ev = {.events = events, .data.fd = fd};
+    if (scope_epoll_ctl(g_wait.epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        DBG("%d", fd);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+ipcQueueOpen(void)
+{
+    char name[256];
+    scope_snprintf(name, sizeof(name), "/ScopeIPCIn.%d", g_proc.pid);
+
+    int fd = waitPlace(ipcOpenConnection(name, O_RDONLY | O_NONBLOCK));
+    if (fd == -1) return;
+
+    if (g_wait.ipcfd != (mqd_t)-1) ipcCloseConnection(g_wait.ipcfd);
+    g_wait.ipcfd = (mqd_t)fd;
+
+    // Edge triggered; a request we can't answer (no /ScopeIPCOut) isn't
+    // looked at again until the next one comes in, or the next summary.
+    waitWatch(fd, EPOLLIN | EPOLLET);
+}
+
+static void
+ipcQueueClose(void)
+{
+    if (g_wait.ipcfd == (mqd_t)-1) return;
+    ipcCloseConnection(g_wait.ipcfd);
+    g_wait.ipcfd = (mqd_t)-1;
+}
+
+/*
+ * The cli creates our IPC queue for each command it sends us, and
+ * removes it once it has the answer.
+ */
+static void
+ipcQueueEvents(void)
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    char name[64];
+    int state = 0;      // 1 created, -1 deleted
+    ssize_t len;
+
+    scope_snprintf(name, sizeof(name), "ScopeIPCIn.%d", g_proc.pid);
+
+    while ((len = scope_read(g_wait.mqdirfd, buf, sizeof(buf))) > 0) {
+        char *ptr = buf;
+        while (ptr < buf + len) {
+            const struct inotify_event *ev = (const struct inotify_event *)ptr;
+            ptr += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // We can't tell what's happened; look again
+                ipcQueueClose();
+                state = 1;
+            } else if (ev->len && !scope_strcmp(ev->name, name)) {
+                state = (ev->mask & IN_CREATE) ? 1 : -1;
+            }
         }
-        
-        if (scope_fread(cmd, sb.st_size, 1, fs) == 0) {
-            scope_fclose(fs);
-            scope_unlink(path);
-            scope_free(cmd);
-            cmdSendInfoStr(g_ctl, "Error in receive from stream.  Read error in scope.");
-            return;
+    }
+
+    if (state == -1) ipcQueueClose();
+    if (state == 1) ipcQueueOpen();
+}
+
+static void
+ipcQueuePoll(void)
+{
+    // With no way to be told, see if it's been created, or removed
+    struct stat sb;
+    if ((g_wait.ipcfd != (mqd_t)-1) &&
+        (scope_fstat(g_wait.ipcfd, &sb) == 0) && (sb.st_nlink > 0)) return;
+
+    ipcQueueClose();
+    ipcQueueOpen();
+}
+
+/*
+ * The dynamic config files, <cmddir>/scope.<pid> and the cli's in
+ * DYN_CONFIG_CLI_DIR, are looked for when one of them has been written,
+ * rather than on each summary.  The watch follows the cmddir of the
+ * current config.
+ */
+static void
+dynConfigWatch(void)
+{
+    if (!g_cmddir ||
+        (g_wait.cfgdir && !scope_strcmp(g_wait.cfgdir, g_cmddir))) return;
+
+    waitCloseFd(&g_wait.cfgdirfd);
+    if (g_wait.cfgdir) scope_free(g_wait.cfgdir);
+    if (!(g_wait.cfgdir = scope_strdup(g_cmddir))) return;
+
+    int fd = waitPlace(scope_inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    if (fd == -1) return;
+
+    // Written in place, or written elsewhere and moved in
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO;
+    if ((scope_inotify_add_watch(fd, g_wait.cfgdir, mask) == -1) ||
+        (scope_inotify_add_watch(fd, DYN_CONFIG_CLI_DIR, mask) == -1) ||
+        !waitWatch(fd, EPOLLIN)) {
+        scope_close(fd);
+        return;
+    }
+    g_wait.cfgdirfd = fd;
+
+    // It may have been written while we weren't watching
+    dynConfig();
+}
+
+static void
+dynConfigEvents(void)
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    char username[64];
+    char cliname[64];
+    bool written = FALSE;
+    ssize_t len;
+
+    scope_snprintf(username, sizeof(username), "%s.%d", DYN_CONFIG_PREFIX, g_proc.pid);
+    scope_snprintf(cliname, sizeof(cliname), "%s.%d", DYN_CONFIG_CLI_PREFIX, g_proc.pid);
+
+    while ((len = scope_read(g_wait.cfgdirfd, buf, sizeof(buf))) > 0) {
+        char *ptr = buf;
+        while (ptr < buf + len) {
+            const struct inotify_event *ev = (const struct inotify_event *)ptr;
+            ptr += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_IGNORED) {
+                // The directory is gone; back to looking on each summary
+                waitCloseFd(&g_wait.cfgdirfd);
+                written = TRUE;
+                break;
+            } else if (ev->mask & IN_Q_OVERFLOW) {
+                written = TRUE;
+            } else if (ev->len && (!scope_strcmp(ev->name, username) ||
+                                   !scope_strcmp(ev->name, cliname))) {
+                written = TRUE;
+            }
         }
-        
-        req = cmdParse((const char*)cmd);
-        if (req) {
-            cJSON* body = NULL;
-            switch (req->cmd) {
-                case REQ_PARSE_ERR:
-                case REQ_MALFORMED:
-                case REQ_UNKNOWN:
-                case REQ_PARAM_ERR:
-                    // Nothing to do here.  Req is not well-formed.
-                    break;
-                case REQ_SET_CFG:
-                    if (req->cfg) {
-                        // Replace the config
-                        doAndReplaceConfig(req->cfg);
-                    } else {
-                        DBG(NULL);
-                    }
-                    break;
-                case REQ_GET_CFG:
-                    // construct a response representing our current config
-                    body = jsonConfigurationObject(g_staticfg);
-                    break;
-                case REQ_GET_DIAG:
-                    // Not implemented yet.
-                    break;
-                case REQ_BLOCK_PORT:
-                    // Assign new value for port blocking
-                    g_cfg.blockconn = req->port;
-                    break;
-                case REQ_SWITCH:
-                    switch (req->action) {
-                        case FUNC_DETACH:
-                            cmdDetach();
-                            break;
-                        case FUNC_ATTACH:
-                            cmdAttach();
-                            break;
-                        default:
-                            DBG("%d", req->action);
-                    }
-                    break;
-                case REQ_ADD_PROTOCOL:
-                    // define a new protocol
-                    addProtocol(req);
-                    break;
-                case REQ_DEL_PROTOCOL:
-                    // remove a protocol
-                    delProtocol(req);
-                    break;
-            default:
-                    DBG(NULL);
+        if (g_wait.cfgdirfd == -1) break;
+    }
+
+    if (written) dynConfig();
+}
+
+static void
+waitInit(void)
+{
+    waitClose();
+
+    if (((g_wait.epfd = waitPlace(scope_epoll_create1(EPOLL_CLOEXEC))) == -1) ||
+        ((g_wait.wakefd = waitPlace(scope_eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) == -1) ||
+        !waitWatch(g_wait.wakefd, EPOLLIN)) {
+        DBG(NULL);
+        waitClose();
+        return;
+    }
+
+    struct statfs sfs;
+    if ((scope_statfs(MQUEUE_DIR, &sfs) == 0) && (sfs.f_type == MQUEUE_MAGIC) &&
+        ((g_wait.mqdirfd = waitPlace(scope_inotify_init1(IN_NONBLOCK | IN_CLOEXEC))) != -1)) {
+        if ((scope_inotify_add_watch(g_wait.mqdirfd, MQUEUE_DIR, IN_CREATE | IN_DELETE) == -1) ||
+            !waitWatch(g_wait.mqdirfd, EPOLLIN)) {
+            waitCloseFd(&g_wait.mqdirfd);
+        }
+    }
+
+    // It may be there already
+    ipcQueueOpen();
+}
+
+static void
+waitWatchCtl(void)
+{
+    transport_t *trans = ctlTransport(g_ctl, CFG_CTL);
+    int fd = ctlConnection(g_ctl, CFG_CTL);
+    uint64_t conns = transportConnections(trans);
+
+    if ((trans == g_wait.ctltrans) && (fd == g_wait.ctlfd) &&
+        (conns == g_wait.ctlconns)) return;
+
+    // A new connection.  The old one, if it's been closed, is gone from
+    // the set already.
+    if (g_wait.ctlfd != -1) {
+        scope_epoll_ctl(g_wait.epfd, EPOLL_CTL_DEL, g_wait.ctlfd, NULL);
+    }
+    g_wait.ctltrans = trans;
+    g_wait.ctlfd = -1;
+    g_wait.ctlconns = conns;
+
+    // We want to accept incoming requests on TCP, unix, and edge.
+    // However, we don't currently support receiving on TLS connections.
+    if ((fd != -1) && transportSupportsCommandControl(trans) &&
+        waitWatch(fd, EPOLLIN | EPOLLRDHUP)) {
+        g_wait.ctlfd = fd;
+    }
+}
+
+/*
+ * Waits for as much as timeout ms, and does what it was woken for
+ */
+static void
+waitForWork(int timeout)
+{
+    struct epoll_event events[4];
+    int i, num;
+
+    if (g_wait.mqdirfd == -1) ipcQueuePoll();
+
+    if (g_wait.epfd == -1) {
+        struct timespec ts = {.tv_sec = timeout / 1000,
+                              .tv_nsec = (timeout % 1000) * 1000000};
+        sigSafeNanosleep(&ts);
+        remoteConfig();
+        if (g_wait.ipcfd != (mqd_t)-1) ipcCommunication(g_wait.ipcfd, &g_wait.ipcoutfd);
+        return;
+    }
+
+    waitWatchCtl();
+    dynConfigWatch();
+
+    num = scope_epoll_wait(g_wait.epfd, events, ARRAY_SIZE(events), timeout);
+    if (num == -1) {
+        if (scope_errno == EINTR) return;
+
+        // Most likely the app has closed it
+        DBG("%d", scope_errno);
+        waitInit();
+        return;
+    }
+
+    for (i = 0; i < num; i++) {
+        int fd = events[i].data.fd;
+
+        if (fd == g_wait.wakefd) {
+            uint64_t count;
+            if (scope_read(fd, &count, sizeof(count)) == -1) DBG(NULL);
+        } else if (fd == g_wait.ctlfd) {
+            if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                // Nothing more will come in; wait for the reconnect
+                scope_epoll_ctl(g_wait.epfd, EPOLL_CTL_DEL, fd, NULL);
+                g_wait.ctlfd = -1;
+            } else {
+                remoteConfig();
             }
-            
-            cmdSendResponse(g_ctl, req, body);
-            destroyReq(&req);
-        } else {
-            cmdSendInfoStr(g_ctl, "Error in receive from stream.  Memory error in scope parsing.");
+        } else if (fd == g_wait.mqdirfd) {
+            ipcQueueEvents();
+        } else if (fd == g_wait.cfgdirfd) {
+            dynConfigEvents();
+        } else if (fd == (int)g_wait.ipcfd) {
+            ipcCommunication(g_wait.ipcfd, &g_wait.ipcoutfd);
         }
+    }
+}
 
-        scope_free(cmd);
-    } else {
-        cmdSendInfoStr(g_ctl, "Error in receive from stream.  Scope receive retries exhausted.");
+/*
+ * How long the periodic thread can sleep for: until the next summary,
+ * unless there's something it should come back for sooner.
+ */
+static int
+waitTimeout(time_t summaryTime, bool perf, bool retired)
+{
+    struct timeval tv;
+    scope_gettimeofday(&tv, NULL);
+
+    long long ms = (long long)(summaryTime - tv.tv_sec) * 1000 - tv.tv_usec / 1000;
+    if (ms < 0) ms = 0;
+    if (ms > (long long)g_thread.interval * 1000) ms = (long long)g_thread.interval * 1000;
+
+    // Without epoll, or a way to be told of the IPC queue, there's only polling
+    bool busy = (g_wait.epfd == -1) || (g_wait.mqdirfd == -1);
+
+    // Old configs are destroyed after the last section using them ends
+    busy |= retired;
+
+    if (!perf) {
+        bool ctlDown = ctlNeedsConnection(g_ctl, CFG_CTL);
+        bool lsDown = ctlNeedsConnection(g_ctl, CFG_LS);
+
+        // A connection that's down is retried when its backoff next allows
+        long long retry = -1;
+        if (ctlDown) retry = ctlConnectWaitMs(g_ctl, CFG_CTL);
+        if (lsDown) {
+            long long lsRetry = ctlConnectWaitMs(g_ctl, CFG_LS);
+            if ((retry == -1) || (lsRetry < retry)) retry = lsRetry;
+        }
+        if (retry != -1) {
+            if (retry < PERIODIC_DRAIN_MS) retry = PERIODIC_DRAIN_MS;
+            if (ms > retry) ms = retry;
+        }
+
+        // Events are drained on every trip around, unless they've nowhere
+        // to go until the ctl connection is back (see doConnection())
+        bool stuck = ctlDown && !ctlSpills(g_ctl) &&
+                     (cfgLogStreamEnable(g_cfg.staticfg) || mtcNeedsConnection(g_mtc));
+        if (!stuck) busy |= !ctlWakeupArm(g_ctl);
     }
 
-    scope_fclose(fs);
-    scope_unlink(path);
+    if (busy && (ms > PERIODIC_DRAIN_MS)) ms = PERIODIC_DRAIN_MS;
+    return (int)ms;
+}
+
+static void
+retireMtc(void *obj)
+{
+    mtc_t *mtc = obj;
+    mtcDestroy(&mtc);
+}
+
+static void
+retireLog(void *obj)
+{
+    log_t *log = obj;
+    logDestroy(&log);
+}
+
+static void
+retireCtl(void *obj)
+{
+    ctl_t *ctl = obj;
+    ctlDestroy(&ctl);
 }
 
 static void
 doConfig(config_t *cfg)
 {
     // Save the current objects to get cleaned up on the periodic thread
-    g_prevmtc = g_mtc;
-    g_prevlog = g_log;
-    g_prevctl = g_ctl;
+    mtc_t *prevmtc = g_mtc;
+    log_t *prevlog = g_log;
+    ctl_t *prevctl = g_ctl;
 
     if (cfgLogStreamEnable(cfg)) {
         cfgLogStreamDefault(cfg);
@@ -762,11 +1159,19 @@ doConfig(config_t *cfg)
     }
 
     // Disconnect the old interfaces that were just replaced
-    mtcDisconnect(g_prevmtc);
-    logDisconnect(g_prevlog);
-    ctlStopAggregating(g_prevctl);
-    ctlFlush(g_prevctl);
-    ctlDisconnect(g_prevctl, CFG_CTL);
+    mtcDisconnect(prevmtc);
+    logDisconnect(prevlog);
+    ctlStopAggregating(prevctl);
+    ctlFlush(prevctl);
+    ctlDisconnect(prevctl, CFG_CTL);
+
+    // and destroy them once no datapath thread can be using them
+    epochRetire(retireMtc, prevmtc);
+    epochRetire(retireLog, prevlog);
+    epochRetire(retireCtl, prevctl);
+
+    // The new ctl's connection is the one to watch, even at the same address
+    g_wait.ctltrans = NULL;
 }
 
 // Process dynamic config change if they are available
@@ -776,40 +1181,38 @@ dynConfig(void)
     FILE *fs;
     time_t now;
     char *path;
+    struct stat sb;
     char userpath[PATH_MAX];
     char clipath[PATH_MAX];
-    static time_t modtime = 0;
+    static time_t modtime = 0;      // of a file we couldn't remove
 
     scope_snprintf(userpath, sizeof(userpath), "%s/%s.%d", g_cmddir, DYN_CONFIG_PREFIX, g_proc.pid);
     scope_snprintf(clipath, sizeof(clipath), "%s/%s.%d", DYN_CONFIG_CLI_DIR, DYN_CONFIG_CLI_PREFIX, g_proc.pid);
 
-    // Is there a command file for this pid
-    if (osIsFilePresent(userpath) != -1) {
+    // Is there a command file for this pid; open it if there is
+    if ((fs = scope_fopen(userpath, "r")) != NULL) {
         path = userpath;
-    } else if (osIsFilePresent(clipath) != -1) {
+    } else if ((fs = scope_fopen(clipath, "r")) != NULL) {
         path = clipath;
     } else {
         return 0;
     }
 
     // Have we already processed this file?
-    now = fileModTime(path);
-    if (now == modtime) {
+    // STATMODTIME from os.h as timespec names are different between OSs
+    now = (scope_fstat(scope_fileno(fs), &sb) == 0) ? STATMODTIME(sb) : 0;
+    if (modtime && (now == modtime)) {
         // Been there, try to remove the file and we're done
+        scope_fclose(fs);
         scope_unlink(path);
         return 0;
     }
 
-    modtime = now;
-
-    // Open the command file
-    if ((fs = scope_fopen(path, "r")) == NULL) return -1;
-
     // Modify the static config from the command file
     cfgProcessCommands(g_staticfg, fs);
 
     scope_fclose(fs);
-    scope_unlink(path);
+    modtime = (scope_unlink(path) == -1) ? now : 0;
 
     // Apply the config
     doConfig(g_staticfg);
@@ -1002,6 +1405,10 @@ doReset(void)
     g_thread.startTime = tv.tv_sec + g_thread.interval;
 
     resetState();
+    pcreCtxReset();
+
+    // The parent's threads, and any sections they were in, didn't come along
+    epochReset();
 
     // set stdout/stderr to unknown
     setFSContentType(STDOUT_FILENO, FS_CONTENT_UNKNOWN);
@@ -1012,6 +1419,10 @@ doReset(void)
     ctlReconnect(g_ctl, CFG_CTL);
     ctlReconnect(g_ctl, CFG_LS);
 
+    // What the parent's periodic thread waited on isn't ours to touch
+    ctlWakeupSet(g_ctl, -1);
+    waitClose();
+
     atomicCasU64(&reentrancy_guard, 1ULL, 0ULL);
 
     reportProcessStart(g_ctl, TRUE, CFG_WHICH_MAX);
@@ -1028,10 +1439,16 @@ reportPeriodicStuff(void)
     // aggregate and send http metrics
     doHttpAgg();
 
+    // send dns responses that were counted rather than reported
+    doDNSAgg();
+
     // empty the event queues
     doEvent();
     doPayload();
 
+    // the queues give back memory they went the whole period without
+    doQueueTrim();
+
     if (cfgMtcWatchEnable(g_cfg.staticfg, CFG_MTC_PROC)) {
         doProcMetric(PROC_CPU);
         doProcMetric(PROC_MEM);
@@ -1084,6 +1501,10 @@ handleExit(void)
     if (g_exitdone == TRUE) return;
     g_exitdone = TRUE;
 
+    // The periodic thread may be part way through reclaiming; what we use
+    // from here on has to stay put
+    EPOCH_SECTION();
+
     if (!atomicCasU64(&reentrancy_guard, 0ULL, 1ULL)) {
 
         // Regardless of whether TLS is being used, we need an upper
@@ -1128,6 +1549,7 @@ handleExit(void)
 
     mtcFlush(g_mtc);
     mtcDisconnect(g_mtc);
+    mtcShmRemove();
     ctlFlush(g_ctl);
     ctlDisconnect(g_ctl, CFG_LS);
     ctlDisconnect(g_ctl, CFG_CTL);
@@ -1224,21 +1646,21 @@ periodic(void *arg)
 
     perf = checkEnv(PRESERVE_PERF_REPORTING, "true");
 
+    waitInit();
+
     while (1) {
         // we are trying to exit, do nothing
         if (g_exitdone == TRUE) {
             while (1) sched_yield();
         }
 
+        // g_ctl is replaced with each new config
+        ctlWakeupSet(g_ctl, g_wait.wakefd);
+
         scope_gettimeofday(&tv, NULL);
         if (tv.tv_sec >= summaryTime) {
-            // Process dynamic config changes, if any
-            dynConfig();
-
-            // TODO: need to ensure that the previous object is no longer in use
-            // Clean up previous objects if they exist.
-            //if (g_prevmtc) mtcDestroy(&g_prevmtc);
-            //if (g_prevlog) logDestroy(&g_prevlog);
+            // Process dynamic config changes, if any, unless we'd be told
+            if (g_wait.cfgdirfd == -1) dynConfig();
 
             // Q: What does it mean to connect transports we expect to be
             // "connectionless"?  A: We've observed some processes close all
@@ -1264,6 +1686,9 @@ periodic(void *arg)
                 logReportTime = tv.tv_sec + CONN_LOG_INTERVAL; 
             }
 
+            // Anything left on the IPC queue that didn't wake us
+            if (g_wait.ipcfd != (mqd_t)-1) ipcCommunication(g_wait.ipcfd, &g_wait.ipcoutfd);
+
         } else if (perf == FALSE) {
             if (atomicCasU64(&reentrancy_guard, 0ULL, 1ULL)) {
                 doEvent();
@@ -1271,8 +1696,11 @@ periodic(void *arg)
                 atomicCasU64(&reentrancy_guard, 1ULL, 0ULL);
             }
         }
-        remoteConfig();
-        ipcCommunication();
+
+        // Destroy what earlier configs replaced, as soon as that's safe
+        bool retired = (epochReclaim() != 0);
+
+        waitForWork(waitTimeout(summaryTime, perf, retired));
     }
 
     return NULL;
@@ -1432,11 +1860,7 @@ hookSharedObjs(struct dl_phdr_info *info, size_t size, void *data)
 {
     if (!info || !data || !info->dlpi_name) return FALSE;
 
-    struct link_map *lm;
-    Elf64_Sym *sym = NULL;
-    Elf64_Rela *rel = NULL;
-    char *str = NULL;
-    int rsz = 0;
+    hook_pass_t *pass = data;
     const char *libname = NULL;
 
     // don't attempt to hook libscope.so, libc*.so, ld-*.so
@@ -1455,17 +1879,7 @@ hookSharedObjs(struct dl_phdr_info *info, size_t size, void *data)
     void *handle = g_fn.dlopen(libname, RTLD_LAZY);
     if (handle == NULL) return FALSE;
 
-    // Get the link map and ELF sections in advance of something matching
-    if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) && (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
-        for (int i=0; inject_hook_list[i].symbol; i++) {
-
-            if ((dlsym(handle, inject_hook_list[i].symbol)) &&
-                (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, TRUE) != -1)) {
-                    scopeLog(CFG_LOG_DEBUG, "\tGOT patched %s from shared obj %s",
-                             inject_hook_list[i].symbol, info->dlpi_name);
-            }
-        }
-    }
+    hookObject(handle, info->dlpi_name, TRUE, TRUE, pass->maps);
 
     dlclose(handle);
     return FALSE;
@@ -1485,7 +1899,9 @@ hookInject(void)
             return FALSE;
         }
 
-        dl_iterate_phdr(hookSharedObjs, libscopeHandle);
+        hook_pass_t pass = {.rules = TRUE, .maps = osMapsCreate()};
+        dl_iterate_phdr(hookSharedObjs, &pass);
+        osMapsDestroy(&pass.maps);
         dlclose(libscopeHandle);
 
         return TRUE;
@@ -1520,8 +1936,10 @@ initHook(int attachedFlag, bool scopedFlag, elf_buf_t *ebuf, char *full_path)
         hookInject();
     } else {
         // GOT hooking all interposed funcs
-        dl_iterate_phdr(hookAll, &scopedFlag);
-        hookMain(scopedFlag);
+        hook_pass_t pass = {.rules = scopedFlag, .maps = osMapsCreate()};
+        dl_iterate_phdr(hookAll, &pass);
+        hookMain(pass.rules, pass.maps);
+        osMapsDestroy(&pass.maps);
     }
 
     // libmusl
@@ -3481,6 +3899,8 @@ isAnAppScopeConnection(int fd)
 {
     if (fd == -1) return FALSE;
 
+    EPOCH_SECTION();
+
     if ((fd == ctlConnection(g_ctl, CFG_CTL)) ||
         (fd == ctlConnection(g_ctl, CFG_LS)) ||
         (fd == mtcConnection(g_mtc)) ||
@@ -3491,6 +3911,18 @@ isAnAppScopeConnection(int fd)
     return FALSE;
 }
 
+// The app is about to put something else on fd, one of our connections
+static void
+releaseAppScopeConnection(int fd)
+{
+    EPOCH_SECTION();
+
+    if (fd == ctlConnection(g_ctl, CFG_CTL)) ctlDisconnect(g_ctl, CFG_CTL);
+    if (fd == ctlConnection(g_ctl, CFG_LS)) ctlDisconnect(g_ctl, CFG_LS);
+    if (fd == mtcConnection(g_mtc)) mtcDisconnect(g_mtc);
+    if (fd == logConnection(g_log)) logDisconnect(g_log);
+}
+
 /*
  * Process the sedmmmsg depending on return status of operation
  * and value of msgvec
@@ -4238,7 +4670,6 @@ EXPORTOFF void *
 dlopen(const char *filename, int flags)
 {
     void *handle;
-    struct link_map *lm;
     char fbuf[256];
 
     fbuf[0] = '\0';
@@ -4255,9 +4686,8 @@ dlopen(const char *filename, int flags)
 
     /*
      * Attempting to hook a number of GOT entries based on a static list.
-     * Get the link map and the ELF sections once since they are used for
-     * all symbols. Then loop over the list to locate and hook appropriate
-     * GOT entries.
+     * hookObject() gets the link map and the ELF sections then makes one
+     * pass over the relocations to locate and hook appropriate GOT entries.
      */
     handle = g_fn.dlopen(filename, flags);
 
@@ -4265,24 +4695,9 @@ dlopen(const char *filename, int flags)
     if (flags & RTLD_NOLOAD) return handle;
 
     if (handle) {
-        Elf64_Sym *sym = NULL;
-        Elf64_Rela *rel = NULL;
-        char *str = NULL;
-        int i, rsz = 0;
-
-        // Get the link map and ELF sections in advance of something matching
-        if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) &&
-            (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
-            scopeLog(CFG_LOG_DEBUG, "\tlibrary:  %s", lm->l_name);
-
-            // for each symbol in the list try to hook
-            for (i=0; inject_hook_list[i].symbol; i++) {
-                if ((dlsym(handle, inject_hook_list[i].symbol)) &&
-                    (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, TRUE) != -1)) {
-                    scopeLog(CFG_LOG_DEBUG, "\tdlopen interposed  %s", inject_hook_list[i].symbol);
-                }
-            }
-        }
+        os_maps_t *maps = osMapsCreate();
+        hookObject(handle, (filename) ? filename : "main", TRUE, TRUE, maps);
+        osMapsDestroy(&maps);
     }
 
     return handle;
@@ -5146,12 +5561,7 @@ dup2(int oldfd, int newfd)
 {
     WRAP_CHECK(dup2, -1);
 
-    if (isAnAppScopeConnection(newfd)) {
-        if (newfd == ctlConnection(g_ctl, CFG_CTL)) ctlDisconnect(g_ctl, CFG_CTL);
-        if (newfd == ctlConnection(g_ctl, CFG_LS)) ctlDisconnect(g_ctl, CFG_LS);
-        if (newfd == mtcConnection(g_mtc)) mtcDisconnect(g_mtc);
-        if (newfd == logConnection(g_log)) logDisconnect(g_log);
-    }
+    if (isAnAppScopeConnection(newfd)) releaseAppScopeConnection(newfd);
 
     int rc = g_fn.dup2(oldfd, newfd);
 
@@ -5165,12 +5575,7 @@ dup3(int oldfd, int newfd, int flags)
 {
     WRAP_CHECK(dup3, -1);
 
-    if (isAnAppScopeConnection(newfd)) {
-        if (newfd == ctlConnection(g_ctl, CFG_CTL)) ctlDisconnect(g_ctl, CFG_CTL);
-        if (newfd == ctlConnection(g_ctl, CFG_LS)) ctlDisconnect(g_ctl, CFG_LS);
-        if (newfd == mtcConnection(g_mtc)) mtcDisconnect(g_mtc);
-        if (newfd == logConnection(g_log)) logDisconnect(g_log);
-    }
+    if (isAnAppScopeConnection(newfd)) releaseAppScopeConnection(newfd);
 
     int rc = g_fn.dup3(oldfd, newfd, flags);
     doDup2(oldfd, newfd, rc, "dup3");
@@ -5835,6 +6240,8 @@ scopeLog(cfg_log_level_t level, const char *format, ...)
     struct tm tm_info;
     struct timeval tv;
 
+    EPOCH_SECTION();
+
     if (!g_log) {
         if (!g_constructor_debug_enabled) return;
         local_buf = scope_log_var_buf + scope_snprintf(scope_log_var_buf, LOG_BUF_SIZE, "Constructor: (pid:%d): ", scope_getpid());
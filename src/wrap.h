@@ -8,7 +8,12 @@
 
 #define DYN_CONFIG_PREFIX "scope"
 #define MAXTRIES 10
+#define REMOTE_RECV_SIZE 1024
+#define REMOTE_REQ_MAX (1024 * 1024)
 #define CONN_LOG_INTERVAL 60
+#define PERIODIC_DRAIN_MS 1     // how often the periodic thread goes around while there's work
+#define MQUEUE_DIR "/dev/mqueue"
+#define MQUEUE_MAGIC 0x19800202 // its f_type; not in the uapi headers
 
 typedef struct nss_list_t {
     uint64_t id;
@@ -9,7 +9,10 @@
 
 #include "com.h"
 #include "dbg.h"
+#include "epoch.h"
 #include "gocontext.h"
+#include "goplan.h"
+#include "gosymtab.h"
 #include "linklist.h"
 #include "os.h"
 #include "state.h"
@@ -20,10 +23,6 @@
 #include "scopestdlib.h"
 #include "snapshot.h"
 
-#define GOPCLNTAB_MAGIC_112 0xfffffffb
-#define GOPCLNTAB_MAGIC_116 0xfffffffa
-#define GOPCLNTAB_MAGIC_118 0xfffffff0
-#define GOPCLNTAB_MAGIC_120 0xfffffff1
 #define SCOPE_STACK_SIZE (size_t)(32 * 1024)
 #define UNKNOWN_GO_VER (-1)
 #define MAX_SUPPORTED_GO_VER (20)
@@ -537,33 +536,6 @@ exit:
     scope_free(buf);
 }
 
-static bool
-match_assy_instruction(void *addr, char *mnemonic)
-{
-    csh dhandle = 0;
-    cs_arch arch;
-    cs_mode mode;
-    cs_insn *asm_inst = NULL;
-    unsigned int asm_count = 0;
-    uint64_t size = 32;
-    bool rc = FALSE;
-
-    arch = CS_ARCH;
-    mode = CS_MODE;
-
-    if (cs_open(arch, mode, &dhandle) != CS_ERR_OK) return FALSE;
-
-    asm_count = cs_disasm(dhandle, addr, size, (uint64_t)addr, 0, &asm_inst);
-    if (asm_count <= 0) return FALSE;
-
-    if (!scope_strcmp((const char*)asm_inst->mnemonic, mnemonic)) rc = TRUE;
-
-    if (asm_inst) cs_free(asm_inst, asm_count);
-    cs_close(&dhandle);
-
-    return rc;
-}
-
 static void *
 getGoVersionAddr(const char* buf)
 {
@@ -618,207 +590,6 @@ getGoVersionAddr(const char* buf)
     return go_build_ver_addr;
 }
 
-static Elf64_Addr
-getSym12(const void *pclntab_addr, char *sname)
-{
-    if ((!pclntab_addr) || (!sname)) return 0;
-
-    Elf64_Addr symaddr = 0;
-    uint64_t sym_count      = *((const uint64_t *)(pclntab_addr + 8));
-    const void *symtab_addr = pclntab_addr + 16;
-
-    for (int i = 0; i < sym_count; i++) {
-        uint64_t func_offset  = *((const uint64_t *)(symtab_addr + 8));
-        uint32_t name_offset  = *((const uint32_t *)(pclntab_addr + func_offset + 8));
-        uint64_t sym_addr     = *((const uint64_t *)(symtab_addr));
-        const char *func_name = (const char *)(pclntab_addr + name_offset);
-
-        if (scope_strcmp(sname, func_name) == 0) {
-            symaddr = sym_addr;
-            scopeLog(CFG_LOG_TRACE, "symbol found %s = 0x%08lx\n", func_name, sym_addr);
-            break;
-        }
-
-        symtab_addr += 16;
-    }
-
-    return symaddr;
-}
-
-static Elf64_Addr
-getSym16(const void *pclntab_addr, char *sname, char *altname, char *mnemonic)
-{
-    if ((!pclntab_addr) || (!sname)) return 0;
-
-    Elf64_Addr symaddr = 0;
-    uint64_t sym_count = *((const uint64_t *)(pclntab_addr + 8));
-    uint64_t funcnametab_offset = *((const uint64_t *)(pclntab_addr + (3 * 8)));
-    uint64_t pclntab_offset = *((const uint64_t *)(pclntab_addr + (7 * 8)));
-    const void *symtab_addr = pclntab_addr + pclntab_offset;
-
-    for (int i = 0; i < sym_count; i++) {
-        uint64_t func_offset = *((const uint64_t *)(symtab_addr + 8));
-        uint32_t name_offset = *((const uint32_t *)(pclntab_addr + pclntab_offset + func_offset + 8));
-        uint64_t sym_addr = *((const uint64_t *)(symtab_addr));
-        const char *func_name = (const char *)(pclntab_addr + funcnametab_offset + name_offset);
-
-        if (scope_strcmp(sname, func_name) == 0) {
-            symaddr = sym_addr;
-            scopeLog(CFG_LOG_TRACE, "symbol found %s = 0x%08lx\n", func_name, sym_addr);
-            break;
-        }
-
-        // In go 1.17+ we need to ensure we find the correct symbol in the case of ambiguity
-        if (altname && mnemonic &&
-            (scope_strcmp(altname, func_name) == 0) &&
-            (match_assy_instruction((void *)sym_addr, mnemonic) == TRUE)) {
-            symaddr = sym_addr;
-            break;
-        }
-
-        symtab_addr += 16;
-    }
-
-    return symaddr;
-}
-
-static Elf64_Addr
-getSym1820(const void *pclntab_addr, char *sname, char *altname, char *mnemonic)
-{
-    if ((!pclntab_addr) || (!sname)) return 0;
-
-    Elf64_Addr symaddr = 0;
-    uint64_t sym_count = *((const uint64_t *)(pclntab_addr + 8));
-    // In go 1.18 the funcname table and the pcln table are stored in the text section
-    uint64_t text_start = *((const uint64_t *)(pclntab_addr + (3 * 8)));
-    uint64_t funcnametab_offset = *((const uint64_t *)(pclntab_addr + (4 * 8)));
-    //uint64_t funcnametab_addr = (uint64_t)(funcnametab_offset + pclntab_addr);
-    uint64_t pclntab_offset = *((const uint64_t *)(pclntab_addr + (8 * 8)));
-    // A "symbtab" is an entry in the pclntab, probably better known as a pcln
-    const void *symtab_addr = (const void *)(pclntab_addr + pclntab_offset);
-
-    for (int i = 0; i < sym_count; i++) {
-        uint32_t func_offset = *((uint32_t *)(symtab_addr + 4));
-        uint32_t name_offset = *((const uint32_t *)(pclntab_addr + pclntab_offset + func_offset + 4));
-        func_offset = *((uint32_t *)(symtab_addr));
-        uint64_t sym_addr = (uint64_t)(func_offset + text_start);
-        const char *func_name = (const char *)(pclntab_addr + funcnametab_offset + name_offset);
-        if (scope_strcmp(sname, func_name) == 0) {
-            symaddr = sym_addr;
-            scopeLog(CFG_LOG_ERROR, "symbol found %s = 0x%08lx\n", func_name, sym_addr);
-            break;
-        }
-
-        // In go 1.17+ we need to ensure we find the correct symbol in the case of ambiguity
-        if (altname && mnemonic &&
-            (scope_strcmp(altname, func_name) == 0) &&
-            (match_assy_instruction((void *)sym_addr, mnemonic) == TRUE)) {
-            symaddr = sym_addr;
-            break;
-        }
-
-        symtab_addr += 8;
-    }
-
-    return symaddr;
-}
-
-static Elf64_Addr
-embedPclntab(const char *buf, char *sname, char *altname, char *mnemonic)
-{
-    Elf64_Addr symaddr = 0;
-    Elf64_Ehdr *ehdr = (Elf64_Ehdr *)buf;
-    Elf64_Shdr *sections = (Elf64_Shdr *)(buf + ehdr->e_shoff);
-    const char *section_strtab = (char *)buf + sections[ehdr->e_shstrndx].sh_offset;
-
-    for (int i = 0; i < ehdr->e_shnum; i++) {
-        const char *sec_name = section_strtab + sections[i].sh_name;
-        if (scope_strstr(sec_name, "data.rel.ro") != 0) {
-
-            const void *pclntab_addr = buf + sections[i].sh_offset;
-            unsigned char *data = (unsigned char *)pclntab_addr;
-            size_t slen = sections[i].sh_size;
-            size_t j;
-
-            // Find the magic number in the pclntab header
-            for (j = 0; j <= slen; j += 4) { //0x3c8c80
-                if (((data[j] == 0xf1) || (data[j] == 0xf0) ||
-                     (data[j] == 0xfa) || (data[j] == 0xfb)) &&
-                    data[j+1] == 0xff &&
-                    data[j+2] == 0xff &&
-                    data[j+3] == 0xff) {
-                        //sysprint("%s:%d pclntab was recognized at %p\n",
-                        //             __FUNCTION__, __LINE__, &data[j]);
-
-                        switch (data[j]) {
-                            // Go 18 - 20
-                        case 0xf1:
-                        case 0xf0:
-                            return getSym1820(&data[j], sname, altname, mnemonic);
-                            // Go 16
-                        case 0xfa:
-                            return getSym16(&data[j], sname, altname, mnemonic);
-                            // Go 12
-                        case 0xfb:
-                            return getSym12(&data[j], sname);
-                        }
-                }
-            }
-        }
-    }
-
-    return symaddr;
-}
-
-static void *
-getGoSymbol(const char *buf, char *sname, char *altname, char *mnemonic)
-{
-    int i;
-    bool found = FALSE;
-    Elf64_Addr symaddr = 0;
-    Elf64_Ehdr *ehdr;
-    Elf64_Shdr *sections;
-    const char *section_strtab = NULL;
-    const char *sec_name = NULL;
-
-    if (!buf || !sname) return NULL;
-
-    ehdr = (Elf64_Ehdr *)buf;
-    sections = (Elf64_Shdr *)((char *)buf + ehdr->e_shoff);
-    section_strtab = (char *)buf + sections[ehdr->e_shstrndx].sh_offset;
-
-    for (i = 0; i < ehdr->e_shnum; i++) {
-        sec_name = section_strtab + sections[i].sh_name;
-        if (scope_strstr(sec_name, ".gopclntab")) {
-            found = TRUE;
-            const void *pclntab_addr = buf + sections[i].sh_offset;
-            /*
-             * The Go symbol table is stored in the .gopclntab section
-             * More info: https://docs.google.com/document/d/1lyPIbmsYbXnpNj57a261hgOYVpNRcgydurVQIyZOz_o/pub
-             */
-            uint32_t magic = *((const uint32_t *)(pclntab_addr));
-            if (magic == GOPCLNTAB_MAGIC_112) {
-                symaddr = getSym12(pclntab_addr, sname);
-            } else if (magic == GOPCLNTAB_MAGIC_116) {
-                symaddr = getSym16(pclntab_addr, sname, altname, mnemonic);
-            } else if ((magic == GOPCLNTAB_MAGIC_118) || (magic == GOPCLNTAB_MAGIC_120)) {
-                symaddr = getSym1820(pclntab_addr, sname, altname, mnemonic);
-            } else {
-                scopeLog(CFG_LOG_DEBUG, "Invalid header in .gopclntab");
-                break;
-            }
-            break;
-        }
-    }
-
-    // if no .gopclntab section was found, check embedded
-    if ((found == FALSE) && ((symaddr = embedPclntab(buf, sname, altname, mnemonic)) == 0)) {
-        return NULL;
-    }
-
-    return (void *)symaddr;
-}
-
 // Detect the beginning of a Go Function
 // by identifying instructions in the preamble.
 static bool
@@ -882,10 +653,59 @@ add_argument(cs_insn* asm_inst)
     return 0;
 }
 
+/*
+ * Patch the instruction at addr to call the tap's handler.  The patch
+ * is added to the plan, if there is one, so it can be replayed on the
+ * next start of this executable.
+ */
+static bool
+patch_at(funchook_t *funchook, tap_t *tap, void *addr, uint32_t frame_size,
+         go_patch_kind_t kind, go_plan_t **plan, uint64_t base)
+{
+    void *patch_addr = addr;
+
+    if (funchook_prepare(funchook, (void**)&patch_addr, tap->assembly_fn)) {
+        patchprint("failed to patch 0x%p with frame size 0x%x\n", addr, frame_size);
+        return FALSE;
+    }
+
+    patchprint("patched 0x%p with frame size 0x%x in func %s\n", addr, frame_size, (char *)tap->func_name);
+    tap->return_addr = patch_addr;
+    tap->frame_size = frame_size;
+
+    if (kind == GO_PATCH_SYSCALL) {
+        /*
+         * Initialize return addrs for the syscall functions.
+         * The assy stub will use these when we filter syscalls.
+         */
+        if (tap->assembly_fn == go_hook_reg_syscall) {
+            g_syscall_return = (uint64_t)tap->return_addr;
+        } else if (tap->assembly_fn == go_hook_reg_rawsyscall) {
+            g_rawsyscall_return = (uint64_t)tap->return_addr;
+        } else if (tap->assembly_fn == go_hook_reg_syscall6) {
+            g_syscall6_return = (uint64_t)tap->return_addr;
+        }
+    }
+
+    if (plan && *plan) {
+        go_patch_t patch = {
+            .addr = (uint64_t)addr - base,
+            .frameSize = frame_size,
+            .tap = tap - g_go_schema->tap,
+            .kind = kind,
+        };
+        // An incomplete plan is no use
+        if (!goPlanAdd(*plan, &patch)) goPlanDestroy(plan);
+    }
+
+    return TRUE;
+}
+
 // Patch all intended addresses
 static void
 patch_addrs(funchook_t *funchook,
-            cs_insn* asm_inst, unsigned int asm_count, tap_t* tap)
+            cs_insn* asm_inst, unsigned int asm_count, tap_t* tap,
+            go_plan_t **plan, uint64_t base)
 {
     if (!funchook || !asm_inst || !asm_count || !tap) return;
 
@@ -915,46 +735,20 @@ patch_addrs(funchook_t *funchook,
                        (tap->assembly_fn == go_hook_sighandler))) {
 
             // In this case we want to patch the instruction directly
-            void *pre_patch_addr = (void*)asm_inst[i].address;
-            void *patch_addr = (void*)asm_inst[i].address;
-
-            if (funchook_prepare(funchook, (void**)&patch_addr, tap->assembly_fn)) {
-                patchprint("failed to patch 0x%p with frame size 0x%x\n", pre_patch_addr, add_arg);
+            if (!patch_at(funchook, tap, (void*)asm_inst[i].address, add_arg,
+                          GO_PATCH_FIRST, plan, base)) {
                 continue;
             }
-
-            patchprint("patched 0x%p with frame size 0x%x\n", pre_patch_addr, add_arg);
-            tap->return_addr = patch_addr;
-            tap->frame_size = add_arg;
             break; // Done patching
         }
 
         // PATCH SYSCALLS
         if (!scope_strcmp((const char*)asm_inst[i].mnemonic, SYSCALL_INST)) {
             // In the "syscall" case, we want to patch the instruction directly
-            void *pre_patch_addr = (void*)asm_inst[i].address;
-            void *patch_addr = (void*)asm_inst[i].address;
-
-            if (funchook_prepare(funchook, (void**)&patch_addr, tap->assembly_fn)) {
-                patchprint("failed to patch 0x%p with frame size 0x%x\n", pre_patch_addr, add_arg);
+            if (!patch_at(funchook, tap, (void*)asm_inst[i].address, add_arg,
+                          GO_PATCH_SYSCALL, plan, base)) {
                 continue;
             }
-
-            patchprint("patched 0x%p with frame size 0x%x in func %s\n", pre_patch_addr, add_arg, (char *)tap->func_name);
-            tap->return_addr = patch_addr;
-            tap->frame_size = add_arg;
-
-            /*
-             * Initialize return addrs for the syscall functions.
-             * The assy stub will use these when we filter syscalls.
-             */
-            if (tap->assembly_fn == go_hook_reg_syscall) {
-                g_syscall_return = (uint64_t)tap->return_addr;
-            } else if (tap->assembly_fn == go_hook_reg_rawsyscall) {
-                g_rawsyscall_return = (uint64_t)tap->return_addr;
-            } else if (tap->assembly_fn == go_hook_reg_syscall6) {
-                g_syscall6_return = (uint64_t)tap->return_addr;
-            }
             break; // Done patching
         }
 
@@ -973,18 +767,10 @@ patch_addrs(funchook_t *funchook,
                 (asm_inst[i].size == CALL_SIZE)) {
                 // TODO: why the + 1?
                 // In the "call" case, we want to patch the instruction after the call
-                void *pre_patch_addr = (void*)asm_inst[i+1].address;
-                void *patch_addr = (void*)asm_inst[i+1].address;
-
-                if (funchook_prepare(funchook, (void**)&patch_addr, tap->assembly_fn)) {
-                    patchprint("failed to patch 0x%p with frame size 0x%x\n", pre_patch_addr, add_arg);
+                if (!patch_at(funchook, tap, (void*)asm_inst[i+1].address, add_arg,
+                              GO_PATCH_CALL, plan, base)) {
                     continue;
                 }
-
-                patchprint("patched 0x%p with frame size 0x%x\n", pre_patch_addr, add_arg);
-                tap->return_addr = patch_addr;
-                tap->frame_size = add_arg;
-
                 break; // Done patching
             }
         }
@@ -999,26 +785,31 @@ patch_addrs(funchook_t *funchook,
                 (add_arg = add_argument(&asm_inst[i-1]))) {
             // In the "ret" case, we want to patch previous instruction (to maintain the callee stack context)
             void *pre_patch_addr = (void*)asm_inst[i-1].address;
-            void *patch_addr = (void*)asm_inst[i-1].address;
 
             if (tap->frame_size && (tap->frame_size != add_arg)) {
                 patchprint("aborting patch of 0x%p due to mismatched frame size 0x%x\n", pre_patch_addr, add_arg);
                 break;
             }
-            if (funchook_prepare(funchook, (void**)&patch_addr, tap->assembly_fn)) {
-                patchprint("failed to patch 0x%p with frame size 0x%x\n", pre_patch_addr, add_arg);
-                continue;
-            }
-
-            patchprint("patched 0x%p with frame size 0x%x\n", pre_patch_addr, add_arg);
-            tap->return_addr = patch_addr;
-            tap->frame_size = add_arg;
+            patch_at(funchook, tap, pre_patch_addr, add_arg, GO_PATCH_RET, plan, base);
             // Note: no break here so as to locate multiple return instructions
         }
     }
     patchprint("\n\n");
 }
 
+// Replay the patches of a plan saved by an earlier start
+static void
+patch_plan(funchook_t *funchook, go_plan_t *plan, uint64_t base)
+{
+    size_t i;
+    for (i = 0; i < goPlanCount(plan); i++) {
+        const go_patch_t *patch = goPlanPatch(plan, i);
+        tap_t *tap = &g_go_schema->tap[patch->tap];
+        patch_at(funchook, tap, (void *)(patch->addr + base), patch->frameSize,
+                 patch->kind, NULL, base);
+    }
+}
+
 #if 0
 static void
 patchClone(void)
@@ -1092,14 +883,13 @@ go_version_numbers(const char *go_runtime_version)
  * try the symbol with extension.
  */
 static void *
-tryAbi0(const char *buf, char *sname)
+tryAbi0(go_symtab_t *symtab, char *sname)
 {
-    if (!buf || !sname) return NULL;
+    if (!symtab || !sname) return NULL;
 
     size_t slen = scope_strlen(sname);
     if (slen == 0) return NULL;
 
-    void *funcaddr = NULL;
     char abi0name[slen + sizeof(".abi0 ")];
 
     scope_memset(abi0name, 0, sizeof(abi0name));
@@ -1109,12 +899,142 @@ tryAbi0(const char *buf, char *sname)
     funcprint("%s:%d %s (%ld) %s\n", __FUNCTION__, __LINE__, sname, slen, abi0name);
 
     // Look for the symbol in the elf strtab, then meta data; .gopclntab section
-    if (((funcaddr = getSymbol(buf, abi0name)) == 0) &&
-        ((funcaddr = getGoSymbol(buf, abi0name, NULL, NULL)) == 0)) {
-        return NULL;
+    return goSymtabFind(symtab, abi0name);
+}
+
+/*
+ * Index every name initGoHook() may look up, so that the symbol tables
+ * of the executable are walked once rather than once per name.
+ */
+static go_symtab_t *
+createGoSymtab(elf_buf_t *ebuf, const char *readframe, const char *gosave)
+{
+    size_t num = 2;
+    tap_t *tap;
+    for (tap = g_go_schema->tap; tap->assembly_fn; tap++) num += 2;
+
+    const char *names[num];
+    char *abi0names[num];
+    size_t i = 0, j = 0;
+
+    names[i++] = readframe;
+    names[i++] = gosave;
+    for (tap = g_go_schema->tap; tap->assembly_fn; tap++) {
+        names[i++] = tap->func_name;
+        if (scope_asprintf(&abi0names[j], "%s.abi0", tap->func_name) != -1) {
+            names[i++] = abi0names[j++];
+        }
     }
 
-    return funcaddr;
+    go_symtab_t *symtab = goSymtabCreate(ebuf->buf, names, i);
+
+    while (j) scope_free(abi0names[--j]);
+    return symtab;
+}
+
+/*
+ * Find where to patch each tap's function; the slow path when there's
+ * no saved patch plan.  Resolves the functions, disassembles them and
+ * prepares the patches, recording each in the plan.
+ */
+static bool
+findGoPatches(funchook_t *funchook, elf_buf_t *ebuf, uint64_t base,
+              const char *go_runtime_version, go_plan_t **plan)
+{
+    char *readframe = "net/http.(*http2Framer).ReadFrame";
+    char gosave[30] = "gosave";
+    if (g_go_minor_ver >= 17) scope_strcpy(gosave, "gosave_systemstack_switch");
+
+    uint64_t symStart = getTime();
+    go_symtab_t *symtab = createGoSymtab(ebuf, readframe, gosave);
+    uint64_t symDuration = getDuration(symStart);
+
+    uint64_t *ReadFrame_addr;
+    if ((ReadFrame_addr = goSymtabFind(symtab, readframe)) == 0) {
+        sysprint("WARN: can't get the address for %s\n", readframe);
+    }
+
+    ReadFrame_addr = (uint64_t *)((uint64_t)ReadFrame_addr + base);
+    scope_snprintf(g_ReadFrame_addr, sizeof(g_ReadFrame_addr), "%p\n", ReadFrame_addr);
+
+    if ((go_systemstack_switch = (uint64_t)goSymtabFind(symtab, gosave)) == 0) {
+        sysprint("WARN: can't get the address for %s\n", gosave);
+    }
+    goPlanSetSystemStack(*plan, go_systemstack_switch);
+    go_systemstack_switch = (uint64_t)((char *)go_systemstack_switch + base);
+    sysprint("address for gosave_systemstack_switch: 0x%lx\n", go_systemstack_switch);
+
+    csh disass_handle = 0;
+    cs_arch arch;
+    cs_mode mode;
+
+    arch = CS_ARCH;
+    mode = CS_MODE;
+
+    if (cs_open(arch, mode, &disass_handle) != CS_ERR_OK) {
+        goSymtabDestroy(&symtab);
+        return FALSE;
+    }
+
+    cs_insn *asm_inst = NULL;
+    unsigned int asm_count = 0;
+    int tapNum = 0, tapFound = 0;
+
+    uint64_t patchStart = getTime();
+    for (tap_t *tap = g_go_schema->tap; tap->assembly_fn; tap++) {
+        if (asm_inst) {
+            cs_free(asm_inst, asm_count);
+            asm_inst = NULL;
+            asm_count = 0;
+        }
+        tapNum++;
+
+        void *orig_func;
+        // Look for the symbol in the ELF symbol table, then the .gopclntab section
+        if (((orig_func = goSymtabFind(symtab, tap->func_name)) == NULL) &&
+            // check dynamic symbols; exec has been stripped
+            ((orig_func = getDynSymbol(ebuf->buf, tap->func_name)) == NULL) &&
+            // is the symbol defined as an original API; with an abi0 extension
+            ((orig_func = tryAbi0(symtab, tap->func_name)) == NULL)) {
+            sysprint("WARN: can't get the address for %s\n", tap->func_name);
+            continue;
+        }
+        tapFound++;
+
+        uint64_t offset_into_txt = (uint64_t)orig_func - (uint64_t)ebuf->text_addr;
+        uint64_t text_len_left = ebuf->text_len - offset_into_txt;
+        uint64_t max_bytes = 4096;  // somewhat arbitrary limit.  Allows for
+                                  // >250 instructions @ 15 bytes/inst (x86_64)
+        uint64_t size = MIN(text_len_left, max_bytes); // limit size
+
+        orig_func = (void *) ((uint64_t)orig_func + base);
+        asm_count = cs_disasm(disass_handle, orig_func, size,
+                              (uint64_t)orig_func, 0, &asm_inst);
+        if (asm_count <= 0) {
+            sysprint("ERROR: disassembler fails: %s\n\tlen %" PRIu64 " code %p result %lu\n\ttext addr %p text len %zu oinfotext 0x%" PRIx64 "\n",
+                     tap->func_name, size,
+                     orig_func, sizeof(asm_inst), ebuf->text_addr, ebuf->text_len, offset_into_txt);
+            continue;
+        }
+
+        patchprint ("********************************\n");
+        patchprint ("** %s  %s %p **\n", go_runtime_version, tap->func_name, orig_func);
+        patchprint ("********************************\n");
+        patch_addrs(funchook, asm_inst, asm_count, tap, plan, base);
+    }
+    uint64_t patchDuration = getDuration(patchStart);
+
+    if (asm_inst) {
+        cs_free(asm_inst, asm_count);
+    }
+    cs_close(&disass_handle);
+
+    scopeLogInfo("Go hooks: found %d of %d functions in %" PRIu64 " us "
+                 "(%" PRIu64 " functions in the pclntab), disassembled in %" PRIu64 " us",
+                 tapFound, tapNum, symDuration / 1000, goSymtabFuncCount(symtab),
+                 patchDuration / 1000);
+    goSymtabDestroy(&symtab);
+    return TRUE;
 }
 
 void
@@ -1122,6 +1042,7 @@ initGoHook(elf_buf_t *ebuf)
 {
     if (!ebuf || !ebuf->buf) return;
 
+    uint64_t hookStart = getTime();
     int rc;
     funchook_t *funchook;
     char *go_ver;
@@ -1204,36 +1125,6 @@ initGoHook(elf_buf_t *ebuf)
         containerStart();
     }
 
-    uint64_t *ReadFrame_addr;
-    if (((ReadFrame_addr = getSymbol(ebuf->buf, "net/http.(*http2Framer).ReadFrame")) == 0) &&
-        ((ReadFrame_addr = getGoSymbol(ebuf->buf, "net/http.(*http2Framer).ReadFrame", NULL, NULL)) == 0)) {
-        sysprint("WARN: can't get the address for net/http.(*http2Framer).ReadFrame\n");
-    }
-
-    ReadFrame_addr = (uint64_t *)((uint64_t)ReadFrame_addr + base);
-    scope_snprintf(g_ReadFrame_addr, sizeof(g_ReadFrame_addr), "%p\n", ReadFrame_addr);
-
-    char gosave[30] = "gosave";
-    if (g_go_minor_ver >= 17) scope_strcpy(gosave, "gosave_systemstack_switch");
-    if (((go_systemstack_switch = (uint64_t)getSymbol(ebuf->buf, gosave)) == 0) &&
-        ((go_systemstack_switch = (uint64_t)getGoSymbol(ebuf->buf, gosave, NULL, NULL)) == 0)) {
-        sysprint("WARN: can't get the address for %s\n", gosave);
-    }
-    go_systemstack_switch = (uint64_t)((char *)go_systemstack_switch + base);
-    sysprint("address for gosave_systemstack_switch: 0x%lx\n", go_systemstack_switch);
-
-    csh disass_handle = 0;
-    cs_arch arch;
-    cs_mode mode;
-
-    arch = CS_ARCH;
-    mode = CS_MODE;
-
-    if (cs_open(arch, mode, &disass_handle) != CS_ERR_OK) return;
-
-    cs_insn *asm_inst = NULL;
-    unsigned int asm_count = 0;
-
     if (g_go_minor_ver >= 17) {
         // The Go 17 schema works for 1.17-1.19 and possibly future versions
         if (g_arch == X86_64) {
@@ -1251,60 +1142,41 @@ initGoHook(elf_buf_t *ebuf)
     // For validation tests:
     createGoStructFile();
 
-    for (tap_t *tap = g_go_schema->tap; tap->assembly_fn; tap++) {
-        if (asm_inst) {
-            cs_free(asm_inst, asm_count);
-            asm_inst = NULL;
-            asm_count = 0;
+    int tapNum = 0;
+    for (tap_t *tap = g_go_schema->tap; tap->assembly_fn; tap++) tapNum++;
+
+    char *planDir = fullGetEnv("SCOPE_GO_PLAN_DIR");
+    if (!planDir) planDir = GO_PLAN_DIR;
+    go_plan_t *plan = goPlanCreate(ebuf->buf, SCOPE_VER, tapNum);
+
+    if (goPlanLoad(plan, planDir)) {
+        // A warm start; nothing needs to be resolved or disassembled
+        go_systemstack_switch = goPlanSystemStack(plan) + base;
+        patch_plan(funchook, plan, base);
+        scopeLogInfo("Go hooks: replayed %zu patches from a saved patch plan", goPlanCount(plan));
+    } else if (findGoPatches(funchook, ebuf, base, go_runtime_version, &plan)) {
+        if (plan && !goPlanSave(plan, planDir)) {
+            scopeLogDebug("Go hooks: can't save a patch plan in %s", planDir);
         }
-
-        void *orig_func;
-        // Look for the symbol in the ELF symbol table
-        if (((orig_func = getSymbol(ebuf->buf, tap->func_name)) == NULL) &&
-            // look in the .gopclntab section
-            ((orig_func = getGoSymbol(ebuf->buf, tap->func_name, NULL, NULL)) == NULL) &&
-            // check dynamic symbols; exec has been stripped
-            ((orig_func = getDynSymbol(ebuf->buf, tap->func_name)) == NULL) &&
-            // is the symbol defined as an original API; with an abi0 extension
-            ((orig_func = tryAbi0(ebuf->buf, tap->func_name)) == NULL)) {
-            sysprint("WARN: can't get the address for %s\n", tap->func_name);
-            continue;
-        }
-
-        uint64_t offset_into_txt = (uint64_t)orig_func - (uint64_t)ebuf->text_addr;
-        uint64_t text_len_left = ebuf->text_len - offset_into_txt;
-        uint64_t max_bytes = 4096;  // somewhat arbitrary limit.  Allows for
-                                  // >250 instructions @ 15 bytes/inst (x86_64)
-        uint64_t size = MIN(text_len_left, max_bytes); // limit size
-
-        orig_func = (void *) ((uint64_t)orig_func + base);
-        asm_count = cs_disasm(disass_handle, orig_func, size,
-                              (uint64_t)orig_func, 0, &asm_inst);
-        if (asm_count <= 0) {
-            sysprint("ERROR: disassembler fails: %s\n\tlen %" PRIu64 " code %p result %lu\n\ttext addr %p text len %zu oinfotext 0x%" PRIx64 "\n",
-                     tap->func_name, size,
-                     orig_func, sizeof(asm_inst), ebuf->text_addr, ebuf->text_len, offset_into_txt);
-            continue;
-        }
-
-        patchprint ("********************************\n");
-        patchprint ("** %s  %s %p **\n", go_runtime_version, tap->func_name, orig_func);
-        patchprint ("********************************\n");
-        patch_addrs(funchook, asm_inst, asm_count, tap);
-    }
-
-    if (asm_inst) {
-        cs_free(asm_inst, asm_count);
+    } else {
+        goPlanDestroy(&plan);
+        funchook_destroy(funchook);
+        return;
     }
-    cs_close(&disass_handle);
+    goPlanDestroy(&plan);
 
     // hook a few Go funcs
+    uint64_t installStart = getTime();
     rc = funchook_install(funchook, 0);
+    uint64_t installDuration = getDuration(installStart);
     if (rc != 0) {
         sysprint("ERROR: funchook_install failed.  (%s)\n",
                 funchook_error_message(funchook));
         funchook_destroy(funchook);
     }
+
+    scopeLogInfo("Go hooks: installed in %" PRIu64 " us, %" PRIu64 " us total",
+                 installDuration / 1000, getDuration(hookStart) / 1000);
 }
 
 static void *
@@ -1888,6 +1760,7 @@ c_exit(char *sys_stack)
 
     // ensure the circular buffer is empty
     for (i = 0; i < 100; i++) {
+        EPOCH_SECTION();
         if (cmdCbufEmpty(g_ctl)) break;
         sigSafeNanosleep(&ts);
     }
@@ -0,0 +1,178 @@
+/*
+ * GOT hooking (attach) latency benchmark
+ *
+ * gotbench is linked against 200 small shared libraries (see lib/) so the
+ * process looks like a large application.  Each pass does what libscope
+ * does when it attaches: walk every loaded object and patch the GOT entries
+ * of the functions it interposes.  Passes are timed two ways; the way the
+ * hooking used to work, one scan of the relocations and one read of
+ * /proc/self/maps per hooked function, and the way it works now, one scan
+ * against a hash of the hooks with one snapshot of the maps.
+ *
+ * The GOT entries are "patched" with the address the dynamic linker would
+ * resolve them to so the process keeps working.
+ *
+ * Build and run from the top of the repo with `make libbench`.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <link.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "dbg.h"
+#include "os.h"
+#include "scopeelf.h"
+
+// These live in wrap.c, which isn't linked into the benchmark
+bool cmdAttach(void) { return TRUE; }
+bool cmdDetach(void) { return TRUE; }
+
+// The functions libscope interposes, from inject_hook_list in wrap.c
+static const char *g_symbols[] = {
+    "sigaction", "signal", "raise", "open", "openat", "fopen", "freopen",
+    "nanosleep", "select", "sigsuspend", "epoll_wait", "poll", "__poll_chk",
+    "pause", "sigwaitinfo", "sigtimedwait", "epoll_pwait", "ppoll",
+    "__ppoll_chk", "pselect", "msgsnd", "msgrcv", "semop", "semtimedop",
+    "clock_nanosleep", "usleep", "open64", "openat64", "__open_2",
+    "__open64_2", "__openat_2", "creat64", "fopen64", "freopen64", "pread64",
+    "__pread64_chk", "preadv", "preadv2", "preadv64v2", "__pread_chk",
+    "__read_chk", "__fread_unlocked_chk", "pwrite64", "pwritev", "pwritev64",
+    "pwritev2", "pwritev64v2", "lseek64", "fseeko64", "ftello64", "statfs64",
+    "fstatfs64", "fsetpos64", "__xstat", "__xstat64", "__lxstat",
+    "__lxstat64", "__fxstat", "__fxstatat", "__fxstatat64", "statfs",
+    "fstatfs", "statvfs", "statvfs64", "fstatvfs", "fstatvfs64", "access",
+    "faccessat", "gethostbyname_r", "gethostbyname2_r", "fstatat", "prctl",
+    "execve", "execv", "syscall", "sendfile", "sendfile64", "SSL_read",
+    "SSL_write", "gnutls_record_recv", "gnutls_record_recv_early_data",
+    "gnutls_record_recv_packet", "gnutls_record_recv_seq",
+    "gnutls_record_send", "gnutls_record_send2",
+    "gnutls_record_send_early_data", "gnutls_record_send_range", "dlopen",
+    "_exit", "close", "fclose", "fcloseall", "unlink", "unlinkat", "lseek",
+    "fseek", "fseeko", "ftell", "ftello", "rewind", "fsetpos", "fgetpos",
+    "fgetpos64", "write", "pwrite", "writev", "fwrite", "puts", "putchar",
+    "fputs", "fputs_unlocked", "read", "readv", "pread", "fread",
+    "__fread_chk", "fgets", "__fgets_chk", "fgets_unlocked", "__fgetws_chk",
+    "fgetws", "fgetwc", "fgetc", "fputc", "fputc_unlocked", "putwc",
+    "fputwc", "getline", "getdelim", "__getdelim", "fcntl", "fcntl64", "dup",
+    "dup2", "dup3", "vsyslog", "fork", "socket", "shutdown", "listen",
+    "accept", "accept4", "bind", "connect", "send", "sendto", "sendmsg",
+    "sendmmsg", "recv", "__recv_chk", "recvfrom", "__recvfrom_chk",
+    "recvmsg", "opendir", "closedir", "readdir", "gethostbyname",
+    "gethostbyname2", "getaddrinfo", "__fprintf_chk", "__memset_chk",
+    "__memcpy_chk", "__sprintf_chk", "__fdelt_chk", "__register_atfork",
+    "setrlimit", "SSL_ImportFD",
+};
+#define NUM_HOOKS (sizeof(g_symbols) / sizeof(g_symbols[0]))
+
+static got_list_t g_hook_list[NUM_HOOKS + 1];
+static got_list_t g_single_list[NUM_HOOKS][2];
+static got_hooks_t *g_single_hooks[NUM_HOOKS];
+static void *g_gfn[NUM_HOOKS];
+
+typedef struct {
+    bool per_hook;        // scan once per hook, as it used to be done
+    got_hooks_t *hooks;   // all hooks, for a single scan
+    os_maps_t *maps;
+    int objects;
+} pass_t;
+
+static bool
+hookFilter(got_list_t *hook, void *data)
+{
+    return hook->func && dlsym(data, hook->symbol);
+}
+
+static int
+hookObject(struct dl_phdr_info *info, size_t size, void *data)
+{
+    pass_t *pass = data;
+    const char *name = info->dlpi_name;
+
+    // like hookSharedObjs(), leave libc and ld.so alone
+    if (!name || !strstr(name, ".so") || strstr(name, "libc") || strstr(name, "ld-")) {
+        return 0;
+    }
+
+    void *handle = dlopen(name, RTLD_LAZY | RTLD_NOLOAD);
+    if (!handle) return 0;
+
+    struct link_map *lm;
+    Elf64_Sym *sym = NULL;
+    Elf64_Rela *rel = NULL;
+    char *str = NULL;
+    int rsz = 0;
+    if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) &&
+        (getElfEntries(lm, &rel, &sym, &str, &rsz, pass->maps) != -1)) {
+        if (pass->per_hook) {
+            int i;
+            for (i = 0; i < NUM_HOOKS; i++) {
+                doGotcha(lm, g_single_hooks[i], rel, sym, str, rsz, TRUE, NULL, hookFilter, handle);
+            }
+        } else {
+            doGotcha(lm, pass->hooks, rel, sym, str, rsz, TRUE, pass->maps, hookFilter, handle);
+        }
+        pass->objects++;
+    }
+
+    dlclose(handle);
+    return 0;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Returns msecs per attach
+static double
+runPasses(bool per_hook, got_hooks_t *hooks, int passes, int *objects)
+{
+    double start = now();
+    int i;
+    for (i = 0; i < passes; i++) {
+        pass_t pass = {.per_hook = per_hook, .hooks = hooks};
+        if (!per_hook) pass.maps = osMapsCreate();
+        dl_iterate_phdr(hookObject, &pass);
+        osMapsDestroy(&pass.maps);
+        *objects = pass.objects;
+    }
+    return (now() - start) / passes;
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    int i;
+    for (i = 0; i < NUM_HOOKS; i++) {
+        g_hook_list[i].symbol = g_symbols[i];
+        g_hook_list[i].func = dlsym(RTLD_DEFAULT, g_symbols[i]);
+        g_hook_list[i].gfn = &g_gfn[i];
+        g_single_list[i][0] = g_hook_list[i];
+        g_single_hooks[i] = gotHooksCreate(g_single_list[i]);
+    }
+    got_hooks_t *hooks = gotHooksCreate(g_hook_list);
+
+    // the first pass binds the GOT entries so every pass does the same work
+    int objects = 0;
+    runPasses(FALSE, hooks, 1, &objects);
+
+    double per_hook = runPasses(TRUE, NULL, 3, &objects);
+    double single = runPasses(FALSE, hooks, 50, &objects);
+
+    printf("%d objects, %zu hooks\n", objects, NUM_HOOKS);
+    printf("  %-36s %10.3f ms/attach\n", "scan and read maps per hook", per_hook);
+    printf("  %-36s %10.3f ms/attach\n", "single scan with maps snapshot", single);
+
+    for (i = 0; i < NUM_HOOKS; i++) {
+        gotHooksDestroy(&g_single_hooks[i]);
+    }
+    gotHooksDestroy(&hooks);
+    return 0;
+}
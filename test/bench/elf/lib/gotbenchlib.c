@@ -0,0 +1,62 @@
+/*
+ * One of the many shared libraries gotbench is linked against.  It's built
+ * once per library with a different LIBNUM so each has its own symbol.  It
+ * only needs PLT entries for the kind of functions libscope interposes; it
+ * is never called.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define GOTBENCH_FN2(n) gotbench_lib ## n
+#define GOTBENCH_FN(n) GOTBENCH_FN2(n)
+
+int
+GOTBENCH_FN(LIBNUM)(const char *path)
+{
+    char buf[64];
+    struct stat sbuf;
+    struct addrinfo *ai = NULL;
+    int rc = 0;
+
+    int fd = open(path, O_RDONLY);
+    rc += read(fd, buf, sizeof(buf));
+    rc += pread(fd, buf, sizeof(buf), 0);
+    rc += lseek(fd, 0, SEEK_SET);
+    rc += fstat(fd, &sbuf);
+    rc += dup2(dup(fd), fd);
+    rc += write(fd, buf, 0);
+    rc += close(fd);
+
+    FILE *fp = fopen(path, "r");
+    rc += fread(buf, 1, sizeof(buf), fp) + (fgets(buf, sizeof(buf), fp) != NULL);
+    rc += fwrite(buf, 1, 0, fp) + fseek(fp, 0, SEEK_SET) + ftell(fp);
+    rc += fclose(fp);
+
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+    rc += connect(sd, NULL, 0) + bind(sd, NULL, 0) + listen(sd, 1);
+    rc += accept(sd, NULL, NULL) + send(sd, buf, 0, 0) + recv(sd, buf, 0, 0);
+    rc += sendto(sd, buf, 0, 0, NULL, 0) + recvfrom(sd, buf, 0, 0, NULL, NULL);
+    rc += shutdown(sd, SHUT_RDWR);
+    rc += getaddrinfo(path, NULL, NULL, &ai);
+
+    struct pollfd pfd = {.fd = sd, .events = POLLIN};
+    rc += poll(&pfd, 1, 0);
+
+    DIR *dir = opendir(path);
+    rc += (readdir(dir) != NULL) + closedir(dir);
+
+    char *mem = malloc(sizeof(buf));
+    free(mem);
+    rc += access(path, R_OK) + unlink(path);
+
+    return rc;
+}
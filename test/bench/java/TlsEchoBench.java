@@ -0,0 +1,216 @@
+import java.io.EOFException;
+import java.io.IOException;
+import java.net.InetSocketAddress;
+import java.nio.ByteBuffer;
+import java.nio.channels.ServerSocketChannel;
+import java.nio.channels.SocketChannel;
+import javax.net.ssl.SSLContext;
+import javax.net.ssl.SSLEngine;
+import javax.net.ssl.SSLEngineResult;
+import javax.net.ssl.SSLEngineResult.HandshakeStatus;
+
+/*
+ * TLS echo throughput over loopback, using SSLEngine and SocketChannel
+ * with direct buffers; the path libscope intercepts in
+ * SSLEngineImpl.wrap()/unwrap().  Run like a JMH throughput benchmark:
+ * warmup iterations, then measured iterations, each reported in ops/s.
+ *
+ * usage: java TlsEchoBench [msgSize] [warmups] [iterations] [seconds]
+ * msgSize should fit in the loopback socket buffers; the echo is not
+ * read until the whole message is written.
+ * The key and trust stores come from the javax.net.ssl.* properties.
+ */
+public class TlsEchoBench {
+
+    static final class TlsChannel {
+        final SocketChannel ch;
+        final SSLEngine engine;
+        final ByteBuffer netIn;     // kept ready for writing
+        final ByteBuffer netOut;
+        final ByteBuffer appIn;     // kept ready for writing
+        final ByteBuffer empty = ByteBuffer.allocateDirect(0);
+
+        TlsChannel(SocketChannel ch, SSLEngine engine) {
+            this.ch = ch;
+            this.engine = engine;
+            netIn = ByteBuffer.allocateDirect(engine.getSession().getPacketBufferSize());
+            netOut = ByteBuffer.allocateDirect(engine.getSession().getPacketBufferSize());
+            appIn = ByteBuffer.allocateDirect(engine.getSession().getApplicationBufferSize());
+        }
+
+        void handshake() throws IOException {
+            engine.beginHandshake();
+            HandshakeStatus hs = engine.getHandshakeStatus();
+            while (hs != HandshakeStatus.FINISHED && hs != HandshakeStatus.NOT_HANDSHAKING) {
+                hs = step(hs);
+            }
+        }
+
+        // Does what the engine asks for once; returns what it asks for next
+        private HandshakeStatus step(HandshakeStatus hs) throws IOException {
+            switch (hs) {
+                case NEED_WRAP:
+                    netOut.clear();
+                    SSLEngineResult res = engine.wrap(empty, netOut);
+                    flush();
+                    return res.getHandshakeStatus();
+                case NEED_TASK:
+                    Runnable task;
+                    while ((task = engine.getDelegatedTask()) != null) task.run();
+                    return engine.getHandshakeStatus();
+                case NEED_UNWRAP:
+                    return unwrap().getHandshakeStatus();
+                default:
+                    // NEED_UNWRAP_AGAIN, from Java 9 on
+                    return unwrap().getHandshakeStatus();
+            }
+        }
+
+        private void flush() throws IOException {
+            netOut.flip();
+            while (netOut.hasRemaining()) ch.write(netOut);
+        }
+
+        // Unwraps one record into appIn, reading from the channel as needed
+        private SSLEngineResult unwrap() throws IOException {
+            while (true) {
+                netIn.flip();
+                SSLEngineResult res = engine.unwrap(netIn, appIn);
+                netIn.compact();
+                switch (res.getStatus()) {
+                    case OK:
+                        return res;
+                    case BUFFER_UNDERFLOW:
+                        if (ch.read(netIn) < 0) throw new EOFException();
+                        break;
+                    case BUFFER_OVERFLOW:
+                        throw new IOException("the application buffer is full");
+                    default:
+                        throw new EOFException();
+                }
+            }
+        }
+
+        // Reads application data into appIn; handles post-handshake messages
+        private void read() throws IOException {
+            SSLEngineResult res;
+            do {
+                res = unwrap();
+                HandshakeStatus hs = res.getHandshakeStatus();
+                while (hs != HandshakeStatus.FINISHED && hs != HandshakeStatus.NOT_HANDSHAKING &&
+                       hs != HandshakeStatus.NEED_UNWRAP) {
+                    hs = step(hs);
+                }
+            } while (appIn.position() == 0);
+        }
+
+        void write(ByteBuffer src) throws IOException {
+            while (src.hasRemaining()) {
+                netOut.clear();
+                SSLEngineResult res = engine.wrap(src, netOut);
+                if (res.getStatus() != SSLEngineResult.Status.OK) {
+                    throw new IOException("wrap failed: " + res.getStatus());
+                }
+                flush();
+            }
+        }
+
+        void readFully(ByteBuffer dst) throws IOException {
+            while (dst.hasRemaining()) {
+                if (appIn.position() == 0) read();
+                appIn.flip();
+                int n = Math.min(appIn.remaining(), dst.remaining());
+                ByteBuffer chunk = appIn.duplicate();
+                chunk.limit(chunk.position() + n);
+                dst.put(chunk);
+                appIn.position(appIn.position() + n);
+                appIn.compact();
+            }
+        }
+
+        // Writes back whatever arrives until the peer closes
+        void echo() throws IOException {
+            while (true) {
+                read();
+                appIn.flip();
+                write(appIn);
+                appIn.clear();
+            }
+        }
+    }
+
+    public static void main(String[] args) throws Exception {
+        int msgSize = (args.length > 0) ? Integer.parseInt(args[0]) : 16384;
+        int warmups = (args.length > 1) ? Integer.parseInt(args[1]) : 3;
+        int iterations = (args.length > 2) ? Integer.parseInt(args[2]) : 5;
+        int seconds = (args.length > 3) ? Integer.parseInt(args[3]) : 5;
+
+        SSLContext ctx = SSLContext.getDefault();
+        ServerSocketChannel server = ServerSocketChannel.open();
+        server.bind(new InetSocketAddress("127.0.0.1", 0));
+        int port = ((InetSocketAddress)server.getLocalAddress()).getPort();
+
+        Thread echoThread = new Thread(() -> {
+            try {
+                SSLEngine engine = ctx.createSSLEngine();
+                engine.setUseClientMode(false);
+                TlsChannel tls = new TlsChannel(server.accept(), engine);
+                tls.handshake();
+                tls.echo();
+            } catch (EOFException e) {
+                // the client is done
+            } catch (IOException e) {
+                e.printStackTrace();
+            }
+        });
+        echoThread.setDaemon(true);
+        echoThread.start();
+
+        SSLEngine engine = ctx.createSSLEngine("localhost", port);
+        engine.setUseClientMode(true);
+        TlsChannel tls = new TlsChannel(SocketChannel.open(new InetSocketAddress("127.0.0.1", port)), engine);
+        tls.handshake();
+
+        ByteBuffer msg = ByteBuffer.allocateDirect(msgSize);
+        ByteBuffer reply = ByteBuffer.allocateDirect(msgSize);
+        byte[] request = ("POST /echo HTTP/1.1\r\nHost: localhost\r\nContent-Length: " +
+                          msgSize + "\r\n\r\n").getBytes("US-ASCII");
+        msg.put(request, 0, Math.min(request.length, msgSize));
+
+        double[] scores = new double[iterations];
+        for (int i = -warmups; i < iterations; i++) {
+            long ops = 0;
+            long start = System.nanoTime();
+            long end = start + (seconds * 1000000000L);
+            long now;
+            do {
+                msg.clear();
+                tls.write(msg);
+                reply.clear();
+                tls.readFully(reply);
+                ops++;
+            } while ((now = System.nanoTime()) < end);
+
+            double score = ops / ((now - start) / 1e9);
+            if (i < 0) {
+                System.out.printf("# Warmup Iteration %3d: %.1f ops/s%n", i + warmups + 1, score);
+            } else {
+                scores[i] = score;
+                System.out.printf("Iteration %3d: %.1f ops/s%n", i + 1, score);
+            }
+        }
+        tls.ch.close();
+
+        double mean = 0;
+        for (double score : scores) mean += score;
+        mean /= iterations;
+        double var = 0;
+        for (double score : scores) var += (score - mean) * (score - mean);
+        double sd = (iterations > 1) ? Math.sqrt(var / (iterations - 1)) : 0;
+
+        System.out.printf("%nBenchmark            Size  Mode  Cnt        Score       Error  Units%n");
+        System.out.printf("TlsEchoBench.echo  %6d  thrpt  %3d  %11.1f ± %9.1f  ops/s%n", msgSize, iterations, mean, sd);
+        System.out.printf("TlsEchoBench.echo  %6d  thrpt  %3d  %11.1f ± %9.1f  MB/s%n", msgSize, iterations,
+                          mean * msgSize * 2 / 1e6, sd * msgSize * 2 / 1e6);
+    }
+}
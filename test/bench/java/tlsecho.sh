@@ -0,0 +1,26 @@
+#!/bin/bash
+# Requires a JDK (8 or later) and scope
+# usage: tlsecho.sh [msgSize] [warmups] [iterations] [seconds]
+# Set SCOPE to compare another build of scope, e.g. one from before a change.
+
+cd "$(dirname "$0")"
+SCOPE=${SCOPE:-../../../bin/linux/$(uname -m)/scope}
+WORK=$(mktemp -d)
+trap 'rm -rf $WORK' EXIT
+
+keytool -genkeypair -alias bench -keyalg RSA -keysize 2048 -validity 1 -dname "CN=localhost" \
+    -keystore $WORK/keystore.jks -storepass benchpass -keypass benchpass > /dev/null 2>&1
+keytool -exportcert -alias bench -keystore $WORK/keystore.jks -storepass benchpass \
+    -file $WORK/bench.cer > /dev/null 2>&1
+keytool -importcert -noprompt -alias bench -file $WORK/bench.cer \
+    -keystore $WORK/truststore.jks -storepass benchpass > /dev/null 2>&1
+javac -d $WORK TlsEchoBench.java || exit 1
+
+JAVA_OPTS="-Djavax.net.ssl.keyStore=$WORK/keystore.jks -Djavax.net.ssl.keyStorePassword=benchpass \
+    -Djavax.net.ssl.trustStore=$WORK/truststore.jks -Djavax.net.ssl.trustStorePassword=benchpass"
+
+printf "Unscoped Java:\n"
+java $JAVA_OPTS -cp $WORK TlsEchoBench "$@"
+
+printf "\nScoped Java:\n"
+SCOPE_EVENT_HTTP=true $SCOPE run -- java $JAVA_OPTS -cp $WORK TlsEchoBench "$@"
@@ -0,0 +1,151 @@
+/*
+ * Regex matching cost by thread count
+ *
+ * Runs the default event watch filters (names, fields and values) and a
+ * protocol detect regex through regexec_wrapper() and pcre2_match_wrapper()
+ * from 1 up to 256 threads at once, and reports the CPU time each match
+ * takes.  That should stay flat as threads are added; with the old pool of
+ * 48 stacks, threads beyond the 48th paid for a stack malloc and free on
+ * every match.
+ *
+ * Build and run from the top of the repo with `make libbench`.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "com.h"
+#include "dbg.h"
+#include "pcrectx.h"
+#include "scopestdlib.h"
+
+#define MAX_THREADS 256
+
+// These live in wrap.c, which isn't linked into the benchmark
+bool cmdAttach(void) { return TRUE; }
+bool cmdDetach(void) { return TRUE; }
+
+static const char *g_patterns[] = {
+    "(\\/logs?\\/)|(\\.log$)|(\\.log[.\\d])",   // file name
+    "(stdout|stderr)",                          // console name
+    ".*",                                       // field and value
+    "^fs\\.(open|close)$",                      // metric name
+};
+#define NUM_PATTERNS (sizeof(g_patterns) / sizeof(g_patterns[0]))
+
+static const char *g_subjects[] = {
+    "/var/log/nginx/access.log",
+    "/usr/lib/x86_64-linux-gnu/libssl.so.3",
+    "stdout",
+    "fs.open",
+    "net.rx",
+};
+#define NUM_SUBJECTS (sizeof(g_subjects) / sizeof(g_subjects[0]))
+
+static const char g_response[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+
+static regex_t g_re[NUM_PATTERNS];
+static pcre2_code *g_http;
+
+typedef struct {
+    int iterations;
+    pthread_barrier_t *start;
+    double cpu;
+    unsigned long matches;
+} worker_t;
+
+static double
+cpuSecs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void *
+worker(void *arg)
+{
+    worker_t *w = arg;
+    pthread_barrier_wait(w->start);
+
+    double start = cpuSecs();
+    int i;
+    for (i = 0; i < w->iterations; i++) {
+        int p, s;
+        for (p = 0; p < NUM_PATTERNS; p++) {
+            for (s = 0; s < NUM_SUBJECTS; s++) {
+                regexec_wrapper(&g_re[p], g_subjects[s], 0, NULL, 0);
+                w->matches++;
+            }
+        }
+        pcre2_match_data *md = pcreMatchDataGet(g_http);
+        pcre2_match_wrapper(g_http, (PCRE2_SPTR)g_response, sizeof(g_response) - 1,
+                            0, 0, md, NULL);
+        pcreMatchDataPut(md);
+        w->matches++;
+    }
+    w->cpu = cpuSecs() - start;
+    return NULL;
+}
+
+static void
+runThreads(int nthreads, int iterations)
+{
+    pthread_t threads[MAX_THREADS];
+    worker_t workers[MAX_THREADS];
+    pthread_barrier_t start;
+    int i;
+
+    pthread_barrier_init(&start, NULL, nthreads);
+    for (i = 0; i < nthreads; i++) {
+        workers[i] = (worker_t){.iterations = iterations, .start = &start};
+        pthread_create(&threads[i], NULL, worker, &workers[i]);
+    }
+
+    double cpu = 0;
+    unsigned long matches = 0;
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+        cpu += workers[i].cpu;
+        matches += workers[i].matches;
+    }
+    pthread_barrier_destroy(&start);
+
+    printf("%4d threads %12lu matches %10.1f ns/match\n",
+           nthreads, matches, cpu * 1e9 / matches);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 20000;
+    int i;
+
+    for (i = 0; i < NUM_PATTERNS; i++) {
+        if (regcomp_wrapper(&g_re[i], g_patterns[i], REG_EXTENDED | REG_NOSUB)) {
+            fprintf(stderr, "can't compile %s\n", g_patterns[i]);
+            return 1;
+        }
+    }
+    int err;
+    PCRE2_SIZE off;
+    g_http = pcre2_compile_wrapper((PCRE2_SPTR)"^HTTP/1\\.[0-2] [1-5][0-9][0-9]",
+                                   PCRE2_ZERO_TERMINATED, 0, &err, &off, NULL);
+
+    size_t jit = 0;
+    pcre2_pattern_info(g_http, PCRE2_INFO_JITSIZE, &jit);
+    printf("Regex match cost by thread count, %d iterations of %zu matches per thread (%s)\n",
+           iterations, NUM_PATTERNS * NUM_SUBJECTS + 1, (jit) ? "JIT" : "interpreter");
+
+    int nthreads;
+    for (nthreads = 1; nthreads <= MAX_THREADS; nthreads *= 4) {
+        runThreads(nthreads, iterations);
+    }
+
+    for (i = 0; i < NUM_PATTERNS; i++) regfree(&g_re[i]);
+    pcre2_code_free(g_http);
+    return 0;
+}
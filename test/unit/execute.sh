@@ -72,15 +72,24 @@ run_test test/${OS}/ostest
 run_test test/${OS}/ocitest
 run_test test/${OS}/evtutilstest
 run_test test/${OS}/strsettest
+run_test test/${OS}/arenatest
+run_test test/${OS}/gosymtabtest
+run_test test/${OS}/goplantest
 run_test test/${OS}/cfgutilstest
 run_test test/${OS}/cfgtest
 run_test test/${OS}/transporttest
+run_test test/${OS}/compresstest
+run_test test/${OS}/spilltest
 run_test test/${OS}/backofftest
 run_test test/${OS}/logtest
 run_test test/${OS}/utilstest
 run_test test/${OS}/mtctest
+run_test test/${OS}/mtcshmtest
 run_test test/${OS}/evtformattest
+run_test test/${OS}/evtfiltertest
+run_test test/${OS}/evtbintest
 run_test test/${OS}/ctltest
+run_test test/${OS}/epochtest
 run_test test/${OS}/mtcformattest
 run_test test/${OS}/circbuftest
 run_test test/${OS}/linklisttest
@@ -95,6 +104,10 @@ if [ "${OS}" = "linux" ]; then
     run_test test/${OS}/httpheadertest
 fi
 run_test test/${OS}/httpmatchtest
+run_test test/${OS}/chantabtest
+run_test test/${OS}/dnsmsgtest
+run_test test/${OS}/dnscachetest
+run_test test/${OS}/pcrectxtest
 run_test test/${OS}/httpaggtest
 run_test test/${OS}/selfinterposetest
 
@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "test.h"
+
+static void
+arenaCreateReturnsNonNull(void **state)
+{
+    arena_t *arena = arenaCreate(DEFAULT_ARENA_CHUNK);
+    assert_non_null(arena);
+    assert_int_equal(arenaUsed(arena), 0);
+    assert_int_equal(arenaSize(arena), 0);
+    arenaDestroy(&arena);
+
+    // Test that arenaDestroy changes the value of arena to null
+    assert_null(arena);
+}
+
+static void
+arenaNullArenaDoesNotCrash(void **state)
+{
+    arena_t *arena = NULL;
+    arenaDestroy(&arena);
+    arenaDestroy(NULL);
+    arenaReset(NULL);
+    assert_null(arenaAlloc(NULL, 10));
+    assert_null(arenaStrndup(NULL, "hey", 3));
+    assert_int_equal(arenaUsed(NULL), 0);
+    assert_int_equal(arenaSize(NULL), 0);
+}
+
+static void
+arenaAllocIsAligned(void **state)
+{
+    arena_t *arena = arenaCreate(256);
+    int i;
+    for (i = 0; i < 100; i++) {
+        char *mem = arenaAlloc(arena, i % 7 + 1);
+        assert_non_null(mem);
+        assert_int_equal((uintptr_t)mem % (sizeof(void *) * 2), 0);
+        memset(mem, 'x', i % 7 + 1);
+    }
+    arenaDestroy(&arena);
+}
+
+static void
+arenaStrndupCopiesAndTerminates(void **state)
+{
+    arena_t *arena = arenaCreate(64);
+    const char *src = "GET /path HTTP/2";
+
+    char *method = arenaStrndup(arena, src, 3);
+    char *all = arenaStrndup(arena, src, strlen(src));
+    assert_string_equal(method, "GET");
+    assert_string_equal(all, src);
+    assert_ptr_not_equal(all, src);
+    assert_true(arenaUsed(arena) >= strlen(src) + 1 + 4);
+
+    arenaDestroy(&arena);
+}
+
+static void
+arenaAllocBiggerThanChunk(void **state)
+{
+    arena_t *arena = arenaCreate(64);
+
+    char *small = arenaAlloc(arena, 8);
+    assert_non_null(small);
+    size_t size = arenaSize(arena);
+
+    // an oversized request gets its own chunk
+    char *big = arenaAlloc(arena, 1000);
+    assert_non_null(big);
+    memset(big, 'x', 1000);
+    assert_true(arenaSize(arena) >= size + 1000);
+
+    // and the first chunk is still used for small requests
+    char *next = arenaAlloc(arena, 8);
+    assert_ptr_equal(next, small + 16);
+
+    arenaDestroy(&arena);
+}
+
+static void
+arenaResetKeepsOneChunk(void **state)
+{
+    arena_t *arena = arenaCreate(128);
+    int i;
+    for (i = 0; i < 50; i++) {
+        assert_non_null(arenaStrndup(arena, "0123456789abcdef", 16));
+    }
+    size_t grown = arenaSize(arena);
+    assert_true(arenaUsed(arena) >= 50 * 17);
+
+    arenaReset(arena);
+    assert_int_equal(arenaUsed(arena), 0);
+    assert_true(arenaSize(arena) < grown);
+    assert_true(arenaSize(arena) >= 128);
+
+    // still usable afterwards
+    assert_string_equal(arenaStrndup(arena, "abc", 3), "abc");
+    arenaDestroy(&arena);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(arenaCreateReturnsNonNull),
+        cmocka_unit_test(arenaNullArenaDoesNotCrash),
+        cmocka_unit_test(arenaAllocIsAligned),
+        cmocka_unit_test(arenaStrndupCopiesAndTerminates),
+        cmocka_unit_test(arenaAllocBiggerThanChunk),
+        cmocka_unit_test(arenaResetKeepsOneChunk),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -1,8 +1,43 @@
 #define _GNU_SOURCE
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "backoff.h"
 #include "scopestdlib.h"
 #include "test.h"
 
+// The monotonic clock, as backoff.c sees it
+static uint64_t now_ms = 1000000;
+
+int __real_scope_clock_gettime(clockid_t, struct timespec *);
+
+int
+__wrap_scope_clock_gettime(clockid_t clk, struct timespec *ts)
+{
+    if (clk != CLOCK_MONOTONIC) return __real_scope_clock_gettime(clk, ts);
+
+    ts->tv_sec = now_ms / 1000;
+    ts->tv_nsec = (now_ms % 1000) * 1000000;
+    return 0;
+}
+
+// Lets time pass until the next attempt is allowed, making sure it
+// isn't allowed a ms before.  Returns the wait that was chosen after it.
+static uint64_t
+waitForNextAttempt(backoff_t *backoff)
+{
+    uint64_t remaining = backoffRemainingMs(backoff);
+    if (remaining) {
+        now_ms += remaining - 1;
+        assert_false(backoffAlgoAllowsConnect(backoff));
+        now_ms += 1;
+    }
+    assert_true(backoffAlgoAllowsConnect(backoff));
+    assert_int_equal(backoffRemainingMs(backoff), backoffDelayMs(backoff));
+    return backoffDelayMs(backoff);
+}
+
 
 static void
 backoffCreateReturnsValidPtr(void **state)
@@ -26,6 +61,8 @@ static void
 backoffAlgoAllowsConnectReturnsTrueIfNull(void **state)
 {
     assert_true(backoffAlgoAllowsConnect(NULL));
+    assert_int_equal(backoffDelayMs(NULL), 0);
+    assert_int_equal(backoffRemainingMs(NULL), 0);
 }
 
 static void
@@ -34,48 +71,116 @@ backoffAlgoAllowsConnectFirstTime(void **state)
     backoff_t *backoff = backoffCreate();
     assert_non_null(backoff);
 
+    assert_int_equal(backoffDelayMs(backoff), 0);
+    assert_int_equal(backoffRemainingMs(backoff), 0);
     assert_true(backoffAlgoAllowsConnect(backoff));
 
     backoffDestroy(&backoff);
 }
 
+static void
+backoffAlgoAllowsConnectIgnoresCallFrequency(void **state)
+{
+    backoff_t *backoff = backoffCreate();
+    assert_true(backoffAlgoAllowsConnect(backoff));
+
+    // However often it's asked, it's time that has to pass
+    int i;
+    for (i = 0; i < 1000000; i++) {
+        assert_false(backoffAlgoAllowsConnect(backoff));
+    }
+
+    now_ms += backoffRemainingMs(backoff);
+    assert_true(backoffAlgoAllowsConnect(backoff));
 
-unsigned values[] = { 0, 1, 2, 4, 8, 16, 32, 64, 128, 256 };
-const unsigned num_values = sizeof(values) / sizeof(values[0]);
+    backoffDestroy(&backoff);
+}
 
 static void
 backoffAlgoAllowsConnectIsInRange(void **state)
 {
     backoff_t *backoff = backoffCreate();
+    assert_true(backoffAlgoAllowsConnect(backoff));
 
-    // test values are in range while the window is expanding
+    // Each wait is between the base and three times the last, up to the max
+    uint64_t prev = BACKOFF_BASE_MS;
+    bool reached_max = FALSE;
     int i;
-    for (i=0; i<num_values; i++) {
-        unsigned lower_bound_ms = values[i] * 1000;
-        // as much as 1000 ms of jitter is possible
-        unsigned upper_bound_ms = lower_bound_ms + 1000;
+    for (i = 0; i < 100; i++) {
+        uint64_t delay = backoffDelayMs(backoff);
+        uint64_t upper = (prev * 3 < BACKOFF_MAX_MS) ? prev * 3 : BACKOFF_MAX_MS;
+        assert_in_range(delay, BACKOFF_BASE_MS, upper);
+        if (delay == BACKOFF_MAX_MS) reached_max = TRUE;
+
+        prev = delay;
+        waitForNextAttempt(backoff);
+    }
+    assert_true(reached_max);
 
-        int ms = 0;
-        while (!backoffAlgoAllowsConnect(backoff)) ms++;
+    backoffDestroy(&backoff);
+}
 
-        //printf("ms = %d, lower_bound_ms = %d, upper_bound_ms = %d\n",
-        //       ms, lower_bound_ms, upper_bound_ms);
-        assert_in_range(ms, lower_bound_ms, upper_bound_ms);
+static void
+backoffAlgoAllowsConnectIsJittered(void **state)
+{
+    // Two that start together don't keep retrying together
+    backoff_t *backoff1 = backoffCreate();
+    backoff_t *backoff2 = backoffCreate();
+    assert_true(backoffAlgoAllowsConnect(backoff1));
+    assert_true(backoffAlgoAllowsConnect(backoff2));
+
+    int same = 0;
+    int i;
+    for (i = 0; i < 10; i++) {
+        if (backoffDelayMs(backoff1) == backoffDelayMs(backoff2)) same++;
+        now_ms += BACKOFF_MAX_MS;
+        assert_true(backoffAlgoAllowsConnect(backoff1));
+        assert_true(backoffAlgoAllowsConnect(backoff2));
     }
+    assert_true(same < 10);
 
-    // test that the values show that the window stops expanding
-    for (i=0; i<10; i++) {
-        unsigned lower_bound_ms = 256 * 1000;
-        unsigned upper_bound_ms = lower_bound_ms + 1000;
+    backoffDestroy(&backoff1);
+    backoffDestroy(&backoff2);
+}
+
+static void
+backoffAlgoAllowsConnectIsJitteredAfterFork(void **state)
+{
+    // A child starts with its parent's backoff, but doesn't retry with it
+    backoff_t *backoff = backoffCreate();
+    uint64_t delays[10];
+    int fds[2];
+    assert_int_equal(pipe(fds), 0);
 
-        int ms = 0;
-        while (!backoffAlgoAllowsConnect(backoff)) ms++;
+    pid_t child = fork();
+    assert_true(child >= 0);
 
-        //printf("ms = %d, lower_bound_ms = %d, upper_bound_ms = %d\n",
-        //       ms, lower_bound_ms, upper_bound_ms);
-        assert_in_range(ms, lower_bound_ms, upper_bound_ms);
+    int i;
+    for (i = 0; i < 10; i++) {
+        now_ms += BACKOFF_MAX_MS;
+        assert_true(backoffAlgoAllowsConnect(backoff));
+        delays[i] = backoffDelayMs(backoff);
     }
 
+    if (!child) {
+        int ok = (write(fds[1], delays, sizeof(delays)) == sizeof(delays));
+        _exit(ok ? 0 : 1);
+    }
+
+    uint64_t childDelays[10];
+    assert_int_equal(read(fds[0], childDelays, sizeof(childDelays)), sizeof(childDelays));
+    int status;
+    assert_int_equal(waitpid(child, &status, 0), child);
+    assert_true(WIFEXITED(status) && !WEXITSTATUS(status));
+    close(fds[0]);
+    close(fds[1]);
+
+    int same = 0;
+    for (i = 0; i < 10; i++) {
+        if (delays[i] == childDelays[i]) same++;
+    }
+    assert_true(same < 10);
+
     backoffDestroy(&backoff);
 }
 
@@ -89,37 +194,21 @@ static void
 backoffResetReinitializesState(void **state)
 {
     backoff_t *backoff = backoffCreate();
+    assert_true(backoffAlgoAllowsConnect(backoff));
 
-    // iterate through half of the expanding windows.
     int i;
-    for (i=0; i<num_values/2; i++) {
-        unsigned lower_bound_ms = values[i] * 1000;
-        unsigned upper_bound_ms = lower_bound_ms + 1000;
-
-        int ms = 0;
-        while (!backoffAlgoAllowsConnect(backoff)) ms++;
-
-        //printf("ms = %d, lower_bound_ms = %d, upper_bound_ms = %d\n",
-        //       ms, lower_bound_ms, upper_bound_ms);
-        assert_in_range(ms, lower_bound_ms, upper_bound_ms);
+    for (i = 0; i < 20; i++) {
+        waitForNextAttempt(backoff);
     }
 
     // Call reset
     backoffReset(backoff);
+    assert_int_equal(backoffDelayMs(backoff), 0);
+    assert_int_equal(backoffRemainingMs(backoff), 0);
 
-    // repeat the above starting at values[0] again.
-    // This shows backoffReset() had the desired effect.
-    for (i=0; i<num_values; i++) {
-        unsigned lower_bound_ms = values[i] * 1000;
-        unsigned upper_bound_ms = lower_bound_ms + 1000;
-
-        int ms = 0;
-        while (!backoffAlgoAllowsConnect(backoff)) ms++;
-
-        //printf("ms = %d, lower_bound_ms = %d, upper_bound_ms = %d\n",
-        //       ms, lower_bound_ms, upper_bound_ms);
-        assert_in_range(ms, lower_bound_ms, upper_bound_ms);
-    }
+    // Allowed right away, then back to waits from the base
+    assert_true(backoffAlgoAllowsConnect(backoff));
+    assert_in_range(backoffDelayMs(backoff), BACKOFF_BASE_MS, 3 * BACKOFF_BASE_MS);
 
     backoffDestroy(&backoff);
 }
@@ -135,11 +224,13 @@ main(int argc, char* argv[])
         cmocka_unit_test(backoffDestroyNullDoesntCrash),
         cmocka_unit_test(backoffAlgoAllowsConnectReturnsTrueIfNull),
         cmocka_unit_test(backoffAlgoAllowsConnectFirstTime),
+        cmocka_unit_test(backoffAlgoAllowsConnectIgnoresCallFrequency),
         cmocka_unit_test(backoffAlgoAllowsConnectIsInRange),
+        cmocka_unit_test(backoffAlgoAllowsConnectIsJittered),
+        cmocka_unit_test(backoffAlgoAllowsConnectIsJitteredAfterFork),
         cmocka_unit_test(backoffResetNullDoesntCrash),
         cmocka_unit_test(backoffResetReinitializesState),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
 }
-
@@ -82,6 +82,9 @@ verifyDefaults(config_t *config)
     assert_int_equal       (cfgLogLevel(config), DEFAULT_LOG_LEVEL);
     assert_int_equal       (cfgPayEnable(config), DEFAULT_PAYLOAD_ENABLE);
     assert_string_equal    (cfgPayDir(config), DEFAULT_PAYLOAD_DIR);
+    assert_null            (cfgEvtSpillDir(config));
+    assert_int_equal       (cfgEvtSpillMaxSize(config), DEFAULT_SPILL_MAXSIZE);
+    assert_int_equal       (cfgEvtSpillDrainRate(config), DEFAULT_SPILL_DRAINRATE);
 }
 
 static void
@@ -373,6 +376,35 @@ cfgEvtFormatNameFilterSetAndGet(void **state)
     cfgDestroy(&config);
 }
 
+static void
+cfgEvtFormatHeaderSetAndGet(void **state)
+{
+    config_t *config = cfgCreateDefault();
+    bool nocase;
+
+    cfgEvtFormatHeaderSet(config, "X-Request-Id");
+    cfgEvtFormatHeaderSet(config, "(?i)accept-language");
+    cfgEvtFormatHeaderSet(config, "x-content-type-.*: no.*");
+    cfgEvtFormatHeaderSet(config, "(?i)");
+    assert_int_equal(cfgEvtFormatNumHeaders(config), 4);
+
+    // plain strings can be matched without the regex
+    assert_string_equal(cfgEvtFormatHeader(config, 0), "X-Request-Id");
+    assert_non_null(cfgEvtFormatHeaderRe(config, 0));
+    assert_string_equal(cfgEvtFormatHeaderLiteral(config, 0, &nocase), "X-Request-Id");
+    assert_false(nocase);
+    assert_string_equal(cfgEvtFormatHeaderLiteral(config, 1, &nocase), "accept-language");
+    assert_true(nocase);
+
+    // everything else needs the regex
+    assert_non_null(cfgEvtFormatHeaderRe(config, 2));
+    assert_null(cfgEvtFormatHeaderLiteral(config, 2, &nocase));
+    assert_null(cfgEvtFormatHeaderLiteral(config, 3, &nocase));
+    assert_null(cfgEvtFormatHeaderLiteral(config, 4, &nocase));
+
+    cfgDestroy(&config);
+}
+
 static void
 cfgEvtFormatSourceEnabledSetAndGet(void **state)
 {
@@ -490,6 +522,8 @@ cfgTransportTypeSetAndGet(void **state)
     assert_int_equal(cfgTransportType(config, t), CFG_FILE);
     cfgTransportTypeSet(config, t, CFG_EDGE);
     assert_int_equal(cfgTransportType(config, t), CFG_EDGE);
+    cfgTransportTypeSet(config, t, CFG_SHM);
+    assert_int_equal(cfgTransportType(config, t), (t == CFG_MTC) ? CFG_SHM : CFG_EDGE);
     cfgDestroy(&config);
 }
 
@@ -557,6 +591,26 @@ cfgTransportBufSetAndGet(void **state)
     cfgDestroy(&config);
 }
 
+static void
+cfgTransportCompressSetAndGet(void **state)
+{
+    which_transport_t t = *(which_transport_t*)state[0];
+    config_t *config = cfgCreateDefault();
+    assert_int_equal(cfgTransportCompress(config, t), CFG_COMPRESS_NONE);
+    cfgTransportCompressSet(config, t, CFG_COMPRESS_ZSTD);
+    assert_int_equal(cfgTransportCompress(config, t), CFG_COMPRESS_ZSTD);
+    cfgTransportCompressSet(config, t, CFG_COMPRESS_ZSTD+1);
+    assert_int_equal(cfgTransportCompress(config, t), CFG_COMPRESS_ZSTD);
+    cfgTransportCompressSet(config, t, CFG_COMPRESS_NONE);
+    assert_int_equal(cfgTransportCompress(config, t), CFG_COMPRESS_NONE);
+
+    // Don't crash
+    cfgTransportCompressSet(NULL, t, CFG_COMPRESS_ZSTD);
+    assert_int_equal(cfgTransportCompress(NULL, t), DEFAULT_COMPRESS);
+
+    cfgDestroy(&config);
+}
+
 
 static void
 cfgCustomTagsSetAndGet(void **state)
@@ -646,6 +700,29 @@ cfgPayDirSetAndGet(void **state)
     cfgDestroy(&config);
 }
 
+static void
+cfgEvtSpillSetAndGet(void **state)
+{
+    config_t *config = cfgCreateDefault();
+    cfgEvtSpillDirSet(config, "/some/path");
+    assert_string_equal(cfgEvtSpillDir(config), "/some/path");
+    cfgEvtSpillDirSet(config, "");
+    assert_null(cfgEvtSpillDir(config));
+
+    cfgEvtSpillMaxSizeSet(config, 1024);
+    assert_int_equal(cfgEvtSpillMaxSize(config), 1024);
+    // Zero is ignored; there'd be no room for anything
+    cfgEvtSpillMaxSizeSet(config, 0);
+    assert_int_equal(cfgEvtSpillMaxSize(config), 1024);
+
+    // Zero is no limit
+    cfgEvtSpillDrainRateSet(config, 0);
+    assert_int_equal(cfgEvtSpillDrainRate(config), 0);
+    cfgEvtSpillDrainRateSet(config, 4096);
+    assert_int_equal(cfgEvtSpillDrainRate(config), 4096);
+    cfgDestroy(&config);
+}
+
 static void
 cfgAuthTokenSetAndGet(void **state)
 {
@@ -720,6 +797,7 @@ main(int argc, char *argv[])
         cmocka_unit_test_prestate(cfgEvtFormatNameFilterSetAndGet, &fs),
         cmocka_unit_test_prestate(cfgEvtFormatNameFilterSetAndGet, &dns),
 
+        cmocka_unit_test(cfgEvtFormatHeaderSetAndGet),
         cmocka_unit_test(cfgEvtFormatSourceEnabledSetAndGet),
 
         cmocka_unit_test_prestate(cfgTransportTypeSetAndGet, mtc_state),
@@ -727,24 +805,28 @@ main(int argc, char *argv[])
         cmocka_unit_test_prestate(cfgTransportPortSetAndGet, mtc_state),
         cmocka_unit_test_prestate(cfgTransportPathSetAndGet, mtc_state),
         cmocka_unit_test_prestate(cfgTransportBufSetAndGet,  mtc_state),
+        cmocka_unit_test_prestate(cfgTransportCompressSetAndGet, mtc_state),
 
         cmocka_unit_test_prestate(cfgTransportTypeSetAndGet, evt_state),
         cmocka_unit_test_prestate(cfgTransportHostSetAndGet, evt_state),
         cmocka_unit_test_prestate(cfgTransportPortSetAndGet, evt_state),
         cmocka_unit_test_prestate(cfgTransportPathSetAndGet, evt_state),
         cmocka_unit_test_prestate(cfgTransportBufSetAndGet,  evt_state),
+        cmocka_unit_test_prestate(cfgTransportCompressSetAndGet, evt_state),
 
         cmocka_unit_test_prestate(cfgTransportTypeSetAndGet, log_state),
         cmocka_unit_test_prestate(cfgTransportHostSetAndGet, log_state),
         cmocka_unit_test_prestate(cfgTransportPortSetAndGet, log_state),
         cmocka_unit_test_prestate(cfgTransportPathSetAndGet, log_state),
         cmocka_unit_test_prestate(cfgTransportBufSetAndGet,  log_state),
+        cmocka_unit_test_prestate(cfgTransportCompressSetAndGet, log_state),
 
         cmocka_unit_test(cfgCustomTagsSetAndGet),
         cmocka_unit_test(cfgLoggingSetAndGet),
         cmocka_unit_test(cfgLogLevelSetAndGet),
         cmocka_unit_test(cfgPayEnableSetAndGet),
         cmocka_unit_test(cfgPayDirSetAndGet),
+        cmocka_unit_test(cfgEvtSpillSetAndGet),
         cmocka_unit_test(cfgAuthTokenSetAndGet),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
@@ -516,6 +516,11 @@ cfgProcessEnvironmentEventFormat(void **state)
     cfgProcessEnvironment(cfg);
     assert_int_equal(cfgEventFormat(cfg), CFG_FMT_NDJSON);
 
+    assert_int_equal(setenv("SCOPE_EVENT_FORMAT", "binary", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgEventFormat(cfg), CFG_FMT_BINARY);
+    assert_int_equal(unsetenv("SCOPE_EVENT_FORMAT"), 0);
+
     // Just don't crash on null cfg
     cfgDestroy(&cfg);
     cfgProcessEnvironment(cfg);
@@ -739,6 +744,42 @@ cfgProcessEnvironmentTransport(void **state)
     cfgProcessEnvironment(cfg);
     assert_int_equal(cfgTransportType(cfg, data->transport), CFG_UNIX);
     assert_string_equal(cfgTransportPath(cfg, data->transport), "@theUnixAddress");
+    assert_int_equal(cfgTransportCompress(cfg, data->transport), CFG_COMPRESS_NONE);
+
+    // compression is optional for tcp, unix and edge, but not for the log
+    assert_int_equal(setenv(data->env_name, "tcp://host:9109?compress=zstd", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgTransportType(cfg, data->transport), CFG_TCP);
+    assert_string_equal(cfgTransportHost(cfg, data->transport), "host");
+    assert_string_equal(cfgTransportPort(cfg, data->transport), "9109");
+    assert_int_equal(cfgTransportCompress(cfg, data->transport),
+                     (data->transport == CFG_LOG) ? CFG_COMPRESS_NONE : CFG_COMPRESS_ZSTD);
+    assert_string_equal(getenv(data->env_name), "tcp://host:9109?compress=zstd");
+
+    assert_int_equal(setenv(data->env_name, "unix://@theUnixAddress?compress=none", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgTransportType(cfg, data->transport), CFG_UNIX);
+    assert_string_equal(cfgTransportPath(cfg, data->transport), "@theUnixAddress");
+    assert_int_equal(cfgTransportCompress(cfg, data->transport), CFG_COMPRESS_NONE);
+
+    // but not for the rest, nor an unknown compression
+    assert_int_equal(setenv(data->env_name, "udp://host:234?compress=zstd", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(setenv(data->env_name, "unix://@another?compress=lz77", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgTransportType(cfg, data->transport), CFG_UNIX);
+    assert_string_equal(cfgTransportPath(cfg, data->transport), "@theUnixAddress");
+    assert_int_equal(cfgTransportCompress(cfg, data->transport), CFG_COMPRESS_NONE);
+
+    // shared memory is only where metrics can go
+    assert_int_equal(setenv(data->env_name, "shm", 1), 0);
+    cfgProcessEnvironment(cfg);
+    if (data->transport == CFG_MTC) {
+        assert_int_equal(cfgTransportType(cfg, data->transport), CFG_SHM);
+    } else {
+        assert_int_equal(cfgTransportType(cfg, data->transport), CFG_UNIX);
+    }
+    assert_int_equal(unsetenv(data->env_name), 0);
 
     // Just don't crash on null cfg
     cfgDestroy(&cfg);
@@ -846,6 +887,41 @@ cfgProcessEnvironmentPayDir(void **state)
     cfgProcessEnvironment(cfg);
 }
 
+static void
+cfgProcessEnvironmentEvtSpill(void **state)
+{
+    config_t *cfg = cfgCreateDefault();
+    assert_null(cfgEvtSpillDir(cfg));
+
+    assert_int_equal(setenv("SCOPE_EVENT_SPILL_DIR", "/my/spill/dir", 1), 0);
+    assert_int_equal(setenv("SCOPE_EVENT_SPILL_MAXSIZE", "1048576", 1), 0);
+    assert_int_equal(setenv("SCOPE_EVENT_SPILL_DRAINRATE", "65536", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_string_equal(cfgEvtSpillDir(cfg), "/my/spill/dir");
+    assert_int_equal(cfgEvtSpillMaxSize(cfg), 1048576);
+    assert_int_equal(cfgEvtSpillDrainRate(cfg), 65536);
+
+    // Not numbers, ignored
+    assert_int_equal(setenv("SCOPE_EVENT_SPILL_MAXSIZE", "1MB", 1), 0);
+    assert_int_equal(setenv("SCOPE_EVENT_SPILL_DRAINRATE", "fast", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgEvtSpillMaxSize(cfg), 1048576);
+    assert_int_equal(cfgEvtSpillDrainRate(cfg), 65536);
+
+    // empty string
+    assert_int_equal(setenv("SCOPE_EVENT_SPILL_DIR", "", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_null(cfgEvtSpillDir(cfg));
+
+    assert_int_equal(unsetenv("SCOPE_EVENT_SPILL_DIR"), 0);
+    assert_int_equal(unsetenv("SCOPE_EVENT_SPILL_MAXSIZE"), 0);
+    assert_int_equal(unsetenv("SCOPE_EVENT_SPILL_DRAINRATE"), 0);
+
+    // Just don't crash on null cfg
+    cfgDestroy(&cfg);
+    cfgProcessEnvironment(cfg);
+}
+
 static void
 cfgProcessEnvironmentCmdDebugIsIgnored(void **state)
 {
@@ -1242,6 +1318,7 @@ cfgReadGoodYaml(void **state)
         "    host: 127.0.0.2\n"
         "    port: 9009\n"
         "    buffering: line\n"
+        "    compression: zstd\n"
         "  format:\n"
         "    type : ndjson                   # ndjson\n"
         "    maxeventpersec : 989898         # max events per second.\n"
@@ -1258,6 +1335,10 @@ cfgReadGoodYaml(void **state)
         "    - type: net\n"
         "    - type: fs\n"
         "    - type: dns\n"
+        "  spill:\n"
+        "    dir: /var/spool/scope\n"
+        "    maxsize: 1048576\n"
+        "    drainrate: 65536\n"
         "payload:\n"
         "  enable: false\n"
         "  dir: '/my/dir'\n"
@@ -1309,6 +1390,9 @@ cfgReadGoodYaml(void **state)
     assert_int_equal(cfgEvtFormatSourceEnabled(config, CFG_SRC_NET), 1);
     assert_int_equal(cfgEvtFormatSourceEnabled(config, CFG_SRC_FS), 1);
     assert_int_equal(cfgEvtFormatSourceEnabled(config, CFG_SRC_DNS), 1);
+    assert_string_equal(cfgEvtSpillDir(config), "/var/spool/scope");
+    assert_int_equal(cfgEvtSpillMaxSize(config), 1048576);
+    assert_int_equal(cfgEvtSpillDrainRate(config), 65536);
     assert_int_equal(cfgTransportType(config, CFG_MTC), CFG_FILE);
     assert_string_equal(cfgTransportHost(config, CFG_MTC), "127.0.0.1");
     assert_string_equal(cfgTransportPort(config, CFG_MTC), "8125");
@@ -1319,6 +1403,8 @@ cfgReadGoodYaml(void **state)
     assert_string_equal(cfgTransportPort(config, CFG_CTL), "9009");
     assert_null(cfgTransportPath(config, CFG_CTL));
     assert_int_equal(cfgTransportBuf(config, CFG_CTL), CFG_BUFFER_LINE);
+    assert_int_equal(cfgTransportCompress(config, CFG_CTL), CFG_COMPRESS_ZSTD);
+    assert_int_equal(cfgTransportCompress(config, CFG_MTC), CFG_COMPRESS_NONE);
     assert_int_equal(cfgTransportType(config, CFG_LOG), CFG_EDGE);
     assert_null(cfgTransportHost(config, CFG_LOG));
     assert_null(cfgTransportPort(config, CFG_LOG));
@@ -1422,6 +1508,49 @@ cfgReadEveryTransportType(void **state)
 
 }
 
+static void
+cfgReadLogTransportIgnoresCompression(void **state)
+{
+    // the library log is only flushed at exit, so it isn't compressed
+    const char *yamlText =
+        "---\n"
+        "event:\n"
+        "  transport:\n"
+        "    type: unix\n"
+        "    path: '@events.sock'\n"
+        "    compression: zstd\n"
+        "libscope:\n"
+        "  log:\n"
+        "    transport:\n"
+        "      type: unix\n"
+        "      path: '@log.sock'\n"
+        "      compression: zstd\n"
+        "...\n";
+    const char *path = CFG_FILE_NAME;
+    writeFile(path, yamlText);
+    g_protlist = lstCreate(destroyProtEntry);
+    assert_non_null(g_protlist);
+    config_t *config = cfgRead(path);
+    assert_non_null(config);
+
+    assert_int_equal(cfgTransportType(config, CFG_LOG), CFG_UNIX);
+    assert_string_equal(cfgTransportPath(config, CFG_LOG), "@log.sock");
+    assert_int_equal(cfgTransportCompress(config, CFG_LOG), CFG_COMPRESS_NONE);
+    assert_int_equal(cfgTransportCompress(config, CFG_CTL), CFG_COMPRESS_ZSTD);
+
+    // nor is it when it comes from the environment
+    assert_int_equal(setenv("SCOPE_LOG_DEST", "unix://@other.sock?compress=zstd", 1), 0);
+    cfgProcessEnvironment(config);
+    assert_string_equal(cfgTransportPath(config, CFG_LOG), "@other.sock");
+    assert_int_equal(cfgTransportCompress(config, CFG_LOG), CFG_COMPRESS_NONE);
+    assert_int_equal(unsetenv("SCOPE_LOG_DEST"), 0);
+
+    deleteFile(path);
+    cfgDestroy(&config);
+    lstDestroy(&g_protlist);
+    g_prot_sequence = 0;
+}
+
 static void
 cfgReadEveryProcessLevel(void **state)
 {
@@ -1957,6 +2086,7 @@ initLogReturnsPtr(void **state)
                 break;
             case CFG_TCP:
             case CFG_EDGE:
+            case CFG_SHM:
                 break;
 	    }
         cfgTransportTypeSet(cfg, CFG_LOG, t);
@@ -1974,7 +2104,7 @@ initMtcReturnsPtr(void **state)
     assert_non_null(cfg);
 
     cfg_transport_t t;
-    for (t=CFG_UDP; t<=CFG_EDGE; t++) {
+    for (t=CFG_UDP; t<=CFG_SHM; t++) {
         cfgTransportTypeSet(cfg, CFG_MTC, t);
         if (t == CFG_UNIX) {
             cfgTransportPathSet(cfg, CFG_MTC, "@scope.sock");
@@ -3048,6 +3178,7 @@ main(int argc, char *argv[])
         cmocka_unit_test(cfgProcessEnvironmentStatsdTags),
         cmocka_unit_test(cfgProcessEnvironmentPayEnable),
         cmocka_unit_test(cfgProcessEnvironmentPayDir),
+        cmocka_unit_test(cfgProcessEnvironmentEvtSpill),
         cmocka_unit_test(cfgProcessEnvironmentCmdDebugIsIgnored),
         cmocka_unit_test(cfgProcessCommandsCmdDebugIsProcessed),
         cmocka_unit_test(cfgProcessCommandsFromFile),
@@ -3055,6 +3186,7 @@ main(int argc, char *argv[])
         cmocka_unit_test(cfgReadGoodYaml),
         cmocka_unit_test(cfgReadStockYaml),
         cmocka_unit_test(cfgReadEveryTransportType),
+        cmocka_unit_test(cfgReadLogTransportIgnoresCompression),
         cmocka_unit_test(cfgReadEveryProcessLevel),
         cmocka_unit_test(cfgReadGoodJson),
         cmocka_unit_test(cfgReadNonExistentFileReturnsDefaults),
@@ -0,0 +1,298 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "chantab.h"
+#include "dbg.h"
+#include "plattime.h"
+#include "test.h"
+
+#define THREAD_NUM 8
+#define THREAD_CHANNELS 32
+
+static int g_resets = 0;
+
+static void
+countReset(net_info *net)
+{
+    g_resets++;
+}
+
+static int
+chanTabSetup(void **state)
+{
+    initTime();
+    return groupSetup(state);
+}
+
+static void
+chanTabNullArgsDoNotCrash(void **state)
+{
+    chantab_stats_t stats;
+    chanTabDestroy(NULL);
+    assert_null(chanTabGet(NULL, 1));
+    assert_null(chanTabFind(NULL, 1));
+    chanTabStats(NULL, &stats);
+    assert_int_equal(stats.lookups, 0);
+
+    chantab_t *tab = chanTabCreate(16, 0, NULL);
+    assert_non_null(tab);
+    assert_null(chanTabGet(tab, 0));
+    chanTabStats(tab, NULL);
+    chanTabDestroy(&tab);
+    assert_null(tab);
+}
+
+static void
+chanTabGetReturnsTheSameChannel(void **state)
+{
+    chantab_t *tab = chanTabCreate(CHANNEL_ENTRIES, CHANNEL_MAX_IDLE, NULL);
+    assert_null(chanTabFind(tab, 0x7f0012345670));
+
+    net_info *net = chanTabGet(tab, 0x7f0012345670);
+    assert_non_null(net);
+    assert_int_equal(net->uid, 0x7f0012345670);
+    assert_true(net->active);
+    assert_int_equal(net->type, SOCK_STREAM);
+    chanTabPut(tab, net);
+
+    net_info *other = chanTabGet(tab, 0x7f0012345680);
+    assert_non_null(other);
+    assert_ptr_not_equal(net, other);
+    chanTabPut(tab, other);
+
+    assert_ptr_equal(chanTabGet(tab, 0x7f0012345670), net);
+    chanTabPut(tab, net);
+    assert_ptr_equal(chanTabGet(tab, 0x7f0012345670), net);
+    chanTabPut(tab, net);
+    assert_ptr_equal(chanTabFind(tab, 0x7f0012345670), net);
+    assert_ptr_equal(chanTabFind(tab, 0x7f0012345680), other);
+
+    chantab_stats_t stats;
+    chanTabStats(tab, &stats);
+    assert_int_equal(stats.lookups, 4);
+    assert_int_equal(stats.inserts, 2);
+    assert_int_equal(stats.hits, 1);      // after switching channels
+    assert_int_equal(stats.cacheHits, 1); // the same channel again
+    assert_int_equal(stats.full, 0);
+
+    chanTabDestroy(&tab);
+}
+
+static void
+chanTabEvictsLeastRecentlyUsedWhenBucketIsFull(void **state)
+{
+    // one bucket, so every channel competes for the same slots
+    chantab_t *tab = chanTabCreate(CHANNEL_WAYS, CHANNEL_MAX_IDLE, countReset);
+    g_resets = 0;
+
+    uint64_t id;
+    for (id = 1; id <= CHANNEL_WAYS; id++) {
+        net_info *net = chanTabGet(tab, id);
+        assert_non_null(net);
+        net->numTX.evt = id;
+        chanTabPut(tab, net);
+        usleep(2000);
+    }
+
+    // 1 is used again and 2 is in use, so 3 is the one to go
+    net_info *net = chanTabGet(tab, 1);
+    chanTabPut(tab, net);
+    net_info *pinned = chanTabGet(tab, 2);
+
+    net = chanTabGet(tab, 100);
+    assert_non_null(net);
+    assert_int_equal(net->uid, 100);
+    assert_int_equal(net->numTX.evt, 0);
+    assert_ptr_equal(chanTabFind(tab, 100), net);
+    assert_null(chanTabFind(tab, 3));
+    assert_ptr_equal(chanTabFind(tab, 2), pinned);
+    assert_int_equal(pinned->numTX.evt, 2);
+
+    // the evicted channel is reset by the periodic thread, not by its user
+    assert_int_equal(g_resets, 0);
+    assert_int_equal(chanTabReclaim(tab), 0);
+    assert_int_equal(g_resets, 1);
+
+    // with every slot pinned, a new channel isn't kept
+    net_info *more = chanTabGet(tab, 1);
+    net_info *last = chanTabGet(tab, CHANNEL_WAYS);
+    assert_null(chanTabGet(tab, 200));
+    chanTabPut(tab, more);
+    chanTabPut(tab, last);
+    chanTabPut(tab, net);
+    chanTabPut(tab, pinned);
+
+    chantab_stats_t stats;
+    chanTabStats(tab, &stats);
+    assert_int_equal(stats.inserts, CHANNEL_WAYS + 1);
+    assert_int_equal(stats.evictions, 1);
+    assert_int_equal(stats.full, 1);
+    assert_int_equal(stats.reclaims, 0);
+
+    chanTabDestroy(&tab);
+    assert_int_equal(g_resets, CHANNEL_WAYS + 1);
+}
+
+static void
+chanTabReclaimsIdleChannelsNotPinned(void **state)
+{
+    chantab_t *tab = chanTabCreate(CHANNEL_WAYS, 1000000ULL, countReset);
+    g_resets = 0;
+
+    // 1 is still in use, 2 was given back
+    net_info *pinned = chanTabGet(tab, 1);
+    pinned->numTX.evt = 42;
+    net_info *net = chanTabGet(tab, 2);
+    net->numTX.evt = 43;
+    chanTabPut(tab, net);
+    usleep(5000);
+
+    assert_int_equal(chanTabReclaim(tab), 1);
+    assert_int_equal(g_resets, 1);
+    assert_int_equal(pinned->uid, 1);
+    assert_int_equal(pinned->numTX.evt, 42);
+    assert_null(chanTabFind(tab, 2));
+
+    chanTabPut(tab, pinned);
+    assert_int_equal(chanTabReclaim(tab), 1);
+    assert_int_equal(g_resets, 2);
+
+    // the thread's last channel comes back set up afresh
+    net = chanTabGet(tab, 1);
+    assert_non_null(net);
+    assert_int_equal(net->uid, 1);
+    assert_int_equal(net->numTX.evt, 0);
+    chanTabPut(tab, net);
+
+    chantab_stats_t stats;
+    chanTabStats(tab, &stats);
+    assert_int_equal(stats.cacheHits, 0);
+    assert_int_equal(stats.reclaims, 2);
+    assert_int_equal(stats.inserts, 3);
+
+    chanTabDestroy(&tab);
+}
+
+static void
+chanTabFindSkipsIdleChannels(void **state)
+{
+    chantab_t *tab = chanTabCreate(16, 1000000ULL, NULL);
+
+    net_info *net = chanTabGet(tab, 7);
+    chanTabPut(tab, net);
+    assert_ptr_equal(chanTabFind(tab, 7), net);
+    usleep(5000);
+    assert_null(chanTabFind(tab, 7));
+
+    // but it's still there to be used again
+    assert_ptr_equal(chanTabGet(tab, 7), net);
+    chanTabPut(tab, net);
+    assert_ptr_equal(chanTabFind(tab, 7), net);
+
+    chanTabDestroy(&tab);
+}
+
+typedef struct {
+    chantab_t *tab;
+    int thread;
+    int errors;
+    int full;
+} thread_arg_t;
+
+static void *
+useChannels(void *arg)
+{
+    thread_arg_t *targ = arg;
+    int i;
+    for (i = 0; i < 10000; i++) {
+        uint64_t id = ((uint64_t)targ->thread << 32) | (((i / 4) % THREAD_CHANNELS) + 1);
+        net_info *net = chanTabGet(targ->tab, id);
+        if (!net) {
+            targ->full++;
+            continue;
+        }
+        if (net->uid != id) targ->errors++;
+        net->numTX.evt++;
+        if (net->uid != id) targ->errors++;
+        chanTabPut(targ->tab, net);
+    }
+    return NULL;
+}
+
+static volatile int g_reclaiming = 0;
+
+static void *
+reclaimChannels(void *arg)
+{
+    chantab_t *tab = arg;
+    while (g_reclaiming) {
+        chanTabReclaim(tab);
+    }
+    return NULL;
+}
+
+static void
+chanTabFromManyThreads(void **state)
+{
+    // more channels than entries, and idle ones are reclaimed all the time
+    chantab_t *tab = chanTabCreate(64, 1000ULL, countReset);
+    g_resets = 0;
+    g_reclaiming = 1;
+    pthread_t reclaimer;
+    assert_int_equal(pthread_create(&reclaimer, NULL, reclaimChannels, tab), 0);
+
+    pthread_t threads[THREAD_NUM];
+    thread_arg_t args[THREAD_NUM];
+    int i;
+    for (i = 0; i < THREAD_NUM; i++) {
+        args[i] = (thread_arg_t){.tab = tab, .thread = i};
+        assert_int_equal(pthread_create(&threads[i], NULL, useChannels, &args[i]), 0);
+    }
+    int errors = 0;
+    int full = 0;
+    for (i = 0; i < THREAD_NUM; i++) {
+        pthread_join(threads[i], NULL);
+        errors += args[i].errors;
+        full += args[i].full;
+    }
+    g_reclaiming = 0;
+    pthread_join(reclaimer, NULL);
+
+    // a pinned net_info never changes hands under its user
+    assert_int_equal(errors, 0);
+
+    chantab_stats_t stats;
+    chanTabStats(tab, &stats);
+    assert_int_equal(stats.lookups, THREAD_NUM * 10000);
+    assert_int_equal(stats.full, full);
+    assert_true(stats.cacheHits > 0);
+    assert_true(stats.reclaims > 0);
+    assert_true(stats.evictions > 0);
+
+    // every channel that lost its slot is reset once
+    chanTabReclaim(tab);
+    chanTabStats(tab, &stats);
+    assert_int_equal(stats.reclaims + stats.evictions, g_resets);
+
+    chanTabDestroy(&tab);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(chanTabNullArgsDoNotCrash),
+        cmocka_unit_test(chanTabGetReturnsTheSameChannel),
+        cmocka_unit_test(chanTabEvictsLeastRecentlyUsedWhenBucketIsFull),
+        cmocka_unit_test(chanTabReclaimsIdleChannelsNotPinned),
+        cmocka_unit_test(chanTabFindSkipsIdleChannels),
+        cmocka_unit_test(chanTabFromManyThreads),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, chanTabSetup, groupTeardown);
+}
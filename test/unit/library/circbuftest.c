@@ -1,27 +1,50 @@
 #define _GNU_SOURCE
+#include <pthread.h>
 #include <stdio.h>
 #include "dbg.h"
 #include "circbuf.h"
 #include "test.h"
 
+#define PRODUCER_THREADS 4
+#define PUTS_PER_PRODUCER 100000
+
+static int
+segmentsInUse(cbuf_handle_t ch)
+{
+    int i, count = 0;
+    for (i = 0; i < ch->nsegs; i++) {
+        if (ch->segs[i]) count++;
+    }
+    return count;
+}
+
 static void
-circbufInitGetsBuf(void **state)
+circbufInitAllocatesNoEntries(void **state)
 {
-    cbuf_handle_t ch = cbufInit(10);
+    cbuf_handle_t ch = cbufInit(100000);
     assert_non_null(ch);
-    assert_non_null(ch->buffer);
+    assert_non_null(ch->segs);
+    assert_int_equal(ch->segslots, CBUF_SEG_SLOTS);
+    assert_int_equal(segmentsInUse(ch), 0);
+    assert_null(ch->spare);
     cbufFree(ch);
+
+    assert_null(cbufInit(0));
 }
 
 static void
 circbufResetTest(void **state)
 {
+    uint64_t data = 1;
     cbuf_handle_t ch = cbufInit(10);
     assert_non_null(ch);
-    assert_non_null(ch->buffer);
+    assert_int_equal(cbufPut(ch, data), 0);
+    assert_int_equal(segmentsInUse(ch), 1);
     cbufReset(ch);
     assert_int_equal(ch->head, 0);
     assert_int_equal(ch->tail, 0);
+    assert_int_equal(segmentsInUse(ch), 0);
+    assert_int_equal(cbufEmpty(ch), TRUE);
     cbufFree(ch);
 }
 
@@ -40,7 +63,6 @@ circbufPutGetTest(void **state)
     uint64_t data;
     cbuf_handle_t ch = cbufInit(5);
     assert_non_null(ch);
-    assert_non_null(ch->buffer);
 
     data = 1;
     assert_int_equal(cbufPut(ch, data), 0);
@@ -75,19 +97,177 @@ circbufPutGetTest(void **state)
     // should not find a new entry
     assert_int_equal(cbufGet(ch, &data), -1);
 
+    // zero can't be told from an entry that's not written yet
+    assert_int_equal(cbufPut(ch, 0), -1);
+
+    cbufFree(ch);
+}
+
+static void
+circbufGrowsAndShrinksBySegment(void **state)
+{
+    uint64_t data;
+    cbuf_handle_t ch = cbufInit(3000);
+    assert_non_null(ch);
+
+    for (data = 1; data <= 1500; data++) {
+        assert_int_equal(cbufPut(ch, data), 0);
+    }
+    assert_int_equal(segmentsInUse(ch), 2);
+
+    // The first segment is given back once it's emptied, and kept spare
+    uint64_t expected;
+    for (expected = 1; expected <= CBUF_SEG_SLOTS; expected++) {
+        assert_int_equal(cbufGet(ch, &data), 0);
+        assert_int_equal(data, expected);
+    }
+    assert_int_equal(segmentsInUse(ch), 1);
+    assert_non_null(ch->spare);
+
+    // Which the next segment to fill takes over
+    uint64_t *spare = ch->spare;
+    for (data = 1501; data <= 2100; data++) {
+        assert_int_equal(cbufPut(ch, data), 0);
+    }
+    assert_int_equal(segmentsInUse(ch), 2);
+    assert_null(ch->spare);
+    assert_ptr_equal(ch->segs[2], spare);
+
+    for (; expected <= 2100; expected++) {
+        assert_int_equal(cbufGet(ch, &data), 0);
+        assert_int_equal(data, expected);
+    }
+    assert_int_equal(cbufGet(ch, &data), -1);
+    assert_int_equal(cbufEmpty(ch), TRUE);
+
     cbufFree(ch);
 }
 
+static void
+circbufWrapsAround(void **state)
+{
+    uint64_t data, put = 1, expected = 1;
+    cbuf_handle_t ch = cbufInit(2500);
+    assert_non_null(ch);
+
+    // Many times around, never more than the cap queued
+    int i;
+    for (i = 0; i < 20; i++) {
+        while (cbufPut(ch, put) == 0) put++;
+        assert_int_equal(put - expected, 2500);
+        while (cbufGet(ch, &data) == 0) {
+            assert_int_equal(data, expected);
+            expected++;
+        }
+        assert_int_equal(expected, put);
+    }
+    assert_int_equal(dbgCountMatchingLines("src/circbuf.c"), 1);
+    dbgInit();
+
+    // Never more segments than the entries need, plus one
+    assert_true(segmentsInUse(ch) + (ch->spare != NULL) <= ch->nsegs);
+    assert_int_equal(ch->nsegs, 4);
+
+    cbufFree(ch);
+}
+
+static void
+circbufTrimFreesSpareWhenIdle(void **state)
+{
+    uint64_t data;
+    cbuf_handle_t ch = cbufInit(3000);
+    assert_non_null(ch);
+
+    for (data = 1; data <= 1500; data++) {
+        assert_int_equal(cbufPut(ch, data), 0);
+    }
+    uint64_t expected;
+    for (expected = 1; expected <= CBUF_SEG_SLOTS; expected++) {
+        assert_int_equal(cbufGet(ch, &data), 0);
+    }
+    assert_non_null(ch->spare);
+
+    // There were puts in this period; the spare stays
+    cbufTrim(ch);
+    assert_non_null(ch->spare);
+
+    // A put in the next one still keeps it
+    assert_int_equal(cbufPut(ch, 1501), 0);
+    cbufTrim(ch);
+    assert_non_null(ch->spare);
+
+    // A whole period without a put
+    cbufTrim(ch);
+    assert_null(ch->spare);
+    assert_int_equal(segmentsInUse(ch), 1);
+
+    for (; expected <= 1501; expected++) {
+        assert_int_equal(cbufGet(ch, &data), 0);
+        assert_int_equal(data, expected);
+    }
+
+    cbufTrim(NULL);
+    cbufFree(ch);
+}
+
+static void *
+produce(void *arg)
+{
+    cbuf_handle_t ch = arg;
+    uint64_t data;
+    for (data = 1; data <= PUTS_PER_PRODUCER; data++) {
+        while (cbufPut(ch, data) != 0);
+    }
+    return NULL;
+}
+
+static void
+circbufManyProducers(void **state)
+{
+    pthread_t threads[PRODUCER_THREADS];
+    uint64_t data, sum = 0, count = 0;
+    int i;
+
+    // Small enough that the puts wrap around and find it full
+    cbuf_handle_t ch = cbufInit(1500);
+    assert_non_null(ch);
+    for (i = 0; i < PRODUCER_THREADS; i++) {
+        assert_int_equal(pthread_create(&threads[i], NULL, produce, ch), 0);
+    }
+
+    while (count < PRODUCER_THREADS * PUTS_PER_PRODUCER) {
+        if (cbufGet(ch, &data) == 0) {
+            sum += data;
+            count++;
+        }
+    }
+    for (i = 0; i < PRODUCER_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    uint64_t each = (uint64_t)PUTS_PER_PRODUCER * (PUTS_PER_PRODUCER + 1) / 2;
+    assert_int_equal(sum, PRODUCER_THREADS * each);
+    assert_int_equal(cbufGet(ch, &data), -1);
+    cbufFree(ch);
+
+    // Full is reported every time; only the count matters here
+    dbgInit();
+}
+
 int
 main(int argc, char* argv[])
 {
     printf("running %s\n", argv[0]);
 
     const struct CMUnitTest tests[] = {
-        cmocka_unit_test(circbufInitGetsBuf),
+        cmocka_unit_test(circbufInitAllocatesNoEntries),
         cmocka_unit_test(circbufResetTest),
         cmocka_unit_test(circbufCapacityTest),
         cmocka_unit_test(circbufPutGetTest),
+        cmocka_unit_test(circbufGrowsAndShrinksBySegment),
+        cmocka_unit_test(circbufWrapsAround),
+        cmocka_unit_test(circbufTrimFreesSpareWhenIdle),
+        cmocka_unit_test(circbufManyProducers),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
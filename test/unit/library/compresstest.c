@@ -0,0 +1,250 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+
+#include "compress.h"
+#include "scopestdlib.h"
+#include "test.h"
+#include "zstd.h"
+
+// What's been sent, and a decompression of it as a receiver would do
+typedef struct {
+    char sent[64 * 1024];
+    size_t sent_len;
+    int sends;
+    int fail;
+    ZSTD_DCtx *dctx;
+    char out[256 * 1024];
+    size_t out_len;
+} receiver_t;
+
+static int
+receive(void *arg, const char *msg, size_t len)
+{
+    receiver_t *r = arg;
+    r->sends++;
+    if (r->fail) return -1;
+
+    assert_true(r->sent_len + len <= sizeof(r->sent));
+    memcpy(r->sent + r->sent_len, msg, len);
+    r->sent_len += len;
+
+    ZSTD_inBuffer in = {msg, len, 0};
+    while (in.pos < in.size) {
+        ZSTD_outBuffer out = {r->out + r->out_len, sizeof(r->out) - r->out_len, 0};
+        size_t rc = ZSTD_decompressStream(r->dctx, &out, &in);
+        assert_false(ZSTD_isError(rc));
+        r->out_len += out.pos;
+    }
+    return 0;
+}
+
+static int
+discard(void *arg, const char *msg, size_t len)
+{
+    return 0;
+}
+
+static void
+receiverInit(receiver_t *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->dctx = ZSTD_createDCtx();
+    assert_non_null(r->dctx);
+}
+
+static void
+receiverFree(receiver_t *r)
+{
+    ZSTD_freeDCtx(r->dctx);
+}
+
+static void
+compressCreateReturnsNullForNone(void **state)
+{
+    assert_null(compressCreate(CFG_COMPRESS_NONE));
+
+    compress_t *c = compressCreate(CFG_COMPRESS_ZSTD);
+    assert_non_null(c);
+    compressDestroy(&c);
+    assert_null(c);
+
+    // Doesn't crash
+    compressDestroy(NULL);
+    compressDestroy(&c);
+}
+
+static void
+compressNullArgs(void **state)
+{
+    receiver_t r;
+    receiverInit(&r);
+    compress_t *c = compressCreate(CFG_COMPRESS_ZSTD);
+
+    assert_int_equal(compressAppend(NULL, "hey", 3), -1);
+    assert_int_equal(compressAppend(c, NULL, 3), -1);
+    assert_int_equal(compressAppendAhead(NULL, "hey", 3), -1);
+    assert_int_equal(compressAppendAhead(c, NULL, 3), -1);
+    assert_int_equal(compressFlush(NULL, receive, &r), -1);
+    assert_int_equal(compressFlush(c, NULL, &r), -1);
+    compressReset(NULL);
+    compress_stats_t stats = compressStats(NULL);
+    assert_int_equal(stats.in, 0);
+    assert_int_equal(stats.out, 0);
+
+    compressDestroy(&c);
+    receiverFree(&r);
+}
+
+static void
+compressFlushSendsWhatWasAppended(void **state)
+{
+    receiver_t r;
+    receiverInit(&r);
+    compress_t *c = compressCreate(CFG_COMPRESS_ZSTD);
+
+    // Nothing pending, nothing sent
+    assert_int_equal(compressFlush(c, receive, &r), 0);
+    assert_int_equal(r.sends, 0);
+
+    const char msg[] = "{\"type\":\"evt\",\"body\":{\"sourcetype\":\"console\",\"data\":\"hello\"}}\n";
+    int i;
+    for (i = 0; i < 100; i++) {
+        assert_int_equal(compressAppend(c, msg, strlen(msg)), 0);
+    }
+
+    // Not until it's flushed
+    assert_int_equal(r.sends, 0);
+    assert_int_equal(compressFlush(c, receive, &r), 0);
+    assert_int_equal(r.sends, 1);
+
+    // Everything can be decompressed at the end of each flush
+    assert_int_equal(r.out_len, 100 * strlen(msg));
+    for (i = 0; i < 100; i++) {
+        assert_memory_equal(r.out + i * strlen(msg), msg, strlen(msg));
+    }
+
+    // Repetitive ndjson compresses well
+    compress_stats_t stats = compressStats(c);
+    assert_int_equal(stats.in, 100 * strlen(msg));
+    assert_int_equal(stats.out, r.sent_len);
+    assert_true(stats.out < stats.in / 10);
+
+    // The next flush continues the same frame
+    assert_int_equal(compressAppend(c, msg, strlen(msg)), 0);
+    assert_int_equal(compressFlush(c, receive, &r), 0);
+    assert_int_equal(r.sends, 2);
+    assert_int_equal(r.out_len, 101 * strlen(msg));
+
+    compressDestroy(&c);
+    receiverFree(&r);
+}
+
+static void
+compressResetStartsNewFrame(void **state)
+{
+    receiver_t r;
+    receiverInit(&r);
+    compress_t *c = compressCreate(CFG_COMPRESS_ZSTD);
+
+    assert_int_equal(compressAppend(c, "first\n", 6), 0);
+    assert_int_equal(compressFlush(c, receive, &r), 0);
+    assert_int_equal(compressAppend(c, "pending\n", 8), 0);
+    assert_int_equal(compressAppendAhead(c, "hello\n", 6), 0);
+    compressReset(c);
+
+    // A new receiver, as on a new connection, understands what follows,
+    // including what was pending at the reset, but not what was ahead of
+    // it for the last receiver
+    receiverFree(&r);
+    receiverInit(&r);
+    assert_int_equal(compressAppend(c, "second\n", 7), 0);
+    assert_int_equal(compressAppendAhead(c, "again\n", 6), 0);
+    assert_int_equal(compressFlush(c, receive, &r), 0);
+    assert_int_equal(r.out_len, 21);
+    assert_memory_equal(r.out, "again\npending\nsecond\n", 21);
+
+    // It starts with the frame's magic number
+    assert_true(r.sent_len > 4);
+    assert_int_equal(*(uint32_t *)r.sent, ZSTD_MAGICNUMBER);
+
+    compressDestroy(&c);
+    receiverFree(&r);
+}
+
+static void
+compressFailedSendStartsNewFrame(void **state)
+{
+    receiver_t r;
+    receiverInit(&r);
+    compress_t *c = compressCreate(CFG_COMPRESS_ZSTD);
+
+    assert_int_equal(compressAppend(c, "first\n", 6), 0);
+    assert_int_equal(compressFlush(c, receive, &r), 0);
+
+    // What couldn't be sent is kept, but not what was ahead of it
+    r.fail = 1;
+    assert_int_equal(compressAppendAhead(c, "hello\n", 6), 0);
+    assert_int_equal(compressAppend(c, "unsent\n", 7), 0);
+    assert_int_equal(compressFlush(c, receive, &r), -1);
+    compress_stats_t stats = compressStats(c);
+    assert_int_equal(stats.in, 6);
+    assert_int_equal(stats.dropped, 0);
+
+    // and sent to the next receiver, behind what's ahead for it and ahead
+    // of what came after it
+    receiverFree(&r);
+    receiverInit(&r);
+    assert_int_equal(compressAppend(c, "second\n", 7), 0);
+    assert_int_equal(compressAppendAhead(c, "again\n", 6), 0);
+    assert_int_equal(compressFlush(c, receive, &r), 0);
+    assert_int_equal(r.out_len, 20);
+    assert_memory_equal(r.out, "again\nunsent\nsecond\n", 20);
+
+    compressDestroy(&c);
+    receiverFree(&r);
+}
+
+static void
+compressAppendDropsWhenFull(void **state)
+{
+    compress_t *c = compressCreate(CFG_COMPRESS_ZSTD);
+
+    size_t len = 1024 * 1024;
+    char *big = scope_calloc(1, len);
+    assert_non_null(big);
+
+    int i;
+    for (i = 0; i < COMPRESS_MAX_PENDING / len; i++) {
+        assert_int_equal(compressAppend(c, big, len), 0);
+    }
+    assert_int_equal(compressAppend(c, "x", 1), -1);
+    compress_stats_t stats = compressStats(c);
+    assert_int_equal(stats.dropped, 1);
+
+    // There's room again after a flush
+    assert_int_equal(compressFlush(c, discard, NULL), 0);
+    assert_int_equal(compressAppend(c, "x", 1), 0);
+    stats = compressStats(c);
+    assert_int_equal(stats.in, COMPRESS_MAX_PENDING);
+
+    scope_free(big);
+    compressDestroy(&c);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(compressCreateReturnsNullForNone),
+        cmocka_unit_test(compressNullArgs),
+        cmocka_unit_test(compressFlushSendsWhatWasAppended),
+        cmocka_unit_test(compressResetStartsNewFrame),
+        cmocka_unit_test(compressFailedSendStartsNewFrame),
+        cmocka_unit_test(compressAppendDropsWhenFull),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
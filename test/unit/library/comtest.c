@@ -1,5 +1,6 @@
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <string.h>
 #include "com.h"
 #include "ctl.h"
 #include "dbg.h"
@@ -121,6 +122,65 @@ msgStartHasExpectedSubNodes(void** state)
     cfgDestroy(&cfg);
 }
 
+static void
+regexecWrapperMatchesLikeRegexec(void** state)
+{
+    regex_t re;
+    regmatch_t match[3];
+    assert_int_equal(0, regcomp_wrapper(&re, "([a-z]+)=([0-9]*)", REG_EXTENDED));
+
+    assert_int_equal(0, regexec_wrapper(&re, "say x=1", 3, match, 0));
+    assert_int_equal(4, match[0].rm_so);
+    assert_int_equal(7, match[0].rm_eo);
+    assert_int_equal(4, match[1].rm_so);
+    assert_int_equal(6, match[2].rm_so);
+    assert_int_equal(REG_NOMATCH, regexec_wrapper(&re, "SAY X=1", 3, match, 0));
+    assert_int_equal(0, regexec_wrapper(&re, "k=", 0, NULL, 0));
+
+    // only what's between rm_so and rm_eo is looked at
+    match[0].rm_so = 4;
+    match[0].rm_eo = 5;
+    assert_int_equal(REG_NOMATCH, regexec_wrapper(&re, "say x=1", 1, match, REG_STARTEND));
+    match[0].rm_eo = 7;
+    assert_int_equal(0, regexec_wrapper(&re, "say x=1", 1, match, REG_STARTEND));
+    assert_int_equal(4, match[0].rm_so);
+    assert_int_equal(7, match[0].rm_eo);
+    assert_int_equal(REG_INVARG, regexec_wrapper(&re, "say x=1", 0, NULL, REG_STARTEND));
+    regfree(&re);
+
+    // REG_NOSUB leaves pmatch alone
+    assert_int_equal(0, regcomp_wrapper(&re, "^fs\\.", REG_EXTENDED | REG_NOSUB));
+    match[0].rm_so = match[0].rm_eo = 99;
+    assert_int_equal(0, regexec_wrapper(&re, "fs.open", 1, match, 0));
+    assert_int_equal(99, match[0].rm_so);
+    assert_int_equal(REG_NOMATCH, regexec_wrapper(&re, "fs.open", 1, match, REG_NOTBOL));
+    assert_int_equal(REG_NOMATCH, regexec_wrapper(&re, "net.open", 0, NULL, 0));
+    regfree(&re);
+
+    assert_int_equal(REG_INVARG, regexec_wrapper(NULL, "fs.open", 0, NULL, 0));
+}
+
+static void
+pcre2MatchWrapperUsesOwnMatchData(void** state)
+{
+    int err;
+    PCRE2_SIZE off;
+    pcre2_code *re = pcre2_compile_wrapper((PCRE2_SPTR)"^GET (\\S+)", PCRE2_ZERO_TERMINATED,
+                                           0, &err, &off, NULL);
+    assert_non_null(re);
+
+    const char *req = "GET /index.html HTTP/1.1";
+    pcre2_match_data *md = pcreMatchDataGet(re);
+    assert_int_equal(2, pcre2_match_wrapper(re, (PCRE2_SPTR)req, strlen(req), 0, 0, md, NULL));
+    PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(md);
+    assert_int_equal(4, ovector[2]);
+    assert_int_equal(15, ovector[3]);
+    assert_int_equal(PCRE2_ERROR_NOMATCH,
+                     pcre2_match_wrapper(re, (PCRE2_SPTR)"PUT /", 5, 0, 0, md, NULL));
+    pcreMatchDataPut(md);
+    pcre2_code_free(re);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -132,6 +192,8 @@ main(int argc, char* argv[])
         cmocka_unit_test(cmdSendResponseDoesNotCrash),
         cmocka_unit_test(cmdParseDoesNotCrash),
         cmocka_unit_test(msgStartHasExpectedSubNodes),
+        cmocka_unit_test(regexecWrapperMatchesLikeRegexec),
+        cmocka_unit_test(pcre2MatchWrapperUsesOwnMatchData),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
@@ -4,9 +4,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/eventfd.h>
 #include "ctl.h"
 #include "circbuf.h"
 #include "dbg.h"
+#include "evtbin.h"
 #include "cfgutils.h"
 #include "state.h"
 #include "fn.h"
@@ -702,6 +704,108 @@ ctlTransportSetAndMtcSend(void** state)
     ctlDestroy(&ctl);
 }
 
+static void
+ctlFormatBinaryStartsAStreamPerConnection(void** state)
+{
+    const char* file_path = "/tmp/ctlbinary.path";
+    ctl_t* ctl = ctlCreate();
+    assert_non_null(ctl);
+    assert_int_equal(ctlFormat(ctl), CFG_FMT_NDJSON);
+
+    ctlTransportSet(ctl, transportCreateFile(file_path, CFG_BUFFER_LINE), CFG_CTL);
+    ctlFormatSet(ctl, CFG_FMT_BINARY);
+    assert_int_equal(ctlFormat(ctl), CFG_FMT_BINARY);
+    assert_int_equal(ctlConnect(ctl, CFG_CTL), 1);
+
+    int i;
+    for (i = 0; i < 2; i++) {
+        cJSON* json = cJSON_CreateObject();
+        cJSON_AddStringToObject(json, "type", "evt");
+        assert_int_equal(ctlSendJson(ctl, json, CFG_CTL), 0);
+    }
+    ctlFlush(ctl);
+
+    // A reconnect has to start over, with no dictionary
+    ctlDisconnect(ctl, CFG_CTL);
+    assert_int_equal(ctlConnect(ctl, CFG_CTL), 1);
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "type", "evt");
+    assert_int_equal(ctlSendJson(ctl, json, CFG_CTL), 0);
+    ctlFlush(ctl);
+
+    FILE* f = fopen(file_path, "r");
+    assert_non_null(f);
+    unsigned char buf[256];
+    size_t len = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+
+    // Count the records by type
+    int starts = 0, msgs = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        assert_int_equal(buf[pos++], EVTBIN_MARKER);
+        size_t reclen = buf[pos++];
+        if (buf[pos] == 'S') starts++;
+        if (buf[pos] == 'E') msgs++;
+        pos += reclen;
+    }
+    assert_int_equal(pos, len);
+    assert_int_equal(starts, 2);
+    assert_int_equal(msgs, 3);
+
+    ctlFormatSet(ctl, CFG_FMT_NDJSON);
+    assert_int_equal(ctlFormat(ctl), CFG_FMT_NDJSON);
+
+    if (scope_unlink(file_path))
+        fail_msg("Couldn't delete file %s", file_path);
+
+    ctlDestroy(&ctl);
+}
+
+static void
+ctlWakeupOnlyWhenArmed(void** state)
+{
+    ctl_t *ctl = ctlCreate();
+    assert_non_null(ctl);
+    char payload[] = "payload";
+    uint64_t count;
+
+    // Nothing to wake
+    assert_true(ctlWakeupArm(ctl));
+    assert_int_equal(ctlPostPayload(ctl, payload), 0);
+    assert_false(ctlWakeupArm(ctl));
+    assert_int_equal(ctlGetPayload(ctl), (uint64_t)payload);
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    assert_true(fd != -1);
+    ctlWakeupSet(ctl, fd);
+
+    // Not armed
+    assert_int_equal(ctlPostPayload(ctl, payload), 0);
+    assert_int_equal(read(fd, &count, sizeof(count)), -1);
+    assert_false(ctlWakeupArm(ctl));
+    assert_int_equal(ctlGetPayload(ctl), (uint64_t)payload);
+
+    // Armed, the first one wakes and the rest don't
+    assert_true(ctlWakeupArm(ctl));
+    assert_int_equal(ctlPostPayload(ctl, payload), 0);
+    assert_int_equal(ctlPostPayload(ctl, payload), 0);
+    assert_int_equal(read(fd, &count, sizeof(count)), sizeof(count));
+    assert_int_equal(count, 1);
+    assert_int_equal(ctlGetPayload(ctl), (uint64_t)payload);
+    assert_int_equal(ctlGetPayload(ctl), (uint64_t)payload);
+
+    // Re-armed
+    assert_true(ctlWakeupArm(ctl));
+    assert_int_equal(ctlPostPayload(ctl, payload), 0);
+    assert_int_equal(read(fd, &count, sizeof(count)), sizeof(count));
+    assert_int_equal(ctlGetPayload(ctl), (uint64_t)payload);
+
+    ctlWakeupSet(ctl, -1);
+    close(fd);
+    ctlDestroy(&ctl);
+}
+
 static void
 ctlAddProtocol(void** state)
 {
@@ -837,6 +941,8 @@ main(int argc, char* argv[])
         cmocka_unit_test(ctlSendMsgForNullMtcDoesntCrash),
         cmocka_unit_test(ctlSendMsgForNullMessageDoesntCrash),
         cmocka_unit_test(ctlTransportSetAndMtcSend),
+        cmocka_unit_test(ctlFormatBinaryStartsAStreamPerConnection),
+        cmocka_unit_test(ctlWakeupOnlyWhenArmed),
         cmocka_unit_test(ctlAddProtocol),
         cmocka_unit_test(ctlDelProtocol),
         cmocka_unit_test(ctlSendLogConsoleAsciiData),
@@ -0,0 +1,213 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "dbg.h"
+#include "dnscache.h"
+#include "plattime.h"
+#include "test.h"
+
+typedef struct {
+    int calls;
+    char name[MAX_HOSTNAME];
+    unsigned int naddrs;
+    uint64_t count;
+    uint64_t duration;
+} drained_t;
+
+static void
+drainFn(dns_answer_t const *answer, uint64_t count, uint64_t duration, void *ctx)
+{
+    drained_t *drained = ctx;
+    drained->calls++;
+    strncpy(drained->name, answer->name, sizeof(drained->name));
+    drained->naddrs = answer->naddrs;
+    drained->count += count;
+    drained->duration += duration;
+}
+
+static void
+setAnswer(dns_answer_t *answer, const char *name, uint32_t ttl, unsigned int naddrs)
+{
+    memset(answer, 0, sizeof(*answer));
+    strncpy(answer->name, name, sizeof(answer->name));
+    answer->ttl = ttl;
+    answer->naddrs = naddrs;
+    unsigned int i;
+    for (i = 0; i < naddrs; i++) {
+        answer->addrs[i].family = AF_INET;
+        answer->addrs[i].addr[0] = 10;
+        answer->addrs[i].addr[3] = i + 1;
+    }
+}
+
+static int
+dnsCacheSetup(void **state)
+{
+    initTime();
+    return groupSetup(state);
+}
+
+static void
+dnsCacheNullArgsDoNotCrash(void **state)
+{
+    dns_answer_t answer;
+    setAnswer(&answer, "www.example.com", 60, 1);
+
+    dnsCacheDestroy(NULL);
+    assert_false(dnsCacheRepeat(NULL, &answer, 0));
+    dnsCacheDrain(NULL, drainFn, NULL);
+
+    dns_cache_t *cache = dnsCacheCreate(0);
+    assert_non_null(cache);
+    assert_false(dnsCacheRepeat(cache, NULL, 0));
+    dnsCacheDrain(cache, NULL, NULL);
+    dnsCacheDestroy(&cache);
+    assert_null(cache);
+}
+
+static void
+dnsCacheCountsRepeats(void **state)
+{
+    dns_cache_t *cache = dnsCacheCreate(DNS_CACHE_ENTRIES);
+    dns_answer_t answer;
+    setAnswer(&answer, "www.example.com", 60, 3);
+
+    assert_false(dnsCacheRepeat(cache, &answer, 1000));
+    assert_true(dnsCacheRepeat(cache, &answer, 2000000));
+
+    // the same addresses in another order are the same answer
+    dns_addr_t first = answer.addrs[0];
+    answer.addrs[0] = answer.addrs[2];
+    answer.addrs[2] = first;
+    assert_true(dnsCacheRepeat(cache, &answer, 4000000));
+
+    drained_t drained = {0};
+    dnsCacheDrain(cache, drainFn, &drained);
+    assert_int_equal(drained.calls, 1);
+    assert_string_equal(drained.name, "www.example.com");
+    assert_int_equal(drained.naddrs, 3);
+    assert_int_equal(drained.count, 2);
+    assert_int_equal(drained.duration, 6000000);
+
+    // drained means cleared
+    memset(&drained, 0, sizeof(drained));
+    dnsCacheDrain(cache, drainFn, &drained);
+    assert_int_equal(drained.calls, 0);
+
+    // but the answer is still cached
+    assert_true(dnsCacheRepeat(cache, &answer, 0));
+
+    dnsCacheDestroy(&cache);
+}
+
+static void
+dnsCacheReplacesChangedAnswers(void **state)
+{
+    dns_cache_t *cache = dnsCacheCreate(DNS_CACHE_ENTRIES);
+    dns_answer_t answer;
+    setAnswer(&answer, "www.example.com", 60, 2);
+    assert_false(dnsCacheRepeat(cache, &answer, 0));
+    assert_true(dnsCacheRepeat(cache, &answer, 0));
+
+    // While there's a count for the cached answer, it stays
+    dns_answer_t changed;
+    setAnswer(&changed, "www.example.com", 60, 1);
+    assert_false(dnsCacheRepeat(cache, &changed, 0));
+    assert_false(dnsCacheRepeat(cache, &changed, 0));
+    assert_true(dnsCacheRepeat(cache, &answer, 0));
+
+    drained_t drained = {0};
+    dnsCacheDrain(cache, drainFn, &drained);
+    assert_int_equal(drained.naddrs, 2);
+    assert_int_equal(drained.count, 2);
+
+    // after it's drained the new one takes its place
+    assert_false(dnsCacheRepeat(cache, &changed, 0));
+    assert_true(dnsCacheRepeat(cache, &changed, 0));
+    assert_false(dnsCacheRepeat(cache, &answer, 0));
+
+    // Responses without addresses aren't cached
+    dns_answer_t none;
+    setAnswer(&none, "nxdomain.example.com", 60, 0);
+    assert_false(dnsCacheRepeat(cache, &none, 0));
+    assert_false(dnsCacheRepeat(cache, &none, 0));
+
+    dnsCacheDestroy(&cache);
+}
+
+static void
+dnsCacheHonorsTtl(void **state)
+{
+    dns_cache_t *cache = dnsCacheCreate(DNS_CACHE_ENTRIES);
+    dns_answer_t answer;
+
+    // a TTL of zero is not to be cached
+    setAnswer(&answer, "zero.example.com", 0, 1);
+    assert_false(dnsCacheRepeat(cache, &answer, 0));
+    assert_false(dnsCacheRepeat(cache, &answer, 0));
+
+    setAnswer(&answer, "one.example.com", 1, 1);
+    assert_false(dnsCacheRepeat(cache, &answer, 0));
+    assert_true(dnsCacheRepeat(cache, &answer, 0));
+    sleep(1);
+    usleep(100000);
+    assert_false(dnsCacheRepeat(cache, &answer, 0));
+
+    dnsCacheDestroy(&cache);
+}
+
+static void
+dnsCacheEvictsOnlyWhatsDrained(void **state)
+{
+    dns_cache_t *cache = dnsCacheCreate(4);
+    dns_answer_t answer;
+    char name[64];
+    int i;
+
+    // fill it, and give each name a count
+    for (i = 0; i < 4; i++) {
+        snprintf(name, sizeof(name), "host%d.example.com", i);
+        setAnswer(&answer, name, 60, 1);
+        assert_false(dnsCacheRepeat(cache, &answer, 0));
+        assert_true(dnsCacheRepeat(cache, &answer, 0));
+    }
+
+    // no room for another until the counts are drained
+    setAnswer(&answer, "new.example.com", 60, 1);
+    assert_false(dnsCacheRepeat(cache, &answer, 0));
+    assert_false(dnsCacheRepeat(cache, &answer, 0));
+
+    drained_t drained = {0};
+    dnsCacheDrain(cache, drainFn, &drained);
+    assert_int_equal(drained.calls, 4);
+    assert_int_equal(drained.count, 4);
+
+    // host0 was used least recently
+    assert_false(dnsCacheRepeat(cache, &answer, 0));
+    assert_true(dnsCacheRepeat(cache, &answer, 0));
+    setAnswer(&answer, "host0.example.com", 60, 1);
+    assert_false(dnsCacheRepeat(cache, &answer, 0));
+    setAnswer(&answer, "host3.example.com", 60, 1);
+    assert_true(dnsCacheRepeat(cache, &answer, 0));
+
+    dnsCacheDestroy(&cache);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(dnsCacheNullArgsDoNotCrash),
+        cmocka_unit_test(dnsCacheCountsRepeats),
+        cmocka_unit_test(dnsCacheReplacesChangedAnswers),
+        cmocka_unit_test(dnsCacheHonorsTtl),
+        cmocka_unit_test(dnsCacheEvictsOnlyWhatsDrained),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, dnsCacheSetup, groupTeardown);
+}
@@ -0,0 +1,189 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "dns.h"
+#include "test.h"
+
+// A response for www.example.com; a CNAME to web.example.com, then an
+// A and an AAAA record for that, all with compressed names.
+static const unsigned char response[] = {
+    0x12, 0x34, 0x81, 0x80, 0x00, 0x01, 0x00, 0x03,   // header
+    0x00, 0x00, 0x00, 0x00,
+    0x03, 'w', 'w', 'w',                               // 12: question
+    0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+    0x03, 'c', 'o', 'm', 0x00,
+    0x00, 0x01, 0x00, 0x01,
+    0xc0, 0x0c, 0x00, 0x05, 0x00, 0x01,                // 33: CNAME
+    0x00, 0x00, 0x01, 0x2c, 0x00, 0x06,
+    0x03, 'w', 'e', 'b', 0xc0, 0x10,                   // 45: web + example.com
+    0xc0, 0x2d, 0x00, 0x01, 0x00, 0x01,                // 51: A
+    0x00, 0x00, 0x00, 0x3c, 0x00, 0x04,
+    0x5d, 0xb8, 0xd8, 0x22,
+    0xc0, 0x2d, 0x00, 0x1c, 0x00, 0x01,                // 67: AAAA
+    0x00, 0x00, 0x00, 0x78, 0x00, 0x10,
+    0x26, 0x06, 0x28, 0x00, 0x02, 0x20, 0x00, 0x01,
+    0x02, 0x48, 0x18, 0x93, 0x25, 0xc8, 0x19, 0x46,
+};
+
+static void
+dnsMsgInitRejectsShortHeader(void **state)
+{
+    dns_msg_t msg;
+    assert_false(dnsMsgInit(NULL, response, sizeof(response)));
+    assert_false(dnsMsgInit(&msg, NULL, sizeof(response)));
+    assert_false(dnsMsgInit(&msg, response, 11));
+    assert_true(dnsMsgInit(&msg, response, 12));
+    // the question doesn't fit, so there are no answers to be had
+    dns_rr_t rr;
+    assert_false(dnsMsgNextAnswer(&msg, &rr));
+}
+
+static void
+dnsMsgParsesResponse(void **state)
+{
+    dns_msg_t msg;
+    dns_rr_t rr;
+    char name[MAX_HOSTNAME];
+
+    assert_true(dnsMsgInit(&msg, response, sizeof(response)));
+    assert_int_equal(msg.id, 0x1234);
+    assert_int_equal(DNS_QR(&msg), 1);
+    assert_int_equal(DNS_OPCODE(&msg), OPCODE_QUERY);
+    assert_int_equal(msg.qdcount, 1);
+    assert_int_equal(msg.ancount, 3);
+    assert_int_equal(dnsMsgName(&msg, msg.qname, name, sizeof(name)), 15);
+    assert_string_equal(name, "www.example.com");
+
+    assert_true(dnsMsgNextAnswer(&msg, &rr));
+    assert_int_equal(rr.type, ns_t_cname);
+    assert_int_equal(rr.class, ns_c_in);
+    assert_int_equal(rr.ttl, 300);
+    assert_int_equal(dnsMsgName(&msg, rr.name, name, sizeof(name)), 15);
+    assert_string_equal(name, "www.example.com");
+    // rdata points into the message
+    assert_ptr_equal(rr.rdata, &response[45]);
+    assert_int_equal(dnsMsgName(&msg, rr.rdata - msg.buf, name, sizeof(name)), 15);
+    assert_string_equal(name, "web.example.com");
+
+    assert_true(dnsMsgNextAnswer(&msg, &rr));
+    assert_int_equal(rr.type, ns_t_a);
+    assert_int_equal(rr.ttl, 60);
+    assert_int_equal(rr.rdlength, 4);
+    assert_memory_equal(rr.rdata, "\x5d\xb8\xd8\x22", 4);
+    dnsMsgName(&msg, rr.name, name, sizeof(name));
+    assert_string_equal(name, "web.example.com");
+
+    assert_true(dnsMsgNextAnswer(&msg, &rr));
+    assert_int_equal(rr.type, ns_t_aaaa);
+    assert_int_equal(rr.rdlength, 16);
+    assert_ptr_equal(rr.rdata, &response[79]);
+
+    assert_false(dnsMsgNextAnswer(&msg, &rr));
+}
+
+static void
+dnsMsgHandlesEveryTruncation(void **state)
+{
+    // With each length short of the whole message, whatever is returned
+    // has to lie inside it; ASAN tells if anything is read past it.
+    size_t len;
+    for (len = 0; len < sizeof(response); len++) {
+        unsigned char *buf = malloc(len ? len : 1);
+        memcpy(buf, response, len);
+
+        dns_msg_t msg;
+        dns_rr_t rr;
+        char name[MAX_HOSTNAME];
+        int answers = 0;
+        if (dnsMsgInit(&msg, buf, len)) {
+            dnsMsgName(&msg, msg.qname, name, sizeof(name));
+            while (dnsMsgNextAnswer(&msg, &rr)) {
+                assert_true(rr.rdata + rr.rdlength <= buf + len);
+                dnsMsgName(&msg, rr.name, name, sizeof(name));
+                answers++;
+            }
+        }
+        assert_true(answers < 3);
+        free(buf);
+    }
+}
+
+static void
+dnsMsgNameRejectsMalformed(void **state)
+{
+    dns_msg_t msg;
+    char name[MAX_HOSTNAME];
+    unsigned char buf[sizeof(response)];
+
+    // a pointer to itself
+    memcpy(buf, response, sizeof(buf));
+    buf[12] = 0xc0;
+    buf[13] = 0x0c;
+    assert_true(dnsMsgInit(&msg, buf, sizeof(buf)));
+    assert_int_equal(dnsMsgName(&msg, 12, name, sizeof(name)), -1);
+    assert_string_equal(name, "");
+
+    // a pointer past the end
+    buf[13] = 0xff;
+    assert_int_equal(dnsMsgName(&msg, 12, name, sizeof(name)), -1);
+
+    // a label longer than 63
+    memcpy(buf, response, sizeof(buf));
+    buf[12] = 64;
+    assert_true(dnsMsgInit(&msg, buf, sizeof(buf)));
+    assert_int_equal(dnsMsgName(&msg, 12, name, sizeof(name)), -1);
+
+    // a name that doesn't fit
+    assert_true(dnsMsgInit(&msg, response, sizeof(response)));
+    assert_int_equal(dnsMsgName(&msg, 12, name, 15), -1);
+    assert_int_equal(dnsMsgName(&msg, 12, name, 16), 15);
+    assert_int_equal(dnsMsgName(&msg, 12, NULL, 16), -1);
+    assert_int_equal(dnsMsgName(&msg, sizeof(response), name, sizeof(name)), -1);
+
+    // the root name
+    buf[12] = 0;
+    assert_true(dnsMsgInit(&msg, buf, sizeof(buf)));
+    assert_int_equal(dnsMsgName(&msg, 12, name, sizeof(name)), 0);
+    assert_string_equal(name, "");
+}
+
+static void
+dnsMsgNameRejectsLongNames(void **state)
+{
+    // 5 labels of 63 make a name of 319 characters
+    unsigned char buf[12 + 5 * 64 + 1] = {0};
+    int i;
+    for (i = 0; i < 5; i++) {
+        buf[12 + i * 64] = 63;
+        memset(&buf[12 + i * 64 + 1], 'a', 63);
+    }
+
+    dns_msg_t msg;
+    char name[1024];
+    assert_true(dnsMsgInit(&msg, buf, sizeof(buf)));
+    assert_int_equal(dnsMsgName(&msg, 12, name, MAX_HOSTNAME), -1);
+    assert_int_equal(dnsMsgName(&msg, 12, name, 5 * 64), 5 * 63 + 4);
+
+    // 3 of them are fine
+    buf[12 + 3 * 64] = 0;
+    assert_int_equal(dnsMsgName(&msg, 12, name, MAX_HOSTNAME), 3 * 63 + 2);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(dnsMsgInitRejectsShortHeader),
+        cmocka_unit_test(dnsMsgParsesResponse),
+        cmocka_unit_test(dnsMsgHandlesEveryTruncation),
+        cmocka_unit_test(dnsMsgNameRejectsMalformed),
+        cmocka_unit_test(dnsMsgNameRejectsLongNames),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
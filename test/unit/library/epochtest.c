@@ -0,0 +1,251 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "ctl.h"
+#include "dbg.h"
+#include "epoch.h"
+#include "log.h"
+#include "mtc.h"
+#include "test.h"
+
+#define READER_THREADS 4
+#define RELOADS 2000
+
+#ifdef __SANITIZE_ADDRESS__
+// What's freed is held in quarantine, up to 256MB of it by default.  To the
+// RSS that looks just like the leak we're testing for.
+const char *
+__asan_default_options(void)
+{
+    return "quarantine_size_mb=1";
+}
+#endif
+
+static int g_freed;
+
+static void
+countFree(void *obj)
+{
+    g_freed++;
+}
+
+static void
+epochReclaimWithNothingRetired(void **state)
+{
+    assert_int_equal(epochReclaim(), 0);
+}
+
+static void
+epochReclaimWithNoSections(void **state)
+{
+    int a, b;
+    g_freed = 0;
+
+    epochRetire(countFree, &a);
+    epochRetire(countFree, &b);
+    epochRetire(countFree, NULL);
+    epochRetire(NULL, &a);
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(g_freed, 2);
+}
+
+static void
+epochSectionHoldsOffReclaim(void **state)
+{
+    int a;
+    g_freed = 0;
+
+    epochEnter();
+    epochRetire(countFree, &a);
+    assert_int_equal(epochReclaim(), 1);
+    assert_int_equal(epochReclaim(), 1);
+    assert_int_equal(g_freed, 0);
+    epochLeave();
+
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(g_freed, 1);
+}
+
+static void
+epochNestedSectionsEndWithTheOutermost(void **state)
+{
+    int a;
+    g_freed = 0;
+
+    epochEnter();
+    {
+        EPOCH_SECTION();
+        epochRetire(countFree, &a);
+    }
+    assert_int_equal(epochReclaim(), 1);
+    epochLeave();
+
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(g_freed, 1);
+}
+
+static void
+epochLaterSectionsDontHoldOffReclaim(void **state)
+{
+    int a;
+    g_freed = 0;
+
+    epochEnter();
+    epochRetire(countFree, &a);
+    assert_int_equal(epochReclaim(), 1);
+
+    // Sections begun after the flip can't have loaded a; they don't count
+    epochEnter();
+    epochLeave();
+    epochEnter();
+    epochLeave();
+    epochEnter();
+    epochLeave();
+
+    // It's the one that began before that holds a
+    assert_int_equal(epochReclaim(), 1);
+    epochLeave();
+    epochEnter();
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(g_freed, 1);
+    epochLeave();
+}
+
+static void
+epochLeaveWithoutEnter(void **state)
+{
+    epochLeave();
+    assert_int_equal(dbgCountMatchingLines("src/epoch.c"), 1);
+    dbgInit();
+}
+
+// The objects a config reload replaces
+static ctl_t *g_ctl_now;
+static mtc_t *g_mtc_now;
+static log_t *g_log_now;
+static volatile int g_reloading;
+
+static void
+retireCtl(void *obj)
+{
+    ctl_t *ctl = obj;
+    ctlDestroy(&ctl);
+}
+
+static void
+retireMtc(void *obj)
+{
+    mtc_t *mtc = obj;
+    mtcDestroy(&mtc);
+}
+
+static void
+retireLog(void *obj)
+{
+    log_t *log = obj;
+    logDestroy(&log);
+}
+
+static void *
+useConfig(void *arg)
+{
+    long *used = arg;
+    while (g_reloading) {
+        EPOCH_SECTION();
+        if (ctlEvtSourceEnabled(g_ctl_now, CFG_SRC_FILE) ||
+            mtcEnabled(g_mtc_now) || (logLevel(g_log_now) != CFG_LOG_NONE)) {
+            (*used)++;
+        }
+    }
+    return NULL;
+}
+
+static long
+rss(void)
+{
+    long size, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static void
+reload(void)
+{
+    ctl_t *ctl = g_ctl_now;
+    mtc_t *mtc = g_mtc_now;
+    log_t *log = g_log_now;
+
+    g_ctl_now = ctlCreate();
+    g_mtc_now = mtcCreate();
+    g_log_now = logCreate();
+
+    epochRetire(retireCtl, ctl);
+    epochRetire(retireMtc, mtc);
+    epochRetire(retireLog, log);
+
+    // A reader preempted in its section holds off the reclaim for as long
+    // as it's off the cpu.  Reloads are rare; don't outrun it by thousands.
+    if (epochReclaim() > 30) sched_yield();
+}
+
+static void
+epochReloadStormKeepsRssFlat(void **state)
+{
+    pthread_t threads[READER_THREADS];
+    long used[READER_THREADS] = {0};
+    int i;
+
+    g_ctl_now = ctlCreate();
+    g_mtc_now = mtcCreate();
+    g_log_now = logCreate();
+    g_reloading = 1;
+    for (i = 0; i < READER_THREADS; i++) {
+        assert_int_equal(pthread_create(&threads[i], NULL, useConfig, &used[i]), 0);
+    }
+
+    // Warm up the heap, then reload as fast as we can
+    for (i = 0; i < RELOADS / 10; i++) reload();
+    long before = rss();
+    for (i = 0; i < RELOADS; i++) reload();
+    long after = rss();
+
+    g_reloading = 0;
+    for (i = 0; i < READER_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        assert_true(used[i] > 0);
+    }
+
+    // Nothing is left behind once the readers are gone
+    assert_int_equal(epochReclaim(), 0);
+    ctlDestroy(&g_ctl_now);
+    mtcDestroy(&g_mtc_now);
+    logDestroy(&g_log_now);
+
+    // Each generation is hundreds of KB; a leak would be hundreds of MB
+    assert_true(before > 0);
+    assert_true(after < before + 16 * 1024 * 1024);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(epochReclaimWithNothingRetired),
+        cmocka_unit_test(epochReclaimWithNoSections),
+        cmocka_unit_test(epochSectionHoldsOffReclaim),
+        cmocka_unit_test(epochNestedSectionsEndWithTheOutermost),
+        cmocka_unit_test(epochLaterSectionsDontHoldOffReclaim),
+        cmocka_unit_test(epochLeaveWithoutEnter),
+        cmocka_unit_test(epochReloadStormKeepsRssFlat),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -0,0 +1,395 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dbg.h"
+#include "evtbin.h"
+#include "test.h"
+
+// Just enough of a decoder to check what the encoder writes
+typedef struct {
+    char *strs[8192];
+    int nstrs;
+    uint64_t stream;
+    int starts;
+    bool bad;
+} decoder_t;
+
+static uint64_t
+getUvarint(const uint8_t **p, const uint8_t *end, decoder_t *d)
+{
+    uint64_t val = 0;
+    int shift = 0;
+    while (*p < end) {
+        uint8_t b = *(*p)++;
+        val |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return val;
+        shift += 7;
+    }
+    d->bad = TRUE;
+    return 0;
+}
+
+static char *
+getStr(const uint8_t **p, const uint8_t *end, decoder_t *d, bool key)
+{
+    uint8_t tag = *(*p)++;
+    if (tag == 0x07) {
+        uint64_t i = getUvarint(p, end, d);
+        if (i >= d->nstrs) {
+            d->bad = TRUE;
+            return strdup("");
+        }
+        return strdup(d->strs[i]);
+    }
+    if ((tag != 0x05) && (tag != 0x06) && (tag != 0x0a)) {
+        d->bad = TRUE;
+        return strdup("");
+    }
+    uint64_t len = getUvarint(p, end, d);
+    if (len > end - *p) {
+        d->bad = TRUE;
+        return strdup("");
+    }
+    char *str = strndup((const char *)*p, len);
+    *p += len;
+    if (tag == 0x06) d->strs[d->nstrs++] = strdup(str);
+    return str;
+}
+
+static cJSON *
+getValue(const uint8_t **p, const uint8_t *end, decoder_t *d)
+{
+    if (*p >= end) {
+        d->bad = TRUE;
+        return cJSON_CreateNull();
+    }
+
+    uint8_t tag = **p;
+    uint64_t count, i;
+    cJSON *item;
+    char *str;
+
+    switch (tag) {
+        case 0x00: (*p)++; return cJSON_CreateNull();
+        case 0x01: (*p)++; return cJSON_CreateFalse();
+        case 0x02: (*p)++; return cJSON_CreateTrue();
+        case 0x03:
+        {
+            (*p)++;
+            uint64_t zz = getUvarint(p, end, d);
+            return cJSON_CreateNumber((double)(int64_t)((zz >> 1) ^ -(zz & 1)));
+        }
+        case 0x04:
+        {
+            (*p)++;
+            uint64_t bits = 0;
+            double dbl;
+            for (i = 0; i < 8; i++) bits |= (uint64_t)(*p)[i] << (i * 8);
+            *p += 8;
+            memcpy(&dbl, &bits, sizeof(dbl));
+            return cJSON_CreateNumber(dbl);
+        }
+        case 0x05:
+        case 0x06:
+        case 0x07:
+            str = getStr(p, end, d, FALSE);
+            item = cJSON_CreateString(str);
+            free(str);
+            return item;
+        case 0x0a:
+            str = getStr(p, end, d, FALSE);
+            item = cJSON_Parse(str);
+            free(str);
+            return item;
+        case 0x08:
+            (*p)++;
+            item = cJSON_CreateObject();
+            count = getUvarint(p, end, d);
+            for (i = 0; (i < count) && !d->bad; i++) {
+                str = getStr(p, end, d, TRUE);
+                cJSON_AddItemToObject(item, str, getValue(p, end, d));
+                free(str);
+            }
+            return item;
+        case 0x09:
+            (*p)++;
+            item = cJSON_CreateArray();
+            count = getUvarint(p, end, d);
+            for (i = 0; (i < count) && !d->bad; i++) {
+                cJSON_AddItemToArray(item, getValue(p, end, d));
+            }
+            return item;
+        default:
+            d->bad = TRUE;
+            (*p)++;
+            return cJSON_CreateNull();
+    }
+}
+
+static void
+clearDecoder(decoder_t *d)
+{
+    while (d->nstrs) free(d->strs[--d->nstrs]);
+}
+
+// Decodes the records in buf, returns the messages in them
+static int
+decode(decoder_t *d, const char *buf, size_t len, cJSON **msgs, int max)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    const uint8_t *end = p + len;
+    int n = 0;
+
+    while ((p < end) && !d->bad) {
+        if (*p++ != EVTBIN_MARKER) {
+            d->bad = TRUE;
+            break;
+        }
+        uint64_t reclen = getUvarint(&p, end, d);
+        if (reclen > end - p) {
+            d->bad = TRUE;
+            break;
+        }
+        const uint8_t *recend = p + reclen;
+        char type = *p++;
+        d->stream = getUvarint(&p, recend, d);
+
+        switch (type) {
+            case 'S':
+                if (getUvarint(&p, recend, d) != EVTBIN_VERSION) d->bad = TRUE;
+                clearDecoder(d);
+                d->starts++;
+                break;
+            case 'E':
+                if (n < max) msgs[n++] = getValue(&p, recend, d);
+                break;
+            case 'J':
+            {
+                char *text = strndup((const char *)p, recend - p);
+                if (n < max) msgs[n++] = cJSON_Parse(text);
+                free(text);
+                p = recend;
+                break;
+            }
+            default:
+                d->bad = TRUE;
+        }
+        if (p != recend) d->bad = TRUE;
+        p = recend;
+    }
+    return n;
+}
+
+static cJSON *
+event(const char *proc, const char *path, double duration)
+{
+    cJSON *body = cJSON_CreateObject();
+    cJSON_AddStringToObject(body, "sourcetype", "fs");
+    cJSON_AddStringToObject(body, "source", "fs.open");
+    cJSON_AddNumberToObject(body, "_time", 1650000000.123);
+    cJSON_AddStringToObject(body, "host", "myhost");
+    cJSON_AddStringToObject(body, "proc", proc);
+    cJSON_AddNumberToObject(body, "pid", 4321);
+    cJSON *data = cJSON_AddObjectToObject(body, "data");
+    cJSON_AddStringToObject(data, "file", path);
+    cJSON_AddNumberToObject(data, "duration", duration);
+    cJSON_AddNumberToObject(data, "negative", -17);
+    cJSON_AddNumberToObject(data, "big", 9007199254740993.0);
+    cJSON_AddNumberToObject(data, "huge", -1e300);
+    cJSON_AddBoolToObject(data, "yes", TRUE);
+    cJSON_AddBoolToObject(data, "no", FALSE);
+    cJSON_AddNullToObject(data, "nothing");
+    cJSON_AddRawToObject(data, "raw", "{\"a\":[1,2]}");
+    cJSON *args = cJSON_AddArrayToObject(data, "args");
+    cJSON_AddItemToArray(args, cJSON_CreateString(proc));
+    cJSON_AddItemToArray(args, cJSON_CreateString(""));
+    cJSON_AddItemToArray(args, cJSON_CreateNumber(0.5));
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "type", "evt");
+    cJSON_AddStringToObject(root, "_channel", "12345");
+    cJSON_AddItemToObject(root, "body", body);
+    return root;
+}
+
+static void
+assertSameJson(cJSON *one, cJSON *two)
+{
+    char *a = cJSON_PrintUnformatted(one);
+    char *b = cJSON_PrintUnformatted(two);
+    assert_string_equal(a, b);
+    free(a);
+    free(b);
+}
+
+static void
+evtBinEncodeDecodesToTheSameJson(void **state)
+{
+    evt_bin_t *bin = evtBinCreate(TRUE);
+    assert_non_null(bin);
+    decoder_t d = {0};
+    size_t lens[4];
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        cJSON *json = event("nginx", (i & 1) ? "/var/log/a.log" : "/etc/hosts", i * 1.25);
+        size_t len;
+        const char *rec = evtBinEncode(bin, json, &len);
+        assert_non_null(rec);
+        lens[i] = len;
+
+        cJSON *msg = NULL;
+        assert_int_equal(decode(&d, rec, len, &msg, 1), 1);
+        assert_false(d.bad);
+        assert_non_null(msg);
+        assertSameJson(json, msg);
+
+        cJSON_Delete(msg);
+        cJSON_Delete(json);
+    }
+
+    // Only the first began a stream, and the ones after it are smaller
+    // for the strings they no longer have to spell out
+    assert_int_equal(d.starts, 1);
+    assert_true(lens[1] < lens[0]);
+    assert_true(lens[2] < lens[1]);
+    assert_true(lens[3] < lens[1]);
+    assert_int_equal(d.stream & ((1 << 22) - 1), getpid());
+
+    clearDecoder(&d);
+    evtBinDestroy(&bin);
+    assert_null(bin);
+}
+
+static void
+evtBinResetStartsANewStream(void **state)
+{
+    evt_bin_t *bin = evtBinCreate(TRUE);
+    decoder_t d = {0};
+    cJSON *json = event("redis", "/tmp/dump.rdb", 3);
+    cJSON *msg;
+    size_t len;
+
+    const char *rec = evtBinEncode(bin, json, &len);
+    assert_int_equal(decode(&d, rec, len, &msg, 1), 1);
+    cJSON_Delete(msg);
+    uint64_t first = d.stream;
+
+    // A decoder that missed everything before the reset still gets it all
+    evtBinReset(bin);
+    decoder_t late = {0};
+    rec = evtBinEncode(bin, json, &len);
+    assert_int_equal(decode(&late, rec, len, &msg, 1), 1);
+    assert_false(late.bad);
+    assert_int_equal(late.starts, 1);
+    assert_int_not_equal(late.stream, first);
+    assertSameJson(json, msg);
+    cJSON_Delete(msg);
+
+    clearDecoder(&d);
+    clearDecoder(&late);
+    cJSON_Delete(json);
+    evtBinDestroy(&bin);
+}
+
+static void
+evtBinWithoutDictionaryStandsAlone(void **state)
+{
+    evt_bin_t *bin = evtBinCreate(FALSE);
+    cJSON *json = event("nginx", "/etc/hosts", 1);
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        // Each one decodes without having seen any other
+        decoder_t d = {0};
+        cJSON *msg;
+        size_t len;
+        const char *rec = evtBinEncode(bin, json, &len);
+        assert_int_equal(decode(&d, rec, len, &msg, 1), 1);
+        assert_false(d.bad);
+        assert_int_equal(d.nstrs, 0);
+        assertSameJson(json, msg);
+        cJSON_Delete(msg);
+    }
+
+    cJSON_Delete(json);
+    evtBinDestroy(&bin);
+}
+
+static void
+evtBinEncodeTextIsTheText(void **state)
+{
+    evt_bin_t *bin = evtBinCreate(TRUE);
+    decoder_t d = {0};
+    const char *text = "{\"type\":\"resp\",\"reqId\":3,\"status\":200}";
+    cJSON *msg;
+    size_t len;
+
+    const char *rec = evtBinEncodeText(bin, text, &len);
+    assert_non_null(rec);
+    assert_int_equal(decode(&d, rec, len, &msg, 1), 1);
+    assert_false(d.bad);
+    char *out = cJSON_PrintUnformatted(msg);
+    assert_string_equal(out, text);
+    free(out);
+    cJSON_Delete(msg);
+
+    assert_null(evtBinEncodeText(bin, NULL, &len));
+    assert_null(evtBinEncodeText(NULL, text, &len));
+    assert_null(evtBinEncode(bin, NULL, &len));
+    assert_null(evtBinEncode(NULL, NULL, &len));
+    evtBinReset(NULL);
+    evtBinDestroy(NULL);
+
+    clearDecoder(&d);
+    evtBinDestroy(&bin);
+}
+
+static void
+evtBinDictionaryStartsOverWhenFull(void **state)
+{
+    evt_bin_t *bin = evtBinCreate(TRUE);
+    decoder_t d = {0};
+    int i;
+
+    // Unique keys, far more than fit
+    for (i = 0; i < 10000; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "key%d", i);
+        cJSON *json = cJSON_CreateObject();
+        cJSON_AddNumberToObject(json, key, i);
+        cJSON_AddStringToObject(json, "type", "evt");
+
+        cJSON *msg;
+        size_t len;
+        const char *rec = evtBinEncode(bin, json, &len);
+        assert_int_equal(decode(&d, rec, len, &msg, 1), 1);
+        assert_false(d.bad);
+        assertSameJson(json, msg);
+        cJSON_Delete(msg);
+        cJSON_Delete(json);
+    }
+    assert_true(d.starts > 1);
+
+    clearDecoder(&d);
+    evtBinDestroy(&bin);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(evtBinEncodeDecodesToTheSameJson),
+        cmocka_unit_test(evtBinResetStartsANewStream),
+        cmocka_unit_test(evtBinWithoutDictionaryStandsAlone),
+        cmocka_unit_test(evtBinEncodeTextIsTheText),
+        cmocka_unit_test(evtBinDictionaryStartsOverWhenFull),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
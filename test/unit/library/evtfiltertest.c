@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "evtfilter.h"
+#include "pcrectx.h"
+#include "test.h"
+
+// The default filters, and ones like those in the docs
+static const char *patterns[] = {
+    "",
+    ".*",
+    "^.*",
+    ".*$",
+    "^.*$",
+    "net.rx",
+    "net\\.rx",
+    "^net\\.",
+    "^net\\..*",
+    "\\.log$",
+    "^stdout$",
+    "(stdout)|(stderr)",
+    "(stdout|stderr)",
+    "^(stdout|stderr)$",
+    "^http\\.req|http\\.resp$",
+    ".*host.*",
+    ".*host",
+    "^fs\\.(open|close)$",
+    "^[^h]+",
+    "(\\/logs?\\/)|(\\.log$)|(\\.log[.\\d])",
+    "a|",
+    "^$",
+    "$",
+    "^",
+    "\\/var\\/log\\/",
+    "net\\d",
+    "(?:stdout)",
+    "^net.*$",
+    "x\\$y",
+};
+
+static const char *subjects[] = {
+    "",
+    "\n",
+    "net.rx",
+    "net.rx\n",
+    "net.rxy",
+    "netxrx",
+    "fs.open",
+    "fs.open\n",
+    "fs.opened",
+    "fs.close",
+    "stdout",
+    "stdout\n",
+    "/dev/stdout",
+    "stderr\nstdout",
+    "stdout\nstderr",
+    "http.req",
+    "http.resp",
+    "xhttp.req",
+    "http.resp\n\n",
+    "hostname",
+    "my.host",
+    "/var/log/messages",
+    "/opt/app/app.log",
+    "/opt/app/app.log\n",
+    "/opt/app/app.log.1",
+    "a\nb",
+    "x$y",
+    "net1",
+};
+
+#define NUM(a) (sizeof(a) / sizeof((a)[0]))
+
+static void
+evtFilterMatchesLikeTheRegex(void **state)
+{
+    int p, s;
+    for (p = 0; p < NUM(patterns); p++) {
+        regex_t re;
+        assert_int_equal(regcomp(&re, patterns[p], REG_EXTENDED | REG_NOSUB), 0);
+        evt_filter_t *filter = evtFilterCreate(patterns[p]);
+        assert_non_null(filter);
+
+        for (s = 0; s < NUM(subjects); s++) {
+            bool expected = !regexec(&re, subjects[s], 0, NULL, 0);
+            if (evtFilterMatch(filter, subjects[s]) != expected ||
+                evtFilterMatchName(filter, subjects[s]) != expected) {
+                fail_msg("\"%s\" against \"%s\" should be %s",
+                         patterns[p], subjects[s], expected ? "a match" : "no match");
+            }
+        }
+        regfree(&re);
+        evtFilterDestroy(&filter);
+        assert_null(filter);
+    }
+}
+
+static void
+evtFilterKnowsWhatMatchesAll(void **state)
+{
+    const char *all[] = {"", ".*", "^.*", ".*$"};
+    const char *notall[] = {"^.*$", ".+", "net.*", "a|", "^[^h]+"};
+    int i;
+
+    for (i = 0; i < NUM(all); i++) {
+        evt_filter_t *filter = evtFilterCreate(all[i]);
+        assert_true(evtFilterMatchesAll(filter));
+        evtFilterDestroy(&filter);
+    }
+    for (i = 0; i < NUM(notall); i++) {
+        evt_filter_t *filter = evtFilterCreate(notall[i]);
+        assert_false(evtFilterMatchesAll(filter));
+        evtFilterDestroy(&filter);
+    }
+}
+
+static void
+evtFilterCreateRejectsBadPatterns(void **state)
+{
+    assert_null(evtFilterCreate(NULL));
+    assert_null(evtFilterCreate("W![T^F?"));
+    assert_null(evtFilterCreate("(stdout"));
+
+    evt_filter_t *filter = NULL;
+    evtFilterDestroy(&filter);
+    evtFilterDestroy(NULL);
+    assert_false(evtFilterMatch(NULL, "x"));
+    assert_false(evtFilterMatchName(NULL, "x"));
+    assert_false(evtFilterMatchesAll(NULL));
+
+    filter = evtFilterCreate(".*");
+    assert_false(evtFilterMatch(filter, NULL));
+    assert_false(evtFilterMatchName(filter, NULL));
+    evtFilterDestroy(&filter);
+}
+
+static void
+evtFilterMatchNameIsntFooledByANameThatChanges(void **state)
+{
+    evt_filter_t *filter = evtFilterCreate("^[^h]+");
+    char name[16];
+
+    strcpy(name, "proc");
+    assert_true(evtFilterMatchName(filter, name));
+    assert_true(evtFilterMatchName(filter, name));
+
+    // Same place, different name
+    strcpy(name, "host");
+    assert_false(evtFilterMatchName(filter, name));
+    assert_false(evtFilterMatchName(filter, name));
+    strcpy(name, "proc");
+    assert_true(evtFilterMatchName(filter, name));
+
+    // Longer than what's remembered
+    const char *longname = "haaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+    assert_false(evtFilterMatchName(filter, longname));
+    assert_true(evtFilterMatchName(filter, longname + 1));
+
+    evtFilterDestroy(&filter);
+}
+
+#define NAME_THREADS 16
+
+static evt_filter_t *g_filter;
+
+static void *
+matchNames(void *arg)
+{
+    long *wrong = arg;
+    char name[16];
+    int i;
+    for (i = 0; i < 20000; i++) {
+        // Half the names start with h and don't match
+        snprintf(name, sizeof(name), "%c%d", (i & 1) ? 'h' : 'p', i % 97);
+        if (evtFilterMatchName(g_filter, name) != !(i & 1)) (*wrong)++;
+    }
+    return NULL;
+}
+
+static void
+evtFilterMatchNameManyThreads(void **state)
+{
+    pthread_t threads[NAME_THREADS];
+    long wrong[NAME_THREADS] = {0};
+    int i;
+
+    g_filter = evtFilterCreate("^[^h]+");
+    for (i = 0; i < NAME_THREADS; i++) {
+        assert_int_equal(pthread_create(&threads[i], NULL, matchNames, &wrong[i]), 0);
+    }
+    for (i = 0; i < NAME_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        assert_int_equal(wrong[i], 0);
+    }
+    evtFilterDestroy(&g_filter);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(evtFilterMatchesLikeTheRegex),
+        cmocka_unit_test(evtFilterKnowsWhatMatchesAll),
+        cmocka_unit_test(evtFilterCreateRejectsBadPatterns),
+        cmocka_unit_test(evtFilterMatchNameIsntFooledByANameThatChanges),
+        cmocka_unit_test(evtFilterMatchNameManyThreads),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
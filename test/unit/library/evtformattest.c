@@ -572,9 +572,9 @@ fmtMetricJsonWFilteredFields(void** state)
         FIELDEND
     };
     event_t e = INT_EVENT("hey", 2, HISTOGRAM, fields);
-    regex_t re;
-    assert_int_equal(regcomp(&re, "[AD]", REG_EXTENDED), 0);
-    cJSON* json = fmtMetricJson(&e, &re, CFG_SRC_METRIC, NULL);
+    evt_filter_t *re = evtFilterCreate("[AD]");
+    assert_non_null(re);
+    cJSON* json = fmtMetricJson(&e, re, CFG_SRC_METRIC, NULL);
     assert_non_null(json);
     char* str = cJSON_PrintUnformatted(json);
     assert_non_null(str);
@@ -584,7 +584,7 @@ fmtMetricJsonWFilteredFields(void** state)
                  "\"_value\":2,"
                  "\"A\":\"Z\",\"D\":654}");
     if (str) scope_free(str);
-    regfree(&re);
+    evtFilterDestroy(&re);
     cJSON_Delete(json);
 }
 
@@ -637,35 +637,35 @@ evtFormatValueFilterSetAndGet(void** state)
      * The default is ".*"
      * When the default changes this needs to change
     */
-    regex_t* default_re = evtFormatValueFilter(evt, CFG_SRC_FILE);
+    evt_filter_t* default_re = evtFormatValueFilter(evt, CFG_SRC_FILE);
     assert_non_null(default_re);
-    assert_int_equal(regexec(default_re, "anythingmatches", 0, NULL, 0), 0);
+    assert_true(evtFilterMatch(default_re, "anythingmatches"));
 
     // Make sure it can be changed
     evtFormatValueFilterSet(evt, CFG_SRC_FILE, "myvalue.*");
-    regex_t* new_re = evtFormatValueFilter(evt, CFG_SRC_FILE);
+    evt_filter_t* new_re = evtFormatValueFilter(evt, CFG_SRC_FILE);
     assert_non_null(new_re);
-    assert_int_equal(regexec(new_re, "whatever", 0, NULL, 0), REG_NOMATCH);
-    assert_int_equal(regexec(new_re, "myvalue.value", 0, NULL, 0), 0);
+    assert_false(evtFilterMatch(new_re, "whatever"));
+    assert_true(evtFilterMatch(new_re, "myvalue.value"));
 
     // Make sure default is returned for null strings
     evtFormatValueFilterSet(evt, CFG_SRC_FILE, "");
     new_re = evtFormatValueFilter(evt, CFG_SRC_FILE);
     assert_non_null(new_re);
-    assert_int_equal(regexec(new_re, "anythingmatches", 0, NULL, 0), 0);
+    assert_true(evtFilterMatch(new_re, "anythingmatches"));
 
     // Make sure default is returned for bad regex
     evtFormatValueFilterSet(evt, CFG_SRC_FILE, "W![T^F?");
     new_re = evtFormatValueFilter(evt, CFG_SRC_FILE);
     assert_non_null(new_re);
-    assert_int_equal(regexec(new_re, "anything", 0, NULL, 0), 0);
+    assert_true(evtFilterMatch(new_re, "anything"));
 
     evtFormatDestroy(&evt);
 
     // Get a default filter, even if evt is NULL
     default_re = evtFormatValueFilter(evt, CFG_SRC_FILE);
     assert_non_null(default_re);
-    assert_int_equal(regexec(default_re, "whatever", 0, NULL, 0), 0);
+    assert_true(evtFilterMatch(default_re, "whatever"));
 }
 
 static void
@@ -678,35 +678,35 @@ evtFormatFieldFilterSetAndGet(void** state)
      * The default is ".*host.*"
      * When the default changes this needs to change
     */
-    regex_t* default_re = evtFormatFieldFilter(evt, CFG_SRC_FILE);
+    evt_filter_t* default_re = evtFormatFieldFilter(evt, CFG_SRC_FILE);
     assert_non_null(default_re);
-    assert_int_equal(regexec(default_re, "host:", 0, NULL, 0), 0);
+    assert_true(evtFilterMatch(default_re, "host:"));
 
     // Make sure it can be changed
     evtFormatFieldFilterSet(evt, CFG_SRC_FILE, "myfield.*");
-    regex_t* new_re = evtFormatFieldFilter(evt, CFG_SRC_FILE);
+    evt_filter_t* new_re = evtFormatFieldFilter(evt, CFG_SRC_FILE);
     assert_non_null(new_re);
-    assert_int_equal(regexec(new_re, "whatever", 0, NULL, 0), REG_NOMATCH);
-    assert_int_equal(regexec(new_re, "myfield.value", 0, NULL, 0), 0);
+    assert_false(evtFilterMatch(new_re, "whatever"));
+    assert_true(evtFilterMatch(new_re, "myfield.value"));
 
     // Make sure default is returned for null strings
     evtFormatFieldFilterSet(evt, CFG_SRC_FILE, "");
     new_re = evtFormatFieldFilter(evt, CFG_SRC_FILE);
     assert_non_null(new_re);
-    assert_int_equal(regexec(new_re, "host.myhost", 0, NULL, 0), 0);
+    assert_true(evtFilterMatch(new_re, "host.myhost"));
 
     // Make sure default is returned for bad regex
     evtFormatFieldFilterSet(evt, CFG_SRC_FILE, "W![T^F?");
     new_re = evtFormatFieldFilter(evt, CFG_SRC_FILE);
     assert_non_null(new_re);
-    assert_int_equal(regexec(new_re, "thishost", 0, NULL, 0), 0);
+    assert_true(evtFilterMatch(new_re, "thishost"));
 
     evtFormatDestroy(&evt);
 
     // Get a default filter, even if evt is NULL
     default_re = evtFormatFieldFilter(evt, CFG_SRC_FILE);
     assert_non_null(default_re);
-    assert_int_equal(regexec(default_re, "dohost", 0, NULL, 0), 0);
+    assert_true(evtFilterMatch(default_re, "dohost"));
 }
 
 typedef struct {
@@ -746,41 +746,41 @@ evtFormatNameFilterSetAndGet(void** state)
      * The default is "(\/logs?\/)|(\.log$)|(\.log[.\d])"
      * When the default changes this needs to change
     */
-    regex_t* default_re = evtFormatNameFilter(evt, CFG_SRC_FILE);
+    evt_filter_t* default_re = evtFormatNameFilter(evt, CFG_SRC_FILE);
     assert_non_null(default_re);
     for (test = expected; test->filename; test++) {
-        assert_int_equal(regexec(default_re, test->filename, 0, NULL, 0),
-            (test->matches) ? 0 : REG_NOMATCH);
+        assert_int_equal(evtFilterMatch(default_re, test->filename),
+            test->matches);
     }
     test = expected;
 
     // Make sure it can be changed
     evtFormatNameFilterSet(evt, CFG_SRC_FILE, "net.*");
-    regex_t* new_re = evtFormatNameFilter(evt, CFG_SRC_FILE);
+    evt_filter_t* new_re = evtFormatNameFilter(evt, CFG_SRC_FILE);
     assert_non_null(new_re);
-    assert_int_equal(regexec(new_re, "whatever", 0, NULL, 0), REG_NOMATCH);
-    assert_int_equal(regexec(new_re, "net.tx", 0, NULL, 0), 0);
+    assert_false(evtFilterMatch(new_re, "whatever"));
+    assert_true(evtFilterMatch(new_re, "net.tx"));
 
     // Make sure default is returned for null strings
     evtFormatNameFilterSet(evt, CFG_SRC_FILE, "");
     new_re = evtFormatNameFilter(evt, CFG_SRC_FILE);
     assert_non_null(new_re);
-    assert_int_equal(regexec(new_re, "anythingwithlogmatches", 0, NULL, 0), 0);
+    assert_true(evtFilterMatch(new_re, "anythingwithlogmatches"));
 
     // Make sure default is returned for bad regex
     evtFormatNameFilterSet(evt, CFG_SRC_FILE, "W![T^F?");
     new_re = evtFormatNameFilter(evt, CFG_SRC_FILE);
     assert_non_null(new_re);
-    assert_int_equal(regexec(new_re, test->filename, 0, NULL, 0),
-        (test->matches) ? 0 : REG_NOMATCH);
+    assert_int_equal(evtFilterMatch(new_re, test->filename),
+        test->matches);
 
     evtFormatDestroy(&evt);
 
     // Get a default filter, even if evt is NULL
     default_re = evtFormatNameFilter(evt, CFG_SRC_FILE);
     assert_non_null(default_re);
-    assert_int_equal(regexec(default_re, test->filename, 0, NULL, 0),
-        (test->matches) ? 0 : REG_NOMATCH);
+    assert_int_equal(evtFilterMatch(default_re, test->filename),
+        test->matches);
 }
 
 static void
@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+#include <elf.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "goplan.h"
+#include "test.h"
+
+#define TAP_NUM 20
+
+static char g_dir[] = "/tmp/goplantest.XXXXXX";
+
+/*
+ * Builds an ELF file with a note section named notesec whose descriptor
+ * is id.
+ */
+static char *
+buildElf(const char *notesec, const char *id)
+{
+    size_t size = 4096;
+    char *buf = calloc(1, size);
+    assert_non_null(buf);
+    size_t off = sizeof(Elf64_Ehdr);
+
+    const char shstrtab[] = "\0.shstrtab\0";
+    size_t shstrOff = off;
+    memcpy(buf + off, shstrtab, sizeof(shstrtab));
+    strcpy(buf + off + sizeof(shstrtab), notesec);
+    size_t shstrSize = sizeof(shstrtab) + strlen(notesec) + 1;
+    off = (off + shstrSize + 7) & ~7;
+
+    size_t noteOff = off;
+    Elf64_Nhdr *note = (Elf64_Nhdr *)(buf + off);
+    note->n_namesz = 4;
+    note->n_descsz = strlen(id);
+    note->n_type = NT_GNU_BUILD_ID;
+    memcpy(buf + off + sizeof(*note), "GNU", 4);
+    memcpy(buf + off + sizeof(*note) + 4, id, strlen(id));
+    size_t noteSize = sizeof(*note) + 4 + strlen(id);
+    off = (off + noteSize + 7) & ~7;
+
+    Elf64_Shdr *sections = (Elf64_Shdr *)(buf + off);
+    sections[1].sh_name = 1;
+    sections[1].sh_type = SHT_STRTAB;
+    sections[1].sh_offset = shstrOff;
+    sections[1].sh_size = shstrSize;
+    sections[2].sh_name = sizeof(shstrtab);
+    sections[2].sh_type = SHT_NOTE;
+    sections[2].sh_offset = noteOff;
+    sections[2].sh_size = noteSize;
+
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *)buf;
+    ehdr->e_shoff = off;
+    ehdr->e_shnum = 3;
+    ehdr->e_shstrndx = 1;
+    assert_true(off + 3 * sizeof(Elf64_Shdr) < size);
+
+    return buf;
+}
+
+static go_plan_t *
+planWithPatches(const char *buf, const char *version, int num)
+{
+    go_plan_t *plan = goPlanCreate(buf, version, TAP_NUM);
+    assert_non_null(plan);
+
+    int i;
+    for (i = 0; i < num; i++) {
+        go_patch_t patch = {
+            .addr = 0x401000 + (i * 0x40),
+            .frameSize = i * 8,
+            .tap = i % TAP_NUM,
+            .kind = i % (GO_PATCH_RET + 1),
+        };
+        assert_true(goPlanAdd(plan, &patch));
+    }
+    goPlanSetSystemStack(plan, 0x46a000);
+    return plan;
+}
+
+// The plan file that was saved last
+static void
+planFile(char *path, size_t len)
+{
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "ls -t %s/%u/*.plan | head -1", g_dir, geteuid());
+    FILE *ls = popen(cmd, "r");
+    assert_non_null(fgets(path, len, ls));
+    pclose(ls);
+    path[strcspn(path, "\n")] = '\0';
+}
+
+static int
+planSetup(void **state)
+{
+    assert_non_null(mkdtemp(g_dir));
+    return groupSetup(state);
+}
+
+static int
+planTeardown(void **state)
+{
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", g_dir);
+    assert_int_equal(system(cmd), 0);
+    return groupTeardown(state);
+}
+
+static void
+goPlanNullArgsDoNotCrash(void **state)
+{
+    go_patch_t patch = {0};
+    assert_null(goPlanCreate(NULL, "v1.0.0", TAP_NUM));
+    goPlanDestroy(NULL);
+    assert_false(goPlanLoad(NULL, g_dir));
+    assert_false(goPlanSave(NULL, g_dir));
+    assert_false(goPlanAdd(NULL, &patch));
+    assert_int_equal(goPlanCount(NULL), 0);
+    assert_null(goPlanPatch(NULL, 0));
+    assert_int_equal(goPlanSystemStack(NULL), 0);
+}
+
+static void
+goPlanNeedsBuildId(void **state)
+{
+    char *buf = buildElf(".note.ABI-tag", "abcdef");
+    assert_null(goPlanCreate(buf, "v1.0.0", TAP_NUM));
+    free(buf);
+}
+
+static void
+goPlanSaveThenLoad(void **state)
+{
+    char *buf = buildElf(".note.gnu.build-id", "\x12\x34\x56\x78\x9a\xbc");
+    go_plan_t *saved = planWithPatches(buf, "v1.0.0", 100);
+    assert_int_equal(goPlanCount(saved), 100);
+    assert_true(goPlanSave(saved, g_dir));
+
+    go_plan_t *plan = goPlanCreate(buf, "v1.0.0", TAP_NUM);
+    assert_non_null(plan);
+    assert_true(goPlanLoad(plan, g_dir));
+    assert_int_equal(goPlanCount(plan), 100);
+    assert_int_equal(goPlanSystemStack(plan), 0x46a000);
+
+    size_t i;
+    for (i = 0; i < goPlanCount(plan); i++) {
+        const go_patch_t *patch = goPlanPatch(plan, i);
+        assert_non_null(patch);
+        assert_memory_equal(patch, goPlanPatch(saved, i), sizeof(*patch));
+    }
+    assert_null(goPlanPatch(plan, 100));
+
+    goPlanDestroy(&plan);
+    assert_null(plan);
+    goPlanDestroy(&saved);
+    free(buf);
+}
+
+static void
+goPlanIsKeyedByBuildIdAndVersion(void **state)
+{
+    char *buf = buildElf(".note.go.buildid", "xYz/abc/def");
+    go_plan_t *plan = planWithPatches(buf, "v1.0.0", 10);
+    assert_true(goPlanSave(plan, g_dir));
+    goPlanDestroy(&plan);
+
+    // another libscope version
+    plan = goPlanCreate(buf, "v1.0.1", TAP_NUM);
+    assert_false(goPlanLoad(plan, g_dir));
+    goPlanDestroy(&plan);
+
+    // another schema
+    plan = goPlanCreate(buf, "v1.0.0", TAP_NUM + 1);
+    assert_false(goPlanLoad(plan, g_dir));
+    goPlanDestroy(&plan);
+
+    // another executable
+    char *other = buildElf(".note.go.buildid", "xYz/abc/deg");
+    plan = goPlanCreate(other, "v1.0.0", TAP_NUM);
+    assert_false(goPlanLoad(plan, g_dir));
+    goPlanDestroy(&plan);
+    free(other);
+
+    plan = goPlanCreate(buf, "v1.0.0", TAP_NUM);
+    assert_true(goPlanLoad(plan, g_dir));
+    assert_int_equal(goPlanCount(plan), 10);
+    goPlanDestroy(&plan);
+    free(buf);
+}
+
+static void
+goPlanIgnoresCorruptFile(void **state)
+{
+    char *buf = buildElf(".note.gnu.build-id", "corrupt");
+    go_plan_t *plan = planWithPatches(buf, "v1.0.0", 10);
+    assert_true(goPlanSave(plan, g_dir));
+
+    // Find the file that was just written and flip a byte of a patch
+    char path[PATH_MAX] = {0};
+    planFile(path, sizeof(path));
+
+    int fd = open(path, O_RDWR);
+    assert_int_not_equal(fd, -1);
+    off_t end = lseek(fd, 0, SEEK_END);
+    char byte;
+    assert_int_equal(pread(fd, &byte, 1, end - 10), 1);
+    byte ^= 0x01;
+    assert_int_equal(pwrite(fd, &byte, 1, end - 10), 1);
+    assert_false(goPlanLoad(plan, g_dir));
+
+    // a truncated file
+    assert_int_equal(ftruncate(fd, end - 16), 0);
+    assert_false(goPlanLoad(plan, g_dir));
+    close(fd);
+
+    // and the plan is still usable
+    assert_int_equal(goPlanCount(plan), 10);
+    assert_true(goPlanSave(plan, g_dir));
+    assert_true(goPlanLoad(plan, g_dir));
+
+    goPlanDestroy(&plan);
+    free(buf);
+}
+
+static void
+goPlanIsPrivateToTheUser(void **state)
+{
+    char *buf = buildElf(".note.gnu.build-id", "private");
+    go_plan_t *plan = planWithPatches(buf, "v1.0.0", 10);
+    assert_true(goPlanSave(plan, g_dir));
+
+    char userDir[PATH_MAX];
+    snprintf(userDir, sizeof(userDir), "%s/%u", g_dir, geteuid());
+    struct stat st;
+    assert_int_equal(stat(userDir, &st), 0);
+    assert_int_equal(st.st_mode & 0777, 0700);
+
+    char path[PATH_MAX] = {0};
+    planFile(path, sizeof(path));
+    assert_int_equal(stat(path, &st), 0);
+    assert_int_equal(st.st_mode & 0777, 0600);
+
+    // Not a file that others can write
+    assert_int_equal(chmod(path, 0666), 0);
+    assert_false(goPlanLoad(plan, g_dir));
+    assert_int_equal(chmod(path, 0644), 0);
+    assert_true(goPlanLoad(plan, g_dir));
+
+    // Nor a directory that others can write
+    assert_int_equal(chmod(userDir, 0777), 0);
+    assert_false(goPlanLoad(plan, g_dir));
+    assert_false(goPlanSave(plan, g_dir));
+    assert_int_equal(chmod(userDir, 0700), 0);
+
+    // Nor a link to a plan
+    char link[PATH_MAX + 8];
+    snprintf(link, sizeof(link), "%s.link", path);
+    assert_int_equal(rename(path, link), 0);
+    assert_int_equal(symlink(link, path), 0);
+    assert_false(goPlanLoad(plan, g_dir));
+    assert_int_equal(unlink(path), 0);
+    assert_int_equal(unlink(link), 0);
+
+    goPlanDestroy(&plan);
+    free(buf);
+}
+
+static void
+goPlanSaveDoesntWriteThroughLinks(void **state)
+{
+    char *buf = buildElf(".note.gnu.build-id", "links");
+    go_plan_t *plan = planWithPatches(buf, "v1.0.0", 10);
+    assert_true(goPlanSave(plan, g_dir));
+
+    char path[PATH_MAX] = {0};
+    planFile(path, sizeof(path));
+
+    // A link planted where the temp file goes, to something else
+    char victim[PATH_MAX];
+    snprintf(victim, sizeof(victim), "%s/victim", g_dir);
+    FILE *f = fopen(victim, "w");
+    assert_non_null(f);
+    fputs("untouched", f);
+    fclose(f);
+    char tmpPath[PATH_MAX + 16];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%d", path, getpid());
+    assert_int_equal(symlink(victim, tmpPath), 0);
+
+    assert_true(goPlanSave(plan, g_dir));
+    assert_true(goPlanLoad(plan, g_dir));
+
+    char contents[32] = {0};
+    f = fopen(victim, "r");
+    assert_non_null(f);
+    assert_non_null(fgets(contents, sizeof(contents), f));
+    fclose(f);
+    assert_string_equal(contents, "untouched");
+    assert_int_equal(unlink(victim), 0);
+
+    goPlanDestroy(&plan);
+    free(buf);
+}
+
+static void
+goPlanEmptyDirDisablesPlans(void **state)
+{
+    char *buf = buildElf(".note.gnu.build-id", "nodir");
+    go_plan_t *plan = planWithPatches(buf, "v1.0.0", 1);
+    assert_false(goPlanSave(plan, ""));
+    assert_false(goPlanLoad(plan, ""));
+    goPlanDestroy(&plan);
+    free(buf);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(goPlanNullArgsDoNotCrash),
+        cmocka_unit_test(goPlanNeedsBuildId),
+        cmocka_unit_test(goPlanSaveThenLoad),
+        cmocka_unit_test(goPlanIsKeyedByBuildIdAndVersion),
+        cmocka_unit_test(goPlanIgnoresCorruptFile),
+        cmocka_unit_test(goPlanIsPrivateToTheUser),
+        cmocka_unit_test(goPlanSaveDoesntWriteThroughLinks),
+        cmocka_unit_test(goPlanEmptyDirDisablesPlans),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, planSetup, planTeardown);
+}
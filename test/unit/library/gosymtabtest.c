@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gosymtab.h"
+#include "test.h"
+
+#define FUNC_NUM 2000
+#define TEXT_START 0x401000
+#define FUNC_ADDR(i) (TEXT_START + ((i) * 0x10))
+
+/*
+ * Builds an ELF file with a Go 1.20 pclntab of FUNC_NUM functions named
+ * main.f0 ... main.f1999, followed by a second main.f0.  The pclntab is
+ * in a section named pclnsec, behind pad bytes.  If withSymtab is TRUE
+ * there's also a .symtab with main.f7 and main.onlysym.
+ */
+static char *
+buildElf(const char *pclnsec, size_t pad, bool withSymtab)
+{
+    size_t size = 1024 * 1024;
+    char *buf = calloc(1, size);
+    assert_non_null(buf);
+    size_t off = sizeof(Elf64_Ehdr);
+    int i;
+
+    // section names
+    const char shstrtab[] = "\0.shstrtab\0.symtab\0.strtab\0";
+    size_t shstrOff = off;
+    memcpy(buf + off, shstrtab, sizeof(shstrtab));
+    size_t pclnNameOff = sizeof(shstrtab);
+    strcpy(buf + off + pclnNameOff, pclnsec);
+    size_t shstrSize = pclnNameOff + strlen(pclnsec) + 1;
+    off += shstrSize;
+    off = (off + 7) & ~7;
+
+    // pclntab: header, function names, function table, func structs
+    size_t pclnSecOff = off;
+    off += pad;
+    char *pcln = buf + off;
+    size_t namesOff = 72;
+    size_t namesLen = 0;
+    uint32_t nameOffsets[FUNC_NUM + 1];
+    for (i = 0; i <= FUNC_NUM; i++) {
+        nameOffsets[i] = namesLen;
+        namesLen += sprintf(pcln + namesOff + namesLen, "main.f%d", i % FUNC_NUM) + 1;
+    }
+    size_t functabOff = (namesOff + namesLen + 7) & ~7;
+    uint32_t *functab = (uint32_t *)(pcln + functabOff);
+    uint32_t funcOff = (FUNC_NUM + 1) * 8;
+    for (i = 0; i <= FUNC_NUM; i++) {
+        uint32_t entry = (i < FUNC_NUM) ? i * 0x10 : 0x100000;
+        functab[i * 2] = entry;
+        functab[i * 2 + 1] = funcOff;
+        uint32_t *func = (uint32_t *)((char *)functab + funcOff);
+        func[0] = entry;
+        func[1] = nameOffsets[i];
+        funcOff += 8;
+    }
+    *(uint32_t *)pcln = 0xfffffff1;
+    ((uint64_t *)pcln)[1] = FUNC_NUM + 1;
+    ((uint64_t *)pcln)[3] = TEXT_START;
+    ((uint64_t *)pcln)[4] = namesOff;
+    ((uint64_t *)pcln)[8] = functabOff;
+    off += functabOff + funcOff;
+    size_t pclnSecSize = off - pclnSecOff;
+    off = (off + 7) & ~7;
+
+    // .symtab and .strtab
+    const char strtab[] = "\0main.f7\0main.onlysym\0";
+    size_t strOff = off;
+    memcpy(buf + off, strtab, sizeof(strtab));
+    off += sizeof(strtab);
+    off = (off + 7) & ~7;
+    size_t symOff = off;
+    Elf64_Sym *syms = (Elf64_Sym *)(buf + off);
+    syms[1].st_name = 1;
+    syms[1].st_value = 0x999000;
+    syms[2].st_name = 9;
+    syms[2].st_value = 0x777000;
+    off += 3 * sizeof(Elf64_Sym);
+
+    Elf64_Shdr *sections = (Elf64_Shdr *)(buf + off);
+    sections[1].sh_name = 1;
+    sections[1].sh_type = SHT_STRTAB;
+    sections[1].sh_offset = shstrOff;
+    sections[1].sh_size = shstrSize;
+    sections[2].sh_name = pclnNameOff;
+    sections[2].sh_type = SHT_PROGBITS;
+    sections[2].sh_offset = pclnSecOff;
+    sections[2].sh_size = pclnSecSize;
+    if (withSymtab) {
+        sections[3].sh_name = 11;
+        sections[3].sh_type = SHT_SYMTAB;
+        sections[3].sh_offset = symOff;
+        sections[3].sh_size = 3 * sizeof(Elf64_Sym);
+        sections[3].sh_entsize = sizeof(Elf64_Sym);
+        sections[4].sh_name = 19;
+        sections[4].sh_type = SHT_STRTAB;
+        sections[4].sh_offset = strOff;
+        sections[4].sh_size = sizeof(strtab);
+    }
+
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *)buf;
+    ehdr->e_shoff = off;
+    ehdr->e_shnum = (withSymtab) ? 5 : 3;
+    ehdr->e_shstrndx = 1;
+    off += 5 * sizeof(Elf64_Shdr);
+    assert_true(off < size);
+
+    return buf;
+}
+
+static void
+goSymtabNullArgsDoNotCrash(void **state)
+{
+    const char *names[] = {"main.f0"};
+    assert_null(goSymtabCreate(NULL, names, 1));
+
+    go_symtab_t *symtab = NULL;
+    goSymtabDestroy(&symtab);
+    goSymtabDestroy(NULL);
+    assert_null(goSymtabFind(NULL, "main.f0"));
+    assert_int_equal(goSymtabFuncCount(NULL), 0);
+}
+
+static void
+goSymtabFindsIndexedNames(void **state)
+{
+    char *buf = buildElf(".gopclntab", 0, TRUE);
+    const char *names[] = {"main.f0", "main.f1999", "main.f7", "main.onlysym",
+                           "main.missing", "main.f0", "main.f1234"};
+
+    go_symtab_t *symtab = goSymtabCreate(buf, names, sizeof(names) / sizeof(names[0]));
+    assert_non_null(symtab);
+    assert_int_equal(goSymtabFuncCount(symtab), FUNC_NUM + 1);
+
+    // the first of two functions with the same name is found
+    assert_int_equal(goSymtabFind(symtab, "main.f0"), FUNC_ADDR(0));
+    assert_int_equal(goSymtabFind(symtab, "main.f1999"), FUNC_ADDR(1999));
+    assert_int_equal(goSymtabFind(symtab, "main.f1234"), FUNC_ADDR(1234));
+    // .symtab is preferred over the pclntab
+    assert_int_equal(goSymtabFind(symtab, "main.f7"), 0x999000);
+    assert_int_equal(goSymtabFind(symtab, "main.onlysym"), 0x777000);
+    assert_null(goSymtabFind(symtab, "main.missing"));
+
+    goSymtabDestroy(&symtab);
+    assert_null(symtab);
+    free(buf);
+}
+
+static void
+goSymtabFindsNamesNotIndexed(void **state)
+{
+    char *buf = buildElf(".gopclntab", 0, TRUE);
+    const char *names[] = {"main.f1"};
+
+    go_symtab_t *symtab = goSymtabCreate(buf, names, 1);
+    assert_non_null(symtab);
+
+    assert_int_equal(goSymtabFind(symtab, "main.f1"), FUNC_ADDR(1));
+    assert_int_equal(goSymtabFind(symtab, "main.f0"), FUNC_ADDR(0));
+    assert_int_equal(goSymtabFind(symtab, "main.f1500"), FUNC_ADDR(1500));
+    assert_int_equal(goSymtabFind(symtab, "main.f7"), 0x999000);
+    assert_int_equal(goSymtabFind(symtab, "main.onlysym"), 0x777000);
+    assert_null(goSymtabFind(symtab, "main.f"));
+    assert_null(goSymtabFind(symtab, "main.missing"));
+
+    goSymtabDestroy(&symtab);
+    free(buf);
+}
+
+static void
+goSymtabFindsEmbeddedPclntab(void **state)
+{
+    // no .gopclntab section; the pclntab is somewhere in .data.rel.ro
+    char *buf = buildElf(".data.rel.ro", 64, FALSE);
+    const char *names[] = {"main.f3", "main.f7"};
+
+    go_symtab_t *symtab = goSymtabCreate(buf, names, 2);
+    assert_non_null(symtab);
+    assert_int_equal(goSymtabFuncCount(symtab), FUNC_NUM + 1);
+    assert_int_equal(goSymtabFind(symtab, "main.f3"), FUNC_ADDR(3));
+    assert_int_equal(goSymtabFind(symtab, "main.f7"), FUNC_ADDR(7));
+    assert_int_equal(goSymtabFind(symtab, "main.f42"), FUNC_ADDR(42));
+    assert_null(goSymtabFind(symtab, "main.onlysym"));
+
+    goSymtabDestroy(&symtab);
+    free(buf);
+}
+
+static void
+goSymtabWithoutPclntab(void **state)
+{
+    char *buf = buildElf(".data", 0, TRUE);
+    const char *names[] = {"main.f3", "main.onlysym"};
+
+    go_symtab_t *symtab = goSymtabCreate(buf, names, 2);
+    assert_non_null(symtab);
+    assert_int_equal(goSymtabFuncCount(symtab), 0);
+    assert_null(goSymtabFind(symtab, "main.f3"));
+    assert_int_equal(goSymtabFind(symtab, "main.onlysym"), 0x777000);
+
+    goSymtabDestroy(&symtab);
+    free(buf);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(goSymtabNullArgsDoNotCrash),
+        cmocka_unit_test(goSymtabFindsIndexedNames),
+        cmocka_unit_test(goSymtabFindsNamesNotIndexed),
+        cmocka_unit_test(goSymtabFindsEmbeddedPclntab),
+        cmocka_unit_test(goSymtabWithoutPclntab),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
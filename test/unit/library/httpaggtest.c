@@ -11,13 +11,55 @@
 mtc_t *bogus_mtc_addr = (mtc_t*)0xDEADBEEF;
 int g_send_metric_count = 0;
 
+// http.req metrics seen by cmdSendMetric
+#define MAX_REQ_METRICS 64
+struct {
+    char target[128];
+    long long count;
+} g_req_metric[MAX_REQ_METRICS];
+int g_req_metric_count = 0;
+
 // Needed for httpAggSendReport
 int cmdSendMetric(mtc_t *mtc, event_t *evt)
 {
     g_send_metric_count++;
+
+    if (!strcmp(evt->name, "http.req") && g_req_metric_count < MAX_REQ_METRICS) {
+        event_field_t *field;
+        for (field = evt->fields; field->value_type != FMT_END; field++) {
+            if (!strcmp(field->name, "http_target")) {
+                snprintf(g_req_metric[g_req_metric_count].target,
+                         sizeof(g_req_metric[0].target), "%s", field->value.str);
+            }
+        }
+        g_req_metric[g_req_metric_count++].count = evt->value.integer;
+    }
     return 0;
 }
 
+// Returns the http.req count reported for the target or -1
+static long long
+reqMetricCount(const char *target)
+{
+    int i;
+    for (i=0; i<g_req_metric_count; i++) {
+        if (!strcmp(g_req_metric[i].target, target)) return g_req_metric[i].count;
+    }
+    return -1;
+}
+
+static void
+addTarget(http_agg_t *http_agg, const char *target)
+{
+    event_field_t fields[] = {
+        STRFIELD("http_target", target, 4, FALSE),
+        NUMFIELD("http_status_code", 200, 1, FALSE),
+        FIELDEND
+    };
+    event_t event = INT_EVENT("http_server_duration", 2, DELTA_MS, fields);
+    httpAggAddMetric(http_agg, &event, -1, -1);
+}
+
 static void
 httpAggCreateReturnsNonNull(void **state)
 {
@@ -168,6 +210,97 @@ httpAggAddMetricWithManyHttpTargetsDoesNotCrash(void **state)
     httpAggDestroy(&http_agg);
 }
 
+static void
+httpAggTargetsAreTemplated(void **state)
+{
+    http_agg_t *http_agg = httpAggCreate();
+
+    addTarget(http_agg, "/user/42");
+    addTarget(http_agg, "/user/43?tab=orders");
+    addTarget(http_agg, "/user/550e8400-e29b-41d4-a716-446655440000/orders/7");
+    addTarget(http_agg, "/user/550E8400-E29B-41D4-A716-446655440001/orders/8");
+    addTarget(http_agg, "/user/abc");
+    addTarget(http_agg, "/user/42abc");
+
+    g_req_metric_count = 0;
+    httpAggSendReport(http_agg, bogus_mtc_addr);
+    assert_int_equal(g_req_metric_count, 4);
+    assert_int_equal(reqMetricCount("/user/{id}"), 2);
+    assert_int_equal(reqMetricCount("/user/{uuid}/orders/{id}"), 2);
+    assert_int_equal(reqMetricCount("/user/abc"), 1);
+    assert_int_equal(reqMetricCount("/user/42abc"), 1);
+
+    httpAggDestroy(&http_agg);
+}
+
+static void
+httpAggMaxTargetsKeepsFrequentTargets(void **state)
+{
+    http_agg_t *http_agg = httpAggCreate();
+    httpAggSetMaxTargets(http_agg, 8);
+
+    // two frequent targets among many that are seen once; with 8 slots the
+    // counts the cold targets inherit grow slower than /warm's
+    int i;
+    for (i=0; i<100; i++) {
+        char http_target[128];
+        snprintf(http_target, sizeof(http_target), "/cold-%d", i);
+        addTarget(http_agg, http_target);
+        addTarget(http_agg, "/hot");
+        if (i % 2) addTarget(http_agg, "/warm");
+    }
+
+    g_req_metric_count = 0;
+    httpAggSendReport(http_agg, bogus_mtc_addr);
+    assert_int_equal(g_req_metric_count, 9);
+    assert_int_equal(reqMetricCount("/hot"), 100);
+    assert_int_equal(reqMetricCount("/warm"), 50);
+
+    // everything else is counted in "other" so the total is right
+    long long total = 0;
+    for (i=0; i<g_req_metric_count; i++) {
+        total += g_req_metric[i].count;
+    }
+    assert_int_equal(total, 250);
+    assert_true(reqMetricCount("other") > 0);
+
+    // after a reset, "other" is empty again
+    httpAggReset(http_agg);
+    addTarget(http_agg, "/hot");
+    g_req_metric_count = 0;
+    httpAggSendReport(http_agg, bogus_mtc_addr);
+    assert_int_equal(g_req_metric_count, 1);
+    assert_int_equal(reqMetricCount("other"), -1);
+
+    httpAggDestroy(&http_agg);
+}
+
+static void
+httpAggNoMaxTargetsKeepsAllTargets(void **state)
+{
+    http_agg_t *http_agg = httpAggCreate();
+    httpAggSetMaxTargets(http_agg, 0);
+
+    int i;
+    for (i=0; i<1000; i++) {
+        char http_target[128];
+        snprintf(http_target, sizeof(http_target), "/v%d", i);
+        addTarget(http_agg, http_target);
+    }
+    addTarget(http_agg, "/v999");
+
+    g_req_metric_count = 0;
+    httpAggSendReport(http_agg, bogus_mtc_addr);
+    assert_int_equal(reqMetricCount("other"), -1);
+
+    // all 1000 were reported; only the first MAX_REQ_METRICS were kept
+    g_send_metric_count = 0;
+    httpAggSendReport(http_agg, bogus_mtc_addr);
+    assert_int_equal(g_send_metric_count, 2000);
+
+    httpAggDestroy(&http_agg);
+}
+
 static void
 httpAggSendReportForNullDoesNotCrash(void **state)
 {
@@ -193,6 +326,9 @@ main(int argc, char *argv[])
         cmocka_unit_test(httpAggAddMetricWithQueryStringsAreAggregatedTogether),
         cmocka_unit_test(httpAggAddMetricWithManyStatusCodesDoesNotCrash),
         cmocka_unit_test(httpAggAddMetricWithManyHttpTargetsDoesNotCrash),
+        cmocka_unit_test(httpAggTargetsAreTemplated),
+        cmocka_unit_test(httpAggMaxTargetsKeepsFrequentTargets),
+        cmocka_unit_test(httpAggNoMaxTargetsKeepsAllTargets),
         cmocka_unit_test(httpAggSendReportForNullDoesNotCrash),
         cmocka_unit_test(httpAggResetForNullDoesNotCrash)
     };
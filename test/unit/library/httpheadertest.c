@@ -16,6 +16,8 @@
 #include "evtutils.h"
 #include "evtformat.h"
 #include "httpstate.h"
+#include "report.h"
+#include "lshpack.h"
 #include "test.h"
 
 #define UNIX_SOCK_PATH "/tmp/headertestsock"
@@ -57,7 +59,9 @@ int cmdSendHttp(ctl_t *ctl, event_t *event, uint64_t id, proc_id_t *proc)
     //printf("%s: %s\n", __FUNCTION__, event->name);
     if (!event || !proc) return -1;
 
-    cJSON *json  = fmtMetricJson(event, NULL, CFG_SRC_HTTP, NULL);
+    // HTTP/2 events come with the body already built in event->data which,
+    // like the real cmdSendHttp(), we take ownership of
+    cJSON *json  = (event->data) ? event->data : fmtMetricJson(event, NULL, CFG_SRC_HTTP, NULL);
     header_event = cJSON_PrintUnformatted(json);
     cJSON_Delete(json);
 
@@ -227,6 +231,29 @@ headerResponseIP(void **state)
     scope_free(header_event);
 }
 
+static void
+headerChunkedResponseIP(void **state)
+{
+    char *response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\n\r\n"
+                     "6\r\nchunk1\r\n15\r\nchunk2chunk2chunk2xyz\r\n0\r\n\r\n";
+    char *result[] = {
+        "\"http_flavor\":\"1.1\"",
+        "\"http_status_code\":200",
+        "\"net_peer_ip\":\"192.1.2.99\"",
+        "\"http_response_content_length\":27"
+    };
+
+    net_info *net = getNet(3);
+    assert_non_null(net);
+    assert_true(doHttp(3, net, response, strlen(response), TLSRX, BUF));
+    assert_non_null(header_event);
+    int i;
+    for (i=0; i<sizeof(result)/sizeof(result[0]); i++) {
+        assert_non_null(scope_strstr(header_event, result[i]));
+    }
+    scope_free(header_event);
+}
+
 static void
 headerRequestUnix(void **state)
 {
@@ -334,6 +361,319 @@ xAppScopeHeaderExtract(void **state)
     cfgDestroy(&cfg);
 }
 
+static void
+headerFieldNamesExtract(void **state)
+{
+    char *request = "GET /hello HTTP/1.1\r\nX-Original-Host: proxy\r\nHOST:localhost:4430\r\n"
+                    "accept-LANGUAGE: en-US\r\nAccept-Encoding: gzip\r\nReferer: http://Accept-Encoding\r\n"
+                    "X-Trace: 42\r\nContent-Length: 010\r\n\r\n";
+    char *result[] = {
+        "\"http_host\":\"localhost:4430\"",
+        "\"accept-LANGUAGE\":\"en-US\"",
+        "\"Accept-Encoding\":\"gzip\"",
+        "\"X-Trace\":\"42\"",
+        "\"http_request_content_length\":10"
+    };
+
+    // filters are still matched against the whole header line
+    config_t *cfg = cfgCreateDefault();
+    cfgEvtFormatSourceEnabledSet(cfg, CFG_SRC_HTTP, (unsigned)1);
+    cfgEvtFormatHeaderSet(cfg, "(?i)accept-language");
+    cfgEvtFormatHeaderSet(cfg, "Accept-Encoding:");
+    cfgEvtFormatHeaderSet(cfg, "^X-T[a-z]+: [0-9]+$");
+    ctl_t *saved_ctl = g_ctl;
+    g_ctl = initCtl(cfg);
+    g_cfg.staticfg = cfg;
+
+    net_info *net = getNet(3);
+    assert_non_null(net);
+    assert_true(doHttp(3, net, request, strlen(request), TLSRX, BUF));
+    int i;
+    for (i=0; i<sizeof(result)/sizeof(result[0]); i++) {
+        assert_non_null(scope_strstr(header_event, result[i]));
+    }
+
+    // only the field name picks the known fields
+    assert_null(scope_strstr(header_event, "proxy"));
+    assert_null(scope_strstr(header_event, "Referer"));
+    scope_free(header_event);
+    ctlDestroy(&g_ctl);
+    g_ctl = saved_ctl;
+    g_cfg.staticfg = NULL;
+    cfgDestroy(&cfg);
+}
+
+// Build an HTTP/2 HEADERS frame with END_HEADERS and the given flags set
+// from name/value pairs
+static size_t
+http2HeadersFrame(struct lshpack_enc *enc, uint8_t *frame, size_t size,
+                  uint32_t stream, uint8_t flags, const char *hdrs[][2], int num)
+{
+    uint8_t *pos = frame + 9;
+    int i;
+    for (i = 0; i < num; i++) {
+        char buf[512];
+        size_t nlen = strlen(hdrs[i][0]);
+        size_t vlen = strlen(hdrs[i][1]);
+        memcpy(buf, hdrs[i][0], nlen);
+        memcpy(buf + nlen, hdrs[i][1], vlen);
+        lsxpack_header_t hdr;
+        lsxpack_header_set_offset2(&hdr, buf, 0, nlen, nlen, vlen);
+        pos = lshpack_enc_encode(enc, pos, frame + size, &hdr);
+    }
+
+    size_t len = pos - (frame + 9);
+    frame[0] = (len >> 16) & 0xff;
+    frame[1] = (len >> 8) & 0xff;
+    frame[2] = len & 0xff;
+    frame[3] = 0x01;  // HEADERS
+    frame[4] = 0x04 | flags;  // END_HEADERS
+    frame[5] = (stream >> 24) & 0x7f;
+    frame[6] = (stream >> 16) & 0xff;
+    frame[7] = (stream >> 8) & 0xff;
+    frame[8] = stream & 0xff;
+    return len + 9;
+}
+
+// Build an HTTP/2 frame header with no payload; a DATA frame's header is
+// all that's reported for it
+static size_t
+http2EmptyFrame(uint8_t *frame, uint8_t type, uint8_t flags, uint32_t stream)
+{
+    memset(frame, 0, 9);
+    frame[3] = type;
+    frame[4] = flags;
+    frame[5] = (stream >> 24) & 0x7f;
+    frame[6] = (stream >> 16) & 0xff;
+    frame[7] = (stream >> 8) & 0xff;
+    frame[8] = stream & 0xff;
+    return 9;
+}
+
+static void
+http2Send(uint64_t uid, uint8_t *frame, size_t len, bool isSend)
+{
+    protocol_info *proto = evtProtoAllocHttp2Frame(len);
+    assert_non_null(proto);
+    http_post *post = (http_post *)proto->data;
+    memcpy(post->hdr, frame, len);
+    post->start_duration = getTime();
+    post->id.uid = uid;
+    proto->len = len;
+    proto->uid = uid;
+    proto->fd = 3;
+    proto->isServer = isSend;
+    proto->sock_type = SOCK_STREAM;
+    doProtocolMetric(proto);
+    evtFree((evt_type *)proto);
+}
+
+// Returns the named value from the memory report for the channel or -1
+static double
+http2Memory(uint64_t uid, const char *name)
+{
+    double value = -1;
+    cJSON *channels = reportHttp2Memory();
+    assert_non_null(channels);
+
+    cJSON *entry;
+    cJSON_ArrayForEach(entry, channels) {
+        if (cJSON_GetObjectItem(entry, "uid")->valuedouble == uid) {
+            value = cJSON_GetObjectItem(entry, name)->valuedouble;
+        }
+    }
+    cJSON_Delete(channels);
+    return value;
+}
+
+static void
+http2StreamsReleasedAfterResponse(void **state)
+{
+    config_t *cfg = cfgCreateDefault();
+    cfgEvtFormatSourceEnabledSet(cfg, CFG_SRC_HTTP, (unsigned)1);
+    ctl_t *saved_ctl = g_ctl;
+    g_ctl = initCtl(cfg);
+
+    struct lshpack_enc reqEnc, respEnc;
+    assert_int_equal(lshpack_enc_init(&reqEnc), 0);
+    assert_int_equal(lshpack_enc_init(&respEnc), 0);
+    uint64_t uid = 0x2222;
+    uint8_t frame[1024];
+    size_t len;
+    uint32_t id;
+
+    // open 100 streams; more than the initial hash buckets
+    char targets[100][32];
+    for (id = 1; id < 200; id += 2) {
+        scope_snprintf(targets[id/2], sizeof(targets[0]), "/item/%u", id);
+        const char *req[][2] = {
+            {":method", "GET"},
+            {":scheme", "https"},
+            {":authority", "example.com"},
+            {":path", targets[id/2]},
+            {"user-agent", "grpc-go/1.0"},
+        };
+        len = http2HeadersFrame(&reqEnc, frame, sizeof(frame), id, 0x01, req, 5);
+        http2Send(uid, frame, len, TRUE);
+        scope_free(header_event);
+        header_event = NULL;
+    }
+    assert_int_equal(http2Memory(uid, "streams"), 100);
+    // the repeated host, method, and user-agent values are stored once
+    assert_true(http2Memory(uid, "string_bytes_used") <= 100 * 16 + 3 * 16);
+
+    // answer them in reverse order; each response gets its request's values
+    int i;
+    for (i = 99; i >= 0; i--) {
+        id = 2 * i + 1;
+        const char *resp[][2] = {{":status", "200"}};
+        len = http2HeadersFrame(&respEnc, frame, sizeof(frame), id, 0x01, resp, 1);
+        http2Send(uid, frame, len, FALSE);
+
+        char target[64];
+        scope_snprintf(target, sizeof(target), "\"http_target\":\"%s\"", targets[id/2]);
+        assert_non_null(header_event);
+        assert_non_null(scope_strstr(header_event, target));
+        assert_non_null(scope_strstr(header_event, "\"http_host\":\"example.com\""));
+        assert_non_null(scope_strstr(header_event, "\"http_method\":\"GET\""));
+        assert_non_null(scope_strstr(header_event, "\"http_user_agent\":\"grpc-go/1.0\""));
+        scope_free(header_event);
+        header_event = NULL;
+    }
+
+    // nothing is held for answered streams
+    assert_int_equal(http2Memory(uid, "streams"), 0);
+    assert_int_equal(http2Memory(uid, "string_bytes_used"), 0);
+
+    // a long-lived stream keeps its strings across compactions while
+    // many short ones come and go
+    const char *longReq[][2] = {{":method", "POST"}, {":path", "/long/lived"}};
+    len = http2HeadersFrame(&reqEnc, frame, sizeof(frame), 1001, 0x00, longReq, 2);
+    http2Send(uid, frame, len, TRUE);
+    scope_free(header_event);
+    header_event = NULL;
+
+    char path[300];
+    scope_memset(path, 'p', sizeof(path) - 1);
+    path[0] = '/';
+    path[sizeof(path) - 1] = '\0';
+    for (id = 1003; id < 1003 + 2 * 1000; id += 2) {
+        const char *req[][2] = {{":method", "GET"}, {":path", path}};
+        len = http2HeadersFrame(&reqEnc, frame, sizeof(frame), id, 0x01, req, 2);
+        http2Send(uid, frame, len, TRUE);
+        scope_free(header_event);
+        const char *resp[][2] = {{":status", "204"}};
+        len = http2HeadersFrame(&respEnc, frame, sizeof(frame), id, 0x01, resp, 1);
+        http2Send(uid, frame, len, FALSE);
+        scope_free(header_event);
+        header_event = NULL;
+    }
+    assert_int_equal(http2Memory(uid, "streams"), 1);
+    assert_true(http2Memory(uid, "string_bytes_used") < 128 * 1024);
+
+    // its response has a body so the stream is held until the body ends
+    const char *resp[][2] = {{":status", "201"}};
+    len = http2HeadersFrame(&respEnc, frame, sizeof(frame), 1001, 0x00, resp, 1);
+    http2Send(uid, frame, len, FALSE);
+    assert_non_null(header_event);
+    assert_non_null(scope_strstr(header_event, "\"http_target\":\"/long/lived\""));
+    assert_non_null(scope_strstr(header_event, "\"http_method\":\"POST\""));
+    scope_free(header_event);
+    header_event = NULL;
+    assert_int_equal(http2Memory(uid, "streams"), 1);
+
+    len = http2EmptyFrame(frame, 0x00, 0x01, 1001);  // DATA, END_STREAM
+    http2Send(uid, frame, len, FALSE);
+    assert_int_equal(http2Memory(uid, "streams"), 0);
+
+    lshpack_enc_cleanup(&reqEnc);
+    lshpack_enc_cleanup(&respEnc);
+    ctlDestroy(&g_ctl);
+    g_ctl = saved_ctl;
+    cfgDestroy(&cfg);
+}
+
+static void
+http2StreamsReleasedAfterTrailers(void **state)
+{
+    config_t *cfg = cfgCreateDefault();
+    cfgEvtFormatSourceEnabledSet(cfg, CFG_SRC_HTTP, (unsigned)1);
+    ctl_t *saved_ctl = g_ctl;
+    g_ctl = initCtl(cfg);
+
+    struct lshpack_enc reqEnc, respEnc;
+    assert_int_equal(lshpack_enc_init(&reqEnc), 0);
+    assert_int_equal(lshpack_enc_init(&respEnc), 0);
+    uint64_t uid = 0x3333;
+    uint8_t frame[1024];
+    size_t len;
+
+    // a gRPC call; the request and response each have a body and the
+    // response ends with trailers
+    const char *req[][2] = {
+        {":method", "POST"},
+        {":path", "/pkg.Service/Call"},
+        {"content-type", "application/grpc"},
+    };
+    len = http2HeadersFrame(&reqEnc, frame, sizeof(frame), 1, 0x00, req, 3);
+    http2Send(uid, frame, len, TRUE);
+    assert_non_null(header_event);
+    scope_free(header_event);
+    header_event = NULL;
+
+    // the client ending its side doesn't finish the stream
+    len = http2EmptyFrame(frame, 0x00, 0x01, 1);
+    http2Send(uid, frame, len, TRUE);
+    assert_int_equal(http2Memory(uid, "streams"), 1);
+
+    const char *resp[][2] = {
+        {":status", "200"},
+        {"content-type", "application/grpc"},
+    };
+    len = http2HeadersFrame(&respEnc, frame, sizeof(frame), 1, 0x00, resp, 2);
+    http2Send(uid, frame, len, FALSE);
+    assert_non_null(header_event);
+    assert_non_null(scope_strstr(header_event, "\"http_target\":\"/pkg.Service/Call\""));
+    scope_free(header_event);
+    header_event = NULL;
+    assert_int_equal(http2Memory(uid, "streams"), 1);
+
+    // the trailers end the stream without an event of their own
+    const char *trailers[][2] = {
+        {"grpc-status", "0"},
+        {"grpc-message", ""},
+    };
+    len = http2HeadersFrame(&respEnc, frame, sizeof(frame), 1, 0x01, trailers, 2);
+    http2Send(uid, frame, len, FALSE);
+    assert_null(header_event);
+    assert_int_equal(http2Memory(uid, "streams"), 0);
+    assert_int_equal(http2Memory(uid, "string_bytes_used"), 0);
+
+    // a reset stream is released before it's answered
+    len = http2HeadersFrame(&reqEnc, frame, sizeof(frame), 3, 0x00, req, 3);
+    http2Send(uid, frame, len, TRUE);
+    scope_free(header_event);
+    header_event = NULL;
+    assert_int_equal(http2Memory(uid, "streams"), 1);
+    len = http2EmptyFrame(frame, 0x03, 0x00, 3);  // RST_STREAM
+    frame[2] = 4;
+    memset(frame + 9, 0, 4);
+    len += 4;
+    http2Send(uid, frame, len, TRUE);
+    assert_int_equal(http2Memory(uid, "streams"), 0);
+
+    // frames for streams that are gone don't bring them back
+    len = http2EmptyFrame(frame, 0x00, 0x01, 1);
+    http2Send(uid, frame, len, FALSE);
+    assert_int_equal(http2Memory(uid, "streams"), 0);
+
+    lshpack_enc_cleanup(&reqEnc);
+    lshpack_enc_cleanup(&respEnc);
+    ctlDestroy(&g_ctl);
+    g_ctl = saved_ctl;
+    cfgDestroy(&cfg);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -344,9 +684,13 @@ main(int argc, char *argv[])
         cmocka_unit_test(headerBasicResponse),
         cmocka_unit_test(headerRequestIP),
         cmocka_unit_test(headerResponseIP),
+        cmocka_unit_test(headerChunkedResponseIP),
         cmocka_unit_test(headerRequestUnix),
         cmocka_unit_test(userDefinedHeaderExtract),
         cmocka_unit_test(xAppScopeHeaderExtract),
+        cmocka_unit_test(headerFieldNamesExtract),
+        cmocka_unit_test(http2StreamsReleasedAfterResponse),
+        cmocka_unit_test(http2StreamsReleasedAfterTrailers),
     };
     return cmocka_run_group_tests(tests, needleTestSetup, needleTestTeardown);
 }
@@ -10,13 +10,13 @@
 
 #define NET_ENTRIES 1024
 net_info *g_netinfo = NULL;
-list_t *g_extra_net_info_list = NULL;
+chantab_t *g_channel_net_info = NULL;
 
 static int
 setup(void **state)
 {
     g_netinfo = scope_calloc(NET_ENTRIES, sizeof(net_info));
-    g_extra_net_info_list = lstCreate(scope_free);
+    g_channel_net_info = chanTabCreate(CHANNEL_ENTRIES, CHANNEL_MAX_IDLE, NULL);
 
     return groupSetup(state);
 }
@@ -25,7 +25,7 @@ static int
 teardown(void **state)
 {
     scope_free(g_netinfo);
-    lstDestroy(&g_extra_net_info_list);
+    chanTabDestroy(&g_channel_net_info);
 
     return groupTeardown(state);
 }
@@ -51,15 +51,15 @@ freeReq(http_map *req)
 static void
 httpMatchCreateReturnsNullWithNullParams(void **state)
 {
-   assert_null(httpMatchCreate(NULL, g_extra_net_info_list, freeReq));
+   assert_null(httpMatchCreate(NULL, g_channel_net_info, freeReq));
    assert_null(httpMatchCreate(g_netinfo, NULL, freeReq));
-   assert_null(httpMatchCreate(g_netinfo, g_extra_net_info_list, NULL));
+   assert_null(httpMatchCreate(g_netinfo, g_channel_net_info, NULL));
 }
 
 static void
 httpMatchCreateReturnsNonNull(void **state)
 {
-    httpmatch_t *match = httpMatchCreate(g_netinfo, g_extra_net_info_list, freeReq);
+    httpmatch_t *match = httpMatchCreate(g_netinfo, g_channel_net_info, freeReq);
     assert_non_null(match);
     httpMatchDestroy(&match);
     assert_null(match);
@@ -76,7 +76,7 @@ httpMatchDestroyForNullDoesNotCrash(void **state)
 static void
 httpReqSaveReturnsFalseWithNullParams(void **state)
 {
-    httpmatch_t *match = httpMatchCreate(g_netinfo, g_extra_net_info_list, freeReq);
+    httpmatch_t *match = httpMatchCreate(g_netinfo, g_channel_net_info, freeReq);
     http_map *reqToAdd = newReq(531, 3);
 
     assert_false(httpReqSave(NULL, reqToAdd));
@@ -89,7 +89,7 @@ httpReqSaveReturnsFalseWithNullParams(void **state)
 static void
 httpReqSaveAddOfDuplicateFails(void **state)
 {
-    httpmatch_t *match = httpMatchCreate(g_netinfo, g_extra_net_info_list, freeReq);
+    httpmatch_t *match = httpMatchCreate(g_netinfo, g_channel_net_info, freeReq);
     http_map *reqToAdd1 = newReq(531, 3);
     http_map *reqToAdd2 = newReq(531, 3);
     assert_true(httpReqSave(match, reqToAdd1));
@@ -109,7 +109,7 @@ httpReqSaveAddOfDuplicateFails(void **state)
 static void
 httpReqSaveDoesNotCrash(void **state)
 {
-    httpmatch_t *match = httpMatchCreate(g_netinfo, g_extra_net_info_list, freeReq);
+    httpmatch_t *match = httpMatchCreate(g_netinfo, g_channel_net_info, freeReq);
     assert_non_null(match);
 
     http_map *reqToAdd = newReq(531, 3);
@@ -130,7 +130,7 @@ httpReqSaveDoesNotCrash(void **state)
 static void
 httpReqSaveAndGetWorks(void **state)
 {
-    httpmatch_t *match = httpMatchCreate(g_netinfo, g_extra_net_info_list, freeReq);
+    httpmatch_t *match = httpMatchCreate(g_netinfo, g_channel_net_info, freeReq);
     http_map *reqToAdd1 = newReq(1234, 4);
     http_map *reqToAdd2 = newReq(1235, 4);
     http_map *reqToAdd3 = newReq(1235+HASH_PRIME, 4);
@@ -163,7 +163,7 @@ httpReqSaveAndGetWorks(void **state)
 static void
 httpReqExpireWithoutAnyRequests(void **state)
 {
-    httpmatch_t *match = httpMatchCreate(g_netinfo, g_extra_net_info_list, freeReq);
+    httpmatch_t *match = httpMatchCreate(g_netinfo, g_channel_net_info, freeReq);
     httpReqExpire(match, 123456789, FALSE);
     httpMatchDestroy(&match);
 }
@@ -171,7 +171,7 @@ httpReqExpireWithoutAnyRequests(void **state)
 static void
 httpReqExpireRequestsFromCircBufCount(void **state)
 {
-    httpmatch_t *match = httpMatchCreate(g_netinfo, g_extra_net_info_list, freeReq);
+    httpmatch_t *match = httpMatchCreate(g_netinfo, g_channel_net_info, freeReq);
     http_map *reqToAdd1 = newReq(1234, 4);
     http_map *reqToAdd2 = newReq(1235, 4);
     http_map *reqToAdd3 = newReq(1235+HASH_PRIME, 4);
@@ -205,7 +205,7 @@ httpReqExpireRequestsAtDifferentTimes(void **state)
     int red = 1235;
     int blue = red + HASH_PRIME;
 
-    httpmatch_t *match = httpMatchCreate(g_netinfo, g_extra_net_info_list, freeReq);
+    httpmatch_t *match = httpMatchCreate(g_netinfo, g_channel_net_info, freeReq);
 
     // add red
     http_map *req1 = newReq(red, 4);
@@ -242,7 +242,7 @@ httpReqExpireRequestsAtDifferentTimes(void **state)
 static void
 httpReqExpireRequestsFromEmptyFlag(void **state)
 {
-    httpmatch_t *match = httpMatchCreate(g_netinfo, g_extra_net_info_list, freeReq);
+    httpmatch_t *match = httpMatchCreate(g_netinfo, g_channel_net_info, freeReq);
     http_map *reqToAdd1 = newReq(1234, 4);
     http_map *reqToAdd2 = newReq(1235, 4);
     http_map *reqToAdd3 = newReq(1235+HASH_PRIME, 4);
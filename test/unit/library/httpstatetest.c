@@ -15,6 +15,7 @@
 #define NET_ENTRIES 1024
 extern uint64_t g_http_guard[NET_ENTRIES];
 struct protocol_info_t* g_msg = NULL;
+int g_msg_count = 0;
 
 
 void
@@ -37,6 +38,7 @@ int __wrap_cmdPostEvent(ctl_t *ctl, char *event)
 {
     if (g_msg) freeMsg(&g_msg); // Don't leak
     g_msg = (struct protocol_info_t*)event;
+    g_msg_count++;
     return 0;
 }
 
@@ -279,6 +281,331 @@ doHttpWhichExceedsReallocSize(void** state)
 
 }
 
+static void
+doHttpWithContentLengthSkipsBody(void** state)
+{
+    char *buffers[] = {
+        "HTTP/1.1 200 OK\r\n"
+        "CONTENT-length:  10 \r\n"
+        "\r\n"
+        "HTTP/",
+        "HTTP/",
+        "HTTP/1.1 204 No Content\r\n\r\n",
+        NULL };
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    // header found and the first 5 bytes of body are skipped
+    assert_true(doHttp(3, &net, buffers[0], strlen(buffers[0]), NETTX, BUF));
+    assert_non_null(g_msg);
+    struct http_post_t *post = (struct http_post_t*) g_msg->data;
+    assert_string_equal(post->hdr, "HTTP/1.1 200 OK\r\nCONTENT-length:  10 \r\n");
+    freeMsg(&g_msg);
+    assert_int_equal(net.http[HTTP_TX].state, HTTP_DATA);
+    assert_int_equal(net.http[HTTP_TX].clen, 5);
+
+    // the rest of the body looks like a header but is skipped
+    assert_false(doHttp(3, &net, buffers[1], strlen(buffers[1]), NETTX, BUF));
+    assert_null(g_msg);
+
+    // and then we're looking for a new header again
+    assert_true(doHttp(3, &net, buffers[2], strlen(buffers[2]), NETTX, BUF));
+    assert_non_null(g_msg);
+    freeMsg(&g_msg);
+    assert_int_equal(net.http[HTTP_TX].state, HTTP_NONE);
+}
+
+static void
+doHttpWithInvalidContentLength(void** state)
+{
+    char *buffer =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 12abc\r\n"
+        "\r\n";
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    assert_true(doHttp(3, &net, buffer, strlen(buffer), NETTX, BUF));
+    freeMsg(&g_msg);
+    assert_int_equal(net.http[HTTP_TX].state, HTTP_NONE);
+}
+
+static void
+doHttpWithFieldsSplitAcrossBuffers(void** state)
+{
+    // after the start line, every byte is in its own buffer
+    char *buffer =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "connection: keep-alive, Upgrade\r\n"
+        "UPGRADE: h2c\r\n"
+        "\r\n";
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+    int i = strlen("HTTP/1.1 101 Switching Protocols\r\n");
+    int len = strlen(buffer);
+
+    assert_false(doHttp(3, &net, buffer, i, NETTX, BUF));
+    for (; i < len - 1; i++) {
+        assert_false(doHttp(3, &net, &buffer[i], 1, NETTX, BUF));
+    }
+    assert_true(doHttp(3, &net, &buffer[i], 1, NETTX, BUF));
+    assert_non_null(g_msg);
+    struct http_post_t *post = (struct http_post_t*) g_msg->data;
+    assert_string_equal(post->hdr, "HTTP/1.1 101 Switching Protocols\r\n"
+                                   "connection: keep-alive, Upgrade\r\n"
+                                   "UPGRADE: h2c\r\n");
+    freeMsg(&g_msg);
+
+    // the upgrade response switched both sides to HTTP/2
+    assert_int_equal(net.http[HTTP_TX].version, 2);
+    assert_int_equal(net.http[HTTP_RX].version, 2);
+    resetHttp(net.http);
+}
+
+static void
+doHttpWithoutConnectionUpgrade(void** state)
+{
+    char *buffer =
+        "HTTP/1.1 200 OK\r\n"
+        "Connection: upgraded\r\n"
+        "Upgrade: h2c\r\n"
+        "\r\n";
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    assert_true(doHttp(3, &net, buffer, strlen(buffer), NETTX, BUF));
+    freeMsg(&g_msg);
+    assert_int_equal(net.http[HTTP_TX].version, 1);
+}
+
+static void
+doHttpWithEventsDisabled(void** state)
+{
+    char *buffer =
+        "POST /path HTTP/1.1\r\n"
+        "Host: www.google.com\r\n"
+        "Content-Length: 2\r\n"
+        "User-Agent: test\r\n"
+        "\r\n"
+        "{}";
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    config_t *cfg = cfgCreateDefault();
+    cfgEvtEnableSet(cfg, FALSE);
+    g_cfg.staticfg = cfg;
+
+    // only the start line and content length are kept for metrics
+    assert_true(doHttp(3, &net, buffer, strlen(buffer), NETRX, BUF));
+    assert_non_null(g_msg);
+    struct http_post_t *post = (struct http_post_t*) g_msg->data;
+    assert_string_equal(post->hdr, "POST /path HTTP/1.1\r\nContent-Length: 2\r\n");
+    freeMsg(&g_msg);
+    assert_int_equal(net.http[HTTP_RX].state, HTTP_NONE);
+
+    g_cfg.staticfg = NULL;
+    cfgDestroy(&cfg);
+}
+
+static void
+doHttpWithChunkedResponse(void** state)
+{
+    char *buffers[] = {
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "5\r\nHTTP/\r\n"
+        "1C;name=val",
+        "ue\r\n"
+        "HTTP/1.1 200 OK\r\n\r\n123456789",
+        "\r\n0",
+        "\r\nTrailer: x\r\n",
+        "\r\n",
+        NULL };
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+    int i;
+
+    // the header isn't reported until the body ends
+    assert_true(doHttp(3, &net, buffers[0], strlen(buffers[0]), NETTX, BUF));
+    assert_null(g_msg);
+    assert_int_equal(net.http[HTTP_TX].state, HTTP_CHUNKED);
+
+    // nothing in the body is mistaken for a header
+    for (i = 1; buffers[i + 1]; i++) {
+        assert_false(doHttp(3, &net, buffers[i], strlen(buffers[i]), NETTX, BUF));
+        assert_null(g_msg);
+        assert_int_equal(net.http[HTTP_TX].state, HTTP_CHUNKED);
+    }
+
+    assert_false(doHttp(3, &net, buffers[i], strlen(buffers[i]), NETTX, BUF));
+    assert_non_null(g_msg);
+    assert_int_equal(g_msg->ptype, EVT_HRES);
+    struct http_post_t *post = (struct http_post_t*) g_msg->data;
+    assert_string_equal(post->hdr, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n");
+    assert_int_equal(post->clen, 5 + 0x1C);
+    freeMsg(&g_msg);
+    assert_int_equal(net.http[HTTP_TX].state, HTTP_NONE);
+}
+
+static void
+doHttpWithChunkedResponseClosedEarly(void** state)
+{
+    char *buffer =
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: gzip, chunked\r\n"
+        "\r\n"
+        "100\r\nabc";
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    assert_true(doHttp(3, &net, buffer, strlen(buffer), NETTX, BUF));
+    assert_null(g_msg);
+
+    // the header is still reported, without a body size
+    resetHttp(net.http);
+    assert_non_null(g_msg);
+    struct http_post_t *post = (struct http_post_t*) g_msg->data;
+    assert_int_equal(post->clen, -1);
+    freeMsg(&g_msg);
+}
+
+static void
+doHttpWithInvalidChunkedBody(void** state)
+{
+    char *buffers[] = {
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "zz\r\n",
+        "HTTP/1.1 204 No Content\r\n\r\n",
+        NULL };
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    // the bad body gives up the pending header and we resync on the next one
+    assert_true(doHttp(3, &net, buffers[0], strlen(buffers[0]), NETTX, BUF));
+    assert_non_null(g_msg);
+    freeMsg(&g_msg);
+    assert_int_equal(net.http[HTTP_TX].state, HTTP_NONE);
+
+    assert_true(doHttp(3, &net, buffers[1], strlen(buffers[1]), NETTX, BUF));
+    assert_non_null(g_msg);
+    freeMsg(&g_msg);
+}
+
+static void
+doHttpWithPipelinedRequests(void** state)
+{
+    char *buffers[] = {
+        "GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+        "POST /b HTTP/1.1\r\nContent-Length: 5\r\n\r\nHTTP/"
+        "PUT /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n"
+        "GET /d HTTP/1.1\r\n",
+        "Host: x\r\n\r\n",
+        NULL };
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    g_msg_count = 0;
+    assert_true(doHttp(3, &net, buffers[0], strlen(buffers[0]), NETRX, BUF));
+    assert_int_equal(g_msg_count, 3);
+    struct http_post_t *post = (struct http_post_t*) g_msg->data;
+    assert_string_equal(post->hdr, "PUT /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n");
+    freeMsg(&g_msg);
+    assert_int_equal(net.http[HTTP_RX].state, HTTP_HDR);
+
+    assert_true(doHttp(3, &net, buffers[1], strlen(buffers[1]), NETRX, BUF));
+    assert_int_equal(g_msg_count, 4);
+    post = (struct http_post_t*) g_msg->data;
+    assert_string_equal(post->hdr, "GET /d HTTP/1.1\r\nHost: x\r\n");
+    freeMsg(&g_msg);
+    assert_int_equal(net.http[HTTP_RX].state, HTTP_NONE);
+}
+
+static void
+doHttpWithPipelinedResponses(void** state)
+{
+    char *buffer =
+        "HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nabc"
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "4\r\nabcd\r\n2\r\nef\r\n0\r\n\r\n"
+        "HTTP/1.1 304 Not Modified\r\n\r\n";
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+
+    g_msg_count = 0;
+    assert_true(doHttp(3, &net, buffer, strlen(buffer), NETTX, BUF));
+    assert_int_equal(g_msg_count, 3);
+    struct http_post_t *post = (struct http_post_t*) g_msg->data;
+    assert_string_equal(post->hdr, "HTTP/1.1 304 Not Modified\r\n");
+    assert_int_equal(post->clen, -1);
+    freeMsg(&g_msg);
+    assert_int_equal(net.http[HTTP_TX].state, HTTP_NONE);
+}
+
+static void
+doHttp2WithGrpcCall(void** state)
+{
+    // the magic, request HEADERS, and request DATA ending the client's side
+    uint8_t reqBuf[] = {
+        'P','R','I',' ','*',' ','H','T','T','P','/','2','.','0','\r','\n',
+        '\r','\n','S','M','\r','\n','\r','\n',
+        0,0,3, 0x01, 0x04, 0,0,0,1, 'a','b','c',
+        0,0,5, 0x00, 0x01, 0,0,0,1, 1,2,3,4,5,
+    };
+    // response HEADERS and DATA then the trailers split across buffers
+    uint8_t respBuf[] = {
+        0,0,2, 0x01, 0x04, 0,0,0,1, 'x','y',
+        0,0,4, 0x00, 0x00, 0,0,0,1, 1,2,3,4,
+        0,0,2, 0x01, 0x05, 0,0,0,1, 'g','h',
+    };
+    // a DATA frame ending a stream that's split after its header and a
+    // RST_STREAM
+    uint8_t endBuf[] = {
+        0,0,20, 0x00, 0x01, 0,0,0,3, 1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,
+        0,0,4, 0x03, 0x00, 0,0,0,5, 0,0,0,8,
+    };
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+    struct http_post_t *post;
+
+    g_msg_count = 0;
+    assert_true(doHttp(3, &net, (char *)reqBuf, sizeof(reqBuf), NETTX, BUF));
+    assert_int_equal(g_msg_count, 2);
+    // only the header of the DATA frame is reported and its length says so
+    assert_int_equal(g_msg->len, 9);
+    assert_true(g_msg->isServer);
+    post = (struct http_post_t*) g_msg->data;
+    assert_memory_equal(post->hdr, "\0\0\0\x00\x01\0\0\0\x01", 9);
+    freeMsg(&g_msg);
+
+    // DATA without END_STREAM isn't reported
+    assert_true(doHttp(3, &net, (char *)respBuf, sizeof(respBuf) - 10, NETRX, BUF));
+    assert_int_equal(g_msg_count, 3);
+    assert_int_equal(g_msg->len, 11);
+    freeMsg(&g_msg);
+
+    assert_true(doHttp(3, &net, (char *)respBuf + sizeof(respBuf) - 10, 10, NETRX, BUF));
+    assert_int_equal(g_msg_count, 4);
+    assert_int_equal(g_msg->len, 11);
+    assert_false(g_msg->isServer);
+    post = (struct http_post_t*) g_msg->data;
+    assert_memory_equal(post->hdr, "\0\0\x02\x01\x05\0\0\0\x01gh", 11);
+    freeMsg(&g_msg);
+
+    assert_false(doHttp(3, &net, (char *)endBuf, 12, NETRX, BUF));
+    assert_int_equal(g_msg_count, 4);
+    assert_false(doHttp(3, &net, (char *)endBuf + 12, sizeof(endBuf) - 12, NETRX, BUF));
+    assert_int_equal(g_msg_count, 6);
+    assert_int_equal(g_msg->len, 13);
+    post = (struct http_post_t*) g_msg->data;
+    assert_memory_equal(post->hdr, endBuf + 29, 13);
+    freeMsg(&g_msg);
+
+    resetHttp(net.http);
+}
+
 
 int
 main(int argc, char* argv[])
@@ -294,6 +621,17 @@ main(int argc, char* argv[])
         cmocka_unit_test(doHttpWithInterleavedEncryption),
         cmocka_unit_test(doHttpWhichRequiresRealloc),
         cmocka_unit_test(doHttpWhichExceedsReallocSize),
+        cmocka_unit_test(doHttpWithContentLengthSkipsBody),
+        cmocka_unit_test(doHttpWithInvalidContentLength),
+        cmocka_unit_test(doHttpWithFieldsSplitAcrossBuffers),
+        cmocka_unit_test(doHttpWithoutConnectionUpgrade),
+        cmocka_unit_test(doHttpWithEventsDisabled),
+        cmocka_unit_test(doHttpWithChunkedResponse),
+        cmocka_unit_test(doHttpWithChunkedResponseClosedEarly),
+        cmocka_unit_test(doHttpWithInvalidChunkedBody),
+        cmocka_unit_test(doHttpWithPipelinedRequests),
+        cmocka_unit_test(doHttpWithPipelinedResponses),
+        cmocka_unit_test(doHttp2WithGrpcCall),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, needleTestSetup, needleTestTeardown);
@@ -852,6 +852,125 @@ ipcHandlerMultipleFrameErrorTimeoutFrame(void **state) {
     assert_int_equal(status, 0);
 }
 
+static void
+ipcHandlerMultipleFrameRequest(void **state) {
+    const char *ipcConnName = "/testConnection";
+    int status;
+    mqd_t mqReadWriteDes;
+    int uniqueId = -1;
+    req_parse_status_t parseStatus = REQ_PARSE_GENERIC_ERROR;
+    char *scopeReq;
+
+    const long maxMsgSize = 64;
+    struct mq_attr attr = {.mq_flags = 0, 
+                           .mq_maxmsg = 10,
+                           .mq_msgsize = maxMsgSize,
+                           .mq_curmsgs = 0};
+
+    mqReadWriteDes = scope_mq_open(ipcConnName, O_RDWR | O_CREAT | O_CLOEXEC | O_NONBLOCK, 0666, &attr);
+    assert_int_not_equal(mqReadWriteDes, -1);
+
+    // The request split across three frames, each of them NUL terminated
+    const char *frames[][2] = {
+        {"{\"req\":1,\"uniq\":2345,\"remain\":12}", "[{\"req\""},
+        {"{\"req\":1,\"uniq\":2345,\"remain\":5}", ":1},{\"r"},
+        {"{\"req\":0,\"uniq\":2345,\"remain\":2}", "eq\":4}]"},
+    };
+    for (int i = 0; i < ARRAY_SIZE(frames); ++i) {
+        ipc_msg_t *msg = createIpcMessage(frames[i][0], frames[i][1]);
+        status = scope_mq_send(mqReadWriteDes, msg->full, msg->fullLen, 0);
+        assert_int_equal(status, 0);
+        destroyIpcMessage(msg);
+    }
+
+    scopeReq = ipcRequestHandler(mqReadWriteDes, attr.mq_msgsize, &parseStatus, &uniqueId);
+    assert_non_null(scopeReq);
+    assert_int_equal(parseStatus, REQ_PARSE_OK);
+    assert_string_equal(scopeReq, "[{\"req\":1},{\"req\":4}]");
+    assert_int_equal(uniqueId, 2345);
+    scope_free(scopeReq);
+
+    status = scope_mq_close(mqReadWriteDes);
+    assert_int_equal(status, 0);
+    status = scope_mq_unlink(ipcConnName);
+    assert_int_equal(status, 0);
+}
+
+static void
+ipcHandlerScopeResponseBatch(void **state) {
+    const char *ipcConnName = "/testConnection";
+    int status;
+    mqd_t mqReadWriteDes;
+    ipc_resp_result_t res;
+    void *buf;
+    struct mq_attr attr;
+    ssize_t dataLen;
+    int uniqueId = 3434;
+
+    mqReadWriteDes = scope_mq_open(ipcConnName, O_RDWR | O_CREAT | O_CLOEXEC | O_NONBLOCK, 0666, NULL);
+    assert_int_not_equal(mqReadWriteDes, -1);
+
+    status = scope_mq_getattr(mqReadWriteDes, &attr);
+    assert_int_equal(status, 0);
+
+    // Get Scope Status, an unknown command and something which isn't a request
+    res = ipcSendSuccessfulResponse(mqReadWriteDes, attr.mq_msgsize, "[{\"req\":1},{\"req\":99999},3]", uniqueId);
+    assert_int_equal(res, RESP_RESULT_OK);
+    status = scope_mq_getattr(mqReadWriteDes, &attr);
+    assert_int_equal(status, 0);
+    assert_int_equal(attr.mq_curmsgs, 1);
+
+    buf = scope_calloc(1, attr.mq_msgsize + 1);
+    assert_non_null(buf);
+
+    dataLen = scope_mq_receive(mqReadWriteDes, buf, attr.mq_msgsize, 0);
+    assert_int_not_equal(dataLen, -1);
+
+    cJSON *item;
+    cJSON *mqResp = cJSON_Parse(buf);
+    assert_non_null(mqResp);
+    item = cJSON_GetObjectItemCaseSensitive(mqResp, "status");
+    assert_non_null(item);
+    assert_int_equal(item->valueint, 200);
+    cJSON_Delete(mqResp);
+
+    // The responses in the order of the requests
+    cJSON *scopeResp = cJSON_Parse(buf + scope_strlen(buf) + 1);
+    assert_non_null(scopeResp);
+    assert_true(cJSON_IsArray(scopeResp));
+    assert_int_equal(cJSON_GetArraySize(scopeResp), 3);
+
+    cJSON *single = cJSON_GetArrayItem(scopeResp, 0);
+    item = cJSON_GetObjectItemCaseSensitive(single, "status");
+    assert_non_null(item);
+    assert_int_equal(item->valueint, 200);
+    item = cJSON_GetObjectItemCaseSensitive(single, "scoped");
+    assert_non_null(item);
+    assert_true(cJSON_IsFalse(item));
+
+    single = cJSON_GetArrayItem(scopeResp, 1);
+    item = cJSON_GetObjectItemCaseSensitive(single, "status");
+    assert_non_null(item);
+    assert_int_equal(item->valueint, 501);
+
+    single = cJSON_GetArrayItem(scopeResp, 2);
+    item = cJSON_GetObjectItemCaseSensitive(single, "status");
+    assert_non_null(item);
+    assert_int_equal(item->valueint, 400);
+
+    cJSON_Delete(scopeResp);
+    scope_free(buf);
+
+    status = scope_mq_close(mqReadWriteDes);
+    assert_int_equal(status, 0);
+    status = scope_mq_unlink(ipcConnName);
+    assert_int_equal(status, 0);
+
+    // The one which isn't a request
+    assert_int_equal(dbgCountMatchingLines("src/ipc.c"), 1);
+    dbgInit(); // reset dbg for the rest of the tests
+}
+
 int
 main(int argc, char* argv[]) {
     printf("running %s\n", argv[0]);
@@ -875,6 +994,8 @@ main(int argc, char* argv[]) {
         cmocka_unit_test(ipcHandlerScopeResponseGetCfgSingleMsg),
         cmocka_unit_test(ipcHandlerScopeResponseSetCfgSingleMsg),
         cmocka_unit_test(ipcHandlerMultipleFrameErrorTimeoutFrame),
+        cmocka_unit_test(ipcHandlerMultipleFrameRequest),
+        cmocka_unit_test(ipcHandlerScopeResponseBatch),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
@@ -204,7 +204,7 @@ javaBciConvertMethodToNative(void** state)
     assert_non_null(classInfo);
 
     int methodIndex = javaFindMethodIndex(classInfo, "print", "(Ljava/lang/String;)V");
-    void *addrConv = javaConvertMethodToNative(classInfo, methodIndex);
+    javaConvertMethodToNative(classInfo, methodIndex);
     
     unsigned char *dest = malloc(classInfo->length);
     javaWriteClass(dest, classInfo);
@@ -218,7 +218,6 @@ javaBciConvertMethodToNative(void** state)
 
     javaDestroy(&modClassInfo);
     free(dest);
-    scope_free(addrConv);
 }
 
 static void
@@ -267,6 +266,36 @@ javaBciAddStringTag(void** state)
     free(dest);
 }
 
+static void
+javaBciAddField(void** state)
+{
+    java_class_t *classInfo = javaReadClass(JavaTest_class);
+    assert_non_null(classInfo);
+    uint16_t fieldsCount = classInfo->fields_count;
+
+    javaAddField(classInfo, "__fd", "I", ACC_PRIVATE);
+
+    unsigned char *dest = malloc(classInfo->length);
+    javaWriteClass(dest, classInfo);
+    javaDestroy(&classInfo);
+    assert_null(classInfo);
+
+    java_class_t *modClassInfo = javaReadClass(dest);
+    assert_int_equal(modClassInfo->fields_count, fieldsCount + 1);
+
+    unsigned char *field = modClassInfo->fields[fieldsCount];
+    assert_int_equal(be16toh(*((uint16_t *)field)), ACC_PRIVATE);
+    char *name = javaGetUtf8String(modClassInfo, be16toh(*((uint16_t *)(field + 2))));
+    assert_string_equal(name, "__fd");
+    scope_free(name);
+    char *desc = javaGetUtf8String(modClassInfo, be16toh(*((uint16_t *)(field + 4))));
+    assert_string_equal(desc, "I");
+    scope_free(desc);
+
+    javaDestroy(&modClassInfo);
+    free(dest);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -280,6 +309,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(javaBciConvertMethodToNative),
         cmocka_unit_test(javaBciInjectCode),
         cmocka_unit_test(javaBciAddStringTag),
+        cmocka_unit_test(javaBciAddField),
         cmocka_unit_test(dbgHasNoUnexpectedFailures)
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
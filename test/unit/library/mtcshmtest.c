@@ -0,0 +1,295 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mtcshm.h"
+#include "test.h"
+
+#define REGION_SIZE (sizeof(mtcshm_hdr_t) + (MTCSHM_ENTRIES * sizeof(mtcshm_entry_t)))
+
+static void
+shmPath(char *path, size_t len)
+{
+    snprintf(path, len, "%s%d", MTCSHM_PATH, getpid());
+}
+
+static bool
+shmExists(void)
+{
+    char path[64];
+    struct stat sb;
+    shmPath(path, sizeof(path));
+    return stat(path, &sb) == 0;
+}
+
+// Maps the region the way a collector would, read only
+static mtcshm_hdr_t *
+shmOpen(void)
+{
+    char path[64];
+    shmPath(path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return NULL;
+    void *addr = mmap(NULL, REGION_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return (addr == MAP_FAILED) ? NULL : addr;
+}
+
+static void
+shmClose(mtcshm_hdr_t *hdr)
+{
+    if (hdr) munmap(hdr, REGION_SIZE);
+}
+
+static mtcshm_entry_t *
+shmFind(mtcshm_hdr_t *hdr, const char *name, const char *tags)
+{
+    mtcshm_entry_t *entry = (mtcshm_entry_t *)((char *)hdr + hdr->hdr_size);
+    int i;
+    for (i = 0; i < hdr->count; i++) {
+        if (!strcmp(entry[i].name, name) && !strcmp(entry[i].tags, tags)) {
+            return &entry[i];
+        }
+    }
+    return NULL;
+}
+
+static int
+publish(const char *name, long long value, data_type_t type, unsigned verbosity)
+{
+    event_field_t fields[] = {
+        STRFIELD("proc",    "mtcshmtest",  2,  TRUE),
+        NUMFIELD("pid",     getpid(),      7,  TRUE),
+        NUMFIELD("fd",      3,             7,  TRUE),
+        STRFIELD("host",    "myhost",      2,  TRUE),
+        STRFIELD("file",    "/tmp/x",      5,  TRUE),
+        STRFIELD("op",      "read",        3,  TRUE),
+        STRFIELD("unit",    "byte",        1,  TRUE),
+        STRFIELD("summary", "true",        4,  TRUE),
+        FIELDEND
+    };
+    event_t e = INT_EVENT(name, value, type, fields);
+    return mtcShmPublish(&e, verbosity);
+}
+
+static void
+mtcShmPublishNullEvent(void **state)
+{
+    assert_int_equal(mtcShmPublish(NULL, 4), -1);
+    event_t e = INT_EVENT(NULL, 1, DELTA, NULL);
+    assert_int_equal(mtcShmPublish(&e, 4), -1);
+    assert_false(shmExists());
+}
+
+static void
+mtcShmPublishCreatesRegion(void **state)
+{
+    mtcShmAttach();
+    assert_false(shmExists());
+    assert_int_equal(publish("fs.read", 10, DELTA, 4), 0);
+    assert_true(shmExists());
+
+    mtcshm_hdr_t *hdr = shmOpen();
+    assert_non_null(hdr);
+    assert_true(hdr->magic == MTCSHM_MAGIC);
+    assert_int_equal(hdr->version, MTCSHM_VERSION);
+    assert_int_equal(hdr->hdr_size, sizeof(mtcshm_hdr_t));
+    assert_int_equal(hdr->entry_size, sizeof(mtcshm_entry_t));
+    assert_int_equal(hdr->capacity, MTCSHM_ENTRIES);
+    assert_int_equal(hdr->pid, getpid());
+    assert_int_equal(hdr->count, 1);
+    assert_int_equal(hdr->dropped, 0);
+    assert_int_equal(hdr->seq & 1, 0);
+    assert_true(hdr->updated > 0);
+
+    // Only op is both a tag and allowed at verbosity 4
+    mtcshm_entry_t *entry = shmFind(hdr, "fs.read", "op:read");
+    assert_non_null(entry);
+    assert_string_equal(entry->unit, "byte");
+    assert_int_equal(entry->type, DELTA);
+    assert_true(entry->last == 10.0);
+    assert_true(entry->total == 10.0);
+    assert_int_equal(entry->count, 1);
+
+    shmClose(hdr);
+    mtcShmDetach();
+    assert_false(shmExists());
+}
+
+static void
+mtcShmReplacesAPlantedFile(void **state)
+{
+    // Someone got to the name first, with a file anyone can write
+    char path[64];
+    shmPath(path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    assert_int_not_equal(fd, -1);
+    assert_int_equal(fchmod(fd, 0666), 0);
+    struct stat planted;
+    assert_int_equal(fstat(fd, &planted), 0);
+
+    mtcShmAttach();
+    assert_int_equal(publish("fs.read", 10, DELTA, 4), 0);
+
+    // It's not the file that was mapped; ours is private
+    struct stat sb;
+    assert_int_equal(stat(path, &sb), 0);
+    assert_true(sb.st_ino != planted.st_ino);
+    assert_int_equal(sb.st_mode & 0777, 0600);
+    assert_int_equal(sb.st_uid, geteuid());
+    assert_int_equal(fstat(fd, &planted), 0);
+    assert_int_equal(planted.st_size, 0);
+    close(fd);
+
+    mtcshm_hdr_t *hdr = shmOpen();
+    assert_non_null(hdr);
+    assert_non_null(shmFind(hdr, "fs.read", "op:read"));
+    mtcShmDetach();
+    shmClose(hdr);
+}
+
+static void
+mtcShmCountersAccumulate(void **state)
+{
+    mtcShmAttach();
+    assert_int_equal(publish("fs.read", 10, DELTA, 4), 0);
+    assert_int_equal(publish("fs.read", 5, DELTA, 4), 0);
+    assert_int_equal(publish("proc.fd", 7, CURRENT, 4), 0);
+    assert_int_equal(publish("proc.fd", 3, CURRENT, 4), 0);
+
+    mtcshm_hdr_t *hdr = shmOpen();
+    assert_non_null(hdr);
+    assert_int_equal(hdr->count, 2);
+
+    mtcshm_entry_t *entry = shmFind(hdr, "fs.read", "op:read");
+    assert_non_null(entry);
+    assert_true(entry->last == 5.0);
+    assert_true(entry->total == 15.0);
+    assert_int_equal(entry->count, 2);
+
+    entry = shmFind(hdr, "proc.fd", "op:read");
+    assert_non_null(entry);
+    assert_int_equal(entry->type, CURRENT);
+    assert_true(entry->last == 3.0);
+    assert_int_equal(entry->count, 2);
+
+    // Each update leaves seq even, two further on
+    assert_int_equal(hdr->seq, 2 + (4 * 2));
+
+    shmClose(hdr);
+    mtcShmDetach();
+}
+
+static void
+mtcShmTagsFollowVerbosity(void **state)
+{
+    mtcShmAttach();
+    assert_int_equal(publish("fs.read", 1, DELTA, 0), 0);
+    assert_int_equal(publish("fs.read", 1, DELTA, 4), 0);
+    assert_int_equal(publish("fs.read", 1, DELTA, 9), 0);
+
+    mtcshm_hdr_t *hdr = shmOpen();
+    assert_non_null(hdr);
+    assert_int_equal(hdr->count, 3);
+    assert_non_null(shmFind(hdr, "fs.read", ""));
+    assert_non_null(shmFind(hdr, "fs.read", "op:read"));
+    assert_non_null(shmFind(hdr, "fs.read", "fd:3,file:/tmp/x,op:read"));
+
+    shmClose(hdr);
+    mtcShmDetach();
+}
+
+static void
+mtcShmFullRegionCountsDrops(void **state)
+{
+    mtcShmAttach();
+    char name[32];
+    int i;
+    for (i = 0; i < MTCSHM_ENTRIES + 5; i++) {
+        snprintf(name, sizeof(name), "metric.%d", i);
+        assert_int_equal(publish(name, 1, DELTA, 0), (i < MTCSHM_ENTRIES) ? 0 : -1);
+    }
+    // The ones that made it in still count
+    assert_int_equal(publish("metric.0", 1, DELTA, 0), 0);
+
+    mtcshm_hdr_t *hdr = shmOpen();
+    assert_non_null(hdr);
+    assert_int_equal(hdr->count, MTCSHM_ENTRIES);
+    assert_int_equal(hdr->dropped, 5);
+    mtcshm_entry_t *entry = shmFind(hdr, "metric.0", "");
+    assert_non_null(entry);
+    assert_int_equal(entry->count, 2);
+
+    shmClose(hdr);
+    mtcShmDetach();
+}
+
+static void
+mtcShmOutlivesAReload(void **state)
+{
+    // The new config's mtc attaches before the old one is destroyed
+    mtcShmAttach();
+    assert_int_equal(publish("fs.read", 1, DELTA, 0), 0);
+    mtcShmAttach();
+    mtcShmDetach();
+    assert_true(shmExists());
+    assert_int_equal(publish("fs.read", 1, DELTA, 0), 0);
+
+    mtcshm_hdr_t *hdr = shmOpen();
+    assert_non_null(hdr);
+    mtcshm_entry_t *entry = shmFind(hdr, "fs.read", "");
+    assert_non_null(entry);
+    assert_int_equal(entry->count, 2);
+    shmClose(hdr);
+
+    mtcShmDetach();
+    assert_false(shmExists());
+
+    // Detaching more often than attaching is harmless
+    mtcShmDetach();
+}
+
+static void
+mtcShmRemoveAtExit(void **state)
+{
+    mtcShmAttach();
+    mtcShmAttach();
+    assert_int_equal(publish("fs.read", 1, DELTA, 0), 0);
+    assert_true(shmExists());
+    mtcShmRemove();
+    assert_false(shmExists());
+
+    // And a new region starts from nothing
+    mtcShmAttach();
+    assert_int_equal(publish("fs.write", 1, DELTA, 0), 0);
+    mtcshm_hdr_t *hdr = shmOpen();
+    assert_non_null(hdr);
+    assert_int_equal(hdr->count, 1);
+    assert_null(shmFind(hdr, "fs.read", ""));
+    shmClose(hdr);
+    mtcShmDetach();
+    assert_false(shmExists());
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(mtcShmPublishNullEvent),
+        cmocka_unit_test(mtcShmPublishCreatesRegion),
+        cmocka_unit_test(mtcShmReplacesAPlantedFile),
+        cmocka_unit_test(mtcShmCountersAccumulate),
+        cmocka_unit_test(mtcShmTagsFollowVerbosity),
+        cmocka_unit_test(mtcShmFullRegionCountsDrops),
+        cmocka_unit_test(mtcShmOutlivesAReload),
+        cmocka_unit_test(mtcShmRemoveAtExit),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
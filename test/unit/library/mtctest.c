@@ -5,6 +5,7 @@
 
 #include "fn.h"
 #include "mtc.h"
+#include "mtcshm.h"
 #include "test.h"
 
 // These signatures satisfy --wrap=cfgLogStreamEnable in the Makefile
@@ -133,6 +134,39 @@ mtcFormatSetAndMtcSendEvent(void** state)
     mtcDestroy(&mtc);
 }
 
+static void
+mtcShmSetAndMtcSendEvent(void** state)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s%d", MTCSHM_PATH, getpid());
+    mtc_t* mtc = mtcCreate();
+    assert_non_null(mtc);
+    mtcFormatSet(mtc, mtcFormatCreate(CFG_FMT_STATSD));
+
+    mtcShmSet(mtc, TRUE);
+    transport_status_t status = mtcConnectionStatus(mtc);
+    assert_string_equal(status.configString, "shm");
+    assert_true(status.isConnected);
+
+    // Published in place of being sent
+    event_t e = INT_EVENT("A", 1, DELTA, NULL);
+    assert_int_equal(mtcSendMetric(mtc, &e), 0);
+    assert_int_equal(access(path, F_OK), 0);
+
+    // A transport takes its place
+    mtcTransportSet(mtc, transportCreateFile("/tmp/my.path", CFG_BUFFER_LINE));
+    assert_int_not_equal(access(path, F_OK), 0);
+    assert_int_equal(mtcSendMetric(mtc, &e), 0);
+    assert_int_not_equal(access(path, F_OK), 0);
+    if (unlink("/tmp/my.path"))
+        fail_msg("Couldn't delete file %s", "/tmp/my.path");
+
+    mtcShmSet(mtc, TRUE);
+    assert_int_equal(mtcSendMetric(mtc, &e), 0);
+    mtcDestroy(&mtc);
+    assert_int_not_equal(access(path, F_OK), 0);
+}
+
 
 int
 main(int argc, char* argv[])
@@ -148,6 +182,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(mtcSendForNullMessageDoesntCrash),
         cmocka_unit_test(mtcTransportSetAndMtcSend),
         cmocka_unit_test(mtcFormatSetAndMtcSendEvent),
+        cmocka_unit_test(mtcShmSetAndMtcSendEvent),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
@@ -39,6 +39,38 @@ osWritePermFailure(void **state) {
     scope_close(fd);
 }
 
+static void
+osMapsPageProtMatchesGetPageProt(void **state) {
+    size_t len = 4096 * 3;
+    char *addr = scope_mmap(NULL, len, PROT_READ | PROT_EXEC, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    assert_ptr_not_equal(addr, MAP_FAILED);
+    // split it into three mappings
+    assert_int_equal(scope_mprotect(addr + 4096, 4096, PROT_READ | PROT_WRITE), 0);
+
+    os_maps_t *maps = osMapsCreate();
+    assert_non_null(maps);
+    assert_int_equal(osMapsPageProt(maps, (uint64_t)addr), PROT_READ | PROT_EXEC);
+    assert_int_equal(osMapsPageProt(maps, (uint64_t)addr + 4096 + 8), PROT_READ | PROT_WRITE);
+    assert_int_equal(osMapsPageProt(maps, (uint64_t)addr + 4096 * 2), PROT_READ | PROT_EXEC);
+    assert_int_equal(osMapsPageProt(maps, (uint64_t)&len), osGetPageProt((uint64_t)&len));
+    assert_int_equal(osMapsPageProt(maps, 0), -1);
+    osMapsDestroy(&maps);
+    assert_null(maps);
+
+    // the snapshot doesn't see later changes
+    maps = osMapsCreate();
+    scope_munmap(addr, len);
+    assert_int_equal(osMapsPageProt(maps, (uint64_t)addr), PROT_READ | PROT_EXEC);
+    osMapsDestroy(&maps);
+    maps = osMapsCreate();
+    assert_int_equal(osMapsPageProt(maps, (uint64_t)addr), -1);
+    osMapsDestroy(&maps);
+
+    // without a snapshot, /proc/self/maps is read
+    assert_int_equal(osMapsPageProt(NULL, (uint64_t)&len), osGetPageProt((uint64_t)&len));
+    osMapsDestroy(NULL);
+}
+
 int
 main(int argc, char* argv[]) {
     printf("running %s\n", argv[0]);
@@ -49,6 +81,7 @@ main(int argc, char* argv[]) {
         cmocka_unit_test(osTestTimerStopNotInit),
         cmocka_unit_test(osWritePermSuccess),
         cmocka_unit_test(osWritePermFailure),
+        cmocka_unit_test(osMapsPageProtMatchesGetPageProt),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "pcrectx.h"
+#include "test.h"
+
+static pcre2_code *
+compile(const char *pattern)
+{
+    int err;
+    PCRE2_SIZE off;
+    return pcre2_compile_wrapper((PCRE2_SPTR)pattern, PCRE2_ZERO_TERMINATED, 0,
+                                 &err, &off, NULL);
+}
+
+static void
+pcreCtxCompilesForTheJit(void **state)
+{
+    pcre2_code *re = compile("^HTTP/1\\.[01] ([0-9]{3})");
+    assert_non_null(re);
+    size_t jitsize = 0;
+    assert_int_equal(pcre2_pattern_info(re, PCRE2_INFO_JITSIZE, &jitsize), 0);
+    assert_true(jitsize > 0);
+    pcre2_code_free(re);
+
+    regex_t preg;
+    assert_int_equal(regcomp_wrapper(&preg, "^fs\\.(open|close)$", REG_EXTENDED | REG_NOSUB), 0);
+    jitsize = 0;
+    assert_int_equal(pcre2_pattern_info(preg.re_pcre2_code, PCRE2_INFO_JITSIZE, &jitsize), 0);
+    assert_true(jitsize > 0);
+    regfree(&preg);
+
+    assert_int_not_equal(regcomp_wrapper(&preg, "(unbalanced", REG_EXTENDED), 0);
+    assert_null(compile("(unbalanced"));
+}
+
+static void
+pcreCtxIsKeptByTheThread(void **state)
+{
+    pcre_ctx_t *ctx = pcreCtxAcquire();
+    assert_non_null(ctx);
+    assert_non_null(pcreCtxStack(ctx));
+    assert_non_null(pcreCtxMatchContext(ctx));
+
+    // While it's in use, another comes from the pool
+    pcre_ctx_t *nested = pcreCtxAcquire();
+    assert_non_null(nested);
+    assert_ptr_not_equal(nested, ctx);
+    pcreCtxRelease(nested);
+    pcreCtxRelease(ctx);
+
+    assert_ptr_equal(pcreCtxAcquire(), ctx);
+    pcreCtxRelease(ctx);
+}
+
+static void
+pcreCtxMatchDataIsPerPattern(void **state)
+{
+    pcre2_code *one = compile("(a)(b)");
+    pcre2_code *two = compile("c");
+
+    pcre_ctx_t *ctx = pcreCtxAcquire();
+    pcre2_match_data *md = pcreCtxMatchData(ctx, one);
+    assert_non_null(md);
+    assert_true(pcre2_get_ovector_count(md) >= 3);
+    assert_ptr_equal(pcreCtxMatchData(ctx, one), md);
+    assert_ptr_not_equal(pcreCtxMatchData(ctx, two), md);
+    assert_int_equal(pcre2_match(one, (PCRE2_SPTR)"xab", 3, 0, 0, md,
+                                 pcreCtxMatchContext(ctx)), 3);
+    pcreCtxRelease(ctx);
+
+    // The thread's own block, until it's out; then one made for the occasion
+    pcre2_match_data *held = pcreMatchDataGet(one);
+    assert_ptr_equal(held, md);
+    pcre2_match_data *other = pcreMatchDataGet(one);
+    assert_non_null(other);
+    assert_ptr_not_equal(other, held);
+    pcreMatchDataPut(other);
+    pcreMatchDataPut(held);
+    assert_ptr_equal(pcreMatchDataGet(one), md);
+    pcreMatchDataPut(md);
+
+    // Many more patterns than are kept
+    int i;
+    for (i = 0; i < PCRE_CTX_PATTERNS * 2; i++) {
+        char pattern[32];
+        snprintf(pattern, sizeof(pattern), "x{%d}", i + 1);
+        pcre2_code *re = compile(pattern);
+        pcre2_match_data *md = pcreMatchDataGet(re);
+        assert_non_null(md);
+        pcreMatchDataPut(md);
+        pcre2_code_free(re);
+    }
+
+    pcreMatchDataPut(NULL);
+    assert_null(pcreMatchDataGet(NULL));
+    pcre2_code_free(one);
+    pcre2_code_free(two);
+}
+
+static void *
+acquireAndRelease(void *arg)
+{
+    pcre_ctx_t **ctx = arg;
+    *ctx = pcreCtxAcquire();
+    pcreCtxRelease(*ctx);
+    return NULL;
+}
+
+static void
+pcreCtxIsHandedOnWhenTheThreadIsGone(void **state)
+{
+    pcre_ctx_t *first = NULL, *second = NULL;
+    pthread_t thread;
+
+    assert_int_equal(pthread_create(&thread, NULL, acquireAndRelease, &first), 0);
+    pthread_join(thread, NULL);
+    assert_non_null(first);
+
+    assert_int_equal(pthread_create(&thread, NULL, acquireAndRelease, &second), 0);
+    pthread_join(thread, NULL);
+    assert_ptr_equal(second, first);
+}
+
+#define MATCH_THREADS 64
+
+static pcre2_code *g_shared;
+
+static void *
+matchALot(void *arg)
+{
+    long *matched = arg;
+    const char *subject = "HTTP/1.1 404 Not Found";
+    int i;
+    for (i = 0; i < 1000; i++) {
+        pcre_ctx_t *ctx = pcreCtxAcquire();
+        pcre2_match_data *md = pcreCtxMatchData(ctx, g_shared);
+        if ((pcre2_match(g_shared, (PCRE2_SPTR)subject, strlen(subject), 0, 0, md,
+                         pcreCtxMatchContext(ctx)) == 2) &&
+            (pcre2_get_ovector_pointer(md)[2] == 9)) {
+            (*matched)++;
+        }
+        pcreCtxRelease(ctx);
+    }
+    return NULL;
+}
+
+static void
+pcreCtxManyThreads(void **state)
+{
+    pthread_t threads[MATCH_THREADS];
+    long matched[MATCH_THREADS] = {0};
+    int i;
+
+    g_shared = compile("^HTTP/1\\.[01] ([0-9]{3})");
+    for (i = 0; i < MATCH_THREADS; i++) {
+        assert_int_equal(pthread_create(&threads[i], NULL, matchALot, &matched[i]), 0);
+    }
+    for (i = 0; i < MATCH_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        assert_int_equal(matched[i], 1000);
+    }
+    pcre2_code_free(g_shared);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(pcreCtxCompilesForTheJit),
+        cmocka_unit_test(pcreCtxIsKeptByTheThread),
+        cmocka_unit_test(pcreCtxMatchDataIsPerPattern),
+        cmocka_unit_test(pcreCtxIsHandedOnWhenTheThreadIsGone),
+        cmocka_unit_test(pcreCtxManyThreads),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
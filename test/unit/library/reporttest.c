@@ -33,6 +33,10 @@ int cmdSendEvent(ctl_t* ctl, event_t* event, uint64_t uit, proc_id_t* proc)
     memcpy(&evtBuf[evtBufNext++], event, sizeof(*event));
     if (evtBufNext >= BUFSIZE) fail();
 
+    // like the real one, this owns the event's data
+    if (event->data) cJSON_Delete(event->data);
+    evtBuf[evtBufNext - 1].data = NULL;
+
     return 0; //__real_cmdSendEvent(ctl, event, uid, proc);
 }
 
@@ -1317,6 +1321,92 @@ doDNSSendDNSSummarization(void** state)
     if(addr_list) freeaddrinfo(addr_list);
 }
 
+// A query for www.example.com, and a response to it
+static uint8_t dnsQuery[] = {
+    0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x03, 'w', 'w', 'w',
+    0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+    0x03, 'c', 'o', 'm', 0x00, 0x00, 0x01, 0x00,
+    0x01
+};
+static uint8_t dnsResponse[] = {
+    0x12, 0x34, 0x81, 0x80, 0x00, 0x01, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x00, 0x03, 'w', 'w', 'w',
+    0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+    0x03, 'c', 'o', 'm', 0x00, 0x00, 0x01, 0x00,
+    0x01,
+    0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+    0x00, 0x3c, 0x00, 0x04, 0x5d, 0xb8, 0xd8, 0x22,
+    0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+    0x00, 0x3c, 0x00, 0x04, 0x5d, 0xb8, 0xd8, 0x23,
+};
+
+static void
+dnsLookup(int fd, struct addrinfo *addr)
+{
+    doAccept(15, fd, addr->ai_addr, &addr->ai_addrlen, "acceptFunc");
+    getDNSName(fd, dnsQuery, sizeof(dnsQuery));
+    doSend(fd, sizeof(dnsQuery), NULL, sizeof(dnsQuery), BUF);
+    getDNSAnswer(fd, (char *)dnsResponse, sizeof(dnsResponse), BUF);
+    doRecv(fd, sizeof(dnsResponse), NULL, sizeof(dnsResponse), BUF);
+    doClose(fd, "closeFunc");
+}
+
+static void
+doDNSRecvDNSSummarization(void** state)
+{
+    struct addrinfo* addr_list = NULL;
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    if (getaddrinfo("localhost", "53", &hints, &addr_list) || !addr_list) {
+        fail();
+    }
+
+    setVerbosity(5);
+    addSock(15, SOCK_STREAM, 0);
+    doSetConnection(15, addr_list->ai_addr, addr_list->ai_addrlen, LOCAL);
+
+    // The first response for a name is reported
+    clearTestData();
+    dnsLookup(16, addr_list);
+    assert_int_equal(eventCalls("dns.req"), 2);
+    assert_int_equal(eventCalls("dns.resp"), 2);
+    assert_int_equal(eventValues("dns.resp"), 2);
+
+    // Ones with the same answers are counted, and reported per period
+    clearTestData();
+    dnsLookup(16, addr_list);
+    dnsLookup(17, addr_list);
+    assert_int_equal(eventCalls("dns.req"), 4);
+    assert_int_equal(eventCalls("dns.resp"), 0);
+    doDNSAgg();
+    assert_int_equal(eventCalls("dns.resp"), 2);
+    assert_int_equal(eventValues("dns.resp"), 2 * 2);
+    clearTestData();
+    doDNSAgg();
+    assert_int_equal(eventCalls("dns.resp"), 0);
+
+    // A different answer is reported
+    dnsResponse[sizeof(dnsResponse) - 1] = 0x24;
+    clearTestData();
+    dnsLookup(16, addr_list);
+    assert_int_equal(eventCalls("dns.resp"), 2);
+
+    // Without DNS summarization, every response is reported
+    setVerbosity(6);
+    clearTestData();
+    dnsLookup(16, addr_list);
+    dnsLookup(17, addr_list);
+    assert_int_equal(eventCalls("dns.resp"), 4);
+    doDNSAgg();
+    assert_int_equal(eventCalls("dns.resp"), 4);
+
+    doClose(15, "closeFunc");
+    if(addr_list) freeaddrinfo(addr_list);
+}
+
 static void
 doFSConnectionErrorNoSummarization(void** state)
 {
@@ -1704,6 +1794,7 @@ main(int argc, char* argv[])
 #endif // __linux__
         cmocka_unit_test(doDNSSendNoDNSSummarization),
         cmocka_unit_test(doDNSSendDNSSummarization),
+        cmocka_unit_test(doDNSRecvDNSSummarization),
         cmocka_unit_test(doFSConnectionErrorNoSummarization),
         cmocka_unit_test(doFSConnectionErrorSummarization),
         cmocka_unit_test(doNetConnectionErrorNoSummarization),
@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dbg.h"
+#include "spill.h"
+#include "scopestdlib.h"
+#include "test.h"
+
+// What's been replayed, as a receiver would see it
+typedef struct {
+    char out[64 * 1024];
+    size_t out_len;
+    int sends;
+    int fail_after;     // sends that succeed before they fail, if set
+} receiver_t;
+
+static char dir[] = "/tmp/spilltest.XXXXXX";
+
+static int
+receive(void *arg, const char *msg, size_t len)
+{
+    receiver_t *r = arg;
+    if (r->fail_after && (r->sends >= r->fail_after)) return -1;
+    r->sends++;
+
+    assert_true(r->out_len + len <= sizeof(r->out));
+    memcpy(r->out + r->out_len, msg, len);
+    r->out_len += len;
+    return 0;
+}
+
+static int
+dirEntries(void)
+{
+    int count = 0;
+    DIR *d = opendir(dir);
+    assert_non_null(d);
+    struct dirent *ent;
+    while ((ent = readdir(d))) {
+        if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, "..")) count++;
+    }
+    closedir(d);
+    return count;
+}
+
+static int
+spillSetup(void **state)
+{
+    if (!mkdtemp(dir)) return -1;
+    return groupSetup(state);
+}
+
+static int
+spillTeardown(void **state)
+{
+    rmdir(dir);
+    return groupTeardown(state);
+}
+
+static void
+spillCreateReturnsNullWithoutDir(void **state)
+{
+    assert_null(spillCreate(NULL, 1024, 0));
+    assert_null(spillCreate("", 1024, 0));
+    assert_null(spillCreate(dir, 0, 0));
+
+    spill_t *s = spillCreate(dir, 1024, 0);
+    assert_non_null(s);
+    assert_true(spillEmpty(s));
+    spillDestroy(&s);
+    assert_null(s);
+
+    // Doesn't crash
+    spillDestroy(NULL);
+    spillDestroy(&s);
+}
+
+static void
+spillNullArgs(void **state)
+{
+    receiver_t r = {0};
+    spill_t *s = spillCreate(dir, 1024, 0);
+
+    assert_int_equal(spillAppend(NULL, "hey", 3), -1);
+    assert_int_equal(spillAppend(s, NULL, 3), -1);
+    assert_int_equal(spillDrain(NULL, receive, &r), -1);
+    assert_int_equal(spillDrain(s, NULL, &r), -1);
+    assert_true(spillEmpty(NULL));
+    spillReset(NULL);
+    spill_stats_t stats = spillStats(NULL);
+    assert_int_equal(stats.spilled, 0);
+    assert_int_equal(stats.pending, 0);
+
+    spillDestroy(&s);
+}
+
+static void
+spillDrainReplaysInOrder(void **state)
+{
+    receiver_t r = {0};
+    spill_t *s = spillCreate(dir, 64 * 1024, 0);
+
+    char msg[64];
+    size_t total = 0;
+    int i;
+    for (i = 0; i < 100; i++) {
+        int len = snprintf(msg, sizeof(msg), "{\"seq\":%d}\n", i);
+        assert_int_equal(spillAppend(s, msg, len), 0);
+        total += len;
+    }
+    assert_false(spillEmpty(s));
+
+    // The files are unlinked as soon as they're made
+    assert_int_equal(dirEntries(), 0);
+
+    spill_stats_t stats = spillStats(s);
+    assert_int_equal(stats.spilled, total);
+    assert_int_equal(stats.pending, total);
+    assert_int_equal(stats.dropped, 0);
+
+    assert_int_equal(spillDrain(s, receive, &r), 0);
+    assert_int_equal(r.sends, 100);
+    assert_int_equal(r.out_len, total);
+    char *pos = r.out;
+    for (i = 0; i < 100; i++) {
+        int len = snprintf(msg, sizeof(msg), "{\"seq\":%d}\n", i);
+        assert_memory_equal(pos, msg, len);
+        pos += len;
+    }
+
+    assert_true(spillEmpty(s));
+    stats = spillStats(s);
+    assert_int_equal(stats.replayed, total);
+    assert_int_equal(stats.pending, 0);
+
+    // Nothing more to send
+    assert_int_equal(spillDrain(s, receive, &r), 0);
+    assert_int_equal(r.sends, 100);
+
+    spillDestroy(&s);
+}
+
+static void
+spillDrainKeepsWhatFailedToSend(void **state)
+{
+    receiver_t r = {.fail_after = 2};
+    spill_t *s = spillCreate(dir, 64 * 1024, 0);
+
+    assert_int_equal(spillAppend(s, "one\n", 4), 0);
+    assert_int_equal(spillAppend(s, "two\n", 4), 0);
+    assert_int_equal(spillAppend(s, "three\n", 6), 0);
+
+    assert_int_equal(spillDrain(s, receive, &r), -1);
+    assert_int_equal(r.out_len, 8);
+    assert_memory_equal(r.out, "one\ntwo\n", 8);
+    assert_int_equal(spillStats(s).pending, 6);
+
+    // Appended after what failed, in a new segment
+    assert_int_equal(spillAppend(s, "four\n", 5), 0);
+
+    r.fail_after = 0;
+    assert_int_equal(spillDrain(s, receive, &r), 0);
+    assert_int_equal(r.out_len, 19);
+    assert_memory_equal(r.out, "one\ntwo\nthree\nfour\n", 19);
+    assert_true(spillEmpty(s));
+
+    spillDestroy(&s);
+}
+
+static void
+spillDropsOldestWhenFull(void **state)
+{
+    receiver_t r = {0};
+    size_t maxsize = 8 * 1024;
+    spill_t *s = spillCreate(dir, maxsize, 0);
+
+    // Too big to ever fit
+    char *big = calloc(1, maxsize);
+    assert_non_null(big);
+    assert_int_equal(spillAppend(s, big, maxsize), -1);
+    assert_int_equal(spillStats(s).dropped, maxsize);
+    free(big);
+
+    char msg[100];
+    int i;
+    for (i = 0; i < 1000; i++) {
+        memset(msg, 'a' + (i % 26), sizeof(msg));
+        snprintf(msg, sizeof(msg), "%04d", i);
+        msg[sizeof(msg) - 1] = '\n';
+        assert_int_equal(spillAppend(s, msg, sizeof(msg)), 0);
+    }
+
+    spill_stats_t stats = spillStats(s);
+    assert_true(stats.pending <= maxsize);
+    assert_int_equal(stats.spilled, 1000 * sizeof(msg));
+    assert_int_equal(stats.spilled, stats.pending + stats.dropped - maxsize);
+
+    // What's left is the newest, in order
+    assert_int_equal(spillDrain(s, receive, &r), 0);
+    assert_int_equal(r.out_len, stats.pending);
+    int first = 1000 - r.sends;
+    for (i = 0; i < r.sends; i++) {
+        char seq[5];
+        snprintf(seq, sizeof(seq), "%04d", first + i);
+        assert_memory_equal(r.out + i * sizeof(msg), seq, 4);
+    }
+
+    spillDestroy(&s);
+}
+
+static void
+spillDrainIsRateLimited(void **state)
+{
+    receiver_t r = {0};
+    spill_t *s = spillCreate(dir, 64 * 1024, 1000);
+
+    char msg[500];
+    memset(msg, 'x', sizeof(msg));
+    int i;
+    for (i = 0; i < 10; i++) {
+        assert_int_equal(spillAppend(s, msg, sizeof(msg)), 0);
+    }
+
+    // A second's worth to start with
+    assert_int_equal(spillDrain(s, receive, &r), 0);
+    assert_int_equal(r.sends, 2);
+
+    // Then no more than what's been earned since, give or take a message
+    assert_int_equal(spillDrain(s, receive, &r), 0);
+    assert_int_equal(spillDrain(s, receive, &r), 0);
+    assert_true(r.sends <= 3);
+    assert_false(spillEmpty(s));
+
+    spillDestroy(&s);
+}
+
+static void
+spillResetDiscardsEverything(void **state)
+{
+    receiver_t r = {0};
+    spill_t *s = spillCreate(dir, 64 * 1024, 0);
+
+    assert_int_equal(spillAppend(s, "one\n", 4), 0);
+    spillReset(s);
+    assert_true(spillEmpty(s));
+
+    assert_int_equal(spillAppend(s, "two\n", 4), 0);
+    assert_int_equal(spillDrain(s, receive, &r), 0);
+    assert_int_equal(r.out_len, 4);
+    assert_memory_equal(r.out, "two\n", 4);
+
+    spillDestroy(&s);
+}
+
+static void
+spillAppendDropsWithoutDir(void **state)
+{
+    spill_t *s = spillCreate("/tmp/spilltest/does/not/exist", 64 * 1024, 0);
+    assert_non_null(s);
+
+    assert_int_equal(spillAppend(s, "one\n", 4), -1);
+    assert_true(spillEmpty(s));
+    assert_int_equal(spillStats(s).dropped, 4);
+    assert_int_equal(dbgCountMatchingLines("src/spill.c"), 1);
+    dbgInit(); // reset dbg for the rest of the tests
+
+    spillDestroy(&s);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(spillCreateReturnsNullWithoutDir),
+        cmocka_unit_test(spillNullArgs),
+        cmocka_unit_test(spillDrainReplaysInOrder),
+        cmocka_unit_test(spillDrainKeepsWhatFailedToSend),
+        cmocka_unit_test(spillDropsOldestWhenFull),
+        cmocka_unit_test(spillDrainIsRateLimited),
+        cmocka_unit_test(spillResetDiscardsEverything),
+        cmocka_unit_test(spillAppendDropsWithoutDir),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, spillSetup, spillTeardown);
+}
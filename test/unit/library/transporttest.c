@@ -9,12 +9,14 @@
 #include <sys/un.h>
 #include <unistd.h>
 
+#include "backoff.h"
 #include "fn.h"
 #include "dbg.h"
 #include "scopestdlib.h"
 #include "scopetypes.h"
 #include "transport.h"
 #include "test.h"
+#include "zstd.h"
 
 static void
 transportCreateTcpReturnsNullPtrForNullHostOrPath(void** state)
@@ -336,6 +338,253 @@ transportSendForAbstractUnixTransmitsMsg(void** state)
     scope_close(sd);
 }
 
+static void
+transportSendForCompressedUnixTransmitsMsgOnFlush(void** state)
+{
+    const char* path = "@mytestcompressedsockname";
+
+    struct sockaddr_un addr;
+    addr.sun_family = AF_UNIX;
+    scope_memset(addr.sun_path, 0, sizeof(addr.sun_path));
+    scope_strncpy(addr.sun_path, path, scope_strlen(path));
+    addr.sun_path[0] = 0;
+    int addr_len = sizeof(sa_family_t) + scope_strlen(path);
+
+    int sd = scope_socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sd == -1) {
+        fail_msg("Couldn't create socket");
+    }
+    if (scope_bind(sd, (const struct sockaddr *)&addr, addr_len) == -1) {
+        fail_msg("Couldn't bind socket");
+    }
+    if (scope_listen(sd, 10) == -1) {
+        fail_msg("Couldn't listen on socket");
+    }
+
+    transport_t* t = transportCreateUnix(path);
+    assert_non_null(t);
+    assert_int_equal(transportCompressSet(t, CFG_COMPRESS_ZSTD), 0);
+    assert_false(transportNeedsConnection(t));
+    int rx_sock = scope_accept(sd, NULL, NULL);
+    assert_true(rx_sock != -1);
+
+    // Nothing is sent until it's flushed
+    const char msg[] = "This is the payload message to transfer.\n";
+    int i;
+    for (i = 0; i < 10; i++) {
+        assert_int_equal(transportSend(t, msg, scope_strlen(msg)), 0);
+    }
+    char buf[4096];
+    assert_int_equal(scope_recv(rx_sock, buf, sizeof(buf), MSG_DONTWAIT), -1);
+    assert_int_equal(transportFlush(t), 0);
+
+    int byteCount = scope_recv(rx_sock, buf, sizeof(buf), 0);
+    assert_true(byteCount > 0);
+    assert_true(byteCount < 10 * scope_strlen(msg));
+    assert_int_equal(*(uint32_t *)buf, ZSTD_MAGICNUMBER);
+
+    char out[sizeof(buf)];
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    ZSTD_inBuffer in = {buf, byteCount, 0};
+    ZSTD_outBuffer outb = {out, sizeof(out), 0};
+    assert_false(ZSTD_isError(ZSTD_decompressStream(dctx, &outb, &in)));
+    assert_int_equal(outb.pos, 10 * scope_strlen(msg));
+    for (i = 0; i < 10; i++) {
+        assert_memory_equal(out + i * scope_strlen(msg), msg, scope_strlen(msg));
+    }
+    ZSTD_freeDCtx(dctx);
+
+    transport_status_t status = transportConnectionStatus(t);
+    assert_true(status.compressed);
+    assert_int_equal(status.uncompressedBytes, 10 * scope_strlen(msg));
+    assert_int_equal(status.compressedBytes, byteCount);
+
+    // Compression is only for connections
+    transport_t* f = transportCreateFile("/tmp/compressed.log", CFG_BUFFER_LINE);
+    assert_int_equal(transportCompressSet(f, CFG_COMPRESS_ZSTD), -1);
+    assert_int_equal(dbgCountMatchingLines("src/transport.c"), 1);
+    dbgInit(); // reset dbg for the rest of the tests
+    transportDestroy(&f);
+    scope_unlink("/tmp/compressed.log");
+
+    transportDestroy(&t);
+    scope_close(rx_sock);
+    scope_close(sd);
+}
+
+static void
+transportSendForSpillingUnixReplaysAfterReconnect(void** state)
+{
+    const char* path = "@mytestspillsockname";
+
+    struct sockaddr_un addr;
+    addr.sun_family = AF_UNIX;
+    scope_memset(addr.sun_path, 0, sizeof(addr.sun_path));
+    scope_strncpy(addr.sun_path, path, scope_strlen(path));
+    addr.sun_path[0] = 0;
+    int addr_len = sizeof(sa_family_t) + scope_strlen(path);
+
+    int sd = scope_socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sd == -1) {
+        fail_msg("Couldn't create socket");
+    }
+    if (scope_bind(sd, (const struct sockaddr *)&addr, addr_len) == -1) {
+        fail_msg("Couldn't bind socket");
+    }
+    if (scope_listen(sd, 10) == -1) {
+        fail_msg("Couldn't listen on socket");
+    }
+
+    transport_t* t = transportCreateUnix(path);
+    assert_non_null(t);
+    assert_int_equal(transportSpillSet(t, "/tmp", 64 * 1024, 0), 0);
+    assert_true(transportSpills(t));
+    int rx_sock = scope_accept(sd, NULL, NULL);
+    assert_true(rx_sock != -1);
+    scope_close(rx_sock);
+
+    // Spilled while there's no connection
+    transportDisconnect(t);
+    assert_int_equal(transportSend(t, "one\n", 4), 0);
+    assert_int_equal(transportSend(t, "two\n", 4), 0);
+    assert_true(transportSpilled(t));
+    transport_status_t status = transportConnectionStatus(t);
+    assert_true(status.spilling);
+    assert_int_equal(status.spillPendingBytes, 8);
+
+    assert_int_equal(transportConnect(t), 1);
+    rx_sock = scope_accept(sd, NULL, NULL);
+    assert_true(rx_sock != -1);
+
+    // Ahead of what's spilled, e.g. for what comes first on a connection
+    assert_int_equal(transportSendAhead(t, "hello\n", 6), 0);
+
+    // Behind what's spilled, until it's been replayed
+    assert_int_equal(transportSend(t, "three\n", 6), 0);
+    char buf[4096];
+    int byteCount = scope_recv(rx_sock, buf, sizeof(buf), 0);
+    assert_int_equal(byteCount, 6);
+    assert_memory_equal(buf, "hello\n", 6);
+    assert_int_equal(scope_recv(rx_sock, buf, sizeof(buf), MSG_DONTWAIT), -1);
+
+    transportFlush(t);
+    assert_false(transportSpilled(t));
+    byteCount = scope_recv(rx_sock, buf, sizeof(buf), 0);
+    assert_int_equal(byteCount, 14);
+    assert_memory_equal(buf, "one\ntwo\nthree\n", 14);
+
+    // And sent as it's sent from then on
+    assert_int_equal(transportSend(t, "four\n", 5), 0);
+    byteCount = scope_recv(rx_sock, buf, sizeof(buf), 0);
+    assert_int_equal(byteCount, 5);
+    assert_memory_equal(buf, "four\n", 5);
+
+    // Spilling is only for connections
+    transport_t* f = transportCreateFile("/tmp/spilled.log", CFG_BUFFER_LINE);
+    assert_false(transportSpills(f));
+    assert_int_equal(transportSpillSet(f, "/tmp", 64 * 1024, 0), -1);
+    assert_int_equal(dbgCountMatchingLines("src/transport.c"), 1);
+    dbgInit(); // reset dbg for the rest of the tests
+    transportDestroy(&f);
+    scope_unlink("/tmp/spilled.log");
+
+    transportDestroy(&t);
+    scope_close(rx_sock);
+    scope_close(sd);
+}
+
+static void
+transportSendForCompressedSpillingUnixReplaysFailedFlush(void** state)
+{
+    const char* path = "@mytestcompressedspillsockname";
+
+    struct sockaddr_un addr;
+    addr.sun_family = AF_UNIX;
+    scope_memset(addr.sun_path, 0, sizeof(addr.sun_path));
+    scope_strncpy(addr.sun_path, path, scope_strlen(path));
+    addr.sun_path[0] = 0;
+    int addr_len = sizeof(sa_family_t) + scope_strlen(path);
+
+    int sd = scope_socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sd == -1) {
+        fail_msg("Couldn't create socket");
+    }
+    if (scope_bind(sd, (const struct sockaddr *)&addr, addr_len) == -1) {
+        fail_msg("Couldn't bind socket");
+    }
+    if (scope_listen(sd, 10) == -1) {
+        fail_msg("Couldn't listen on socket");
+    }
+
+    transport_t* t = transportCreateUnix(path);
+    assert_non_null(t);
+    assert_int_equal(transportCompressSet(t, CFG_COMPRESS_ZSTD), 0);
+    assert_int_equal(transportSpillSet(t, "/tmp", 64 * 1024, 0), 0);
+    int rx_sock = scope_accept(sd, NULL, NULL);
+    assert_true(rx_sock != -1);
+
+    // Compressed, then the receiver stops reading before it's flushed
+    assert_int_equal(transportSendAhead(t, "start1\n", 7), 0);
+    assert_int_equal(transportSend(t, "one\n", 4), 0);
+    assert_int_equal(transportSend(t, "two\n", 4), 0);
+    assert_false(transportSpilled(t));
+    assert_int_equal(scope_shutdown(rx_sock, SHUT_RD), 0);
+
+    // The failed send makes a new connection, and what it was is kept
+    // for it, behind what's spilled from then on
+    uint64_t connections = transportConnections(t);
+    assert_int_equal(transportFlush(t), -1);
+    assert_int_equal(transportConnections(t), connections + 1);
+    assert_false(transportSpilled(t));
+    transport_status_t status = transportConnectionStatus(t);
+    assert_int_equal(status.uncompressedBytes, 0);
+    assert_int_equal(dbgCountMatchingLines("src/transport.c"), 1);
+    dbgInit(); // reset dbg for the rest of the tests
+    scope_close(rx_sock);
+    rx_sock = scope_accept(sd, NULL, NULL);
+    assert_true(rx_sock != -1);
+    scope_close(rx_sock);
+
+    // Spilled while there's no connection, and behind what's spilled after
+    transportDisconnect(t);
+    assert_int_equal(transportSend(t, "three\n", 6), 0);
+    assert_true(transportSpilled(t));
+    assert_int_equal(transportConnect(t), 1);
+    rx_sock = scope_accept(sd, NULL, NULL);
+    assert_true(rx_sock != -1);
+    assert_int_equal(transportSendAhead(t, "start2\n", 7), 0);
+    assert_int_equal(transportSend(t, "four\n", 5), 0);
+    status = transportConnectionStatus(t);
+    assert_int_equal(status.spillPendingBytes, 11);
+
+    // Replayed in a new frame on the new connection, in the order it was
+    // sent, behind what comes first on it and without what came first on
+    // the connection it failed on
+    assert_int_equal(transportFlush(t), 0);
+    assert_false(transportSpilled(t));
+    char buf[4096];
+    int byteCount = scope_recv(rx_sock, buf, sizeof(buf), 0);
+    assert_true(byteCount > 0);
+    assert_int_equal(*(uint32_t *)buf, ZSTD_MAGICNUMBER);
+
+    char out[sizeof(buf)];
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    ZSTD_inBuffer in = {buf, byteCount, 0};
+    ZSTD_outBuffer outb = {out, sizeof(out), 0};
+    assert_false(ZSTD_isError(ZSTD_decompressStream(dctx, &outb, &in)));
+    assert_int_equal(outb.pos, 26);
+    assert_memory_equal(out, "start2\none\ntwo\nthree\nfour\n", 26);
+    ZSTD_freeDCtx(dctx);
+
+    status = transportConnectionStatus(t);
+    assert_int_equal(status.uncompressedBytes, 26);
+    assert_int_equal(status.spillDroppedBytes, 0);
+
+    transportDestroy(&t);
+    scope_close(rx_sock);
+    scope_close(sd);
+}
+
 static void
 transportSendForFilepathUnixTransmitsMsg(void** state)
 {
@@ -609,6 +858,12 @@ transportConnectionStatusInitialValues(void ** state)
     assert_false(status.isConnected);
     assert_int_equal(status.connectAttemptCount, 1);
     assert_string_equal(status.failureString, "Socket connection failed");
+    // and isn't retried until the backoff allows
+    assert_in_range(status.backoffDelayMs, BACKOFF_BASE_MS, 3 * BACKOFF_BASE_MS);
+    assert_in_range(status.nextConnectMs, 1, status.backoffDelayMs);
+    assert_int_equal(transportConnect(t), 0);
+    status = transportConnectionStatus(t);
+    assert_int_equal(status.connectAttemptCount, 1);
     transportDestroy(&t);
 
     // Udp
@@ -738,6 +993,9 @@ main(int argc, char* argv[])
         cmocka_unit_test(transportSendForNullMessageDoesNothing),
         cmocka_unit_test(transportSendForUdpTransmitsMsg),
         cmocka_unit_test(transportSendForAbstractUnixTransmitsMsg),
+        cmocka_unit_test(transportSendForCompressedUnixTransmitsMsgOnFlush),
+        cmocka_unit_test(transportSendForSpillingUnixReplaysAfterReconnect),
+        cmocka_unit_test(transportSendForCompressedSpillingUnixReplaysFailedFlush),
         cmocka_unit_test(transportSendForFilepathUnixTransmitsMsg),
         cmocka_unit_test(transportSendForFilepathUnixFailedTransmitsMsg),
         cmocka_unit_test(transportSendForFileWritesToFileAfterFlushWhenFullyBuffered),